@@ -167,6 +167,9 @@ app_run (const gchar         *full_prog_name,
       filenames = NULL;
     }
 
+  /*  must happen before any operation class picks its pixel functions  */
+  gimp_cpu_accel_set_use (use_cpu_accel);
+
   /*  Create an instance of the "Gimp" object which is the root of the
    *  core object system
    */
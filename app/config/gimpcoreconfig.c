@@ -91,6 +91,7 @@ enum
   PROP_DEFAULT_IMAGE,
   PROP_DEFAULT_GRID,
   PROP_UNDO_LEVELS,
+  PROP_UNDO_LEVELS_MAX,
   PROP_UNDO_SIZE,
   PROP_UNDO_PREVIEW_SIZE,
   PROP_PLUG_IN_HISTORY_SIZE,
@@ -103,6 +104,7 @@ enum
   PROP_COLOR_PROFILE_POLICY,
   PROP_SAVE_DOCUMENT_HISTORY,
   PROP_QUICK_MASK_COLOR,
+  PROP_XCF_LAZY_LOAD,
 
   /* ignored, only for backward compatibility: */
   PROP_INSTALL_COLORMAP,
@@ -377,6 +379,11 @@ gimp_core_config_class_init (GimpCoreConfigClass *klass)
                                 0, 1 << 20, 5,
                                 GIMP_PARAM_STATIC_STRINGS |
                                 GIMP_CONFIG_PARAM_CONFIRM);
+  GIMP_CONFIG_INSTALL_PROP_INT (object_class, PROP_UNDO_LEVELS_MAX,
+                                "undo-levels-max", UNDO_LEVELS_MAX_BLURB,
+                                1, 1 << 20, 1024,
+                                GIMP_PARAM_STATIC_STRINGS |
+                                GIMP_CONFIG_PARAM_CONFIRM);
 
   undo_size = gimp_get_physical_memory_size ();
 
@@ -448,6 +455,10 @@ gimp_core_config_class_init (GimpCoreConfigClass *klass)
                                 "quick-mask-color", QUICK_MASK_COLOR_BLURB,
                                 TRUE, &red,
                                 GIMP_PARAM_STATIC_STRINGS);
+  GIMP_CONFIG_INSTALL_PROP_BOOLEAN (object_class, PROP_XCF_LAZY_LOAD,
+                                    "xcf-lazy-load", XCF_LAZY_LOAD_BLURB,
+                                    FALSE,
+                                    GIMP_PARAM_STATIC_STRINGS);
 
   /*  only for backward compatibility:  */
   GIMP_CONFIG_INSTALL_PROP_BOOLEAN (object_class, PROP_INSTALL_COLORMAP,
@@ -685,6 +696,9 @@ gimp_core_config_set_property (GObject      *object,
     case PROP_UNDO_LEVELS:
       core_config->levels_of_undo = g_value_get_int (value);
       break;
+    case PROP_UNDO_LEVELS_MAX:
+      core_config->max_levels_of_undo = g_value_get_int (value);
+      break;
     case PROP_UNDO_SIZE:
       core_config->undo_size = g_value_get_uint64 (value);
       break;
@@ -721,6 +735,9 @@ gimp_core_config_set_property (GObject      *object,
     case PROP_QUICK_MASK_COLOR:
       gimp_value_get_rgb (value, &core_config->quick_mask_color);
       break;
+    case PROP_XCF_LAZY_LOAD:
+      core_config->xcf_lazy_load = g_value_get_boolean (value);
+      break;
 
     case PROP_INSTALL_COLORMAP:
     case PROP_MIN_COLORS:
@@ -857,6 +874,9 @@ gimp_core_config_get_property (GObject    *object,
     case PROP_UNDO_LEVELS:
       g_value_set_int (value, core_config->levels_of_undo);
       break;
+    case PROP_UNDO_LEVELS_MAX:
+      g_value_set_int (value, core_config->max_levels_of_undo);
+      break;
     case PROP_UNDO_SIZE:
       g_value_set_uint64 (value, core_config->undo_size);
       break;
@@ -890,6 +910,9 @@ gimp_core_config_get_property (GObject    *object,
     case PROP_QUICK_MASK_COLOR:
       gimp_value_set_rgb (value, &core_config->quick_mask_color);
       break;
+    case PROP_XCF_LAZY_LOAD:
+      g_value_set_boolean (value, core_config->xcf_lazy_load);
+      break;
 
     case PROP_INSTALL_COLORMAP:
     case PROP_MIN_COLORS:
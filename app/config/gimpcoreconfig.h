@@ -76,6 +76,7 @@ struct _GimpCoreConfig
   GimpTemplate           *default_image;
   GimpGrid               *default_grid;
   gint                    levels_of_undo;
+  gint                    max_levels_of_undo;
   guint64                 undo_size;
   GimpViewSize            undo_preview_size;
   gint                    plug_in_history_size;
@@ -88,6 +89,7 @@ struct _GimpCoreConfig
   GimpColorProfilePolicy  color_profile_policy;
   gboolean                save_document_history;
   GimpRGB                 quick_mask_color;
+  gboolean                xcf_lazy_load;
 };
 
 struct _GimpCoreConfigClass
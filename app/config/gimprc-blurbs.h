@@ -445,6 +445,10 @@ N_("When enabled, GIMP will not save an image if it has not been changed " \
 N_("Sets the minimal number of operations that can be undone. More undo " \
    "levels are kept available until the undo-size limit is reached.")
 
+#define UNDO_LEVELS_MAX_BLURB \
+N_("Sets the maximal number of operations that are kept on the undo " \
+   "stack, even if the undo-size limit is not reached yet.")
+
 #define UNDO_SIZE_BLURB \
 N_("Sets an upper limit to the memory that is used per image to keep " \
    "operations on the undo stack. Regardless of this setting, at least " \
@@ -464,6 +468,10 @@ N_("When enabled, pressing F1 will open the help browser.")
 "The location of the online user manual. This is used if " \
 "'user-manual-online' is enabled."
 
+#define XCF_LAZY_LOAD_BLURB \
+"When enabled, the pixels of XCF files are read from disk only when " \
+"they are first needed, instead of when the file is opened."
+
 #define ZOOM_QUALITY_BLURB \
 "There's a tradeoff between speed and quality of the zoomed-out display."
 
@@ -237,6 +237,9 @@ typedef gboolean (* GimpObjectFilterFunc)  (const GimpObject *object,
 typedef gint64   (* GimpMemsizeFunc)       (gpointer          instance,
                                             gint64           *gui_size);
 
+typedef void     (* GimpUndoBufferFunc)    (GeglBuffer      **buffer,
+                                            gpointer          user_data);
+
 
 /*  structs  */
 
@@ -0,0 +1,363 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-parallel.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+
+#include "core-types.h"
+
+#include "config/gimpgeglconfig.h"
+
+#include "gimp.h"
+#include "gimp-parallel.h"
+
+
+typedef struct
+{
+  GimpParallelDistributeFunc  func;
+  gpointer                    user_data;
+  gint                        n;
+  gint                        remaining;
+  GMutex                      mutex;
+  GCond                       cond;
+} GimpParallelTask;
+
+typedef struct
+{
+  GimpParallelTask *task;
+  gint              i;
+} GimpParallelItem;
+
+typedef struct
+{
+  GimpParallelDistributeRangeFunc  func;
+  gpointer                         user_data;
+  gsize                            size;
+} GimpParallelRangeData;
+
+typedef struct
+{
+  GimpParallelDistributeAreaFunc  func;
+  gpointer                        user_data;
+  const GeglRectangle            *area;
+  gboolean                        split_rows;
+} GimpParallelAreaData;
+
+
+/*  local function prototypes  */
+
+static void   gimp_parallel_notify_num_processors (GimpGeglConfig *config);
+static void   gimp_parallel_set_n_threads         (gint            n_threads);
+static void   gimp_parallel_worker                (gpointer        data,
+                                                   gpointer        user_data);
+static void   gimp_parallel_range_func            (gint            i,
+                                                   gint            n,
+                                                   gpointer        user_data);
+static void   gimp_parallel_area_func             (gint            i,
+                                                   gint            n,
+                                                   gpointer        user_data);
+
+
+/*  local variables  */
+
+static GThreadPool *parallel_pool      = NULL;
+static gint         parallel_n_threads = 1;
+
+/*  set while a thread runs a part of a distributed task, nested
+ *  distributions run serially on that thread
+ */
+static GPrivate     parallel_busy      = G_PRIVATE_INIT (NULL);
+
+
+/*  public functions  */
+
+void
+gimp_parallel_init (Gimp *gimp)
+{
+  GimpGeglConfig *config;
+
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  config = GIMP_GEGL_CONFIG (gimp->config);
+
+  gimp_parallel_set_n_threads (config->num_processors);
+
+  g_signal_connect (config, "notify::num-processors",
+                    G_CALLBACK (gimp_parallel_notify_num_processors),
+                    NULL);
+}
+
+void
+gimp_parallel_exit (Gimp *gimp)
+{
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  g_signal_handlers_disconnect_by_func (gimp->config,
+                                        gimp_parallel_notify_num_processors,
+                                        NULL);
+
+  if (parallel_pool)
+    {
+      g_thread_pool_free (parallel_pool, FALSE, TRUE);
+      parallel_pool = NULL;
+    }
+
+  parallel_n_threads = 1;
+}
+
+gint
+gimp_parallel_get_n_threads (void)
+{
+  return parallel_n_threads;
+}
+
+/**
+ * gimp_parallel_distribute:
+ * @max_n:     the maximal number of parts to split the work into
+ * @func:      the function to call for each part
+ * @user_data: user data passed to @func
+ *
+ * Calls @func for i = 0 .. n - 1, where n is the smaller of @max_n
+ * and the number of threads configured by GimpGeglConfig:num-processors,
+ * running the calls concurrently on the worker pool and the calling
+ * thread. Returns after all calls have finished.
+ *
+ * When called from inside another distributed function, @func is
+ * called once, with n = 1, on the current thread.
+ **/
+void
+gimp_parallel_distribute (gint                       max_n,
+                          GimpParallelDistributeFunc func,
+                          gpointer                   user_data)
+{
+  GimpParallelTask  task;
+  GimpParallelItem *items;
+  gint              i;
+
+  g_return_if_fail (func != NULL);
+
+  if (max_n <= 0)
+    return;
+
+  task.n = MIN (max_n, parallel_n_threads);
+
+  if (task.n == 1 || ! parallel_pool || g_private_get (&parallel_busy))
+    {
+      func (0, 1, user_data);
+
+      return;
+    }
+
+  task.func      = func;
+  task.user_data = user_data;
+  task.remaining = task.n - 1;
+
+  g_mutex_init (&task.mutex);
+  g_cond_init (&task.cond);
+
+  items = g_newa (GimpParallelItem, task.n);
+
+  for (i = 1; i < task.n; i++)
+    {
+      items[i].task = &task;
+      items[i].i    = i;
+
+      g_thread_pool_push (parallel_pool, &items[i], NULL);
+    }
+
+  g_private_set (&parallel_busy, GINT_TO_POINTER (TRUE));
+
+  func (0, task.n, user_data);
+
+  g_private_set (&parallel_busy, NULL);
+
+  g_mutex_lock (&task.mutex);
+
+  while (task.remaining > 0)
+    g_cond_wait (&task.cond, &task.mutex);
+
+  g_mutex_unlock (&task.mutex);
+
+  g_cond_clear (&task.cond);
+  g_mutex_clear (&task.mutex);
+}
+
+/**
+ * gimp_parallel_distribute_range:
+ * @size:         the size of the range
+ * @min_sub_size: the minimal size of a sub-range, or 0
+ * @func:         the function to call for each sub-range
+ * @user_data:    user data passed to @func
+ *
+ * Splits the range [0, @size) into consecutive sub-ranges of at least
+ * @min_sub_size elements and calls @func for each of them through
+ * gimp_parallel_distribute().
+ **/
+void
+gimp_parallel_distribute_range (gsize                           size,
+                                gsize                           min_sub_size,
+                                GimpParallelDistributeRangeFunc func,
+                                gpointer                        user_data)
+{
+  GimpParallelRangeData data;
+  gsize                 max_n;
+
+  g_return_if_fail (func != NULL);
+
+  if (size == 0)
+    return;
+
+  max_n = size;
+
+  if (min_sub_size > 1)
+    max_n /= min_sub_size;
+
+  max_n = CLAMP (max_n, 1, G_MAXINT);
+
+  data.func      = func;
+  data.user_data = user_data;
+  data.size      = size;
+
+  gimp_parallel_distribute (max_n, gimp_parallel_range_func, &data);
+}
+
+/**
+ * gimp_parallel_distribute_area:
+ * @area:         the area to process
+ * @min_sub_area: the minimal number of pixels of a sub-area, or 0
+ * @func:         the function to call for each sub-area
+ * @user_data:    user data passed to @func
+ *
+ * Splits @area into stripes along its longer side, each covering at
+ * least @min_sub_area pixels, and calls @func for each of them
+ * through gimp_parallel_distribute().
+ **/
+void
+gimp_parallel_distribute_area (const GeglRectangle            *area,
+                               gsize                           min_sub_area,
+                               GimpParallelDistributeAreaFunc  func,
+                               gpointer                        user_data)
+{
+  GimpParallelAreaData data;
+  gsize                max_n;
+
+  g_return_if_fail (area != NULL);
+  g_return_if_fail (func != NULL);
+
+  if (area->width <= 0 || area->height <= 0)
+    return;
+
+  data.func       = func;
+  data.user_data  = user_data;
+  data.area       = area;
+  data.split_rows = area->height >= area->width;
+
+  max_n = (gsize) area->width * (gsize) area->height;
+
+  if (min_sub_area > 1)
+    max_n /= min_sub_area;
+
+  max_n = MIN (max_n, data.split_rows ? area->height : area->width);
+  max_n = MAX (max_n, 1);
+
+  gimp_parallel_distribute (max_n, gimp_parallel_area_func, &data);
+}
+
+
+/*  private functions  */
+
+static void
+gimp_parallel_notify_num_processors (GimpGeglConfig *config)
+{
+  gimp_parallel_set_n_threads (config->num_processors);
+}
+
+static void
+gimp_parallel_set_n_threads (gint n_threads)
+{
+  n_threads = MAX (n_threads, 1);
+
+  if (n_threads > 1)
+    {
+      /*  the calling thread always takes one part of the work itself  */
+      if (! parallel_pool)
+        parallel_pool = g_thread_pool_new (gimp_parallel_worker, NULL,
+                                           n_threads - 1, FALSE, NULL);
+      else
+        g_thread_pool_set_max_threads (parallel_pool, n_threads - 1, NULL);
+    }
+
+  parallel_n_threads = n_threads;
+}
+
+static void
+gimp_parallel_worker (gpointer data,
+                      gpointer user_data)
+{
+  GimpParallelItem *item = data;
+  GimpParallelTask *task = item->task;
+
+  g_private_set (&parallel_busy, GINT_TO_POINTER (TRUE));
+
+  task->func (item->i, task->n, task->user_data);
+
+  g_private_set (&parallel_busy, NULL);
+
+  g_mutex_lock (&task->mutex);
+
+  if (--task->remaining == 0)
+    g_cond_signal (&task->cond);
+
+  g_mutex_unlock (&task->mutex);
+}
+
+static void
+gimp_parallel_range_func (gint     i,
+                          gint     n,
+                          gpointer user_data)
+{
+  GimpParallelRangeData *data   = user_data;
+  gsize                  offset = data->size * i / n;
+  gsize                  end    = data->size * (i + 1) / n;
+
+  data->func (offset, end - offset, data->user_data);
+}
+
+static void
+gimp_parallel_area_func (gint     i,
+                         gint     n,
+                         gpointer user_data)
+{
+  GimpParallelAreaData *data = user_data;
+  GeglRectangle         sub  = *data->area;
+
+  if (data->split_rows)
+    {
+      sub.y      = data->area->y + data->area->height * i / n;
+      sub.height = data->area->y + data->area->height * (i + 1) / n - sub.y;
+    }
+  else
+    {
+      sub.x     = data->area->x + data->area->width * i / n;
+      sub.width = data->area->x + data->area->width * (i + 1) / n - sub.x;
+    }
+
+  data->func (&sub, data->user_data);
+}
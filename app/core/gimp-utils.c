@@ -57,6 +57,8 @@
 
 #include "core-types.h"
 
+#include "gegl/gimptilebackendcompressed.h"
+
 #include "gimp.h"
 #include "gimp-utils.h"
 #include "gimpcontainer.h"
@@ -289,7 +291,12 @@ gimp_g_param_spec_get_memsize (GParamSpec *pspec)
 gint64
 gimp_gegl_buffer_get_memsize (GeglBuffer *buffer)
 {
-  if (buffer)
+  if (buffer && gimp_tile_backend_compressed_is_compressed (buffer))
+    {
+      return (gimp_tile_backend_compressed_get_memsize (buffer) +
+              gimp_g_object_get_memsize (G_OBJECT (buffer)));
+    }
+  else if (buffer)
     {
       const Babl *format = gegl_buffer_get_format (buffer);
 
@@ -45,6 +45,7 @@
 #include "gimp-contexts.h"
 #include "gimp-gradients.h"
 #include "gimp-modules.h"
+#include "gimp-parallel.h"
 #include "gimp-parasites.h"
 #include "gimp-templates.h"
 #include "gimp-units.h"
@@ -444,6 +445,11 @@ gimp_finalize (GObject *object)
 
   gimp_paint_exit (gimp);
 
+  gimp_imagefile_exit ();
+
+  if (gimp->config)
+    gimp_parallel_exit (gimp);
+
   if (gimp->parasites)
     {
       g_object_unref (gimp->parasites);
@@ -926,6 +932,8 @@ gimp_load_config (Gimp        *gimp,
   g_signal_connect_object (gimp->edit_config, "notify",
                            G_CALLBACK (gimp_edit_config_notify),
                            gimp->config, 0);
+
+  gimp_parallel_init (gimp);
 }
 
 void
@@ -981,10 +989,17 @@ gimp_restore (Gimp               *gimp,
   gimp_data_factory_data_init (gimp->gradient_factory, gimp->user_context,
                                gimp->no_data);
 
-  /*  initialize the list of fonts  */
+  /*  initialize the list of fonts, in the background if there is
+   *  an interface coming up meanwhile
+   */
   status_callback (NULL, _("Fonts (this may take a while)"), 0.6);
   if (! gimp->no_fonts)
-    gimp_fonts_load (gimp);
+    {
+      if (gimp->no_interface)
+        gimp_fonts_load (gimp);
+      else
+        gimp_fonts_load_async (gimp);
+    }
 
   /*  initialize the list of gimp tool presets if we have a GUI  */
   if (! gimp->no_interface)
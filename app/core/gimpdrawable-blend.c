@@ -34,6 +34,7 @@
 #include "gegl/gimp-gegl-utils.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimp-utils.h"
 #include "gimpchannel.h"
 #include "gimpcontext.h"
@@ -45,7 +46,20 @@
 #include "gimp-intl.h"
 
 
-//#define USE_GRADIENT_CACHE 1
+/*  the number of entries of the gradient lookup table, the colors in
+ *  between are interpolated linearly
+ */
+#define GRADIENT_CACHE_SIZE  8192
+
+/*  the region is filled in bands of at most this height and number of
+ *  pixels. the threads render each band to memory, and it is written
+ *  to the buffer before the next one, so progress can be reported in
+ *  between
+ */
+#define GRADIENT_BAND_HEIGHT 256
+#define GRADIENT_BAND_PIXELS (1024 * 1024)
+
+#define MIN_PARALLEL_PIXELS  (64 * 64)
 
 
 typedef struct
@@ -53,10 +67,7 @@ typedef struct
   GimpGradient     *gradient;
   GimpContext      *context;
   gboolean          reverse;
-#ifdef USE_GRADIENT_CACHE
   GimpRGB          *gradient_cache;
-  gint              gradient_cache_size;
-#endif
   gdouble           offset;
   gdouble           sx, sy;
   GimpBlendMode     blend_mode;
@@ -65,10 +76,19 @@ typedef struct
   gdouble           dist;
   gdouble           vec[2];
   GimpRepeatMode    repeat;
-  GRand            *seed;
   GeglBuffer       *dist_buffer;
 } RenderBlendData;
 
+typedef struct
+{
+  const RenderBlendData *rbd;
+  GeglRectangle          band;
+  gfloat                *band_data;  /*  R'G'B'A float        */
+  const gfloat          *band_dist;  /*  Y float, or NULL     */
+  gboolean               dither;
+  guint32                dither_seed;
+} FillAreaData;
+
 typedef struct
 {
   GeglBuffer    *buffer;
@@ -80,50 +100,48 @@ typedef struct
 
 /*  local function prototypes  */
 
-static gdouble  gradient_calc_conical_sym_factor  (gdouble   dist,
-                                                   gdouble  *axis,
-                                                   gdouble   offset,
-                                                   gdouble   x,
-                                                   gdouble   y);
-static gdouble  gradient_calc_conical_asym_factor (gdouble   dist,
-                                                   gdouble  *axis,
-                                                   gdouble   offset,
-                                                   gdouble   x,
-                                                   gdouble   y);
-static gdouble  gradient_calc_square_factor       (gdouble   dist,
-                                                   gdouble   offset,
-                                                   gdouble   x,
-                                                   gdouble   y);
-static gdouble  gradient_calc_radial_factor       (gdouble   dist,
-                                                   gdouble   offset,
-                                                   gdouble   x,
-                                                   gdouble   y);
-static gdouble  gradient_calc_linear_factor       (gdouble   dist,
-                                                   gdouble  *vec,
-                                                   gdouble   offset,
-                                                   gdouble   x,
-                                                   gdouble   y);
-static gdouble  gradient_calc_bilinear_factor     (gdouble   dist,
-                                                   gdouble  *vec,
-                                                   gdouble   offset,
-                                                   gdouble   x,
-                                                   gdouble   y);
-static gdouble  gradient_calc_spiral_factor       (gdouble   dist,
-                                                   gdouble  *axis,
-                                                   gdouble   offset,
-                                                   gdouble   x,
-                                                   gdouble   y,
-                                                   gboolean  clockwise);
-
-static gdouble  gradient_calc_shapeburst_angular_factor   (GeglBuffer *dist_buffer,
-                                                           gdouble     x,
-                                                           gdouble     y);
-static gdouble  gradient_calc_shapeburst_spherical_factor (GeglBuffer *dist_buffer,
-                                                           gdouble     x,
-                                                           gdouble     y);
-static gdouble  gradient_calc_shapeburst_dimpled_factor   (GeglBuffer *dist_buffer,
-                                                           gdouble     x,
-                                                           gdouble     y);
+static gdouble  gradient_calc_conical_sym_factor  (gdouble         dist,
+                                                   const gdouble  *axis,
+                                                   gdouble         offset,
+                                                   gdouble         x,
+                                                   gdouble         y);
+static gdouble  gradient_calc_conical_asym_factor (gdouble         dist,
+                                                   const gdouble  *axis,
+                                                   gdouble         offset,
+                                                   gdouble         x,
+                                                   gdouble         y);
+static gdouble  gradient_calc_square_factor       (gdouble         dist,
+                                                   gdouble         offset,
+                                                   gdouble         x,
+                                                   gdouble         y);
+static gdouble  gradient_calc_radial_factor       (gdouble         dist,
+                                                   gdouble         offset,
+                                                   gdouble         x,
+                                                   gdouble         y);
+static gdouble  gradient_calc_linear_factor       (gdouble         dist,
+                                                   const gdouble  *vec,
+                                                   gdouble         offset,
+                                                   gdouble         x,
+                                                   gdouble         y);
+static gdouble  gradient_calc_bilinear_factor     (gdouble         dist,
+                                                   const gdouble  *vec,
+                                                   gdouble         offset,
+                                                   gdouble         x,
+                                                   gdouble         y);
+static gdouble  gradient_calc_spiral_factor       (gdouble         dist,
+                                                   const gdouble  *axis,
+                                                   gdouble         offset,
+                                                   gdouble         x,
+                                                   gdouble         y,
+                                                   gboolean        clockwise);
+
+static gdouble  gradient_calc_shapeburst_angular_factor   (gdouble     value);
+static gdouble  gradient_calc_shapeburst_spherical_factor (gdouble     value);
+static gdouble  gradient_calc_shapeburst_dimpled_factor   (gdouble     value);
+
+static gfloat   gradient_get_shapeburst_value (GeglBuffer *dist_buffer,
+                                               gdouble     x,
+                                               gdouble     y);
 
 static GeglBuffer * gradient_precalc_shapeburst (GimpImage           *image,
                                                  GimpDrawable        *drawable,
@@ -131,6 +149,17 @@ static GeglBuffer * gradient_precalc_shapeburst (GimpImage           *image,
                                                  gdouble              dist,
                                                  GimpProgress        *progress);
 
+static gdouble  gradient_calc_factor        (const RenderBlendData *rbd,
+                                             gdouble                x,
+                                             gdouble                y,
+                                             gfloat                 shapeburst);
+static void     gradient_blend_color        (const RenderBlendData *rbd,
+                                             gdouble                factor,
+                                             GimpRGB               *color);
+static void     gradient_lookup_color       (const RenderBlendData *rbd,
+                                             gdouble                factor,
+                                             GimpRGB               *color);
+
 static void     gradient_render_pixel       (gdouble              x,
                                              gdouble              y,
                                              GimpRGB             *color,
@@ -139,6 +168,8 @@ static void     gradient_put_pixel          (gint                 x,
                                              gint                 y,
                                              GimpRGB             *color,
                                              gpointer             put_pixel_data);
+static void     gradient_fill_area          (const GeglRectangle *area,
+                                             gpointer             data);
 
 static void     gradient_fill_region        (GimpImage           *image,
                                              GimpDrawable        *drawable,
@@ -227,11 +258,11 @@ gimp_drawable_blend (GimpDrawable         *drawable,
 }
 
 static gdouble
-gradient_calc_conical_sym_factor (gdouble  dist,
-                                  gdouble *axis,
-                                  gdouble  offset,
-                                  gdouble  x,
-                                  gdouble  y)
+gradient_calc_conical_sym_factor (gdouble        dist,
+                                  const gdouble *axis,
+                                  gdouble        offset,
+                                  gdouble        x,
+                                  gdouble        y)
 {
   if (dist == 0.0)
     {
@@ -272,11 +303,11 @@ gradient_calc_conical_sym_factor (gdouble  dist,
 }
 
 static gdouble
-gradient_calc_conical_asym_factor (gdouble  dist,
-                                   gdouble *axis,
-                                   gdouble  offset,
-                                   gdouble  x,
-                                   gdouble  y)
+gradient_calc_conical_asym_factor (gdouble        dist,
+                                   const gdouble *axis,
+                                   gdouble        offset,
+                                   gdouble        x,
+                                   gdouble        y)
 {
   if (dist == 0.0)
     {
@@ -371,11 +402,11 @@ gradient_calc_radial_factor (gdouble dist,
 }
 
 static gdouble
-gradient_calc_linear_factor (gdouble  dist,
-                             gdouble *vec,
-                             gdouble  offset,
-                             gdouble  x,
-                             gdouble  y)
+gradient_calc_linear_factor (gdouble        dist,
+                             const gdouble *vec,
+                             gdouble        offset,
+                             gdouble        x,
+                             gdouble        y)
 {
   if (dist == 0.0)
     {
@@ -403,11 +434,11 @@ gradient_calc_linear_factor (gdouble  dist,
 }
 
 static gdouble
-gradient_calc_bilinear_factor (gdouble  dist,
-                               gdouble *vec,
-                               gdouble  offset,
-                               gdouble  x,
-                               gdouble  y)
+gradient_calc_bilinear_factor (gdouble        dist,
+                               const gdouble *vec,
+                               gdouble        offset,
+                               gdouble        x,
+                               gdouble        y)
 {
   if (dist == 0.0)
     {
@@ -435,12 +466,12 @@ gradient_calc_bilinear_factor (gdouble  dist,
 }
 
 static gdouble
-gradient_calc_spiral_factor (gdouble   dist,
-                             gdouble  *axis,
-                             gdouble   offset,
-                             gdouble   x,
-                             gdouble   y,
-                             gboolean  clockwise)
+gradient_calc_spiral_factor (gdouble         dist,
+                             const gdouble  *axis,
+                             gdouble         offset,
+                             gdouble         x,
+                             gdouble         y,
+                             gboolean        clockwise)
 {
   if (dist == 0.0)
     {
@@ -474,47 +505,29 @@ gradient_calc_spiral_factor (gdouble   dist,
 }
 
 static gdouble
-gradient_calc_shapeburst_angular_factor (GeglBuffer *dist_buffer,
-                                         gdouble     x,
-                                         gdouble     y)
+gradient_calc_shapeburst_angular_factor (gdouble value)
 {
-  gint   ix = CLAMP (x, 0.0, gegl_buffer_get_width  (dist_buffer) - 0.7);
-  gint   iy = CLAMP (y, 0.0, gegl_buffer_get_height (dist_buffer) - 0.7);
-  gfloat value;
-
-  gegl_buffer_get (dist_buffer, GEGL_RECTANGLE (ix, iy, 1, 1), 1.0,
-                   NULL, &value,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-  value = 1.0 - value;
-
-  return value;
+  return 1.0 - value;
 }
 
 
 static gdouble
-gradient_calc_shapeburst_spherical_factor (GeglBuffer *dist_buffer,
-                                           gdouble     x,
-                                           gdouble     y)
+gradient_calc_shapeburst_spherical_factor (gdouble value)
 {
-  gint   ix = CLAMP (x, 0.0, gegl_buffer_get_width  (dist_buffer) - 0.7);
-  gint   iy = CLAMP (y, 0.0, gegl_buffer_get_height (dist_buffer) - 0.7);
-  gfloat value;
-
-  gegl_buffer_get (dist_buffer, GEGL_RECTANGLE (ix, iy, 1, 1), 1.0,
-                   NULL, &value,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-  value = 1.0 - sin (0.5 * G_PI * value);
-
-  return value;
+  return 1.0 - sin (0.5 * G_PI * value);
 }
 
 
 static gdouble
-gradient_calc_shapeburst_dimpled_factor (GeglBuffer *dist_buffer,
-                                         gdouble     x,
-                                         gdouble     y)
+gradient_calc_shapeburst_dimpled_factor (gdouble value)
+{
+  return cos (0.5 * G_PI * value);
+}
+
+static gfloat
+gradient_get_shapeburst_value (GeglBuffer *dist_buffer,
+                               gdouble     x,
+                               gdouble     y)
 {
   gint   ix = CLAMP (x, 0.0, gegl_buffer_get_width  (dist_buffer) - 0.7);
   gint   iy = CLAMP (y, 0.0, gegl_buffer_get_height (dist_buffer) - 0.7);
@@ -524,8 +537,6 @@ gradient_calc_shapeburst_dimpled_factor (GeglBuffer *dist_buffer,
                    NULL, &value,
                    GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-  value = cos (0.5 * G_PI * value);
-
   return value;
 }
 
@@ -550,13 +561,12 @@ gradient_precalc_shapeburst (GimpImage           *image,
                                                  region->width, region->height),
                                  babl_format ("Y float"));
 
-  /*  allocate the selection mask copy
-   *  XXX: its format should be the same of gimp:shapeburst input buffer
-   *       porting the op to 'float' should be reflected here as well
+  /*  allocate the selection mask copy, in the format of the
+   *  gimp:shapeburst input buffer
    */
   temp_buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0,
                                                  region->width, region->height),
-                                 babl_format ("Y u8"));
+                                 babl_format ("Y float"));
 
   mask = gimp_image_get_mask (image);
 
@@ -582,7 +592,7 @@ gradient_precalc_shapeburst (GimpImage           *image,
         {
           const Babl *component_format;
 
-          component_format = babl_format ("A u8");
+          component_format = babl_format ("A float");
 
           /*  extract the aplha into the temp mask  */
           gegl_buffer_set_format (temp_buffer, component_format);
@@ -642,14 +652,17 @@ gradient_precalc_shapeburst (GimpImage           *image,
 }
 
 
-static void
-gradient_render_pixel (gdouble   x,
-                       gdouble   y,
-                       GimpRGB  *color,
-                       gpointer  render_data)
+/*  Calculates the blending factor of a pixel, adjusted for repeat.
+ *  @shapeburst is the normalized distance map value at the pixel and
+ *  is only used by the shapeburst gradients.
+ */
+static gdouble
+gradient_calc_factor (const RenderBlendData *rbd,
+                      gdouble                x,
+                      gdouble                y,
+                      gfloat                 shapeburst)
 {
-  RenderBlendData *rbd = render_data;
-  gdouble          factor;
+  gdouble factor;
 
   /* Calculate blending factor */
 
@@ -691,15 +704,15 @@ gradient_render_pixel (gdouble   x,
       break;
 
     case GIMP_GRADIENT_SHAPEBURST_ANGULAR:
-      factor = gradient_calc_shapeburst_angular_factor (rbd->dist_buffer, x, y);
+      factor = gradient_calc_shapeburst_angular_factor (shapeburst);
       break;
 
     case GIMP_GRADIENT_SHAPEBURST_SPHERICAL:
-      factor = gradient_calc_shapeburst_spherical_factor (rbd->dist_buffer, x, y);
+      factor = gradient_calc_shapeburst_spherical_factor (shapeburst);
       break;
 
     case GIMP_GRADIENT_SHAPEBURST_DIMPLED:
-      factor = gradient_calc_shapeburst_dimpled_factor (rbd->dist_buffer, x, y);
+      factor = gradient_calc_shapeburst_dimpled_factor (shapeburst);
       break;
 
     case GIMP_GRADIENT_SPIRAL_CLOCKWISE:
@@ -716,7 +729,7 @@ gradient_render_pixel (gdouble   x,
 
     default:
       g_assert_not_reached ();
-      return;
+      return 0.0;
     }
 
   /* Adjust for repeat */
@@ -747,16 +760,19 @@ gradient_render_pixel (gdouble   x,
       break;
     }
 
-  /* Blend the colors */
+  return factor;
+}
 
+/*  The exact color of the gradient at @factor  */
+static void
+gradient_blend_color (const RenderBlendData *rbd,
+                      gdouble                factor,
+                      GimpRGB               *color)
+{
   if (rbd->blend_mode == GIMP_CUSTOM_MODE)
     {
-#ifdef USE_GRADIENT_CACHE
-      *color = rbd->gradient_cache[(gint) (factor * (rbd->gradient_cache_size - 1))];
-#else
       gimp_gradient_get_color_at (rbd->gradient, rbd->context, NULL,
                                   factor, rbd->reverse, color);
-#endif
     }
   else
     {
@@ -779,6 +795,52 @@ gradient_render_pixel (gdouble   x,
     }
 }
 
+/*  The color of the gradient at @factor, interpolated from the lookup
+ *  table.  This is thread-safe, unlike gradient_blend_color().
+ */
+static void
+gradient_lookup_color (const RenderBlendData *rbd,
+                       gdouble                factor,
+                       GimpRGB               *color)
+{
+  const GimpRGB *a;
+  const GimpRGB *b;
+  gdouble        pos;
+  gdouble        frac;
+  gint           index;
+
+  pos   = CLAMP (factor, 0.0, 1.0) * (GRADIENT_CACHE_SIZE - 1);
+  index = MIN ((gint) pos, GRADIENT_CACHE_SIZE - 2);
+  frac  = pos - index;
+
+  a = &rbd->gradient_cache[index];
+  b = &rbd->gradient_cache[index + 1];
+
+  color->r = a->r + (b->r - a->r) * frac;
+  color->g = a->g + (b->g - a->g) * frac;
+  color->b = a->b + (b->b - a->b) * frac;
+  color->a = a->a + (b->a - a->a) * frac;
+}
+
+/*  The exact path, used by adaptive supersampling  */
+static void
+gradient_render_pixel (gdouble   x,
+                       gdouble   y,
+                       GimpRGB  *color,
+                       gpointer  render_data)
+{
+  RenderBlendData *rbd        = render_data;
+  gfloat           shapeburst = 0.0;
+  gdouble          factor;
+
+  if (rbd->dist_buffer)
+    shapeburst = gradient_get_shapeburst_value (rbd->dist_buffer, x, y);
+
+  factor = gradient_calc_factor (rbd, x, y, shapeburst);
+
+  gradient_blend_color (rbd, factor, color);
+}
+
 static void
 gradient_put_pixel (gint      x,
                     gint      y,
@@ -813,6 +875,63 @@ gradient_put_pixel (gint      x,
                      GEGL_AUTO_ROWSTRIDE);
 }
 
+static void
+gradient_fill_area (const GeglRectangle *area,
+                    gpointer             data)
+{
+  FillAreaData          *fill = data;
+  const RenderBlendData *rbd  = fill->rbd;
+  GRand                 *dither_rand = NULL;
+  gint                   endx = area->x + area->width;
+  gint                   endy = area->y + area->height;
+  gint                   x, y;
+
+  /*  seed each area from its position, so the dithering noise doesn't
+   *  depend on which thread renders it
+   */
+  if (fill->dither)
+    dither_rand = g_rand_new_with_seed (fill->dither_seed ^
+                                        (area->y * 65599 + area->x));
+
+  for (y = area->y; y < endy; y++)
+    {
+      gint          offset = ((y - fill->band.y) * fill->band.width +
+                              (area->x - fill->band.x));
+      gfloat       *dest   = fill->band_data + offset * 4;
+      const gfloat *dist   = fill->band_dist ? fill->band_dist + offset : NULL;
+
+      for (x = area->x; x < endx; x++)
+        {
+          GimpRGB color;
+          gdouble factor;
+
+          factor = gradient_calc_factor (rbd, x, y, dist ? *dist++ : 0.0);
+
+          gradient_lookup_color (rbd, factor, &color);
+
+          if (dither_rand)
+            {
+              gint i = g_rand_int (dither_rand);
+
+              *dest++ = color.r + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
+              *dest++ = color.g + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
+              *dest++ = color.b + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
+              *dest++ = color.a + (gdouble) (i & 0xff) / 256.0 / 256.0;
+            }
+          else
+            {
+              *dest++ = color.r;
+              *dest++ = color.g;
+              *dest++ = color.b;
+              *dest++ = color.a;
+            }
+        }
+    }
+
+  if (dither_rand)
+    g_rand_free (dither_rand);
+}
+
 static void
 gradient_fill_region (GimpImage           *image,
                       GimpDrawable        *drawable,
@@ -842,24 +961,6 @@ gradient_fill_region (GimpImage           *image,
   rbd.context  = context;
   rbd.reverse  = reverse;
 
-#ifdef USE_GRADIENT_CACHE
-  {
-    gint i;
-
-    rbd.gradient_cache_size = ceil (sqrt (SQR (sx - ex) + SQR (sy - ey)));
-    rbd.gradient_cache      = g_new0 (GimpRGB, rbd.gradient_cache_size);
-
-    for (i = 0; i < rbd.gradient_cache_size; i++)
-      {
-        gdouble factor = (gdouble) i / (gdouble) (rbd.gradient_cache_size - 1);
-
-        gimp_gradient_get_color_at (rbd.gradient, rbd.context, NULL,
-                                    factor, rbd.reverse,
-                                    rbd.gradient_cache + i);
-      }
-  }
-#endif
-
   if (gimp_gradient_has_fg_bg_segments (rbd.gradient))
     rbd.gradient = gimp_gradient_flatten (rbd.gradient, context);
   else
@@ -980,77 +1081,73 @@ gradient_fill_region (GimpImage           *image,
     }
   else
     {
-      GeglBufferIterator *iter;
-      GeglRectangle      *roi;
-      gint                total = buffer_region->width * buffer_region->height;
-      gint                done  = 0;
-
-      iter = gegl_buffer_iterator_new (buffer, buffer_region, 0,
-                                       babl_format ("R'G'B'A float"),
-                                       GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-      roi = &iter->roi[0];
-
-      if (dither)
-        rbd.seed = g_rand_new ();
-
-      while (gegl_buffer_iterator_next (iter))
+      FillAreaData  fill;
+      gint          band_height;
+      gfloat       *band_data;
+      gfloat       *band_dist = NULL;
+      gint          i;
+      gint          y;
+
+      /*  the lookup table makes the colors cheap and thread-safe,
+       *  the supersampling above keeps using the exact colors
+       */
+      rbd.gradient_cache = g_new (GimpRGB, GRADIENT_CACHE_SIZE);
+
+      for (i = 0; i < GRADIENT_CACHE_SIZE; i++)
+        gradient_blend_color (&rbd,
+                              (gdouble) i / (GRADIENT_CACHE_SIZE - 1),
+                              rbd.gradient_cache + i);
+
+      band_height = CLAMP (GRADIENT_BAND_PIXELS /
+                           MAX (buffer_region->width, 1),
+                           1, GRADIENT_BAND_HEIGHT);
+
+      band_data = g_new (gfloat, (gsize) 4 * buffer_region->width * band_height);
+
+      if (rbd.dist_buffer)
+        band_dist = g_new (gfloat, (gsize) buffer_region->width * band_height);
+
+      fill.rbd         = &rbd;
+      fill.band_data   = band_data;
+      fill.band_dist   = band_dist;
+      fill.dither      = dither;
+      fill.dither_seed = g_random_int ();
+
+      for (y = 0; y < buffer_region->height; y += band_height)
         {
-          gfloat *dest = iter->data[0];
-          gint    endx  = roi->x + roi->width;
-          gint    endy  = roi->y + roi->height;
-          gint    x, y;
-
-          if (rbd.seed)
-            {
-              GRand *dither_rand = g_rand_new_with_seed (g_rand_int (rbd.seed));
+          GeglRectangle *band = &fill.band;
 
-              for (y = roi->y; y < endy; y++)
-                for (x = roi->x; x < endx; x++)
-                  {
-                    GimpRGB  color;
-                    gint     i = g_rand_int (dither_rand);
+          band->x      = buffer_region->x;
+          band->y      = buffer_region->y + y;
+          band->width  = buffer_region->width;
+          band->height = MIN (band_height, buffer_region->height - y);
 
-                    gradient_render_pixel (x, y, &color, &rbd);
+          /*  only the threads' own memory is touched in parallel, the
+           *  buffers are read and written here
+           */
+          if (band_dist)
+            gegl_buffer_get (rbd.dist_buffer, band, 1.0,
+                             babl_format ("Y float"), band_dist,
+                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-                    *dest++ = color.r + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
-                    *dest++ = color.g + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
-                    *dest++ = color.b + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
-                    *dest++ = color.a + (gdouble) (i & 0xff) / 256.0 / 256.0;
-                  }
+          gimp_parallel_distribute_area (band, MIN_PARALLEL_PIXELS,
+                                         gradient_fill_area, &fill);
 
-              g_rand_free (dither_rand);
-            }
-          else
-            {
-              for (y = roi->y; y < endy; y++)
-                for (x = roi->x; x < endx; x++)
-                  {
-                    GimpRGB  color;
-
-                    gradient_render_pixel (x, y, &color, &rbd);
-
-                    *dest++ = color.r;
-                    *dest++ = color.g;
-                    *dest++ = color.b;
-                    *dest++ = color.a;
-                  }
-            }
-
-          done += roi->width * roi->height;
+          gegl_buffer_set (buffer, band, 0,
+                           babl_format ("R'G'B'A float"), band_data,
+                           GEGL_AUTO_ROWSTRIDE);
 
           if (progress)
             gimp_progress_set_value (progress,
-                                     (gdouble) done / (gdouble) total);
+                                     (gdouble) (y + band->height) /
+                                     (gdouble) buffer_region->height);
         }
 
-      if (dither)
-        g_rand_free (rbd.seed);
+      g_free (band_dist);
+      g_free (band_data);
+      g_free (rbd.gradient_cache);
     }
 
-#ifdef USE_GRADIENT_CACHE
-  g_free (rbd.gradient_cache);
-#endif
-
   g_object_unref (rbd.gradient);
 
   if (rbd.dist_buffer)
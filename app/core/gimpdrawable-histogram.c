@@ -120,3 +120,57 @@ gimp_drawable_calculate_histogram (GimpDrawable  *drawable,
         }
     }
 }
+
+/**
+ * gimp_drawable_update_histogram:
+ * @drawable:    a #GimpDrawable
+ * @histogram:   a histogram calculated for @drawable
+ * @update_rect: the changed area, in @drawable's coordinates
+ *
+ * Like gimp_drawable_calculate_histogram(), but only counts the parts
+ * of @drawable touching @update_rect again, when @histogram still
+ * belongs to the same buffer, selection and area.
+ **/
+void
+gimp_drawable_update_histogram (GimpDrawable        *drawable,
+                                GimpHistogram       *histogram,
+                                const GeglRectangle *update_rect)
+{
+  GimpImage   *image;
+  GimpChannel *mask;
+  gint         x, y, width, height;
+
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
+  g_return_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)));
+  g_return_if_fail (histogram != NULL);
+  g_return_if_fail (update_rect != NULL);
+
+  if (! gimp_item_mask_intersect (GIMP_ITEM (drawable), &x, &y, &width, &height))
+    return;
+
+  image = gimp_item_get_image (GIMP_ITEM (drawable));
+  mask  = gimp_image_get_mask (image);
+
+  if (! gimp_channel_is_empty (mask))
+    {
+      gint off_x, off_y;
+
+      gimp_item_get_offset (GIMP_ITEM (drawable), &off_x, &off_y);
+
+      gimp_histogram_update (histogram,
+                             gimp_drawable_get_buffer (drawable),
+                             GEGL_RECTANGLE (x, y, width, height),
+                             gimp_drawable_get_buffer (GIMP_DRAWABLE (mask)),
+                             GEGL_RECTANGLE (x + off_x, y + off_y,
+                                             width, height),
+                             update_rect);
+    }
+  else
+    {
+      gimp_histogram_update (histogram,
+                             gimp_drawable_get_buffer (drawable),
+                             GEGL_RECTANGLE (x, y, width, height),
+                             NULL, NULL,
+                             update_rect);
+    }
+}
@@ -54,6 +54,10 @@ static void     gimp_drawable_mod_undo_pop          (GimpUndo            *undo,
                                                      GimpUndoAccumulator *accum);
 static void     gimp_drawable_mod_undo_free         (GimpUndo            *undo,
                                                      GimpUndoMode         undo_mode);
+static void     gimp_drawable_mod_undo_foreach_buffer
+                                                    (GimpUndo            *undo,
+                                                     GimpUndoBufferFunc   func,
+                                                     gpointer             user_data);
 
 
 G_DEFINE_TYPE (GimpDrawableModUndo, gimp_drawable_mod_undo, GIMP_TYPE_ITEM_UNDO)
@@ -76,6 +80,7 @@ gimp_drawable_mod_undo_class_init (GimpDrawableModUndoClass *klass)
 
   undo_class->pop                = gimp_drawable_mod_undo_pop;
   undo_class->free               = gimp_drawable_mod_undo_free;
+  undo_class->foreach_buffer     = gimp_drawable_mod_undo_foreach_buffer;
 
   g_object_class_install_property (object_class, PROP_COPY_BUFFER,
                                    g_param_spec_boolean ("copy-buffer",
@@ -215,3 +220,14 @@ gimp_drawable_mod_undo_free (GimpUndo     *undo,
 
   GIMP_UNDO_CLASS (parent_class)->free (undo, undo_mode);
 }
+
+static void
+gimp_drawable_mod_undo_foreach_buffer (GimpUndo           *undo,
+                                       GimpUndoBufferFunc  func,
+                                       gpointer            user_data)
+{
+  GimpDrawableModUndo *drawable_mod_undo = GIMP_DRAWABLE_MOD_UNDO (undo);
+
+  if (drawable_mod_undo->buffer)
+    func (&drawable_mod_undo->buffer, user_data);
+}
@@ -56,6 +56,10 @@ static void     gimp_drawable_undo_pop          (GimpUndo            *undo,
                                                  GimpUndoAccumulator *accum);
 static void     gimp_drawable_undo_free         (GimpUndo            *undo,
                                                  GimpUndoMode         undo_mode);
+static void     gimp_drawable_undo_foreach_buffer
+                                                (GimpUndo            *undo,
+                                                 GimpUndoBufferFunc   func,
+                                                 gpointer             user_data);
 
 
 G_DEFINE_TYPE (GimpDrawableUndo, gimp_drawable_undo, GIMP_TYPE_ITEM_UNDO)
@@ -78,6 +82,7 @@ gimp_drawable_undo_class_init (GimpDrawableUndoClass *klass)
 
   undo_class->pop                = gimp_drawable_undo_pop;
   undo_class->free               = gimp_drawable_undo_free;
+  undo_class->foreach_buffer     = gimp_drawable_undo_foreach_buffer;
 
   g_object_class_install_property (object_class, PROP_BUFFER,
                                    g_param_spec_object ("buffer", NULL, NULL,
@@ -214,3 +219,17 @@ gimp_drawable_undo_free (GimpUndo     *undo,
 
   GIMP_UNDO_CLASS (parent_class)->free (undo, undo_mode);
 }
+
+static void
+gimp_drawable_undo_foreach_buffer (GimpUndo           *undo,
+                                   GimpUndoBufferFunc  func,
+                                   gpointer            user_data)
+{
+  GimpDrawableUndo *drawable_undo = GIMP_DRAWABLE_UNDO (undo);
+
+  if (drawable_undo->buffer)
+    func (&drawable_undo->buffer, user_data);
+
+  if (drawable_undo->applied_buffer)
+    func (&drawable_undo->applied_buffer, user_data);
+}
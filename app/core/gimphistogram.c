@@ -29,21 +29,83 @@
 
 #include "gegl/gimp-babl.h"
 
+#include "gimp-parallel.h"
 #include "gimphistogram.h"
 
 
+/*  the histogram is calculated in chunks of the buffer, whose partial
+ *  histograms are kept so gimp_histogram_update() can recalculate only
+ *  the chunks that changed
+ */
+#define HISTOGRAM_CHUNK_SIZE  256
+#define HISTOGRAM_CACHE_SIZE  (8 * 1024 * 1024)
+
+/*  how many bytes of pixels are read at once for the threads to count  */
+#define HISTOGRAM_BATCH_SIZE  (16 * 1024 * 1024)
+
+
 struct _GimpHistogram
 {
-  gint     ref_count;
-  gint     n_channels;
-  gdouble *values;
+  gint           ref_count;
+  gint           n_channels;
+  gint           n_bins;
+  gdouble       *values;
+
+  GeglBuffer    *buffer;
+  GeglRectangle  buffer_rect;
+  GeglBuffer    *mask;
+  GeglRectangle  mask_rect;
+  gboolean       has_mask;
+  gint           chunk_size;
+  gint           n_chunk_cols;
+  gint           n_chunk_rows;
+  gdouble       *chunk_values;
 };
 
+typedef struct
+{
+  GimpHistogram  *histogram;
+  gint            n_components;
+  const gint     *chunks;
+  guchar        **pixels;
+  gfloat        **mask_pixels;
+} GimpHistogramChunks;
+
 
 /*  local function prototypes  */
 
-static void   gimp_histogram_alloc_values (GimpHistogram *histogram,
-                                           gint           bytes);
+static void         gimp_histogram_alloc_values     (GimpHistogram       *histogram,
+                                                     gint                 bytes);
+static void         gimp_histogram_alloc_chunks     (GimpHistogram       *histogram,
+                                                     GeglBuffer          *buffer,
+                                                     const GeglRectangle *buffer_rect,
+                                                     GeglBuffer          *mask,
+                                                     const GeglRectangle *mask_rect);
+static void         gimp_histogram_clear_chunks     (GimpHistogram       *histogram);
+static const Babl * gimp_histogram_get_format       (GimpHistogram       *histogram,
+                                                     GeglBuffer          *buffer);
+static void         gimp_histogram_calculate_chunks (GimpHistogram       *histogram,
+                                                     const Babl          *format,
+                                                     const gint          *chunks,
+                                                     gint                 n_chunks);
+static void         gimp_histogram_get_chunk_area   (GimpHistogram       *histogram,
+                                                     gint                 chunk,
+                                                     GeglRectangle       *area);
+static void         gimp_histogram_calculate_range  (gsize                offset,
+                                                     gsize                size,
+                                                     gpointer             user_data);
+static void         gimp_histogram_calculate_pixels (gdouble             *values,
+                                                     gint                 n_components,
+                                                     const guchar        *data,
+                                                     const gfloat        *mask_data,
+                                                     gint                 n_pixels);
+static void         gimp_histogram_calculate_pixels_float
+                                                    (gdouble             *values,
+                                                     gint                 n_bins,
+                                                     gint                 n_components,
+                                                     const gfloat        *data,
+                                                     const gfloat        *mask_data,
+                                                     gint                 n_pixels);
 
 
 /*  public functions  */
@@ -51,9 +113,30 @@ static void   gimp_histogram_alloc_values (GimpHistogram *histogram,
 GimpHistogram *
 gimp_histogram_new (void)
 {
-  GimpHistogram *histogram = g_slice_new0 (GimpHistogram);
+  return gimp_histogram_new_with_bins (256);
+}
+
+/**
+ * gimp_histogram_new_with_bins:
+ * @n_bins: the number of bins per channel
+ *
+ * Creates a histogram with @n_bins bins per channel. Histograms with
+ * other than 256 bins read the pixels as float, so they can resolve
+ * images of a higher bit depth.
+ *
+ * Return value: a newly allocated %GimpHistogram
+ **/
+GimpHistogram *
+gimp_histogram_new_with_bins (gint n_bins)
+{
+  GimpHistogram *histogram;
+
+  g_return_val_if_fail (n_bins >= 2 && n_bins <= 65536, NULL);
+
+  histogram = g_slice_new0 (GimpHistogram);
 
   histogram->ref_count = 1;
+  histogram->n_bins    = n_bins;
 
   return histogram;
 }
@@ -98,15 +181,28 @@ gimp_histogram_duplicate (GimpHistogram *histogram)
 
   g_return_val_if_fail (histogram != NULL, NULL);
 
-  dup = gimp_histogram_new ();
+  dup = gimp_histogram_new_with_bins (histogram->n_bins);
 
   dup->n_channels = histogram->n_channels;
   dup->values     = g_memdup (histogram->values,
-                              sizeof (gdouble) * dup->n_channels * 256);
+                              sizeof (gdouble) *
+                              dup->n_channels * dup->n_bins);
 
   return dup;
 }
 
+/**
+ * gimp_histogram_calculate:
+ * @histogram:   a %GimpHistogram
+ * @buffer:      the buffer to count
+ * @buffer_rect: the area of @buffer to count
+ * @mask:        a mask weighting the pixels, or %NULL
+ * @mask_rect:   the area of @mask matching @buffer_rect
+ *
+ * Calculates the histogram of @buffer_rect. The area is split into
+ * chunks whose pixels are read on the calling thread and counted in
+ * parallel.
+ **/
 void
 gimp_histogram_calculate (GimpHistogram       *histogram,
                           GeglBuffer          *buffer,
@@ -114,180 +210,102 @@ gimp_histogram_calculate (GimpHistogram       *histogram,
                           GeglBuffer          *mask,
                           const GeglRectangle *mask_rect)
 {
-  GeglBufferIterator *iter;
-  const Babl         *format;
-  gint                n_components;
+  const Babl *format;
+  gint       *chunks;
+  gint        n_chunks;
+  gint        i;
 
   g_return_if_fail (histogram != NULL);
   g_return_if_fail (GEGL_IS_BUFFER (buffer));
   g_return_if_fail (buffer_rect != NULL);
+  g_return_if_fail (mask == NULL || mask_rect != NULL);
 
-  format = gegl_buffer_get_format (buffer);
+  format = gimp_histogram_get_format (histogram, buffer);
 
-  if (babl_format_is_palette (format))
-    format = gimp_babl_format (GIMP_RGB, GIMP_PRECISION_U8,
-                               babl_format_has_alpha (format));
-  else
-    format = gimp_babl_format (gimp_babl_format_get_base_type (format),
-                               GIMP_PRECISION_U8,
-                               babl_format_has_alpha (format));
+  gimp_histogram_alloc_values (histogram,
+                               babl_format_get_n_components (format));
+  gimp_histogram_alloc_chunks (histogram,
+                               buffer, buffer_rect, mask, mask_rect);
 
-  n_components = babl_format_get_n_components (format);
+  n_chunks = histogram->n_chunk_cols * histogram->n_chunk_rows;
+  chunks   = g_new (gint, n_chunks);
 
-  gimp_histogram_alloc_values (histogram, n_components);
+  for (i = 0; i < n_chunks; i++)
+    chunks[i] = i;
 
-  iter = gegl_buffer_iterator_new (buffer, buffer_rect, 0, format,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+  gimp_histogram_calculate_chunks (histogram, format, chunks, n_chunks);
 
-  if (mask)
-    gegl_buffer_iterator_add (iter, mask, mask_rect, 0,
-                              babl_format ("Y float"),
-                              GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+  g_free (chunks);
+}
 
-#define VALUE(c,i) (histogram->values[(c) * 256 + (i)])
+/**
+ * gimp_histogram_update:
+ * @histogram:   a %GimpHistogram
+ * @buffer:      the buffer to count
+ * @buffer_rect: the area of @buffer to count
+ * @mask:        a mask weighting the pixels, or %NULL
+ * @mask_rect:   the area of @mask matching @buffer_rect
+ * @update_rect: the part of @buffer that changed
+ *
+ * Updates @histogram after the pixels in @update_rect changed, by
+ * counting only the chunks touching @update_rect again. Falls back to
+ * gimp_histogram_calculate() if the buffers or areas are not the ones
+ * of the last calculation.
+ **/
+void
+gimp_histogram_update (GimpHistogram       *histogram,
+                       GeglBuffer          *buffer,
+                       const GeglRectangle *buffer_rect,
+                       GeglBuffer          *mask,
+                       const GeglRectangle *mask_rect,
+                       const GeglRectangle *update_rect)
+{
+  const Babl    *format;
+  GeglRectangle  rect;
+  gint          *chunks;
+  gint           n_chunks = 0;
+  gint           col1, col2;
+  gint           row1, row2;
+  gint           col, row;
 
-  while (gegl_buffer_iterator_next (iter))
+  g_return_if_fail (histogram != NULL);
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+  g_return_if_fail (buffer_rect != NULL);
+  g_return_if_fail (mask == NULL || mask_rect != NULL);
+  g_return_if_fail (update_rect != NULL);
+
+  format = gimp_histogram_get_format (histogram, buffer);
+
+  if (! histogram->chunk_values                                   ||
+      histogram->n_channels != babl_format_get_n_components (format) + 1 ||
+      histogram->buffer     != buffer                             ||
+      histogram->mask       != mask                               ||
+      histogram->has_mask   != (mask != NULL)                     ||
+      ! gegl_rectangle_equal (&histogram->buffer_rect, buffer_rect) ||
+      (mask && ! gegl_rectangle_equal (&histogram->mask_rect, mask_rect)))
     {
-      const guchar *data = iter->data[0];
-      gint          max;
-
-      if (mask)
-        {
-          const gfloat *mask_data = iter->data[1];
-
-          switch (n_components)
-            {
-            case 1:
-              while (iter->length--)
-                {
-                  const gdouble masked = *mask_data;
-
-                  VALUE (0, data[0]) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 2:
-              while (iter->length--)
-                {
-                  const gdouble masked = *mask_data;
-                  const gdouble weight = data[1] / 255.0;
-
-                  VALUE (0, data[0]) += weight * masked;
-                  VALUE (1, data[1]) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 3: /* calculate separate value values */
-              while (iter->length--)
-                {
-                  const gdouble masked = *mask_data;
-
-                  VALUE (1, data[0]) += masked;
-                  VALUE (2, data[1]) += masked;
-                  VALUE (3, data[2]) += masked;
-
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
-
-                  VALUE (0, max) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 4: /* calculate separate value values */
-              while (iter->length--)
-                {
-                  const gdouble masked = *mask_data;
-                  const gdouble weight = data[3] / 255.0;
-
-                  VALUE (1, data[0]) += weight * masked;
-                  VALUE (2, data[1]) += weight * masked;
-                  VALUE (3, data[2]) += weight * masked;
-                  VALUE (4, data[3]) += masked;
-
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
-
-                  VALUE (0, max) += weight * masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-            }
-        }
-      else /* no mask */
-        {
-          switch (n_components)
-            {
-            case 1:
-              while (iter->length--)
-                {
-                  VALUE (0, data[0]) += 1.0;
-
-                  data += n_components;
-                }
-              break;
-
-            case 2:
-              while (iter->length--)
-                {
-                  const gdouble weight = data[1] / 255.0;
-
-                  VALUE (0, data[0]) += weight;
-                  VALUE (1, data[1]) += 1.0;
-
-                  data += n_components;
-                }
-              break;
-
-            case 3: /* calculate separate value values */
-              while (iter->length--)
-                {
-                  VALUE (1, data[0]) += 1.0;
-                  VALUE (2, data[1]) += 1.0;
-                  VALUE (3, data[2]) += 1.0;
-
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
-
-                  VALUE (0, max) += 1.0;
-
-                  data += n_components;
-                }
-              break;
+      gimp_histogram_calculate (histogram,
+                                buffer, buffer_rect, mask, mask_rect);
+      return;
+    }
 
-            case 4: /* calculate separate value values */
-              while (iter->length--)
-                {
-                  const gdouble weight = data[3] / 255.0;
+  if (! gegl_rectangle_intersect (&rect, update_rect, buffer_rect))
+    return;
 
-                  VALUE (1, data[0]) += weight;
-                  VALUE (2, data[1]) += weight;
-                  VALUE (3, data[2]) += weight;
-                  VALUE (4, data[3]) += 1.0;
+  col1 = (rect.x - buffer_rect->x) / histogram->chunk_size;
+  col2 = (rect.x + rect.width - 1 - buffer_rect->x) / histogram->chunk_size;
+  row1 = (rect.y - buffer_rect->y) / histogram->chunk_size;
+  row2 = (rect.y + rect.height - 1 - buffer_rect->y) / histogram->chunk_size;
 
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
+  chunks = g_new (gint, (col2 - col1 + 1) * (row2 - row1 + 1));
 
-                  VALUE (0, max) += weight;
+  for (row = row1; row <= row2; row++)
+    for (col = col1; col <= col2; col++)
+      chunks[n_chunks++] = row * histogram->n_chunk_cols + col;
 
-                  data += n_components;
-                }
-              break;
-            }
-        }
-    }
+  gimp_histogram_calculate_chunks (histogram, format, chunks, n_chunks);
 
-#undef VALUE
+  g_free (chunks);
 }
 
 void
@@ -302,10 +320,12 @@ gimp_histogram_clear_values (GimpHistogram *histogram)
     }
 
   histogram->n_channels = 0;
+
+  gimp_histogram_clear_chunks (histogram);
 }
 
 
-#define HISTOGRAM_VALUE(c,i) (histogram->values[(c) * 256 + (i)])
+#define HISTOGRAM_VALUE(c,i) (histogram->values[(c) * histogram->n_bins + (i)])
 
 
 gdouble
@@ -326,14 +346,14 @@ gimp_histogram_get_maximum (GimpHistogram        *histogram,
     return 0.0;
 
   if (channel == GIMP_HISTOGRAM_RGB)
-    for (x = 0; x < 256; x++)
+    for (x = 0; x < histogram->n_bins; x++)
       {
         max = MAX (max, HISTOGRAM_VALUE (GIMP_HISTOGRAM_RED,   x));
         max = MAX (max, HISTOGRAM_VALUE (GIMP_HISTOGRAM_GREEN, x));
         max = MAX (max, HISTOGRAM_VALUE (GIMP_HISTOGRAM_BLUE,  x));
       }
   else
-    for (x = 0; x < 256; x++)
+    for (x = 0; x < histogram->n_bins; x++)
       {
         max = MAX (max, HISTOGRAM_VALUE (channel, x));
       }
@@ -353,7 +373,7 @@ gimp_histogram_get_value (GimpHistogram        *histogram,
     channel = 1;
 
   if (! histogram->values ||
-      bin < 0 || bin >= 256 ||
+      bin < 0 || bin >= histogram->n_bins ||
       (channel == GIMP_HISTOGRAM_RGB && histogram->n_channels < 4) ||
       (channel != GIMP_HISTOGRAM_RGB && channel >= histogram->n_channels))
     return 0.0;
@@ -393,6 +413,14 @@ gimp_histogram_n_channels (GimpHistogram *histogram)
   return histogram->n_channels - 1;
 }
 
+gint
+gimp_histogram_n_bins (GimpHistogram *histogram)
+{
+  g_return_val_if_fail (histogram != NULL, 0);
+
+  return histogram->n_bins;
+}
+
 gdouble
 gimp_histogram_get_count (GimpHistogram        *histogram,
                           GimpHistogramChannel  channel,
@@ -421,8 +449,8 @@ gimp_histogram_get_count (GimpHistogram        *histogram,
       channel >= histogram->n_channels)
     return 0.0;
 
-  start = CLAMP (start, 0, 255);
-  end   = CLAMP (end, 0, 255);
+  start = CLAMP (start, 0, histogram->n_bins - 1);
+  end   = CLAMP (end, 0, histogram->n_bins - 1);
 
   for (i = start; i <= end; i++)
     count += HISTOGRAM_VALUE (channel, i);
@@ -452,8 +480,8 @@ gimp_histogram_get_mean (GimpHistogram        *histogram,
       (channel != GIMP_HISTOGRAM_RGB && channel >= histogram->n_channels))
     return 0.0;
 
-  start = CLAMP (start, 0, 255);
-  end = CLAMP (end, 0, 255);
+  start = CLAMP (start, 0, histogram->n_bins - 1);
+  end   = CLAMP (end, 0, histogram->n_bins - 1);
 
   if (channel == GIMP_HISTOGRAM_RGB)
     {
@@ -498,8 +526,8 @@ gimp_histogram_get_median (GimpHistogram         *histogram,
       (channel != GIMP_HISTOGRAM_RGB && channel >= histogram->n_channels))
     return 0;
 
-  start = CLAMP (start, 0, 255);
-  end = CLAMP (end, 0, 255);
+  start = CLAMP (start, 0, histogram->n_bins - 1);
+  end   = CLAMP (end, 0, histogram->n_bins - 1);
 
   count = gimp_histogram_get_count (histogram, channel, start, end);
 
@@ -560,8 +588,8 @@ gimp_histogram_get_threshold (GimpHistogram        *histogram,
       (channel != GIMP_HISTOGRAM_RGB && channel >= histogram->n_channels))
     return 0;
 
-  start = CLAMP (start, 0, 255);
-  end = CLAMP (end, 0, 255);
+  start = CLAMP (start, 0, histogram->n_bins - 1);
+  end   = CLAMP (end, 0, histogram->n_bins - 1);
 
   maxval = end - start;
 
@@ -683,11 +711,477 @@ gimp_histogram_alloc_values (GimpHistogram *histogram,
 
       histogram->n_channels = bytes + 1;
 
-      histogram->values = g_new0 (gdouble, histogram->n_channels * 256);
+      histogram->values = g_new0 (gdouble,
+                                  histogram->n_channels * histogram->n_bins);
     }
   else
     {
-      memset (histogram->values,
-              0, histogram->n_channels * 256 * sizeof (gdouble));
+      memset (histogram->values, 0,
+              histogram->n_channels * histogram->n_bins * sizeof (gdouble));
+    }
+}
+
+static void
+gimp_histogram_alloc_chunks (GimpHistogram       *histogram,
+                             GeglBuffer          *buffer,
+                             const GeglRectangle *buffer_rect,
+                             GeglBuffer          *mask,
+                             const GeglRectangle *mask_rect)
+{
+  gsize chunk_bytes = histogram->n_channels * histogram->n_bins * sizeof (gdouble);
+  gint  chunk_size  = HISTOGRAM_CHUNK_SIZE;
+  gint  n_cols;
+  gint  n_rows;
+
+  gimp_histogram_clear_chunks (histogram);
+
+  /*  use larger chunks rather than more memory  */
+  while (TRUE)
+    {
+      n_cols = (MAX (buffer_rect->width,  0) + chunk_size - 1) / chunk_size;
+      n_rows = (MAX (buffer_rect->height, 0) + chunk_size - 1) / chunk_size;
+
+      if ((gsize) n_cols * n_rows * chunk_bytes <= HISTOGRAM_CACHE_SIZE ||
+          (n_cols == 1 && n_rows == 1))
+        break;
+
+      chunk_size *= 2;
+    }
+
+  histogram->buffer      = buffer;
+  histogram->buffer_rect = *buffer_rect;
+  g_object_add_weak_pointer (G_OBJECT (buffer),
+                             (gpointer *) &histogram->buffer);
+
+  if (mask)
+    {
+      histogram->mask      = mask;
+      histogram->mask_rect = *mask_rect;
+      histogram->has_mask  = TRUE;
+      g_object_add_weak_pointer (G_OBJECT (mask),
+                                 (gpointer *) &histogram->mask);
+    }
+
+  histogram->chunk_size   = chunk_size;
+  histogram->n_chunk_cols = n_cols;
+  histogram->n_chunk_rows = n_rows;
+  histogram->chunk_values = g_new (gdouble,
+                                   n_cols * n_rows *
+                                   histogram->n_channels * histogram->n_bins);
+}
+
+static void
+gimp_histogram_clear_chunks (GimpHistogram *histogram)
+{
+  if (histogram->buffer)
+    {
+      g_object_remove_weak_pointer (G_OBJECT (histogram->buffer),
+                                    (gpointer *) &histogram->buffer);
+      histogram->buffer = NULL;
+    }
+
+  if (histogram->mask)
+    {
+      g_object_remove_weak_pointer (G_OBJECT (histogram->mask),
+                                    (gpointer *) &histogram->mask);
+      histogram->mask = NULL;
+    }
+
+  if (histogram->chunk_values)
+    {
+      g_free (histogram->chunk_values);
+      histogram->chunk_values = NULL;
+    }
+
+  histogram->has_mask     = FALSE;
+  histogram->n_chunk_cols = 0;
+  histogram->n_chunk_rows = 0;
+}
+
+static const Babl *
+gimp_histogram_get_format (GimpHistogram *histogram,
+                           GeglBuffer    *buffer)
+{
+  const Babl        *format = gegl_buffer_get_format (buffer);
+  GimpImageBaseType  base_type;
+  GimpPrecision      precision;
+
+  if (babl_format_is_palette (format))
+    base_type = GIMP_RGB;
+  else
+    base_type = gimp_babl_format_get_base_type (format);
+
+  /*  256 bins are counted directly from 8 bit values  */
+  if (histogram->n_bins == 256)
+    precision = GIMP_PRECISION_U8;
+  else
+    precision = GIMP_PRECISION_FLOAT;
+
+  return gimp_babl_format (base_type, precision,
+                           babl_format_has_alpha (format));
+}
+
+static void
+gimp_histogram_calculate_chunks (GimpHistogram *histogram,
+                                 const Babl    *format,
+                                 const gint    *chunks,
+                                 gint           n_chunks)
+{
+  GimpHistogramChunks   data;
+  gint                  n_values     = histogram->n_channels * histogram->n_bins;
+  gint                  n_all        = histogram->n_chunk_cols * histogram->n_chunk_rows;
+  gint                  n_components = babl_format_get_n_components (format);
+  gint                  bpp          = babl_format_get_bytes_per_pixel (format);
+  guchar              **pixels;
+  gfloat              **mask_pixels;
+  const gdouble        *src;
+  gint                  i, j, k;
+
+  pixels      = g_new0 (guchar *, n_chunks);
+  mask_pixels = g_new0 (gfloat *, n_chunks);
+
+  data.histogram    = histogram;
+  data.n_components = n_components;
+
+  /*  GEGL may only be used from here, so the pixels are read in
+   *  batches, and the threads only count them
+   */
+  for (i = 0; i < n_chunks; i = j)
+    {
+      gsize batch_size = 0;
+
+      for (j = i; j < n_chunks && batch_size < HISTOGRAM_BATCH_SIZE; j++)
+        {
+          GeglRectangle area;
+          gint          n_pixels;
+
+          gimp_histogram_get_chunk_area (histogram, chunks[j], &area);
+
+          n_pixels = area.width * area.height;
+
+          pixels[j] = g_malloc (n_pixels * bpp);
+
+          gegl_buffer_get (histogram->buffer, &area, 1.0, format,
+                           pixels[j], GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+          batch_size += n_pixels * bpp;
+
+          if (histogram->has_mask)
+            {
+              mask_pixels[j] = g_new (gfloat, n_pixels);
+
+              gegl_buffer_get (histogram->mask,
+                               GEGL_RECTANGLE (histogram->mask_rect.x +
+                                               area.x -
+                                               histogram->buffer_rect.x,
+                                               histogram->mask_rect.y +
+                                               area.y -
+                                               histogram->buffer_rect.y,
+                                               area.width, area.height),
+                               1.0, babl_format ("Y float"),
+                               mask_pixels[j],
+                               GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+              batch_size += n_pixels * sizeof (gfloat);
+            }
+        }
+
+      data.chunks      = chunks      + i;
+      data.pixels      = pixels      + i;
+      data.mask_pixels = mask_pixels + i;
+
+      gimp_parallel_distribute_range (j - i, 1,
+                                      gimp_histogram_calculate_range,
+                                      &data);
+
+      for (k = i; k < j; k++)
+        {
+          g_free (pixels[k]);
+          g_free (mask_pixels[k]);
+        }
+    }
+
+  g_free (pixels);
+  g_free (mask_pixels);
+
+  /*  merge the partial histograms, always in the same order so the
+   *  sums don't depend on the number of threads
+   */
+  memset (histogram->values, 0, n_values * sizeof (gdouble));
+
+  for (i = 0, src = histogram->chunk_values; i < n_all; i++, src += n_values)
+    {
+      for (j = 0; j < n_values; j++)
+        histogram->values[j] += src[j];
+    }
+}
+
+static void
+gimp_histogram_get_chunk_area (GimpHistogram *histogram,
+                               gint           chunk,
+                               GeglRectangle *area)
+{
+  const GeglRectangle *rect       = &histogram->buffer_rect;
+  gint                 chunk_size = histogram->chunk_size;
+
+  area->x      = rect->x + (chunk % histogram->n_chunk_cols) * chunk_size;
+  area->y      = rect->y + (chunk / histogram->n_chunk_cols) * chunk_size;
+  area->width  = MIN (chunk_size, rect->x + rect->width  - area->x);
+  area->height = MIN (chunk_size, rect->y + rect->height - area->y);
+}
+
+static void
+gimp_histogram_calculate_range (gsize    offset,
+                                gsize    size,
+                                gpointer user_data)
+{
+  GimpHistogramChunks *data      = user_data;
+  GimpHistogram       *histogram = data->histogram;
+  gint                 n_values  = histogram->n_channels * histogram->n_bins;
+  gsize                i;
+
+  for (i = offset; i < offset + size; i++)
+    {
+      gint           chunk  = data->chunks[i];
+      gdouble       *values = histogram->chunk_values + chunk * n_values;
+      GeglRectangle  area;
+
+      gimp_histogram_get_chunk_area (histogram, chunk, &area);
+
+      memset (values, 0, n_values * sizeof (gdouble));
+
+      if (histogram->n_bins == 256)
+        gimp_histogram_calculate_pixels (values, data->n_components,
+                                         data->pixels[i],
+                                         data->mask_pixels[i],
+                                         area.width * area.height);
+      else
+        gimp_histogram_calculate_pixels_float (values, histogram->n_bins,
+                                               data->n_components,
+                                               (const gfloat *) data->pixels[i],
+                                               data->mask_pixels[i],
+                                               area.width * area.height);
     }
 }
+
+static void
+gimp_histogram_calculate_pixels (gdouble      *values,
+                                 gint          n_components,
+                                 const guchar *data,
+                                 const gfloat *mask_data,
+                                 gint          n_pixels)
+{
+  gint max;
+
+#define VALUE(c,i) (values[(c) * 256 + (i)])
+
+  if (mask_data)
+    {
+      switch (n_components)
+        {
+        case 1:
+          while (n_pixels--)
+            {
+              const gdouble masked = *mask_data;
+
+              VALUE (0, data[0]) += masked;
+
+              data += n_components;
+              mask_data += 1;
+            }
+          break;
+
+        case 2:
+          while (n_pixels--)
+            {
+              const gdouble masked = *mask_data;
+              const gdouble weight = data[1] / 255.0;
+
+              VALUE (0, data[0]) += weight * masked;
+              VALUE (1, data[1]) += masked;
+
+              data += n_components;
+              mask_data += 1;
+            }
+          break;
+
+        case 3: /* calculate separate value values */
+          while (n_pixels--)
+            {
+              const gdouble masked = *mask_data;
+
+              VALUE (1, data[0]) += masked;
+              VALUE (2, data[1]) += masked;
+              VALUE (3, data[2]) += masked;
+
+              max = MAX (data[0], data[1]);
+              max = MAX (data[2], max);
+
+              VALUE (0, max) += masked;
+
+              data += n_components;
+              mask_data += 1;
+            }
+          break;
+
+        case 4: /* calculate separate value values */
+          while (n_pixels--)
+            {
+              const gdouble masked = *mask_data;
+              const gdouble weight = data[3] / 255.0;
+
+              VALUE (1, data[0]) += weight * masked;
+              VALUE (2, data[1]) += weight * masked;
+              VALUE (3, data[2]) += weight * masked;
+              VALUE (4, data[3]) += masked;
+
+              max = MAX (data[0], data[1]);
+              max = MAX (data[2], max);
+
+              VALUE (0, max) += weight * masked;
+
+              data += n_components;
+              mask_data += 1;
+            }
+          break;
+        }
+    }
+  else /* no mask */
+    {
+      switch (n_components)
+        {
+        case 1:
+          while (n_pixels--)
+            {
+              VALUE (0, data[0]) += 1.0;
+
+              data += n_components;
+            }
+          break;
+
+        case 2:
+          while (n_pixels--)
+            {
+              const gdouble weight = data[1] / 255.0;
+
+              VALUE (0, data[0]) += weight;
+              VALUE (1, data[1]) += 1.0;
+
+              data += n_components;
+            }
+          break;
+
+        case 3: /* calculate separate value values */
+          while (n_pixels--)
+            {
+              VALUE (1, data[0]) += 1.0;
+              VALUE (2, data[1]) += 1.0;
+              VALUE (3, data[2]) += 1.0;
+
+              max = MAX (data[0], data[1]);
+              max = MAX (data[2], max);
+
+              VALUE (0, max) += 1.0;
+
+              data += n_components;
+            }
+          break;
+
+        case 4: /* calculate separate value values */
+          while (n_pixels--)
+            {
+              const gdouble weight = data[3] / 255.0;
+
+              VALUE (1, data[0]) += weight;
+              VALUE (2, data[1]) += weight;
+              VALUE (3, data[2]) += weight;
+              VALUE (4, data[3]) += 1.0;
+
+              max = MAX (data[0], data[1]);
+              max = MAX (data[2], max);
+
+              VALUE (0, max) += weight;
+
+              data += n_components;
+            }
+          break;
+        }
+    }
+
+#undef VALUE
+}
+
+/*  float pixels, spread over any number of bins. values outside of
+ *  [0, 1] are counted in the first and last bin, NaN is not counted
+ */
+static void
+gimp_histogram_calculate_pixels_float (gdouble      *values,
+                                       gint          n_bins,
+                                       gint          n_components,
+                                       const gfloat *data,
+                                       const gfloat *mask_data,
+                                       gint          n_pixels)
+{
+#define VALUE(c,i) (values[(c) * n_bins + (i)])
+#define BIN(v)     ((v) <= 0.0f ? 0                                  : \
+                    (v) >= 1.0f ? n_bins - 1                         : \
+                    (gint) ((v) * (n_bins - 1) + 0.5f))
+#define COUNT(c,v,w)                                                   \
+  G_STMT_START {                                                       \
+    const gfloat v_ = (v);                                             \
+                                                                       \
+    if (! isnan (v_))                                                  \
+      VALUE (c, BIN (v_)) += (w);                                      \
+  } G_STMT_END
+
+  while (n_pixels--)
+    {
+      const gdouble masked = mask_data ? *mask_data++ : 1.0;
+      gdouble       weight;
+      gfloat        max;
+
+      switch (n_components)
+        {
+        case 1:
+          COUNT (0, data[0], masked);
+          break;
+
+        case 2:
+          weight = isnan (data[1]) ? 0.0 : CLAMP (data[1], 0.0f, 1.0f);
+
+          COUNT (0, data[0], weight * masked);
+          COUNT (1, data[1], masked);
+          break;
+
+        case 3:
+        case 4:
+          if (n_components == 4)
+            weight = isnan (data[3]) ? 0.0 : CLAMP (data[3], 0.0f, 1.0f);
+          else
+            weight = 1.0;
+
+          COUNT (1, data[0], weight * masked);
+          COUNT (2, data[1], weight * masked);
+          COUNT (3, data[2], weight * masked);
+
+          if (n_components == 4)
+            COUNT (4, data[3], masked);
+
+          /*  the largest component which is a number  */
+          max = data[0];
+          if (isnan (max) || data[1] > max)
+            max = data[1];
+          if (isnan (max) || data[2] > max)
+            max = data[2];
+
+          COUNT (0, max, weight * masked);
+          break;
+        }
+
+      data += n_components;
+    }
+
+#undef COUNT
+#undef BIN
+#undef VALUE
+}
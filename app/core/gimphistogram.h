@@ -22,6 +22,7 @@
 
 
 GimpHistogram * gimp_histogram_new           (void);
+GimpHistogram * gimp_histogram_new_with_bins (gint                  n_bins);
 
 GimpHistogram * gimp_histogram_ref           (GimpHistogram        *histogram);
 void            gimp_histogram_unref         (GimpHistogram        *histogram);
@@ -33,6 +34,12 @@ void            gimp_histogram_calculate     (GimpHistogram        *histogram,
                                               const GeglRectangle  *buffer_rect,
                                               GeglBuffer           *mask,
                                               const GeglRectangle  *mask_rect);
+void            gimp_histogram_update        (GimpHistogram        *histogram,
+                                              GeglBuffer           *buffer,
+                                              const GeglRectangle  *buffer_rect,
+                                              GeglBuffer           *mask,
+                                              const GeglRectangle  *mask_rect,
+                                              const GeglRectangle  *update_rect);
 
 void            gimp_histogram_clear_values  (GimpHistogram        *histogram);
 
@@ -65,6 +72,7 @@ gdouble         gimp_histogram_get_channel   (GimpHistogram        *histogram,
                                               GimpHistogramChannel  channel,
                                               gint                  bin);
 gint            gimp_histogram_n_channels    (GimpHistogram        *histogram);
+gint            gimp_histogram_n_bins        (GimpHistogram        *histogram);
 
 
 #endif /* __GIMP_HISTOGRAM_H__ */
@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <cairo.h>
 #include <gegl.h>
@@ -36,13 +37,59 @@
 #include "gimppickable.h"
 
 
+/*  the seed fill keeps a few bands of rows in memory, each holding the
+ *  precomputed difference of every source pixel to the seed color and
+ *  the corresponding rows of the mask buffer
+ */
+#define BAND_HEIGHT 32
+#define N_BANDS      4
+
+
+typedef struct
+{
+  gint y;
+  gint start;
+  gint end;
+} ContiguousSpan;
+
+typedef struct
+{
+  gint      y;
+  gint      height;
+  guint     stamp;
+  gboolean  dirty;
+  gfloat   *diff;
+  gfloat   *mask;
+} ContiguousBand;
+
+typedef struct
+{
+  GeglBuffer          *src_buffer;
+  GeglBuffer          *mask_buffer;
+  const Babl          *format;
+  gint                 n_components;
+  gboolean             has_alpha;
+  gboolean             select_transparent;
+  GimpSelectCriterion  select_criterion;
+  gboolean             antialias;
+  gfloat               threshold;
+  const gfloat        *col;
+
+  gint                 width;
+  gint                 height;
+  gfloat              *src;
+  ContiguousBand       bands[N_BANDS];
+  guint                stamp;
+} ContiguousBandCache;
+
+
 /*  local function prototypes  */
 
 static const Babl * choose_format         (GeglBuffer          *buffer,
                                            GimpSelectCriterion  select_criterion,
                                            gint                *n_components,
                                            gboolean            *has_alpha);
-static gfloat   pixel_difference          (const gfloat        *col1,
+static inline gfloat pixel_difference     (const gfloat        *col1,
                                            const gfloat        *col2,
                                            gboolean             antialias,
                                            gfloat               threshold,
@@ -50,21 +97,27 @@ static gfloat   pixel_difference          (const gfloat        *col1,
                                            gboolean             has_alpha,
                                            gboolean             select_transparent,
                                            GimpSelectCriterion  select_criterion);
-static gboolean find_contiguous_segment   (const gfloat        *col,
-                                           GeglBuffer          *src_buffer,
-                                           GeglBuffer          *mask_buffer,
-                                           const Babl          *src_format,
+static void     pixel_difference_row      (const gfloat        *col,
+                                           const gfloat        *src,
+                                           gfloat              *dest,
+                                           gint                 n_pixels,
+                                           gboolean             antialias,
+                                           gfloat               threshold,
                                            gint                 n_components,
                                            gboolean             has_alpha,
-                                           gint                 width,
                                            gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 initial_x,
-                                           gint                 initial_y,
-                                           gint                *start,
-                                           gint                *end);
+                                           GimpSelectCriterion  select_criterion);
+
+static void     band_cache_init           (ContiguousBandCache *cache);
+static void     band_cache_flush          (ContiguousBandCache *cache,
+                                           ContiguousBand      *band);
+static void     band_cache_free           (ContiguousBandCache *cache);
+static void     band_cache_get_row        (ContiguousBandCache *cache,
+                                           gint                 y,
+                                           const gfloat       **diff_row,
+                                           gfloat             **mask_row,
+                                           ContiguousBand     **band);
+
 static void find_contiguous_region_helper (GeglBuffer          *src_buffer,
                                            GeglBuffer          *mask_buffer,
                                            const Babl          *format,
@@ -220,20 +273,14 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
       const gfloat *src  = iter->data[0];
       gfloat       *dest = iter->data[1];
 
-      while (iter->length--)
-        {
-          /*  Find how closely the colors match  */
-          *dest = pixel_difference (start_col, src,
-                                    antialias,
-                                    threshold,
-                                    n_components,
-                                    has_alpha,
-                                    select_transparent,
-                                    select_criterion);
-
-          src  += n_components;
-          dest += 1;
-        }
+      /*  Find how closely the colors match  */
+      pixel_difference_row (start_col, src, dest, iter->length,
+                            antialias,
+                            threshold,
+                            n_components,
+                            has_alpha,
+                            select_transparent,
+                            select_criterion);
     }
 
   return mask_buffer;
@@ -285,7 +332,7 @@ choose_format (GeglBuffer          *buffer,
   return format;
 }
 
-static gfloat
+static inline gfloat
 pixel_difference (const gfloat        *col1,
                   const gfloat        *col2,
                   gboolean             antialias,
@@ -379,81 +426,154 @@ pixel_difference (const gfloat        *col1,
     }
 }
 
-static gboolean
-find_contiguous_segment (const gfloat        *col,
-                         GeglBuffer          *src_buffer,
-                         GeglBuffer          *mask_buffer,
-                         const Babl          *format,
-                         gint                 n_components,
-                         gboolean             has_alpha,
-                         gint                 width,
-                         gboolean             select_transparent,
-                         GimpSelectCriterion  select_criterion,
-                         gboolean             antialias,
-                         gfloat               threshold,
-                         gint                 initial_x,
-                         gint                 initial_y,
-                         gint                *start,
-                         gint                *end)
+static void
+pixel_difference_row (const gfloat        *col,
+                      const gfloat        *src,
+                      gfloat              *dest,
+                      gint                 n_pixels,
+                      gboolean             antialias,
+                      gfloat               threshold,
+                      gint                 n_components,
+                      gboolean             has_alpha,
+                      gboolean             select_transparent,
+                      GimpSelectCriterion  select_criterion)
 {
-  gfloat s[MAX_CHANNELS];
-  gfloat mask_row[width];
-  gfloat diff;
+  /*  pixel_difference() is inlined here, so the compiler can hoist
+   *  the loop-invariant criterion and alpha tests out of the loop
+   */
+  while (n_pixels--)
+    {
+      *dest++ = pixel_difference (col, src,
+                                  antialias,
+                                  threshold,
+                                  n_components,
+                                  has_alpha,
+                                  select_transparent,
+                                  select_criterion);
+
+      src += n_components;
+    }
+}
 
-  gegl_buffer_sample (src_buffer, initial_x, initial_y, NULL, s, format,
-                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+static void
+band_cache_init (ContiguousBandCache *cache)
+{
+  gint i;
+
+  cache->width  = gegl_buffer_get_width  (cache->src_buffer);
+  cache->height = gegl_buffer_get_height (cache->src_buffer);
+  cache->src    = g_new (gfloat,
+                         cache->width * BAND_HEIGHT * cache->n_components);
+  cache->stamp  = 0;
 
-  diff = pixel_difference (col, s, antialias, threshold,
-                           n_components, has_alpha, select_transparent,
-                           select_criterion);
+  for (i = 0; i < N_BANDS; i++)
+    {
+      ContiguousBand *band = &cache->bands[i];
+
+      band->y      = -1;
+      band->height = 0;
+      band->stamp  = 0;
+      band->dirty  = FALSE;
+      band->diff   = g_new (gfloat, cache->width * BAND_HEIGHT);
+      band->mask   = g_new (gfloat, cache->width * BAND_HEIGHT);
+    }
+}
 
-  /* check the starting pixel */
-  if (! diff)
-    return FALSE;
+static void
+band_cache_flush (ContiguousBandCache *cache,
+                  ContiguousBand      *band)
+{
+  if (band->dirty)
+    {
+      gegl_buffer_set (cache->mask_buffer,
+                       GEGL_RECTANGLE (0, band->y,
+                                       cache->width, band->height),
+                       0, babl_format ("Y float"), band->mask,
+                       GEGL_AUTO_ROWSTRIDE);
 
-  mask_row[initial_x] = diff;
+      band->dirty = FALSE;
+    }
+}
 
-  *start = initial_x - 1;
+static void
+band_cache_free (ContiguousBandCache *cache)
+{
+  gint i;
 
-  while (*start >= 0 && diff)
+  for (i = 0; i < N_BANDS; i++)
     {
-      gegl_buffer_sample (src_buffer, *start, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+      ContiguousBand *band = &cache->bands[i];
 
-      mask_row[*start] = diff;
+      if (band->y >= 0)
+        band_cache_flush (cache, band);
 
-      if (diff)
-        (*start)--;
+      g_free (band->diff);
+      g_free (band->mask);
     }
 
-  diff = 1;
-  *end = initial_x + 1;
+  g_free (cache->src);
+}
+
+static void
+band_cache_get_row (ContiguousBandCache  *cache,
+                    gint                  y,
+                    const gfloat        **diff_row,
+                    gfloat              **mask_row,
+                    ContiguousBand      **band)
+{
+  ContiguousBand *lru = NULL;
+  gint            i;
 
-  while (*end < width && diff)
+  for (i = 0; i < N_BANDS; i++)
     {
-      gegl_buffer_sample (src_buffer, *end, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+      ContiguousBand *b = &cache->bands[i];
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+      if (b->y >= 0 && y >= b->y && y < b->y + b->height)
+        {
+          lru = b;
+          break;
+        }
 
-      mask_row[*end] = diff;
+      if (! lru || b->stamp < lru->stamp)
+        lru = b;
+    }
 
-      if (diff)
-        (*end)++;
+  if (i == N_BANDS)
+    {
+      /*  miss, replace the least recently used band by the one
+       *  containing y, reading all its rows at once
+       */
+      if (lru->y >= 0)
+        band_cache_flush (cache, lru);
+
+      lru->y      = y - y % BAND_HEIGHT;
+      lru->height = MIN (BAND_HEIGHT, cache->height - lru->y);
+
+      gegl_buffer_get (cache->src_buffer,
+                       GEGL_RECTANGLE (0, lru->y, cache->width, lru->height),
+                       1.0, cache->format, cache->src,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+      pixel_difference_row (cache->col, cache->src, lru->diff,
+                            cache->width * lru->height,
+                            cache->antialias,
+                            cache->threshold,
+                            cache->n_components,
+                            cache->has_alpha,
+                            cache->select_transparent,
+                            cache->select_criterion);
+
+      gegl_buffer_get (cache->mask_buffer,
+                       GEGL_RECTANGLE (0, lru->y, cache->width, lru->height),
+                       1.0, babl_format ("Y float"), lru->mask,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
     }
 
-  gegl_buffer_set (mask_buffer, GEGL_RECTANGLE (*start, initial_y,
-                                                *end - *start, 1),
-                   0, babl_format ("Y float"), &mask_row[*start],
-                   GEGL_AUTO_ROWSTRIDE);
+  lru->stamp = ++cache->stamp;
 
-  return TRUE;
+  *diff_row = lru->diff + (y - lru->y) * cache->width;
+  *mask_row = lru->mask + (y - lru->y) * cache->width;
+  *band     = lru;
 }
 
 static void
@@ -470,63 +590,92 @@ find_contiguous_region_helper (GeglBuffer          *src_buffer,
                                gint                 y,
                                const gfloat        *col)
 {
-  gint    start, end;
-  gint    new_start, new_end;
-  GQueue *coord_stack;
-
-  coord_stack = g_queue_new ();
-
-  /* To avoid excessive memory allocation (y, start, end) tuples are
-   * stored in interleaved format:
-   *
-   * [y1] [start1] [end1] [y2] [start2] [end2]
+  ContiguousBandCache  cache = { 0, };
+  GArray              *stack;
+  ContiguousSpan       span;
+
+  cache.src_buffer         = src_buffer;
+  cache.mask_buffer        = mask_buffer;
+  cache.format             = format;
+  cache.n_components       = n_components;
+  cache.has_alpha          = has_alpha;
+  cache.select_transparent = select_transparent;
+  cache.select_criterion   = select_criterion;
+  cache.antialias          = antialias;
+  cache.threshold          = threshold;
+  cache.col                = col;
+
+  if (x < 0 || x >= gegl_buffer_get_width  (src_buffer) ||
+      y < 0 || y >= gegl_buffer_get_height (src_buffer))
+    return;
+
+  band_cache_init (&cache);
+
+  /*  (y, start, end) spans with exclusive start and end, popped from
+   *  the end of the array so its storage is reused
    */
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (y));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x - 1));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x + 1));
+  stack = g_array_sized_new (FALSE, FALSE, sizeof (ContiguousSpan), 256);
+
+  span.y     = y;
+  span.start = x - 1;
+  span.end   = x + 1;
+  g_array_append_val (stack, span);
 
-  do
+  while (stack->len > 0)
     {
-      y     = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      start = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      end   = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
+      ContiguousBand *band;
+      const gfloat   *diff_row;
+      gfloat         *mask_row;
+
+      span = g_array_index (stack, ContiguousSpan, stack->len - 1);
+      g_array_set_size (stack, stack->len - 1);
+
+      band_cache_get_row (&cache, span.y, &diff_row, &mask_row, &band);
 
-      for (x = start + 1; x < end; x++)
+      for (x = span.start + 1; x < span.end; x++)
         {
-          gfloat val;
+          ContiguousSpan new_span;
+          gint           start;
+          gint           end;
 
-          gegl_buffer_sample (mask_buffer, x, y, NULL, &val,
-                              babl_format ("Y float"),
-                              GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-          if (val != 0.0)
+          if (mask_row[x] != 0.0 || diff_row[x] == 0.0)
             continue;
 
-          if (! find_contiguous_segment (col, src_buffer, mask_buffer,
-                                         format,
-                                         n_components,
-                                         has_alpha,
-                                         gegl_buffer_get_width (src_buffer),
-                                         select_transparent, select_criterion,
-                                         antialias, threshold, x, y,
-                                         &new_start, &new_end))
-            continue;
+          /*  segments are maximal runs of matching pixels, so a matching
+           *  pixel that isn't in the mask yet can't border one that is
+           */
+          start = x - 1;
+          while (start >= 0 && diff_row[start] != 0.0)
+            start--;
+
+          end = x + 1;
+          while (end < cache.width && diff_row[end] != 0.0)
+            end++;
+
+          memcpy (mask_row + start + 1, diff_row + start + 1,
+                  (end - start - 1) * sizeof (gfloat));
+          band->dirty = TRUE;
 
-          if (y + 1 < gegl_buffer_get_height (src_buffer))
+          new_span.start = start;
+          new_span.end   = end;
+
+          if (span.y + 1 < cache.height)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y + 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              new_span.y = span.y + 1;
+              g_array_append_val (stack, new_span);
             }
 
-          if (y - 1 >= 0)
+          if (span.y - 1 >= 0)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y - 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              new_span.y = span.y - 1;
+              g_array_append_val (stack, new_span);
             }
+
+          x = end;
         }
     }
-  while (! g_queue_is_empty (coord_stack));
 
-  g_queue_free (coord_stack);
+  g_array_free (stack, TRUE);
+
+  band_cache_free (&cache);
 }
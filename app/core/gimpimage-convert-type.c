@@ -144,6 +144,7 @@
 #include "gegl/gimp-gegl-utils.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimpcontainer.h"
 #include "gimpdrawable.h"
 #include "gimperror.h"
@@ -187,14 +188,32 @@
 #define G_SCALE 24              /*  scale G (a*) distances by this much  */
 #define B_SCALE 26              /*  and B (b*) by this much              */
 
+/*  the histogram of a layer is counted in parallel parts of at least
+ *  this many pixels, each into its own partial histogram
+ */
+#define HISTOGRAM_PART_PIXELS (512 * 512)
+
+/*  layers are remapped in parallel bands of this many rows.  the
+ *  floyd-steinberg error is not carried over from one band to the next,
+ *  so this is kept a fixed size, and the result doesn't depend on the
+ *  number of threads
+ */
+#define PASS2_BAND_HEIGHT 256
+
+/*  the pixels of the bands remapped together are held in memory, up to
+ *  about this many bytes
+ */
+#define PASS2_BATCH_SIZE (64 * 1024 * 1024)
+
 
 typedef struct _Color Color;
 typedef struct _QuantizeObj QuantizeObj;
+typedef struct _Pass2Band Pass2Band;
 typedef void (* Pass1_Func)   (QuantizeObj *quantize_obj);
 typedef void (* Pass2i_Func)  (QuantizeObj *quantize_obj);
-typedef void (* Pass2_Func)   (QuantizeObj *quantize_obj,
-                               GimpLayer   *layer,
-                               GeglBuffer  *new_buffer);
+typedef void (* Pass2_Func)   (QuantizeObj         *quantize_obj,
+                               const Pass2Band     *band,
+                               gulong              *index_used_count);
 typedef void (* Cleanup_Func) (QuantizeObj *quantize_obj);
 typedef unsigned long ColorFreq;
 typedef ColorFreq *CFHistogram;
@@ -468,13 +487,13 @@ struct _QuantizeObj
   Color clin[256];                  /* .. converted back to linear space */
   gulong index_used_count[256];     /* how many times an index was used */
   CFHistogram histogram;            /* holds the histogram               */
+  gint *inverse_cmap;               /* colormap index + 1 per histogram
+                                       cell, 0 until it is looked up     */
 
   gboolean want_alpha_dither;
   int      error_freedom;           /* 0=much bleed, 1=controlled bleed */
 
   GimpProgress *progress;
-  gint          nth_layer;
-  gint          n_layers;
 };
 
 typedef struct
@@ -502,6 +521,25 @@ typedef struct
 
 } box, *boxptr;
 
+/*  the pass2 functions only see the band's pixels in memory, they
+ *  are fetched and stored around them on the calling thread
+ */
+struct _Pass2Band
+{
+  GimpLayer     *layer;
+  GeglBuffer    *new_buffer;
+  GeglRectangle  area;
+
+  gint           offset_x;
+  gint           offset_y;
+  gboolean       is_gray;
+  const Babl    *src_format;
+  const Babl    *dest_format;
+
+  guchar        *src;
+  guchar        *dest;
+};
+
 
 static void zero_histogram_gray     (CFHistogram   histogram);
 static void zero_histogram_rgb      (CFHistogram   histogram);
@@ -528,6 +566,10 @@ static void          compute_color_lin8    (QuantizeObj           *quantobj,
                                             boxptr                 boxp,
                                             const int              icolor);
 
+static void          median_cut_pass2_bands (QuantizeObj         *quantobj,
+                                             Pass2Band           *bands,
+                                             gint                 n_bands);
+
 
 static guchar    found_cols[MAXNUMCOLORS][3];
 static gint      num_found_cols;
@@ -728,8 +770,16 @@ color_quicksort (const void *c1,
     return -1;
   else if (v1 > v2)
     return 1;
+
+  /*  break ties by the components, so the order of the colormap
+   *  doesn't depend on the order the colors were found in
+   */
+  if (color1->red != color2->red)
+    return color1->red - color2->red;
+  else if (color1->green != color2->green)
+    return color1->green - color2->green;
   else
-    return 0;
+    return color1->blue - color2->blue;
 }
 
 gboolean
@@ -753,6 +803,7 @@ gimp_image_convert_type (GimpImage               *image,
   GList             *all_layers;
   GList             *list;
   const gchar       *undo_desc = NULL;
+  GArray            *bands;
   gint               nth_layer, n_layers;
 
   g_return_val_if_fail (GIMP_IS_IMAGE (image), FALSE);
@@ -965,13 +1016,12 @@ gimp_image_convert_type (GimpImage               *image,
       break;
     }
 
-  /*  Convert all layers  */
-  if (quantobj)
-    quantobj->n_layers = n_layers;
+  /*  Convert all layers, the ones to quantize are collected in bands
+   *  which are remapped in parallel below
+   */
+  bands = g_array_new (FALSE, FALSE, sizeof (Pass2Band));
 
-  for (list = all_layers, nth_layer = 0;
-       list;
-       list = g_list_next (list), nth_layer++)
+  for (list = all_layers; list; list = g_list_next (list))
     {
       GimpLayer *layer    = list->data;
       gboolean   quantize = FALSE;
@@ -996,24 +1046,41 @@ gimp_image_convert_type (GimpImage               *image,
 
       if (quantize)
         {
-          GeglBuffer *new_buffer;
-          gboolean    has_alpha;
+          Pass2Band band;
+          gboolean  has_alpha;
+          gint      width;
+          gint      height;
+          gint      y;
 
           has_alpha = gimp_drawable_has_alpha (GIMP_DRAWABLE (layer));
 
-          new_buffer =
-            gegl_buffer_new (GEGL_RECTANGLE (0, 0,
-                                             gimp_item_get_width  (GIMP_ITEM (layer)),
-                                             gimp_item_get_height (GIMP_ITEM (layer))),
+          width  = gimp_item_get_width  (GIMP_ITEM (layer));
+          height = gimp_item_get_height (GIMP_ITEM (layer));
+
+          band.layer      = layer;
+          band.new_buffer =
+            gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height),
                              gimp_image_get_layer_format (image,
                                                           has_alpha));
 
-          quantobj->nth_layer = nth_layer;
-          quantobj->second_pass (quantobj, layer, new_buffer);
+          gimp_item_get_offset (GIMP_ITEM (layer),
+                                &band.offset_x, &band.offset_y);
+
+          band.is_gray     = gimp_drawable_is_gray (GIMP_DRAWABLE (layer));
+          band.src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
+          band.dest_format = gegl_buffer_get_format (band.new_buffer);
+          band.src         = NULL;
+          band.dest        = NULL;
+
+          for (y = 0; y < height; y += PASS2_BAND_HEIGHT)
+            {
+              band.area.x      = 0;
+              band.area.y      = y;
+              band.area.width  = width;
+              band.area.height = MIN (PASS2_BAND_HEIGHT, height - y);
 
-          gimp_drawable_set_buffer (GIMP_DRAWABLE (layer), TRUE, NULL,
-                                    new_buffer);
-          g_object_unref (new_buffer);
+              g_array_append_val (bands, band);
+            }
         }
       else
         {
@@ -1024,6 +1091,29 @@ gimp_image_convert_type (GimpImage               *image,
         }
     }
 
+  if (bands->len > 0)
+    {
+      guint i;
+
+      median_cut_pass2_bands (quantobj,
+                              (Pass2Band *) bands->data, bands->len);
+
+      /*  set the new buffers in layer order, once per layer  */
+      for (i = 0; i < bands->len; i++)
+        {
+          Pass2Band *band = &g_array_index (bands, Pass2Band, i);
+
+          if (band->area.y == 0)
+            {
+              gimp_drawable_set_buffer (GIMP_DRAWABLE (band->layer), TRUE, NULL,
+                                        band->new_buffer);
+              g_object_unref (band->new_buffer);
+            }
+        }
+    }
+
+  g_array_free (bands, TRUE);
+
   /*  Set the final palette on the image  */
   switch (new_type)
     {
@@ -1177,208 +1267,346 @@ generate_histogram_gray (CFHistogram  histogram,
 }
 
 
+typedef struct
+{
+  ColorFreq *histogram;
+  guchar     found_cols[MAXNUMCOLORS][3];
+  gint       num_found_cols;
+  gboolean   needs_quantize;
+} HistogramPart;
+
+typedef struct
+{
+  const Babl    *format;
+  CFHistogram    histogram;
+  gint           col_limit;
+  gboolean       alpha_dither;
+  gint           offsetx;
+  gint           offsety;
+  gint           width;
+  const guchar  *pixels;
+  gint           band_y;
+  gint           band_height;
+  HistogramPart *parts;
+} HistogramData;
+
 static void
-generate_histogram_rgb (CFHistogram   histogram,
-                        GimpLayer    *layer,
-                        gint          col_limit,
-                        gboolean      alpha_dither,
-                        GimpProgress *progress,
-                        gint          nth_layer,
-                        gint          n_layers)
+generate_histogram_rgb_part (gint     i,
+                             gint     n,
+                             gpointer user_data)
 {
-  GeglBufferIterator *iter;
-  const Babl         *format;
-  GeglRectangle      *roi;
+  HistogramData      *data         = user_data;
+  HistogramPart      *part         = &data->parts[i];
+  gint                col_limit    = data->col_limit;
+  gboolean            alpha_dither = data->alpha_dither;
+  const guchar       *src;
+  gint                y;
+  gint                height;
+  gsize               n_pixels;
   ColorFreq          *colfreq;
   gint                nfc_iter;
   gint                row, col, coledge;
-  gint                offsetx, offsety;
-  glong               layer_size;
-  glong               total_size = 0;
-  gint                count      = 0;
   gint                bpp;
   gboolean            has_alpha;
 
-  format = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
+  bpp       = babl_format_get_bytes_per_pixel (data->format);
+  has_alpha = babl_format_has_alpha (data->format);
 
-  g_return_if_fail (format == babl_format ("R'G'B' u8") ||
-                    format == babl_format ("R'G'B'A u8"));
+  y      = (gint64) data->band_height * i / n;
+  height = (gint64) data->band_height * (i + 1) / n - y;
 
-  bpp       = babl_format_get_bytes_per_pixel (format);
-  has_alpha = babl_format_has_alpha (format);
+  /*  the first part counts into the histogram itself, the others into
+   *  partial histograms which are kept over all bands and added up
+   *  afterwards
+   */
+  if (! part->histogram)
+    {
+      if (i == 0)
+        part->histogram = data->histogram;
+      else
+        part->histogram = g_new0 (ColorFreq,
+                                  HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS);
+    }
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  if (height <= 0)
+    return;
 
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
+  src      = data->pixels + (gsize) y * data->width * bpp;
+  n_pixels = (gsize) height * data->width;
 
-  /*  g_printerr ("col_limit = %d, nfc = %d\n", col_limit, num_found_cols); */
+  if (part->needs_quantize)
+    {
+      if (alpha_dither)
+        {
+          /* if alpha-dithering,
+             we need to be deterministic w.r.t. offsets */
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, format,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-  roi = &iter->roi[0];
+          col = data->offsetx;
+          coledge = col + data->width;
+          row = data->band_y + y + data->offsety;
 
-  if (progress)
-    gimp_progress_set_value (progress, 0.0);
+          while (n_pixels--)
+            {
+              gboolean transparent = FALSE;
 
-  while (gegl_buffer_iterator_next (iter))
-    {
-      const guchar *data = iter->data[0];
+              if (has_alpha &&
+                  src[ALPHA] <
+                  DM[col & DM_WIDTHMASK][row & DM_HEIGHTMASK])
+                transparent = TRUE;
 
-      total_size += iter->length;
+              if (! transparent)
+                {
+                  colfreq = HIST_RGB (part->histogram,
+                                      src[RED],
+                                      src[GREEN],
+                                      src[BLUE]);
+                  (*colfreq)++;
+                }
 
-      /* g_printerr (" [%d,%d - %d,%d]", srcPR.x, src_roi->y, offsetx, offsety); */
+              col++;
+              if (col == coledge)
+                {
+                  col = data->offsetx;
+                  row++;
+                }
 
-      if (needs_quantize)
+              src += bpp;
+            }
+        }
+      else
         {
-          if (alpha_dither)
+          while (n_pixels--)
             {
-              /* if alpha-dithering,
-                 we need to be deterministic w.r.t. offsets */
+              if ((has_alpha && ((src[ALPHA] > 127)))
+                  || (!has_alpha))
+                {
+                  colfreq = HIST_RGB (part->histogram,
+                                      src[RED],
+                                      src[GREEN],
+                                      src[BLUE]);
+                  (*colfreq)++;
+                }
+
+              src += bpp;
+            }
+        }
+    }
+  else
+    {
+      /* if alpha-dithering, we need to be deterministic w.r.t. offsets */
+      col = data->offsetx;
+      coledge = col + data->width;
+      row = data->band_y + y + data->offsety;
 
-              col = roi->x + offsetx;
-              coledge = col + roi->width;
-              row = roi->y + offsety;
+      while (n_pixels--)
+        {
+          gboolean transparent = FALSE;
 
-              while (iter->length--)
+          if (has_alpha)
+            {
+              if (alpha_dither)
                 {
-                  gboolean transparent = FALSE;
-
-                  if (has_alpha &&
-                      data[ALPHA] <
+                  if (src[ALPHA] <
                       DM[col & DM_WIDTHMASK][row & DM_HEIGHTMASK])
                     transparent = TRUE;
+                }
+              else
+                {
+                  if (src[ALPHA] <= 127)
+                    transparent = TRUE;
+                }
+            }
 
-                  if (! transparent)
+          if (! transparent)
+            {
+              colfreq = HIST_RGB (part->histogram,
+                                  src[RED],
+                                  src[GREEN],
+                                  src[BLUE]);
+              (*colfreq)++;
+
+              if (! part->needs_quantize)
+                {
+                  for (nfc_iter = part->num_found_cols - 1;
+                       nfc_iter >= 0;
+                       nfc_iter--)
                     {
-                      colfreq = HIST_RGB (histogram,
-                                          data[RED],
-                                          data[GREEN],
-                                          data[BLUE]);
-                      (*colfreq)++;
+                      if ((src[RED]   == part->found_cols[nfc_iter][0]) &&
+                          (src[GREEN] == part->found_cols[nfc_iter][1]) &&
+                          (src[BLUE]  == part->found_cols[nfc_iter][2]))
+                        goto already_found;
                     }
 
-                  col++;
-                  if (col == coledge)
+                  /* Colour was not in the table of
+                   * existing colours
+                   */
+
+                  if (part->num_found_cols == col_limit)
                     {
-                      col = roi->x + offsetx;
-                      row++;
+                      /* There are more colours in this part than
+                       *  were allowed, so there are more in the
+                       *  image.  We switch to plain histogram
+                       *  calculation with a view to quantizing at
+                       *  a later stage.
+                       */
+                      part->needs_quantize = TRUE;
                     }
-
-                  data += bpp;
-                }
-            }
-          else
-            {
-              while (iter->length--)
-                {
-                  if ((has_alpha && ((data[ALPHA] > 127)))
-                      || (!has_alpha))
+                  else
                     {
-                      colfreq = HIST_RGB (histogram,
-                                          data[RED],
-                                          data[GREEN],
-                                          data[BLUE]);
-                      (*colfreq)++;
+                      /* Remember the new colour we just found.
+                       */
+                      part->found_cols[part->num_found_cols][0] = src[RED];
+                      part->found_cols[part->num_found_cols][1] = src[GREEN];
+                      part->found_cols[part->num_found_cols][2] = src[BLUE];
+                      part->num_found_cols++;
                     }
-
-                  data += bpp;
                 }
             }
+        already_found:
+
+          col++;
+          if (col == coledge)
+            {
+              col = data->offsetx;
+              row++;
+            }
+
+          src += bpp;
         }
-      else
+    }
+}
+
+static void
+generate_histogram_rgb (CFHistogram   histogram,
+                        GimpLayer    *layer,
+                        gint          col_limit,
+                        gboolean      alpha_dither,
+                        GimpProgress *progress,
+                        gint          nth_layer,
+                        gint          n_layers)
+{
+  HistogramData  data;
+  GeglBuffer    *buffer;
+  const Babl    *format;
+  guchar        *pixels;
+  gint           height;
+  gint           band_rows;
+  gint           max_n;
+  gint           i, j;
+
+  format = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
+
+  g_return_if_fail (format == babl_format ("R'G'B' u8") ||
+                    format == babl_format ("R'G'B'A u8"));
+
+  buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  height = gimp_item_get_height (GIMP_ITEM (layer));
+
+  data.format       = format;
+  data.histogram    = histogram;
+  data.col_limit    = col_limit;
+  data.alpha_dither = alpha_dither;
+  data.width        = gimp_item_get_width  (GIMP_ITEM (layer));
+
+  gimp_item_get_offset (GIMP_ITEM (layer), &data.offsetx, &data.offsety);
+
+  /*  g_printerr ("col_limit = %d, nfc = %d\n", col_limit, num_found_cols); */
+
+  max_n = CLAMP ((gint64) data.width * height / HISTOGRAM_PART_PIXELS,
+                 1, gimp_parallel_get_n_threads ());
+
+  /*  the layer is read in bands of rows on this thread, only the
+   *  counting is done in parallel, from memory
+   */
+  band_rows = CLAMP ((gint64) HISTOGRAM_PART_PIXELS * max_n /
+                     MAX (data.width, 1),
+                     1, MAX (height, 1));
+
+  pixels = g_malloc ((gsize) band_rows * data.width *
+                     babl_format_get_bytes_per_pixel (format));
+
+  data.pixels = pixels;
+
+  data.parts = g_new (HistogramPart, max_n);
+
+  /*  parts which were not used by gimp_parallel_distribute() stay empty  */
+  for (i = 0; i < max_n; i++)
+    {
+      data.parts[i].histogram      = NULL;
+      data.parts[i].num_found_cols = 0;
+      data.parts[i].needs_quantize = needs_quantize;
+    }
+
+  for (data.band_y = 0; data.band_y < height; data.band_y += band_rows)
+    {
+      data.band_height = MIN (band_rows, height - data.band_y);
+
+      gegl_buffer_get (buffer,
+                       GEGL_RECTANGLE (0, data.band_y,
+                                       data.width, data.band_height),
+                       1.0, format, pixels,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+      gimp_parallel_distribute (max_n, generate_histogram_rgb_part, &data);
+    }
+
+  g_free (pixels);
+
+  for (i = 0; i < max_n; i++)
+    {
+      HistogramPart *part = &data.parts[i];
+
+      if (part->histogram && part->histogram != histogram)
         {
-          /* if alpha-dithering, we need to be deterministic w.r.t. offsets */
-          col = roi->x + offsetx;
-          coledge = col + roi->width;
-          row = roi->y + offsety;
+          for (j = 0; j < HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS; j++)
+            histogram[j] += part->histogram[j];
 
-          while (iter->length--)
-            {
-	      gboolean transparent = FALSE;
-
-	      if (has_alpha)
-	        {
-		  if (alpha_dither)
-		    {
-		      if (data[ALPHA] <
-                          DM[col & DM_WIDTHMASK][row & DM_HEIGHTMASK])
-		  	transparent = TRUE;
-		    }
-		  else
-		    {
-		      if (data[ALPHA] <= 127)
-			transparent = TRUE;
-		    }
-		}
-
-	      if (! transparent)
-                {
-                  colfreq = HIST_RGB (histogram,
-                                      data[RED],
-                                      data[GREEN],
-                                      data[BLUE]);
-                  (*colfreq)++;
+          g_free (part->histogram);
+        }
 
-                  if (!needs_quantize)
-                    {
-                      for (nfc_iter = 0;
-                           nfc_iter < num_found_cols;
-                           nfc_iter++)
-                        {
-                          if ((data[RED]   == found_cols[nfc_iter][0]) &&
-                              (data[GREEN] == found_cols[nfc_iter][1]) &&
-                              (data[BLUE]  == found_cols[nfc_iter][2]))
-                            goto already_found;
-                        }
-
-                      /* Colour was not in the table of
-                       * existing colours
-                       */
+      /*  add the colours found in this part to the table of existing
+       *  colours, the order doesn't matter because the colormap is
+       *  sorted later
+       */
+      if (part->needs_quantize)
+        needs_quantize = TRUE;
 
-                      num_found_cols++;
-
-                      if (num_found_cols > col_limit)
-                        {
-                          /* There are more colours in the image
-                           *  than were allowed.  We switch to plain
-                           *  histogram calculation with a view to
-                           *  quantizing at a later stage.
-                           */
-                          needs_quantize = TRUE;
-                          /* g_print ("\nmax colours exceeded - needs quantize.\n");*/
-                          goto already_found;
-                        }
-                      else
-                        {
-                          /* Remember the new colour we just found.
-                           */
-                          found_cols[num_found_cols-1][0] = data[RED];
-                          found_cols[num_found_cols-1][1] = data[GREEN];
-                          found_cols[num_found_cols-1][2] = data[BLUE];
-                        }
-                    }
-                }
-            already_found:
+      for (j = 0; j < part->num_found_cols && ! needs_quantize; j++)
+        {
+          gint nfc_iter;
 
-              col++;
-              if (col == coledge)
-                {
-                  col = roi->x + offsetx;
-                  row++;
-                }
+          for (nfc_iter = 0; nfc_iter < num_found_cols; nfc_iter++)
+            {
+              if ((part->found_cols[j][0] == found_cols[nfc_iter][0]) &&
+                  (part->found_cols[j][1] == found_cols[nfc_iter][1]) &&
+                  (part->found_cols[j][2] == found_cols[nfc_iter][2]))
+                break;
+            }
 
-              data += bpp;
+          if (nfc_iter < num_found_cols)
+            continue;
+
+          if (num_found_cols == col_limit)
+            {
+              /* g_print ("\nmax colours exceeded - needs quantize.\n");*/
+              needs_quantize = TRUE;
+            }
+          else
+            {
+              found_cols[num_found_cols][0] = part->found_cols[j][0];
+              found_cols[num_found_cols][1] = part->found_cols[j][1];
+              found_cols[num_found_cols][2] = part->found_cols[j][2];
+              num_found_cols++;
             }
         }
-
-      if (progress && (count % 16 == 0))
-        gimp_progress_set_value (progress,
-                                 (nth_layer + ((gdouble) total_size)/
-                                  layer_size) / (gdouble) n_layers);
     }
 
+  g_free (data.parts);
+
+  if (progress)
+    gimp_progress_set_value (progress,
+                             (gdouble) (nth_layer + 1) / (gdouble) n_layers);
+
 /*  g_print ("O: col_limit = %d, nfc = %d\n", col_limit, num_found_cols);*/
 }
 
@@ -2319,16 +2547,18 @@ select_colors_rgb (QuantizeObj *quantobj,
  * These routines are concerned with the time-critical task of mapping input
  * colors to the nearest color in the selected colormap.
  *
- * We re-use the histogram space as an "inverse color map", essentially a
- * cache for the results of nearest-color searches.  All colors within a
- * histogram cell will be mapped to the same colormap entry, namely the one
- * closest to the cell's center.  This may not be quite the closest entry to
- * the actual input color, but it's almost as good.  A zero in the cache
+ * We keep an "inverse color map" with one entry per histogram cell,
+ * essentially a cache for the results of nearest-color searches.  All colors
+ * within a histogram cell will be mapped to the same colormap entry, namely
+ * the one closest to the cell's center.  This may not be quite the closest
+ * entry to the actual input color, but it's almost as good.  A zero in the cache
  * indicates we haven't found the nearest color for that cell yet; the array
  * is cleared to zeroes before starting the mapping pass.  When we find the
  * nearest color for a cell, its colormap index plus one is recorded in the
  * cache for future use.  The pass2 scanning routines call fill_inverse_cmap
- * when they need to use an unfilled entry in the cache.
+ * when they need to use an unfilled entry in the cache.  The entries are
+ * read and written atomically, so several bands can be mapped at once;
+ * threads racing to fill the same entry store the same value.
  *
  * Our method of efficiently finding nearest colors is based on the "locally
  * sorted search" idea described by Heckbert and on the incremental distance
@@ -2657,11 +2887,8 @@ find_best_colors (QuantizeObj *quantobj,
 
 static void
 fill_inverse_cmap_gray (QuantizeObj *quantobj,
-                        CFHistogram  histogram,
                         int          pixel)
-/* Fill the inverse-colormap entries in the update box that contains */
-/* histogram cell R/G/B.  (Only that one cell MUST be filled, but */
-/* we can fill as many others as we wish.) */
+/* Fill the inverse-colormap entry of gray value pixel. */
 {
   Color *cmap;
   long   dist;
@@ -2686,20 +2913,22 @@ fill_inverse_cmap_gray (QuantizeObj *quantobj,
     }
 
   if (i >= 0)
-    histogram[pixel] = mindisti + 1;
+    quantobj->inverse_cmap[pixel] = mindisti + 1;
 }
 
 
-static void
+static int
 fill_inverse_cmap_rgb (QuantizeObj *quantobj,
-                       CFHistogram  histogram,
                        int          R,
                        int          G,
                        int          B)
 /* Fill the inverse-colormap entries in the update box that contains */
 /* histogram cell R/G/B.  (Only that one cell MUST be filled, but */
-/* we can fill as many others as we wish.) */
+/* we can fill as many others as we wish.)  Returns the entry of that */
+/* cell.  This may run in several threads at once, which then store */
+/* the same entries. */
 {
+  int  cellR = R, cellG = G, cellB = B;
   int  minR, minG, minB; /* lower left corner of update box */
   int  iR, iG, iB;
   int *cptr;           /* pointer into bestcolor[] array */
@@ -2742,10 +2971,34 @@ fill_inverse_cmap_rgb (QuantizeObj *quantobj,
         {
           for (iB = 0; iB < BOX_B_ELEMS; iB++)
             {
-              *HIST_LIN (histogram, R + iR, G + iG, B + iB) = (*cptr++) + 1;
+              g_atomic_int_set (&quantobj->inverse_cmap[REF_FUNC (R + iR,
+                                                                  G + iG,
+                                                                  B + iB)],
+                                (*cptr++) + 1);
             }
         }
     }
+
+  return bestcolor[(((cellR - R) * BOX_G_ELEMS) +
+                    (cellG - G)) * BOX_B_ELEMS + (cellB - B)] + 1;
+}
+
+
+static inline int
+lookup_inverse_cmap_rgb (QuantizeObj *quantobj,
+                         int          R,
+                         int          G,
+                         int          B)
+/* Return the colormap index of histogram cell R/G/B.  If we have not */
+/* seen this color before, find nearest colormap entry and update the */
+/* cache. */
+{
+  int index = g_atomic_int_get (&quantobj->inverse_cmap[REF_FUNC (R, G, B)]);
+
+  if (index == 0)
+    index = fill_inverse_cmap_rgb (quantobj, R, G, B);
+
+  return index - 1;
 }
 
 
@@ -2825,116 +3078,95 @@ custompal_pass1 (QuantizeObj *quantobj)
  */
 
 static void
-median_cut_pass2_no_dither_gray (QuantizeObj *quantobj,
-                                 GimpLayer   *layer,
-                                 GeglBuffer  *new_buffer)
+median_cut_pass2_no_dither_gray (QuantizeObj         *quantobj,
+                                 const Pass2Band     *band,
+                                 gulong              *index_used_count)
 {
-  GeglBufferIterator *iter;
-  CFHistogram         histogram = quantobj->histogram;
-  ColorFreq          *cachep;
+  const gint         *inverse_cmap = quantobj->inverse_cmap;
   const Babl         *src_format;
   const Babl         *dest_format;
-  GeglRectangle      *src_roi;
+  const guchar       *src  = band->src;
+  guchar             *dest = band->dest;
+  gint                row;
   gint                src_bpp;
   gint                dest_bpp;
   gint                has_alpha;
-  gulong             *index_used_count = quantobj->index_used_count;
   gboolean            alpha_dither     = quantobj->want_alpha_dither;
   gint                offsetx, offsety;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = band->offset_x;
+  offsety = band->offset_y;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = band->src_format;
+  dest_format = band->dest_format;
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
 
   has_alpha = babl_format_has_alpha (src_format);
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-  src_roi = &iter->roi[0];
-
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-
-  while (gegl_buffer_iterator_next (iter))
+  for (row = 0; row < band->area.height; row++)
     {
-      const guchar *src  = iter->data[0];
-      guchar       *dest = iter->data[1];
-      gint          row;
+      gint col;
 
-      for (row = 0; row < src_roi->height; row++)
+      for (col = 0; col < band->area.width; col++)
         {
-          gint col;
+          gint index;
 
-          for (col = 0; col < src_roi->width; col++)
-            {
-              gint pixel;
+          /* get pixel value and look it up in the inverse colormap */
+          index = inverse_cmap[src[GRAY]] - 1;
 
-              /* get pixel value and index into the cache */
-              pixel = src[GRAY];
-              cachep = &histogram[pixel];
-              /* If we have not seen this color before, find nearest colormap entry */
-              /* and update the cache */
-              if (*cachep == 0)
-                fill_inverse_cmap_gray (quantobj, histogram, pixel);
+          if (has_alpha)
+            {
+              gboolean transparent = FALSE;
 
-              if (has_alpha)
+              if (alpha_dither)
                 {
-                  gboolean transparent = FALSE;
-
-                  if (alpha_dither)
-                    {
-                      gint dither_x = (col + offsetx + src_roi->x) & DM_WIDTHMASK;
-                      gint dither_y = (row + offsety + src_roi->y) & DM_HEIGHTMASK;
-
-                      if ((src[ALPHA_G]) < DM[dither_x][dither_y])
-                        transparent = TRUE;
-                    }
-                  else
-                    {
-                      if (src[ALPHA_G] <= 127)
-                        transparent = TRUE;
-                    }
+                  gint dither_x = (col + offsetx + band->area.x) & DM_WIDTHMASK;
+                  gint dither_y = (row + offsety + band->area.y) & DM_HEIGHTMASK;
 
-                  if (transparent)
-                    {
-                      dest[ALPHA_I] = 0;
-                    }
-                  else
-                    {
-                      dest[ALPHA_I] = 255;
-                      index_used_count[dest[INDEXED] = *cachep - 1]++;
-                    }
+                  if ((src[ALPHA_G]) < DM[dither_x][dither_y])
+                    transparent = TRUE;
                 }
               else
                 {
-                  /* Now emit the colormap index for this cell */
-                  index_used_count[dest[INDEXED] = *cachep - 1]++;
+                  if (src[ALPHA_G] <= 127)
+                    transparent = TRUE;
                 }
 
-              src  += src_bpp;
-              dest += dest_bpp;
+              if (transparent)
+                {
+                  dest[ALPHA_I] = 0;
+                }
+              else
+                {
+                  dest[ALPHA_I] = 255;
+                  index_used_count[dest[INDEXED] = index]++;
+                }
+            }
+          else
+            {
+              /* Now emit the colormap index for this cell */
+              index_used_count[dest[INDEXED] = index]++;
             }
+
+          src  += src_bpp;
+          dest += dest_bpp;
         }
     }
 }
 
 static void
-median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
-                                    GimpLayer   *layer,
-                                    GeglBuffer  *new_buffer)
+median_cut_pass2_fixed_dither_gray (QuantizeObj         *quantobj,
+                                    const Pass2Band     *band,
+                                    gulong              *index_used_count)
 {
-  GeglBufferIterator *iter;
-  CFHistogram         histogram = quantobj->histogram;
-  ColorFreq          *cachep;
+  const gint         *inverse_cmap = quantobj->inverse_cmap;
   const Babl         *src_format;
   const Babl         *dest_format;
-  GeglRectangle      *src_roi;
+  const guchar       *src  = band->src;
+  guchar             *dest = band->dest;
+  gint                row;
   gint                src_bpp;
   gint                dest_bpp;
   gboolean            has_alpha;
@@ -2944,182 +3176,145 @@ median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
   gint                err2;
   Color              *color1;
   Color              *color2;
-  gulong             *index_used_count = quantobj->index_used_count;
   gboolean            alpha_dither     = quantobj->want_alpha_dither;
   gint                offsetx, offsety;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = band->offset_x;
+  offsety = band->offset_y;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = band->src_format;
+  dest_format = band->dest_format;
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
 
   has_alpha = babl_format_has_alpha (src_format);
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-  src_roi = &iter->roi[0];
-
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-
-  while (gegl_buffer_iterator_next (iter))
+  for (row = 0; row < band->area.height; row++)
     {
-      const guchar *src  = iter->data[0];
-      guchar       *dest = iter->data[1];
-      gint          row;
+      gint col;
 
-      for (row = 0; row < src_roi->height; row++)
+      for (col = 0; col < band->area.width; col++)
         {
-          gint col;
+          const int dmval =
+            DM[(col + offsetx + band->area.x) & DM_WIDTHMASK]
+            [(row + offsety + band->area.y) & DM_HEIGHTMASK];
 
-          for (col = 0; col < src_roi->width; col++)
+          /* get pixel value and look it up in the inverse colormap */
+          pixval1 = inverse_cmap[src[GRAY]] - 1;
+          color1 = &quantobj->cmap[pixval1];
+
+          if (quantobj->actual_number_of_colors > 2)
             {
-              gint      pixel;
-              const int dmval =
-                DM[(col + offsetx + src_roi->x) & DM_WIDTHMASK]
-                [(row + offsety + src_roi->y) & DM_HEIGHTMASK];
-
-              /* get pixel value and index into the cache */
-              pixel = src[GRAY];
-              cachep = &histogram[pixel];
-              /* If we have not seen this color before, find nearest colormap entry */
-              /* and update the cache */
-              if (*cachep == 0)
-                fill_inverse_cmap_gray (quantobj, histogram, pixel);
-
-              pixval1 = *cachep - 1;
-              color1 = &quantobj->cmap[pixval1];
+              const int re = src[GRAY] - (int)color1->red;
+              int RV = src[GRAY] + re;
 
-              if (quantobj->actual_number_of_colors > 2)
+              do
                 {
-                  const int re = src[GRAY] - (int)color1->red;
-                  int RV = src[GRAY] + re;
-
-                  do
-                    {
-                      const gint R = CLAMP0255(RV);
-                      cachep = &histogram[R];
-                      /* If we have not seen this color before, find nearest
-                         colormap entry and update the cache */
-                      if (*cachep == 0)
-                        {
-                          fill_inverse_cmap_gray (quantobj, histogram, R);
-                        }
-                      pixval2 = *cachep - 1;
-                      RV += re;
-                    }
-                  while ((pixval1 == pixval2) &&
-                         (! (RV>255 || RV<0) ) &&
-                         re);
-                }
-              else
-                {
-                  /* not enough colours to bother looking for an 'alternative'
-                     colour (we may fail to do so anyway), so decide that
-                     the alternative colour is simply the other cmap entry. */
-                  pixval2 = (pixval1 + 1) %
-                    (quantobj->actual_number_of_colors);
+                  pixval2 = inverse_cmap[CLAMP0255(RV)] - 1;
+                  RV += re;
                 }
+              while ((pixval1 == pixval2) &&
+                     (! (RV>255 || RV<0) ) &&
+                     re);
+            }
+          else
+            {
+              /* not enough colours to bother looking for an 'alternative'
+                 colour (we may fail to do so anyway), so decide that
+                 the alternative colour is simply the other cmap entry. */
+              pixval2 = (pixval1 + 1) %
+                (quantobj->actual_number_of_colors);
+            }
+
+          /* always deterministically sort pixval1 and pixval2, to
+             avoid artifacts in the dither range due to inverting our
+             relative colour viewpoint -- most obvious in 1-bit dither. */
+          if (pixval1 > pixval2)
+            {
+              gint tmpval = pixval1;
+              pixval1 = pixval2;
+              pixval2 = tmpval;
+              color1 = &quantobj->cmap[pixval1];
+            }
+
+          color2 = &quantobj->cmap[pixval2];
 
-              /* always deterministically sort pixval1 and pixval2, to
-                 avoid artifacts in the dither range due to inverting our
-                 relative colour viewpoint -- most obvious in 1-bit dither. */
-              if (pixval1 > pixval2)
+          err1 = ABS(color1->red - src[GRAY]);
+          err2 = ABS(color2->red - src[GRAY]);
+          if (err1 || err2)
+            {
+              const int proportion2 = (256 * 255 * err2) / (err1 + err2);
+              if ((dmval * 256) > proportion2)
                 {
-                  gint tmpval = pixval1;
-                  pixval1 = pixval2;
-                  pixval2 = tmpval;
-                  color1 = &quantobj->cmap[pixval1];
+                  pixval1 = pixval2; /* use color2 instead of color1*/
                 }
+            }
 
-              color2 = &quantobj->cmap[pixval2];
+          if (has_alpha)
+            {
+              gboolean transparent = FALSE;
 
-              err1 = ABS(color1->red - src[GRAY]);
-              err2 = ABS(color2->red - src[GRAY]);
-              if (err1 || err2)
+              if (alpha_dither)
                 {
-                  const int proportion2 = (256 * 255 * err2) / (err1 + err2);
-                  if ((dmval * 256) > proportion2)
-                    {
-                      pixval1 = pixval2; /* use color2 instead of color1*/
-                    }
+                  if (src[ALPHA_G] < dmval)
+                    transparent = TRUE;
                 }
-
-              if (has_alpha)
+              else
                 {
-                  gboolean transparent = FALSE;
-
-                  if (alpha_dither)
-                    {
-                      if (src[ALPHA_G] < dmval)
-                        transparent = TRUE;
-                    }
-                  else
-                    {
-                      if (src[ALPHA_G] <= 127)
-                        transparent = TRUE;
-                    }
+                  if (src[ALPHA_G] <= 127)
+                    transparent = TRUE;
+                }
 
-                  if (transparent)
-                    {
-                      dest[ALPHA_I] = 0;
-                    }
-                  else
-                    {
-                      dest[ALPHA_I] = 255;
-                      index_used_count[dest[INDEXED] = pixval1]++;
-                    }
+              if (transparent)
+                {
+                  dest[ALPHA_I] = 0;
                 }
               else
                 {
-                  /* Now emit the colormap index for this cell, barfbarf */
+                  dest[ALPHA_I] = 255;
                   index_used_count[dest[INDEXED] = pixval1]++;
                 }
-
-              src  += src_bpp;
-              dest += dest_bpp;
             }
+          else
+            {
+              /* Now emit the colormap index for this cell, barfbarf */
+              index_used_count[dest[INDEXED] = pixval1]++;
+            }
+
+          src  += src_bpp;
+          dest += dest_bpp;
         }
     }
 }
 
 static void
-median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
-                                GimpLayer   *layer,
-                                GeglBuffer  *new_buffer)
+median_cut_pass2_no_dither_rgb (QuantizeObj         *quantobj,
+                                const Pass2Band     *band,
+                                gulong              *index_used_count)
 {
-  GeglBufferIterator *iter;
-  CFHistogram         histogram = quantobj->histogram;
-  ColorFreq          *cachep;
   const Babl         *src_format;
   const Babl         *dest_format;
-  GeglRectangle      *src_roi;
+  const guchar       *src  = band->src;
+  guchar             *dest = band->dest;
+  gint                row;
   gint                src_bpp;
   gint                dest_bpp;
   gint                has_alpha;
   gint                R, G, B;
+  gint                index;
   gint                red_pix          = RED;
   gint                green_pix        = GREEN;
   gint                blue_pix         = BLUE;
   gint                alpha_pix        = ALPHA;
   gboolean            alpha_dither     = quantobj->want_alpha_dither;
   gint                offsetx, offsety;
-  gulong             *index_used_count = quantobj->index_used_count;
-  glong               total_size       = 0;
-  glong               layer_size;
-  gint                count            = 0;
-  gint                nth_layer        = quantobj->nth_layer;
-  gint                n_layers         = quantobj->n_layers;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = band->offset_x;
+  offsety = band->offset_y;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = band->src_format;
+  dest_format = band->dest_format;
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
@@ -3129,103 +3324,72 @@ median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
   /*  In the case of web/mono palettes, we actually force
    *   grayscale drawables through the rgb pass2 functions
    */
-  if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
+  if (band->is_gray)
     {
       red_pix = green_pix = blue_pix = GRAY;
       alpha_pix = ALPHA_G;
     }
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-  src_roi = &iter->roi[0];
-
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
-
-  while (gegl_buffer_iterator_next (iter))
+  for (row = 0; row < band->area.height; row++)
     {
-      const guchar *src  = iter->data[0];
-      guchar       *dest = iter->data[1];
-      gint          row;
-
-      total_size += src_roi->height * src_roi->width;
+      gint col;
 
-      for (row = 0; row < src_roi->height; row++)
+      for (col = 0; col < band->area.width; col++)
         {
-          gint col;
-
-          for (col = 0; col < src_roi->width; col++)
+          if (has_alpha)
             {
-              if (has_alpha)
-                {
-                  gboolean transparent = FALSE;
+              gboolean transparent = FALSE;
 
-                  if (alpha_dither)
-                    {
-                      gint dither_x = (col + offsetx + src_roi->x) & DM_WIDTHMASK;
-                      gint dither_y = (row + offsety + src_roi->y) & DM_HEIGHTMASK;
-                      if ((src[alpha_pix]) < DM[dither_x][dither_y])
-                        transparent = TRUE;
-                    }
-                  else
-                    {
-                      if (src[alpha_pix] <= 127)
-                        transparent = TRUE;
-                    }
+              if (alpha_dither)
+                {
+                  gint dither_x = (col + offsetx + band->area.x) & DM_WIDTHMASK;
+                  gint dither_y = (row + offsety + band->area.y) & DM_HEIGHTMASK;
+                  if ((src[alpha_pix]) < DM[dither_x][dither_y])
+                    transparent = TRUE;
+                }
+              else
+                {
+                  if (src[alpha_pix] <= 127)
+                    transparent = TRUE;
+                }
 
-                  if (transparent)
-                    {
-                      dest[ALPHA_I] = 0;
-                      goto next_pixel;
-                    }
-                  else
-                    {
-                      dest[ALPHA_I] = 255;
-                    }
+              if (transparent)
+                {
+                  dest[ALPHA_I] = 0;
+                  goto next_pixel;
                 }
+              else
+                {
+                  dest[ALPHA_I] = 255;
+                }
+            }
 
-              /* get pixel value and index into the cache */
-              rgb_to_lin (src[red_pix], src[green_pix], src[blue_pix],
-                          &R, &G, &B);
-              cachep = HIST_LIN(histogram,R,G,B);
-              /* If we have not seen this color before, find nearest
-                 colormap entry and update the cache */
-              if (*cachep == 0)
-                fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
+          /* get pixel value and index into the cache */
+          rgb_to_lin (src[red_pix], src[green_pix], src[blue_pix],
+                      &R, &G, &B);
+          index = lookup_inverse_cmap_rgb (quantobj, R, G, B);
 
-              /* Now emit the colormap index for this cell, barfbarf */
-              index_used_count[dest[INDEXED] = *cachep - 1]++;
+          /* Now emit the colormap index for this cell, barfbarf */
+          index_used_count[dest[INDEXED] = index]++;
 
-            next_pixel:
+        next_pixel:
 
-              src  += src_bpp;
-              dest += dest_bpp;
-            }
+          src  += src_bpp;
+          dest += dest_bpp;
         }
-
-      if (quantobj->progress && (count % 16 == 0))
-         gimp_progress_set_value (quantobj->progress,
-                                  (nth_layer + ((gdouble) total_size)/
-                                   layer_size) / (gdouble) n_layers);
     }
 }
 
 static void
-median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
-                                   GimpLayer   *layer,
-                                   GeglBuffer  *new_buffer)
+median_cut_pass2_fixed_dither_rgb (QuantizeObj         *quantobj,
+                                   const Pass2Band     *band,
+                                   gulong              *index_used_count)
 {
-  GeglBufferIterator *iter;
-  CFHistogram         histogram = quantobj->histogram;
-  ColorFreq          *cachep;
   const Babl         *src_format;
   const Babl         *dest_format;
-  GeglRectangle      *src_roi;
+  const guchar       *src  = band->src;
+  guchar             *dest = band->dest;
+  gint                row;
   gint                src_bpp;
   gint                dest_bpp;
   gint                has_alpha;
@@ -3242,17 +3406,12 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
   gint                alpha_pix        = ALPHA;
   gboolean            alpha_dither     = quantobj->want_alpha_dither;
   gint                offsetx, offsety;
-  gulong             *index_used_count = quantobj->index_used_count;
-  glong               total_size       = 0;
-  glong               layer_size;
-  gint                count            = 0;
-  gint                nth_layer        = quantobj->nth_layer;
-  gint                n_layers         = quantobj->n_layers;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = band->offset_x;
+  offsety = band->offset_y;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = band->src_format;
+  dest_format = band->dest_format;
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
@@ -3262,142 +3421,109 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
   /*  In the case of web/mono palettes, we actually force
    *   grayscale drawables through the rgb pass2 functions
    */
-  if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
+  if (band->is_gray)
     {
       red_pix = green_pix = blue_pix = GRAY;
       alpha_pix = ALPHA_G;
     }
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-  src_roi = &iter->roi[0];
-
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
-
-  while (gegl_buffer_iterator_next (iter))
+  for (row = 0; row < band->area.height; row++)
     {
-      const guchar *src  = iter->data[0];
-      guchar       *dest = iter->data[1];
-      gint          row;
+      gint col;
 
-      total_size += src_roi->height * src_roi->width;
-
-      for (row = 0; row < src_roi->height; row++)
+      for (col = 0; col < band->area.width; col++)
         {
-          gint col;
+          const int dmval =
+            DM[(col + offsetx + band->area.x) & DM_WIDTHMASK]
+            [(row + offsety + band->area.y) & DM_HEIGHTMASK];
 
-          for (col = 0; col < src_roi->width; col++)
+          if (has_alpha)
             {
-              const int dmval =
-                DM[(col + offsetx + src_roi->x) & DM_WIDTHMASK]
-                [(row + offsety + src_roi->y) & DM_HEIGHTMASK];
+              gboolean transparent = FALSE;
 
-              if (has_alpha)
+              if (alpha_dither)
                 {
-                  gboolean transparent = FALSE;
-
-                  if (alpha_dither)
-                    {
-                      if (src[alpha_pix] < dmval)
-                        transparent = TRUE;
-                    }
-                  else
-                    {
-                      if (src[alpha_pix] <= 127)
-                        transparent = TRUE;
-                    }
-
-                  if (transparent)
-                    {
-                      dest[ALPHA_I] = 0;
-                      goto next_pixel;
-                    }
-                  else
-                    {
-                      dest[ALPHA_I] = 255;
-                    }
+                  if (src[alpha_pix] < dmval)
+                    transparent = TRUE;
                 }
-
-              /* get pixel value and index into the cache */
-              rgb_to_lin(src[red_pix], src[green_pix], src[blue_pix],
-                         &R, &G, &B);
-              cachep = HIST_LIN(histogram,R,G,B);
-              /* If we have not seen this color before, find nearest
-                 colormap entry and update the cache */
-              if (*cachep == 0)
-                fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
-
-              /* We now try to find a colour which, when mixed in some fashion
-                 with the closest match, yields something closer to the
-                 desired colour.  We do this by repeatedly extrapolating the
-                 colour vector from one to the other until we find another
-                 colour cell.  Then we assess the distance of both mixer
-                 colours from the intended colour to determine their relative
-                 probabilities of being chosen. */
-              pixval1 = *cachep - 1;
-              color1 = &quantobj->cmap[pixval1];
-
-              if (quantobj->actual_number_of_colors > 2)
+              else
                 {
-                  const int re = src[red_pix] - (int)color1->red;
-                  const int ge = src[green_pix] - (int)color1->green;
-                  const int be = src[blue_pix] - (int)color1->blue;
-                  int RV = src[red_pix] + re;
-                  int GV = src[green_pix] + ge;
-                  int BV = src[blue_pix] + be;
-
-                  do
-                    {
-                      rgb_to_lin ((CLAMP0255(RV)),
-                                  (CLAMP0255(GV)),
-                                  (CLAMP0255(BV)),
-                                  &R, &G, &B);
-                      cachep = HIST_LIN(histogram,R,G,B);
-
-                      /* If we have not seen this color before, find nearest
-                         colormap entry and update the cache */
-                      if (*cachep == 0)
-                        {
-                          fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
-                        }
-                      pixval2 = *cachep - 1;
-                      RV += re;  GV += ge;  BV += be;
-                    }
-                  while ((pixval1 == pixval2) &&
-                         (!( (RV>255 || RV<0) || (GV>255 || GV<0) || (BV>255 || BV<0) )) &&
-                         (re || ge || be));
+                  if (src[alpha_pix] <= 127)
+                    transparent = TRUE;
                 }
 
-              if (quantobj->actual_number_of_colors <= 2
-                  /* || pixval1 == pixval2 */) {
-                /* not enough colours to bother looking for an 'alternative'
-                   colour (we may fail to do so anyway), so decide that
-                   the alternative colour is simply the other cmap entry. */
-                pixval2 = (pixval1 + 1) %
-                  (quantobj->actual_number_of_colors);
-              }
+              if (transparent)
+                {
+                  dest[ALPHA_I] = 0;
+                  goto next_pixel;
+                }
+              else
+                {
+                  dest[ALPHA_I] = 255;
+                }
+            }
 
-              /* always deterministically sort pixval1 and pixval2, to
-                 avoid artifacts in the dither range due to inverting our
-                 relative colour viewpoint -- most obvious in 1-bit dither. */
-              if (pixval1 > pixval2)
+          /* get pixel value and index into the cache */
+          rgb_to_lin(src[red_pix], src[green_pix], src[blue_pix],
+                     &R, &G, &B);
+
+          /* We now try to find a colour which, when mixed in some fashion
+             with the closest match, yields something closer to the
+             desired colour.  We do this by repeatedly extrapolating the
+             colour vector from one to the other until we find another
+             colour cell.  Then we assess the distance of both mixer
+             colours from the intended colour to determine their relative
+             probabilities of being chosen. */
+          pixval1 = lookup_inverse_cmap_rgb (quantobj, R, G, B);
+          color1 = &quantobj->cmap[pixval1];
+
+          if (quantobj->actual_number_of_colors > 2)
+            {
+              const int re = src[red_pix] - (int)color1->red;
+              const int ge = src[green_pix] - (int)color1->green;
+              const int be = src[blue_pix] - (int)color1->blue;
+              int RV = src[red_pix] + re;
+              int GV = src[green_pix] + ge;
+              int BV = src[blue_pix] + be;
+
+              do
                 {
-                  gint tmpval = pixval1;
-                  pixval1 = pixval2;
-                  pixval2 = tmpval;
-                  color1 = &quantobj->cmap[pixval1];
+                  rgb_to_lin ((CLAMP0255(RV)),
+                              (CLAMP0255(GV)),
+                              (CLAMP0255(BV)),
+                              &R, &G, &B);
+                  pixval2 = lookup_inverse_cmap_rgb (quantobj, R, G, B);
+                  RV += re;  GV += ge;  BV += be;
                 }
+              while ((pixval1 == pixval2) &&
+                     (!( (RV>255 || RV<0) || (GV>255 || GV<0) || (BV>255 || BV<0) )) &&
+                     (re || ge || be));
+            }
+
+          if (quantobj->actual_number_of_colors <= 2
+              /* || pixval1 == pixval2 */) {
+            /* not enough colours to bother looking for an 'alternative'
+               colour (we may fail to do so anyway), so decide that
+               the alternative colour is simply the other cmap entry. */
+            pixval2 = (pixval1 + 1) %
+              (quantobj->actual_number_of_colors);
+          }
+
+          /* always deterministically sort pixval1 and pixval2, to
+             avoid artifacts in the dither range due to inverting our
+             relative colour viewpoint -- most obvious in 1-bit dither. */
+          if (pixval1 > pixval2)
+            {
+              gint tmpval = pixval1;
+              pixval1 = pixval2;
+              pixval2 = tmpval;
+              color1 = &quantobj->cmap[pixval1];
+            }
 
-              color2 = &quantobj->cmap[pixval2];
+          color2 = &quantobj->cmap[pixval2];
 
-              /* now figure out the relative probabilites of choosing
-                 either of our candidates. */
+          /* now figure out the relative probabilites of choosing
+             either of our candidates. */
 #define DISTP(R1,G1,B1,R2,G2,B2,D) do {D = sqrt( 30*SQR((R1)-(R2)) + \
                                                  59*SQR((G1)-(G2)) + \
                                                  11*SQR((B1)-(B2)) ); }while(0)
@@ -3411,50 +3537,45 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
                          B_SCALE * SQR((spaceb1)-(spaceb2))); \
               } while(0)
 
-              /* although LIN_DISTP is more correct, DISTP is much faster and
-                 barely distinguishable. */
-              DISTP (color1->red, color1->green, color1->blue,
-                     src[red_pix], src[green_pix], src[blue_pix],
-                     err1);
-              DISTP (color2->red, color2->green, color2->blue,
-                     src[red_pix], src[green_pix], src[blue_pix],
-                     err2);
+          /* although LIN_DISTP is more correct, DISTP is much faster and
+             barely distinguishable. */
+          DISTP (color1->red, color1->green, color1->blue,
+                 src[red_pix], src[green_pix], src[blue_pix],
+                 err1);
+          DISTP (color2->red, color2->green, color2->blue,
+                 src[red_pix], src[green_pix], src[blue_pix],
+                 err2);
 
-              if (err1 || err2)
+          if (err1 || err2)
+            {
+              const int proportion2 = (255 * err2) / (err1 + err2);
+              if (dmval > proportion2)
                 {
-                  const int proportion2 = (255 * err2) / (err1 + err2);
-                  if (dmval > proportion2)
-                    {
-                      pixval1 = pixval2; /* use color2 instead of color1*/
-                    }
+                  pixval1 = pixval2; /* use color2 instead of color1*/
                 }
+            }
 
-              /* Now emit the colormap index for this cell, barfbarf */
-              index_used_count[dest[INDEXED] = pixval1]++;
+          /* Now emit the colormap index for this cell, barfbarf */
+          index_used_count[dest[INDEXED] = pixval1]++;
 
-            next_pixel:
+        next_pixel:
 
-              src  += src_bpp;
-              dest += dest_bpp;
-            }
+          src  += src_bpp;
+          dest += dest_bpp;
         }
-
-      if (quantobj->progress && (count % 16 == 0))
-        gimp_progress_set_value (quantobj->progress,
-                                 (nth_layer + ((gdouble) total_size)/
-                                  layer_size) / (gdouble) n_layers);
     }
 }
 
 static void
-median_cut_pass2_nodestruct_dither_rgb (QuantizeObj *quantobj,
-                                        GimpLayer   *layer,
-                                        GeglBuffer  *new_buffer)
+median_cut_pass2_nodestruct_dither_rgb (QuantizeObj         *quantobj,
+                                        const Pass2Band     *band,
+                                        gulong              *index_used_count)
 {
-  GeglBufferIterator *iter;
   const Babl         *src_format;
   const Babl         *dest_format;
-  GeglRectangle      *src_roi;
+  const guchar       *src  = band->src;
+  guchar             *dest = band->dest;
+  gint                row;
   gint                src_bpp;
   gint                dest_bpp;
   gint                has_alpha;
@@ -3469,103 +3590,88 @@ median_cut_pass2_nodestruct_dither_rgb (QuantizeObj *quantobj,
   gint                lastblue     = -1;
   gint                offsetx, offsety;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = band->offset_x;
+  offsety = band->offset_y;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = band->src_format;
+  dest_format = band->dest_format;
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
 
   has_alpha = babl_format_has_alpha (src_format);
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-  src_roi = &iter->roi[0];
-
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-
-  while (gegl_buffer_iterator_next (iter))
+  for (row = 0; row < band->area.height; row++)
     {
-      const guchar *src  = iter->data[0];
-      guchar       *dest = iter->data[1];
-      gint          row;
+      gint col;
 
-      for (row = 0; row < src_roi->height; row++)
+      for (col = 0; col < band->area.width; col++)
         {
-          gint col;
+          gboolean transparent = FALSE;
 
-          for (col = 0; col < src_roi->width; col++)
+          if (has_alpha)
             {
-              gboolean transparent = FALSE;
-
-              if (has_alpha)
+              if (alpha_dither)
                 {
-                  if (alpha_dither)
-                    {
-                      gint dither_x = (col + src_roi->x + offsetx) & DM_WIDTHMASK;
-                      gint dither_y = (row + src_roi->y + offsety) & DM_HEIGHTMASK;
+                  gint dither_x = (col + band->area.x + offsetx) & DM_WIDTHMASK;
+                  gint dither_y = (row + band->area.y + offsety) & DM_HEIGHTMASK;
 
-                      if ((src[alpha_pix]) < DM[dither_x][dither_y])
-                        transparent = TRUE;
-                    }
-                  else
-                    {
-                      if (src[alpha_pix] < 128)
-                        transparent = TRUE;
-                    }
+                  if ((src[alpha_pix]) < DM[dither_x][dither_y])
+                    transparent = TRUE;
+                }
+              else
+                {
+                  if (src[alpha_pix] < 128)
+                    transparent = TRUE;
                 }
+            }
 
-              if (! transparent)
+          if (! transparent)
+            {
+              if ((lastred   == src[red_pix]) &&
+                  (lastgreen == src[green_pix]) &&
+                  (lastblue  == src[blue_pix]))
                 {
-                  if ((lastred   == src[red_pix]) &&
-                      (lastgreen == src[green_pix]) &&
-                      (lastblue  == src[blue_pix]))
-                    {
-                      /*  same pixel colour as last time  */
-                      dest[INDEXED] = lastindex;
-                      if (has_alpha)
-                        dest[ALPHA_I] = 255;
-                    }
-                  else
-                    {
-                      gint i;
-
-                      for (i = 0 ;
-                           i < quantobj->actual_number_of_colors;
-                           i++)
-                        {
-                          if ((quantobj->cmap[i].green == src[green_pix]) &&
-                              (quantobj->cmap[i].red   == src[red_pix]) &&
-                              (quantobj->cmap[i].blue  == src[blue_pix]))
-                          {
-                            lastred   = src[red_pix];
-                            lastgreen = src[green_pix];
-                            lastblue  = src[blue_pix];
-                            lastindex = i;
-
-                            goto got_colour;
-                          }
-                        }
-                      g_error ("Non-existant colour was expected to "
-                               "be in non-destructive colourmap.");
-                    got_colour:
-                      dest[INDEXED] = lastindex;
-                      if (has_alpha)
-                        dest[ALPHA_I] = 255;
-                    }
+                  /*  same pixel colour as last time  */
+                  dest[INDEXED] = lastindex;
+                  if (has_alpha)
+                    dest[ALPHA_I] = 255;
                 }
               else
-                { /*  have alpha, and transparent  */
-                  dest[ALPHA_I] = 0;
-                }
+                {
+                  gint i;
 
-              src  += src_bpp;
-              dest += dest_bpp;
+                  for (i = 0 ;
+                       i < quantobj->actual_number_of_colors;
+                       i++)
+                    {
+                      if ((quantobj->cmap[i].green == src[green_pix]) &&
+                          (quantobj->cmap[i].red   == src[red_pix]) &&
+                          (quantobj->cmap[i].blue  == src[blue_pix]))
+                      {
+                        lastred   = src[red_pix];
+                        lastgreen = src[green_pix];
+                        lastblue  = src[blue_pix];
+                        lastindex = i;
+
+                        goto got_colour;
+                      }
+                    }
+                  g_error ("Non-existant colour was expected to "
+                           "be in non-destructive colourmap.");
+                got_colour:
+                  dest[INDEXED] = lastindex;
+                  if (has_alpha)
+                    dest[ALPHA_I] = 255;
+                }
+            }
+          else
+            { /*  have alpha, and transparent  */
+              dest[ALPHA_I] = 0;
             }
+
+          src  += src_bpp;
+          dest += dest_bpp;
         }
     }
 }
@@ -3660,13 +3766,11 @@ init_error_limit (const int error_freedom)
  */
 
 static void
-median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
-                                 GimpLayer   *layer,
-                                 GeglBuffer  *new_buffer)
+median_cut_pass2_fs_dither_gray (QuantizeObj         *quantobj,
+                                 const Pass2Band     *band,
+                                 gulong              *index_used_count)
 {
-  GeglBuffer   *src_buffer;
-  CFHistogram   histogram = quantobj->histogram;
-  ColorFreq    *cachep;
+  const gint   *inverse_cmap = quantobj->inverse_cmap;
   Color        *color;
   gint         *error_limiter;
   const gshort *fs_err1, *fs_err2;
@@ -3676,7 +3780,6 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
   const Babl   *dest_format;
   gint          src_bpp;
   gint          dest_bpp;
-  guchar       *src_buf, *dest_buf;
   gint         *next_row, *prev_row;
   gint         *nr, *pr;
   gint         *tmp;
@@ -3689,30 +3792,24 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
   gboolean      has_alpha;
   gint          offsetx, offsety;
   gboolean      alpha_dither = quantobj->want_alpha_dither;
-  gint          width, height;
-  gulong       *index_used_count = quantobj->index_used_count;
+  gint          width;
 
-  src_buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  offsetx = band->offset_x;
+  offsety = band->offset_y;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
-
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = band->src_format;
+  dest_format = band->dest_format;
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
 
   has_alpha = babl_format_has_alpha (src_format);
 
-  width  = gimp_item_get_width  (GIMP_ITEM (layer));
-  height = gimp_item_get_height (GIMP_ITEM (layer));
+  width = band->area.width;
 
   error_limiter = init_error_limit (quantobj->error_freedom);
   range_limiter = range_array + 256;
 
-  src_buf  = g_malloc (width * src_bpp);
-  dest_buf = g_malloc (width * dest_bpp);
-
   next_row = g_new (gint, width + 2);
   prev_row = g_new0 (gint, width + 2);
 
@@ -3721,19 +3818,18 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
   fs_err3 = floyd_steinberg_error3 + 511;
   fs_err4 = floyd_steinberg_error4 + 511;
 
-  odd_row = 0;
+  /* Serpentine scanning follows the parity of the layer rows, so
+   * the rows of each band are traversed as they would be in one pass
+   */
+  odd_row = band->area.y & 1;
 
-  for (row = 0; row < height; row++)
+  for (row = band->area.y; row < band->area.y + band->area.height; row++)
     {
       const guchar *src;
       guchar       *dest;
 
-      gegl_buffer_get (src_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       1.0, NULL, src_buf,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-      src  = src_buf;
-      dest = dest_buf;
+      src  = band->src  + (row - band->area.y) * width * src_bpp;
+      dest = band->dest + (row - band->area.y) * width * dest_bpp;
 
       nr = next_row;
       pr = prev_row + 1;
@@ -3765,12 +3861,6 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
         {
           pixel = range_limiter[src[GRAY] + error_limiter[*pr]];
 
-          cachep = &histogram[pixel];
-          /* If we have not seen this color before, find nearest colormap entry */
-          /* and update the cache */
-          if (*cachep == 0)
-            fill_inverse_cmap_gray (quantobj, histogram, pixel);
-
           if (has_alpha)
             {
               gboolean transparent = FALSE;
@@ -3779,7 +3869,7 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
                 {
                   if (alpha_dither)
                     {
-                      gint dither_x = ((width-col)+offsetx-1) & DM_WIDTHMASK;
+                      gint dither_x = ((width-col)+band->area.x+offsetx-1) & DM_WIDTHMASK;
                       gint dither_y = (row+offsety) & DM_HEIGHTMASK;
 
                       if ((src[ALPHA_G]) < DM[dither_x][dither_y])
@@ -3808,7 +3898,7 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
                 {
                   if (alpha_dither)
                     {
-                      gint dither_x = (col + offsetx) & DM_WIDTHMASK;
+                      gint dither_x = (col + band->area.x + offsetx) & DM_WIDTHMASK;
                       gint dither_y = (row + offsety) & DM_HEIGHTMASK;
 
                       if ((src[ALPHA_G]) < DM[dither_x][dither_y])
@@ -3835,7 +3925,7 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
                 }
             }
 
-          index = *cachep - 1;
+          index = inverse_cmap[pixel] - 1;
           index_used_count[dest[INDEXED] = index]++;
 
           color = &quantobj->cmap[index];
@@ -3867,17 +3957,11 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
       prev_row = tmp;
 
       odd_row = !odd_row;
-
-      gegl_buffer_set (new_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       0, NULL, dest_buf,
-                       GEGL_AUTO_ROWSTRIDE);
     }
 
   g_free (error_limiter - 255); /* good lord. */
   g_free (next_row);
   g_free (prev_row);
-  g_free (src_buf);
-  g_free (dest_buf);
 }
 
 static void
@@ -3885,7 +3969,12 @@ median_cut_pass2_rgb_init (QuantizeObj *quantobj)
 {
   int i;
 
-  zero_histogram_rgb (quantobj->histogram);
+  /* The histogram is done with, the inverse colormap is filled lazily */
+  g_free (quantobj->histogram);
+  quantobj->histogram = NULL;
+
+  quantobj->inverse_cmap = g_new0 (gint,
+                                   HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS);
 
   /* Mark all indices as currently unused */
   memset (quantobj->index_used_count, 0, 256 * sizeof (unsigned long));
@@ -3905,20 +3994,23 @@ median_cut_pass2_rgb_init (QuantizeObj *quantobj)
 static void
 median_cut_pass2_gray_init (QuantizeObj *quantobj)
 {
-  zero_histogram_gray (quantobj->histogram);
+  int pixel;
+
+  /* The inverse colormap is small enough to fill right away */
+  quantobj->inverse_cmap = g_new0 (gint, 256);
+
+  for (pixel = 0; pixel < 256; pixel++)
+    fill_inverse_cmap_gray (quantobj, pixel);
 
   /* Mark all indices as currently unused */
   memset (quantobj->index_used_count, 0, 256 * sizeof (unsigned long));
 }
 
 static void
-median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
-                                GimpLayer   *layer,
-                                GeglBuffer  *new_buffer)
+median_cut_pass2_fs_dither_rgb (QuantizeObj         *quantobj,
+                                const Pass2Band     *band,
+                                gulong              *index_used_count)
 {
-  GeglBuffer   *src_buffer;
-  CFHistogram   histogram = quantobj->histogram;
-  ColorFreq    *cachep;
   Color        *color;
   gint         *error_limiter;
   const gshort *fs_err1, *fs_err2;
@@ -3928,7 +4020,6 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
   const Babl   *dest_format;
   gint          src_bpp;
   gint          dest_bpp;
-  guchar       *src_buf, *dest_buf;
   gint         *red_n_row, *red_p_row;
   gint         *grn_n_row, *grn_p_row;
   gint         *blu_n_row, *blu_p_row;
@@ -3942,40 +4033,35 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
   gint          step_dest, step_src;
   gint          odd_row;
   gboolean      has_alpha;
-  gint          width, height;
+  gint          width;
   gint          red_pix   = RED;
   gint          green_pix = GREEN;
   gint          blue_pix  = BLUE;
   gint          alpha_pix = ALPHA;
   gint          offsetx, offsety;
   gboolean      alpha_dither     = quantobj->want_alpha_dither;
-  gulong       *index_used_count = quantobj->index_used_count;
   gint          global_rmax = 0, global_rmin = G_MAXINT;
   gint          global_gmax = 0, global_gmin = G_MAXINT;
   gint          global_bmax = 0, global_bmin = G_MAXINT;
-  gint          nth_layer = quantobj->nth_layer;
-  gint          n_layers  = quantobj->n_layers;
-
-  src_buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = band->offset_x;
+  offsety = band->offset_y;
 
   /*  In the case of web/mono palettes, we actually force
    *   grayscale drawables through the rgb pass2 functions
    */
-  if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
+  if (band->is_gray)
     red_pix = green_pix = blue_pix = GRAY;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = band->src_format;
+  dest_format = band->dest_format;
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
 
   has_alpha = babl_format_has_alpha (src_format);
 
-  width  = gimp_item_get_width  (GIMP_ITEM (layer));
-  height = gimp_item_get_height (GIMP_ITEM (layer));
+  width = band->area.width;
 
   error_limiter = init_error_limit (quantobj->error_freedom);
   range_limiter = range_array + 256;
@@ -3994,9 +4080,6 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
       global_bmin = MIN(global_bmin, quantobj->clin[index].blue);
     }
 
-  src_buf  = g_malloc (width * src_bpp);
-  dest_buf = g_malloc (width * dest_bpp);
-
   red_n_row = g_new (gint, width + 2);
   red_p_row = g_new0 (gint, width + 2);
   grn_n_row = g_new (gint, width + 2);
@@ -4009,19 +4092,18 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
   fs_err3 = floyd_steinberg_error3 + 511;
   fs_err4 = floyd_steinberg_error4 + 511;
 
-  odd_row = 0;
+  /* Serpentine scanning follows the parity of the layer rows, so
+   * the rows of each band are traversed as they would be in one pass
+   */
+  odd_row = band->area.y & 1;
 
-  for (row = 0; row < height; row++)
+  for (row = band->area.y; row < band->area.y + band->area.height; row++)
     {
       const guchar *src;
       guchar       *dest;
 
-      gegl_buffer_get (src_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       1.0, NULL, src_buf,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-      src  = src_buf;
-      dest = dest_buf;
+      src  = band->src  + (row - band->area.y) * width * src_bpp;
+      dest = band->dest + (row - band->area.y) * width * dest_bpp;
 
       rnr = red_n_row;
       gnr = grn_n_row;
@@ -4067,7 +4149,7 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
                 {
                   if (alpha_dither)
                     {
-                      gint dither_x = ((width-col)+offsetx-1) & DM_WIDTHMASK;
+                      gint dither_x = ((width-col)+band->area.x+offsetx-1) & DM_WIDTHMASK;
                       gint dither_y = (row+offsety) & DM_HEIGHTMASK;
 
                       if ((src[alpha_pix]) < DM[dither_x][dither_y])
@@ -4096,7 +4178,7 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
                 {
                   if (alpha_dither)
                     {
-                      gint dither_x = (col + offsetx) & DM_WIDTHMASK;
+                      gint dither_x = (col + band->area.x + offsetx) & DM_WIDTHMASK;
                       gint dither_y = (row + offsety) & DM_HEIGHTMASK;
 
                       if ((src[alpha_pix]) < DM[dither_x][dither_y])
@@ -4148,19 +4230,10 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
           ge = range_limiter[ge + error_limiter[*gpr]];
           be = range_limiter[be + error_limiter[*bpr]];
 
-          cachep = HIST_LIN(histogram,
-                            RSDF(re),
-                            GSDF(ge),
-                            BSDF(be));
-          /* If we have not seen this color before, find nearest
-             colormap entry and update the cache */
-          if (*cachep == 0)
-            fill_inverse_cmap_rgb (quantobj, histogram,
-                                   RSDF(re),
-                                   GSDF(ge),
-                                   BSDF(be));
-
-          index = *cachep - 1;
+          index = lookup_inverse_cmap_rgb (quantobj,
+                                           RSDF(re),
+                                           GSDF(ge),
+                                           BSDF(be));
           index_used_count[index]++;
           dest[INDEXED] = index;
 
@@ -4264,15 +4337,6 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
       blu_p_row = tmp;
 
       odd_row = !odd_row;
-
-      gegl_buffer_set (new_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       0, NULL, dest_buf,
-                       GEGL_AUTO_ROWSTRIDE);
-
-      if (quantobj->progress && (row % 16 == 0))
-        gimp_progress_set_value (quantobj->progress,
-                                 (nth_layer + ((gdouble) row) /
-                                  height) / (gdouble) n_layers);
     }
 
   g_free (error_limiter - 255);
@@ -4282,8 +4346,126 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
   g_free (grn_p_row);
   g_free (blu_n_row);
   g_free (blu_p_row);
-  g_free (src_buf);
-  g_free (dest_buf);
+}
+
+
+typedef struct
+{
+  QuantizeObj     *quantobj;
+  const Pass2Band *bands;
+  GMutex           mutex;
+} Pass2BandsData;
+
+static void
+median_cut_pass2_bands_range (gsize    offset,
+                              gsize    size,
+                              gpointer user_data)
+{
+  Pass2BandsData *data     = user_data;
+  QuantizeObj    *quantobj = data->quantobj;
+  gulong          index_used_count[256] = { 0, };
+  gsize           i;
+  gint            j;
+
+  for (i = offset; i < offset + size; i++)
+    {
+      const Pass2Band *band = &data->bands[i];
+
+      quantobj->second_pass (quantobj, band, index_used_count);
+    }
+
+  g_mutex_lock (&data->mutex);
+
+  for (j = 0; j < 256; j++)
+    quantobj->index_used_count[j] += index_used_count[j];
+
+  g_mutex_unlock (&data->mutex);
+}
+
+static void
+median_cut_pass2_bands (QuantizeObj *quantobj,
+                        Pass2Band   *bands,
+                        gint         n_bands)
+{
+  Pass2BandsData data;
+  gint           max_batch;
+  gint           i;
+
+  data.quantobj = quantobj;
+
+  g_mutex_init (&data.mutex);
+
+  /*  the bands of all layers are mapped together, so small layers are
+   *  mapped concurrently too.  they are handed out in batches, to
+   *  report the progress in between
+   */
+  max_batch = 4 * gimp_parallel_get_n_threads ();
+
+  i = 0;
+
+  while (i < n_bands)
+    {
+      gsize batch_size = 0;
+      gint  n;
+      gint  j;
+
+      /*  the buffers are only read and written here, the pass2
+       *  functions map the pixels in memory
+       */
+      for (n = 0; n < max_batch && i + n < n_bands; n++)
+        {
+          Pass2Band *band = &bands[i + n];
+          gsize      n_pixels;
+          gsize      src_size;
+          gsize      dest_size;
+
+          n_pixels  = (gsize) band->area.width * band->area.height;
+          src_size  = n_pixels *
+                      babl_format_get_bytes_per_pixel (band->src_format);
+          dest_size = n_pixels *
+                      babl_format_get_bytes_per_pixel (band->dest_format);
+
+          if (n > 0 && batch_size + src_size + dest_size > PASS2_BATCH_SIZE)
+            break;
+
+          batch_size += src_size + dest_size;
+
+          band->src  = g_malloc (src_size);
+          band->dest = g_malloc (dest_size);
+
+          gegl_buffer_get (gimp_drawable_get_buffer (GIMP_DRAWABLE (band->layer)),
+                           &band->area, 1.0, band->src_format, band->src,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+        }
+
+      data.bands = bands + i;
+
+      gimp_parallel_distribute_range (n, 1,
+                                      median_cut_pass2_bands_range, &data);
+
+      for (j = i; j < i + n; j++)
+        {
+          Pass2Band *band = &bands[j];
+
+          gegl_buffer_set (band->new_buffer, &band->area,
+                           0, band->dest_format, band->dest,
+                           GEGL_AUTO_ROWSTRIDE);
+
+          g_free (band->src);
+          g_free (band->dest);
+
+          band->src  = NULL;
+          band->dest = NULL;
+        }
+
+      i += n;
+
+      if (quantobj->progress)
+        gimp_progress_set_value (quantobj->progress,
+                                 (gdouble) i / (gdouble) n_bands);
+    }
+
+  g_mutex_clear (&data.mutex);
 }
 
 
@@ -4291,6 +4473,7 @@ static void
 delete_median_cut (QuantizeObj *quantobj)
 {
   g_free (quantobj->histogram);
+  g_free (quantobj->inverse_cmap);
   g_free (quantobj);
 }
 
@@ -4344,6 +4527,7 @@ initialize_median_cut (GimpImageBaseType       type,
     quantobj->histogram = g_new (ColorFreq,
                                  HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS);
 
+  quantobj->inverse_cmap             = NULL;
   quantobj->desired_number_of_colors = num_colors;
   quantobj->want_alpha_dither        = want_alpha_dither;
   quantobj->progress                 = progress;
@@ -30,6 +30,9 @@ struct _GimpImageFlushAccumulator
 };
 
 
+typedef struct _GimpUndoCompress GimpUndoCompress;
+
+
 typedef struct _GimpImagePrivate GimpImagePrivate;
 
 struct _GimpImagePrivate
@@ -101,6 +104,11 @@ struct _GimpImagePrivate
   GimpUndoStack     *redo_stack;            /*  stack for redo operations    */
   gint               group_count;           /*  nested undo groups           */
   GimpUndoType       pushing_undo_group;    /*  undo group status flag       */
+  guint              undo_compress_idle_id; /*  compresses cold undo steps   */
+  GimpUndoCompress  *undo_compress;         /*  the step being compressed    */
+  GimpTileBackendCompressedSwap
+                    *undo_swap;             /*  swap file for cold steps     */
+  gboolean           undo_swap_failed;      /*  don't swap after an error    */
 
   /*  Signal emission accumulator  */
   GimpImageFlushAccumulator  flush_accum;
@@ -19,10 +19,14 @@
 
 #include <gegl.h>
 
+#include "libgimpconfig/gimpconfig.h"
+
 #include "core-types.h"
 
 #include "config/gimpcoreconfig.h"
 
+#include "gegl/gimptilebackendcompressed.h"
+
 #include "gimp.h"
 #include "gimp-utils.h"
 #include "gimpdrawableundo.h"
@@ -34,14 +38,85 @@
 #include "gimpundostack.h"
 
 
+/*  the number of rows of tiles which may wait for the compress thread  */
+#define COMPRESS_MAX_PENDING 2
+
+
+typedef struct _CompressBuffer CompressBuffer;
+typedef struct _CompressTask   CompressTask;
+
+struct _CompressBuffer
+{
+  GeglBuffer                **slot;     /* where the undo keeps the buffer */
+  GeglBuffer                 *source;
+  GimpTileBackendCompressed  *backend;
+  gboolean                    fresh;    /* backend is filled from source   */
+};
+
+/*  compressing an undo step reads its buffers one row of tiles at a
+ *  time on the main thread, the rows are compressed, and the tiles are
+ *  written to the swap file, in a thread. The buffers of the step are
+ *  only replaced once all that is done.
+ */
+struct _GimpUndoCompress
+{
+  gint                           ref_count;
+
+  GimpImage                     *image;    /* NULL once canceled          */
+  GimpUndo                      *undo;
+  GimpTileBackendCompressedSwap *swap;     /* NULL if only compressing    */
+
+  GList                         *buffers;
+  GList                         *current;  /* the buffer being read       */
+  gint                           row;      /* its next row of tiles       */
+  gboolean                       finish_pushed;
+
+  GMutex                         mutex;    /* protects the fields below   */
+  GCond                          cond;
+  gint                           pending;  /* tasks not done yet          */
+  gboolean                       waiting;  /* the idle waits for a task   */
+  gboolean                       done;
+  gboolean                       canceled;
+  GError                        *error;
+};
+
+struct _CompressTask
+{
+  GimpUndoCompress *compress;
+  CompressBuffer   *buffer;
+  gint              row;
+  guchar           *band;                  /* NULL for the finish task    */
+};
+
+
 /*  local function prototypes  */
 
-static void          gimp_image_undo_pop_stack       (GimpImage     *image,
+static gboolean      gimp_image_undo_pop_stack       (GimpImage     *image,
                                                       GimpUndoStack *undo_stack,
                                                       GimpUndoStack *redo_stack,
                                                       GimpUndoMode   undo_mode);
 static void          gimp_image_undo_free_space      (GimpImage     *image);
 static void          gimp_image_undo_free_redo       (GimpImage     *image);
+static void          gimp_image_undo_queue_compress  (GimpImage     *image);
+static gboolean      gimp_image_undo_compress_idle   (GimpImage     *image);
+
+static GimpUndoCompress *
+                     gimp_image_undo_compress_new    (GimpImage        *image,
+                                                      GimpUndo         *undo,
+                                                      GimpTileBackendCompressedSwap *swap);
+static void          gimp_image_undo_compress_unref  (GimpUndoCompress *compress);
+static void          gimp_image_undo_compress_add_buffer
+                                                     (GeglBuffer      **buffer,
+                                                      gpointer          data);
+static void          gimp_image_undo_compress_push   (GimpUndoCompress *compress,
+                                                      CompressBuffer   *buffer,
+                                                      gint              row,
+                                                      guchar           *band);
+static void          gimp_image_undo_compress_run    (CompressTask     *task,
+                                                      gpointer          unused);
+static gboolean      gimp_image_undo_compress_resume (GimpUndoCompress *compress);
+static void          gimp_image_undo_compress_finish (GimpImage        *image);
+static void          gimp_image_undo_compress_cancel (GimpImage        *image);
 
 static GimpDirtyMask gimp_image_undo_dirty_from_type (GimpUndoType   undo_type);
 
@@ -123,12 +198,10 @@ gimp_image_undo (GimpImage *image)
   g_return_val_if_fail (private->pushing_undo_group == GIMP_UNDO_GROUP_NONE,
                         FALSE);
 
-  gimp_image_undo_pop_stack (image,
-                             private->undo_stack,
-                             private->redo_stack,
-                             GIMP_UNDO_MODE_UNDO);
-
-  return TRUE;
+  return gimp_image_undo_pop_stack (image,
+                                    private->undo_stack,
+                                    private->redo_stack,
+                                    GIMP_UNDO_MODE_UNDO);
 }
 
 gboolean
@@ -143,12 +216,10 @@ gimp_image_redo (GimpImage *image)
   g_return_val_if_fail (private->pushing_undo_group == GIMP_UNDO_GROUP_NONE,
                         FALSE);
 
-  gimp_image_undo_pop_stack (image,
-                             private->redo_stack,
-                             private->undo_stack,
-                             GIMP_UNDO_MODE_REDO);
-
-  return TRUE;
+  return gimp_image_undo_pop_stack (image,
+                                    private->redo_stack,
+                                    private->undo_stack,
+                                    GIMP_UNDO_MODE_REDO);
 }
 
 /*
@@ -170,13 +241,14 @@ gimp_image_strong_undo (GimpImage *image)
 
   undo = gimp_undo_stack_peek (private->undo_stack);
 
-  gimp_image_undo (image);
+  if (! gimp_image_undo (image))
+    return FALSE;
 
   while (gimp_undo_is_weak (undo))
     {
       undo = gimp_undo_stack_peek (private->undo_stack);
-      if (gimp_undo_is_weak (undo))
-        gimp_image_undo (image);
+      if (gimp_undo_is_weak (undo) && ! gimp_image_undo (image))
+        return FALSE;
     }
 
   return TRUE;
@@ -203,13 +275,14 @@ gimp_image_strong_redo (GimpImage *image)
 
   undo = gimp_undo_stack_peek (private->redo_stack);
 
-  gimp_image_redo (image);
+  if (! gimp_image_redo (image))
+    return FALSE;
 
   while (gimp_undo_is_weak (undo))
     {
       undo = gimp_undo_stack_peek (private->redo_stack);
-      if (gimp_undo_is_weak (undo))
-        gimp_image_redo (image);
+      if (gimp_undo_is_weak (undo) && ! gimp_image_redo (image))
+        return FALSE;
     }
 
   return TRUE;
@@ -240,6 +313,14 @@ gimp_image_undo_free (GimpImage *image)
 
   private = GIMP_IMAGE_GET_PRIVATE (image);
 
+  if (private->undo_compress_idle_id)
+    {
+      g_source_remove (private->undo_compress_idle_id);
+      private->undo_compress_idle_id = 0;
+    }
+
+  gimp_image_undo_compress_cancel (image);
+
   /*  Emit the UNDO_FREE event before actually freeing everything
    *  so the views can properly detach from the undo items
    */
@@ -256,6 +337,14 @@ gimp_image_undo_free (GimpImage *image)
   if (private->dirty < 0)
     private->dirty = 100000;
 
+  if (private->undo_swap)
+    {
+      gimp_tile_backend_compressed_swap_unref (private->undo_swap);
+      private->undo_swap = NULL;
+    }
+
+  private->undo_swap_failed = FALSE;
+
   /* The same applies to the case where the image would become clean
    * due to undo actions, but since user can't undo without an undo
    * stack, that's not so much a problem.
@@ -484,7 +573,7 @@ gimp_image_undo_get_fadeable (GimpImage *image)
 
 /*  private functions  */
 
-static void
+static gboolean
 gimp_image_undo_pop_stack (GimpImage     *image,
                            GimpUndoStack *undo_stack,
                            GimpUndoStack *redo_stack,
@@ -492,6 +581,24 @@ gimp_image_undo_pop_stack (GimpImage     *image,
 {
   GimpUndo            *undo;
   GimpUndoAccumulator  accum = { 0, };
+  GError              *error = NULL;
+
+  /*  the step's buffers must not change while they are compressed  */
+  gimp_image_undo_compress_cancel (image);
+
+  undo = gimp_undo_stack_peek (undo_stack);
+
+  if (undo && ! gimp_undo_decompress (undo, &error))
+    {
+      gimp_message_literal (image->gimp, NULL, GIMP_MESSAGE_ERROR,
+                            error->message);
+      g_clear_error (&error);
+
+      /*  some of the step's buffers may have been read back  */
+      gimp_undo_stack_update_undo (undo_stack, undo);
+
+      return FALSE;
+    }
 
   g_object_freeze_notify (G_OBJECT (image));
 
@@ -531,44 +638,60 @@ gimp_image_undo_pop_stack (GimpImage     *image,
     }
 
   g_object_thaw_notify (G_OBJECT (image));
+
+  return TRUE;
 }
 
 static void
 gimp_image_undo_free_space (GimpImage *image)
 {
   GimpImagePrivate *private = GIMP_IMAGE_GET_PRIVATE (image);
+  GimpUndoStack    *stack   = private->undo_stack;
   GimpContainer    *container;
   gint              min_undo_levels;
   gint              max_undo_levels;
   gint64            undo_size;
 
-  container = private->undo_stack->undos;
+  container = stack->undos;
 
   min_undo_levels = image->gimp->config->levels_of_undo;
-  max_undo_levels = 1024; /* FIXME */
+  max_undo_levels = image->gimp->config->max_levels_of_undo;
   undo_size       = image->gimp->config->undo_size;
 
+  /*  the undo on top may have grown since it was pushed  */
+  gimp_undo_stack_update_top (stack);
+
 #ifdef DEBUG_IMAGE_UNDO
   g_printerr ("undo_steps: %d    undo_bytes: %ld\n",
               gimp_container_get_n_children (container),
-              (glong) gimp_object_get_memsize (GIMP_OBJECT (container), NULL));
+              (glong) stack->memsize);
 #endif
 
+  /*  the undo below the new one just became cold  */
+  gimp_image_undo_queue_compress (image);
+
   /*  keep at least min_undo_levels undo steps  */
   if (gimp_container_get_n_children (container) <= min_undo_levels)
     return;
 
-  while ((gimp_object_get_memsize (GIMP_OBJECT (container), NULL) > undo_size) ||
+  while ((stack->memsize > undo_size) ||
          (gimp_container_get_n_children (container) > max_undo_levels))
     {
-      GimpUndo *freed = gimp_undo_stack_free_bottom (private->undo_stack,
-                                                     GIMP_UNDO_MODE_UNDO);
+      GimpUndo *freed;
+
+      if (private->undo_compress &&
+          private->undo_compress->undo ==
+          GIMP_UNDO (gimp_container_get_last_child (container)))
+        {
+          gimp_image_undo_compress_cancel (image);
+        }
+
+      freed = gimp_undo_stack_free_bottom (stack, GIMP_UNDO_MODE_UNDO);
 
 #ifdef DEBUG_IMAGE_UNDO
       g_printerr ("freed one step: undo_steps: %d    undo_bytes: %ld\n",
                   gimp_container_get_n_children (container),
-                  (glong) gimp_object_get_memsize (GIMP_OBJECT (container),
-                                                   NULL));
+                  (glong) stack->memsize);
 #endif
 
       gimp_image_undo_event (image, GIMP_UNDO_EVENT_UNDO_EXPIRED, freed);
@@ -589,7 +712,7 @@ gimp_image_undo_free_redo (GimpImage *image)
 #ifdef DEBUG_IMAGE_UNDO
   g_printerr ("redo_steps: %d    redo_bytes: %ld\n",
               gimp_container_get_n_children (container),
-              (glong) gimp_object_get_memsize (GIMP_OBJECT (container), NULL));
+              (glong) private->redo_stack->memsize);
 #endif
 
   if (gimp_container_is_empty (container))
@@ -603,8 +726,7 @@ gimp_image_undo_free_redo (GimpImage *image)
 #ifdef DEBUG_IMAGE_UNDO
       g_printerr ("freed one step: redo_steps: %d    redo_bytes: %ld\n",
                   gimp_container_get_n_children (container),
-                  (glong )gimp_object_get_memsize (GIMP_OBJECT (container),
-                                                   NULL));
+                  (glong) private->redo_stack->memsize);
 #endif
 
       gimp_image_undo_event (image, GIMP_UNDO_EVENT_REDO_EXPIRED, freed);
@@ -626,6 +748,470 @@ gimp_image_undo_free_redo (GimpImage *image)
     }
 }
 
+static void
+gimp_image_undo_queue_compress (GimpImage *image)
+{
+  GimpImagePrivate *private = GIMP_IMAGE_GET_PRIVATE (image);
+
+  if (! private->undo_compress_idle_id &&
+      gimp_undo_stack_get_depth (private->undo_stack) > 1)
+    {
+      private->undo_compress_idle_id =
+        g_idle_add_full (G_PRIORITY_LOW,
+                         (GSourceFunc) gimp_image_undo_compress_idle,
+                         image, NULL);
+    }
+}
+
+/*  Compresses one undo step at a time. All steps but the top one get
+ *  compressed, and the steps beyond the configured undo levels are
+ *  moved to a swap file. Steps only sink deeper as new ones are pushed,
+ *  so the ones still to be done are always right below the top, and
+ *  right below the undo levels; the coldest of them goes first.
+ *
+ *  Each call reads one row of tiles of the current step; the idle
+ *  pauses while the thread is behind, and is resumed by it.
+ */
+static gboolean
+gimp_image_undo_compress_idle (GimpImage *image)
+{
+  GimpImagePrivate *private  = GIMP_IMAGE_GET_PRIVATE (image);
+  GimpUndoCompress *compress = private->undo_compress;
+  gboolean          wait     = FALSE;
+  gboolean          done;
+
+  if (! compress)
+    {
+      GimpCoreConfig *config     = image->gimp->config;
+      GimpUndoStack  *stack      = private->undo_stack;
+      GimpUndo       *undo       = NULL;
+      GimpUndo       *swap       = NULL;
+      gint            swap_depth = MAX (config->levels_of_undo, 1);
+      GList          *list;
+      gint            depth;
+
+      if (! private->undo_swap && ! private->undo_swap_failed &&
+          GIMP_GEGL_CONFIG (config)->swap_path)
+        {
+          gchar *swap_dir;
+
+          swap_dir = gimp_config_path_expand (GIMP_GEGL_CONFIG (config)->swap_path,
+                                              TRUE, NULL);
+
+          if (swap_dir && g_file_test (swap_dir, G_FILE_TEST_IS_DIR))
+            private->undo_swap = gimp_tile_backend_compressed_swap_new (swap_dir);
+
+          g_free (swap_dir);
+        }
+
+      if (private->undo_swap_failed)
+        swap_depth = G_MAXINT;
+
+      /*  leave the top undo alone, it can still be compressed or faded  */
+      for (list = g_list_nth (GIMP_LIST (stack->undos)->list, 1), depth = 1;
+           list && ! GIMP_UNDO (list->data)->compressed;
+           list = g_list_next (list), depth++)
+        {
+          if (private->undo_swap && depth >= swap_depth)
+            break;
+
+          undo = list->data;
+        }
+
+      if (private->undo_swap && ! private->undo_swap_failed)
+        {
+          for (list = g_list_nth (GIMP_LIST (stack->undos)->list, swap_depth);
+               list && ! GIMP_UNDO (list->data)->swapped;
+               list = g_list_next (list))
+            {
+              swap = list->data;
+            }
+        }
+
+      if (swap)
+        compress = gimp_image_undo_compress_new (image, swap,
+                                                 private->undo_swap);
+      else if (undo)
+        compress = gimp_image_undo_compress_new (image, undo, NULL);
+
+      if (! compress)
+        {
+          private->undo_compress_idle_id = 0;
+
+          return FALSE;
+        }
+
+      private->undo_compress = compress;
+    }
+
+  g_mutex_lock (&compress->mutex);
+
+  done = compress->done;
+
+  if (! done &&
+      (compress->finish_pushed ||
+       compress->pending >= COMPRESS_MAX_PENDING))
+    {
+      compress->waiting = TRUE;
+      wait = TRUE;
+    }
+
+  g_mutex_unlock (&compress->mutex);
+
+  if (wait)
+    {
+      private->undo_compress_idle_id = 0;
+
+      return FALSE;
+    }
+
+  if (done)
+    {
+      gimp_image_undo_compress_finish (image);
+
+      return TRUE;
+    }
+
+  /*  skip the buffers which are compressed already, or read completely  */
+  while (compress->current &&
+         (! ((CompressBuffer *) compress->current->data)->fresh ||
+          compress->row ==
+          ((CompressBuffer *) compress->current->data)->backend->n_tile_rows))
+    {
+      compress->current = g_list_next (compress->current);
+      compress->row     = 0;
+    }
+
+  if (compress->current)
+    {
+      CompressBuffer *buffer = compress->current->data;
+      guchar         *band;
+
+      band = gimp_tile_backend_compressed_read_row (buffer->backend,
+                                                    buffer->source,
+                                                    compress->row);
+
+      gimp_image_undo_compress_push (compress, buffer, compress->row, band);
+
+      compress->row++;
+    }
+  else
+    {
+      compress->finish_pushed = TRUE;
+
+      gimp_image_undo_compress_push (compress, NULL, 0, NULL);
+    }
+
+  return TRUE;
+}
+
+static GimpUndoCompress *
+gimp_image_undo_compress_new (GimpImage                     *image,
+                              GimpUndo                      *undo,
+                              GimpTileBackendCompressedSwap *swap)
+{
+  GimpUndoCompress *compress = g_slice_new0 (GimpUndoCompress);
+
+  compress->ref_count = 1;
+  compress->image     = image;
+  compress->undo      = g_object_ref (undo);
+
+  if (swap)
+    compress->swap = gimp_tile_backend_compressed_swap_ref (swap);
+
+  g_mutex_init (&compress->mutex);
+  g_cond_init (&compress->cond);
+
+  gimp_undo_foreach_buffer (undo,
+                            gimp_image_undo_compress_add_buffer, compress);
+
+  compress->buffers = g_list_reverse (compress->buffers);
+  compress->current = compress->buffers;
+
+  return compress;
+}
+
+/*  the last reference is always dropped on the main thread  */
+static void
+gimp_image_undo_compress_unref (GimpUndoCompress *compress)
+{
+  if (g_atomic_int_dec_and_test (&compress->ref_count))
+    {
+      GList *list;
+
+      for (list = compress->buffers; list; list = g_list_next (list))
+        {
+          CompressBuffer *buffer = list->data;
+
+          g_object_unref (buffer->backend);
+          g_object_unref (buffer->source);
+
+          g_slice_free (CompressBuffer, buffer);
+        }
+
+      g_list_free (compress->buffers);
+
+      if (compress->swap)
+        gimp_tile_backend_compressed_swap_unref (compress->swap);
+
+      g_object_unref (compress->undo);
+
+      g_clear_error (&compress->error);
+
+      g_cond_clear (&compress->cond);
+      g_mutex_clear (&compress->mutex);
+
+      g_slice_free (GimpUndoCompress, compress);
+    }
+}
+
+static void
+gimp_image_undo_compress_add_buffer (GeglBuffer **slot,
+                                     gpointer     data)
+{
+  GimpUndoCompress          *compress = data;
+  GimpTileBackendCompressed *backend;
+  CompressBuffer            *buffer;
+  GList                     *list;
+
+  if (! *slot)
+    return;
+
+  backend = gimp_tile_backend_compressed_get_backend (*slot);
+
+  /*  compressed buffers only need to be swapped  */
+  if (backend && ! compress->swap)
+    return;
+
+  /*  a buffer kept twice is compressed once  */
+  for (list = compress->buffers; list; list = g_list_next (list))
+    {
+      CompressBuffer *other = list->data;
+
+      if (other->source == *slot)
+        {
+          buffer = g_slice_dup (CompressBuffer, other);
+
+          buffer->slot = slot;
+          g_object_ref (buffer->source);
+          g_object_ref (buffer->backend);
+
+          compress->buffers = g_list_prepend (compress->buffers, buffer);
+
+          return;
+        }
+    }
+
+  buffer = g_slice_new0 (CompressBuffer);
+
+  buffer->slot   = slot;
+  buffer->source = g_object_ref (*slot);
+
+  if (backend)
+    {
+      buffer->backend = g_object_ref (backend);
+    }
+  else
+    {
+      buffer->backend = gimp_tile_backend_compressed_new (*slot);
+      buffer->fresh   = TRUE;
+    }
+
+  compress->buffers = g_list_prepend (compress->buffers, buffer);
+}
+
+static void
+gimp_image_undo_compress_push (GimpUndoCompress *compress,
+                               CompressBuffer   *buffer,
+                               gint              row,
+                               guchar           *band)
+{
+  static GThreadPool *pool = NULL;
+  CompressTask       *task;
+
+  if (! pool)
+    pool = g_thread_pool_new ((GFunc) gimp_image_undo_compress_run,
+                              NULL, 1, FALSE, NULL);
+
+  task = g_slice_new (CompressTask);
+
+  task->compress = compress;
+  task->buffer   = buffer;
+  task->row      = row;
+  task->band     = band;
+
+  g_mutex_lock (&compress->mutex);
+  compress->pending++;
+  g_mutex_unlock (&compress->mutex);
+
+  g_thread_pool_push (pool, task, NULL);
+}
+
+/*  runs in the compress thread, touches neither GEGL buffers nor the
+ *  undo step
+ */
+static void
+gimp_image_undo_compress_run (CompressTask *task,
+                              gpointer      unused)
+{
+  GimpUndoCompress *compress = task->compress;
+  GError           *error    = NULL;
+  gboolean          canceled;
+  gboolean          resume   = FALSE;
+
+  g_mutex_lock (&compress->mutex);
+  canceled = compress->canceled;
+  g_mutex_unlock (&compress->mutex);
+
+  if (canceled)
+    {
+      /*  nothing to do  */
+    }
+  else if (task->band)
+    {
+      gimp_tile_backend_compressed_encode_row (task->buffer->backend,
+                                               task->row, task->band);
+    }
+  else if (compress->swap)
+    {
+      GList *list;
+
+      for (list = compress->buffers; list; list = g_list_next (list))
+        {
+          CompressBuffer *buffer = list->data;
+
+          g_mutex_lock (&compress->mutex);
+          canceled = compress->canceled;
+          g_mutex_unlock (&compress->mutex);
+
+          if (canceled)
+            break;
+
+          if (! gimp_tile_backend_compressed_write_swap (buffer->backend,
+                                                         compress->swap,
+                                                         &error))
+            break;
+        }
+    }
+
+  g_mutex_lock (&compress->mutex);
+
+  compress->pending--;
+
+  if (! task->band)
+    {
+      compress->done  = TRUE;
+      compress->error = error;
+    }
+
+  if (compress->waiting)
+    {
+      compress->waiting = FALSE;
+      resume            = TRUE;
+
+      g_atomic_int_inc (&compress->ref_count);
+    }
+
+  g_cond_signal (&compress->cond);
+
+  g_mutex_unlock (&compress->mutex);
+
+  if (resume)
+    g_idle_add_full (G_PRIORITY_LOW,
+                     (GSourceFunc) gimp_image_undo_compress_resume,
+                     compress, NULL);
+
+  g_free (task->band);
+  g_slice_free (CompressTask, task);
+}
+
+static gboolean
+gimp_image_undo_compress_resume (GimpUndoCompress *compress)
+{
+  GimpImage *image = compress->image;
+
+  if (image)
+    {
+      GimpImagePrivate *private = GIMP_IMAGE_GET_PRIVATE (image);
+
+      if (! private->undo_compress_idle_id)
+        private->undo_compress_idle_id =
+          g_idle_add_full (G_PRIORITY_LOW,
+                           (GSourceFunc) gimp_image_undo_compress_idle,
+                           image, NULL);
+    }
+
+  gimp_image_undo_compress_unref (compress);
+
+  return FALSE;
+}
+
+static void
+gimp_image_undo_compress_finish (GimpImage *image)
+{
+  GimpImagePrivate *private  = GIMP_IMAGE_GET_PRIVATE (image);
+  GimpUndoCompress *compress = private->undo_compress;
+  GList            *list;
+
+  private->undo_compress = NULL;
+  compress->image        = NULL;
+
+  for (list = compress->buffers; list; list = g_list_next (list))
+    {
+      CompressBuffer *buffer = list->data;
+
+      if (buffer->fresh)
+        {
+          g_object_unref (*buffer->slot);
+          *buffer->slot =
+            gimp_tile_backend_compressed_create_buffer (buffer->backend);
+        }
+    }
+
+  compress->undo->compressed = TRUE;
+
+  /*  a step which failed to be swapped isn't tried again  */
+  if (compress->swap)
+    compress->undo->swapped = TRUE;
+
+  gimp_undo_stack_update_undo (private->undo_stack, compress->undo);
+
+  if (compress->error)
+    {
+      gimp_message_literal (image->gimp, NULL, GIMP_MESSAGE_ERROR,
+                            compress->error->message);
+
+      private->undo_swap_failed = TRUE;
+    }
+
+  gimp_image_undo_compress_unref (compress);
+}
+
+/*  stops compressing the current step, which is left as it was  */
+static void
+gimp_image_undo_compress_cancel (GimpImage *image)
+{
+  GimpImagePrivate *private  = GIMP_IMAGE_GET_PRIVATE (image);
+  GimpUndoCompress *compress = private->undo_compress;
+
+  if (! compress)
+    return;
+
+  g_mutex_lock (&compress->mutex);
+
+  compress->canceled = TRUE;
+
+  while (compress->pending > 0)
+    g_cond_wait (&compress->cond, &compress->mutex);
+
+  g_mutex_unlock (&compress->mutex);
+
+  private->undo_compress = NULL;
+  compress->image        = NULL;
+
+  gimp_image_undo_compress_unref (compress);
+}
+
 static GimpDirtyMask
 gimp_image_undo_dirty_from_type (GimpUndoType undo_type)
 {
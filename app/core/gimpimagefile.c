@@ -52,6 +52,12 @@
 #include "gimp-intl.h"
 
 
+/*  thumbnails are loaded and written by a small pool of threads,
+ *  there is no point in hammering the disk with more
+ */
+#define GIMP_IMAGEFILE_N_THREADS 2
+
+
 enum
 {
   INFO_CHANGED,
@@ -59,18 +65,51 @@ enum
 };
 
 
+typedef enum
+{
+  GIMP_IMAGEFILE_JOB_LOAD,  /*  a visible preview is waiting for it  */
+  GIMP_IMAGEFILE_JOB_SAVE
+} GimpImagefileJobType;
+
+
+typedef struct _GimpImagefileJob     GimpImagefileJob;
 typedef struct _GimpImagefilePrivate GimpImagefilePrivate;
 
+struct _GimpImagefileJob
+{
+  GimpImagefileJobType  type;
+  guint                 serial;
+  gint                  cancelled;   /*  atomic  */
+
+  /*  only touched by the main thread  */
+  GimpImagefile        *imagefile;   /*  owned by save jobs  */
+
+  /*  private copy, only touched by the worker while the job runs  */
+  GimpThumbnail        *thumbnail;
+
+  gint                  size;
+  gboolean              replace;     /*  save jobs  */
+
+  GdkPixbuf            *pixbuf;
+  gboolean              success;
+  GError               *error;
+};
+
 struct _GimpImagefilePrivate
 {
-  Gimp          *gimp;
+  Gimp             *gimp;
 
-  GimpThumbnail *thumbnail;
-  GIcon         *icon;
-  GCancellable  *icon_cancellable;
+  GimpThumbnail    *thumbnail;
+  GIcon            *icon;
+  GCancellable     *icon_cancellable;
 
-  gchar         *description;
-  gboolean       static_desc;
+  GdkPixbuf        *pixbuf;          /*  last loaded thumbnail, or NULL  */
+  gint              pixbuf_size;     /*  the size it was loaded for      */
+  GimpImagefileJob *load_job;
+  GimpImagefileJob *save_job;
+
+  gchar            *description;
+  gboolean          static_desc;
 };
 
 #define GET_PRIVATE(imagefile) G_TYPE_INSTANCE_GET_PRIVATE (imagefile, \
@@ -91,15 +130,35 @@ static GdkPixbuf * gimp_imagefile_get_new_pixbuf   (GimpViewable   *viewable,
                                                     GimpContext    *context,
                                                     gint            width,
                                                     gint            height);
-static GdkPixbuf * gimp_imagefile_load_thumb       (GimpImagefile  *imagefile,
+static void        gimp_imagefile_drop_pixbuf      (GimpImagefile  *imagefile);
+static void        gimp_imagefile_cancel_load      (GimpImagefile  *imagefile);
+static GdkPixbuf * gimp_imagefile_load_thumb       (GimpThumbnail  *thumbnail,
+                                                    gint            size,
+                                                    GError        **error);
+static GdkPixbuf * gimp_imagefile_scale_thumb      (GdkPixbuf      *thumb,
                                                     gint            width,
                                                     gint            height);
 static gboolean    gimp_imagefile_save_thumb       (GimpImagefile  *imagefile,
                                                     GimpImage      *image,
                                                     gint            size,
                                                     gboolean        replace,
+                                                    gboolean        async,
                                                     GError        **error);
 
+static GimpImagefileJob *
+                   gimp_imagefile_job_new          (GimpImagefile  *imagefile,
+                                                    GimpImagefileJobType  type);
+static void        gimp_imagefile_job_free         (GimpImagefileJob *job);
+static void        gimp_imagefile_job_push         (GimpImagefileJob *job);
+static gint        gimp_imagefile_job_compare      (gconstpointer   a,
+                                                    gconstpointer   b,
+                                                    gpointer        data);
+static void        gimp_imagefile_job_process      (GimpImagefileJob *job);
+static void        gimp_imagefile_job_run          (GimpImagefileJob *job,
+                                                    gpointer        data);
+static gboolean    gimp_imagefile_job_idle         (gpointer        data);
+static void        gimp_imagefile_job_finish       (GimpImagefileJob *job);
+
 static gchar     * gimp_imagefile_get_description  (GimpViewable   *viewable,
                                                     gchar         **tooltip);
 
@@ -124,6 +183,15 @@ G_DEFINE_TYPE (GimpImagefile, gimp_imagefile, GIMP_TYPE_VIEWABLE)
 
 static guint gimp_imagefile_signals[LAST_SIGNAL] = { 0 };
 
+static GThreadPool *thumbnail_pool     = NULL;
+static guint        thumbnail_serial   = 0;
+static gint         thumbnail_exiting  = FALSE;
+
+/*  finished jobs, delivered to their imagefiles from an idle  */
+static GMutex       thumbnail_mutex;
+static GQueue       thumbnail_done     = G_QUEUE_INIT;
+static guint        thumbnail_idle_id  = 0;
+
 
 static void
 gimp_imagefile_class_init (GimpImagefileClass *klass)
@@ -187,6 +255,9 @@ gimp_imagefile_dispose (GObject *object)
       private->icon_cancellable = NULL;
     }
 
+  gimp_imagefile_cancel_load (GIMP_IMAGEFILE (object));
+  gimp_imagefile_drop_pixbuf (GIMP_IMAGEFILE (object));
+
   G_OBJECT_CLASS (parent_class)->dispose (object);
 }
 
@@ -298,6 +369,9 @@ gimp_imagefile_update (GimpImagefile *imagefile)
 
   private = GET_PRIVATE (imagefile);
 
+  gimp_imagefile_cancel_load (imagefile);
+  gimp_imagefile_drop_pixbuf (imagefile);
+
   gimp_viewable_invalidate_preview (GIMP_VIEWABLE (imagefile));
 
   g_object_get (private->thumbnail,
@@ -388,7 +462,7 @@ gimp_imagefile_create_thumbnail (GimpImagefile *imagefile,
         {
           success = gimp_imagefile_save_thumb (imagefile,
                                                image, size, replace,
-                                               &error);
+                                               TRUE, &error);
 
           g_object_unref (image);
         }
@@ -452,7 +526,25 @@ gimp_imagefile_create_thumbnail_weak (GimpImagefile *imagefile,
       if (uri &&
           strcmp (uri, gimp_object_get_name (local)) == 0)
         {
-          gimp_imagefile_update (imagefile);
+          GimpImagefilePrivate *local_private = GET_PRIVATE (local);
+          GimpImagefileJob     *job           = local_private->save_job;
+
+          if (job)
+            {
+              /*  the thumbnail is still being written, hand it to
+               *  @imagefile once it is done
+               */
+              local_private->save_job = NULL;
+
+              g_object_unref (job->imagefile);
+              job->imagefile = g_object_ref (imagefile);
+
+              GET_PRIVATE (imagefile)->save_job = job;
+            }
+          else
+            {
+              gimp_imagefile_update (imagefile);
+            }
         }
 
       g_object_remove_weak_pointer (G_OBJECT (imagefile),
@@ -510,7 +602,7 @@ gimp_imagefile_save_thumbnail (GimpImagefile *imagefile,
 
       success = gimp_imagefile_save_thumb (imagefile,
                                            image, size, FALSE,
-                                           &error);
+                                           FALSE, &error);
       if (! success)
         {
           gimp_message_literal (private->gimp, NULL, GIMP_MESSAGE_ERROR,
@@ -522,6 +614,79 @@ gimp_imagefile_save_thumbnail (GimpImagefile *imagefile,
   return success;
 }
 
+/*  Like gimp_imagefile_save_thumbnail(), but the thumbnail is written
+ *  by the thumbnail threads, only rendering the preview blocks.
+ *  Errors are reported by gimp_message().
+ */
+void
+gimp_imagefile_save_thumbnail_async (GimpImagefile *imagefile,
+                                     const gchar   *mime_type,
+                                     GimpImage     *image)
+{
+  GimpImagefilePrivate *private;
+  gint                  size;
+
+  g_return_if_fail (GIMP_IS_IMAGEFILE (imagefile));
+  g_return_if_fail (GIMP_IS_IMAGE (image));
+
+  private = GET_PRIVATE (imagefile);
+
+  size = private->gimp->config->thumbnail_size;
+
+  if (size > 0)
+    {
+      gimp_thumbnail_set_info_from_image (private->thumbnail,
+                                          mime_type, image);
+
+      gimp_imagefile_save_thumb (imagefile,
+                                 image, size, FALSE,
+                                 TRUE, NULL);
+    }
+}
+
+/*  Waits for the thumbnails that are still being written and stops
+ *  the thumbnail threads, called when GIMP exits.
+ */
+void
+gimp_imagefile_exit (void)
+{
+  g_atomic_int_set (&thumbnail_exiting, TRUE);
+
+  if (thumbnail_pool)
+    {
+      g_thread_pool_free (thumbnail_pool, FALSE, TRUE);
+      thumbnail_pool = NULL;
+    }
+
+  g_mutex_lock (&thumbnail_mutex);
+
+  if (thumbnail_idle_id)
+    {
+      g_source_remove (thumbnail_idle_id);
+      thumbnail_idle_id = 0;
+    }
+
+  while (! g_queue_is_empty (&thumbnail_done))
+    {
+      GimpImagefileJob *job = g_queue_pop_head (&thumbnail_done);
+
+      if (job->imagefile)
+        {
+          GimpImagefilePrivate *private = GET_PRIVATE (job->imagefile);
+
+          if (private->load_job == job)
+            private->load_job = NULL;
+
+          if (private->save_job == job)
+            private->save_job = NULL;
+        }
+
+      gimp_imagefile_job_free (job);
+    }
+
+  g_mutex_unlock (&thumbnail_mutex);
+}
+
 
 /*  private functions  */
 
@@ -533,6 +698,9 @@ gimp_imagefile_name_changed (GimpObject *object)
   if (GIMP_OBJECT_CLASS (parent_class)->name_changed)
     GIMP_OBJECT_CLASS (parent_class)->name_changed (object);
 
+  gimp_imagefile_cancel_load (GIMP_IMAGEFILE (object));
+  gimp_imagefile_drop_pixbuf (GIMP_IMAGEFILE (object));
+
   gimp_thumbnail_set_uri (private->thumbnail, gimp_object_get_name (object));
 }
 
@@ -569,12 +737,49 @@ gimp_imagefile_get_new_pixbuf (GimpViewable *viewable,
                                gint          width,
                                gint          height)
 {
-  GimpImagefile *imagefile = GIMP_IMAGEFILE (viewable);
+  GimpImagefile        *imagefile = GIMP_IMAGEFILE (viewable);
+  GimpImagefilePrivate *private   = GET_PRIVATE (imagefile);
+  GimpImagefileJob     *job;
+  gint                  size      = MAX (width, height);
 
   if (! gimp_object_get_name (imagefile))
     return NULL;
 
-  return gimp_imagefile_load_thumb (imagefile, width, height);
+  /*  only ever load larger thumbnails, so that views of different
+   *  sizes don't take turns reloading it
+   */
+  if (private->pixbuf_size >= size)
+    {
+      if (private->pixbuf)
+        return gimp_imagefile_scale_thumb (private->pixbuf, width, height);
+
+      return NULL;
+    }
+
+  /*  a thumbnail is being written, we get invalidated when it's done  */
+  if (private->save_job)
+    return NULL;
+
+  if (private->load_job)
+    {
+      if (private->load_job->size >= size)
+        return NULL;
+
+      gimp_imagefile_cancel_load (imagefile);
+    }
+
+  /*  load the thumbnail in the background, the preview is invalidated
+   *  when it arrives and we return it from above
+   */
+  job = gimp_imagefile_job_new (imagefile, GIMP_IMAGEFILE_JOB_LOAD);
+
+  job->size = size;
+
+  private->load_job = job;
+
+  gimp_imagefile_job_push (job);
+
+  return NULL;
 }
 
 static gchar *
@@ -817,41 +1022,59 @@ gimp_imagefile_get_desc_string (GimpImagefile *imagefile)
   return (const gchar *) private->description;
 }
 
-static GdkPixbuf *
-gimp_imagefile_load_thumb (GimpImagefile *imagefile,
-                           gint           width,
-                           gint           height)
+static void
+gimp_imagefile_drop_pixbuf (GimpImagefile *imagefile)
 {
-  GimpImagefilePrivate *private   = GET_PRIVATE (imagefile);
-  GimpThumbnail        *thumbnail = private->thumbnail;
-  GdkPixbuf            *pixbuf    = NULL;
-  GError               *error     = NULL;
-  gint                  size      = MAX (width, height);
-  gint                  pixbuf_width;
-  gint                  pixbuf_height;
-  gint                  preview_width;
-  gint                  preview_height;
+  GimpImagefilePrivate *private = GET_PRIVATE (imagefile);
+
+  if (private->pixbuf)
+    {
+      g_object_unref (private->pixbuf);
+      private->pixbuf = NULL;
+    }
+
+  private->pixbuf_size = 0;
+}
 
+static void
+gimp_imagefile_cancel_load (GimpImagefile *imagefile)
+{
+  GimpImagefilePrivate *private = GET_PRIVATE (imagefile);
+
+  if (private->load_job)
+    {
+      g_atomic_int_set (&private->load_job->cancelled, TRUE);
+
+      private->load_job->imagefile = NULL;
+      private->load_job            = NULL;
+    }
+}
+
+/*  runs in a thumbnail thread, @thumbnail must not be shared  */
+static GdkPixbuf *
+gimp_imagefile_load_thumb (GimpThumbnail  *thumbnail,
+                           gint            size,
+                           GError        **error)
+{
   if (gimp_thumbnail_peek_thumb (thumbnail, size) < GIMP_THUMB_STATE_EXISTS)
     return NULL;
 
   if (thumbnail->image_state == GIMP_THUMB_STATE_NOT_FOUND)
     return NULL;
 
-  pixbuf = gimp_thumbnail_load_thumb (thumbnail, size, &error);
-
-  if (! pixbuf)
-    {
-      if (error)
-        {
-          gimp_message (private->gimp, NULL, GIMP_MESSAGE_ERROR,
-                        _("Could not open thumbnail '%s': %s"),
-                        thumbnail->thumb_filename, error->message);
-          g_clear_error (&error);
-        }
+  return gimp_thumbnail_load_thumb (thumbnail, size, error);
+}
 
-      return NULL;
-    }
+static GdkPixbuf *
+gimp_imagefile_scale_thumb (GdkPixbuf *thumb,
+                            gint       width,
+                            gint       height)
+{
+  GdkPixbuf *pixbuf = g_object_ref (thumb);
+  gint       pixbuf_width;
+  gint       pixbuf_height;
+  gint       preview_width;
+  gint       preview_height;
 
   pixbuf_width  = gdk_pixbuf_get_width  (pixbuf);
   pixbuf_height = gdk_pixbuf_get_height (pixbuf);
@@ -902,13 +1125,14 @@ gimp_imagefile_save_thumb (GimpImagefile  *imagefile,
                            GimpImage      *image,
                            gint            size,
                            gboolean        replace,
+                           gboolean        async,
                            GError        **error)
 {
-  GimpImagefilePrivate *private   = GET_PRIVATE (imagefile);
-  GimpThumbnail        *thumbnail = private->thumbnail;
+  GimpImagefilePrivate *private = GET_PRIVATE (imagefile);
+  GimpImagefileJob     *job;
   GdkPixbuf            *pixbuf;
   gint                  width, height;
-  gboolean              success = FALSE;
+  gboolean              success;
 
   if (size < 1)
     return TRUE;
@@ -949,26 +1173,246 @@ gimp_imagefile_save_thumb (GimpImagefile  *imagefile,
   if (! pixbuf)
     return TRUE;
 
-  success = gimp_thumbnail_save_thumb (thumbnail,
-                                       pixbuf,
-                                       "GIMP " GIMP_VERSION,
-                                       error);
+  /*  only the rendering needs the image, writing the PNG doesn't  */
+  job = gimp_imagefile_job_new (imagefile, GIMP_IMAGEFILE_JOB_SAVE);
 
-  g_object_unref (pixbuf);
+  job->pixbuf  = pixbuf;
+  job->size    = size;
+  job->replace = replace;
 
-  if (success)
+  private->save_job = job;
+
+  if (async)
     {
-      if (replace)
-        gimp_thumbnail_delete_others (thumbnail, size);
-      else
-        gimp_thumbnail_delete_failure (thumbnail);
+      gimp_imagefile_job_push (job);
 
-      gimp_imagefile_update (imagefile);
+      return TRUE;
     }
 
+  gimp_imagefile_job_process (job);
+
+  success = job->success;
+
+  if (! success)
+    {
+      g_propagate_error (error, job->error);
+      job->error = NULL;
+    }
+
+  gimp_imagefile_job_finish (job);
+
   return success;
 }
 
+static GimpImagefileJob *
+gimp_imagefile_job_new (GimpImagefile        *imagefile,
+                        GimpImagefileJobType  type)
+{
+  GimpImagefilePrivate *private = GET_PRIVATE (imagefile);
+  GimpImagefileJob     *job     = g_slice_new0 (GimpImagefileJob);
+
+  job->type      = type;
+  job->serial    = ++thumbnail_serial;
+  job->thumbnail = gimp_thumbnail_new ();
+
+  gimp_thumbnail_copy_info (job->thumbnail, private->thumbnail);
+
+  if (type == GIMP_IMAGEFILE_JOB_SAVE)
+    job->imagefile = g_object_ref (imagefile);
+  else
+    job->imagefile = imagefile;
+
+  return job;
+}
+
+static void
+gimp_imagefile_job_free (GimpImagefileJob *job)
+{
+  if (job->type == GIMP_IMAGEFILE_JOB_SAVE && job->imagefile)
+    g_object_unref (job->imagefile);
+
+  g_object_unref (job->thumbnail);
+
+  if (job->pixbuf)
+    g_object_unref (job->pixbuf);
+
+  g_clear_error (&job->error);
+
+  g_slice_free (GimpImagefileJob, job);
+}
+
+static void
+gimp_imagefile_job_push (GimpImagefileJob *job)
+{
+  if (! thumbnail_pool)
+    {
+      thumbnail_pool = g_thread_pool_new ((GFunc) gimp_imagefile_job_run,
+                                          NULL,
+                                          GIMP_IMAGEFILE_N_THREADS,
+                                          FALSE, NULL);
+
+      g_thread_pool_set_sort_function (thumbnail_pool,
+                                       gimp_imagefile_job_compare,
+                                       NULL);
+    }
+
+  g_thread_pool_push (thumbnail_pool, job, NULL);
+}
+
+/*  loads for visible previews go first, most recently requested first,
+ *  so that scrolling through a large folder shows what is on screen
+ *  before what was scrolled past
+ */
+static gint
+gimp_imagefile_job_compare (gconstpointer a,
+                            gconstpointer b,
+                            gpointer      data)
+{
+  const GimpImagefileJob *job_a = a;
+  const GimpImagefileJob *job_b = b;
+
+  if (job_a->type != job_b->type)
+    return job_a->type < job_b->type ? -1 : 1;
+
+  return job_a->serial > job_b->serial ? -1 : 1;
+}
+
+static void
+gimp_imagefile_job_process (GimpImagefileJob *job)
+{
+  switch (job->type)
+    {
+    case GIMP_IMAGEFILE_JOB_LOAD:
+      if (! g_atomic_int_get (&job->cancelled) &&
+          ! g_atomic_int_get (&thumbnail_exiting))
+        {
+          job->pixbuf = gimp_imagefile_load_thumb (job->thumbnail,
+                                                   job->size,
+                                                   &job->error);
+        }
+      break;
+
+    case GIMP_IMAGEFILE_JOB_SAVE:
+      job->success = gimp_thumbnail_save_thumb (job->thumbnail,
+                                                job->pixbuf,
+                                                "GIMP " GIMP_VERSION,
+                                                &job->error);
+
+      if (job->success)
+        {
+          if (job->replace)
+            gimp_thumbnail_delete_others (job->thumbnail, job->size);
+          else
+            gimp_thumbnail_delete_failure (job->thumbnail);
+        }
+      break;
+    }
+}
+
+static void
+gimp_imagefile_job_run (GimpImagefileJob *job,
+                        gpointer          data)
+{
+  gimp_imagefile_job_process (job);
+
+  g_mutex_lock (&thumbnail_mutex);
+
+  g_queue_push_tail (&thumbnail_done, job);
+
+  if (! thumbnail_idle_id)
+    thumbnail_idle_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                         gimp_imagefile_job_idle,
+                                         NULL, NULL);
+
+  g_mutex_unlock (&thumbnail_mutex);
+}
+
+static gboolean
+gimp_imagefile_job_idle (gpointer data)
+{
+  GQueue done;
+
+  g_mutex_lock (&thumbnail_mutex);
+
+  done = thumbnail_done;
+  g_queue_init (&thumbnail_done);
+
+  thumbnail_idle_id = 0;
+
+  g_mutex_unlock (&thumbnail_mutex);
+
+  while (! g_queue_is_empty (&done))
+    gimp_imagefile_job_finish (g_queue_pop_head (&done));
+
+  return FALSE;
+}
+
+/*  delivers the results of @job to its imagefile, if it still wants
+ *  them, and frees the job
+ */
+static void
+gimp_imagefile_job_finish (GimpImagefileJob *job)
+{
+  GimpImagefile        *imagefile = job->imagefile;
+  GimpImagefilePrivate *private;
+
+  if (! imagefile)
+    {
+      gimp_imagefile_job_free (job);
+      return;
+    }
+
+  private = GET_PRIVATE (imagefile);
+
+  switch (job->type)
+    {
+    case GIMP_IMAGEFILE_JOB_LOAD:
+      private->load_job = NULL;
+
+      gimp_thumbnail_copy_info (private->thumbnail, job->thumbnail);
+
+      if (job->error)
+        {
+          gimp_message (private->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        _("Could not open thumbnail '%s': %s"),
+                        job->thumbnail->thumb_filename, job->error->message);
+        }
+
+      gimp_imagefile_drop_pixbuf (imagefile);
+
+      private->pixbuf      = job->pixbuf;
+      private->pixbuf_size = job->size;
+
+      job->pixbuf = NULL;
+
+      gimp_viewable_invalidate_preview (GIMP_VIEWABLE (imagefile));
+      break;
+
+    case GIMP_IMAGEFILE_JOB_SAVE:
+      if (private->save_job == job)
+        private->save_job = NULL;
+
+      if (job->success)
+        {
+          if (! g_strcmp0 (gimp_object_get_name (imagefile),
+                           job->thumbnail->image_uri))
+            {
+              gimp_thumbnail_copy_info (private->thumbnail, job->thumbnail);
+            }
+
+          gimp_imagefile_update (imagefile);
+        }
+      else if (job->error)
+        {
+          gimp_message_literal (private->gimp, NULL, GIMP_MESSAGE_ERROR,
+                                job->error->message);
+        }
+      break;
+    }
+
+  gimp_imagefile_job_free (job);
+}
+
 static void
 gimp_thumbnail_set_info_from_image (GimpThumbnail *thumbnail,
                                     const gchar   *mime_type,
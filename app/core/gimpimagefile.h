@@ -78,7 +78,12 @@ gboolean        gimp_imagefile_check_thumbnail       (GimpImagefile *imagefile);
 gboolean        gimp_imagefile_save_thumbnail        (GimpImagefile *imagefile,
                                                       const gchar   *mime_type,
                                                       GimpImage     *image);
+void            gimp_imagefile_save_thumbnail_async  (GimpImagefile *imagefile,
+                                                      const gchar   *mime_type,
+                                                      GimpImage     *image);
 const gchar   * gimp_imagefile_get_desc_string       (GimpImagefile *imagefile);
 
+void            gimp_imagefile_exit                  (void);
+
 
 #endif /* __GIMP_IMAGEFILE_H__ */
@@ -47,6 +47,7 @@
 #include "gimpimagemap.h"
 #include "gimpmarshal.h"
 #include "gimppickable.h"
+#include "gimpprojection.h"
 #include "gimpviewable.h"
 #include "gimpchannel.h"
 #include "gimpprogress.h"
@@ -404,6 +405,21 @@ gimp_image_map_apply (GimpImageMap *image_map)
                         rect.x, rect.y,
                         rect.width, rect.height);
 
+  /*  the settings are likely to change again before the whole area is
+   *  rendered, show the visible part at display resolution first
+   */
+  if (gimp_item_is_visible (GIMP_ITEM (image_map->drawable)))
+    {
+      gint offset_x, offset_y;
+
+      gimp_item_get_offset (GIMP_ITEM (image_map->drawable),
+                            &offset_x, &offset_y);
+
+      gimp_projection_preview_area (gimp_image_get_projection (image),
+                                    rect.x + offset_x, rect.y + offset_y,
+                                    rect.width, rect.height);
+    }
+
   g_signal_emit (image_map, image_map_signals[FLUSH], 0);
 }
 
@@ -53,6 +53,10 @@ static void     gimp_mask_undo_pop          (GimpUndo            *undo,
                                              GimpUndoAccumulator *accum);
 static void     gimp_mask_undo_free         (GimpUndo            *undo,
                                              GimpUndoMode         undo_mode);
+static void     gimp_mask_undo_foreach_buffer
+                                            (GimpUndo            *undo,
+                                             GimpUndoBufferFunc   func,
+                                             gpointer             user_data);
 
 
 G_DEFINE_TYPE (GimpMaskUndo, gimp_mask_undo, GIMP_TYPE_ITEM_UNDO)
@@ -75,6 +79,7 @@ gimp_mask_undo_class_init (GimpMaskUndoClass *klass)
 
   undo_class->pop                = gimp_mask_undo_pop;
   undo_class->free               = gimp_mask_undo_free;
+  undo_class->foreach_buffer     = gimp_mask_undo_foreach_buffer;
 
   g_object_class_install_property (object_class, PROP_CONVERT_FORMAT,
                                    g_param_spec_boolean ("convert-format",
@@ -287,3 +292,14 @@ gimp_mask_undo_free (GimpUndo     *undo,
 
   GIMP_UNDO_CLASS (parent_class)->free (undo, undo_mode);
 }
+
+static void
+gimp_mask_undo_foreach_buffer (GimpUndo           *undo,
+                               GimpUndoBufferFunc  func,
+                               gpointer            user_data)
+{
+  GimpMaskUndo *mask_undo = GIMP_MASK_UNDO (undo);
+
+  if (mask_undo->buffer)
+    func (&mask_undo->buffer, user_data);
+}
@@ -35,11 +35,16 @@
 #include "gimpprojectable.h"
 #include "gimpprojection.h"
 
+#include "gimp-log.h"
+
 
 /*  halfway between G_PRIORITY_HIGH_IDLE and G_PRIORITY_DEFAULT_IDLE  */
 #define GIMP_PROJECTION_IDLE_PRIORITY \
         ((G_PRIORITY_HIGH_IDLE + G_PRIORITY_DEFAULT_IDLE) / 2)
 
+#define GIMP_PROJECTION_CHUNK_WIDTH  256
+#define GIMP_PROJECTION_CHUNK_HEIGHT 128
+
 
 enum
 {
@@ -48,6 +53,14 @@ enum
 };
 
 
+typedef struct
+{
+  gpointer        owner;
+  GeglRectangle   rect;   /*  in tile-pyramid coordinates  */
+  gdouble         scale;
+} GimpProjectionPriority;
+
+
 /*  local function prototypes  */
 
 static void   gimp_projection_pickable_iface_init (GimpPickableInterface  *iface);
@@ -81,6 +94,11 @@ static void        gimp_projection_flush_whenever        (GimpProjection  *proj,
 static void        gimp_projection_idle_render_init      (GimpProjection  *proj);
 static gboolean    gimp_projection_idle_render_callback  (gpointer         data);
 static gboolean    gimp_projection_idle_render_next_area (GimpProjection  *proj);
+static GimpProjectionPriority *
+                   gimp_projection_get_priority_area     (GimpProjection  *proj,
+                                                          GimpArea        *area,
+                                                          GeglRectangle   *priority);
+static void        gimp_projection_priority_rendered     (GimpProjection  *proj);
 static void        gimp_projection_paint_area            (GimpProjection  *proj,
                                                           gboolean         now,
                                                           gint             x,
@@ -92,6 +110,17 @@ static void        gimp_projection_invalidate            (GimpProjection  *proj,
                                                           guint            y,
                                                           guint            w,
                                                           guint            h);
+static void        gimp_projection_render_area           (GimpProjection  *proj,
+                                                          gint             x,
+                                                          gint             y,
+                                                          gint             w,
+                                                          gint             h);
+static void        gimp_projection_render_level          (GimpProjection  *proj,
+                                                          gint             x,
+                                                          gint             y,
+                                                          gint             w,
+                                                          gint             h,
+                                                          gint             level);
 
 static void        gimp_projection_projectable_invalidate(GimpProjectable *projectable,
                                                           gint             x,
@@ -174,6 +203,9 @@ gimp_projection_finalize (GObject *object)
   gimp_area_list_free (proj->idle_render.update_areas);
   proj->idle_render.update_areas = NULL;
 
+  g_slist_free_full (proj->priority_rects, g_free);
+  proj->priority_rects = NULL;
+
   gimp_projection_free_buffer (proj);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -385,6 +417,182 @@ gimp_projection_finish_draw (GimpProjection *proj)
     }
 }
 
+/**
+ * gimp_projection_set_priority_rect:
+ * @proj:   a #GimpProjection
+ * @owner:  the display the rectangle is visible in
+ * @x:      x offset of the rectangle, in image coordinates
+ * @y:      y offset of the rectangle, in image coordinates
+ * @width:  width of the rectangle
+ * @height: height of the rectangle
+ * @scale:  the scale the rectangle is displayed at
+ *
+ * Sets the part of the projection that is currently visible in
+ * @owner. Update areas intersecting the visible parts of all owners
+ * are rendered before all others, and their tiles are rendered
+ * right away instead of on demand. Pass an empty rectangle when
+ * @owner stops showing the projection.
+ **/
+void
+gimp_projection_set_priority_rect (GimpProjection *proj,
+                                   gpointer        owner,
+                                   gint            x,
+                                   gint            y,
+                                   gint            width,
+                                   gint            height,
+                                   gdouble         scale)
+{
+  GimpProjectionPriority *priority = NULL;
+  GSList                 *list;
+  gint                    off_x, off_y;
+
+  g_return_if_fail (GIMP_IS_PROJECTION (proj));
+  g_return_if_fail (owner != NULL);
+
+  for (list = proj->priority_rects; list; list = g_slist_next (list))
+    {
+      if (((GimpProjectionPriority *) list->data)->owner == owner)
+        {
+          priority = list->data;
+          break;
+        }
+    }
+
+  if (width <= 0 || height <= 0)
+    {
+      if (priority)
+        {
+          proj->priority_rects = g_slist_remove (proj->priority_rects,
+                                                 priority);
+          g_free (priority);
+        }
+
+      return;
+    }
+
+  if (! priority)
+    {
+      priority = g_new0 (GimpProjectionPriority, 1);
+
+      priority->owner = owner;
+
+      proj->priority_rects = g_slist_append (proj->priority_rects, priority);
+    }
+
+  gimp_projectable_get_offset (proj->projectable, &off_x, &off_y);
+
+  /*  the priority rects are in tile-pyramid coordinates, like the
+   *  list of update areas
+   */
+  priority->rect.x      = x - off_x;
+  priority->rect.y      = y - off_y;
+  priority->rect.width  = width;
+  priority->rect.height = height;
+  priority->scale       = scale;
+}
+
+/**
+ * gimp_projection_preview_area:
+ * @proj:   a #GimpProjection
+ * @x:      x offset of the area, in image coordinates
+ * @y:      y offset of the area, in image coordinates
+ * @width:  width of the area
+ * @height: height of the area
+ *
+ * Shows a preview of an area whose update is pending, for updates
+ * that are likely to be superseded soon, like the live preview of a
+ * filter while its settings are changed.
+ *
+ * When the visible part of the projection is displayed zoomed out,
+ * the part of the area within it is invalidated and emitted as
+ * updated right away, so the display redraws it from mipmap tiles
+ * rendered at its scale. The full resolution rendering of the area,
+ * which goes through the usual update, follows in the background
+ * and refines the preview.
+ **/
+void
+gimp_projection_preview_area (GimpProjection *proj,
+                              gint            x,
+                              gint            y,
+                              gint            width,
+                              gint            height)
+{
+  GSList *list;
+  gint    off_x, off_y;
+  gint    proj_width, proj_height;
+
+  g_return_if_fail (GIMP_IS_PROJECTION (proj));
+
+  gimp_projectable_get_offset (proj->projectable, &off_x, &off_y);
+  gimp_projectable_get_size   (proj->projectable, &proj_width, &proj_height);
+
+  for (list = proj->priority_rects; list; list = g_slist_next (list))
+    {
+      GimpProjectionPriority *priority = list->data;
+      GeglRectangle           visible;
+
+      /*  at full resolution, the preview would be the real thing  */
+      if (gimp_projection_get_level (proj, priority->scale) == 0)
+        continue;
+
+      if (! gegl_rectangle_intersect (&visible,
+                                      GEGL_RECTANGLE (x - off_x, y - off_y,
+                                                      width, height),
+                                      &priority->rect) ||
+          ! gegl_rectangle_intersect (&visible,
+                                      &visible,
+                                      GEGL_RECTANGLE (0, 0,
+                                                      proj_width,
+                                                      proj_height)))
+        continue;
+
+      gimp_projection_invalidate (proj,
+                                  visible.x, visible.y,
+                                  visible.width, visible.height);
+
+      g_signal_emit (proj, projection_signals[UPDATE], 0,
+                     FALSE,
+                     visible.x + off_x,
+                     visible.y + off_y,
+                     visible.width,
+                     visible.height);
+    }
+}
+
+/**
+ * gimp_projection_get_level:
+ * @proj:  a #GimpProjection
+ * @scale: the scale the projection is displayed at
+ *
+ * Returns the mipmap level of the projection's buffer that
+ * gegl_buffer_get() reads from when it is asked for pixels at @scale,
+ * the level the visible part of the projection is rendered at.
+ *
+ * Return value: the mipmap level, 0 being full resolution.
+ **/
+gint
+gimp_projection_get_level (GimpProjection *proj,
+                           gdouble         scale)
+{
+  GimpTileHandlerProjection *handler;
+  gint                       level = 0;
+
+  g_return_val_if_fail (GIMP_IS_PROJECTION (proj), 0);
+
+  if (! proj->validate_handler)
+    return 0;
+
+  handler = GIMP_TILE_HANDLER_PROJECTION (proj->validate_handler);
+
+  while (scale <= 0.5 && level < handler->max_z)
+    {
+      scale *= 2.0;
+      level++;
+    }
+
+  return level;
+}
+
 
 /*  private functions  */
 
@@ -433,6 +641,17 @@ gimp_projection_add_update_area (GimpProjection *proj,
                         CLAMP (x + w, 0, width),
                         CLAMP (y + h, 0, height));
 
+  if (! proj->priority_update_time)
+    {
+      GeglRectangle priority;
+
+      /*  remember when the visible area was first invalidated, to
+       *  measure how long it takes until it is rendered again
+       */
+      if (gimp_projection_get_priority_area (proj, area, &priority))
+        proj->priority_update_time = g_get_monotonic_time ();
+    }
+
   proj->update_areas = gimp_area_list_process (proj->update_areas, area);
 }
 
@@ -461,6 +680,9 @@ gimp_projection_flush_whenever (GimpProjection *proj,
                                               (area->y2 - area->y1));
                 }
             }
+
+          if (! proj->idle_render.idle_id)
+            gimp_projection_priority_rendered (proj);
         }
       else  /* Asynchronous */
         {
@@ -551,11 +773,8 @@ gimp_projection_idle_render_callback (gpointer data)
   gint            workx, worky;
   gint            workw, workh;
 
-#define CHUNK_WIDTH  256
-#define CHUNK_HEIGHT 128
-
-  workw = CHUNK_WIDTH;
-  workh = CHUNK_HEIGHT;
+  workw = proj->idle_render.chunk_width;
+  workh = proj->idle_render.chunk_height;
   workx = proj->idle_render.x;
   worky = proj->idle_render.y;
 
@@ -572,13 +791,13 @@ gimp_projection_idle_render_callback (gpointer data)
   gimp_projection_paint_area (proj, TRUE /* sic! */,
                               workx, worky, workw, workh);
 
-  proj->idle_render.x += CHUNK_WIDTH;
+  proj->idle_render.x += proj->idle_render.chunk_width;
 
   if (proj->idle_render.x >=
       proj->idle_render.base_x + proj->idle_render.width)
     {
       proj->idle_render.x = proj->idle_render.base_x;
-      proj->idle_render.y += CHUNK_HEIGHT;
+      proj->idle_render.y += proj->idle_render.chunk_height;
 
       if (proj->idle_render.y >=
           proj->idle_render.base_y + proj->idle_render.height)
@@ -610,16 +829,85 @@ gimp_projection_idle_render_callback (gpointer data)
 static gboolean
 gimp_projection_idle_render_next_area (GimpProjection *proj)
 {
-  GimpArea *area;
+  GimpProjectionPriority *visible = NULL;
+  GimpArea               *area    = NULL;
+  GeglRectangle           priority;
+  GSList                 *list;
+  gint                    level;
+
+  /*  areas intersecting the visible parts of the projection go first,
+   *  so new invalidations there preempt rendering of the rest
+   */
+  for (list = proj->idle_render.update_areas; list; list = g_slist_next (list))
+    {
+      visible = gimp_projection_get_priority_area (proj, list->data,
+                                                   &priority);
 
-  if (! proj->idle_render.update_areas)
-    return FALSE;
+      if (visible)
+        {
+          area = list->data;
+          break;
+        }
+    }
+
+  if (! area)
+    {
+      gimp_projection_priority_rendered (proj);
 
-  area = proj->idle_render.update_areas->data;
+      if (! proj->idle_render.update_areas)
+        return FALSE;
+
+      area = proj->idle_render.update_areas->data;
+    }
 
   proj->idle_render.update_areas =
     g_slist_remove (proj->idle_render.update_areas, area);
 
+  proj->idle_render.chunk_width  = GIMP_PROJECTION_CHUNK_WIDTH;
+  proj->idle_render.chunk_height = GIMP_PROJECTION_CHUNK_HEIGHT;
+
+  if (visible)
+    {
+      GSList *areas = proj->idle_render.update_areas;
+      gint    x1    = priority.x;
+      gint    y1    = priority.y;
+      gint    x2    = priority.x + priority.width;
+      gint    y2    = priority.y + priority.height;
+
+      /*  put the invisible parts back into the list, without merging
+       *  them with the rest, and continue with the visible part only
+       */
+      if (y1 > area->y1)
+        areas = g_slist_prepend (areas,
+                                 gimp_area_new (area->x1, area->y1,
+                                                area->x2, y1));
+      if (y2 < area->y2)
+        areas = g_slist_prepend (areas,
+                                 gimp_area_new (area->x1, y2,
+                                                area->x2, area->y2));
+      if (x1 > area->x1)
+        areas = g_slist_prepend (areas,
+                                 gimp_area_new (area->x1, y1, x1, y2));
+      if (x2 < area->x2)
+        areas = g_slist_prepend (areas,
+                                 gimp_area_new (x2, y1, area->x2, y2));
+
+      proj->idle_render.update_areas = areas;
+
+      area->x1 = x1;
+      area->y1 = y1;
+      area->x2 = x2;
+      area->y2 = y2;
+
+      /*  when zoomed out, only the mipmap level of visible chunks is
+       *  rendered, so the chunks can cover as many pixels of it
+       */
+      level = gimp_projection_get_level (proj, visible->scale);
+
+      proj->idle_render.chunk_width  <<= level;
+      proj->idle_render.chunk_height <<= level;
+    }
+
   proj->idle_render.x      = proj->idle_render.base_x = area->x1;
   proj->idle_render.y      = proj->idle_render.base_y = area->y1;
   proj->idle_render.width  = area->x2 - area->x1;
@@ -630,6 +918,47 @@ gimp_projection_idle_render_next_area (GimpProjection *proj)
   return TRUE;
 }
 
+/*  returns the first visible part of the projection that intersects
+ *  @area, and the intersection in @priority
+ */
+static GimpProjectionPriority *
+gimp_projection_get_priority_area (GimpProjection *proj,
+                                   GimpArea       *area,
+                                   GeglRectangle  *priority)
+{
+  GeglRectangle  rect;
+  GSList        *list;
+
+  rect.x      = area->x1;
+  rect.y      = area->y1;
+  rect.width  = area->x2 - area->x1;
+  rect.height = area->y2 - area->y1;
+
+  for (list = proj->priority_rects; list; list = g_slist_next (list))
+    {
+      GimpProjectionPriority *visible = list->data;
+
+      if (gegl_rectangle_intersect (priority, &rect, &visible->rect))
+        return visible;
+    }
+
+  return NULL;
+}
+
+static void
+gimp_projection_priority_rendered (GimpProjection *proj)
+{
+  if (proj->priority_update_time)
+    {
+      GIMP_LOG (PROJECTION,
+                "visible area rendered %.3f ms after invalidation",
+                (g_get_monotonic_time () - proj->priority_update_time) /
+                1000.0);
+
+      proj->priority_update_time = 0;
+    }
+}
+
 static void
 gimp_projection_paint_area (GimpProjection *proj,
                             gboolean        now,
@@ -638,9 +967,10 @@ gimp_projection_paint_area (GimpProjection *proj,
                             gint            w,
                             gint            h)
 {
-  gint off_x, off_y;
-  gint width, height;
-  gint x1, y1, x2, y2;
+  GSList *list;
+  gint    off_x, off_y;
+  gint    width, height;
+  gint    x1, y1, x2, y2;
 
   gimp_projectable_get_offset (proj->projectable, &off_x, &off_y);
   gimp_projectable_get_size   (proj->projectable, &width, &height);
@@ -653,6 +983,40 @@ gimp_projection_paint_area (GimpProjection *proj,
 
   gimp_projection_invalidate (proj, x1, y1, x2 - x1, y2 - y1);
 
+  for (list = proj->priority_rects; list; list = g_slist_next (list))
+    {
+      GimpProjectionPriority *priority = list->data;
+      GeglRectangle           visible;
+
+      /*  render the visible parts right away, instead of tile by tile
+       *  when the displays fetch them
+       */
+      if (gegl_rectangle_intersect (&visible,
+                                    GEGL_RECTANGLE (x1, y1, x2 - x1, y2 - y1),
+                                    &priority->rect))
+        {
+          gint level = gimp_projection_get_level (proj, priority->scale);
+
+          /*  when zoomed out, render only the mipmap level the display
+           *  reads, the full resolution tiles are rendered when
+           *  something fetches them
+           */
+          if (level > 0)
+            gimp_projection_render_level (proj,
+                                          visible.x,
+                                          visible.y,
+                                          visible.width,
+                                          visible.height,
+                                          level);
+          else
+            gimp_projection_render_area (proj,
+                                         visible.x,
+                                         visible.y,
+                                         visible.width,
+                                         visible.height);
+        }
+    }
+
   /*  add the projectable's offsets because the list of update areas
    *  is in tile-pyramid coordinates, but our external API is always
    *  in terms of image coordinates.
@@ -678,6 +1042,155 @@ gimp_projection_invalidate (GimpProjection *proj,
 }
 
 
+/*  renders the dirty parts of an area's tiles right away, instead of
+ *  when they are fetched.  GEGL 0.2 graphs and buffers must not be
+ *  used from several threads, so this happens on the main thread, and
+ *  projection rendering is not spread over the gimp-parallel threads.
+ */
+static void
+gimp_projection_render_area (GimpProjection *proj,
+                             gint            x,
+                             gint            y,
+                             gint            w,
+                             gint            h)
+{
+  GimpTileHandlerProjection *handler;
+  const Babl                *format;
+  gint                       bpp;
+  gint                       tile_x1, tile_y1;
+  gint                       tile_x2, tile_y2;
+  gint                       tile_x, tile_y;
+
+  if (! proj->validate_handler)
+    return;
+
+  handler = GIMP_TILE_HANDLER_PROJECTION (proj->validate_handler);
+
+  format = handler->format;
+  bpp    = babl_format_get_bytes_per_pixel (format);
+
+  tile_x1 = x / handler->tile_width;
+  tile_y1 = y / handler->tile_height;
+  tile_x2 = (x + w - 1) / handler->tile_width;
+  tile_y2 = (y + h - 1) / handler->tile_height;
+
+  for (tile_y = tile_y1; tile_y <= tile_y2; tile_y++)
+    {
+      for (tile_x = tile_x1; tile_x <= tile_x2; tile_x++)
+        {
+          cairo_region_t *region;
+          gint            n_rects;
+          gint            i;
+
+          /*  take the dirty part of the tile out of the tile handler,
+           *  so it isn't rendered again when the tile is fetched
+           */
+          region = gimp_tile_handler_projection_claim_tile (handler,
+                                                            tile_x,
+                                                            tile_y);
+          if (! region)
+            continue;
+
+          n_rects = cairo_region_num_rectangles (region);
+
+          for (i = 0; i < n_rects; i++)
+            {
+              cairo_rectangle_int_t rect;
+              guchar               *data;
+
+              cairo_region_get_rectangle (region, i, &rect);
+
+              data = g_malloc (rect.width * rect.height * bpp);
+
+              gegl_node_blit (handler->graph, 1.0,
+                              GEGL_RECTANGLE (rect.x, rect.y,
+                                              rect.width, rect.height),
+                              format, data, rect.width * bpp,
+                              GEGL_BLIT_DEFAULT);
+
+              gegl_buffer_set (proj->buffer,
+                               GEGL_RECTANGLE (rect.x, rect.y,
+                                               rect.width, rect.height),
+                               0, format, data, rect.width * bpp);
+
+              g_free (data);
+            }
+
+          cairo_region_destroy (region);
+        }
+    }
+}
+
+/*  renders the missing tiles of a mipmap level above an area straight
+ *  from the graph, at the level's scale.  like gimp_projection_render_area()
+ *  this uses the graph, so it happens on the main thread.
+ */
+static void
+gimp_projection_render_level (GimpProjection *proj,
+                              gint            x,
+                              gint            y,
+                              gint            w,
+                              gint            h,
+                              gint            level)
+{
+  GimpTileHandlerProjection *handler;
+  const Babl                *format;
+  gint                       bpp;
+  guchar                    *data;
+  gint                       level_tile_width;
+  gint                       level_tile_height;
+  gint                       tile_x1, tile_y1;
+  gint                       tile_x2, tile_y2;
+  gint                       tile_x, tile_y;
+
+  if (! proj->validate_handler)
+    return;
+
+  handler = GIMP_TILE_HANDLER_PROJECTION (proj->validate_handler);
+
+  format = handler->format;
+  bpp    = babl_format_get_bytes_per_pixel (format);
+
+  /*  the size of the level's tiles at full resolution  */
+  level_tile_width  = handler->tile_width  << level;
+  level_tile_height = handler->tile_height << level;
+
+  tile_x1 = x / level_tile_width;
+  tile_y1 = y / level_tile_height;
+  tile_x2 = (x + w - 1) / level_tile_width;
+  tile_y2 = (y + h - 1) / level_tile_height;
+
+  data = g_malloc (handler->tile_width * handler->tile_height * bpp);
+
+  for (tile_y = tile_y1; tile_y <= tile_y2; tile_y++)
+    {
+      for (tile_x = tile_x1; tile_x <= tile_x2; tile_x++)
+        {
+          if (! gimp_tile_handler_projection_claim_level_tile (handler,
+                                                               tile_x,
+                                                               tile_y,
+                                                               level))
+            continue;
+
+          /*  in the level's coordinates  */
+          gegl_node_blit (handler->graph, 1.0 / (1 << level),
+                          GEGL_RECTANGLE (tile_x * handler->tile_width,
+                                          tile_y * handler->tile_height,
+                                          handler->tile_width,
+                                          handler->tile_height),
+                          format, data, handler->tile_width * bpp,
+                          GEGL_BLIT_DEFAULT);
+
+          gimp_tile_handler_projection_set_level_tile (handler,
+                                                       tile_x, tile_y,
+                                                       level, data);
+        }
+    }
+
+  g_free (data);
+}
+
+
 /*  image callbacks  */
 
 static void
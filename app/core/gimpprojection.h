@@ -32,6 +32,8 @@ struct _GimpProjectionIdleRender
   gint    y;
   gint    base_x;
   gint    base_y;
+  gint    chunk_width;
+  gint    chunk_height;
   guint   idle_id;
   GSList *update_areas;   /*  flushed update areas */
 };
@@ -60,6 +62,12 @@ struct _GimpProjection
   GSList                   *update_areas;
   GimpProjectionIdleRender  idle_render;
 
+  /*  the visible parts of the projection, one per display showing
+   *  it, which are rendered first
+   */
+  GSList                   *priority_rects;
+  gint64                    priority_update_time;
+
   gboolean                  invalidate_preview;
 };
 
@@ -76,18 +84,33 @@ struct _GimpProjectionClass
 };
 
 
-GType            gimp_projection_get_type         (void) G_GNUC_CONST;
-
-GimpProjection * gimp_projection_new              (GimpProjectable   *projectable);
-
-void             gimp_projection_flush            (GimpProjection    *proj);
-void             gimp_projection_flush_now        (GimpProjection    *proj);
-void             gimp_projection_finish_draw      (GimpProjection    *proj);
-
-gint64           gimp_projection_estimate_memsize (GimpImageBaseType  type,
-                                                   GimpPrecision      precision,
-                                                   gint               width,
-                                                   gint               height);
+GType            gimp_projection_get_type          (void) G_GNUC_CONST;
+
+GimpProjection * gimp_projection_new               (GimpProjectable   *projectable);
+
+void             gimp_projection_flush             (GimpProjection    *proj);
+void             gimp_projection_flush_now         (GimpProjection    *proj);
+void             gimp_projection_finish_draw       (GimpProjection    *proj);
+
+void             gimp_projection_set_priority_rect (GimpProjection    *proj,
+                                                    gpointer           owner,
+                                                    gint               x,
+                                                    gint               y,
+                                                    gint               width,
+                                                    gint               height,
+                                                    gdouble            scale);
+void             gimp_projection_preview_area      (GimpProjection    *proj,
+                                                    gint               x,
+                                                    gint               y,
+                                                    gint               width,
+                                                    gint               height);
+gint             gimp_projection_get_level         (GimpProjection    *proj,
+                                                    gdouble            scale);
+
+gint64           gimp_projection_estimate_memsize  (GimpImageBaseType  type,
+                                                    GimpPrecision      precision,
+                                                    gint               width,
+                                                    gint               height);
 
 
 #endif /*  __GIMP_PROJECTION_H__  */
@@ -27,6 +27,8 @@
 
 #include "config/gimpcoreconfig.h"
 
+#include "gegl/gimptilebackendcompressed.h"
+
 #include "gimp.h"
 #include "gimpcontext.h"
 #include "gimpimage.h"
@@ -86,6 +88,12 @@ static void          gimp_undo_real_pop            (GimpUndo            *undo,
                                                     GimpUndoAccumulator *accum);
 static void          gimp_undo_real_free           (GimpUndo            *undo,
                                                     GimpUndoMode         undo_mode);
+static void          gimp_undo_real_foreach_buffer (GimpUndo            *undo,
+                                                    GimpUndoBufferFunc   func,
+                                                    gpointer             user_data);
+
+static void          gimp_undo_decompress_buffer   (GeglBuffer         **buffer,
+                                                    gpointer             data);
 
 static gboolean      gimp_undo_create_preview_idle (gpointer             data);
 static void       gimp_undo_create_preview_private (GimpUndo            *undo,
@@ -140,6 +148,7 @@ gimp_undo_class_init (GimpUndoClass *klass)
 
   klass->pop                       = gimp_undo_real_pop;
   klass->free                      = gimp_undo_real_free;
+  klass->foreach_buffer            = gimp_undo_real_foreach_buffer;
 
   g_object_class_install_property (object_class, PROP_IMAGE,
                                    g_param_spec_object ("image", NULL, NULL,
@@ -347,6 +356,13 @@ gimp_undo_real_free (GimpUndo     *undo,
 {
 }
 
+static void
+gimp_undo_real_foreach_buffer (GimpUndo           *undo,
+                               GimpUndoBufferFunc  func,
+                               gpointer            user_data)
+{
+}
+
 void
 gimp_undo_pop (GimpUndo            *undo,
                GimpUndoMode         undo_mode,
@@ -381,6 +397,65 @@ gimp_undo_free (GimpUndo     *undo,
   g_signal_emit (undo, undo_signals[FREE], 0, undo_mode);
 }
 
+/**
+ * gimp_undo_foreach_buffer:
+ * @undo:      a #GimpUndo
+ * @func:      the function to call for each buffer
+ * @user_data: data to pass to @func
+ *
+ * Calls @func with the location of each buffer kept by @undo, and by
+ * the undos in it if it is a group. @func may replace the buffer, e.g.
+ * by a compressed copy.
+ **/
+void
+gimp_undo_foreach_buffer (GimpUndo           *undo,
+                          GimpUndoBufferFunc  func,
+                          gpointer            user_data)
+{
+  g_return_if_fail (GIMP_IS_UNDO (undo));
+  g_return_if_fail (func != NULL);
+
+  GIMP_UNDO_GET_CLASS (undo)->foreach_buffer (undo, func, user_data);
+}
+
+/**
+ * gimp_undo_decompress:
+ * @undo:  a #GimpUndo
+ * @error: return location for errors
+ *
+ * Replaces the compressed buffers kept by @undo by plain ones, which
+ * must be done before @undo is popped.
+ *
+ * Return value: %FALSE if a buffer could not be read back, @undo must
+ *               not be popped then.
+ **/
+gboolean
+gimp_undo_decompress (GimpUndo  *undo,
+                      GError   **error)
+{
+  GError *my_error = NULL;
+
+  g_return_val_if_fail (GIMP_IS_UNDO (undo), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (! undo->compressed)
+    return TRUE;
+
+  gimp_undo_foreach_buffer (undo, gimp_undo_decompress_buffer, &my_error);
+
+  if (my_error)
+    {
+      g_propagate_error (error, my_error);
+
+      return FALSE;
+    }
+
+  undo->compressed = FALSE;
+  undo->swapped    = FALSE;
+
+  return TRUE;
+}
+
 typedef struct _GimpUndoIdle GimpUndoIdle;
 
 struct _GimpUndoIdle
@@ -498,6 +573,26 @@ gimp_undo_create_preview_private (GimpUndo    *undo,
   gimp_viewable_invalidate_preview (GIMP_VIEWABLE (undo));
 }
 
+static void
+gimp_undo_decompress_buffer (GeglBuffer **buffer,
+                             gpointer     data)
+{
+  GError     **error = data;
+  GeglBuffer  *plain;
+
+  /*  stop at the first buffer which can't be read  */
+  if (*error)
+    return;
+
+  plain = gimp_tile_backend_compressed_decompress (*buffer, error);
+
+  if (plain)
+    {
+      g_object_unref (*buffer);
+      *buffer = plain;
+    }
+}
+
 void
 gimp_undo_refresh_preview (GimpUndo    *undo,
                            GimpContext *context)
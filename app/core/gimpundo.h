@@ -59,6 +59,10 @@ struct _GimpUndo
   GimpUndoType      undo_type;      /* undo type                          */
   GimpDirtyMask     dirty_mask;     /* affected parts of the image        */
 
+  gint64            memsize;        /* size accounted by the undo stack   */
+  gboolean          compressed;     /* buffers are compressed             */
+  gboolean          swapped;        /* buffers are in a swap file         */
+
   GimpTempBuf      *preview;
   guint             preview_idle_id;
 };
@@ -72,6 +76,13 @@ struct _GimpUndoClass
                  GimpUndoAccumulator *accum);
   void (* free) (GimpUndo            *undo,
                  GimpUndoMode         undo_mode);
+
+  /*  calls @func for each buffer the undo keeps, @func may replace
+   *  it.  the buffers are decompressed before the undo is popped
+   */
+  void (* foreach_buffer) (GimpUndo            *undo,
+                           GimpUndoBufferFunc   func,
+                           gpointer             user_data);
 };
 
 
@@ -82,6 +93,11 @@ void          gimp_undo_pop             (GimpUndo            *undo,
                                          GimpUndoAccumulator *accum);
 void          gimp_undo_free            (GimpUndo            *undo,
                                          GimpUndoMode         undo_mode);
+void          gimp_undo_foreach_buffer  (GimpUndo            *undo,
+                                         GimpUndoBufferFunc   func,
+                                         gpointer             user_data);
+gboolean      gimp_undo_decompress      (GimpUndo            *undo,
+                                         GError             **error);
 
 void          gimp_undo_create_preview  (GimpUndo            *undo,
                                          GimpContext         *context,
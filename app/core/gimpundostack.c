@@ -37,6 +37,13 @@ static void    gimp_undo_stack_pop         (GimpUndo            *undo,
                                             GimpUndoAccumulator *accum);
 static void    gimp_undo_stack_free        (GimpUndo            *undo,
                                             GimpUndoMode         undo_mode);
+static void    gimp_undo_stack_foreach_buffer
+                                           (GimpUndo            *undo,
+                                            GimpUndoBufferFunc   func,
+                                            gpointer             user_data);
+
+static void    gimp_undo_stack_account     (GimpUndoStack       *stack,
+                                            GimpUndo            *undo);
 
 
 G_DEFINE_TYPE (GimpUndoStack, gimp_undo_stack, GIMP_TYPE_UNDO)
@@ -57,6 +64,7 @@ gimp_undo_stack_class_init (GimpUndoStackClass *klass)
 
   undo_class->pop                = gimp_undo_stack_pop;
   undo_class->free               = gimp_undo_stack_free;
+  undo_class->foreach_buffer     = gimp_undo_stack_foreach_buffer;
 }
 
 static void
@@ -86,7 +94,10 @@ gimp_undo_stack_get_memsize (GimpObject *object,
   GimpUndoStack *stack   = GIMP_UNDO_STACK (object);
   gint64         memsize = 0;
 
-  memsize += gimp_object_get_memsize (GIMP_OBJECT (stack->undos), gui_size);
+  /*  use the running total instead of walking all undos, so the
+   *  size of a group can be updated cheaply while it grows
+   */
+  memsize += stack->memsize;
 
   return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
                                                                   gui_size);
@@ -107,6 +118,9 @@ gimp_undo_stack_pop (GimpUndo            *undo,
       GimpUndo *child = list->data;
 
       gimp_undo_pop (child, undo_mode, accum);
+
+      /*  popping swaps the undo's data, which may change its size  */
+      gimp_undo_stack_account (stack, child);
     }
 }
 
@@ -128,6 +142,24 @@ gimp_undo_stack_free (GimpUndo     *undo,
     }
 
   gimp_container_clear (stack->undos);
+
+  stack->memsize = 0;
+}
+
+static void
+gimp_undo_stack_foreach_buffer (GimpUndo           *undo,
+                                GimpUndoBufferFunc  func,
+                                gpointer            user_data)
+{
+  GimpUndoStack *stack = GIMP_UNDO_STACK (undo);
+  GList         *list;
+
+  for (list = GIMP_LIST (stack->undos)->list;
+       list;
+       list = g_list_next (list))
+    {
+      gimp_undo_foreach_buffer (list->data, func, user_data);
+    }
 }
 
 GimpUndoStack *
@@ -147,6 +179,10 @@ gimp_undo_stack_push_undo (GimpUndoStack *stack,
   g_return_if_fail (GIMP_IS_UNDO_STACK (stack));
   g_return_if_fail (GIMP_IS_UNDO (undo));
 
+  undo->memsize = 0;
+
+  gimp_undo_stack_account (stack, undo);
+
   gimp_container_add (stack->undos, GIMP_OBJECT (undo));
 }
 
@@ -165,6 +201,8 @@ gimp_undo_stack_pop_undo (GimpUndoStack       *stack,
   if (undo)
     {
       gimp_container_remove (stack->undos, GIMP_OBJECT (undo));
+      stack->memsize -= undo->memsize;
+
       gimp_undo_pop (undo, undo_mode, accum);
 
       return undo;
@@ -186,6 +224,8 @@ gimp_undo_stack_free_bottom (GimpUndoStack *stack,
   if (undo)
     {
       gimp_container_remove (stack->undos, GIMP_OBJECT (undo));
+      stack->memsize -= undo->memsize;
+
       gimp_undo_free (undo, undo_mode);
 
       return undo;
@@ -209,3 +249,69 @@ gimp_undo_stack_get_depth (GimpUndoStack *stack)
 
   return gimp_container_get_n_children (stack->undos);
 }
+
+/**
+ * gimp_undo_stack_update_undo:
+ * @stack: a #GimpUndoStack
+ * @undo:  an undo in @stack
+ *
+ * Updates the running memsize total of @stack after the buffers of
+ * @undo were replaced, e.g. because they were compressed. The totals
+ * of @undo are updated too if it is a group.
+ **/
+void
+gimp_undo_stack_update_undo (GimpUndoStack *stack,
+                             GimpUndo      *undo)
+{
+  g_return_if_fail (GIMP_IS_UNDO_STACK (stack));
+  g_return_if_fail (GIMP_IS_UNDO (undo));
+
+  if (GIMP_IS_UNDO_STACK (undo))
+    {
+      GimpUndoStack *group = GIMP_UNDO_STACK (undo);
+      GList         *list;
+
+      for (list = GIMP_LIST (group->undos)->list;
+           list;
+           list = g_list_next (list))
+        {
+          gimp_undo_stack_update_undo (group, list->data);
+        }
+    }
+
+  gimp_undo_stack_account (stack, undo);
+}
+
+/**
+ * gimp_undo_stack_update_top:
+ * @stack: a #GimpUndoStack
+ *
+ * Updates the running memsize total of @stack after the undo on top of
+ * it changed, e.g. because more undos were pushed into that group or
+ * because it was compressed.
+ **/
+void
+gimp_undo_stack_update_top (GimpUndoStack *stack)
+{
+  GimpUndo *undo;
+
+  g_return_if_fail (GIMP_IS_UNDO_STACK (stack));
+
+  undo = gimp_undo_stack_peek (stack);
+
+  if (undo)
+    gimp_undo_stack_account (stack, undo);
+}
+
+
+/*  private functions  */
+
+static void
+gimp_undo_stack_account (GimpUndoStack *stack,
+                         GimpUndo      *undo)
+{
+  gint64 memsize = gimp_object_get_memsize (GIMP_OBJECT (undo), NULL);
+
+  stack->memsize += memsize - undo->memsize;
+  undo->memsize   = memsize;
+}
@@ -37,6 +37,7 @@ struct _GimpUndoStack
   GimpUndo       parent_instance;
 
   GimpContainer *undos;
+  gint64         memsize;  /* running total of the undos' memsizes */
 };
 
 struct _GimpUndoStackClass
@@ -60,5 +61,9 @@ GimpUndo      * gimp_undo_stack_free_bottom (GimpUndoStack       *stack,
 GimpUndo      * gimp_undo_stack_peek        (GimpUndoStack       *stack);
 gint            gimp_undo_stack_get_depth   (GimpUndoStack       *stack);
 
+void            gimp_undo_stack_update_top  (GimpUndoStack       *stack);
+void            gimp_undo_stack_update_undo (GimpUndoStack       *stack,
+                                             GimpUndo            *undo);
+
 
 #endif /* __GIMP_UNDO_STACK_H__ */
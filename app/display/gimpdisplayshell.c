@@ -75,6 +75,7 @@
 #include "gimpdisplayshell-title.h"
 #include "gimpdisplayshell-tool-events.h"
 #include "gimpdisplayshell-transform.h"
+#include "gimpdisplayxfer.h"
 #include "gimpimagewindow.h"
 #include "gimpmotionbuffer.h"
 #include "gimpstatusbar.h"
@@ -170,6 +171,8 @@ static void   gimp_display_shell_transform_overlay (GimpDisplayShell *shell,
                                                     GtkWidget        *child,
                                                     gdouble          *x,
                                                     gdouble          *y);
+static void   gimp_display_shell_update_priority_rect
+                                                   (GimpDisplayShell *shell);
 
 
 G_DEFINE_TYPE_WITH_CODE (GimpDisplayShell, gimp_display_shell,
@@ -1180,6 +1183,37 @@ gimp_display_shell_transform_overlay (GimpDisplayShell *shell,
     }
 }
 
+static void
+gimp_display_shell_update_priority_rect (GimpDisplayShell *shell)
+{
+  GimpImage *image = gimp_display_get_image (shell->display);
+
+  if (image)
+    {
+      gint    x, y;
+      gint    width, height;
+      gdouble window_scale = 1.0;
+
+#ifdef GIMP_DISPLAY_RENDER_ENABLE_SCALING
+      window_scale = gdk_window_get_scale_factor (gtk_widget_get_window (gtk_widget_get_toplevel (GTK_WIDGET (shell))));
+#endif
+
+      window_scale = MIN (window_scale, GIMP_DISPLAY_RENDER_MAX_SCALE);
+
+      /*  let the projection render what we show first, at the scale
+       *  gimp_display_shell_render() reads it at, so it renders the
+       *  mipmap level we actually show
+       */
+      gimp_display_shell_untransform_viewport (shell,
+                                               &x, &y, &width, &height);
+
+      gimp_projection_set_priority_rect (gimp_image_get_projection (image),
+                                         shell,
+                                         x, y, width, height,
+                                         shell->scale_x * window_scale);
+    }
+}
+
 
 /*  public functions  */
 
@@ -1464,6 +1498,8 @@ gimp_display_shell_scaled (GimpDisplayShell *shell)
                                            child, x, y);
     }
 
+  gimp_display_shell_update_priority_rect (shell);
+
   g_signal_emit (shell, display_shell_signals[SCALED], 0);
 }
 
@@ -1487,6 +1523,8 @@ gimp_display_shell_scrolled (GimpDisplayShell *shell)
                                            child, x, y);
     }
 
+  gimp_display_shell_update_priority_rect (shell);
+
   g_signal_emit (shell, display_shell_signals[SCROLLED], 0);
 }
 
@@ -0,0 +1,1147 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimptilebackendcompressed.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <gegl.h>
+#include <glib/gstdio.h>
+
+#ifdef G_OS_WIN32
+#include <io.h>
+#endif
+
+#include "libgimpbase/gimpbase.h"
+
+#include "gimp-gegl-types.h"
+
+#include "gimptilebackendcompressed.h"
+
+#include "gimp-intl.h"
+
+
+/*  the buffer data key under which a compressed buffer's backend lives  */
+#define BACKEND_KEY "gimp-tile-backend-compressed"
+
+
+struct _GimpCompressedTile
+{
+  guchar *data;    /* compressed pixels, NULL when empty or swapped out  */
+  gint    size;    /* compressed size, 0 for an empty tile, tile size
+                    * when stored uncompressed
+                    */
+  gint64  offset;  /* position in the swap file                          */
+};
+
+struct _GimpTileBackendCompressedSwap
+{
+  gint     ref_count;
+  gchar   *swap_dir;
+  gchar   *filename;  /* NULL until the first tile is written          */
+  gint     fd;
+  gint64   size;      /* end of the used part of the file              */
+  GList   *holes;     /* unused ranges below size, sorted by offset    */
+  GMutex   mutex;     /* protects everything above and the file offset */
+};
+
+typedef struct
+{
+  gint64 offset;
+  gint64 size;
+} SwapRange;
+
+
+static void       gimp_tile_backend_compressed_finalize  (GObject                        *object);
+
+static gpointer   gimp_tile_backend_compressed_command   (GeglTileSource                 *source,
+                                                          GeglTileCommand                 command,
+                                                          gint                            x,
+                                                          gint                            y,
+                                                          gint                            z,
+                                                          gpointer                        data);
+
+static GeglTile * gimp_tile_backend_compressed_get_tile  (GimpTileBackendCompressed      *backend,
+                                                          gint                            x,
+                                                          gint                            y);
+static void       gimp_tile_backend_compressed_set_tile  (GimpTileBackendCompressed      *backend,
+                                                          gint                            x,
+                                                          gint                            y,
+                                                          const guchar                   *pixels);
+static gboolean   gimp_tile_backend_compressed_read_tile (GimpTileBackendCompressed      *backend,
+                                                          GimpCompressedTile             *tile,
+                                                          guchar                         *pixels,
+                                                          GError                        **error);
+static void       gimp_tile_backend_compressed_clear     (GimpTileBackendCompressed      *backend,
+                                                          GimpCompressedTile             *tile);
+
+static void       gimp_tile_backend_compressed_encode    (const guchar                   *pixels,
+                                                          gint                            tile_size,
+                                                          GimpCompressedTile             *tile);
+static gboolean   gimp_tile_backend_compressed_decode    (const guchar                   *data,
+                                                          gint                            size,
+                                                          guchar                         *pixels,
+                                                          gint                            tile_size);
+
+static gint64     gimp_tile_backend_compressed_swap_alloc
+                                                         (GimpTileBackendCompressedSwap  *swap,
+                                                          gint64                          size);
+static void       gimp_tile_backend_compressed_swap_release
+                                                         (GimpTileBackendCompressedSwap  *swap,
+                                                          gint64                          offset,
+                                                          gint64                          size);
+static gboolean   gimp_tile_backend_compressed_swap_write
+                                                         (GimpTileBackendCompressedSwap  *swap,
+                                                          const guchar                   *data,
+                                                          gint                            size,
+                                                          gint64                         *offset,
+                                                          GError                        **error);
+static gboolean   gimp_tile_backend_compressed_swap_read (GimpTileBackendCompressedSwap  *swap,
+                                                          gint64                          offset,
+                                                          guchar                         *data,
+                                                          gint                            size,
+                                                          GError                        **error);
+
+
+G_DEFINE_TYPE (GimpTileBackendCompressed, gimp_tile_backend_compressed,
+               GEGL_TYPE_TILE_BACKEND)
+
+#define parent_class gimp_tile_backend_compressed_parent_class
+
+
+static void
+gimp_tile_backend_compressed_class_init (GimpTileBackendCompressedClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gimp_tile_backend_compressed_finalize;
+}
+
+static void
+gimp_tile_backend_compressed_init (GimpTileBackendCompressed *backend)
+{
+  GeglTileSource *source = GEGL_TILE_SOURCE (backend);
+
+  source->command = gimp_tile_backend_compressed_command;
+
+  g_mutex_init (&backend->mutex);
+}
+
+static void
+gimp_tile_backend_compressed_finalize (GObject *object)
+{
+  GimpTileBackendCompressed *backend = GIMP_TILE_BACKEND_COMPRESSED (object);
+
+  if (backend->tiles)
+    {
+      gint n_tiles = backend->n_tile_cols * backend->n_tile_rows;
+      gint i;
+
+      /*  hands the tiles' space in the swap file back  */
+      for (i = 0; i < n_tiles; i++)
+        gimp_tile_backend_compressed_clear (backend, &backend->tiles[i]);
+
+      g_free (backend->tiles);
+      backend->tiles = NULL;
+    }
+
+  if (backend->swap)
+    {
+      gimp_tile_backend_compressed_swap_unref (backend->swap);
+      backend->swap = NULL;
+    }
+
+  g_mutex_clear (&backend->mutex);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static gpointer
+gimp_tile_backend_compressed_command (GeglTileSource  *source,
+                                      GeglTileCommand  command,
+                                      gint             x,
+                                      gint             y,
+                                      gint             z,
+                                      gpointer         data)
+{
+  GimpTileBackendCompressed *backend = GIMP_TILE_BACKEND_COMPRESSED (source);
+
+  /*  only the full resolution level is stored  */
+  if (z != 0)
+    return NULL;
+
+  if (x < 0 || x >= backend->n_tile_cols ||
+      y < 0 || y >= backend->n_tile_rows)
+    return NULL;
+
+  switch (command)
+    {
+    case GEGL_TILE_GET:
+      return gimp_tile_backend_compressed_get_tile (backend, x, y);
+
+    case GEGL_TILE_SET:
+      gimp_tile_backend_compressed_set_tile (backend, x, y,
+                                             gegl_tile_get_data (data));
+      gegl_tile_mark_as_stored (data);
+      break;
+
+    case GEGL_TILE_VOID:
+      g_mutex_lock (&backend->mutex);
+      gimp_tile_backend_compressed_clear (backend,
+                                          &backend->tiles[y * backend->n_tile_cols + x]);
+      g_mutex_unlock (&backend->mutex);
+      break;
+
+    case GEGL_TILE_EXIST:
+      return GINT_TO_POINTER (backend->tiles[y * backend->n_tile_cols + x].size != 0);
+
+    default:
+      g_assert (command < GEGL_TILE_LAST_COMMAND && command >= 0);
+    }
+
+  return NULL;
+}
+
+static GeglTile *
+gimp_tile_backend_compressed_get_tile (GimpTileBackendCompressed *backend,
+                                       gint                       x,
+                                       gint                       y)
+{
+  GeglTileBackend    *tile_backend = GEGL_TILE_BACKEND (backend);
+  gint                tile_size    = gegl_tile_backend_get_tile_size (tile_backend);
+  GimpCompressedTile *ctile        = &backend->tiles[y * backend->n_tile_cols + x];
+  GeglTile           *tile         = NULL;
+  gboolean            success;
+
+  g_mutex_lock (&backend->mutex);
+
+  if (ctile->size == 0)
+    {
+      g_mutex_unlock (&backend->mutex);
+
+      return NULL;
+    }
+
+  tile = gegl_tile_new (tile_size);
+
+  success = gimp_tile_backend_compressed_read_tile (backend, ctile,
+                                                    gegl_tile_get_data (tile),
+                                                    NULL);
+
+  g_mutex_unlock (&backend->mutex);
+
+  /*  GEGL can't be told about errors.  undos read their buffers with
+   *  gimp_tile_backend_compressed_decompress(), which reports them, so
+   *  a tile which can't be read is only left empty here
+   */
+  if (! success)
+    {
+      gegl_tile_unref (tile);
+
+      return NULL;
+    }
+
+  return tile;
+}
+
+static void
+gimp_tile_backend_compressed_set_tile (GimpTileBackendCompressed *backend,
+                                       gint                       x,
+                                       gint                       y,
+                                       const guchar              *pixels)
+{
+  GeglTileBackend    *tile_backend = GEGL_TILE_BACKEND (backend);
+  gint                tile_size    = gegl_tile_backend_get_tile_size (tile_backend);
+  GimpCompressedTile  ctile;
+
+  gimp_tile_backend_compressed_encode (pixels, tile_size, &ctile);
+
+  g_mutex_lock (&backend->mutex);
+
+  gimp_tile_backend_compressed_clear (backend,
+                                      &backend->tiles[y * backend->n_tile_cols + x]);
+
+  backend->tiles[y * backend->n_tile_cols + x] = ctile;
+  backend->memsize += ctile.size;
+
+  g_mutex_unlock (&backend->mutex);
+}
+
+/*  must be called with backend->mutex held  */
+static gboolean
+gimp_tile_backend_compressed_read_tile (GimpTileBackendCompressed  *backend,
+                                        GimpCompressedTile         *tile,
+                                        guchar                     *pixels,
+                                        GError                    **error)
+{
+  GeglTileBackend *tile_backend = GEGL_TILE_BACKEND (backend);
+  gint             tile_size    = gegl_tile_backend_get_tile_size (tile_backend);
+  guchar          *data;
+  gboolean         success;
+
+  if (tile->size == 0)
+    {
+      memset (pixels, 0, tile_size);
+
+      return TRUE;
+    }
+
+  if (tile->data)
+    {
+      data = tile->data;
+    }
+  else
+    {
+      data = g_malloc (tile->size);
+
+      if (! gimp_tile_backend_compressed_swap_read (backend->swap,
+                                                    tile->offset,
+                                                    data, tile->size,
+                                                    error))
+        {
+          g_free (data);
+
+          return FALSE;
+        }
+    }
+
+  success = gimp_tile_backend_compressed_decode (data, tile->size,
+                                                 pixels, tile_size);
+
+  if (! success)
+    g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                         _("Corrupt tile data"));
+
+  if (data != tile->data)
+    g_free (data);
+
+  return success;
+}
+
+/*  must be called with backend->mutex held  */
+static void
+gimp_tile_backend_compressed_clear (GimpTileBackendCompressed *backend,
+                                    GimpCompressedTile        *tile)
+{
+  if (tile->data)
+    {
+      backend->memsize -= tile->size;
+
+      g_free (tile->data);
+    }
+  else if (tile->size > 0)
+    {
+      gimp_tile_backend_compressed_swap_release (backend->swap,
+                                                 tile->offset, tile->size);
+    }
+
+  tile->data   = NULL;
+  tile->size   = 0;
+  tile->offset = 0;
+}
+
+/*  compresses one tile with a fast codec; tiles which don't shrink are
+ *  stored as they are
+ */
+static void
+gimp_tile_backend_compressed_encode (const guchar       *pixels,
+                                     gint                tile_size,
+                                     GimpCompressedTile *tile)
+{
+  guchar *data;
+  gsize   size;
+
+#ifdef HAVE_ZSTD
+  size = ZSTD_compressBound (tile_size);
+  data = g_malloc (size);
+
+  size = ZSTD_compress (data, size, pixels, tile_size, 1);
+
+  if (ZSTD_isError (size))
+    size = tile_size;
+#else
+  uLongf zsize = compressBound (tile_size);
+
+  data = g_malloc (zsize);
+
+  if (compress2 (data, &zsize, pixels, tile_size, Z_BEST_SPEED) == Z_OK)
+    size = zsize;
+  else
+    size = tile_size;
+#endif
+
+  if (size >= tile_size)
+    {
+      size = tile_size;
+      memcpy (data, pixels, tile_size);
+    }
+
+  tile->data   = g_realloc (data, size);
+  tile->size   = size;
+  tile->offset = 0;
+}
+
+static gboolean
+gimp_tile_backend_compressed_decode (const guchar *data,
+                                     gint          size,
+                                     guchar       *pixels,
+                                     gint          tile_size)
+{
+  if (size == tile_size)
+    {
+      memcpy (pixels, data, tile_size);
+
+      return TRUE;
+    }
+  else
+    {
+#ifdef HAVE_ZSTD
+      gsize  n = ZSTD_decompress (pixels, tile_size, data, size);
+
+      return ! ZSTD_isError (n) && n == tile_size;
+#else
+      uLongf n = tile_size;
+
+      return uncompress (pixels, &n, data, size) == Z_OK && n == tile_size;
+#endif
+    }
+}
+
+/*  takes the first unused range which is large enough, or grows the
+ *  file; must be called with swap->mutex held
+ */
+static gint64
+gimp_tile_backend_compressed_swap_alloc (GimpTileBackendCompressedSwap *swap,
+                                         gint64                         size)
+{
+  GList  *list;
+  gint64  offset;
+
+  for (list = swap->holes; list; list = g_list_next (list))
+    {
+      SwapRange *hole = list->data;
+
+      if (hole->size >= size)
+        {
+          offset = hole->offset;
+
+          hole->offset += size;
+          hole->size   -= size;
+
+          if (hole->size == 0)
+            {
+              g_slice_free (SwapRange, hole);
+              swap->holes = g_list_delete_link (swap->holes, list);
+            }
+
+          return offset;
+        }
+    }
+
+  offset = swap->size;
+
+  swap->size += size;
+
+  return offset;
+}
+
+/*  returns a range to the unused ones, merging it with its neighbors;
+ *  must be called with swap->mutex held
+ */
+static void
+gimp_tile_backend_compressed_swap_release (GimpTileBackendCompressedSwap *swap,
+                                           gint64                         offset,
+                                           gint64                         size)
+{
+  GList     *next;
+  GList     *link;
+  SwapRange *range;
+
+  for (next = swap->holes; next; next = g_list_next (next))
+    {
+      if (((SwapRange *) next->data)->offset > offset)
+        break;
+    }
+
+  link = next ? g_list_previous (next) : g_list_last (swap->holes);
+
+  if (link &&
+      ((SwapRange *) link->data)->offset +
+      ((SwapRange *) link->data)->size == offset)
+    {
+      range = link->data;
+
+      range->size += size;
+    }
+  else
+    {
+      range = g_slice_new (SwapRange);
+
+      range->offset = offset;
+      range->size   = size;
+
+      swap->holes = g_list_insert_before (swap->holes, next, range);
+
+      link = next ? g_list_previous (next) : g_list_last (swap->holes);
+    }
+
+  if (next &&
+      range->offset + range->size == ((SwapRange *) next->data)->offset)
+    {
+      range->size += ((SwapRange *) next->data)->size;
+
+      g_slice_free (SwapRange, next->data);
+      swap->holes = g_list_delete_link (swap->holes, next);
+    }
+
+  /*  a range at the end shrinks the file instead  */
+  if (range->offset + range->size == swap->size)
+    {
+      swap->size = range->offset;
+
+      g_slice_free (SwapRange, range);
+      swap->holes = g_list_delete_link (swap->holes, link);
+    }
+}
+
+static gboolean
+gimp_tile_backend_compressed_swap_write (GimpTileBackendCompressedSwap  *swap,
+                                         const guchar                   *data,
+                                         gint                            size,
+                                         gint64                         *offset,
+                                         GError                        **error)
+{
+  gint done = 0;
+
+  g_mutex_lock (&swap->mutex);
+
+  if (! swap->filename)
+    {
+      gchar *filename = g_build_filename (swap->swap_dir,
+                                          "gimpswap.undo-XXXXXX", NULL);
+
+      swap->fd = g_mkstemp (filename);
+
+      if (swap->fd == -1)
+        {
+          gint save_errno = errno;
+
+          g_set_error (error, G_FILE_ERROR,
+                       g_file_error_from_errno (save_errno),
+                       _("Could not create swap file '%s': %s"),
+                       gimp_filename_to_utf8 (filename),
+                       g_strerror (save_errno));
+
+          g_free (filename);
+          g_mutex_unlock (&swap->mutex);
+
+          return FALSE;
+        }
+
+      swap->filename = filename;
+    }
+
+  *offset = gimp_tile_backend_compressed_swap_alloc (swap, size);
+
+  if (lseek (swap->fd, *offset, SEEK_SET) == *offset)
+    {
+      while (done < size)
+        {
+          gint n = write (swap->fd, data + done, size - done);
+
+          if (n < 0 && errno == EINTR)
+            continue;
+
+          if (n <= 0)
+            break;
+
+          done += n;
+        }
+    }
+
+  if (done < size)
+    {
+      gint save_errno = errno;
+
+      gimp_tile_backend_compressed_swap_release (swap, *offset, size);
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (save_errno),
+                   _("Could not write to swap file '%s': %s"),
+                   gimp_filename_to_utf8 (swap->filename),
+                   g_strerror (save_errno));
+
+      g_mutex_unlock (&swap->mutex);
+
+      return FALSE;
+    }
+
+  g_mutex_unlock (&swap->mutex);
+
+  return TRUE;
+}
+
+static gboolean
+gimp_tile_backend_compressed_swap_read (GimpTileBackendCompressedSwap  *swap,
+                                        gint64                          offset,
+                                        guchar                         *data,
+                                        gint                            size,
+                                        GError                        **error)
+{
+  gint done = 0;
+  gint n    = -1;
+
+  g_mutex_lock (&swap->mutex);
+
+  if (lseek (swap->fd, offset, SEEK_SET) == offset)
+    {
+      while (done < size)
+        {
+          n = read (swap->fd, data + done, size - done);
+
+          if (n < 0 && errno == EINTR)
+            continue;
+
+          if (n <= 0)
+            break;
+
+          done += n;
+        }
+    }
+
+  if (done < size)
+    {
+      gint save_errno = errno;
+
+      if (n == 0)
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                     _("Could not read from swap file '%s': %s"),
+                     gimp_filename_to_utf8 (swap->filename),
+                     _("Unexpected end of file"));
+      else
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (save_errno),
+                     _("Could not read from swap file '%s': %s"),
+                     gimp_filename_to_utf8 (swap->filename),
+                     g_strerror (save_errno));
+
+      g_mutex_unlock (&swap->mutex);
+
+      return FALSE;
+    }
+
+  g_mutex_unlock (&swap->mutex);
+
+  return TRUE;
+}
+
+
+/*  public functions  */
+
+/**
+ * gimp_tile_backend_compressed_new:
+ * @buffer: a #GeglBuffer
+ *
+ * Creates an empty backend with the extent, format and tile grid of
+ * @buffer. Its tiles are filled one row at a time with
+ * gimp_tile_backend_compressed_read_row(), which must be called on the
+ * thread which uses @buffer, and gimp_tile_backend_compressed_encode_row(),
+ * which can be called from any thread.
+ *
+ * Return value: a new #GimpTileBackendCompressed.
+ **/
+GimpTileBackendCompressed *
+gimp_tile_backend_compressed_new (GeglBuffer *buffer)
+{
+  GimpTileBackendCompressed *backend;
+  const GeglRectangle       *extent;
+  gint                       tile_width;
+  gint                       tile_height;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+
+  extent = gegl_buffer_get_extent (buffer);
+
+  g_return_val_if_fail (extent->x >= 0 && extent->y >= 0, NULL);
+
+  g_object_get (buffer,
+                "tile-width",  &tile_width,
+                "tile-height", &tile_height,
+                NULL);
+
+  backend = g_object_new (GIMP_TYPE_TILE_BACKEND_COMPRESSED,
+                          "tile-width",  tile_width,
+                          "tile-height", tile_height,
+                          "format",      gegl_buffer_get_format (buffer),
+                          NULL);
+
+  /*  the tile grid starts at the buffer origin, not at its extent  */
+  backend->extent      = *extent;
+  backend->n_tile_cols = ((extent->x + extent->width  + tile_width  - 1) /
+                          tile_width);
+  backend->n_tile_rows = ((extent->y + extent->height + tile_height - 1) /
+                          tile_height);
+
+  backend->tiles = g_new0 (GimpCompressedTile,
+                           backend->n_tile_cols * backend->n_tile_rows);
+
+  gegl_tile_backend_set_extent (GEGL_TILE_BACKEND (backend), extent);
+
+  return backend;
+}
+
+/**
+ * gimp_tile_backend_compressed_read_row:
+ * @backend: a #GimpTileBackendCompressed
+ * @buffer:  the buffer @backend was created for
+ * @row:     a row of tiles
+ *
+ * Reads the pixels of one row of tiles from @buffer, to be passed to
+ * gimp_tile_backend_compressed_encode_row().
+ *
+ * Return value: the pixels of the row, free them with g_free().
+ **/
+guchar *
+gimp_tile_backend_compressed_read_row (GimpTileBackendCompressed *backend,
+                                       GeglBuffer                *buffer,
+                                       gint                       row)
+{
+  GeglTileBackend *tile_backend;
+  const Babl      *format;
+  GeglRectangle    rect;
+  guchar          *band;
+  gint             tile_width;
+  gint             tile_height;
+  gint             stride;
+
+  g_return_val_if_fail (GIMP_IS_TILE_BACKEND_COMPRESSED (backend), NULL);
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (row >= 0 && row < backend->n_tile_rows, NULL);
+
+  tile_backend = GEGL_TILE_BACKEND (backend);
+  tile_width   = gegl_tile_backend_get_tile_width  (tile_backend);
+  tile_height  = gegl_tile_backend_get_tile_height (tile_backend);
+  format       = gegl_buffer_get_format (buffer);
+
+  stride = (backend->n_tile_cols * tile_width *
+            babl_format_get_bytes_per_pixel (format));
+
+  rect.x      = 0;
+  rect.y      = row * tile_height;
+  rect.width  = backend->extent.x + backend->extent.width;
+  rect.height = MIN (tile_height,
+                     backend->extent.y + backend->extent.height - rect.y);
+
+  /*  the padding of the edge tiles stays empty  */
+  band = g_malloc0 ((gsize) stride * tile_height);
+
+  gegl_buffer_get (buffer, &rect, 1.0, format, band,
+                   stride, GEGL_ABYSS_NONE);
+
+  return band;
+}
+
+/**
+ * gimp_tile_backend_compressed_encode_row:
+ * @backend: a #GimpTileBackendCompressed
+ * @row:     a row of tiles
+ * @band:    the pixels returned by gimp_tile_backend_compressed_read_row()
+ *
+ * Compresses the tiles of one row into @backend. This touches no GEGL
+ * buffer and can be called from any thread, as long as @backend is not
+ * used by a buffer yet.
+ **/
+void
+gimp_tile_backend_compressed_encode_row (GimpTileBackendCompressed *backend,
+                                         gint                       row,
+                                         const guchar              *band)
+{
+  GeglTileBackend *tile_backend;
+  gint             tile_height;
+  gint             tile_size;
+  gint             tile_stride;
+  guchar          *pixels;
+  gint             col;
+
+  g_return_if_fail (GIMP_IS_TILE_BACKEND_COMPRESSED (backend));
+  g_return_if_fail (row >= 0 && row < backend->n_tile_rows);
+  g_return_if_fail (band != NULL);
+
+  tile_backend = GEGL_TILE_BACKEND (backend);
+  tile_height  = gegl_tile_backend_get_tile_height (tile_backend);
+  tile_size    = gegl_tile_backend_get_tile_size (tile_backend);
+  tile_stride  = tile_size / tile_height;
+
+  pixels = g_malloc (tile_size);
+
+  for (col = 0; col < backend->n_tile_cols; col++)
+    {
+      GimpCompressedTile  ctile;
+      const guchar       *src  = band + col * tile_stride;
+      guchar             *dest = pixels;
+      gint                y;
+
+      for (y = 0; y < tile_height; y++)
+        {
+          memcpy (dest, src, tile_stride);
+
+          src  += backend->n_tile_cols * tile_stride;
+          dest += tile_stride;
+        }
+
+      gimp_tile_backend_compressed_encode (pixels, tile_size, &ctile);
+
+      g_mutex_lock (&backend->mutex);
+
+      gimp_tile_backend_compressed_clear (backend,
+                                          &backend->tiles[row * backend->n_tile_cols + col]);
+
+      backend->tiles[row * backend->n_tile_cols + col] = ctile;
+      backend->memsize += ctile.size;
+
+      g_mutex_unlock (&backend->mutex);
+    }
+
+  g_free (pixels);
+}
+
+/**
+ * gimp_tile_backend_compressed_write_swap:
+ * @backend: a #GimpTileBackendCompressed
+ * @swap:    the swap file to use
+ * @error:   return location for errors
+ *
+ * Moves the tiles of @backend which are still in memory to @swap.
+ * Tiles which could not be written stay in memory. This can be called
+ * from any thread; the tiles are locked one at a time, so the buffer
+ * of @backend stays usable meanwhile.
+ *
+ * Return value: %TRUE if all tiles were written.
+ **/
+gboolean
+gimp_tile_backend_compressed_write_swap (GimpTileBackendCompressed      *backend,
+                                         GimpTileBackendCompressedSwap  *swap,
+                                         GError                        **error)
+{
+  gint n_tiles;
+  gint i;
+
+  g_return_val_if_fail (GIMP_IS_TILE_BACKEND_COMPRESSED (backend), FALSE);
+  g_return_val_if_fail (swap != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  g_mutex_lock (&backend->mutex);
+
+  if (! backend->swap)
+    backend->swap = gimp_tile_backend_compressed_swap_ref (swap);
+
+  g_mutex_unlock (&backend->mutex);
+
+  g_return_val_if_fail (backend->swap == swap, FALSE);
+
+  n_tiles = backend->n_tile_cols * backend->n_tile_rows;
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      GimpCompressedTile *ctile = &backend->tiles[i];
+      gboolean            success;
+      gint64              offset;
+
+      g_mutex_lock (&backend->mutex);
+
+      if (! ctile->data)
+        {
+          g_mutex_unlock (&backend->mutex);
+          continue;
+        }
+
+      success = gimp_tile_backend_compressed_swap_write (swap,
+                                                         ctile->data,
+                                                         ctile->size,
+                                                         &offset, error);
+
+      if (success)
+        {
+          backend->memsize -= ctile->size;
+
+          g_free (ctile->data);
+          ctile->data   = NULL;
+          ctile->offset = offset;
+        }
+
+      g_mutex_unlock (&backend->mutex);
+
+      if (! success)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * gimp_tile_backend_compressed_create_buffer:
+ * @backend: a #GimpTileBackendCompressed
+ *
+ * Return value: a new #GeglBuffer reading its tiles from @backend.
+ **/
+GeglBuffer *
+gimp_tile_backend_compressed_create_buffer (GimpTileBackendCompressed *backend)
+{
+  GeglBuffer *buffer;
+
+  g_return_val_if_fail (GIMP_IS_TILE_BACKEND_COMPRESSED (backend), NULL);
+
+  buffer = gegl_buffer_new_for_backend (&backend->extent,
+                                        GEGL_TILE_BACKEND (backend));
+
+  g_object_set_data (G_OBJECT (buffer), BACKEND_KEY, backend);
+
+  return buffer;
+}
+
+/**
+ * gimp_tile_backend_compressed_get_backend:
+ * @buffer: a #GeglBuffer
+ *
+ * Return value: the #GimpTileBackendCompressed of @buffer, or %NULL
+ *               if @buffer is not compressed.
+ **/
+GimpTileBackendCompressed *
+gimp_tile_backend_compressed_get_backend (GeglBuffer *buffer)
+{
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+
+  return g_object_get_data (G_OBJECT (buffer), BACKEND_KEY);
+}
+
+/**
+ * gimp_tile_backend_compressed_decompress:
+ * @buffer: a #GeglBuffer
+ * @error:  return location for errors
+ *
+ * Reads the tiles of a compressed @buffer back into a plain buffer.
+ *
+ * Return value: a plain copy of @buffer if it is compressed, a new
+ *               reference to @buffer otherwise, or %NULL if a tile
+ *               could not be read.
+ **/
+GeglBuffer *
+gimp_tile_backend_compressed_decompress (GeglBuffer  *buffer,
+                                         GError     **error)
+{
+  GimpTileBackendCompressed *backend;
+  GeglTileBackend           *tile_backend;
+  GeglBuffer                *plain;
+  const Babl                *format;
+  guchar                    *pixels;
+  gint                       tile_width;
+  gint                       tile_height;
+  gint                       bpp;
+  gint                       row;
+  gint                       col;
+  gboolean                   success = TRUE;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  backend = gimp_tile_backend_compressed_get_backend (buffer);
+
+  if (! backend)
+    return g_object_ref (buffer);
+
+  /*  written tiles must reach the backend before reading it directly  */
+  gegl_buffer_flush (buffer);
+
+  tile_backend = GEGL_TILE_BACKEND (backend);
+  tile_width   = gegl_tile_backend_get_tile_width  (tile_backend);
+  tile_height  = gegl_tile_backend_get_tile_height (tile_backend);
+  format       = gegl_buffer_get_format (buffer);
+  bpp          = babl_format_get_bytes_per_pixel (format);
+
+  plain = gegl_buffer_new (&backend->extent, format);
+
+  pixels = g_malloc (gegl_tile_backend_get_tile_size (tile_backend));
+
+  for (row = 0; success && row < backend->n_tile_rows; row++)
+    {
+      for (col = 0; success && col < backend->n_tile_cols; col++)
+        {
+          GimpCompressedTile *ctile;
+          GeglRectangle       rect;
+
+          g_mutex_lock (&backend->mutex);
+
+          ctile = &backend->tiles[row * backend->n_tile_cols + col];
+
+          if (ctile->size == 0)
+            {
+              g_mutex_unlock (&backend->mutex);
+              continue;
+            }
+
+          success = gimp_tile_backend_compressed_read_tile (backend, ctile,
+                                                            pixels, error);
+
+          g_mutex_unlock (&backend->mutex);
+
+          if (success &&
+              gegl_rectangle_intersect (&rect,
+                                        GEGL_RECTANGLE (col * tile_width,
+                                                        row * tile_height,
+                                                        tile_width,
+                                                        tile_height),
+                                        &backend->extent))
+            {
+              gint x = rect.x - col * tile_width;
+              gint y = rect.y - row * tile_height;
+
+              gegl_buffer_set (plain, &rect, 0, format,
+                               pixels + (y * tile_width + x) * bpp,
+                               tile_width * bpp);
+            }
+        }
+    }
+
+  g_free (pixels);
+
+  if (! success)
+    {
+      g_object_unref (plain);
+
+      return NULL;
+    }
+
+  return plain;
+}
+
+gboolean
+gimp_tile_backend_compressed_is_compressed (GeglBuffer *buffer)
+{
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), FALSE);
+
+  return gimp_tile_backend_compressed_get_backend (buffer) != NULL;
+}
+
+/**
+ * gimp_tile_backend_compressed_get_memsize:
+ * @buffer: a compressed #GeglBuffer
+ *
+ * Return value: the memory used by the tiles of @buffer which are
+ *               neither swapped out nor cached by GEGL.
+ **/
+gint64
+gimp_tile_backend_compressed_get_memsize (GeglBuffer *buffer)
+{
+  GimpTileBackendCompressed *backend;
+  gint64                     memsize;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), 0);
+
+  backend = gimp_tile_backend_compressed_get_backend (buffer);
+
+  g_return_val_if_fail (backend != NULL, 0);
+
+  g_mutex_lock (&backend->mutex);
+
+  memsize = (backend->memsize +
+             backend->n_tile_cols * backend->n_tile_rows *
+             sizeof (GimpCompressedTile));
+
+  g_mutex_unlock (&backend->mutex);
+
+  return memsize;
+}
+
+/**
+ * gimp_tile_backend_compressed_swap_new:
+ * @swap_dir: the directory to create the swap file in
+ *
+ * Creates a swap file for the backends of one image. The file is only
+ * created when the first tile is written, and is removed when the last
+ * reference is dropped. Space in it is reused once the tiles which
+ * used it are gone.
+ *
+ * Return value: the new swap file.
+ **/
+GimpTileBackendCompressedSwap *
+gimp_tile_backend_compressed_swap_new (const gchar *swap_dir)
+{
+  GimpTileBackendCompressedSwap *swap;
+
+  g_return_val_if_fail (swap_dir != NULL, NULL);
+
+  swap = g_slice_new0 (GimpTileBackendCompressedSwap);
+
+  swap->ref_count = 1;
+  swap->swap_dir  = g_strdup (swap_dir);
+  swap->fd        = -1;
+
+  g_mutex_init (&swap->mutex);
+
+  return swap;
+}
+
+GimpTileBackendCompressedSwap *
+gimp_tile_backend_compressed_swap_ref (GimpTileBackendCompressedSwap *swap)
+{
+  g_return_val_if_fail (swap != NULL, NULL);
+
+  g_atomic_int_inc (&swap->ref_count);
+
+  return swap;
+}
+
+void
+gimp_tile_backend_compressed_swap_unref (GimpTileBackendCompressedSwap *swap)
+{
+  g_return_if_fail (swap != NULL);
+
+  if (g_atomic_int_dec_and_test (&swap->ref_count))
+    {
+      if (swap->fd != -1)
+        close (swap->fd);
+
+      if (swap->filename)
+        {
+          g_unlink (swap->filename);
+          g_free (swap->filename);
+        }
+
+      while (swap->holes)
+        {
+          g_slice_free (SwapRange, swap->holes->data);
+          swap->holes = g_list_delete_link (swap->holes, swap->holes);
+        }
+
+      g_free (swap->swap_dir);
+
+      g_mutex_clear (&swap->mutex);
+
+      g_slice_free (GimpTileBackendCompressedSwap, swap);
+    }
+}
@@ -0,0 +1,103 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimptilebackendcompressed.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_TILE_BACKEND_COMPRESSED_H__
+#define __GIMP_TILE_BACKEND_COMPRESSED_H__
+
+#include <gegl-buffer-backend.h>
+
+/***
+ * GimpTileBackendCompressed is a GeglTileBackend that keeps its tiles
+ * compressed in memory, or in a swap file once they were swapped out.
+ * Tiles are decompressed when GEGL fetches them.
+ *
+ * The backends of one image share a GimpTileBackendCompressedSwap,
+ * which hands out space in a single swap file.
+ */
+
+G_BEGIN_DECLS
+
+#define GIMP_TYPE_TILE_BACKEND_COMPRESSED            (gimp_tile_backend_compressed_get_type ())
+#define GIMP_TILE_BACKEND_COMPRESSED(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GIMP_TYPE_TILE_BACKEND_COMPRESSED, GimpTileBackendCompressed))
+#define GIMP_TILE_BACKEND_COMPRESSED_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  GIMP_TYPE_TILE_BACKEND_COMPRESSED, GimpTileBackendCompressedClass))
+#define GIMP_IS_TILE_BACKEND_COMPRESSED(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GIMP_TYPE_TILE_BACKEND_COMPRESSED))
+#define GIMP_IS_TILE_BACKEND_COMPRESSED_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  GIMP_TYPE_TILE_BACKEND_COMPRESSED))
+#define GIMP_TILE_BACKEND_COMPRESSED_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GIMP_TYPE_TILE_BACKEND_COMPRESSED, GimpTileBackendCompressedClass))
+
+
+typedef struct _GimpTileBackendCompressed      GimpTileBackendCompressed;
+typedef struct _GimpTileBackendCompressedClass GimpTileBackendCompressedClass;
+typedef struct _GimpCompressedTile             GimpCompressedTile;
+
+struct _GimpTileBackendCompressed
+{
+  GeglTileBackend                parent_instance;
+
+  GMutex                         mutex;        /* protects the tiles, the
+                                                * memsize and the swap    */
+  GimpCompressedTile            *tiles;
+  GeglRectangle                  extent;
+  gint                           n_tile_cols;
+  gint                           n_tile_rows;
+  gint64                         memsize;      /* compressed bytes in memory */
+
+  GimpTileBackendCompressedSwap *swap;         /* the swapped out tiles   */
+};
+
+struct _GimpTileBackendCompressedClass
+{
+  GeglTileBackendClass  parent_class;
+};
+
+
+GType        gimp_tile_backend_compressed_get_type     (void) G_GNUC_CONST;
+
+GimpTileBackendCompressed *
+             gimp_tile_backend_compressed_new          (GeglBuffer                     *buffer);
+guchar     * gimp_tile_backend_compressed_read_row     (GimpTileBackendCompressed      *backend,
+                                                        GeglBuffer                     *buffer,
+                                                        gint                            row);
+void         gimp_tile_backend_compressed_encode_row   (GimpTileBackendCompressed      *backend,
+                                                        gint                            row,
+                                                        const guchar                   *band);
+gboolean     gimp_tile_backend_compressed_write_swap   (GimpTileBackendCompressed      *backend,
+                                                        GimpTileBackendCompressedSwap  *swap,
+                                                        GError                        **error);
+GeglBuffer * gimp_tile_backend_compressed_create_buffer
+                                                       (GimpTileBackendCompressed      *backend);
+
+GimpTileBackendCompressed *
+             gimp_tile_backend_compressed_get_backend  (GeglBuffer                     *buffer);
+GeglBuffer * gimp_tile_backend_compressed_decompress   (GeglBuffer                     *buffer,
+                                                        GError                        **error);
+
+gboolean     gimp_tile_backend_compressed_is_compressed
+                                                       (GeglBuffer                     *buffer);
+gint64       gimp_tile_backend_compressed_get_memsize  (GeglBuffer                     *buffer);
+
+GimpTileBackendCompressedSwap *
+             gimp_tile_backend_compressed_swap_new     (const gchar                    *swap_dir);
+GimpTileBackendCompressedSwap *
+             gimp_tile_backend_compressed_swap_ref     (GimpTileBackendCompressedSwap  *swap);
+void         gimp_tile_backend_compressed_swap_unref   (GimpTileBackendCompressedSwap  *swap);
+
+
+G_END_DECLS
+
+#endif /* __GIMP_TILE_BACKEND_COMPRESSED_H__ */
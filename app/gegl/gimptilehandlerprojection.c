@@ -17,6 +17,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <cairo.h>
 #include <gegl.h>
 
@@ -52,6 +54,14 @@ static gpointer gimp_tile_handler_projection_command      (GeglTileSource  *sour
                                                            gpointer         data);
 
 static void     gimp_tile_handler_projection_update_max_z (GimpTileHandlerProjection *projection);
+static void     gimp_tile_handler_projection_void_pyramid (GeglTileSource  *source,
+                                                           gint             x,
+                                                           gint             y,
+                                                           gint             z,
+                                                           gint             max_z);
+static void     gimp_tile_handler_projection_drop_preview (GimpTileHandlerProjection *projection,
+                                                           gint                       x,
+                                                           gint                       y);
 
 
 G_DEFINE_TYPE (GimpTileHandlerProjection, gimp_tile_handler_projection,
@@ -93,7 +103,8 @@ gimp_tile_handler_projection_init (GimpTileHandlerProjection *projection)
 
   source->command = gimp_tile_handler_projection_command;
 
-  projection->dirty_region = cairo_region_create ();
+  projection->dirty_region   = cairo_region_create ();
+  projection->preview_region = cairo_region_create ();
 }
 
 static void
@@ -110,6 +121,9 @@ gimp_tile_handler_projection_finalize (GObject *object)
   cairo_region_destroy (projection->dirty_region);
   projection->dirty_region = NULL;
 
+  cairo_region_destroy (projection->preview_region);
+  projection->preview_region = NULL;
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -204,6 +218,8 @@ gimp_tile_handler_projection_validate (GeglTileSource *source,
 
       cairo_region_subtract_rectangle (projection->dirty_region, &tile_rect);
 
+      gimp_tile_handler_projection_drop_preview (projection, x, y);
+
       tile_bpp    = babl_format_get_bytes_per_pixel (projection->format);
       tile_stride = tile_bpp * projection->tile_width;
 
@@ -250,6 +266,57 @@ gimp_tile_handler_projection_validate (GeglTileSource *source,
   return tile;
 }
 
+/*  renders a missing mipmap tile straight from the graph, at the
+ *  tile's scale, if the full resolution tiles below it are dirty
+ */
+static GeglTile *
+gimp_tile_handler_projection_preview (GeglTileSource *source,
+                                      gint            x,
+                                      gint            y,
+                                      gint            z)
+{
+  GimpTileHandlerProjection *projection;
+  GeglTile                  *tile;
+  cairo_rectangle_int_t      rect;
+
+  projection = GIMP_TILE_HANDLER_PROJECTION (source);
+
+  if (z > projection->max_z ||
+      cairo_region_is_empty (projection->dirty_region))
+    return NULL;
+
+  rect.x      = (x * projection->tile_width)  << z;
+  rect.y      = (y * projection->tile_height) << z;
+  rect.width  = projection->tile_width  << z;
+  rect.height = projection->tile_height << z;
+
+  if (cairo_region_contains_rectangle (projection->dirty_region,
+                                       &rect) == CAIRO_REGION_OVERLAP_OUT)
+    return NULL;
+
+  cairo_region_union_rectangle (projection->preview_region, &rect);
+
+  tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (source),
+                                        x, y, z);
+
+  gegl_tile_lock (tile);
+
+  gegl_node_blit (projection->graph, 1.0 / (1 << z),
+                  GEGL_RECTANGLE (x * projection->tile_width,
+                                  y * projection->tile_height,
+                                  projection->tile_width,
+                                  projection->tile_height),
+                  projection->format,
+                  gegl_tile_get_data (tile),
+                  projection->tile_width *
+                  babl_format_get_bytes_per_pixel (projection->format),
+                  GEGL_BLIT_DEFAULT);
+
+  gegl_tile_unlock (tile);
+
+  return tile;
+}
+
 static gpointer
 gimp_tile_handler_projection_command (GeglTileSource  *source,
                                       GeglTileCommand  command,
@@ -262,12 +329,46 @@ gimp_tile_handler_projection_command (GeglTileSource  *source,
 
   retval = gegl_tile_handler_source_command (source, command, x, y, z, data);
 
-  if (command == GEGL_TILE_GET && z == 0)
-    retval = gimp_tile_handler_projection_validate (source, retval, x, y);
+  if (command == GEGL_TILE_GET)
+    {
+      if (z == 0)
+        retval = gimp_tile_handler_projection_validate (source, retval, x, y);
+      else if (! retval)
+        retval = gimp_tile_handler_projection_preview (source, x, y, z);
+    }
 
   return retval;
 }
 
+/*  drops the preview mipmap tiles above the full resolution tile at
+ *  x, y, which is about to be rendered, so they are rebuilt from it
+ */
+static void
+gimp_tile_handler_projection_drop_preview (GimpTileHandlerProjection *projection,
+                                           gint                       x,
+                                           gint                       y)
+{
+  cairo_rectangle_int_t tile_rect;
+
+  if (cairo_region_is_empty (projection->preview_region))
+    return;
+
+  tile_rect.x      = x * projection->tile_width;
+  tile_rect.y      = y * projection->tile_height;
+  tile_rect.width  = projection->tile_width;
+  tile_rect.height = projection->tile_height;
+
+  if (cairo_region_contains_rectangle (projection->preview_region,
+                                       &tile_rect) == CAIRO_REGION_OVERLAP_OUT)
+    return;
+
+  cairo_region_subtract_rectangle (projection->preview_region, &tile_rect);
+
+  gimp_tile_handler_projection_void_pyramid (GEGL_TILE_SOURCE (projection),
+                                             x / 2, y / 2, 1,
+                                             projection->max_z);
+}
+
 static void
 gimp_tile_handler_projection_update_max_z (GimpTileHandlerProjection *projection)
 {
@@ -326,17 +427,23 @@ gimp_tile_handler_projection_invalidate (GimpTileHandlerProjection *projection,
                                          gint                       height)
 {
   cairo_rectangle_int_t rect = { x, y, width, height };
+  gint                  z;
 
   g_return_if_fail (GIMP_IS_TILE_HANDLER_PROJECTION (projection));
 
   cairo_region_union_rectangle (projection->dirty_region, &rect);
 
-  if (projection->max_z > 0)
+  /*  void the mipmap tiles above the area level by level, each of them
+   *  once, instead of the whole pyramid above every tile of the area
+   */
+  for (z = 1; z <= projection->max_z; z++)
     {
-      gint tile_x1 = x / projection->tile_width;
-      gint tile_y1 = y / projection->tile_height;
-      gint tile_x2 = (x + width  - 1) / projection->tile_width;
-      gint tile_y2 = (y + height - 1) / projection->tile_height;
+      gint tile_width  = projection->tile_width  << z;
+      gint tile_height = projection->tile_height << z;
+      gint tile_x1     = x / tile_width;
+      gint tile_y1     = y / tile_height;
+      gint tile_x2     = (x + width  - 1) / tile_width;
+      gint tile_y2     = (y + height - 1) / tile_height;
       gint tile_x;
       gint tile_y;
 
@@ -344,12 +451,143 @@ gimp_tile_handler_projection_invalidate (GimpTileHandlerProjection *projection,
         {
           for (tile_x = tile_x1; tile_x <= tile_x2; tile_x++)
             {
-              gimp_tile_handler_projection_void_pyramid (GEGL_TILE_SOURCE (projection),
-                                                         tile_x / 2,
-                                                         tile_y / 2,
-                                                         1,
-                                                         projection->max_z);
+              gegl_tile_source_void (GEGL_TILE_SOURCE (projection),
+                                     tile_x, tile_y, z);
             }
         }
     }
 }
+
+/**
+ * gimp_tile_handler_projection_claim_tile:
+ * @projection: a #GimpTileHandlerProjection
+ * @tile_x:     the tile's column
+ * @tile_y:     the tile's row
+ *
+ * Removes the dirty part of the tile at @tile_x, @tile_y from the
+ * dirty region, so the caller can render it ahead of time and store
+ * the result in the buffer. The tile is not rendered again when it
+ * is fetched in the meantime.
+ *
+ * Return value: the claimed region, to be destroyed by the caller,
+ *               or %NULL if the tile is not dirty.
+ **/
+cairo_region_t *
+gimp_tile_handler_projection_claim_tile (GimpTileHandlerProjection *projection,
+                                         gint                       tile_x,
+                                         gint                       tile_y)
+{
+  cairo_region_t        *tile_region;
+  cairo_rectangle_int_t  tile_rect;
+
+  g_return_val_if_fail (GIMP_IS_TILE_HANDLER_PROJECTION (projection), NULL);
+
+  if (cairo_region_is_empty (projection->dirty_region))
+    return NULL;
+
+  tile_rect.x      = tile_x * projection->tile_width;
+  tile_rect.y      = tile_y * projection->tile_height;
+  tile_rect.width  = projection->tile_width;
+  tile_rect.height = projection->tile_height;
+
+  if (cairo_region_contains_rectangle (projection->dirty_region,
+                                       &tile_rect) == CAIRO_REGION_OVERLAP_OUT)
+    return NULL;
+
+  tile_region = cairo_region_copy (projection->dirty_region);
+
+  cairo_region_intersect_rectangle (tile_region, &tile_rect);
+  cairo_region_subtract_rectangle (projection->dirty_region, &tile_rect);
+
+  gimp_tile_handler_projection_drop_preview (projection, tile_x, tile_y);
+
+  return tile_region;
+}
+
+/**
+ * gimp_tile_handler_projection_claim_level_tile:
+ * @projection: a #GimpTileHandlerProjection
+ * @tile_x:     the tile's column at @level
+ * @tile_y:     the tile's row at @level
+ * @level:      the mipmap level
+ *
+ * Checks if the mipmap tile at @tile_x, @tile_y of @level is missing
+ * while full resolution tiles below it are dirty, so that it would be
+ * rendered from the graph when it is fetched. If so, the caller is
+ * expected to render it, on the main thread like all uses of the graph,
+ * and to store it with gimp_tile_handler_projection_set_level_tile().
+ *
+ * Like the tiles rendered on demand, the tile is dropped again when
+ * the full resolution tiles below it are rendered.
+ *
+ * Return value: %TRUE if the caller should render the tile.
+ **/
+gboolean
+gimp_tile_handler_projection_claim_level_tile (GimpTileHandlerProjection *projection,
+                                               gint                       tile_x,
+                                               gint                       tile_y,
+                                               gint                       level)
+{
+  cairo_rectangle_int_t rect;
+
+  g_return_val_if_fail (GIMP_IS_TILE_HANDLER_PROJECTION (projection), FALSE);
+
+  if (level < 1 || level > projection->max_z ||
+      cairo_region_is_empty (projection->dirty_region))
+    return FALSE;
+
+  rect.x      = (tile_x * projection->tile_width)  << level;
+  rect.y      = (tile_y * projection->tile_height) << level;
+  rect.width  = projection->tile_width  << level;
+  rect.height = projection->tile_height << level;
+
+  if (cairo_region_contains_rectangle (projection->dirty_region,
+                                       &rect) == CAIRO_REGION_OVERLAP_OUT)
+    return FALSE;
+
+  if (gegl_tile_handler_source_command (GEGL_TILE_SOURCE (projection),
+                                        GEGL_TILE_IS_CACHED,
+                                        tile_x, tile_y, level, NULL))
+    return FALSE;
+
+  cairo_region_union_rectangle (projection->preview_region, &rect);
+
+  return TRUE;
+}
+
+/**
+ * gimp_tile_handler_projection_set_level_tile:
+ * @projection: a #GimpTileHandlerProjection
+ * @tile_x:     the tile's column at @level
+ * @tile_y:     the tile's row at @level
+ * @level:      the mipmap level
+ * @data:       the tile's pixels, in the projection's format
+ *
+ * Stores a mipmap tile claimed by
+ * gimp_tile_handler_projection_claim_level_tile().
+ **/
+void
+gimp_tile_handler_projection_set_level_tile (GimpTileHandlerProjection *projection,
+                                             gint                       tile_x,
+                                             gint                       tile_y,
+                                             gint                       level,
+                                             const guchar              *data)
+{
+  GeglTile *tile;
+
+  g_return_if_fail (GIMP_IS_TILE_HANDLER_PROJECTION (projection));
+  g_return_if_fail (data != NULL);
+
+  tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (projection),
+                                        tile_x, tile_y, level);
+
+  gegl_tile_lock (tile);
+
+  memcpy (gegl_tile_get_data (tile), data,
+          projection->tile_width * projection->tile_height *
+          babl_format_get_bytes_per_pixel (projection->format));
+
+  gegl_tile_unlock (tile);
+
+  gegl_tile_unref (tile);
+}
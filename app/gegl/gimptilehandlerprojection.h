@@ -23,6 +23,12 @@
 /***
  * GimpTileHandlerProjection is a GeglTileHandler that renders the
  * projection.
+ *
+ * Dirty tiles of the mipmap levels are rendered directly at their
+ * scale when they are fetched, or ahead of time for the visible part
+ * of a zoomed out display, and are dropped again when the full
+ * resolution tiles below them are rendered. That way the full
+ * resolution tiles need not be rendered before they are fetched.
  */
 
 G_BEGIN_DECLS
@@ -44,6 +50,7 @@ struct _GimpTileHandlerProjection
 
   GeglNode        *graph;
   cairo_region_t  *dirty_region;
+  cairo_region_t  *preview_region;
   const Babl      *format;
   gint             tile_width;
   gint             tile_height;
@@ -68,6 +75,21 @@ void              gimp_tile_handler_projection_invalidate (GimpTileHandlerProjec
                                                            gint                       y,
                                                            gint                       width,
                                                            gint                       height);
+cairo_region_t  * gimp_tile_handler_projection_claim_tile (GimpTileHandlerProjection *projection,
+                                                           gint                       tile_x,
+                                                           gint                       tile_y);
+
+gboolean          gimp_tile_handler_projection_claim_level_tile
+                                                          (GimpTileHandlerProjection *projection,
+                                                           gint                       tile_x,
+                                                           gint                       tile_y,
+                                                           gint                       level);
+void              gimp_tile_handler_projection_set_level_tile
+                                                          (GimpTileHandlerProjection *projection,
+                                                           gint                       tile_x,
+                                                           gint                       tile_y,
+                                                           gint                       level,
+                                                           const guchar              *data);
 
 
 G_END_DECLS
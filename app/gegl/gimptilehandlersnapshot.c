@@ -0,0 +1,345 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <cairo.h>
+#include <gegl.h>
+
+#include "gimp-gegl-types.h"
+
+#include "gimptilehandlersnapshot.h"
+
+
+enum
+{
+  PROP_0,
+  PROP_FORMAT,
+  PROP_TILE_WIDTH,
+  PROP_TILE_HEIGHT
+};
+
+
+static void     gimp_tile_handler_snapshot_finalize     (GObject         *object);
+static void     gimp_tile_handler_snapshot_set_property (GObject         *object,
+                                                         guint            property_id,
+                                                         const GValue    *value,
+                                                         GParamSpec      *pspec);
+static void     gimp_tile_handler_snapshot_get_property (GObject         *object,
+                                                         guint            property_id,
+                                                         GValue          *value,
+                                                         GParamSpec      *pspec);
+
+static gpointer gimp_tile_handler_snapshot_command      (GeglTileSource  *source,
+                                                         GeglTileCommand  command,
+                                                         gint             x,
+                                                         gint             y,
+                                                         gint             z,
+                                                         gpointer         data);
+
+
+G_DEFINE_TYPE (GimpTileHandlerSnapshot, gimp_tile_handler_snapshot,
+               GEGL_TYPE_TILE_HANDLER)
+
+#define parent_class gimp_tile_handler_snapshot_parent_class
+
+
+static void
+gimp_tile_handler_snapshot_class_init (GimpTileHandlerSnapshotClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize     = gimp_tile_handler_snapshot_finalize;
+  object_class->set_property = gimp_tile_handler_snapshot_set_property;
+  object_class->get_property = gimp_tile_handler_snapshot_get_property;
+
+  g_object_class_install_property (object_class, PROP_FORMAT,
+                                   g_param_spec_pointer ("format", NULL, NULL,
+                                                         GIMP_PARAM_READWRITE));
+
+  g_object_class_install_property (object_class, PROP_TILE_WIDTH,
+                                   g_param_spec_int ("tile-width", NULL, NULL,
+                                                     1, G_MAXINT, 1,
+                                                     GIMP_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (object_class, PROP_TILE_HEIGHT,
+                                   g_param_spec_int ("tile-height", NULL, NULL,
+                                                     1, G_MAXINT, 1,
+                                                     GIMP_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+}
+
+static void
+gimp_tile_handler_snapshot_init (GimpTileHandlerSnapshot *snapshot)
+{
+  GeglTileSource *source = GEGL_TILE_SOURCE (snapshot);
+
+  source->command = gimp_tile_handler_snapshot_command;
+
+  snapshot->pending_region = cairo_region_create ();
+}
+
+static void
+gimp_tile_handler_snapshot_finalize (GObject *object)
+{
+  GimpTileHandlerSnapshot *snapshot = GIMP_TILE_HANDLER_SNAPSHOT (object);
+
+  if (snapshot->source)
+    {
+      g_object_unref (snapshot->source);
+      snapshot->source = NULL;
+    }
+
+  cairo_region_destroy (snapshot->pending_region);
+  snapshot->pending_region = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gimp_tile_handler_snapshot_set_property (GObject      *object,
+                                         guint         property_id,
+                                         const GValue *value,
+                                         GParamSpec   *pspec)
+{
+  GimpTileHandlerSnapshot *snapshot = GIMP_TILE_HANDLER_SNAPSHOT (object);
+
+  switch (property_id)
+    {
+    case PROP_FORMAT:
+      snapshot->format = g_value_get_pointer (value);
+      break;
+    case PROP_TILE_WIDTH:
+      snapshot->tile_width = g_value_get_int (value);
+      break;
+    case PROP_TILE_HEIGHT:
+      snapshot->tile_height = g_value_get_int (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+gimp_tile_handler_snapshot_get_property (GObject    *object,
+                                         guint       property_id,
+                                         GValue     *value,
+                                         GParamSpec *pspec)
+{
+  GimpTileHandlerSnapshot *snapshot = GIMP_TILE_HANDLER_SNAPSHOT (object);
+
+  switch (property_id)
+    {
+    case PROP_FORMAT:
+      g_value_set_pointer (value, (gpointer) snapshot->format);
+      break;
+    case PROP_TILE_WIDTH:
+      g_value_set_int (value, snapshot->tile_width);
+      break;
+    case PROP_TILE_HEIGHT:
+      g_value_set_int (value, snapshot->tile_height);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static GeglTile *
+gimp_tile_handler_snapshot_validate (GeglTileSource *source,
+                                     GeglTile       *tile,
+                                     gint            x,
+                                     gint            y)
+{
+  GimpTileHandlerSnapshot *snapshot = GIMP_TILE_HANDLER_SNAPSHOT (source);
+  cairo_region_t          *tile_region;
+  cairo_rectangle_int_t    tile_rect;
+  gint                     tile_bpp;
+  gint                     tile_stride;
+  gint                     n_rects;
+  gint                     i;
+
+  tile_rect.x      = x * snapshot->tile_width;
+  tile_rect.y      = y * snapshot->tile_height;
+  tile_rect.width  = snapshot->tile_width;
+  tile_rect.height = snapshot->tile_height;
+
+  if (cairo_region_contains_rectangle (snapshot->pending_region,
+                                       &tile_rect) == CAIRO_REGION_OVERLAP_OUT)
+    return tile;
+
+  tile_region = cairo_region_copy (snapshot->pending_region);
+
+  cairo_region_intersect_rectangle (tile_region, &tile_rect);
+  cairo_region_subtract_rectangle (snapshot->pending_region, &tile_rect);
+
+  if (! tile)
+    tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (source),
+                                          x, y, 0);
+
+  tile_bpp    = babl_format_get_bytes_per_pixel (snapshot->format);
+  tile_stride = tile_bpp * snapshot->tile_width;
+
+  gegl_tile_lock (tile);
+
+  n_rects = cairo_region_num_rectangles (tile_region);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t copy_rect;
+
+      cairo_region_get_rectangle (tile_region, i, &copy_rect);
+
+      gegl_buffer_get (snapshot->source,
+                       GEGL_RECTANGLE (copy_rect.x,
+                                       copy_rect.y,
+                                       copy_rect.width,
+                                       copy_rect.height),
+                       1.0, snapshot->format,
+                       gegl_tile_get_data (tile) +
+                       (copy_rect.y % snapshot->tile_height) * tile_stride +
+                       (copy_rect.x % snapshot->tile_width)  * tile_bpp,
+                       tile_stride,
+                       GEGL_ABYSS_NONE);
+    }
+
+  gegl_tile_unlock (tile);
+
+  cairo_region_destroy (tile_region);
+
+  return tile;
+}
+
+static gpointer
+gimp_tile_handler_snapshot_command (GeglTileSource  *source,
+                                    GeglTileCommand  command,
+                                    gint             x,
+                                    gint             y,
+                                    gint             z,
+                                    gpointer         data)
+{
+  gpointer retval;
+
+  retval = gegl_tile_handler_source_command (source, command, x, y, z, data);
+
+  if (command == GEGL_TILE_GET && z == 0)
+    retval = gimp_tile_handler_snapshot_validate (source, retval, x, y);
+
+  return retval;
+}
+
+/**
+ * gimp_tile_handler_snapshot_new:
+ * @source: the #GeglBuffer to take a snapshot of
+ *
+ * Creates a tile handler which fills the buffer it is added to with
+ * the pixels @source has at the time the tiles are first fetched.
+ * The buffer should have @source's extent and format. Nothing is
+ * copied up front; before modifying an area of @source, call
+ * gimp_tile_handler_snapshot_take() on it to keep its old pixels.
+ *
+ * Only the full resolution level of the snapshot is valid.
+ *
+ * Return value: the new tile handler.
+ **/
+GeglTileHandler *
+gimp_tile_handler_snapshot_new (GeglBuffer *source)
+{
+  GimpTileHandlerSnapshot *snapshot;
+  const GeglRectangle     *extent;
+  cairo_rectangle_int_t    rect;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (source), NULL);
+
+  snapshot = g_object_new (GIMP_TYPE_TILE_HANDLER_SNAPSHOT, NULL);
+
+  snapshot->source = g_object_ref (source);
+
+  extent = gegl_buffer_get_extent (source);
+
+  rect.x      = extent->x;
+  rect.y      = extent->y;
+  rect.width  = extent->width;
+  rect.height = extent->height;
+
+  cairo_region_union_rectangle (snapshot->pending_region, &rect);
+
+  return GEGL_TILE_HANDLER (snapshot);
+}
+
+/**
+ * gimp_tile_handler_snapshot_take:
+ * @snapshot: a #GimpTileHandlerSnapshot
+ * @x:        left of the area of the source buffer
+ * @y:        top of the area
+ * @width:    width of the area
+ * @height:   height of the area
+ *
+ * Copies the tiles touching the area from the source buffer into the
+ * snapshot, unless they were copied before. Call this before writing
+ * to the area of the source buffer.
+ **/
+void
+gimp_tile_handler_snapshot_take (GimpTileHandlerSnapshot *snapshot,
+                                 gint                     x,
+                                 gint                     y,
+                                 gint                     width,
+                                 gint                     height)
+{
+  cairo_rectangle_int_t rect;
+  cairo_rectangle_int_t extents;
+  gint                  tile_x1, tile_y1;
+  gint                  tile_x2, tile_y2;
+  gint                  tile_x, tile_y;
+
+  g_return_if_fail (GIMP_IS_TILE_HANDLER_SNAPSHOT (snapshot));
+
+  cairo_region_get_extents (snapshot->pending_region, &extents);
+
+  if (! gegl_rectangle_intersect ((GeglRectangle *) &rect,
+                                  GEGL_RECTANGLE (x, y, width, height),
+                                  (GeglRectangle *) &extents))
+    return;
+
+  if (cairo_region_contains_rectangle (snapshot->pending_region,
+                                       &rect) == CAIRO_REGION_OVERLAP_OUT)
+    return;
+
+  tile_x1 = rect.x / snapshot->tile_width;
+  tile_y1 = rect.y / snapshot->tile_height;
+  tile_x2 = (rect.x + rect.width  - 1) / snapshot->tile_width;
+  tile_y2 = (rect.y + rect.height - 1) / snapshot->tile_height;
+
+  for (tile_y = tile_y1; tile_y <= tile_y2; tile_y++)
+    {
+      for (tile_x = tile_x1; tile_x <= tile_x2; tile_x++)
+        {
+          GeglTile *tile;
+
+          /*  fetching the tile copies it, and the buffer's cache keeps it  */
+          tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (snapshot),
+                                            tile_x, tile_y, 0);
+
+          if (tile)
+            gegl_tile_unref (tile);
+        }
+    }
+}
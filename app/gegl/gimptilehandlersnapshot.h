@@ -0,0 +1,72 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_TILE_HANDLER_SNAPSHOT_H__
+#define __GIMP_TILE_HANDLER_SNAPSHOT_H__
+
+#include <gegl-buffer-backend.h>
+
+/***
+ * GimpTileHandlerSnapshot is a GeglTileHandler that makes its buffer
+ * a lazy snapshot of another buffer. Tiles are copied from the source
+ * buffer when they are first fetched, or when the source is about to
+ * be modified.
+ */
+
+G_BEGIN_DECLS
+
+#define GIMP_TYPE_TILE_HANDLER_SNAPSHOT            (gimp_tile_handler_snapshot_get_type ())
+#define GIMP_TILE_HANDLER_SNAPSHOT(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GIMP_TYPE_TILE_HANDLER_SNAPSHOT, GimpTileHandlerSnapshot))
+#define GIMP_TILE_HANDLER_SNAPSHOT_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  GIMP_TYPE_TILE_HANDLER_SNAPSHOT, GimpTileHandlerSnapshotClass))
+#define GIMP_IS_TILE_HANDLER_SNAPSHOT(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GIMP_TYPE_TILE_HANDLER_SNAPSHOT))
+#define GIMP_IS_TILE_HANDLER_SNAPSHOT_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  GIMP_TYPE_TILE_HANDLER_SNAPSHOT))
+#define GIMP_TILE_HANDLER_SNAPSHOT_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GIMP_TYPE_TILE_HANDLER_SNAPSHOT, GimpTileHandlerSnapshotClass))
+
+
+typedef struct _GimpTileHandlerSnapshot      GimpTileHandlerSnapshot;
+typedef struct _GimpTileHandlerSnapshotClass GimpTileHandlerSnapshotClass;
+
+struct _GimpTileHandlerSnapshot
+{
+  GeglTileHandler  parent_instance;
+
+  GeglBuffer      *source;
+  cairo_region_t  *pending_region;
+  const Babl      *format;
+  gint             tile_width;
+  gint             tile_height;
+};
+
+struct _GimpTileHandlerSnapshotClass
+{
+  GeglTileHandlerClass  parent_class;
+};
+
+
+GType             gimp_tile_handler_snapshot_get_type (void) G_GNUC_CONST;
+GeglTileHandler * gimp_tile_handler_snapshot_new      (GeglBuffer              *source);
+
+void              gimp_tile_handler_snapshot_take     (GimpTileHandlerSnapshot *snapshot,
+                                                       gint                     x,
+                                                       gint                     y,
+                                                       gint                     width,
+                                                       gint                     height);
+
+
+G_END_DECLS
+
+#endif /* __GIMP_TILE_HANDLER_SNAPSHOT_H__ */
@@ -36,7 +36,10 @@
 #include "core/gimpcurve.h"
 #include "core/gimphistogram.h"
 
+#include "core/gimpcurve-map.h"
+
 #include "gimpcurvesconfig.h"
+#include "gimppointlut.h"
 
 #include "gimp-intl.h"
 
@@ -52,6 +55,8 @@ enum
 static void     gimp_curves_config_iface_init   (GimpConfigInterface *iface);
 
 static void     gimp_curves_config_finalize     (GObject          *object);
+static void     gimp_curves_config_notify       (GObject          *object,
+                                                 GParamSpec       *pspec);
 static void     gimp_curves_config_get_property (GObject          *object,
                                                  guint             property_id,
                                                  GValue           *value,
@@ -78,6 +83,10 @@ static gboolean gimp_curves_config_copy         (GimpConfig       *src,
 static void     gimp_curves_config_curve_dirty  (GimpCurve        *curve,
                                                  GimpCurvesConfig *config);
 
+static gdouble  gimp_curves_config_map_channel  (gint              channel,
+                                                 gdouble           value,
+                                                 GimpCurvesConfig *config);
+
 
 G_DEFINE_TYPE_WITH_CODE (GimpCurvesConfig, gimp_curves_config,
                          GIMP_TYPE_IMAGE_MAP_CONFIG,
@@ -86,6 +95,8 @@ G_DEFINE_TYPE_WITH_CODE (GimpCurvesConfig, gimp_curves_config,
 
 #define parent_class gimp_curves_config_parent_class
 
+G_LOCK_DEFINE_STATIC (curves_lut);
+
 
 static void
 gimp_curves_config_class_init (GimpCurvesConfigClass *klass)
@@ -94,6 +105,7 @@ gimp_curves_config_class_init (GimpCurvesConfigClass *klass)
   GimpViewableClass *viewable_class = GIMP_VIEWABLE_CLASS (klass);
 
   object_class->finalize           = gimp_curves_config_finalize;
+  object_class->notify             = gimp_curves_config_notify;
   object_class->set_property       = gimp_curves_config_set_property;
   object_class->get_property       = gimp_curves_config_get_property;
 
@@ -155,9 +167,52 @@ gimp_curves_config_finalize (GObject *object)
       self->curve[channel] = NULL;
     }
 
+  if (self->lut_u8)
+    {
+      gimp_point_lut_unref (self->lut_u8);
+      self->lut_u8 = NULL;
+    }
+
+  if (self->lut_u16)
+    {
+      gimp_point_lut_unref (self->lut_u16);
+      self->lut_u16 = NULL;
+    }
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static void
+gimp_curves_config_notify (GObject    *object,
+                           GParamSpec *pspec)
+{
+  GimpCurvesConfig *self = GIMP_CURVES_CONFIG (object);
+
+  if (! strcmp (pspec->name, "curve"))
+    {
+      GimpPointLut *lut_u8;
+      GimpPointLut *lut_u16;
+
+      G_LOCK (curves_lut);
+
+      lut_u8        = self->lut_u8;
+      lut_u16       = self->lut_u16;
+      self->lut_u8  = NULL;
+      self->lut_u16 = NULL;
+
+      G_UNLOCK (curves_lut);
+
+      if (lut_u8)
+        gimp_point_lut_unref (lut_u8);
+
+      if (lut_u16)
+        gimp_point_lut_unref (lut_u16);
+    }
+
+  if (G_OBJECT_CLASS (parent_class)->notify)
+    G_OBJECT_CLASS (parent_class)->notify (object, pspec);
+}
+
 static void
 gimp_curves_config_get_property (GObject    *object,
                                  guint       property_id,
@@ -348,6 +403,21 @@ gimp_curves_config_curve_dirty (GimpCurve        *curve,
   g_object_notify (G_OBJECT (config), "curve");
 }
 
+static gdouble
+gimp_curves_config_map_channel (gint              channel,
+                                gdouble           value,
+                                GimpCurvesConfig *config)
+{
+  /* don't apply the colors curve to the alpha channel */
+  if (channel == 3)
+    return gimp_curve_map_value (config->curve[GIMP_HISTOGRAM_ALPHA], value);
+
+  value = gimp_curve_map_value (config->curve[GIMP_HISTOGRAM_RED + channel],
+                                value);
+
+  return gimp_curve_map_value (config->curve[GIMP_HISTOGRAM_VALUE], value);
+}
+
 
 /*  public functions  */
 
@@ -425,6 +495,48 @@ gimp_curves_config_reset_channel (GimpCurvesConfig *config)
 
 #define GIMP_CURVE_N_CRUFT_POINTS 17
 
+/**
+ * gimp_curves_config_get_lut:
+ * @config: a #GimpCurvesConfig
+ * @format: "R'G'B'A u8" or "R'G'B'A u16"
+ *
+ * Returns a lookup table for @format that applies the value curve and
+ * the color curves in one go. The table is built on first use after
+ * the curves change, and shared until they change again.
+ *
+ * Returns: a reference to the lookup table, release it with
+ *          gimp_point_lut_unref().
+ **/
+GimpPointLut *
+gimp_curves_config_get_lut (GimpCurvesConfig *config,
+                            const Babl       *format)
+{
+  GimpPointLut **lut;
+  GimpPointLut  *result;
+
+  g_return_val_if_fail (GIMP_IS_CURVES_CONFIG (config), NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+
+  G_LOCK (curves_lut);
+
+  if (babl_format_get_type (format, 0) == babl_type ("u8"))
+    lut = &config->lut_u8;
+  else
+    lut = &config->lut_u16;
+
+  if (! *lut)
+    *lut = gimp_point_lut_new (format,
+                               (GimpPointLutFunc)
+                               gimp_curves_config_map_channel,
+                               config);
+
+  result = *lut ? gimp_point_lut_ref (*lut) : NULL;
+
+  G_UNLOCK (curves_lut);
+
+  return result;
+}
+
 gboolean
 gimp_curves_config_load_cruft (GimpCurvesConfig  *config,
                                gpointer           fp,
@@ -42,6 +42,10 @@ struct _GimpCurvesConfig
   GimpHistogramChannel  channel;
 
   GimpCurve            *curve[5];
+
+  /*  fused lookup tables for 8 and 16 bit pixels  */
+  GimpPointLut         *lut_u8;
+  GimpPointLut         *lut_u16;
 };
 
 struct _GimpCurvesConfigClass
@@ -61,6 +65,10 @@ GObject *  gimp_curves_config_new_explicit  (gint32             channel,
 
 void       gimp_curves_config_reset_channel (GimpCurvesConfig  *config);
 
+GimpPointLut *
+           gimp_curves_config_get_lut       (GimpCurvesConfig  *config,
+                                             const Babl        *format);
+
 gboolean   gimp_curves_config_load_cruft    (GimpCurvesConfig  *config,
                                              gpointer           fp,
                                              GError           **error);
@@ -0,0 +1,840 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpdistancetransform.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "operations-types.h"
+
+#include "core/gimp-parallel.h"
+
+#include "gimpdistancetransform.h"
+
+
+/*  The exact Euclidean distance transform of Felzenszwalb and
+ *  Huttenlocher, "Distance Transforms of Sampled Functions".
+ *
+ *  The squared distance is separable, so the 2D transform is a 1D
+ *  transform of every column, followed by a 1D transform of every row
+ *  of the result.  Each 1D transform computes the lower envelope of
+ *  the parabolas f(q) + w * (p - q)^2 in linear time, so the whole
+ *  transform is O(pixels), whatever the distances involved.  Columns
+ *  and rows are independent of each other and are processed in
+ *  parallel.
+ */
+
+#define MIN_PARALLEL_PIXELS 16384
+
+/*  the memory gimp_distance_transform_dilate() works in, the mask is
+ *  processed in bands of rows that fit
+ */
+#define DILATE_BAND_SIZE    (16 * 1024 * 1024)
+
+
+typedef struct
+{
+  gfloat   *dist;
+  gint      width;
+  gint      height;
+  gdouble   weight;
+  gboolean  outside_is_source;
+} DistancePass;
+
+typedef struct
+{
+  gfloat   *dist;
+  gfloat   *tmp;        /*  the columns at twice the resolution, at the
+                         *  rows of the pixel centers
+                         */
+  gint      width;
+  gint      height;
+  gdouble   weight;
+  gdouble   threshold;
+} SquaresPass;
+
+typedef struct
+{
+  gdouble *f;     /*  the samples, f[-1] and f[n] are the outside  */
+  gdouble *d;
+  gint    *v;
+  gdouble *z;
+} DistanceScratch;
+
+typedef struct
+{
+  const gfloat *src;        /*  the band's rows, padded by radius_x  */
+  gfloat       *row_max;    /*  the running maximum of each row      */
+  gfloat       *dst;
+  gint          src_width;
+  gint          src_height;
+  gint          dst_width;
+  gint          dst_height;
+  gint          dst_offset; /*  the row of src of the first dst row  */
+  gint          radius_x;
+  gint          radius_y;
+  gfloat        pad;        /*  the value of the rows outside src    */
+} DilatePass;
+
+
+/*  local function prototypes  */
+
+static void     distance_scratch_init  (DistanceScratch     *scratch,
+                                        gint                 n);
+static void     distance_scratch_clear (DistanceScratch     *scratch);
+
+static void     distance_transform_1d  (DistanceScratch     *scratch,
+                                        gint                 n,
+                                        gdouble              weight,
+                                        gboolean             outside_is_source);
+
+static void     distance_columns_func  (gsize                offset,
+                                        gsize                size,
+                                        gpointer             data);
+static void     distance_rows_func     (gsize                offset,
+                                        gsize                size,
+                                        gpointer             data);
+
+static void     squares_columns_func   (gsize                offset,
+                                        gsize                size,
+                                        gpointer             data);
+static void     squares_rows_func      (gsize                offset,
+                                        gsize                size,
+                                        gpointer             data);
+
+static gboolean mask_is_binary         (GeglBuffer          *input,
+                                        const GeglRectangle *roi);
+
+static void     dilate_band_binary     (gfloat              *src,
+                                        gfloat              *dst,
+                                        gint                 src_width,
+                                        gint                 src_height,
+                                        gint                 dst_width,
+                                        gint                 dst_height,
+                                        gint                 dst_offset,
+                                        gint                 radius_x,
+                                        gint                 radius_y);
+static void     dilate_band_grey       (const gfloat        *src,
+                                        gfloat              *dst,
+                                        gint                 src_width,
+                                        gint                 src_height,
+                                        gint                 dst_width,
+                                        gint                 dst_height,
+                                        gint                 dst_offset,
+                                        gint                 radius_x,
+                                        gint                 radius_y,
+                                        gfloat               pad);
+static void     running_max_blocks     (const gfloat        *samples,
+                                        gint                 n,
+                                        gint                 k,
+                                        gfloat              *g,
+                                        gfloat              *h);
+static void     dilate_rows_func       (gsize                offset,
+                                        gsize                size,
+                                        gpointer             data);
+static void     dilate_columns_func    (gsize                offset,
+                                        gsize                size,
+                                        gpointer             data);
+
+
+/*  public functions  */
+
+/**
+ * gimp_distance_transform:
+ * @dist:              @width x @height squared distances
+ * @width:             the width of the area
+ * @height:            the height of the area
+ * @aspect:            the factor applied to horizontal distances
+ * @outside_is_source: whether everything outside the area is a source
+ *
+ * On input, @dist is 0.0 at the sources and
+ * #GIMP_DISTANCE_TRANSFORM_FAR everywhere else.  On output, it holds
+ * the squared Euclidean distance of each pixel to the nearest source,
+ * with horizontal offsets multiplied by @aspect, so that the distance
+ * to a source is within an ellipse of radii (rx, ry) exactly when it
+ * is within ry, for @aspect = ry / rx.
+ *
+ * If there is no source at all, the distances stay at or above
+ * #GIMP_DISTANCE_TRANSFORM_FAR.
+ **/
+void
+gimp_distance_transform (gfloat   *dist,
+                         gint      width,
+                         gint      height,
+                         gdouble   aspect,
+                         gboolean  outside_is_source)
+{
+  DistancePass pass;
+
+  g_return_if_fail (dist != NULL);
+  g_return_if_fail (width > 0 && height > 0);
+  g_return_if_fail (aspect > 0.0);
+
+  pass.dist              = dist;
+  pass.width             = width;
+  pass.height            = height;
+  pass.outside_is_source = outside_is_source;
+
+  pass.weight = 1.0;
+
+  gimp_parallel_distribute_range (width,
+                                  MAX (1, MIN_PARALLEL_PIXELS / height),
+                                  distance_columns_func, &pass);
+
+  pass.weight = aspect * aspect;
+
+  gimp_parallel_distribute_range (height,
+                                  MAX (1, MIN_PARALLEL_PIXELS / width),
+                                  distance_rows_func, &pass);
+}
+
+
+/**
+ * gimp_distance_transform_squares:
+ * @dist:      @width x @height squared distances
+ * @width:     the width of the area
+ * @height:    the height of the area
+ * @aspect:    the factor applied to horizontal distances
+ * @threshold: the distance to threshold at, or 0.0
+ *
+ * Like gimp_distance_transform(), but measures the distance from the
+ * center of each pixel to the nearest point of a source pixel, seen
+ * as a unit square, instead of to its center.  That is the distance
+ * with both offsets reduced by half a pixel, which is how grow, shrink
+ * and border have always measured their ellipse.  Everything outside
+ * the area is unselected.
+ *
+ * The transform runs on a grid of twice the resolution, where each
+ * source covers the corners and edges of its square, and only keeps
+ * the pixel centers.
+ *
+ * If @threshold is positive, @dist becomes 1.0 where the distance is
+ * less than @threshold and 0.0 elsewhere, compared before the distance
+ * is rounded to float.
+ **/
+void
+gimp_distance_transform_squares (gfloat  *dist,
+                                 gint     width,
+                                 gint     height,
+                                 gdouble  aspect,
+                                 gdouble  threshold)
+{
+  SquaresPass pass;
+
+  g_return_if_fail (dist != NULL);
+  g_return_if_fail (width > 0 && height > 0);
+  g_return_if_fail (aspect > 0.0);
+
+  pass.dist      = dist;
+  pass.tmp       = g_new (gfloat, (gsize) (2 * width + 1) * height);
+  pass.width     = width;
+  pass.height    = height;
+  pass.weight    = aspect * aspect;
+  pass.threshold = threshold;
+
+  gimp_parallel_distribute_range (2 * width + 1,
+                                  MAX (1, MIN_PARALLEL_PIXELS /
+                                          (2 * height + 1)),
+                                  squares_columns_func, &pass);
+
+  gimp_parallel_distribute_range (height,
+                                  MAX (1, MIN_PARALLEL_PIXELS /
+                                          (2 * width + 1)),
+                                  squares_rows_func, &pass);
+
+  g_free (pass.tmp);
+}
+
+
+/**
+ * gimp_distance_transform_dilate:
+ * @input:             a "Y float" mask
+ * @output:            the buffer to write the result to
+ * @roi:               the area of @input to dilate
+ * @radius_x:          the horizontal radius
+ * @radius_y:          the vertical radius
+ * @invert:            whether to erode instead of dilate
+ * @outside_is_source: whether everything outside @roi is selected
+ *
+ * Replaces each pixel of @roi by the maximum of @input around it.  If
+ * @invert is %TRUE it uses the minimum instead, and
+ * @outside_is_source then means that everything outside @roi is
+ * unselected.
+ *
+ * A mask which is only 0.0 and 1.0 is dilated by the ellipse of radii
+ * (@radius_x, @radius_y) that gimp_distance_transform_squares()
+ * measures, by thresholding that transform.  Any other mask is dilated
+ * by the rectangle of the same radii, with a running maximum over the
+ * rows followed by one over the columns.  Either way the cost per
+ * pixel doesn't depend on the radius, and the mask is processed in
+ * bands of rows which keep the memory used within a fixed limit.
+ **/
+void
+gimp_distance_transform_dilate (GeglBuffer          *input,
+                                GeglBuffer          *output,
+                                const GeglRectangle *roi,
+                                gint                 radius_x,
+                                gint                 radius_y,
+                                gboolean             invert,
+                                gboolean             outside_is_source)
+{
+  const Babl *format    = babl_format ("Y float");
+  gint        width     = roi->width;
+  gint        height    = roi->height;
+  gint        src_width = width + 2 * radius_x;
+  gfloat      pad       = outside_is_source ? 1.0f : 0.0f;
+  gboolean    binary;
+  gint64      row_size;
+  gint64      band_pixels;
+  gint        band_height;
+  gint        y0;
+
+  g_return_if_fail (GEGL_IS_BUFFER (input));
+  g_return_if_fail (GEGL_IS_BUFFER (output));
+  g_return_if_fail (roi != NULL);
+  g_return_if_fail (radius_x > 0 && radius_y > 0);
+
+  if (width < 1 || height < 1)
+    return;
+
+  /*  decide for the whole mask, so all bands use the same shape  */
+  binary = mask_is_binary (input, roi);
+
+  /*  a row of a band takes the padded row, twice as much again for
+   *  the distance transform or the running maximum, and the result
+   */
+  row_size = 3 * src_width + 1 + width;
+
+  /*  each band needs radius_y extra rows above and below  */
+  band_pixels = ((gint64) (DILATE_BAND_SIZE / sizeof (gfloat)) -
+                 (gint64) 2 * radius_y * row_size);
+  band_height = CLAMP (band_pixels / row_size, 1, height);
+
+  for (y0 = 0; y0 < height; y0 += band_height)
+    {
+      gint     dst_height = MIN (band_height, height - y0);
+      gint     src_y0     = y0 - radius_y;
+      gint     src_y1     = y0 + dst_height + radius_y;
+      gint     read_y0;
+      gint     read_y1;
+      gint     src_height;
+      gfloat  *src;
+      gfloat  *dst;
+      gint     i, x, y;
+
+      /*  rows outside the area only matter if they are selected  */
+      if (! outside_is_source)
+        {
+          src_y0 = MAX (src_y0, 0);
+          src_y1 = MIN (src_y1, height);
+        }
+
+      read_y0    = MAX (src_y0, 0);
+      read_y1    = MIN (src_y1, height);
+      src_height = src_y1 - src_y0;
+
+      src = g_new (gfloat, (gsize) src_width * src_height);
+      dst = g_new (gfloat, (gsize) width * dst_height);
+
+      for (i = 0; i < src_width * src_height; i++)
+        src[i] = pad;
+
+      gegl_buffer_get (input,
+                       GEGL_RECTANGLE (roi->x, roi->y + read_y0,
+                                       width, read_y1 - read_y0),
+                       1.0, format,
+                       src + (read_y0 - src_y0) * src_width + radius_x,
+                       src_width * sizeof (gfloat), GEGL_ABYSS_NONE);
+
+      if (invert)
+        {
+          for (y = read_y0 - src_y0; y < read_y1 - src_y0; y++)
+            {
+              gfloat *row = src + y * src_width + radius_x;
+
+              for (x = 0; x < width; x++)
+                row[x] = 1.0f - row[x];
+            }
+        }
+
+      if (binary)
+        dilate_band_binary (src, dst, src_width, src_height,
+                            width, dst_height, y0 - src_y0,
+                            radius_x, radius_y);
+      else
+        dilate_band_grey (src, dst, src_width, src_height,
+                          width, dst_height, y0 - src_y0,
+                          radius_x, radius_y, pad);
+
+      if (invert)
+        {
+          for (i = 0; i < width * dst_height; i++)
+            dst[i] = 1.0f - dst[i];
+        }
+
+      gegl_buffer_set (output,
+                       GEGL_RECTANGLE (roi->x, roi->y + y0,
+                                       width, dst_height),
+                       0, format, dst, GEGL_AUTO_ROWSTRIDE);
+
+      g_free (dst);
+      g_free (src);
+    }
+}
+
+
+/*  private functions  */
+
+static void
+distance_scratch_init (DistanceScratch *scratch,
+                       gint             n)
+{
+  scratch->f = g_new (gdouble, n + 2) + 1;
+  scratch->d = g_new (gdouble, n);
+  scratch->v = g_new (gint,    n + 2);
+  scratch->z = g_new (gdouble, n + 3);
+
+  scratch->f[-1] = 0.0;
+  scratch->f[n]  = 0.0;
+}
+
+static void
+distance_scratch_clear (DistanceScratch *scratch)
+{
+  g_free (scratch->f - 1);
+  g_free (scratch->d);
+  g_free (scratch->v);
+  g_free (scratch->z);
+}
+
+/*  Computes d[p] = min_q (f[q] + weight * (p - q)^2) for 0 <= p < n.  q ranges over [0, n), or over [-1, n] when the
+ *  outside is a source.
+ */
+static void
+distance_transform_1d (DistanceScratch *scratch,
+                       gint             n,
+                       gdouble          weight,
+                       gboolean         outside_is_source)
+{
+  const gdouble *f     = scratch->f;
+  gint          *v     = scratch->v;
+  gdouble       *z     = scratch->z;
+  gint           first = outside_is_source ? -1 : 0;
+  gint           last  = outside_is_source ?  n : n - 1;
+  gint           k     = 0;
+  gint           q;
+
+  v[0] = first;
+  z[0] = -G_MAXDOUBLE;
+  z[1] =  G_MAXDOUBLE;
+
+  for (q = first + 1; q <= last; q++)
+    {
+      gdouble fq = f[q] + weight * q * q;
+      gdouble s;
+
+      while (TRUE)
+        {
+          gint r = v[k];
+
+          s = (fq - (f[r] + weight * r * r)) / (2.0 * weight * (q - r));
+
+          if (s > z[k])
+            break;
+
+          k--;
+        }
+
+      k++;
+
+      v[k]     = q;
+      z[k]     = s;
+      z[k + 1] = G_MAXDOUBLE;
+    }
+
+  k = 0;
+
+  for (q = 0; q < n; q++)
+    {
+      while (z[k + 1] < q)
+        k++;
+
+      scratch->d[q] = weight * SQR (q - v[k]) + f[v[k]];
+    }
+}
+
+static void
+distance_columns_func (gsize    offset,
+                       gsize    size,
+                       gpointer data)
+{
+  DistancePass    *pass   = data;
+  gint             width  = pass->width;
+  gint             height = pass->height;
+  DistanceScratch  scratch;
+  gsize            x;
+  gint             y;
+
+  distance_scratch_init (&scratch, height);
+
+  for (x = offset; x < offset + size; x++)
+    {
+      gfloat *dist = pass->dist + x;
+
+      for (y = 0; y < height; y++)
+        scratch.f[y] = dist[y * width];
+
+      distance_transform_1d (&scratch, height, pass->weight,
+                             pass->outside_is_source);
+
+      for (y = 0; y < height; y++)
+        dist[y * width] = scratch.d[y];
+    }
+
+  distance_scratch_clear (&scratch);
+}
+
+static void
+distance_rows_func (gsize    offset,
+                    gsize    size,
+                    gpointer data)
+{
+  DistancePass    *pass  = data;
+  gint             width = pass->width;
+  DistanceScratch  scratch;
+  gsize            y;
+  gint             x;
+
+  distance_scratch_init (&scratch, width);
+
+  for (y = offset; y < offset + size; y++)
+    {
+      gfloat *dist = pass->dist + y * width;
+
+      for (x = 0; x < width; x++)
+        scratch.f[x] = dist[x];
+
+      distance_transform_1d (&scratch, width, pass->weight,
+                             pass->outside_is_source);
+
+      for (x = 0; x < width; x++)
+        dist[x] = scratch.d[x];
+    }
+
+  distance_scratch_clear (&scratch);
+}
+
+
+static void
+squares_columns_func (gsize    offset,
+                      gsize    size,
+                      gpointer data)
+{
+  SquaresPass     *pass   = data;
+  gint             width  = pass->width;
+  gint             height = pass->height;
+  gint             n      = 2 * height + 1;
+  gboolean        *column = g_new (gboolean, height);
+  DistanceScratch  scratch;
+  gsize            x;
+  gint             y;
+
+  distance_scratch_init (&scratch, n);
+
+  for (x = offset; x < offset + size; x++)
+    {
+      /*  the columns at even x are the edges between two pixels, the
+       *  ones at odd x go through the centers of the pixels
+       */
+      gint right = x / 2;
+      gint left  = x % 2 ? right : right - 1;
+
+      for (y = 0; y < height; y++)
+        {
+          const gfloat *row = pass->dist + y * width;
+
+          column[y] = ((left  >= 0    && row[left]  == 0.0f) ||
+                       (right < width && row[right] == 0.0f));
+        }
+
+      for (y = 0; y < n; y++)
+        {
+          gint bottom = y / 2;
+          gint top    = y % 2 ? bottom : bottom - 1;
+
+          if ((top    >= 0      && column[top]) ||
+              (bottom <  height && column[bottom]))
+            scratch.f[y] = 0.0;
+          else
+            scratch.f[y] = GIMP_DISTANCE_TRANSFORM_FAR;
+        }
+
+      distance_transform_1d (&scratch, n, 1.0, FALSE);
+
+      for (y = 0; y < height; y++)
+        pass->tmp[y * (2 * width + 1) + x] = scratch.d[2 * y + 1];
+    }
+
+  distance_scratch_clear (&scratch);
+
+  g_free (column);
+}
+
+static void
+squares_rows_func (gsize    offset,
+                   gsize    size,
+                   gpointer data)
+{
+  SquaresPass     *pass      = data;
+  gint             width     = pass->width;
+  gint             n         = 2 * width + 1;
+  gdouble          threshold = SQR (pass->threshold);
+  DistanceScratch  scratch;
+  gsize            y;
+  gint             x;
+
+  distance_scratch_init (&scratch, n);
+
+  for (y = offset; y < offset + size; y++)
+    {
+      const gfloat *tmp  = pass->tmp + y * n;
+      gfloat       *dist = pass->dist + y * width;
+
+      for (x = 0; x < n; x++)
+        scratch.f[x] = tmp[x];
+
+      distance_transform_1d (&scratch, n, pass->weight, FALSE);
+
+      /*  the grid is twice the resolution, so the squared distances
+       *  are four times as large
+       */
+      for (x = 0; x < width; x++)
+        {
+          gdouble d = scratch.d[2 * x + 1] / 4.0;
+
+          if (pass->threshold > 0.0)
+            dist[x] = d < threshold ? 1.0f : 0.0f;
+          else
+            dist[x] = d;
+        }
+    }
+
+  distance_scratch_clear (&scratch);
+}
+
+static gboolean
+mask_is_binary (GeglBuffer          *input,
+                const GeglRectangle *roi)
+{
+  GeglBufferIterator *iter;
+  gboolean            binary = TRUE;
+
+  iter = gegl_buffer_iterator_new (input, roi, 0, babl_format ("Y float"),
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *data = iter->data[0];
+      gint          i;
+
+      for (i = 0; binary && i < iter->length; i++)
+        {
+          if (data[i] != 0.0f && data[i] != 1.0f)
+            binary = FALSE;
+        }
+    }
+
+  return binary;
+}
+
+/*  a pixel of a band of 0.0 and 1.0 becomes 1.0 exactly when the
+ *  nearest 1.0 is within the ellipse
+ */
+static void
+dilate_band_binary (gfloat *src,
+                    gfloat *dst,
+                    gint    src_width,
+                    gint    src_height,
+                    gint    dst_width,
+                    gint    dst_height,
+                    gint    dst_offset,
+                    gint    radius_x,
+                    gint    radius_y)
+{
+  gint i, y;
+
+  for (i = 0; i < src_width * src_height; i++)
+    src[i] = src[i] == 1.0f ? 0.0f : GIMP_DISTANCE_TRANSFORM_FAR;
+
+  gimp_distance_transform_squares (src, src_width, src_height,
+                                   (gdouble) radius_y / radius_x,
+                                   radius_y);
+
+  for (y = 0; y < dst_height; y++)
+    memcpy (dst + y * dst_width,
+            src + (y + dst_offset) * src_width + radius_x,
+            dst_width * sizeof (gfloat));
+}
+
+/*  the maximum over the rectangle is the running maximum over each
+ *  column of the running maximum over each row
+ */
+static void
+dilate_band_grey (const gfloat *src,
+                  gfloat       *dst,
+                  gint          src_width,
+                  gint          src_height,
+                  gint          dst_width,
+                  gint          dst_height,
+                  gint          dst_offset,
+                  gint          radius_x,
+                  gint          radius_y,
+                  gfloat        pad)
+{
+  DilatePass pass;
+
+  pass.src        = src;
+  pass.row_max    = g_new (gfloat, (gsize) dst_width * src_height);
+  pass.dst        = dst;
+  pass.src_width  = src_width;
+  pass.src_height = src_height;
+  pass.dst_width  = dst_width;
+  pass.dst_height = dst_height;
+  pass.dst_offset = dst_offset;
+  pass.radius_x   = radius_x;
+  pass.radius_y   = radius_y;
+  pass.pad        = pad;
+
+  gimp_parallel_distribute_range (src_height,
+                                  MAX (1, MIN_PARALLEL_PIXELS / src_width),
+                                  dilate_rows_func, &pass);
+
+  gimp_parallel_distribute_range (dst_width,
+                                  MAX (1, MIN_PARALLEL_PIXELS /
+                                          (dst_height + 2 * radius_y)),
+                                  dilate_columns_func, &pass);
+
+  g_free (pass.row_max);
+}
+
+/*  The van Herk/Gil-Werman running maximum.  With the n samples cut
+ *  into blocks of k, g holds the maximum from the start of each block
+ *  and h the maximum up to its end.  Any k consecutive samples span at
+ *  most two blocks, so their maximum is MAX (h[first], g[last]), which
+ *  is three comparisons per sample whatever k is.
+ */
+static void
+running_max_blocks (const gfloat *samples,
+                    gint          n,
+                    gint          k,
+                    gfloat       *g,
+                    gfloat       *h)
+{
+  gint i, j;
+
+  for (i = 0; i < n; i += k)
+    {
+      gint end = MIN (i + k, n);
+
+      g[i] = samples[i];
+
+      for (j = i + 1; j < end; j++)
+        g[j] = MAX (g[j - 1], samples[j]);
+
+      h[end - 1] = samples[end - 1];
+
+      for (j = end - 2; j >= i; j--)
+        h[j] = MAX (h[j + 1], samples[j]);
+    }
+}
+
+static void
+dilate_rows_func (gsize    offset,
+                  gsize    size,
+                  gpointer data)
+{
+  DilatePass *pass      = data;
+  gint        src_width = pass->src_width;
+  gint        radius_x  = pass->radius_x;
+  gfloat     *g         = g_new (gfloat, src_width);
+  gfloat     *h         = g_new (gfloat, src_width);
+  gsize       y;
+
+  for (y = offset; y < offset + size; y++)
+    {
+      gfloat *out = pass->row_max + y * pass->dst_width;
+      gint    x;
+
+      running_max_blocks (pass->src + y * src_width, src_width,
+                          2 * radius_x + 1, g, h);
+
+      /*  the padded row is radius_x longer on each side  */
+      for (x = 0; x < pass->dst_width; x++)
+        out[x] = MAX (h[x], g[x + 2 * radius_x]);
+    }
+
+  g_free (h);
+  g_free (g);
+}
+
+static void
+dilate_columns_func (gsize    offset,
+                     gsize    size,
+                     gpointer data)
+{
+  DilatePass *pass     = data;
+  gint        width    = pass->dst_width;
+  gint        radius_y = pass->radius_y;
+  gint        n        = pass->dst_height + 2 * radius_y;
+  gfloat     *column   = g_new (gfloat, n);
+  gfloat     *g        = g_new (gfloat, n);
+  gfloat     *h        = g_new (gfloat, n);
+  gsize       x;
+
+  for (x = offset; x < offset + size; x++)
+    {
+      gint y;
+
+      /*  the rows radius_y above and below the band's output, which
+       *  the band left out when they are outside the area
+       */
+      for (y = 0; y < n; y++)
+        {
+          gint row = y + pass->dst_offset - radius_y;
+
+          if (row >= 0 && row < pass->src_height)
+            column[y] = pass->row_max[row * width + x];
+          else
+            column[y] = pass->pad;
+        }
+
+      running_max_blocks (column, n, 2 * radius_y + 1, g, h);
+
+      for (y = 0; y < pass->dst_height; y++)
+        pass->dst[y * width + x] = MAX (h[y], g[y + 2 * radius_y]);
+    }
+
+  g_free (h);
+  g_free (g);
+  g_free (column);
+}
@@ -0,0 +1,51 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpdistancetransform.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_DISTANCE_TRANSFORM_H__
+#define __GIMP_DISTANCE_TRANSFORM_H__
+
+
+/*  the initial value of pixels that are not sources, and a lower bound
+ *  of the resulting squared distance when there are no sources at all
+ */
+#define GIMP_DISTANCE_TRANSFORM_FAR 1e20f
+
+
+void   gimp_distance_transform         (gfloat              *dist,
+                                        gint                 width,
+                                        gint                 height,
+                                        gdouble              aspect,
+                                        gboolean             outside_is_source);
+
+void   gimp_distance_transform_squares (gfloat              *dist,
+                                        gint                 width,
+                                        gint                 height,
+                                        gdouble              aspect,
+                                        gdouble              threshold);
+
+void   gimp_distance_transform_dilate  (GeglBuffer          *input,
+                                        GeglBuffer          *output,
+                                        const GeglRectangle *roi,
+                                        gint                 radius_x,
+                                        gint                 radius_y,
+                                        gboolean             invert,
+                                        gboolean             outside_is_source);
+
+
+#endif /* __GIMP_DISTANCE_TRANSFORM_H__ */
@@ -0,0 +1,375 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimplayermodes-avx2.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#ifdef USE_AVX2
+
+#include <immintrin.h>
+
+#include <gegl-plugin.h>
+
+#include "operations-types.h"
+
+#include "gimplayermodes-simd.h"
+
+
+/*  Like gimplayermodes-sse2.c, but each register holds two RGBA float
+ *  pixels, one per 128 bit lane. A trailing odd pixel goes through the
+ *  same code with masked loads and stores.
+ */
+
+typedef __m256 (* CompositeFunc) (__m256 in,
+                                  __m256 layer);
+
+
+static inline __m256
+splat_alpha (__m256 v)
+{
+  return _mm256_permute_ps (v, _MM_SHUFFLE (3, 3, 3, 3));
+}
+
+/*  rcpps plus one Newton-Raphson step, close to a full division  */
+static inline __m256
+reciprocal (__m256 x)
+{
+  __m256 r = _mm256_rcp_ps (x);
+
+  return _mm256_sub_ps (_mm256_add_ps (r, r),
+                        _mm256_mul_ps (_mm256_mul_ps (x, r), r));
+}
+
+static inline __m256
+alpha_lanes (void)
+{
+  return _mm256_castsi256_ps (_mm256_set_epi32 (-1, 0, 0, 0,
+                                                -1, 0, 0, 0));
+}
+
+static inline __m256i
+first_pixel (void)
+{
+  return _mm256_set_epi32 (0, 0, 0, 0, -1, -1, -1, -1);
+}
+
+static inline __m256
+load_mask (const gfloat *mask,
+           gboolean      two_pixels)
+{
+  __m128 lo = _mm_set1_ps (mask[0]);
+  __m128 hi = two_pixels ? _mm_set1_ps (mask[1]) : lo;
+
+  return _mm256_insertf128_ps (_mm256_castps128_ps256 (lo), hi, 1);
+}
+
+
+/*  normal mode  */
+
+static inline __m256
+normal_2 (__m256 v_in,
+          __m256 v_layer,
+          __m256 v_opacity)
+{
+  const __m256 one      = _mm256_set1_ps (1.0f);
+  __m256       in_alpha = splat_alpha (v_in);
+  __m256       aux_alpha;
+  __m256       out_alpha;
+  __m256       in_weight;
+  __m256       valid;
+  __m256       v_out;
+
+  aux_alpha = _mm256_mul_ps (splat_alpha (v_layer), v_opacity);
+  out_alpha = _mm256_sub_ps (_mm256_add_ps (aux_alpha, in_alpha),
+                             _mm256_mul_ps (aux_alpha, in_alpha));
+  in_weight = _mm256_mul_ps (in_alpha, _mm256_sub_ps (one, aux_alpha));
+  valid     = _mm256_cmp_ps (out_alpha, _mm256_setzero_ps (), _CMP_NEQ_UQ);
+
+  v_out = _mm256_add_ps (_mm256_mul_ps (v_layer, aux_alpha),
+                         _mm256_mul_ps (v_in, in_weight));
+  v_out = _mm256_mul_ps (v_out,
+                         _mm256_and_ps (valid, reciprocal (out_alpha)));
+
+  v_out = _mm256_blendv_ps (v_in, v_out, valid);
+
+  return _mm256_blendv_ps (v_out, out_alpha, alpha_lanes ());
+}
+
+static inline void
+normal_pixels (const gfloat   *in,
+               const gfloat   *layer,
+               const gfloat   *mask,
+               gfloat         *out,
+               gfloat          opacity,
+               glong           samples,
+               const gboolean  has_mask)
+{
+  const __m256 v_opacity = _mm256_set1_ps (opacity);
+
+  for (; samples >= 2; samples -= 2)
+    {
+      __m256 v_op = v_opacity;
+
+      if (has_mask)
+        {
+          v_op = _mm256_mul_ps (v_op, load_mask (mask, TRUE));
+          mask += 2;
+        }
+
+      _mm256_storeu_ps (out, normal_2 (_mm256_loadu_ps (in),
+                                       _mm256_loadu_ps (layer),
+                                       v_op));
+
+      in    += 8;
+      layer += 8;
+      out   += 8;
+    }
+
+  if (samples)
+    {
+      const __m256i first = first_pixel ();
+      __m256        v_op  = v_opacity;
+
+      if (has_mask)
+        v_op = _mm256_mul_ps (v_op, load_mask (mask, FALSE));
+
+      _mm256_maskstore_ps (out, first,
+                           normal_2 (_mm256_maskload_ps (in, first),
+                                     _mm256_maskload_ps (layer, first),
+                                     v_op));
+    }
+}
+
+static gboolean
+normal_mode_avx2 (gfloat *in,
+                  gfloat *layer,
+                  gfloat *mask,
+                  gfloat *out,
+                  gfloat  opacity,
+                  glong   samples)
+{
+  if (mask)
+    normal_pixels (in, layer, mask, out, opacity, samples, TRUE);
+  else
+    normal_pixels (in, layer, NULL, out, opacity, samples, FALSE);
+
+  return TRUE;
+}
+
+
+/*  the modes that composite over the input and keep its alpha  */
+
+static inline __m256
+composite_2 (__m256        v_in,
+             __m256        v_layer,
+             __m256        v_opacity,
+             CompositeFunc composite)
+{
+  const __m256 one      = _mm256_set1_ps (1.0f);
+  const __m256 zero     = _mm256_setzero_ps ();
+  __m256       in_alpha = splat_alpha (v_in);
+  __m256       comp_alpha;
+  __m256       new_alpha;
+  __m256       ratio;
+  __m256       v_out;
+
+  comp_alpha = _mm256_mul_ps (_mm256_min_ps (in_alpha, splat_alpha (v_layer)),
+                              v_opacity);
+  new_alpha  = _mm256_add_ps (in_alpha,
+                              _mm256_mul_ps (_mm256_sub_ps (one, in_alpha),
+                                             comp_alpha));
+
+  /*  a zero ratio leaves the input untouched, like the generic
+   *  code's "if (comp_alpha && new_alpha)"
+   */
+  ratio = _mm256_mul_ps (comp_alpha, reciprocal (new_alpha));
+  ratio = _mm256_and_ps (ratio,
+                         _mm256_and_ps (_mm256_cmp_ps (comp_alpha, zero,
+                                                       _CMP_NEQ_UQ),
+                                        _mm256_cmp_ps (new_alpha, zero,
+                                                       _CMP_NEQ_UQ)));
+
+  v_out = _mm256_add_ps (_mm256_mul_ps (composite (v_in, v_layer), ratio),
+                         _mm256_mul_ps (v_in, _mm256_sub_ps (one, ratio)));
+
+  return _mm256_blendv_ps (v_out, v_in, alpha_lanes ());
+}
+
+static inline void
+composite_pixels (const gfloat   *in,
+                  const gfloat   *layer,
+                  const gfloat   *mask,
+                  gfloat         *out,
+                  gfloat          opacity,
+                  glong           samples,
+                  CompositeFunc   composite,
+                  const gboolean  has_mask)
+{
+  const __m256 v_opacity = _mm256_set1_ps (opacity);
+
+  for (; samples >= 2; samples -= 2)
+    {
+      __m256 v_op = v_opacity;
+
+      if (has_mask)
+        {
+          v_op = _mm256_mul_ps (v_op, load_mask (mask, TRUE));
+          mask += 2;
+        }
+
+      _mm256_storeu_ps (out, composite_2 (_mm256_loadu_ps (in),
+                                          _mm256_loadu_ps (layer),
+                                          v_op, composite));
+
+      in    += 8;
+      layer += 8;
+      out   += 8;
+    }
+
+  if (samples)
+    {
+      const __m256i first = first_pixel ();
+      __m256        v_op  = v_opacity;
+
+      if (has_mask)
+        v_op = _mm256_mul_ps (v_op, load_mask (mask, FALSE));
+
+      _mm256_maskstore_ps (out, first,
+                           composite_2 (_mm256_maskload_ps (in, first),
+                                        _mm256_maskload_ps (layer, first),
+                                        v_op, composite));
+    }
+}
+
+static inline __m256
+multiply (__m256 in,
+          __m256 layer)
+{
+  __m256 comp = _mm256_mul_ps (layer, in);
+
+  return _mm256_min_ps (_mm256_max_ps (comp, _mm256_setzero_ps ()),
+                        _mm256_set1_ps (1.0f));
+}
+
+static inline __m256
+screen (__m256 in,
+        __m256 layer)
+{
+  const __m256 one = _mm256_set1_ps (1.0f);
+
+  return _mm256_sub_ps (one, _mm256_mul_ps (_mm256_sub_ps (one, in),
+                                            _mm256_sub_ps (one, layer)));
+}
+
+static inline __m256
+overlay (__m256 in,
+         __m256 layer)
+{
+  const __m256 one       = _mm256_set1_ps (1.0f);
+  __m256       two_layer = _mm256_add_ps (layer, layer);
+
+  return _mm256_mul_ps (in,
+                        _mm256_add_ps (in,
+                                       _mm256_mul_ps (two_layer,
+                                                      _mm256_sub_ps (one, in))));
+}
+
+static inline __m256
+difference (__m256 in,
+            __m256 layer)
+{
+  return _mm256_andnot_ps (_mm256_set1_ps (-0.0f), _mm256_sub_ps (in, layer));
+}
+
+static inline __m256
+addition (__m256 in,
+          __m256 layer)
+{
+  __m256 comp = _mm256_add_ps (in, layer);
+
+  return _mm256_min_ps (_mm256_max_ps (comp, _mm256_setzero_ps ()),
+                        _mm256_set1_ps (1.0f));
+}
+
+static inline __m256
+subtract (__m256 in,
+          __m256 layer)
+{
+  return _mm256_max_ps (_mm256_sub_ps (in, layer), _mm256_setzero_ps ());
+}
+
+static inline __m256
+darken_only (__m256 in,
+             __m256 layer)
+{
+  return _mm256_min_ps (in, layer);
+}
+
+static inline __m256
+lighten_only (__m256 in,
+              __m256 layer)
+{
+  return _mm256_max_ps (layer, in);
+}
+
+/*  instantiate separate masked and unmasked loops for each mode  */
+#define COMPOSITE_MODE(name)                                            \
+static gboolean                                                         \
+name##_mode_avx2 (gfloat *in,                                           \
+                  gfloat *layer,                                        \
+                  gfloat *mask,                                         \
+                  gfloat *out,                                          \
+                  gfloat  opacity,                                      \
+                  glong   samples)                                      \
+{                                                                       \
+  if (mask)                                                             \
+    composite_pixels (in, layer, mask, out, opacity, samples,           \
+                      name, TRUE);                                      \
+  else                                                                  \
+    composite_pixels (in, layer, NULL, out, opacity, samples,           \
+                      name, FALSE);                                     \
+                                                                        \
+  return TRUE;                                                          \
+}
+
+COMPOSITE_MODE (multiply)
+COMPOSITE_MODE (screen)
+COMPOSITE_MODE (overlay)
+COMPOSITE_MODE (difference)
+COMPOSITE_MODE (addition)
+COMPOSITE_MODE (subtract)
+COMPOSITE_MODE (darken_only)
+COMPOSITE_MODE (lighten_only)
+
+#undef COMPOSITE_MODE
+
+
+const GimpLayerModeFunc gimp_layer_mode_funcs_avx2[GIMP_LAYER_MODE_SIMD_N_MODES] =
+{
+  normal_mode_avx2,
+  multiply_mode_avx2,
+  screen_mode_avx2,
+  overlay_mode_avx2,
+  difference_mode_avx2,
+  addition_mode_avx2,
+  subtract_mode_avx2,
+  darken_only_mode_avx2,
+  lighten_only_mode_avx2
+};
+
+#endif /* USE_AVX2 */
@@ -0,0 +1,62 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimplayermodes-simd.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl-plugin.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "operations-types.h"
+
+#include "gimplayermodes-simd.h"
+
+
+/**
+ * gimp_layer_mode_simd_get_func:
+ * @mode:         the layer mode
+ * @generic_func: the scalar pixel function of @mode
+ *
+ * Picks the fastest pixel function for @mode that the CPU supports,
+ * as reported by gimp_cpu_accel_get_support().
+ *
+ * Return value: the vectorized pixel function, or @generic_func.
+ **/
+GimpLayerModeFunc
+gimp_layer_mode_simd_get_func (GimpLayerModeSimd mode,
+                               GimpLayerModeFunc generic_func)
+{
+#if defined (USE_SSE2) || defined (USE_AVX2)
+  GimpCpuAccelFlags accel = gimp_cpu_accel_get_support ();
+#endif
+
+  g_return_val_if_fail (mode < GIMP_LAYER_MODE_SIMD_N_MODES, generic_func);
+
+#ifdef USE_AVX2
+  if ((accel & GIMP_CPU_ACCEL_X86_AVX2) && gimp_layer_mode_funcs_avx2[mode])
+    return gimp_layer_mode_funcs_avx2[mode];
+#endif
+
+#ifdef USE_SSE2
+  if ((accel & GIMP_CPU_ACCEL_X86_SSE2) && gimp_layer_mode_funcs_sse2[mode])
+    return gimp_layer_mode_funcs_sse2[mode];
+#endif
+
+  return generic_func;
+}
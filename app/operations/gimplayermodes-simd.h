@@ -0,0 +1,58 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimplayermodes-simd.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_LAYER_MODES_SIMD_H__
+#define __GIMP_LAYER_MODES_SIMD_H__
+
+
+#include "gimpoperationpointlayermode.h"
+
+
+typedef enum
+{
+  GIMP_LAYER_MODE_SIMD_NORMAL,
+  GIMP_LAYER_MODE_SIMD_MULTIPLY,
+  GIMP_LAYER_MODE_SIMD_SCREEN,
+  GIMP_LAYER_MODE_SIMD_OVERLAY,
+  GIMP_LAYER_MODE_SIMD_DIFFERENCE,
+  GIMP_LAYER_MODE_SIMD_ADDITION,
+  GIMP_LAYER_MODE_SIMD_SUBTRACT,
+  GIMP_LAYER_MODE_SIMD_DARKEN_ONLY,
+  GIMP_LAYER_MODE_SIMD_LIGHTEN_ONLY,
+
+  GIMP_LAYER_MODE_SIMD_N_MODES
+} GimpLayerModeSimd;
+
+
+/*  the vectorized pixel functions, indexed by GimpLayerModeSimd, each
+ *  only exists if the compiler supports the instruction set
+ */
+#ifdef USE_SSE2
+extern const GimpLayerModeFunc gimp_layer_mode_funcs_sse2[GIMP_LAYER_MODE_SIMD_N_MODES];
+#endif
+#ifdef USE_AVX2
+extern const GimpLayerModeFunc gimp_layer_mode_funcs_avx2[GIMP_LAYER_MODE_SIMD_N_MODES];
+#endif
+
+
+GimpLayerModeFunc   gimp_layer_mode_simd_get_func (GimpLayerModeSimd  mode,
+                                                   GimpLayerModeFunc  generic_func);
+
+
+#endif /* __GIMP_LAYER_MODES_SIMD_H__ */
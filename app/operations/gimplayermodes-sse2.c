@@ -0,0 +1,311 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimplayermodes-sse2.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#ifdef USE_SSE2
+
+#include <emmintrin.h>
+
+#include <gegl-plugin.h>
+
+#include "operations-types.h"
+
+#include "gimplayermodes-simd.h"
+
+
+/*  One RGBA float pixel fills one register, so every per-pixel
+ *  quantity below is splatted over all four lanes and the alpha lane
+ *  is fixed up at the end. The generic functions in the mode files are
+ *  the reference for the results.
+ */
+
+typedef __m128 (* CompositeFunc) (__m128 in,
+                                  __m128 layer);
+
+
+static inline __m128
+splat_alpha (__m128 v)
+{
+  return _mm_shuffle_ps (v, v, _MM_SHUFFLE (3, 3, 3, 3));
+}
+
+/*  mask ? a : b  */
+static inline __m128
+select_ps (__m128 mask,
+           __m128 a,
+           __m128 b)
+{
+  return _mm_or_ps (_mm_and_ps (mask, a), _mm_andnot_ps (mask, b));
+}
+
+/*  rcpps plus one Newton-Raphson step, close to a full division  */
+static inline __m128
+reciprocal (__m128 x)
+{
+  __m128 r = _mm_rcp_ps (x);
+
+  return _mm_sub_ps (_mm_add_ps (r, r), _mm_mul_ps (_mm_mul_ps (x, r), r));
+}
+
+static inline __m128
+alpha_lane (void)
+{
+  return _mm_castsi128_ps (_mm_set_epi32 (-1, 0, 0, 0));
+}
+
+
+/*  normal mode  */
+
+static inline void
+normal_pixels (const gfloat   *in,
+               const gfloat   *layer,
+               const gfloat   *mask,
+               gfloat         *out,
+               gfloat          opacity,
+               glong           samples,
+               const gboolean  has_mask)
+{
+  const __m128 v_opacity = _mm_set1_ps (opacity);
+  const __m128 one       = _mm_set1_ps (1.0f);
+  const __m128 zero      = _mm_setzero_ps ();
+  const __m128 alpha     = alpha_lane ();
+
+  while (samples--)
+    {
+      __m128 v_in      = _mm_loadu_ps (in);
+      __m128 v_layer   = _mm_loadu_ps (layer);
+      __m128 in_alpha  = splat_alpha (v_in);
+      __m128 aux_alpha = _mm_mul_ps (splat_alpha (v_layer), v_opacity);
+      __m128 out_alpha;
+      __m128 in_weight;
+      __m128 valid;
+      __m128 v_out;
+
+      if (has_mask)
+        aux_alpha = _mm_mul_ps (aux_alpha, _mm_set1_ps (*mask++));
+
+      out_alpha = _mm_sub_ps (_mm_add_ps (aux_alpha, in_alpha),
+                              _mm_mul_ps (aux_alpha, in_alpha));
+      in_weight = _mm_mul_ps (in_alpha, _mm_sub_ps (one, aux_alpha));
+      valid     = _mm_cmpneq_ps (out_alpha, zero);
+
+      v_out = _mm_add_ps (_mm_mul_ps (v_layer, aux_alpha),
+                          _mm_mul_ps (v_in, in_weight));
+      v_out = _mm_mul_ps (v_out,
+                          _mm_and_ps (valid, reciprocal (out_alpha)));
+
+      v_out = select_ps (valid, v_out, v_in);
+      v_out = select_ps (alpha, out_alpha, v_out);
+
+      _mm_storeu_ps (out, v_out);
+
+      in    += 4;
+      layer += 4;
+      out   += 4;
+    }
+}
+
+static gboolean
+normal_mode_sse2 (gfloat *in,
+                  gfloat *layer,
+                  gfloat *mask,
+                  gfloat *out,
+                  gfloat  opacity,
+                  glong   samples)
+{
+  if (mask)
+    normal_pixels (in, layer, mask, out, opacity, samples, TRUE);
+  else
+    normal_pixels (in, layer, NULL, out, opacity, samples, FALSE);
+
+  return TRUE;
+}
+
+
+/*  the modes that composite over the input and keep its alpha  */
+
+static inline void
+composite_pixels (const gfloat   *in,
+                  const gfloat   *layer,
+                  const gfloat   *mask,
+                  gfloat         *out,
+                  gfloat          opacity,
+                  glong           samples,
+                  CompositeFunc   composite,
+                  const gboolean  has_mask)
+{
+  const __m128 v_opacity = _mm_set1_ps (opacity);
+  const __m128 one       = _mm_set1_ps (1.0f);
+  const __m128 zero      = _mm_setzero_ps ();
+  const __m128 alpha     = alpha_lane ();
+
+  while (samples--)
+    {
+      __m128 v_in     = _mm_loadu_ps (in);
+      __m128 v_layer  = _mm_loadu_ps (layer);
+      __m128 in_alpha = splat_alpha (v_in);
+      __m128 comp_alpha;
+      __m128 new_alpha;
+      __m128 ratio;
+      __m128 v_out;
+
+      comp_alpha = _mm_mul_ps (_mm_min_ps (in_alpha, splat_alpha (v_layer)),
+                               v_opacity);
+      if (has_mask)
+        comp_alpha = _mm_mul_ps (comp_alpha, _mm_set1_ps (*mask++));
+
+      new_alpha = _mm_add_ps (in_alpha,
+                              _mm_mul_ps (_mm_sub_ps (one, in_alpha),
+                                          comp_alpha));
+
+      /*  a zero ratio leaves the input untouched, like the generic
+       *  code's "if (comp_alpha && new_alpha)"
+       */
+      ratio = _mm_mul_ps (comp_alpha, reciprocal (new_alpha));
+      ratio = _mm_and_ps (ratio,
+                          _mm_and_ps (_mm_cmpneq_ps (comp_alpha, zero),
+                                      _mm_cmpneq_ps (new_alpha, zero)));
+
+      v_out = _mm_add_ps (_mm_mul_ps (composite (v_in, v_layer), ratio),
+                          _mm_mul_ps (v_in, _mm_sub_ps (one, ratio)));
+
+      v_out = select_ps (alpha, v_in, v_out);
+
+      _mm_storeu_ps (out, v_out);
+
+      in    += 4;
+      layer += 4;
+      out   += 4;
+    }
+}
+
+static inline __m128
+multiply (__m128 in,
+          __m128 layer)
+{
+  __m128 comp = _mm_mul_ps (layer, in);
+
+  return _mm_min_ps (_mm_max_ps (comp, _mm_setzero_ps ()), _mm_set1_ps (1.0f));
+}
+
+static inline __m128
+screen (__m128 in,
+        __m128 layer)
+{
+  const __m128 one = _mm_set1_ps (1.0f);
+
+  return _mm_sub_ps (one, _mm_mul_ps (_mm_sub_ps (one, in),
+                                      _mm_sub_ps (one, layer)));
+}
+
+static inline __m128
+overlay (__m128 in,
+         __m128 layer)
+{
+  const __m128 one = _mm_set1_ps (1.0f);
+  __m128       two_layer = _mm_add_ps (layer, layer);
+
+  return _mm_mul_ps (in, _mm_add_ps (in, _mm_mul_ps (two_layer,
+                                                     _mm_sub_ps (one, in))));
+}
+
+static inline __m128
+difference (__m128 in,
+            __m128 layer)
+{
+  return _mm_andnot_ps (_mm_set1_ps (-0.0f), _mm_sub_ps (in, layer));
+}
+
+static inline __m128
+addition (__m128 in,
+          __m128 layer)
+{
+  __m128 comp = _mm_add_ps (in, layer);
+
+  return _mm_min_ps (_mm_max_ps (comp, _mm_setzero_ps ()), _mm_set1_ps (1.0f));
+}
+
+static inline __m128
+subtract (__m128 in,
+          __m128 layer)
+{
+  return _mm_max_ps (_mm_sub_ps (in, layer), _mm_setzero_ps ());
+}
+
+static inline __m128
+darken_only (__m128 in,
+             __m128 layer)
+{
+  return _mm_min_ps (in, layer);
+}
+
+static inline __m128
+lighten_only (__m128 in,
+              __m128 layer)
+{
+  return _mm_max_ps (layer, in);
+}
+
+/*  instantiate separate masked and unmasked loops for each mode  */
+#define COMPOSITE_MODE(name)                                            \
+static gboolean                                                         \
+name##_mode_sse2 (gfloat *in,                                           \
+                  gfloat *layer,                                        \
+                  gfloat *mask,                                         \
+                  gfloat *out,                                          \
+                  gfloat  opacity,                                      \
+                  glong   samples)                                      \
+{                                                                       \
+  if (mask)                                                             \
+    composite_pixels (in, layer, mask, out, opacity, samples,           \
+                      name, TRUE);                                      \
+  else                                                                  \
+    composite_pixels (in, layer, NULL, out, opacity, samples,           \
+                      name, FALSE);                                     \
+                                                                        \
+  return TRUE;                                                          \
+}
+
+COMPOSITE_MODE (multiply)
+COMPOSITE_MODE (screen)
+COMPOSITE_MODE (overlay)
+COMPOSITE_MODE (difference)
+COMPOSITE_MODE (addition)
+COMPOSITE_MODE (subtract)
+COMPOSITE_MODE (darken_only)
+COMPOSITE_MODE (lighten_only)
+
+#undef COMPOSITE_MODE
+
+
+const GimpLayerModeFunc gimp_layer_mode_funcs_sse2[GIMP_LAYER_MODE_SIMD_N_MODES] =
+{
+  normal_mode_sse2,
+  multiply_mode_sse2,
+  screen_mode_sse2,
+  overlay_mode_sse2,
+  difference_mode_sse2,
+  addition_mode_sse2,
+  subtract_mode_sse2,
+  darken_only_mode_sse2,
+  lighten_only_mode_sse2
+};
+
+#endif /* USE_SSE2 */
@@ -40,6 +40,7 @@
 #include "gimpcurvesconfig.h"
 #include "gimplevelsconfig.h"
 #include "gimpoperationlevels.h"
+#include "gimppointlut.h"
 
 #include "gimp-intl.h"
 
@@ -58,6 +59,9 @@ enum
 
 static void     gimp_levels_config_iface_init   (GimpConfigInterface *iface);
 
+static void     gimp_levels_config_finalize     (GObject          *object);
+static void     gimp_levels_config_notify       (GObject          *object,
+                                                 GParamSpec       *pspec);
 static void     gimp_levels_config_get_property (GObject          *object,
                                                  guint             property_id,
                                                  GValue           *value,
@@ -89,6 +93,8 @@ G_DEFINE_TYPE_WITH_CODE (GimpLevelsConfig, gimp_levels_config,
 
 #define parent_class gimp_levels_config_parent_class
 
+G_LOCK_DEFINE_STATIC (levels_lut);
+
 
 static void
 gimp_levels_config_class_init (GimpLevelsConfigClass *klass)
@@ -96,6 +102,8 @@ gimp_levels_config_class_init (GimpLevelsConfigClass *klass)
   GObjectClass      *object_class   = G_OBJECT_CLASS (klass);
   GimpViewableClass *viewable_class = GIMP_VIEWABLE_CLASS (klass);
 
+  object_class->finalize           = gimp_levels_config_finalize;
+  object_class->notify             = gimp_levels_config_notify;
   object_class->set_property       = gimp_levels_config_set_property;
   object_class->get_property       = gimp_levels_config_get_property;
 
@@ -149,6 +157,57 @@ gimp_levels_config_init (GimpLevelsConfig *self)
   gimp_config_reset (GIMP_CONFIG (self));
 }
 
+static void
+gimp_levels_config_finalize (GObject *object)
+{
+  GimpLevelsConfig *self = GIMP_LEVELS_CONFIG (object);
+
+  if (self->lut_u8)
+    {
+      gimp_point_lut_unref (self->lut_u8);
+      self->lut_u8 = NULL;
+    }
+
+  if (self->lut_u16)
+    {
+      gimp_point_lut_unref (self->lut_u16);
+      self->lut_u16 = NULL;
+    }
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gimp_levels_config_notify (GObject    *object,
+                           GParamSpec *pspec)
+{
+  GimpLevelsConfig *self = GIMP_LEVELS_CONFIG (object);
+
+  if (strcmp (pspec->name, "channel"))
+    {
+      GimpPointLut *lut_u8;
+      GimpPointLut *lut_u16;
+
+      G_LOCK (levels_lut);
+
+      lut_u8        = self->lut_u8;
+      lut_u16       = self->lut_u16;
+      self->lut_u8  = NULL;
+      self->lut_u16 = NULL;
+
+      G_UNLOCK (levels_lut);
+
+      if (lut_u8)
+        gimp_point_lut_unref (lut_u8);
+
+      if (lut_u16)
+        gimp_point_lut_unref (lut_u16);
+    }
+
+  if (G_OBJECT_CLASS (parent_class)->notify)
+    G_OBJECT_CLASS (parent_class)->notify (object, pspec);
+}
+
 static void
 gimp_levels_config_get_property (GObject    *object,
                                  guint       property_id,
@@ -594,6 +653,48 @@ gimp_levels_config_adjust_by_colors (GimpLevelsConfig     *config,
   g_object_thaw_notify (G_OBJECT (config));
 }
 
+/**
+ * gimp_levels_config_get_lut:
+ * @config: a #GimpLevelsConfig
+ * @format: "R'G'B'A u8" or "R'G'B'A u16"
+ *
+ * Returns a lookup table for @format that applies the levels of each
+ * channel, followed by the value levels. The table is built on first
+ * use after the levels change, and shared until they change again.
+ *
+ * Returns: a reference to the lookup table, release it with
+ *          gimp_point_lut_unref().
+ **/
+GimpPointLut *
+gimp_levels_config_get_lut (GimpLevelsConfig *config,
+                            const Babl       *format)
+{
+  GimpPointLut **lut;
+  GimpPointLut  *result;
+
+  g_return_val_if_fail (GIMP_IS_LEVELS_CONFIG (config), NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+
+  G_LOCK (levels_lut);
+
+  if (babl_format_get_type (format, 0) == babl_type ("u8"))
+    lut = &config->lut_u8;
+  else
+    lut = &config->lut_u16;
+
+  if (! *lut)
+    *lut = gimp_point_lut_new (format,
+                               (GimpPointLutFunc)
+                               gimp_operation_levels_map_channel,
+                               config);
+
+  result = *lut ? gimp_point_lut_ref (*lut) : NULL;
+
+  G_UNLOCK (levels_lut);
+
+  return result;
+}
+
 GimpCurvesConfig *
 gimp_levels_config_to_curves_config (GimpLevelsConfig *config)
 {
@@ -48,6 +48,10 @@ struct _GimpLevelsConfig
 
   gdouble               low_output[5];
   gdouble               high_output[5];
+
+  /*  fused lookup tables for 8 and 16 bit pixels  */
+  GimpPointLut         *lut_u8;
+  GimpPointLut         *lut_u16;
 };
 
 struct _GimpLevelsConfigClass
@@ -72,6 +76,10 @@ void       gimp_levels_config_adjust_by_colors (GimpLevelsConfig      *config,
                                                 const GimpRGB         *gray,
                                                 const GimpRGB         *white);
 
+GimpPointLut *
+           gimp_levels_config_get_lut          (GimpLevelsConfig      *config,
+                                                const Babl            *format);
+
 GimpCurvesConfig *
            gimp_levels_config_to_curves_config (GimpLevelsConfig      *config);
 
@@ -29,6 +29,7 @@
 
 #include "operations-types.h"
 
+#include "gimpdistancetransform.h"
 #include "gimpoperationborder.h"
 
 
@@ -199,8 +200,8 @@ gimp_operation_border_set_property (GObject      *object,
 static void
 gimp_operation_border_prepare (GeglOperation *operation)
 {
-  gegl_operation_set_format (operation, "input",  babl_format ("Y u8"));
-  gegl_operation_set_format (operation, "output", babl_format ("Y u8"));
+  gegl_operation_set_format (operation, "input",  babl_format ("Y float"));
+  gegl_operation_set_format (operation, "output", babl_format ("Y float"));
 }
 
 static GeglRectangle
@@ -218,112 +219,56 @@ gimp_operation_border_get_cached_region (GeglOperation       *self,
   return *gegl_operation_source_get_bounding_box (self, "input");
 }
 
-static inline void
-rotate_pointers (guchar  **p,
-                 guint32   n)
+static inline gboolean
+is_selected (const gfloat *src,
+             gint          width,
+             gint          height,
+             gint          x,
+             gint          y,
+             gboolean      edge_lock)
 {
-  guint32  i;
-  guchar  *tmp;
-
-  tmp = p[0];
-
-  for (i = 0; i < n - 1; i++)
-    p[i] = p[i + 1];
+  /* With edge_lock, pixels outside of the canvas are considered
+   * selected, otherwise they are considered unselected.
+   */
+  if (x < 0 || x >= width || y < 0 || y >= height)
+    return edge_lock;
 
-  p[i] = tmp;
+  return src[y * width + x] >= 0.5f;
 }
 
-/* Computes whether pixels in `buf[1]', if they are selected, have neighbouring
-   pixels that are unselected. Put result in `transition'. */
+/* Computes whether pixels, if they are selected, have neighbouring
+   pixels that are unselected.  Transitional pixels are the sources of
+   the distance transform, so they are 0.0 in `dist', and all other
+   pixels are GIMP_DISTANCE_TRANSFORM_FAR. */
 static void
-compute_transition (guchar    *transition,
-                    guchar   **buf,
-                    gint32     width,
-                    gboolean   edge_lock)
+compute_transition (gfloat       *dist,
+                    const gfloat *src,
+                    gint          width,
+                    gint          height,
+                    gboolean      edge_lock)
 {
-  register gint32 x = 0;
+  gint x, y;
 
-  if (width == 1)
+  for (y = 0; y < height; y++)
     {
-      if (buf[1][0] > 127 && (buf[0][0] < 128 || buf[2][0] < 128))
-        transition[0] = 255;
-      else
-        transition[0] = 0;
-      return;
-    }
-
-  if (buf[1][0] > 127 && edge_lock)
-    {
-      /* The pixel to the left (outside of the canvas) is considered selected,
-         so we check if there are any unselected pixels in neighbouring pixels
-         _on_ the canvas. */
-      if (buf[0][x] < 128 || buf[0][x + 1] < 128 ||
-                             buf[1][x + 1] < 128 ||
-          buf[2][x] < 128 || buf[2][x + 1] < 128 )
-        {
-          transition[x] = 255;
-        }
-      else
+      for (x = 0; x < width; x++)
         {
-          transition[x] = 0;
-        }
-    }
-  else if (buf[1][0] > 127 && !edge_lock)
-    {
-      /* We must not care about neighbouring pixels on the image canvas since
-         there always are unselected pixels to the left (which is outside of
-         the image canvas). */
-      transition[x] = 255;
-    }
-  else
-    {
-      transition[x] = 0;
-    }
+          gboolean transition = FALSE;
 
-  for (x = 1; x < width - 1; x++)
-    {
-      if (buf[1][x] >= 128)
-        {
-          if (buf[0][x - 1] < 128 || buf[0][x] < 128 || buf[0][x + 1] < 128 ||
-              buf[1][x - 1] < 128 ||                    buf[1][x + 1] < 128 ||
-              buf[2][x - 1] < 128 || buf[2][x] < 128 || buf[2][x + 1] < 128)
-            transition[x] = 255;
-          else
-            transition[x] = 0;
-        }
-      else
-        {
-          transition[x] = 0;
-        }
-    }
+          if (src[y * width + x] >= 0.5f)
+            {
+              gint i, j;
 
-  if (buf[1][width - 1] >= 128 && edge_lock)
-    {
-      /* The pixel to the right (outside of the canvas) is considered selected,
-         so we check if there are any unselected pixels in neighbouring pixels
-         _on_ the canvas. */
-      if ( buf[0][x - 1] < 128 || buf[0][x] < 128 ||
-           buf[1][x - 1] < 128 ||
-           buf[2][x - 1] < 128 || buf[2][x] < 128)
-        {
-          transition[width - 1] = 255;
-        }
-      else
-        {
-          transition[width - 1] = 0;
+              for (j = -1; j <= 1 && ! transition; j++)
+                for (i = -1; i <= 1 && ! transition; i++)
+                  if (! is_selected (src, width, height,
+                                     x + i, y + j, edge_lock))
+                    transition = TRUE;
+            }
+
+          dist[y * width + x] = transition ? 0.0f : GIMP_DISTANCE_TRANSFORM_FAR;
         }
     }
-  else if (buf[1][width - 1] >= 128 && !edge_lock)
-    {
-      /* We must not care about neighbouring pixels on the image canvas since
-         there always are unselected pixels to the right (which is outside of
-         the image canvas). */
-      transition[width - 1] = 255;
-    }
-  else
-    {
-      transition[width - 1] = 0;
-    }
 }
 
 static gboolean
@@ -333,388 +278,64 @@ gimp_operation_border_process (GeglOperation       *operation,
                                const GeglRectangle *roi,
                                gint                 level)
 {
-  /* This function has no bugs, but if you imagine some you can blame
-   * them on jaycox@gimp.org
+  /* The border is everything within the ellipse of radii (radius_x,
+   * radius_y) of a transitional pixel, measured to the nearest point of
+   * the pixel.  Without feathering its edge is hard, with feathering it
+   * fades out linearly with the distance.  The distance to the nearest
+   * transitional pixel is computed exactly, in a single pass whatever
+   * the radius.
    */
-  GimpOperationBorder *self          = GIMP_OPERATION_BORDER (operation);
-  const Babl          *input_format  = babl_format ("Y u8");
-  const Babl          *output_format = babl_format ("Y u8");
-
-  gint32 i, j, x, y;
-
-  /* A cache used in the algorithm as it works its way down. `buf[1]' is the
-     current row. Thus, at algorithm initialization, `buf[0]' represents the
-     row 'above' the first row of the region. */
-  guchar  *buf[3];
-
-  /* The resulting selection is calculated row by row, and this buffer holds the
-     output for each individual row, on each iteration. */
-  guchar  *out;
+  GimpOperationBorder *self   = GIMP_OPERATION_BORDER (operation);
+  const Babl          *format = babl_format ("Y float");
+  gint                 n_pixels;
+  gfloat              *src;
+  gfloat              *dist;
+  gint                 i;
 
-  /* Keeps track of transitional pixels (pixels that are selected and have
-     unselected neighbouring pixels). */
-  guchar **transition;
+  n_pixels = roi->width * roi->height;
 
-  /* TODO: Figure out role clearly in algorithm. */
-  gint16  *max;
+  src  = g_new (gfloat, n_pixels);
+  dist = g_new (gfloat, n_pixels);
 
-  /* TODO: Figure out role clearly in algorithm. */
-  guchar **density;
+  gegl_buffer_get (input, roi, 1.0, format, src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-  gint16   last_index;
+  compute_transition (dist, src, roi->width, roi->height, self->edge_lock);
 
-  /* optimize this case specifically */
+  /* optimize this case specifically, the border is the transition */
   if (self->radius_x == 1 && self->radius_y == 1)
     {
-      guchar *transition;
-      guchar *source[3];
-
-      for (i = 0; i < 3; i++)
-        source[i] = g_new (guchar, roi->width);
-
-      transition = g_new (guchar, roi->width);
-
-      /* With `self->edge_lock', initialize row above image as
-       * selected, otherwise, initialize as unselected.
-       */
-      memset (source[0], self->edge_lock ? 255 : 0, roi->width);
-
-      gegl_buffer_get (input,
-                       GEGL_RECTANGLE (roi->x, roi->y + 0,
-                                       roi->width, 1),
-                       1.0, input_format, source[1],
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-      if (roi->height > 1)
-        gegl_buffer_get (input,
-                         GEGL_RECTANGLE (roi->x, roi->y + 1,
-                                         roi->width, 1),
-                         1.0, input_format, source[2],
-                         GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-      else
-        memcpy (source[2], source[1], roi->width);
-
-      compute_transition (transition, source, roi->width, self->edge_lock);
-      gegl_buffer_set (output,
-                       GEGL_RECTANGLE (roi->x, roi->y,
-                                       roi->width, 1),
-                       1.0, output_format, transition,
-                       GEGL_AUTO_ROWSTRIDE);
-
-      for (y = 1; y < roi->height; y++)
-        {
-          rotate_pointers (source, 3);
-
-          if (y + 1 < roi->height)
-            {
-              gegl_buffer_get (input,
-                               GEGL_RECTANGLE (roi->x, roi->y + y + 1,
-                                               roi->width, 1),
-                               1.0, input_format, source[2],
-                               GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-            }
-          else
-            {
-              /* Depending on `self->edge_lock', set the row below the
-               * image as either selected or non-selected.
-               */
-              memset(source[2], self->edge_lock ? 255 : 0, roi->width);
-            }
-
-          compute_transition (transition, source, roi->width, self->edge_lock);
-          gegl_buffer_set (output,
-                           GEGL_RECTANGLE (roi->x, roi->y + y,
-                                           roi->width, 1),
-                           1.0, output_format, transition,
-                           GEGL_AUTO_ROWSTRIDE);
-        }
-
-      for (i = 0; i < 3; i++)
-        g_free (source[i]);
-
-      g_free (transition);
-
-      /* Finnished handling the radius = 1 special case, return here. */
-      return TRUE;
-    }
-
-  max = g_new (gint16, roi->width + 2 * self->radius_x);
-
-  for (i = 0; i < (roi->width + 2 * self->radius_x); i++)
-    max[i] = self->radius_y + 2;
-
-  max += self->radius_x;
-
-  for (i = 0; i < 3; i++)
-    buf[i] = g_new (guchar, roi->width);
-
-  transition = g_new (guchar *, self->radius_y + 1);
-
-  for (i = 0; i < self->radius_y + 1; i++)
-    {
-      transition[i] = g_new (guchar, roi->width + 2 * self->radius_x);
-      memset(transition[i], 0, roi->width + 2 * self->radius_x);
-      transition[i] += self->radius_x;
-    }
-
-  out = g_new (guchar, roi->width);
-
-  density = g_new (guchar *, 2 * self->radius_x + 1);
-  density += self->radius_x;
-
-   /* allocate density[][] */
-  for (x = 0; x < (self->radius_x + 1); x++)
-    {
-      density[ x]  = g_new (guchar, 2 * self->radius_y + 1);
-      density[ x] += self->radius_y;
-      density[-x]  = density[x];
+      for (i = 0; i < n_pixels; i++)
+        src[i] = dist[i] == 0.0f ? 1.0f : 0.0f;
     }
-
-  /* compute density[][] */
-  for (x = 0; x < (self->radius_x + 1); x++)
-    {
-      register gdouble tmpx, tmpy, dist;
-      guchar a;
-
-      if (x > 0)
-        tmpx = x - 0.5;
-      else if (x < 0)
-        tmpx = x + 0.5;
-      else
-        tmpx = 0.0;
-
-      for (y = 0; y < (self->radius_y + 1); y++)
-        {
-          if (y > 0)
-            tmpy = y - 0.5;
-          else if (y < 0)
-            tmpy = y + 0.5;
-          else
-            tmpy = 0.0;
-
-          dist = ((tmpy * tmpy) / (self->radius_y * self->radius_y) +
-                  (tmpx * tmpx) / (self->radius_x * self->radius_x));
-
-          if (dist < 1.0)
-            {
-              if (self->feather)
-                a = 255 * (1.0 - sqrt (dist));
-              else
-                a = 255;
-            }
-          else
-            {
-              a = 0;
-            }
-
-          density[ x][ y] = a;
-          density[ x][-y] = a;
-          density[-x][ y] = a;
-          density[-x][-y] = a;
-        }
-    }
-
-  /* Since the algorithm considerers `buf[0]' to be 'over' the row
-   * currently calculated, we must start with `buf[0]' as non-selected
-   * if there is no `self->edge_lock. If there is an
-   * 'self->edge_lock', initialize the first row to 'selected'. Refer
-   * to bug #350009.
-   */
-  memset (buf[0], self->edge_lock ? 255 : 0, roi->width);
-  gegl_buffer_get (input,
-                   GEGL_RECTANGLE (roi->x, roi->y + 0,
-                                   roi->width, 1),
-                   1.0, input_format, buf[1],
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-  if (roi->height > 1)
-    gegl_buffer_get (input,
-                     GEGL_RECTANGLE (roi->x, roi->y + 1,
-                                     roi->width, 1),
-                     1.0, input_format, buf[2],
-                     GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
   else
-    memcpy (buf[2], buf[1], roi->width);
-
-  compute_transition (transition[1], buf, roi->width, self->edge_lock);
-
-   /* set up top of image */
-  for (y = 1; y < self->radius_y && y + 1 < roi->height; y++)
-    {
-      rotate_pointers (buf, 3);
-      gegl_buffer_get (input,
-                       GEGL_RECTANGLE (roi->x, roi->y + y + 1,
-                                       roi->width, 1),
-                       1.0, input_format, buf[2],
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-      compute_transition (transition[y + 1], buf, roi->width, self->edge_lock);
-    }
-
-  /* set up max[] for top of image */
-  for (x = 0; x < roi->width; x++)
-    {
-      max[x] = -(self->radius_y + 7);
-
-      for (j = 1; j < self->radius_y + 1; j++)
-        if (transition[j][x])
-          {
-            max[x] = j;
-            break;
-          }
-    }
-
-  /* main calculation loop */
-  for (y = 0; y < roi->height; y++)
     {
-      rotate_pointers (buf, 3);
-      rotate_pointers (transition, self->radius_y + 1);
-
-      if (y < roi->height - (self->radius_y + 1))
-        {
-          gegl_buffer_get (input,
-                           GEGL_RECTANGLE (roi->x,
-                                           roi->y + y + self->radius_y + 1,
-                                           roi->width, 1),
-                           1.0, input_format, buf[2],
-                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-          compute_transition (transition[self->radius_y], buf, roi->width, self->edge_lock);
-        }
-      else
-        {
-          if (self->edge_lock)
-            {
-              memcpy (transition[self->radius_y], transition[self->radius_y - 1], roi->width);
-            }
-          else
-            {
-              /* No edge lock, set everything 'below canvas' as seen
-               * from the algorithm as unselected.
-               */
-              memset (buf[2], 0, roi->width);
-              compute_transition (transition[self->radius_y], buf, roi->width, self->edge_lock);
-            }
-        }
+      gdouble aspect = (gdouble) self->radius_y / self->radius_x;
+      gfloat  radius = self->radius_y;
 
-      /* update max array */
-      for (x = 0; x < roi->width; x++)
+      if (self->feather)
         {
-          if (max[x] < 1)
-            {
-              if (max[x] <= -self->radius_y)
-                {
-                  if (transition[self->radius_y][x])
-                    max[x] = self->radius_y;
-                  else
-                    max[x]--;
-                }
-              else
-                {
-                  if (transition[-max[x]][x])
-                    max[x] = -max[x];
-                  else if (transition[-max[x] + 1][x])
-                    max[x] = -max[x] + 1;
-                  else
-                    max[x]--;
-                }
-            }
-          else
-            {
-              max[x]--;
-            }
+          gimp_distance_transform_squares (dist, roi->width, roi->height,
+                                           aspect, 0.0);
 
-          if (max[x] < -self->radius_y - 1)
-            max[x] = -self->radius_y - 1;
+          for (i = 0; i < n_pixels; i++)
+            src[i] = MAX (1.0f - sqrtf (dist[i]) / radius, 0.0f);
         }
-
-      last_index = 1;
-
-       /* render scan line */
-      for (x = 0 ; x < roi->width; x++)
+      else
         {
-          guchar last_max;
-
-          last_index--;
-
-          if (last_index >= 0)
-            {
-              last_max = 0;
-
-              for (i = self->radius_x; i >= 0; i--)
-                if (max[x + i] <= self->radius_y && max[x + i] >= -self->radius_y &&
-                    density[i][max[x+i]] > last_max)
-                  {
-                    last_max = density[i][max[x + i]];
-                    last_index = i;
-                  }
-
-              out[x] = last_max;
-            }
-          else
-            {
-              last_max = 0;
-
-              for (i = self->radius_x; i >= -self->radius_x; i--)
-                if (max[x + i] <= self->radius_y && max[x + i] >= -self->radius_y &&
-                    density[i][max[x + i]] > last_max)
-                  {
-                    last_max = density[i][max[x + i]];
-                    last_index = i;
-                  }
+          gimp_distance_transform_squares (dist, roi->width, roi->height,
+                                           aspect, radius);
 
-              out[x] = last_max;
-            }
-
-          if (last_max == 0)
-            {
-              for (i = x + 1; i < roi->width; i++)
-                {
-                  if (max[i] >= -self->radius_y)
-                    break;
-                }
-
-              if (i - x > self->radius_x)
-                {
-                  for (; x < i - self->radius_x; x++)
-                    out[x] = 0;
-
-                  x--;
-                }
-
-              last_index = self->radius_x;
-            }
+          for (i = 0; i < n_pixels; i++)
+            src[i] = dist[i];
         }
-
-      gegl_buffer_set (output,
-                       GEGL_RECTANGLE (roi->x, roi->y + y,
-                                       roi->width, 1),
-                       1.0, output_format, out,
-                       GEGL_AUTO_ROWSTRIDE);
     }
 
-  g_free (out);
-
-  for (i = 0; i < 3; i++)
-    g_free (buf[i]);
-
-  max -= self->radius_x;
-  g_free (max);
-
-  for (i = 0; i < self->radius_y + 1; i++)
-    {
-      transition[i] -= self->radius_x;
-      g_free (transition[i]);
-    }
-
-  g_free (transition);
-
-  for (i = 0; i < self->radius_x + 1 ; i++)
-    {
-      density[i] -= self->radius_y;
-      g_free (density[i]);
-    }
+  gegl_buffer_set (output, roi, 0, format, src,
+                   GEGL_AUTO_ROWSTRIDE);
 
-  density -= self->radius_x;
-  g_free (density);
+  g_free (dist);
+  g_free (src);
 
   return TRUE;
 }
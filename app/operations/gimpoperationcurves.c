@@ -32,8 +32,10 @@
 
 #include "gimpcurvesconfig.h"
 #include "gimpoperationcurves.h"
+#include "gimppointlut.h"
 
 
+static void     gimp_operation_curves_prepare (GeglOperation       *operation);
 static gboolean gimp_operation_curves_process (GeglOperation       *operation,
                                                void                *in_buf,
                                                void                *out_buf,
@@ -64,7 +66,9 @@ gimp_operation_curves_class_init (GimpOperationCurvesClass *klass)
                                  "description", "GIMP Curves operation",
                                  NULL);
 
-  point_class->process = gimp_operation_curves_process;
+  operation_class->prepare = gimp_operation_curves_prepare;
+
+  point_class->process     = gimp_operation_curves_process;
 
   g_object_class_install_property (object_class,
                                    GIMP_OPERATION_POINT_FILTER_PROP_CONFIG,
@@ -81,6 +85,28 @@ gimp_operation_curves_init (GimpOperationCurves *self)
 {
 }
 
+static void
+gimp_operation_curves_prepare (GeglOperation *operation)
+{
+  GimpOperationCurves *self = GIMP_OPERATION_CURVES (operation);
+  const Babl          *format;
+
+  /*  process 8 and 16 bit R'G'B' pixels without converting them to
+   *  floats, using the config's lookup table
+   */
+  format = gegl_operation_get_source_format (operation, "input");
+
+  self->lut_format = gimp_point_lut_get_format (format);
+
+  if (self->lut_format)
+    format = self->lut_format;
+  else
+    format = babl_format ("R'G'B'A float");
+
+  gegl_operation_set_format (operation, "input",  format);
+  gegl_operation_set_format (operation, "output", format);
+}
+
 static gboolean
 gimp_operation_curves_process (GeglOperation       *operation,
                                void                *in_buf,
@@ -89,6 +115,7 @@ gimp_operation_curves_process (GeglOperation       *operation,
                                const GeglRectangle *roi,
                                gint                 level)
 {
+  GimpOperationCurves      *self   = GIMP_OPERATION_CURVES (operation);
   GimpOperationPointFilter *point  = GIMP_OPERATION_POINT_FILTER (operation);
   GimpCurvesConfig         *config = GIMP_CURVES_CONFIG (point->config);
   gfloat                   *src    = in_buf;
@@ -97,6 +124,17 @@ gimp_operation_curves_process (GeglOperation       *operation,
   if (! config)
     return FALSE;
 
+  if (self->lut_format)
+    {
+      GimpPointLut *lut = gimp_curves_config_get_lut (config,
+                                                      self->lut_format);
+
+      gimp_point_lut_process (lut, in_buf, out_buf, samples);
+      gimp_point_lut_unref (lut);
+
+      return TRUE;
+    }
+
   gimp_curve_map_pixels (config->curve[0],
                          config->curve[1],
                          config->curve[2],
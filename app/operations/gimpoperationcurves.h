@@ -39,6 +39,8 @@ typedef struct _GimpOperationCurvesClass GimpOperationCurvesClass;
 struct _GimpOperationCurves
 {
   GimpOperationPointFilter  parent_instance;
+
+  const Babl               *lut_format;
 };
 
 struct _GimpOperationCurvesClass
@@ -48,7 +48,14 @@ struct _GimpOperationDarkenOnlyModeClass
 };
 
 
-GType   gimp_operation_darken_only_mode_get_type (void) G_GNUC_CONST;
+GType      gimp_operation_darken_only_mode_get_type       (void) G_GNUC_CONST;
+
+gboolean   gimp_operation_darken_only_mode_process_pixels (gfloat *in,
+                                                           gfloat *layer,
+                                                           gfloat *mask,
+                                                           gfloat *out,
+                                                           gfloat  opacity,
+                                                           glong   samples);
 
 
 #endif /* __GIMP_OPERATION_DARKEN_ONLY_MODE_H__ */
@@ -26,6 +26,7 @@
 
 #include "operations-types.h"
 
+#include "gimplayermodes-simd.h"
 #include "gimpoperationdifferencemode.h"
 
 
@@ -42,6 +43,8 @@ static gboolean gimp_operation_difference_mode_process (GeglOperation       *ope
 G_DEFINE_TYPE (GimpOperationDifferenceMode, gimp_operation_difference_mode,
                GIMP_TYPE_OPERATION_POINT_LAYER_MODE)
 
+static GimpLayerModeFunc process_pixels = gimp_operation_difference_mode_process_pixels;
+
 
 static void
 gimp_operation_difference_mode_class_init (GimpOperationDifferenceModeClass *klass)
@@ -58,6 +61,9 @@ gimp_operation_difference_mode_class_init (GimpOperationDifferenceModeClass *kla
                                  NULL);
 
   point_class->process = gimp_operation_difference_mode_process;
+
+  process_pixels = gimp_layer_mode_simd_get_func (GIMP_LAYER_MODE_SIMD_DIFFERENCE,
+                                                  gimp_operation_difference_mode_process_pixels);
 }
 
 static void
@@ -75,11 +81,19 @@ gimp_operation_difference_mode_process (GeglOperation       *operation,
                                         const GeglRectangle *roi,
                                         gint                 level)
 {
-  gdouble        opacity  = GIMP_OPERATION_POINT_LAYER_MODE (operation)->opacity;
-  gfloat        *in       = in_buf;
-  gfloat        *layer    = aux_buf;
-  gfloat        *mask     = aux2_buf;
-  gfloat        *out      = out_buf;
+  gdouble opacity = GIMP_OPERATION_POINT_LAYER_MODE (operation)->opacity;
+
+  return process_pixels (in_buf, aux_buf, aux2_buf, out_buf, opacity, samples);
+}
+
+gboolean
+gimp_operation_difference_mode_process_pixels (gfloat *in,
+                                               gfloat *layer,
+                                               gfloat *mask,
+                                               gfloat *out,
+                                               gfloat  opacity,
+                                               glong   samples)
+{
   const gboolean has_mask = mask != NULL;
 
   while (samples--)
@@ -29,8 +29,10 @@
 
 #include "gimplevelsconfig.h"
 #include "gimpoperationlevels.h"
+#include "gimppointlut.h"
 
 
+static void     gimp_operation_levels_prepare (GeglOperation       *operation);
 static gboolean gimp_operation_levels_process (GeglOperation       *operation,
                                                void                *in_buf,
                                                void                *out_buf,
@@ -61,7 +63,9 @@ gimp_operation_levels_class_init (GimpOperationLevelsClass *klass)
                                  "description", "GIMP Levels operation",
                                  NULL);
 
-  point_class->process = gimp_operation_levels_process;
+  operation_class->prepare = gimp_operation_levels_prepare;
+
+  point_class->process     = gimp_operation_levels_process;
 
   g_object_class_install_property (object_class,
                                    GIMP_OPERATION_POINT_FILTER_PROP_CONFIG,
@@ -78,6 +82,28 @@ gimp_operation_levels_init (GimpOperationLevels *self)
 {
 }
 
+static void
+gimp_operation_levels_prepare (GeglOperation *operation)
+{
+  GimpOperationLevels *self = GIMP_OPERATION_LEVELS (operation);
+  const Babl          *format;
+
+  /*  process 8 and 16 bit R'G'B' pixels without converting them to
+   *  floats, using the config's lookup table
+   */
+  format = gegl_operation_get_source_format (operation, "input");
+
+  self->lut_format = gimp_point_lut_get_format (format);
+
+  if (self->lut_format)
+    format = self->lut_format;
+  else
+    format = babl_format ("R'G'B'A float");
+
+  gegl_operation_set_format (operation, "input",  format);
+  gegl_operation_set_format (operation, "output", format);
+}
+
 static inline gdouble
 gimp_operation_levels_map (gdouble value,
                            gdouble inv_gamma,
@@ -112,6 +138,7 @@ gimp_operation_levels_process (GeglOperation       *operation,
                                const GeglRectangle *roi,
                                gint                 level)
 {
+  GimpOperationLevels      *self   = GIMP_OPERATION_LEVELS (operation);
   GimpOperationPointFilter *point  = GIMP_OPERATION_POINT_FILTER (operation);
   GimpLevelsConfig         *config = GIMP_LEVELS_CONFIG (point->config);
   gfloat                   *src    = in_buf;
@@ -122,6 +149,17 @@ gimp_operation_levels_process (GeglOperation       *operation,
   if (! config)
     return FALSE;
 
+  if (self->lut_format)
+    {
+      GimpPointLut *lut = gimp_levels_config_get_lut (config,
+                                                      self->lut_format);
+
+      gimp_point_lut_process (lut, in_buf, out_buf, samples);
+      gimp_point_lut_unref (lut);
+
+      return TRUE;
+    }
+
   for (channel = 0; channel < 5; channel++)
     {
       g_return_val_if_fail (config->gamma[channel] != 0.0, FALSE);
@@ -164,6 +202,44 @@ gimp_operation_levels_process (GeglOperation       *operation,
 
 /*  public functions  */
 
+/**
+ * gimp_operation_levels_map_channel:
+ * @channel: the R, G, B or A channel, 0..3
+ * @value:   an input value of @channel
+ * @config:  a #GimpLevelsConfig
+ *
+ * Maps @value the way the levels operation does, for building lookup
+ * tables.
+ *
+ * Returns: the output value
+ **/
+gdouble
+gimp_operation_levels_map_channel (gint              channel,
+                                   gdouble           value,
+                                   GimpLevelsConfig *config)
+{
+  g_return_val_if_fail (GIMP_IS_LEVELS_CONFIG (config), 0.0);
+  g_return_val_if_fail (channel >= 0 && channel < 4, 0.0);
+
+  value = gimp_operation_levels_map (value,
+                                     1.0 / config->gamma[channel + 1],
+                                     config->low_input[channel + 1],
+                                     config->high_input[channel + 1],
+                                     config->low_output[channel + 1],
+                                     config->high_output[channel + 1]);
+
+  /* don't apply the overall curve to the alpha channel */
+  if (channel != ALPHA)
+    value = gimp_operation_levels_map (value,
+                                       1.0 / config->gamma[0],
+                                       config->low_input[0],
+                                       config->high_input[0],
+                                       config->low_output[0],
+                                       config->high_output[0]);
+
+  return value;
+}
+
 gdouble
 gimp_operation_levels_map_input (GimpLevelsConfig     *config,
                                  GimpHistogramChannel  channel,
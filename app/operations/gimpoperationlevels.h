@@ -39,6 +39,8 @@ typedef struct _GimpOperationLevelsClass GimpOperationLevelsClass;
 struct _GimpOperationLevels
 {
   GimpOperationPointFilter  parent_instance;
+
+  const Babl               *lut_format;
 };
 
 struct _GimpOperationLevelsClass
@@ -47,11 +49,14 @@ struct _GimpOperationLevelsClass
 };
 
 
-GType     gimp_operation_levels_get_type  (void) G_GNUC_CONST;
+GType     gimp_operation_levels_get_type    (void) G_GNUC_CONST;
 
-gdouble   gimp_operation_levels_map_input (GimpLevelsConfig     *config,
-                                           GimpHistogramChannel  channel,
-                                           gdouble               value);
+gdouble   gimp_operation_levels_map_input   (GimpLevelsConfig     *config,
+                                             GimpHistogramChannel  channel,
+                                             gdouble               value);
+gdouble   gimp_operation_levels_map_channel (gint                  channel,
+                                             gdouble               value,
+                                             GimpLevelsConfig     *config);
 
 
 #endif /* __GIMP_OPERATION_LEVELS_H__ */
@@ -25,6 +25,7 @@
 
 #include "operations-types.h"
 
+#include "gimplayermodes-simd.h"
 #include "gimpoperationnormalmode.h"
 
 
@@ -48,6 +49,8 @@ G_DEFINE_TYPE (GimpOperationNormalMode, gimp_operation_normal_mode,
 
 #define parent_class gimp_operation_normal_mode_parent_class
 
+static GimpLayerModeFunc process_pixels = gimp_operation_normal_mode_process_pixels;
+
 static const gchar* reference_xml = "<?xml version='1.0' encoding='UTF-8'?>"
 "<gegl>"
 "<node operation='gimp:normal-mode'>"
@@ -84,6 +87,9 @@ gimp_operation_normal_mode_class_init (GimpOperationNormalModeClass *klass)
   operation_class->process     = gimp_operation_normal_parent_process;
 
   point_class->process         = gimp_operation_normal_mode_process;
+
+  process_pixels = gimp_layer_mode_simd_get_func (GIMP_LAYER_MODE_SIMD_NORMAL,
+                                                  gimp_operation_normal_mode_process_pixels);
 }
 
 static void
@@ -156,13 +162,20 @@ gimp_operation_normal_mode_process (GeglOperation       *operation,
                                     const GeglRectangle *roi,
                                     gint                 level)
 {
-  GimpOperationPointLayerMode *point    = GIMP_OPERATION_POINT_LAYER_MODE (operation);
-  gdouble                      opacity  = point->opacity;
-  gfloat                      *in       = in_buf;
-  gfloat                      *aux      = aux_buf;
-  gfloat                      *mask     = aux2_buf;
-  gfloat                      *out      = out_buf;
-  const gboolean               has_mask = mask != NULL;
+  gdouble opacity = GIMP_OPERATION_POINT_LAYER_MODE (operation)->opacity;
+
+  return process_pixels (in_buf, aux_buf, aux2_buf, out_buf, opacity, samples);
+}
+
+gboolean
+gimp_operation_normal_mode_process_pixels (gfloat *in,
+                                           gfloat *aux,
+                                           gfloat *mask,
+                                           gfloat *out,
+                                           gfloat  opacity,
+                                           glong   samples)
+{
+  const gboolean has_mask = mask != NULL;
 
   while (samples--)
     {
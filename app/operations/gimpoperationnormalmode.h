@@ -48,7 +48,14 @@ struct _GimpOperationNormalModeClass
 };
 
 
-GType   gimp_operation_normal_mode_get_type (void) G_GNUC_CONST;
+GType      gimp_operation_normal_mode_get_type       (void) G_GNUC_CONST;
+
+gboolean   gimp_operation_normal_mode_process_pixels (gfloat *in,
+                                                      gfloat *aux,
+                                                      gfloat *mask,
+                                                      gfloat *out,
+                                                      gfloat  opacity,
+                                                      glong   samples);
 
 
 #endif /* __GIMP_OPERATION_NORMAL_MODE_H__ */
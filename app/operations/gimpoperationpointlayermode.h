@@ -32,6 +32,13 @@
 
 typedef struct _GimpOperationPointLayerModeClass GimpOperationPointLayerModeClass;
 
+typedef gboolean (* GimpLayerModeFunc) (gfloat *in,
+                                        gfloat *layer,
+                                        gfloat *mask,
+                                        gfloat *out,
+                                        gfloat  opacity,
+                                        glong   samples);
+
 struct _GimpOperationPointLayerModeClass
 {
   GeglOperationPointComposer3Class  parent_class;
@@ -29,6 +29,7 @@
 
 #include "operations-types.h"
 
+#include "gimpdistancetransform.h"
 #include "gimpoperationshapeburst.h"
 
 
@@ -163,7 +164,7 @@ gimp_operation_shapeburst_set_property (GObject      *object,
 static void
 gimp_operation_shapeburst_prepare (GeglOperation *operation)
 {
-  gegl_operation_set_format (operation, "input",  babl_format ("Y u8"));
+  gegl_operation_set_format (operation, "input",  babl_format ("Y float"));
   gegl_operation_set_format (operation, "output", babl_format ("Y float"));
 }
 
@@ -189,130 +190,53 @@ gimp_operation_shapeburst_process (GeglOperation       *operation,
                                    const GeglRectangle *roi,
                                    gint                 level)
 {
-  const Babl *input_format   = babl_format ("Y u8");
-  const Babl *output_format  = babl_format ("Y float");
+  /* The shapeburst of a pixel is its Euclidean distance to the nearest
+   * unselected pixel, the outside of the region being unselected,
+   * minus the unselected fraction of the pixel itself.
+   */
+  const Babl *format         = babl_format ("Y float");
   gfloat      max_iterations = 0.0;
-  gfloat     *distp_cur;
-  gfloat     *distp_prev;
-  gfloat     *memory;
-  gint        length;
+  gint        n_pixels;
+  gfloat     *src;
+  gfloat     *dist;
   gint        i;
 
-  length = roi->width + 1;
-  memory = g_new (gfloat, length * 2);
+  n_pixels = roi->width * roi->height;
 
-  distp_prev = memory;
-  for (i = 0; i < length; i++)
-    distp_prev[i] = 0.0;
+  src  = g_new (gfloat, n_pixels);
+  dist = g_new (gfloat, n_pixels);
 
-  distp_prev += 1;
-  distp_cur = distp_prev + length;
+  gegl_buffer_get (input, roi, 1.0, format, src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-  for (i = 0; i < roi->height; i++)
+  for (i = 0; i < n_pixels; i++)
+    dist[i] = src[i] <= 0.0f ? 0.0f : GIMP_DISTANCE_TRANSFORM_FAR;
+
+  g_object_set (operation,
+                "progress", 0.5,
+                NULL);
+
+  gimp_distance_transform (dist, roi->width, roi->height, 1.0, TRUE);
+
+  for (i = 0; i < n_pixels; i++)
     {
-      gfloat *tmp;
-      gint    src = 0;
-      gint    j;
-
-      /*  set the current dist row to 0's  */
-      memset (distp_cur - 1, 0, sizeof (gfloat) * (length - 1));
-
-      for (j = 0; j < roi->width; j++)
-        {
-          gfloat float_tmp;
-          gfloat min_prev = MIN (distp_cur[j-1], distp_prev[j]);
-          gint   min_left = MIN ((roi->width - j - 1), (roi->height - i - 1));
-          gint   min      = (gint) MIN (min_left, min_prev);
-          gint   fraction = 255;
-          gint   k;
-
-          /*  This might need to be changed to 0
-              instead of k = (min) ? (min - 1) : 0  */
-
-          for (k = (min) ? (min - 1) : 0; k <= min; k++)
-            {
-              gint x   = j;
-              gint y   = i + k;
-              gint end = y - k;
-
-              while (y >= end)
-                {
-                  guchar src_uchar;
-
-#if 1
-                  /* FIXME: this should be much faster, it converts
-                   * to 32 bit rgba intermediately, bah...
-                   */
-                  gegl_buffer_sample (input, x, y, NULL, &src_uchar,
-                                      input_format,
-                                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-#else
-                  gegl_buffer_get (input, GEGL_RECTANGLE (x, y, 1, 1), 1.0,
-                                   input_format, &src_uchar,
-                                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-#endif
-
-                  src = src_uchar;
-
-                  if (src == 0)
-                    {
-                      min = k;
-                      y = -1;
-                      break;
-                    }
-
-                  if (src < fraction)
-                    fraction = src;
-
-                  x++;
-                  y--;
-                }
-            }
-
-          if (src != 0)
-            {
-              /*  If min_left != min_prev use the previous fraction
-               *   if it is less than the one found
-               */
-              if (min_left != min)
-                {
-                  gint prev_frac = (int) (255 * (min_prev - min));
-
-                  if (prev_frac == 255)
-                    prev_frac = 0;
-
-                  fraction = MIN (fraction, prev_frac);
-                }
-
-              min++;
-            }
-
-          float_tmp = distp_cur[j] = min + fraction / 256.0;
-
-          if (float_tmp > max_iterations)
-            max_iterations = float_tmp;
-        }
-
-      /*  set the dist row  */
-      gegl_buffer_set (output,
-                       GEGL_RECTANGLE (roi->x, roi->y + i,
-                                       roi->width, 1),
-                       1.0, output_format, distp_cur,
-                       GEGL_AUTO_ROWSTRIDE);
-
-      /*  swap pointers around  */
-      tmp = distp_prev;
-      distp_prev = distp_cur;
-      distp_cur = tmp;
-
-      g_object_set (operation,
-                    "progress", (gdouble) i / roi->height,
-                    NULL);
+      if (src[i] > 0.0f)
+        dist[i] = sqrtf (dist[i]) - (1.0f - MIN (src[i], 1.0f));
+      else
+        dist[i] = 0.0f;
+
+      if (dist[i] > max_iterations)
+        max_iterations = dist[i];
     }
 
-  g_free (memory);
+  gegl_buffer_set (output, roi, 0, format, dist,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_free (dist);
+  g_free (src);
 
   g_object_set (operation,
+                "progress",       1.0,
                 "max-iterations", (gdouble) max_iterations,
                 NULL);
 
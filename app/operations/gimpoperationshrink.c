@@ -29,6 +29,7 @@
 
 #include "operations-types.h"
 
+#include "gimpdistancetransform.h"
 #include "gimpoperationshrink.h"
 
 
@@ -183,8 +184,8 @@ gimp_operation_shrink_set_property (GObject      *object,
 static void
 gimp_operation_shrink_prepare (GeglOperation *operation)
 {
-  gegl_operation_set_format (operation, "input",  babl_format ("Y u8"));
-  gegl_operation_set_format (operation, "output", babl_format ("Y u8"));
+  gegl_operation_set_format (operation, "input",  babl_format ("Y float"));
+  gegl_operation_set_format (operation, "output", babl_format ("Y float"));
 }
 
 static GeglRectangle
@@ -202,44 +203,6 @@ gimp_operation_shrink_get_cached_region (GeglOperation       *self,
   return *gegl_operation_source_get_bounding_box (self, "input");
 }
 
-static void
-compute_border (gint16  *circ,
-                guint16  xradius,
-                guint16  yradius)
-{
-  gint32  i;
-  gint32  diameter = xradius * 2 + 1;
-  gdouble tmp;
-
-  for (i = 0; i < diameter; i++)
-    {
-      if (i > xradius)
-        tmp = (i - xradius) - 0.5;
-      else if (i < xradius)
-        tmp = (xradius - i) - 0.5;
-      else
-        tmp = 0.0;
-
-      circ[i] = RINT (yradius /
-                      (gdouble) xradius * sqrt (SQR (xradius) - SQR (tmp)));
-    }
-}
-
-static inline void
-rotate_pointers (guchar  **p,
-                 guint32   n)
-{
-  guint32  i;
-  guchar  *tmp;
-
-  tmp = p[0];
-
-  for (i = 0; i < n - 1; i++)
-    p[i] = p[i + 1];
-
-  p[i] = tmp;
-}
-
 static gboolean
 gimp_operation_shrink_process (GeglOperation       *operation,
                                GeglBuffer          *input,
@@ -247,188 +210,20 @@ gimp_operation_shrink_process (GeglOperation       *operation,
                                const GeglRectangle *roi,
                                gint                 level)
 {
-  /* pretty much the same as fatten_region only different blame all
-   * bugs in this function on jaycox@gimp.org
-   *
+  /* Every pixel becomes the minimum of the pixels within the ellipse
+   * of radii (radius_x, radius_y) around it, or within the rectangle
+   * of the radii if the selection is partially selected anywhere.
    * If edge_lock is true we assume that pixels outside the region we
-   * are passed are identical to the edge pixels.  If edge_lock is
-   * false, we assume that pixels outside the region are 0
-   */
-  GimpOperationShrink *self          = GIMP_OPERATION_SHRINK (operation);
-  const Babl          *input_format  = babl_format ("Y u8");
-  const Babl          *output_format = babl_format ("Y u8");
-  gint32               i, j, x, y;
-  guchar             **buf;  /* caches the the region's pixels */
-  guchar              *out;  /* holds the new scan line we are computing */
-  guchar             **max;  /* caches the smallest values for each column */
-  gint16              *circ; /* holds the y coords of the filter's mask */
-  gint16               last_max, last_index;
-  guchar              *buffer;
-  gint                 buffer_size;
-
-  max = g_new (guchar *, roi->width + 2 * self->radius_x);
-  buf = g_new (guchar *, self->radius_y + 1);
-
-  for (i = 0; i < self->radius_y + 1; i++)
-    buf[i] = g_new (guchar, roi->width);
-
-  buffer_size = (roi->width+ 2 * self->radius_x + 1) * (self->radius_y + 1);
-  buffer = g_new (guchar, buffer_size);
-
-  if (self->edge_lock)
-    memset(buffer, 255, buffer_size);
-  else
-    memset(buffer, 0, buffer_size);
-
-  for (i = 0; i < roi->width + 2 * self->radius_x; i++)
-    {
-      if (i < self->radius_x)
-        {
-          if (self->edge_lock)
-            max[i] = buffer;
-          else
-            max[i] = &buffer[(self->radius_x + 1) * (roi->width + self->radius_x)];
-        }
-      else if (i < roi->width + self->radius_x)
-        {
-          max[i] = &buffer[(self->radius_y + 1) * (i - self->radius_x)];
-        }
-      else
-        {
-          if (self->edge_lock)
-            max[i] = &buffer[(self->radius_x + 1) * (roi->width + self->radius_x - 1)];
-          else
-            max[i] = &buffer[(self->radius_x + 1) * (roi->width + self->radius_x)];
-        }
-    }
-
-  if (! self->edge_lock)
-    for (j = 0 ; j < self->radius_x + 1; j++)
-      max[0][j] = 0;
-
-  /* offset the max pointer by self->radius_x so the range of the
-   * array is [-self->radius_x] to [roi->width + self->radius_x]
+   * are passed are identical to the edge pixels, so they never shrink
+   * the selection.  If edge_lock is false, we assume that pixels
+   * outside the region are 0, so the selection shrinks away from the
+   * edge.
    */
-  max += self->radius_x;
-
-  out = g_new (guchar, roi->width);
-
-  circ = g_new (gint16, 2 * self->radius_x + 1);
-  compute_border (circ, self->radius_x, self->radius_y);
-
- /* offset the circ pointer by self->radius_x so the range of the
-  * array is [-self->radius_x] to [self->radius_x]
-  */
-  circ += self->radius_x;
-
-  for (i = 0; i < self->radius_y && i < roi->height; i++) /* load top of image */
-    gegl_buffer_get (input,
-                     GEGL_RECTANGLE (roi->x, roi->y + i,
-                                     roi->width, 1),
-                     1.0, input_format, buf[i + 1],
-                     GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-  if (self->edge_lock)
-    memcpy (buf[0], buf[1], roi->width);
-  else
-    memset (buf[0], 0, roi->width);
-
-
-  for (x = 0; x < roi->width; x++) /* set up max for top of image */
-    {
-      max[x][0] = buf[0][x];
-
-      for (j = 1; j < self->radius_y + 1; j++)
-        max[x][j] = MIN(buf[j][x], max[x][j-1]);
-    }
-
-  for (y = 0; y < roi->height; y++)
-    {
-      rotate_pointers (buf, self->radius_y + 1);
-
-      if (y < roi->height - self->radius_y)
-        gegl_buffer_get (input,
-                         GEGL_RECTANGLE (roi->x,  roi->y + y + self->radius_y,
-                                         roi->width, 1),
-                         1.0, input_format, buf[self->radius_y],
-                         GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-      else if (self->edge_lock)
-        memcpy (buf[self->radius_y], buf[self->radius_y - 1], roi->width);
-      else
-        memset (buf[self->radius_y], 0, roi->width);
-
-      for (x = 0 ; x < roi->width; x++) /* update max array */
-        {
-          for (i = self->radius_y; i > 0; i--)
-            max[x][i] = MIN (MIN (max[x][i - 1], buf[i - 1][x]), buf[i][x]);
-
-          max[x][0] = buf[0][x];
-        }
-
-      last_max =  max[0][circ[-1]];
-      last_index = 0;
-
-      for (x = 0 ; x < roi->width; x++) /* render scan line */
-        {
-          last_index--;
-
-          if (last_index >= 0)
-            {
-              if (last_max == 0)
-                {
-                  out[x] = 0;
-                }
-              else
-                {
-                  last_max = 255;
-
-                  for (i = self->radius_x; i >= 0; i--)
-                    if (last_max > max[x + i][circ[i]])
-                      {
-                        last_max = max[x + i][circ[i]];
-                        last_index = i;
-                      }
-
-                  out[x] = last_max;
-                }
-            }
-          else
-            {
-              last_index = self->radius_x;
-              last_max = max[x + self->radius_y][circ[self->radius_x]];
-
-              for (i = self->radius_x - 1; i >= -self->radius_x; i--)
-                if (last_max > max[x + i][circ[i]])
-                  {
-                    last_max = max[x + i][circ[i]];
-                    last_index = i;
-                  }
-
-              out[x] = last_max;
-            }
-        }
-
-      gegl_buffer_set (output,
-                       GEGL_RECTANGLE (roi->x, roi->y + y,
-                                       roi->width, 1),
-                       1.0, output_format, out,
-                       GEGL_AUTO_ROWSTRIDE);
-    }
-
-  /* undo the offsets to the pointers so we can free the malloced memmory */
-  circ -= self->radius_x;
-  max -= self->radius_x;
-
-  /* free the memmory */
-  g_free (circ);
-  g_free (buffer);
-  g_free (max);
-
-  for (i = 0; i < self->radius_x + 1; i++)
-    g_free (buf[i]);
+  GimpOperationShrink *self = GIMP_OPERATION_SHRINK (operation);
 
-  g_free (buf);
-  g_free (out);
+  gimp_distance_transform_dilate (input, output, roi,
+                                  self->radius_x, self->radius_y,
+                                  TRUE, ! self->edge_lock);
 
   return TRUE;
 }
@@ -0,0 +1,230 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimppointlut.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "operations-types.h"
+
+#include "gimppointlut.h"
+
+
+/*  A GimpPointLut holds the precomputed output of a point filter for
+ *  every possible input value of an 8 or 16 bit per channel R'G'B'A
+ *  format, so that filtering a pixel is four table lookups, instead
+ *  of evaluating curves or calling pow() per component.  It is
+ *  immutable once created and reference counted atomically, so it can
+ *  be shared by the threads processing an operation while its config
+ *  replaces it with a new one.
+ */
+
+struct _GimpPointLut
+{
+  gint        ref_count;
+  const Babl *type;
+  gint        n_values;
+  gpointer    values;    /*  n_values entries per channel  */
+};
+
+
+/*  public functions  */
+
+/**
+ * gimp_point_lut_get_format:
+ * @source_format: the format of a point filter's input, or %NULL
+ *
+ * Returns: the integer format a point filter can process @source_format
+ *          in exactly, using a #GimpPointLut, or %NULL if it has to be
+ *          processed as floats.
+ **/
+const Babl *
+gimp_point_lut_get_format (const Babl *source_format)
+{
+  const Babl *model;
+  const Babl *type;
+
+  if (! source_format || babl_format_is_palette (source_format))
+    return NULL;
+
+  model = babl_format_get_model (source_format);
+  type  = babl_format_get_type (source_format, 0);
+
+  /*  converting linear light to R'G'B' would lose precision  */
+  if (model != babl_model ("Y'")     &&
+      model != babl_model ("Y'A")    &&
+      model != babl_model ("R'G'B'") &&
+      model != babl_model ("R'G'B'A"))
+    return NULL;
+
+  if (type == babl_type ("u8"))
+    return babl_format ("R'G'B'A u8");
+  else if (type == babl_type ("u16"))
+    return babl_format ("R'G'B'A u16");
+
+  return NULL;
+}
+
+GimpPointLut *
+gimp_point_lut_new (const Babl       *format,
+                    GimpPointLutFunc  func,
+                    gpointer          user_data)
+{
+  GimpPointLut *lut;
+  const Babl   *type;
+  gint          channel;
+  gint          i;
+
+  g_return_val_if_fail (format != NULL, NULL);
+  g_return_val_if_fail (func != NULL, NULL);
+
+  type = babl_format_get_type (format, 0);
+
+  g_return_val_if_fail (type == babl_type ("u8") ||
+                        type == babl_type ("u16"), NULL);
+
+  lut = g_slice_new0 (GimpPointLut);
+
+  lut->ref_count = 1;
+  lut->type      = type;
+
+  if (type == babl_type ("u8"))
+    {
+      guint8 *values;
+
+      lut->n_values = 256;
+      lut->values   = values = g_new (guint8, 4 * lut->n_values);
+
+      for (channel = 0; channel < 4; channel++)
+        for (i = 0; i < lut->n_values; i++)
+          {
+            gdouble value = func (channel, i / 255.0, user_data);
+
+            *values++ = RINT (CLAMP (value, 0.0, 1.0) * 255.0);
+          }
+    }
+  else
+    {
+      guint16 *values;
+
+      lut->n_values = 65536;
+      lut->values   = values = g_new (guint16, 4 * lut->n_values);
+
+      for (channel = 0; channel < 4; channel++)
+        for (i = 0; i < lut->n_values; i++)
+          {
+            gdouble value = func (channel, i / 65535.0, user_data);
+
+            *values++ = RINT (CLAMP (value, 0.0, 1.0) * 65535.0);
+          }
+    }
+
+  return lut;
+}
+
+GimpPointLut *
+gimp_point_lut_ref (GimpPointLut *lut)
+{
+  g_return_val_if_fail (lut != NULL, NULL);
+
+  g_atomic_int_inc (&lut->ref_count);
+
+  return lut;
+}
+
+void
+gimp_point_lut_unref (GimpPointLut *lut)
+{
+  g_return_if_fail (lut != NULL);
+
+  if (g_atomic_int_dec_and_test (&lut->ref_count))
+    {
+      g_free (lut->values);
+      g_slice_free (GimpPointLut, lut);
+    }
+}
+
+const Babl *
+gimp_point_lut_get_type (GimpPointLut *lut)
+{
+  g_return_val_if_fail (lut != NULL, NULL);
+
+  return lut->type;
+}
+
+/**
+ * gimp_point_lut_process:
+ * @lut:     a #GimpPointLut
+ * @src:     @samples R'G'B'A pixels of @lut's type
+ * @dest:    where to store the filtered pixels
+ * @samples: the number of pixels
+ *
+ * Filters @src by looking up each component in its channel's table.
+ **/
+void
+gimp_point_lut_process (GimpPointLut  *lut,
+                        gconstpointer  src,
+                        gpointer       dest,
+                        glong          samples)
+{
+  g_return_if_fail (lut != NULL);
+
+  if (lut->type == babl_type ("u8"))
+    {
+      const guint8 *s = src;
+      guint8       *d = dest;
+      const guint8 *r = lut->values;
+      const guint8 *g = r + 256;
+      const guint8 *b = g + 256;
+      const guint8 *a = b + 256;
+
+      while (samples--)
+        {
+          d[0] = r[s[0]];
+          d[1] = g[s[1]];
+          d[2] = b[s[2]];
+          d[3] = a[s[3]];
+
+          s += 4;
+          d += 4;
+        }
+    }
+  else
+    {
+      const guint16 *s = src;
+      guint16       *d = dest;
+      const guint16 *r = lut->values;
+      const guint16 *g = r + 65536;
+      const guint16 *b = g + 65536;
+      const guint16 *a = b + 65536;
+
+      while (samples--)
+        {
+          d[0] = r[s[0]];
+          d[1] = g[s[1]];
+          d[2] = b[s[2]];
+          d[3] = a[s[3]];
+
+          s += 4;
+          d += 4;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimppointlut.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_POINT_LUT_H__
+#define __GIMP_POINT_LUT_H__
+
+
+/*  Maps value, in the range [0..1], of the R, G, B or A channel
+ *  (channel 0..3) to its output value.
+ */
+typedef gdouble (* GimpPointLutFunc) (gint     channel,
+                                      gdouble  value,
+                                      gpointer user_data);
+
+
+const Babl   * gimp_point_lut_get_format (const Babl       *source_format);
+
+GimpPointLut * gimp_point_lut_new        (const Babl       *format,
+                                          GimpPointLutFunc  func,
+                                          gpointer          user_data);
+
+GimpPointLut * gimp_point_lut_ref        (GimpPointLut     *lut);
+void           gimp_point_lut_unref      (GimpPointLut     *lut);
+
+const Babl   * gimp_point_lut_get_type   (GimpPointLut     *lut);
+
+void           gimp_point_lut_process    (GimpPointLut     *lut,
+                                          gconstpointer     src,
+                                          gpointer          dest,
+                                          glong             samples);
+
+
+#endif /* __GIMP_POINT_LUT_H__ */
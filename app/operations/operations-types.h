@@ -47,6 +47,7 @@ typedef struct _GimpThresholdConfig             GimpThresholdConfig;
 /*  non-object types  */
 
 typedef struct _GimpCagePoint                   GimpCagePoint;
+typedef struct _GimpPointLut                    GimpPointLut;
 
 
 #endif /* __OPERATIONS_TYPES_H__ */
@@ -0,0 +1,316 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gegl-plugin.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "operations/operations-types.h"
+
+#include "operations/gimplayermodes-simd.h"
+#include "operations/gimpoperationadditionmode.h"
+#include "operations/gimpoperationdarkenonlymode.h"
+#include "operations/gimpoperationdifferencemode.h"
+#include "operations/gimpoperationlightenonlymode.h"
+#include "operations/gimpoperationmultiplymode.h"
+#include "operations/gimpoperationnormalmode.h"
+#include "operations/gimpoperationoverlaymode.h"
+#include "operations/gimpoperationscreenmode.h"
+#include "operations/gimpoperationsubtractmode.h"
+
+
+/* odd, so the vector loops have a tail to handle */
+#define N_PIXELS       4099
+#define TOLERANCE      1e-5
+
+#define PERF_N_PIXELS  (1 << 20)
+#define PERF_RUNS      10
+
+
+typedef struct
+{
+  const gchar       *name;
+  GimpLayerModeSimd  mode;
+  GimpLayerModeFunc  generic_func;
+} LayerMode;
+
+typedef struct
+{
+  const gchar             *name;
+  GimpCpuAccelFlags        accel;
+  const GimpLayerModeFunc *funcs;
+} Variant;
+
+
+static const LayerMode layer_modes[] =
+{
+  { "normal",       GIMP_LAYER_MODE_SIMD_NORMAL,
+    gimp_operation_normal_mode_process_pixels       },
+  { "multiply",     GIMP_LAYER_MODE_SIMD_MULTIPLY,
+    gimp_operation_multiply_mode_process_pixels     },
+  { "screen",       GIMP_LAYER_MODE_SIMD_SCREEN,
+    gimp_operation_screen_mode_process_pixels       },
+  { "overlay",      GIMP_LAYER_MODE_SIMD_OVERLAY,
+    gimp_operation_overlay_mode_process_pixels      },
+  { "difference",   GIMP_LAYER_MODE_SIMD_DIFFERENCE,
+    gimp_operation_difference_mode_process_pixels   },
+  { "addition",     GIMP_LAYER_MODE_SIMD_ADDITION,
+    gimp_operation_addition_mode_process_pixels     },
+  { "subtract",     GIMP_LAYER_MODE_SIMD_SUBTRACT,
+    gimp_operation_subtract_mode_process_pixels     },
+  { "darken-only",  GIMP_LAYER_MODE_SIMD_DARKEN_ONLY,
+    gimp_operation_darken_only_mode_process_pixels  },
+  { "lighten-only", GIMP_LAYER_MODE_SIMD_LIGHTEN_ONLY,
+    gimp_operation_lighten_only_mode_process_pixels }
+};
+
+static const Variant variants[] =
+{
+#ifdef USE_SSE2
+  { "sse2", GIMP_CPU_ACCEL_X86_SSE2, gimp_layer_mode_funcs_sse2 },
+#endif
+#ifdef USE_AVX2
+  { "avx2", GIMP_CPU_ACCEL_X86_AVX2, gimp_layer_mode_funcs_avx2 },
+#endif
+  { NULL, 0, NULL }
+};
+
+
+static void
+fill_pixels (GRand  *rand,
+             gfloat *in,
+             gfloat *layer,
+             gfloat *mask,
+             glong   n_pixels)
+{
+  glong i;
+
+  for (i = 0; i < n_pixels * 4; i++)
+    {
+      in[i]    = g_rand_double (rand);
+      layer[i] = g_rand_double (rand);
+    }
+
+  for (i = 0; i < n_pixels; i++)
+    {
+      mask[i] = g_rand_double (rand);
+
+      /* exercise the fully transparent special cases */
+      switch (i % 17)
+        {
+        case 3:  in[i * 4 + 3]    = 0.0; break;
+        case 7:  layer[i * 4 + 3] = 0.0; break;
+        case 11: mask[i]          = 0.0; break;
+        case 13: in[i * 4 + 3]    = layer[i * 4 + 3] = 0.0; break;
+        }
+    }
+}
+
+static void
+compare_pixels (const LayerMode *layer_mode,
+                const Variant   *variant,
+                gboolean         masked,
+                const gfloat    *expected,
+                const gfloat    *result,
+                glong            n_pixels)
+{
+  glong i;
+
+  for (i = 0; i < n_pixels * 4; i++)
+    {
+      gdouble error = fabs (expected[i] - result[i]);
+
+      if (error > TOLERANCE * MAX (1.0, fabs (expected[i])))
+        g_error ("%s %s %s: pixel %ld component %ld is %g, expected %g",
+                 layer_mode->name, variant->name,
+                 masked ? "masked" : "unmasked",
+                 i / 4, i % 4, result[i], expected[i]);
+    }
+}
+
+/**
+ * simd_matches_generic:
+ * @data: the LayerMode to test
+ *
+ * Checks that the vectorized pixel functions of a layer mode produce
+ * the same pixels as its generic function, with and without a mask.
+ **/
+static void
+simd_matches_generic (gconstpointer data)
+{
+  const LayerMode   *layer_mode = data;
+  GimpCpuAccelFlags  accel      = gimp_cpu_accel_get_support ();
+  GRand             *rand       = g_rand_new_with_seed (42);
+  gfloat            *in         = g_new (gfloat, N_PIXELS * 4);
+  gfloat            *layer      = g_new (gfloat, N_PIXELS * 4);
+  gfloat            *mask       = g_new (gfloat, N_PIXELS);
+  gfloat            *expected   = g_new (gfloat, N_PIXELS * 4);
+  gfloat            *result     = g_new (gfloat, N_PIXELS * 4);
+  const Variant     *variant;
+
+  fill_pixels (rand, in, layer, mask, N_PIXELS);
+
+  for (variant = variants; variant->name; variant++)
+    {
+      GimpLayerModeFunc func = variant->funcs[layer_mode->mode];
+
+      if (! (accel & variant->accel) || ! func)
+        continue;
+
+      layer_mode->generic_func (in, layer, NULL, expected, 0.7, N_PIXELS);
+      func (in, layer, NULL, result, 0.7, N_PIXELS);
+
+      compare_pixels (layer_mode, variant, FALSE,
+                      expected, result, N_PIXELS);
+
+      layer_mode->generic_func (in, layer, mask, expected, 1.0, N_PIXELS);
+      func (in, layer, mask, result, 1.0, N_PIXELS);
+
+      compare_pixels (layer_mode, variant, TRUE,
+                      expected, result, N_PIXELS);
+    }
+
+  g_free (result);
+  g_free (expected);
+  g_free (mask);
+  g_free (layer);
+  g_free (in);
+  g_rand_free (rand);
+}
+
+static gdouble
+time_func (GimpLayerModeFunc  func,
+           gfloat            *in,
+           gfloat            *layer,
+           gfloat            *mask,
+           gfloat            *out)
+{
+  GTimer  *timer = g_timer_new ();
+  gdouble  time  = G_MAXDOUBLE;
+  gint     run;
+
+  for (run = 0; run < PERF_RUNS; run++)
+    {
+      g_timer_start (timer);
+      func (in, layer, mask, out, 0.7, PERF_N_PIXELS);
+      g_timer_stop (timer);
+
+      time = MIN (time, g_timer_elapsed (timer, NULL));
+    }
+
+  g_timer_destroy (timer);
+
+  return time;
+}
+
+/**
+ * perf_layer_mode:
+ * @data: the LayerMode to time
+ *
+ * Compares the speed of the generic and the vectorized pixel
+ * functions of a layer mode, with and without a mask.
+ **/
+static void
+perf_layer_mode (gconstpointer data)
+{
+  const LayerMode   *layer_mode = data;
+  GimpCpuAccelFlags  accel      = gimp_cpu_accel_get_support ();
+  GRand             *rand       = g_rand_new_with_seed (42);
+  gfloat            *in         = g_new (gfloat, PERF_N_PIXELS * 4);
+  gfloat            *layer      = g_new (gfloat, PERF_N_PIXELS * 4);
+  gfloat            *mask       = g_new (gfloat, PERF_N_PIXELS);
+  gfloat            *out        = g_new (gfloat, PERF_N_PIXELS * 4);
+  const Variant     *variant;
+  gint               masked;
+
+  fill_pixels (rand, in, layer, mask, PERF_N_PIXELS);
+
+  for (masked = 0; masked < 2; masked++)
+    {
+      gfloat  *m       = masked ? mask : NULL;
+      gdouble  generic = time_func (layer_mode->generic_func,
+                                    in, layer, m, out);
+
+      g_test_minimized_result (generic, "%s %s generic: %.2f Mpixels/s",
+                               layer_mode->name,
+                               masked ? "masked" : "unmasked",
+                               PERF_N_PIXELS / generic / 1e6);
+
+      for (variant = variants; variant->name; variant++)
+        {
+          GimpLayerModeFunc func = variant->funcs[layer_mode->mode];
+          gdouble           time;
+
+          if (! (accel & variant->accel) || ! func)
+            continue;
+
+          time = time_func (func, in, layer, m, out);
+
+          g_test_minimized_result (time, "%s %s %s: %.2f Mpixels/s, %.1fx",
+                                   layer_mode->name,
+                                   masked ? "masked" : "unmasked",
+                                   variant->name,
+                                   PERF_N_PIXELS / time / 1e6,
+                                   generic / time);
+        }
+    }
+
+  g_free (out);
+  g_free (mask);
+  g_free (layer);
+  g_free (in);
+  g_rand_free (rand);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gint i;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (layer_modes); i++)
+    {
+      gchar *path = g_strdup_printf ("/layer-modes/%s", layer_modes[i].name);
+
+      g_test_add_data_func (path, &layer_modes[i], simd_matches_generic);
+      g_free (path);
+    }
+
+  /* The benchmarks only run with "-m perf" */
+  if (g_test_perf ())
+    {
+      for (i = 0; i < G_N_ELEMENTS (layer_modes); i++)
+        {
+          gchar *path = g_strdup_printf ("/layer-modes/perf/%s",
+                                         layer_modes[i].name);
+
+          g_test_add_data_func (path, &layer_modes[i], perf_layer_mode);
+          g_free (path);
+        }
+    }
+
+  return g_test_run ();
+}
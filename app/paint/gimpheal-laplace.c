@@ -0,0 +1,571 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpheal-laplace.c: Laplace solvers for the heal tool
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "paint-types.h"
+
+#include "core/gimp-parallel.h"
+
+#include "gimpheal-laplace.h"
+
+
+/* NOTES
+ *
+ * The multigrid solver runs V(2,2) cycles of red/black Gauss-Seidel
+ * on a hierarchy of grids, each half the size of the previous one,
+ * coarse node (x, y) sitting on top of fine node (2x, 2y).  A coarse
+ * node is fixed when it lies on the border of its grid, or when the
+ * fine node below it is fixed.  Residuals are restricted by full
+ * weighting, and corrections are prolonged back by bilinear
+ * interpolation, to the free fine nodes only.
+ *
+ * Each cycle reduces the error by a roughly constant factor
+ * independent of the size of the brush, so unlike the plain
+ * Gauss-Seidel solver, whose convergence slows down quadratically
+ * with the brush size, a handful of cycles is enough at every size.
+ * Iteration stops when a cycle changes the solution by less than
+ * TOLERANCE, or after MAX_CYCLES.
+ *
+ * The channels are independent, and are solved in parallel.
+ */
+
+#define MIN_LEVEL_SIZE  4
+#define MAX_LEVELS      16
+#define PRE_SWEEPS      2
+#define POST_SWEEPS     2
+#define COARSE_SWEEPS   16
+#define MAX_CYCLES      12
+#define TOLERANCE       1e-4f
+
+
+typedef struct
+{
+  gint    width;
+  gint    height;
+  guchar *fixed;
+} HealLevel;
+
+typedef struct
+{
+  gfloat    *data;
+  gint       depth;
+  HealLevel  levels[MAX_LEVELS];
+  gint       n_levels;
+} HealSolve;
+
+
+/*  local function prototypes  */
+
+static void     gimp_heal_laplace_smooth     (const HealLevel *level,
+                                              gfloat          *u,
+                                              const gfloat    *f,
+                                              gint             n_sweeps);
+static void     gimp_heal_laplace_restrict   (const HealLevel *level,
+                                              const gfloat    *u,
+                                              const gfloat    *f,
+                                              gfloat          *r,
+                                              const HealLevel *coarse,
+                                              gfloat          *coarse_f);
+static gfloat   gimp_heal_laplace_prolong    (const HealLevel *coarse,
+                                              const gfloat    *coarse_u,
+                                              const HealLevel *level,
+                                              gfloat          *u);
+static gfloat   gimp_heal_laplace_cycle      (HealSolve       *solve,
+                                              gint             l,
+                                              gfloat         **u,
+                                              gfloat         **f,
+                                              gfloat          *r);
+static void     gimp_heal_laplace_channel    (HealSolve       *solve,
+                                              gint             channel);
+static void     gimp_heal_laplace_distribute (gint             i,
+                                              gint             n,
+                                              HealSolve       *solve);
+
+
+/*  public functions  */
+
+void
+gimp_heal_laplace_multigrid (gfloat       *data,
+                             gint          width,
+                             gint          height,
+                             gint          depth,
+                             const guchar *mask)
+{
+  HealSolve  solve;
+  HealLevel *level;
+  gint       x, y;
+  gint       l;
+
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (mask != NULL);
+
+  if (width < 3 || height < 3)
+    return;
+
+  solve.data     = data;
+  solve.depth    = depth;
+  solve.n_levels = 1;
+
+  level = &solve.levels[0];
+
+  level->width  = width;
+  level->height = height;
+  level->fixed  = g_new (guchar, width * height);
+
+  for (y = 0; y < height; y++)
+    {
+      for (x = 0; x < width; x++)
+        {
+          level->fixed[y * width + x] = (! mask[y * width + x] ||
+                                         x == 0 || x == width  - 1 ||
+                                         y == 0 || y == height - 1);
+        }
+    }
+
+  while (solve.n_levels < MAX_LEVELS             &&
+         level->width  / 2 >= MIN_LEVEL_SIZE     &&
+         level->height / 2 >= MIN_LEVEL_SIZE)
+    {
+      HealLevel *coarse = &solve.levels[solve.n_levels++];
+
+      coarse->width  = level->width  / 2 + 1;
+      coarse->height = level->height / 2 + 1;
+      coarse->fixed  = g_new (guchar, coarse->width * coarse->height);
+
+      for (y = 0; y < coarse->height; y++)
+        {
+          for (x = 0; x < coarse->width; x++)
+            {
+              gboolean fixed = TRUE;
+
+              if (x > 0 && x < coarse->width  - 1 &&
+                  y > 0 && y < coarse->height - 1 &&
+                  2 * x < level->width && 2 * y < level->height)
+                {
+                  fixed = level->fixed[2 * y * level->width + 2 * x];
+                }
+
+              coarse->fixed[y * coarse->width + x] = fixed;
+            }
+        }
+
+      level = coarse;
+    }
+
+  gimp_parallel_distribute (depth,
+                            (GimpParallelDistributeFunc)
+                            gimp_heal_laplace_distribute,
+                            &solve);
+
+  for (l = 0; l < solve.n_levels; l++)
+    g_free (solve.levels[l].fixed);
+}
+
+/* Perform one iteration of the laplace solver for matrix.  Store the
+ * result in solution and return the square of the cummulative error
+ * of the solution.
+ */
+static gdouble
+gimp_heal_laplace_iteration (gdouble      *matrix,
+                             gint          height,
+                             gint          depth,
+                             gint          width,
+                             gdouble      *solution,
+                             const guchar *mask)
+{
+  const gint    rowstride = width * depth;
+  gint          i, j, k, off, offm, offm0, off0;
+  gdouble       tmp, diff;
+  gdouble       err       = 0.0;
+  const gdouble w         = 1.80 * 0.25; /* Over-relaxation = 1.8 */
+
+  /* we use a red/black checker model of the discretization grid */
+
+  /* do reds */
+  for (i = 0; i < height; i++)
+    {
+      off0  = i * rowstride;
+      offm0 = i * width;
+
+      for (j = i % 2; j < width; j += 2)
+        {
+          off  = off0 + j * depth;
+          offm = offm0 + j;
+
+          if ((0 == mask[offm]) ||
+              (i == 0) || (i == (height - 1)) ||
+              (j == 0) || (j == (width - 1)))
+            {
+              /* do nothing at the boundary or outside mask */
+              for (k = 0; k < depth; k++)
+                solution[off + k] = matrix[off + k];
+            }
+          else
+            {
+              /* Use Gauss Siedel to get the correction factor then
+               * over-relax it
+               */
+              for (k = 0; k < depth; k++)
+                {
+                  tmp = solution[off + k];
+                  solution[off + k] = (matrix[off + k] +
+                                       w *
+                                       (matrix[off - depth + k] +     /* west */
+                                        matrix[off + depth + k] +     /* east */
+                                        matrix[off - rowstride + k] + /* north */
+                                        matrix[off + rowstride + k] - 4.0 *
+                                        matrix[off+k]));              /* south */
+
+                  diff = solution[off + k] - tmp;
+                  err += diff * diff;
+                }
+            }
+        }
+    }
+
+
+  /* Do blacks
+   *
+   * As we've done the reds earlier, we can use them right now to
+   * accelerate the convergence. So we have "solution" in the solver
+   * instead of "matrix" above
+   */
+  for (i = 0; i < height; i++)
+    {
+      off0 =  i * rowstride;
+      offm0 = i * width;
+
+      for (j = (i % 2) ? 0 : 1; j < width; j += 2)
+        {
+          off = off0 + j * depth;
+          offm = offm0 + j;
+
+          if ((0 == mask[offm]) ||
+              (i == 0) || (i == (height - 1)) ||
+              (j == 0) || (j == (width - 1)))
+            {
+              /* do nothing at the boundary or outside mask */
+              for (k = 0; k < depth; k++)
+                solution[off + k] = matrix[off + k];
+            }
+          else
+            {
+              /* Use Gauss Siedel to get the correction factor then
+               * over-relax it
+               */
+              for (k = 0; k < depth; k++)
+                {
+                  tmp = solution[off + k];
+                  solution[off + k] = (matrix[off + k] +
+                                       w *
+                                       (solution[off - depth + k] +     /* west */
+                                        solution[off + depth + k] +     /* east */
+                                        solution[off - rowstride + k] + /* north */
+                                        solution[off + rowstride + k] - 4.0 *
+                                        matrix[off+k]));                /* south */
+
+                  diff = solution[off + k] - tmp;
+                  err += diff*diff;
+                }
+            }
+        }
+    }
+
+  return err;
+}
+
+/* Solve the laplace equation for matrix and store the result in solution.
+ */
+void
+gimp_heal_laplace_gauss_seidel (gdouble      *matrix,
+                                gint          height,
+                                gint          depth,
+                                gint          width,
+                                gdouble      *solution,
+                                const guchar *mask)
+{
+#define EPSILON   1e-8
+#define MAX_ITER  500
+  gint i;
+
+  /* repeat until convergence or max iterations */
+  for (i = 0; i < MAX_ITER; i++)
+    {
+      gdouble sqr_err;
+
+      /* do one iteration and store the amount of error */
+      sqr_err = gimp_heal_laplace_iteration (matrix, height, depth, width,
+                                             solution, mask);
+
+      /* copy solution to matrix */
+      memcpy (matrix, solution, width * height * depth * sizeof (double));
+
+      if (sqr_err < EPSILON)
+        break;
+    }
+}
+
+
+/*  private functions  */
+
+/* Run n_sweeps red/black Gauss-Seidel sweeps of u = (f + sum of
+ * neighbors) / 4 over the free nodes of level.
+ */
+static void
+gimp_heal_laplace_smooth (const HealLevel *level,
+                          gfloat          *u,
+                          const gfloat    *f,
+                          gint             n_sweeps)
+{
+  const gint width  = level->width;
+  const gint height = level->height;
+  gint       sweep;
+  gint       color;
+  gint       x, y;
+
+  for (sweep = 0; sweep < n_sweeps; sweep++)
+    {
+      for (color = 0; color < 2; color++)
+        {
+          for (y = 1; y < height - 1; y++)
+            {
+              const guchar *fixed = level->fixed + y * width;
+              gfloat       *row   = u + y * width;
+              const gfloat *rhs   = f + y * width;
+
+              for (x = 1 + ((y + color) & 1); x < width - 1; x += 2)
+                {
+                  if (! fixed[x])
+                    {
+                      row[x] = 0.25f * (rhs[x]         +
+                                        row[x - 1]     + row[x + 1] +
+                                        row[x - width] + row[x + width]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* Compute the residual of u on level into r, and restrict it to
+ * coarse_f by full weighting.  The factor of 4 accounts for the
+ * doubled grid spacing of the coarse level.
+ */
+static void
+gimp_heal_laplace_restrict (const HealLevel *level,
+                            const gfloat    *u,
+                            const gfloat    *f,
+                            gfloat          *r,
+                            const HealLevel *coarse,
+                            gfloat          *coarse_f)
+{
+  const gint width  = level->width;
+  const gint height = level->height;
+  gint       x, y;
+
+  memset (r, 0, width * height * sizeof (gfloat));
+
+  for (y = 1; y < height - 1; y++)
+    {
+      const guchar *fixed = level->fixed + y * width;
+      const gfloat *row   = u + y * width;
+      const gfloat *rhs   = f + y * width;
+      gfloat       *dest  = r + y * width;
+
+      for (x = 1; x < width - 1; x++)
+        {
+          if (! fixed[x])
+            {
+              dest[x] = rhs[x] - 4.0f * row[x] +
+                        row[x - 1]     + row[x + 1] +
+                        row[x - width] + row[x + width];
+            }
+        }
+    }
+
+  memset (coarse_f, 0, coarse->width * coarse->height * sizeof (gfloat));
+
+  for (y = 1; y < coarse->height - 1; y++)
+    {
+      const guchar *fixed = coarse->fixed + y * coarse->width;
+      gfloat       *dest  = coarse_f + y * coarse->width;
+
+      for (x = 1; x < coarse->width - 1; x++)
+        {
+          if (! fixed[x])
+            {
+              const gfloat *src = r + 2 * y * width + 2 * x;
+
+              dest[x] = 0.25f * (4.0f * src[0]                      +
+                                 2.0f * (src[-1]     + src[1]       +
+                                         src[-width] + src[width])  +
+                                 src[-width - 1] + src[-width + 1]  +
+                                 src[ width - 1] + src[ width + 1]);
+            }
+        }
+    }
+}
+
+/* Add the bilinearly interpolated coarse correction to the free nodes
+ * of level, and return the largest correction applied.
+ */
+static gfloat
+gimp_heal_laplace_prolong (const HealLevel *coarse,
+                           const gfloat    *coarse_u,
+                           const HealLevel *level,
+                           gfloat          *u)
+{
+  const gint width = level->width;
+  gfloat     max   = 0.0f;
+  gint       x, y;
+
+  for (y = 1; y < level->height - 1; y++)
+    {
+      const guchar *fixed = level->fixed + y * width;
+      gfloat       *row   = u + y * width;
+      const gfloat *src0  = coarse_u + (y / 2)       * coarse->width;
+      const gfloat *src1  = coarse_u + ((y + 1) / 2) * coarse->width;
+
+      for (x = 1; x < width - 1; x++)
+        {
+          if (! fixed[x])
+            {
+              gint   x0 = x / 2;
+              gint   x1 = (x + 1) / 2;
+              gfloat e;
+
+              e = 0.25f * (src0[x0] + src0[x1] + src1[x0] + src1[x1]);
+
+              row[x] += e;
+
+              max = MAX (max, fabsf (e));
+            }
+        }
+    }
+
+  return max;
+}
+
+/* Run one V-cycle from level l down, and return the largest coarse
+ * correction applied to level l.
+ */
+static gfloat
+gimp_heal_laplace_cycle (HealSolve  *solve,
+                         gint        l,
+                         gfloat    **u,
+                         gfloat    **f,
+                         gfloat     *r)
+{
+  const HealLevel *level  = &solve->levels[l];
+  const HealLevel *coarse = &solve->levels[l + 1];
+  gfloat           correction;
+
+  if (l == solve->n_levels - 1)
+    {
+      gimp_heal_laplace_smooth (level, u[l], f[l], COARSE_SWEEPS);
+
+      return 0.0f;
+    }
+
+  gimp_heal_laplace_smooth (level, u[l], f[l], PRE_SWEEPS);
+
+  gimp_heal_laplace_restrict (level, u[l], f[l], r, coarse, f[l + 1]);
+
+  memset (u[l + 1], 0, coarse->width * coarse->height * sizeof (gfloat));
+
+  gimp_heal_laplace_cycle (solve, l + 1, u, f, r);
+
+  correction = gimp_heal_laplace_prolong (coarse, u[l + 1], level, u[l]);
+
+  gimp_heal_laplace_smooth (level, u[l], f[l], POST_SWEEPS);
+
+  return correction;
+}
+
+static void
+gimp_heal_laplace_channel (HealSolve *solve,
+                           gint       channel)
+{
+  const HealLevel *level = &solve->levels[0];
+  const gint       size  = level->width * level->height;
+  gfloat          *u[MAX_LEVELS];
+  gfloat          *f[MAX_LEVELS];
+  gfloat          *r;
+  gint             depth = solve->depth;
+  gint             cycle;
+  gint             l;
+  gint             i;
+
+  for (l = 0; l < solve->n_levels; l++)
+    {
+      gint n = solve->levels[l].width * solve->levels[l].height;
+
+      u[l] = g_new  (gfloat, n);
+      f[l] = g_new0 (gfloat, n);
+    }
+
+  r = g_new (gfloat, size);
+
+  for (i = 0; i < size; i++)
+    u[0][i] = solve->data[i * depth + channel];
+
+  /* a grid too small to coarsen converges quickly on its own */
+  if (solve->n_levels == 1)
+    {
+      gimp_heal_laplace_smooth (level, u[0], f[0],
+                                COARSE_SWEEPS * MAX_CYCLES);
+    }
+  else
+    {
+      for (cycle = 0; cycle < MAX_CYCLES; cycle++)
+        {
+          if (gimp_heal_laplace_cycle (solve, 0, u, f, r) < TOLERANCE)
+            break;
+        }
+    }
+
+  for (i = 0; i < size; i++)
+    solve->data[i * depth + channel] = u[0][i];
+
+  for (l = 0; l < solve->n_levels; l++)
+    {
+      g_free (u[l]);
+      g_free (f[l]);
+    }
+
+  g_free (r);
+}
+
+static void
+gimp_heal_laplace_distribute (gint       i,
+                              gint       n,
+                              HealSolve *solve)
+{
+  gint channel;
+
+  for (channel = i; channel < solve->depth; channel += n)
+    gimp_heal_laplace_channel (solve, channel);
+}
@@ -0,0 +1,48 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpheal-laplace.h: Laplace solvers for the heal tool
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_HEAL_LAPLACE_H__
+#define __GIMP_HEAL_LAPLACE_H__
+
+
+/*  Both solvers solve the Laplace equation over the nodes of an
+ *  interleaved width x height x depth image for which mask is non-zero,
+ *  using the remaining nodes and the image border as Dirichlet
+ *  boundary conditions.
+ */
+
+void   gimp_heal_laplace_multigrid    (gfloat       *data,
+                                       gint          width,
+                                       gint          height,
+                                       gint          depth,
+                                       const guchar *mask);
+
+/*  The red/black over-relaxed Gauss-Seidel solver the heal tool used
+ *  before, kept as a reference for the multigrid solver's tests and
+ *  benchmarks.
+ */
+void   gimp_heal_laplace_gauss_seidel (gdouble      *matrix,
+                                       gint          height,
+                                       gint          depth,
+                                       gint          width,
+                                       gdouble      *solution,
+                                       const guchar *mask);
+
+
+#endif  /*  __GIMP_HEAL_LAPLACE_H__  */
@@ -17,8 +17,6 @@
 
 #include "config.h"
 
-#include <string.h>
-
 #include <gegl.h>
 
 #include "libgimpbase/gimpbase.h"
@@ -35,6 +33,7 @@
 #include "core/gimptempbuf.h"
 
 #include "gimpheal.h"
+#include "gimpheal-laplace.h"
 #include "gimpsourceoptions.h"
 
 #include "gimp-intl.h"
@@ -48,13 +47,8 @@
  * but subtract them I2 = I0 - I1, where I0 is the sample image to be
  * corrected, I1 is the reference pattern. Then we solve DeltaI=0
  * (Laplace) with I2 Dirichlet conditions at the borders of the
- * mask. The solver is a unoptimized red/black checker Gauss-Siedel
- * with an over-relaxation factor of 1.8. It can benefit from a
- * multi-grid evaluation of an initial solution before the main
- * iteration loop.
- *
- * I reduced the convergence criteria to 0.1% (0.001) as we are
- * dealing here with RGB integer components, more is overkill.
+ * mask. The solver is a multigrid solver working on single
+ * precision floats, see gimpheal-laplace.c.
  *
  * Jean-Yves Couleaud cjyves@free.fr
  */
@@ -143,7 +137,7 @@ gimp_heal_start (GimpPaintCore     *paint_core,
   return TRUE;
 }
 
-/* Subtract bottom from top and store in result as a double
+/* Subtract bottom from top and store in result as a float
  */
 static void
 gimp_heal_sub (GeglBuffer          *top_buffer,
@@ -171,15 +165,15 @@ gimp_heal_sub (GeglBuffer          *top_buffer,
                             GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
 
   gegl_buffer_iterator_add (iter, result_buffer, result_rect, 0,
-                            babl_format_n (babl_type ("double"), n_components),
+                            babl_format_n (babl_type ("float"), n_components),
                             GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
   while (gegl_buffer_iterator_next (iter))
     {
-      gfloat  *t      = iter->data[0];
-      gfloat  *b      = iter->data[1];
-      gdouble *r      = iter->data[2];
-      gint     length = iter->length * n_components;
+      gfloat *t      = iter->data[0];
+      gfloat *b      = iter->data[1];
+      gfloat *r      = iter->data[2];
+      gint    length = iter->length * n_components;
 
       while (length--)
         *r++ = *t++ - *b++;
@@ -208,7 +202,7 @@ gimp_heal_add (GeglBuffer          *first_buffer,
     g_return_if_reached ();
 
   iter = gegl_buffer_iterator_new (first_buffer, first_rect, 0,
-                                   babl_format_n (babl_type ("double"),
+                                   babl_format_n (babl_type ("float"),
                                                   n_components),
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
 
@@ -220,160 +214,16 @@ gimp_heal_add (GeglBuffer          *first_buffer,
 
   while (gegl_buffer_iterator_next (iter))
     {
-      gdouble *f      = iter->data[0];
-      gfloat  *s      = iter->data[1];
-      gfloat  *r      = iter->data[2];
-      gint     length = iter->length * n_components;
+      gfloat *f      = iter->data[0];
+      gfloat *s      = iter->data[1];
+      gfloat *r      = iter->data[2];
+      gint    length = iter->length * n_components;
 
       while (length--)
         *r++ = *f++ + *s++;
     }
 }
 
-/* Perform one iteration of the laplace solver for matrix.  Store the
- * result in solution and return the square of the cummulative error
- * of the solution.
- */
-static gdouble
-gimp_heal_laplace_iteration (gdouble *matrix,
-                             gint     height,
-                             gint     depth,
-                             gint     width,
-                             gdouble *solution,
-                             guchar  *mask)
-{
-  const gint    rowstride = width * depth;
-  gint          i, j, k, off, offm, offm0, off0;
-  gdouble       tmp, diff;
-  gdouble       err       = 0.0;
-  const gdouble w         = 1.80 * 0.25; /* Over-relaxation = 1.8 */
-
-  /* we use a red/black checker model of the discretization grid */
-
-  /* do reds */
-  for (i = 0; i < height; i++)
-    {
-      off0  = i * rowstride;
-      offm0 = i * width;
-
-      for (j = i % 2; j < width; j += 2)
-        {
-          off  = off0 + j * depth;
-          offm = offm0 + j;
-
-          if ((0 == mask[offm]) ||
-              (i == 0) || (i == (height - 1)) ||
-              (j == 0) || (j == (width - 1)))
-            {
-              /* do nothing at the boundary or outside mask */
-              for (k = 0; k < depth; k++)
-                solution[off + k] = matrix[off + k];
-            }
-          else
-            {
-              /* Use Gauss Siedel to get the correction factor then
-               * over-relax it
-               */
-              for (k = 0; k < depth; k++)
-                {
-                  tmp = solution[off + k];
-                  solution[off + k] = (matrix[off + k] +
-                                       w *
-                                       (matrix[off - depth + k] +     /* west */
-                                        matrix[off + depth + k] +     /* east */
-                                        matrix[off - rowstride + k] + /* north */
-                                        matrix[off + rowstride + k] - 4.0 *
-                                        matrix[off+k]));              /* south */
-
-                  diff = solution[off + k] - tmp;
-                  err += diff * diff;
-                }
-            }
-        }
-    }
-
-
-  /* Do blacks
-   *
-   * As we've done the reds earlier, we can use them right now to
-   * accelerate the convergence. So we have "solution" in the solver
-   * instead of "matrix" above
-   */
-  for (i = 0; i < height; i++)
-    {
-      off0 =  i * rowstride;
-      offm0 = i * width;
-
-      for (j = (i % 2) ? 0 : 1; j < width; j += 2)
-        {
-          off = off0 + j * depth;
-          offm = offm0 + j;
-
-          if ((0 == mask[offm]) ||
-              (i == 0) || (i == (height - 1)) ||
-              (j == 0) || (j == (width - 1)))
-            {
-              /* do nothing at the boundary or outside mask */
-              for (k = 0; k < depth; k++)
-                solution[off + k] = matrix[off + k];
-            }
-          else
-            {
-              /* Use Gauss Siedel to get the correction factor then
-               * over-relax it
-               */
-              for (k = 0; k < depth; k++)
-                {
-                  tmp = solution[off + k];
-                  solution[off + k] = (matrix[off + k] +
-                                       w *
-                                       (solution[off - depth + k] +     /* west */
-                                        solution[off + depth + k] +     /* east */
-                                        solution[off - rowstride + k] + /* north */
-                                        solution[off + rowstride + k] - 4.0 *
-                                        matrix[off+k]));                /* south */
-
-                  diff = solution[off + k] - tmp;
-                  err += diff*diff;
-                }
-            }
-        }
-    }
-
-  return err;
-}
-
-/* Solve the laplace equation for matrix and store the result in solution.
- */
-static void
-gimp_heal_laplace_loop (gdouble *matrix,
-                        gint     height,
-                        gint     depth,
-                        gint     width,
-                        gdouble *solution,
-                        guchar  *mask)
-{
-#define EPSILON   1e-8
-#define MAX_ITER  500
-  gint i;
-
-  /* repeat until convergence or max iterations */
-  for (i = 0; i < MAX_ITER; i++)
-    {
-      gdouble sqr_err;
-
-      /* do one iteration and store the amount of error */
-      sqr_err = gimp_heal_laplace_iteration (matrix, height, depth, width,
-                                             solution, mask);
-
-      /* copy solution to matrix */
-      memcpy (matrix, solution, width * height * depth * sizeof (double));
-
-      if (sqr_err < EPSILON)
-        break;
-    }
-}
-
 /* Original Algorithm Design:
  *
  * T. Georgiev, "Photoshop Healing Brush: a Tool for Seamless Cloning
@@ -393,10 +243,8 @@ gimp_heal (GeglBuffer          *src_buffer,
   gint        dest_components;
   gint        width;
   gint        height;
-  gdouble    *i_1;
-  gdouble    *i_2;
-  GeglBuffer *i_1_buffer;
-  GeglBuffer *i_2_buffer;
+  gfloat     *diff;
+  GeglBuffer *diff_buffer;
   guchar     *mask;
 
   src_format  = gegl_buffer_get_format (src_buffer);
@@ -410,46 +258,36 @@ gimp_heal (GeglBuffer          *src_buffer,
 
   g_return_if_fail (src_components == dest_components);
 
-  i_1  = g_new (gdouble, width * height * src_components);
-  i_2  = g_new (gdouble, width * height * src_components);
+  diff = g_new (gfloat, width * height * src_components);
 
-  i_1_buffer =
-    gegl_buffer_linear_new_from_data (i_1,
-                                      babl_format_n (babl_type ("double"),
-                                                     src_components),
-                                      GEGL_RECTANGLE (0, 0, width, height),
-                                      GEGL_AUTO_ROWSTRIDE,
-                                      (GDestroyNotify) g_free, i_1);
-  i_2_buffer =
-    gegl_buffer_linear_new_from_data (i_2,
-                                      babl_format_n (babl_type ("double"),
+  diff_buffer =
+    gegl_buffer_linear_new_from_data (diff,
+                                      babl_format_n (babl_type ("float"),
                                                      src_components),
                                       GEGL_RECTANGLE (0, 0, width, height),
                                       GEGL_AUTO_ROWSTRIDE,
-                                      (GDestroyNotify) g_free, i_2);
+                                      (GDestroyNotify) g_free, diff);
 
-  /* subtract pattern from image and store the result as a double in i_1 */
+  /* subtract pattern from image and store the result as a float in diff */
   gimp_heal_sub (dest_buffer, dest_rect,
                  src_buffer, src_rect,
-                 i_1_buffer, GEGL_RECTANGLE (0, 0, width, height));
+                 diff_buffer, GEGL_RECTANGLE (0, 0, width, height));
 
   mask = g_new (guchar, mask_rect->width * mask_rect->height);
 
   gegl_buffer_get (mask_buffer, mask_rect, 1.0, babl_format ("Y u8"),
                    mask, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-  /* FIXME: is a faster implementation needed? */
-  gimp_heal_laplace_loop (i_1, height, src_components, width, i_2, mask);
+  gimp_heal_laplace_multigrid (diff, width, height, src_components, mask);
 
   g_free (mask);
 
   /* add solution to original image and store in dest */
-  gimp_heal_add (i_2_buffer, GEGL_RECTANGLE (0, 0, width, height),
+  gimp_heal_add (diff_buffer, GEGL_RECTANGLE (0, 0, width, height),
                  src_buffer, src_rect,
                  dest_buffer, dest_rect);
 
-  g_object_unref (i_1_buffer);
-  g_object_unref (i_2_buffer);
+  g_object_unref (diff_buffer);
 }
 
 static void
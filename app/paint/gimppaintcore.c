@@ -30,6 +30,7 @@
 #include "gegl/gimp-gegl-nodes.h"
 #include "gegl/gimp-gegl-utils.h"
 #include "gegl/gimpapplicator.h"
+#include "gegl/gimptilehandlersnapshot.h"
 
 #include "core/gimp.h"
 #include "core/gimp-utils.h"
@@ -106,6 +107,18 @@ static GimpUndo* gimp_paint_core_real_push_undo      (GimpPaintCore    *core,
                                                       GimpImage        *image,
                                                       const gchar      *undo_desc);
 
+static GeglBuffer *
+               gimp_paint_core_new_snapshot          (GeglBuffer       *buffer,
+                                                      gpointer         *handler);
+static void      gimp_paint_core_free_snapshot       (GeglBuffer      **snapshot,
+                                                      gpointer         *handler);
+static void      gimp_paint_core_take_snapshot       (GimpPaintCore    *core,
+                                                      GimpDrawable     *drawable,
+                                                      gint              x,
+                                                      gint              y,
+                                                      gint              width,
+                                                      gint              height);
+
 
 G_DEFINE_TYPE (GimpPaintCore, gimp_paint_core, GIMP_TYPE_OBJECT)
 
@@ -360,25 +373,26 @@ gimp_paint_core_start (GimpPaintCore     *core,
       return FALSE;
     }
 
-  /*  Allocate the undo structure  */
-  if (core->undo_buffer)
-    g_object_unref (core->undo_buffer);
+  /*  Allocate the undo structure, its tiles are copied when they
+   *  are first painted on
+   */
+  gimp_paint_core_free_snapshot (&core->undo_buffer, &core->undo_handler);
 
-  core->undo_buffer = gegl_buffer_dup (gimp_drawable_get_buffer (drawable));
+  core->undo_buffer =
+    gimp_paint_core_new_snapshot (gimp_drawable_get_buffer (drawable),
+                                  &core->undo_handler);
 
   /*  Allocate the saved proj structure  */
-  if (core->saved_proj_buffer)
-    {
-      g_object_unref (core->saved_proj_buffer);
-      core->saved_proj_buffer = NULL;
-    }
+  gimp_paint_core_free_snapshot (&core->saved_proj_buffer,
+                                 &core->saved_proj_handler);
 
   if (core->use_saved_proj)
     {
       GimpPickable *pickable = GIMP_PICKABLE (gimp_image_get_projection (image));
       GeglBuffer   *buffer   = gimp_pickable_get_buffer (pickable);
 
-      core->saved_proj_buffer = gegl_buffer_dup (buffer);
+      core->saved_proj_buffer =
+        gimp_paint_core_new_snapshot (buffer, &core->saved_proj_handler);
     }
 
   /*  Allocate the canvas blocks structure  */
@@ -500,14 +514,9 @@ gimp_paint_core_finish (GimpPaintCore *core,
       gimp_image_undo_group_end (image);
     }
 
-  g_object_unref (core->undo_buffer);
-  core->undo_buffer = NULL;
-
-  if (core->saved_proj_buffer)
-    {
-      g_object_unref (core->saved_proj_buffer);
-      core->saved_proj_buffer = NULL;
-    }
+  gimp_paint_core_free_snapshot (&core->undo_buffer, &core->undo_handler);
+  gimp_paint_core_free_snapshot (&core->saved_proj_buffer,
+                                 &core->saved_proj_handler);
 
   gimp_viewable_preview_thaw (GIMP_VIEWABLE (drawable));
 }
@@ -543,14 +552,9 @@ gimp_paint_core_cancel (GimpPaintCore *core,
                         GEGL_RECTANGLE (x, y, width, height));
     }
 
-  g_object_unref (core->undo_buffer);
-  core->undo_buffer = NULL;
-
-  if (core->saved_proj_buffer)
-    {
-      g_object_unref (core->saved_proj_buffer);
-      core->saved_proj_buffer = NULL;
-    }
+  gimp_paint_core_free_snapshot (&core->undo_buffer, &core->undo_handler);
+  gimp_paint_core_free_snapshot (&core->saved_proj_buffer,
+                                 &core->saved_proj_handler);
 
   gimp_drawable_update (drawable, x, y, width, height);
 
@@ -562,17 +566,9 @@ gimp_paint_core_cleanup (GimpPaintCore *core)
 {
   g_return_if_fail (GIMP_IS_PAINT_CORE (core));
 
-  if (core->undo_buffer)
-    {
-      g_object_unref (core->undo_buffer);
-      core->undo_buffer = NULL;
-    }
-
-  if (core->saved_proj_buffer)
-    {
-      g_object_unref (core->saved_proj_buffer);
-      core->saved_proj_buffer = NULL;
-    }
+  gimp_paint_core_free_snapshot (&core->undo_buffer, &core->undo_handler);
+  gimp_paint_core_free_snapshot (&core->saved_proj_buffer,
+                                 &core->saved_proj_handler);
 
   if (core->canvas_buffer)
     {
@@ -801,6 +797,11 @@ gimp_paint_core_paste (GimpPaintCore            *core,
   gimp_applicator_set_mode (core->applicator,
                             image_opacity, paint_mode);
 
+  gimp_paint_core_take_snapshot (core, drawable,
+                                 core->paint_buffer_x,
+                                 core->paint_buffer_y,
+                                 width, height);
+
   /*  apply the paint area to the image  */
   gimp_applicator_blit (core->applicator,
                         GEGL_RECTANGLE (core->paint_buffer_x,
@@ -881,6 +882,11 @@ gimp_paint_core_replace (GimpPaintCore            *core,
       mask_rect = *paint_mask_rect;
     }
 
+  gimp_paint_core_take_snapshot (core, drawable,
+                                 core->paint_buffer_x,
+                                 core->paint_buffer_y,
+                                 width, height);
+
   /*  apply the paint area to the image  */
   gimp_drawable_replace_buffer (drawable, core->paint_buffer,
                                 GEGL_RECTANGLE (0, 0, width, height),
@@ -969,3 +975,71 @@ gimp_paint_core_smooth_coords (GimpPaintCore    *core,
         }
     }
 }
+
+
+/*  private functions  */
+
+/*  a buffer that reads like a copy of @buffer, but only holds the
+ *  tiles which were fetched or taken before @buffer changed them
+ */
+static GeglBuffer *
+gimp_paint_core_new_snapshot (GeglBuffer *buffer,
+                              gpointer   *handler)
+{
+  GeglBuffer *snapshot;
+
+  snapshot = gegl_buffer_new (gegl_buffer_get_extent (buffer),
+                              gegl_buffer_get_format (buffer));
+
+  *handler = gimp_tile_handler_snapshot_new (buffer);
+  gegl_buffer_add_handler (snapshot, *handler);
+
+  return snapshot;
+}
+
+static void
+gimp_paint_core_free_snapshot (GeglBuffer **snapshot,
+                               gpointer    *handler)
+{
+  if (*snapshot)
+    {
+      if (*handler)
+        gegl_buffer_remove_handler (*snapshot, *handler);
+
+      g_object_unref (*snapshot);
+      *snapshot = NULL;
+    }
+
+  if (*handler)
+    {
+      g_object_unref (*handler);
+      *handler = NULL;
+    }
+}
+
+/*  keep the original pixels of an area before painting on it  */
+static void
+gimp_paint_core_take_snapshot (GimpPaintCore *core,
+                               GimpDrawable  *drawable,
+                               gint           x,
+                               gint           y,
+                               gint           width,
+                               gint           height)
+{
+  if (core->undo_handler)
+    gimp_tile_handler_snapshot_take (core->undo_handler,
+                                     x, y, width, height);
+
+  /*  the projection changes where the drawable changes  */
+  if (core->saved_proj_handler)
+    {
+      gint offset_x;
+      gint offset_y;
+
+      gimp_item_get_offset (GIMP_ITEM (drawable), &offset_x, &offset_y);
+
+      gimp_tile_handler_snapshot_take (core->saved_proj_handler,
+                                       x + offset_x, y + offset_y,
+                                       width, height);
+    }
+}
@@ -59,6 +59,9 @@ struct _GimpPaintCore
   GeglBuffer  *saved_proj_buffer; /*  proj tiles which have been modified */
   GeglBuffer  *canvas_buffer;     /*  the buffer to paint the mask to     */
 
+  gpointer     undo_handler;       /*  fills undo_buffer on demand        */
+  gpointer     saved_proj_handler; /*  fills saved_proj_buffer on demand  */
+
   GeglBuffer  *paint_buffer;      /*  the buffer to paint pixels to       */
   gint         paint_buffer_x;
   gint         paint_buffer_y;
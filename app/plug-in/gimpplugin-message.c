@@ -62,6 +62,21 @@ static void gimp_plug_in_handle_tile_put         (GimpPlugIn      *plug_in,
                                                   GPTileReq       *request);
 static void gimp_plug_in_handle_tile_get         (GimpPlugIn      *plug_in,
                                                   GPTileReq       *request);
+static void gimp_plug_in_handle_tile_map_req     (GimpPlugIn      *plug_in,
+                                                  GPTileMap       *request);
+static void gimp_plug_in_handle_tile_commit      (GimpPlugIn      *plug_in,
+                                                  GPTileMap       *request);
+static void gimp_plug_in_handle_tile_list_req    (GimpPlugIn      *plug_in,
+                                                  GPTileList      *request);
+static void gimp_plug_in_invalid_tile            (GimpPlugIn      *plug_in);
+static GeglBuffer *
+            gimp_plug_in_get_tile_buffer         (GimpPlugIn      *plug_in,
+                                                  gint32           drawable_ID,
+                                                  guint            tile_num,
+                                                  gboolean         shadow,
+                                                  gboolean         write,
+                                                  const Babl     **format,
+                                                  GeglRectangle   *tile_rect);
 static void gimp_plug_in_handle_proc_run         (GimpPlugIn      *plug_in,
                                                   GPProcRun       *proc_run);
 static void gimp_plug_in_handle_proc_return      (GimpPlugIn      *plug_in,
@@ -159,6 +174,36 @@ gimp_plug_in_handle_message (GimpPlugIn      *plug_in,
     case GP_HAS_INIT:
       gimp_plug_in_handle_has_init (plug_in);
       break;
+
+    case GP_TILE_MAP_REQ:
+      gimp_plug_in_handle_tile_map_req (plug_in, msg->data);
+      break;
+
+    case GP_TILE_MAP_DATA:
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent a TILE_MAP_DATA message.  This should not happen.",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      break;
+
+    case GP_TILE_COMMIT:
+      gimp_plug_in_handle_tile_commit (plug_in, msg->data);
+      break;
+
+    case GP_TILE_LIST_REQ:
+      gimp_plug_in_handle_tile_list_req (plug_in, msg->data);
+      break;
+
+    case GP_TILE_LIST_DATA:
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent a TILE_LIST_DATA message.  This should not happen.",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      break;
     }
 }
 
@@ -468,6 +513,302 @@ gimp_plug_in_handle_tile_get (GimpPlugIn *plug_in,
   gimp_wire_destroy (&msg);
 }
 
+static void
+gimp_plug_in_handle_tile_map_req (GimpPlugIn *plug_in,
+                                  GPTileMap  *request)
+{
+  GimpPlugInShm *shm = plug_in->manager->shm;
+  GPTileMap      tile_map;
+  gint           i;
+
+  g_return_if_fail (request != NULL);
+
+  /*  an empty reply makes the plug-in fall back to GP_TILE_REQ  */
+  tile_map.offset  = 0;
+  tile_map.n_tiles = 0;
+  tile_map.tiles   = request->tiles;
+
+  if (shm && plug_in->tile_window == -1)
+    plug_in->tile_window = gimp_plug_in_shm_acquire_window (shm);
+
+  if (plug_in->tile_window != -1)
+    {
+      for (i = 0; i < request->n_tiles; i++)
+        {
+          GPTileMapInfo *info = &request->tiles[i];
+          GeglBuffer    *buffer;
+          const Babl    *format;
+          GeglRectangle  tile_rect;
+
+          if (info->slot >= GP_TILE_WINDOW_SIZE)
+            {
+              gimp_plug_in_invalid_tile (plug_in);
+              return;
+            }
+
+          buffer = gimp_plug_in_get_tile_buffer (plug_in,
+                                                 info->drawable_ID,
+                                                 info->tile_num,
+                                                 info->shadow,
+                                                 FALSE,
+                                                 &format, &tile_rect);
+
+          if (! buffer)
+            return;
+
+          gegl_buffer_get (buffer, &tile_rect, 1.0, format,
+                           gimp_plug_in_shm_get_slot_addr (shm,
+                                                           plug_in->tile_window,
+                                                           info->slot),
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+        }
+
+      tile_map.offset  =
+        gimp_plug_in_shm_get_window_offset (shm, plug_in->tile_window);
+      tile_map.n_tiles = request->n_tiles;
+    }
+
+  if (! gp_tile_map_data_write (plug_in->my_write, &tile_map, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+}
+
+static void
+gimp_plug_in_handle_tile_commit (GimpPlugIn *plug_in,
+                                 GPTileMap  *request)
+{
+  GimpPlugInShm *shm = plug_in->manager->shm;
+  gint           i;
+
+  g_return_if_fail (request != NULL);
+
+  if (plug_in->tile_window == -1)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent a TILE_COMMIT message without mapping tiles "
+                    "(killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  for (i = 0; i < request->n_tiles; i++)
+    {
+      GPTileMapInfo *info = &request->tiles[i];
+      GeglBuffer    *buffer;
+      const Babl    *format;
+      GeglRectangle  tile_rect;
+
+      if (info->slot >= GP_TILE_WINDOW_SIZE)
+        {
+          gimp_plug_in_invalid_tile (plug_in);
+          return;
+        }
+
+      buffer = gimp_plug_in_get_tile_buffer (plug_in,
+                                             info->drawable_ID,
+                                             info->tile_num,
+                                             info->shadow,
+                                             TRUE,
+                                             &format, &tile_rect);
+
+      if (! buffer)
+        return;
+
+      gegl_buffer_set (buffer, &tile_rect, 0, format,
+                       gimp_plug_in_shm_get_slot_addr (shm,
+                                                       plug_in->tile_window,
+                                                       info->slot),
+                       GEGL_AUTO_ROWSTRIDE);
+    }
+
+  if (! gp_tile_ack_write (plug_in->my_write, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+}
+
+static void
+gimp_plug_in_handle_tile_list_req (GimpPlugIn *plug_in,
+                                   GPTileList *request)
+{
+  GPTileDataList  tile_list;
+  gint            i;
+
+  g_return_if_fail (request != NULL);
+
+  tile_list.n_tiles = request->n_tiles;
+  tile_list.tiles   = g_new0 (GPTileData, request->n_tiles);
+
+  for (i = 0; i < request->n_tiles; i++)
+    {
+      GPTileReq     *tile_req  = &request->tiles[i];
+      GPTileData    *tile_data = &tile_list.tiles[i];
+      GeglBuffer    *buffer;
+      const Babl    *format;
+      GeglRectangle  tile_rect;
+      gint           bpp;
+
+      buffer = gimp_plug_in_get_tile_buffer (plug_in,
+                                             tile_req->drawable_ID,
+                                             tile_req->tile_num,
+                                             tile_req->shadow,
+                                             FALSE,
+                                             &format, &tile_rect);
+
+      if (! buffer)
+        {
+          tile_list.n_tiles = i;
+          goto cleanup;
+        }
+
+      bpp = babl_format_get_bytes_per_pixel (format);
+
+      tile_data->drawable_ID = tile_req->drawable_ID;
+      tile_data->tile_num    = tile_req->tile_num;
+      tile_data->shadow      = tile_req->shadow;
+      tile_data->bpp         = bpp;
+      tile_data->width       = tile_rect.width;
+      tile_data->height      = tile_rect.height;
+      tile_data->use_shm     = FALSE;
+      tile_data->data        = g_malloc (bpp *
+                                         tile_rect.width * tile_rect.height);
+
+      gegl_buffer_get (buffer, &tile_rect, 1.0, format,
+                       tile_data->data,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+    }
+
+  if (! gp_tile_list_data_write (plug_in->my_write, &tile_list, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+    }
+
+ cleanup:
+  for (i = 0; i < tile_list.n_tiles; i++)
+    g_free (tile_list.tiles[i].data);
+
+  g_free (tile_list.tiles);
+}
+
+static void
+gimp_plug_in_invalid_tile (GimpPlugIn *plug_in)
+{
+  gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                "Plug-In \"%s\"\n(%s)\n\n"
+                "requested invalid tile (killing)",
+                gimp_object_get_name (plug_in),
+                gimp_filename_to_utf8 (plug_in->prog));
+  gimp_plug_in_close (plug_in, TRUE);
+}
+
+/*  performs the same checks as the GP_TILE_REQ handlers above, and
+ *  closes the plug-in and returns NULL if the tile is not accessible
+ */
+static GeglBuffer *
+gimp_plug_in_get_tile_buffer (GimpPlugIn     *plug_in,
+                              gint32          drawable_ID,
+                              guint           tile_num,
+                              gboolean        shadow,
+                              gboolean        write,
+                              const Babl    **format,
+                              GeglRectangle  *tile_rect)
+{
+  GimpDrawable *drawable;
+  GeglBuffer   *buffer;
+
+  drawable = (GimpDrawable *) gimp_item_get_by_ID (plug_in->manager->gimp,
+                                                   drawable_ID);
+
+  if (! GIMP_IS_DRAWABLE (drawable))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried accessing invalid drawable %d (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog),
+                    drawable_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return NULL;
+    }
+  else if (gimp_item_is_removed (GIMP_ITEM (drawable)))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried accessing drawable %d which was removed "
+                    "from the image (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog),
+                    drawable_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return NULL;
+    }
+
+  if (shadow)
+    {
+      buffer = gimp_drawable_get_shadow_buffer (drawable);
+
+      gimp_plug_in_cleanup_add_shadow (plug_in, drawable);
+    }
+  else
+    {
+      if (write && gimp_item_is_content_locked (GIMP_ITEM (drawable)))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "tried writing to a locked drawable %d (killing)",
+                        gimp_object_get_name (plug_in),
+                        gimp_filename_to_utf8 (plug_in->prog),
+                        drawable_ID);
+          gimp_plug_in_close (plug_in, TRUE);
+          return NULL;
+        }
+      else if (write && gimp_viewable_get_children (GIMP_VIEWABLE (drawable)))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "tried writing to a group layer %d (killing)",
+                        gimp_object_get_name (plug_in),
+                        gimp_filename_to_utf8 (plug_in->prog),
+                        drawable_ID);
+          gimp_plug_in_close (plug_in, TRUE);
+          return NULL;
+        }
+
+      buffer = gimp_drawable_get_buffer (drawable);
+    }
+
+  if (! gimp_gegl_buffer_get_tile_rect (buffer,
+                                        GIMP_PLUG_IN_TILE_WIDTH,
+                                        GIMP_PLUG_IN_TILE_HEIGHT,
+                                        tile_num,
+                                        tile_rect))
+    {
+      gimp_plug_in_invalid_tile (plug_in);
+      return NULL;
+    }
+
+  *format = gegl_buffer_get_format (buffer);
+
+  if (! gimp_plug_in_precision_enabled (plug_in))
+    {
+      *format = gimp_babl_compat_u8_format (*format);
+    }
+
+  return buffer;
+}
+
 static void
 gimp_plug_in_handle_proc_error (GimpPlugIn          *plug_in,
                                 GimpPlugInProcFrame *proc_frame,
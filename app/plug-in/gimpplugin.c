@@ -93,6 +93,7 @@
 #include "gimppluginmanager.h"
 #include "gimppluginmanager-help-domain.h"
 #include "gimppluginmanager-locale-domain.h"
+#include "gimppluginshm.h"
 #include "gimptemporaryprocedure.h"
 #include "plug-in-params.h"
 
@@ -158,6 +159,8 @@ gimp_plug_in_init (GimpPlugIn *plug_in)
   plug_in->input_id           = 0;
   plug_in->write_buffer_index = 0;
 
+  plug_in->tile_window        = -1;
+
   plug_in->temp_procedures    = NULL;
 
   plug_in->ext_main_loop      = NULL;
@@ -529,6 +532,14 @@ gimp_plug_in_close (GimpPlugIn *plug_in,
       plug_in->his_write = NULL;
     }
 
+  /* Give the plug-in's tile window back to other plug-ins. */
+  if (plug_in->tile_window != -1)
+    {
+      gimp_plug_in_shm_release_window (plug_in->manager->shm,
+                                       plug_in->tile_window);
+      plug_in->tile_window = -1;
+    }
+
   gimp_wire_clear_error ();
 
   while (plug_in->temp_proc_frames)
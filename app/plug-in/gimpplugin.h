@@ -60,6 +60,8 @@ struct _GimpPlugIn
   gchar                write_buffer[WRITE_BUFFER_SIZE]; /* Buffer for writing */
   gint                 write_buffer_index;              /* Buffer index       */
 
+  gint                 tile_window;     /*  Shared memory tile window, or -1  */
+
   GSList              *temp_procedures; /*  Temporary procedures              */
 
   GMainLoop           *ext_main_loop;   /*  for waiting for extension_ack     */
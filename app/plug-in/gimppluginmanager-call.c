@@ -19,6 +19,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <gegl.h>
 
 #include "libgimpbase/gimpbase.h"
@@ -48,6 +50,11 @@
 #include "gimp-intl.h"
 
 
+static gboolean   gimp_plug_in_manager_query_recv_message (GIOChannel   *channel,
+                                                           GIOCondition  cond,
+                                                           gpointer      data);
+
+
 /*  public functions  */
 
 void
@@ -90,6 +97,110 @@ gimp_plug_in_manager_call_query (GimpPlugInManager *manager,
     }
 }
 
+void
+gimp_plug_in_manager_call_query_all (GimpPlugInManager  *manager,
+                                     GimpContext        *context,
+                                     GSList             *plug_in_defs,
+                                     gint                max_running,
+                                     GimpInitStatusFunc  status_callback)
+{
+  GMainContext *main_context;
+  GSList       *running   = NULL;
+  gint          n_running = 0;
+  gint          n_plugins;
+  gint          nth       = 0;
+
+  g_return_if_fail (GIMP_IS_PLUG_IN_MANAGER (manager));
+  g_return_if_fail (GIMP_IS_PDB_CONTEXT (context));
+  g_return_if_fail (status_callback != NULL);
+
+  max_running = MAX (max_running, 1);
+  n_plugins   = g_slist_length (plug_in_defs);
+
+  /*  the plug-ins' messages are dispatched from a context of our own,
+   *  so nothing else runs while they are being queried
+   */
+  main_context = g_main_context_new ();
+
+  while (plug_in_defs || running)
+    {
+      GSList *list;
+
+      /*  start plug-ins in list order until the pool is full  */
+      while (plug_in_defs && n_running < max_running)
+        {
+          GimpPlugInDef *plug_in_def = plug_in_defs->data;
+          GimpPlugIn    *plug_in;
+          gchar         *basename;
+
+          plug_in_defs = plug_in_defs->next;
+
+          basename = g_filename_display_basename (plug_in_def->prog);
+          status_callback (NULL, basename,
+                           (gdouble) nth++ / (gdouble) n_plugins);
+          g_free (basename);
+
+          if (manager->gimp->be_verbose)
+            g_print ("Querying plug-in: '%s'\n",
+                     gimp_filename_to_utf8 (plug_in_def->prog));
+
+          plug_in = gimp_plug_in_new (manager, context, NULL,
+                                      NULL, plug_in_def->prog);
+
+          if (! plug_in)
+            continue;
+
+          plug_in->plug_in_def = plug_in_def;
+
+          if (gimp_plug_in_open (plug_in, GIMP_PLUG_IN_CALL_QUERY, TRUE))
+            {
+              GSource *source;
+
+              source = g_io_create_watch (plug_in->my_read,
+                                          G_IO_IN  | G_IO_PRI |
+                                          G_IO_ERR | G_IO_HUP);
+
+              g_source_set_callback (source,
+                                     (GSourceFunc) gimp_plug_in_manager_query_recv_message,
+                                     plug_in, NULL);
+
+              g_source_attach (source, main_context);
+              g_source_unref (source);
+
+              running = g_slist_append (running, plug_in);
+              n_running++;
+            }
+          else
+            {
+              g_object_unref (plug_in);
+            }
+        }
+
+      if (! running)
+        continue;
+
+      g_main_context_iteration (main_context, TRUE);
+
+      /*  reap the plug-ins that are done, making room for the next ones  */
+      for (list = running; list; )
+        {
+          GimpPlugIn *plug_in = list->data;
+
+          list = g_slist_next (list);
+
+          if (! plug_in->open)
+            {
+              running = g_slist_remove (running, plug_in);
+              n_running--;
+
+              g_object_unref (plug_in);
+            }
+        }
+    }
+
+  g_main_context_unref (main_context);
+}
+
 void
 gimp_plug_in_manager_call_init (GimpPlugInManager *manager,
                                 GimpContext       *context,
@@ -349,3 +460,47 @@ gimp_plug_in_manager_call_run_temp (GimpPlugInManager      *manager,
 
   return return_vals;
 }
+
+
+/*  private functions  */
+
+static gboolean
+gimp_plug_in_manager_query_recv_message (GIOChannel   *channel,
+                                         GIOCondition  cond,
+                                         gpointer      data)
+{
+  GimpPlugIn *plug_in = data;
+
+  if (! plug_in->open)
+    return FALSE;
+
+  /*  read one message at a time, so the other plug-ins get their turn;
+   *  a failed read is handled right away, the wire error is global
+   */
+  if (cond & (G_IO_IN | G_IO_PRI))
+    {
+      GimpWireMessage msg;
+
+      memset (&msg, 0, sizeof (GimpWireMessage));
+
+      if (! gimp_wire_read_msg (plug_in->my_read, &msg, plug_in))
+        {
+          gimp_plug_in_close (plug_in, TRUE);
+        }
+      else
+        {
+          gimp_plug_in_handle_message (plug_in, &msg);
+          gimp_wire_destroy (&msg);
+        }
+    }
+  else if (cond & (G_IO_ERR | G_IO_HUP))
+    {
+      /*  the plug-in exited after its last message, don't ask it to  */
+      if (cond & G_IO_HUP)
+        plug_in->hup = TRUE;
+
+      gimp_plug_in_close (plug_in, TRUE);
+    }
+
+  return plug_in->open;
+}
@@ -31,6 +31,16 @@ void             gimp_plug_in_manager_call_query    (GimpPlugInManager      *man
                                                      GimpContext            *context,
                                                      GimpPlugInDef          *plug_in_def);
 
+/*  Call the query() functions of a list of plug-ins, running up to
+ *  max_running of them at once
+ */
+void             gimp_plug_in_manager_call_query_all
+                                                    (GimpPlugInManager      *manager,
+                                                     GimpContext            *context,
+                                                     GSList                 *plug_in_defs,
+                                                     gint                    max_running,
+                                                     GimpInitStatusFunc      status_callback);
+
 /*  Call the plug-in's init() function
  */
 void             gimp_plug_in_manager_call_init     (GimpPlugInManager      *manager,
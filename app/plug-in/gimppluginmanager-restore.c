@@ -31,6 +31,7 @@
 #include "config/gimpcoreconfig.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 
 #include "pdb/gimppdb.h"
 #include "pdb/gimppdbcontext.h"
@@ -329,30 +330,33 @@ gimp_plug_in_manager_query_new (GimpPlugInManager  *manager,
 
   if (n_plugins)
     {
-      gint nth;
+      GSList *query_defs = NULL;
+      gint    max_running;
 
       manager->write_pluginrc = TRUE;
 
-      for (list = manager->plug_in_defs, nth = 0; list; list = list->next)
+      for (list = manager->plug_in_defs; list; list = list->next)
         {
           GimpPlugInDef *plug_in_def = list->data;
 
           if (plug_in_def->needs_query)
-            {
-              gchar *basename;
+            query_defs = g_slist_prepend (query_defs, plug_in_def);
+        }
 
-              basename = g_filename_display_basename (plug_in_def->prog);
-              status_callback (NULL, basename,
-                               (gdouble) nth++ / (gdouble) n_plugins);
-              g_free (basename);
+      query_defs = g_slist_reverse (query_defs);
 
-              if (manager->gimp->be_verbose)
-                g_print ("Querying plug-in: '%s'\n",
-                         gimp_filename_to_utf8 (plug_in_def->prog));
+      /*  query as many plug-ins at once as we use processors, their
+       *  results end up in their own plug-in-defs, which keep their
+       *  order in manager->plug_in_defs, so pluginrc doesn't depend on
+       *  which plug-in finished first.  One at a time when debugging
+       *  plug-ins, though.
+       */
+      max_running = manager->debug ? 1 : gimp_parallel_get_n_threads ();
 
-              gimp_plug_in_manager_call_query (manager, context, plug_in_def);
-            }
-        }
+      gimp_plug_in_manager_call_query_all (manager, context, query_defs,
+                                           max_running, status_callback);
+
+      g_slist_free (query_defs);
     }
 
   status_callback (NULL, "", 1.0);
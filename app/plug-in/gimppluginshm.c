@@ -61,6 +61,9 @@
 
 #endif /* G_OS_WIN32 || G_WITH_CYGWIN */
 
+#include "libgimpbase/gimpbase.h"
+#include "libgimpbase/gimpprotocol.h"
+
 #include "plug-in-types.h"
 
 #include "core/gimp-utils.h"
@@ -72,6 +75,10 @@
 
 #define TILE_MAP_SIZE (GIMP_PLUG_IN_TILE_WIDTH * GIMP_PLUG_IN_TILE_HEIGHT * 16)
 
+/*  one tile for the GP_TILE_DATA transport, followed by the tile windows  */
+#define SHM_SIZE      (TILE_MAP_SIZE * \
+                       (1 + GP_TILE_N_WINDOWS * GP_TILE_WINDOW_SIZE))
+
 #define ERRMSG_SHM_DISABLE "Disabling shared memory tile transport"
 
 
@@ -79,6 +86,7 @@ struct _GimpPlugInShm
 {
   gint    shm_ID;
   guchar *shm_addr;
+  guint   windows;  /*  bit mask of the tile windows in use  */
 
 #if defined(USE_WIN32_SHM)
   HANDLE  shm_handle;
@@ -102,7 +110,7 @@ gimp_plug_in_shm_new (void)
 
   /* Use SysV shared memory mechanisms for transferring tile data. */
   {
-    shm->shm_ID = shmget (IPC_PRIVATE, TILE_MAP_SIZE, IPC_CREAT | 0600);
+    shm->shm_ID = shmget (IPC_PRIVATE, SHM_SIZE, IPC_CREAT | 0600);
 
     if (shm->shm_ID != -1)
       {
@@ -144,7 +152,7 @@ gimp_plug_in_shm_new (void)
     /* Create the file mapping into paging space */
     shm->shm_handle = CreateFileMapping (INVALID_HANDLE_VALUE, NULL,
                                          PAGE_READWRITE, 0,
-                                         TILE_MAP_SIZE,
+                                         SHM_SIZE,
                                          fileMapName);
 
     if (shm->shm_handle)
@@ -152,7 +160,7 @@ gimp_plug_in_shm_new (void)
         /* Map the shared memory into our address space for use */
         shm->shm_addr = (guchar *) MapViewOfFile (shm->shm_handle,
                                                   FILE_MAP_ALL_ACCESS,
-                                                  0, 0, TILE_MAP_SIZE);
+                                                  0, 0, SHM_SIZE);
 
         /* Verify that we mapped our view */
         if (shm->shm_addr)
@@ -191,10 +199,10 @@ gimp_plug_in_shm_new (void)
 
     if (shm_fd != -1)
       {
-        if (ftruncate (shm_fd, TILE_MAP_SIZE) != -1)
+        if (ftruncate (shm_fd, SHM_SIZE) != -1)
           {
             /* Map the shared memory into our address space for use */
-            shm->shm_addr = (guchar *) mmap (NULL, TILE_MAP_SIZE,
+            shm->shm_addr = (guchar *) mmap (NULL, SHM_SIZE,
                                              PROT_READ | PROT_WRITE, MAP_SHARED,
                                              shm_fd, 0);
 
@@ -268,7 +276,7 @@ gimp_plug_in_shm_free (GimpPlugInShm *shm)
 
       gchar shm_handle[32];
 
-      munmap (shm->shm_addr, TILE_MAP_SIZE);
+      munmap (shm->shm_addr, SHM_SIZE);
 
       g_snprintf (shm_handle, sizeof (shm_handle), "/gimp-shm-%d",
                   shm->shm_ID);
@@ -298,3 +306,68 @@ gimp_plug_in_shm_get_addr (GimpPlugInShm *shm)
 
   return shm->shm_addr;
 }
+
+/**
+ * gimp_plug_in_shm_acquire_window:
+ * @shm: a #GimpPlugInShm
+ *
+ * Reserves one of the tile windows of the segment, which a single
+ * plug-in uses to access tiles in place. Returns the window's index,
+ * or -1 if all windows are in use.
+ **/
+gint
+gimp_plug_in_shm_acquire_window (GimpPlugInShm *shm)
+{
+  gint window;
+
+  g_return_val_if_fail (shm != NULL, -1);
+
+  for (window = 0; window < GP_TILE_N_WINDOWS; window++)
+    {
+      if (! (shm->windows & (1 << window)))
+        {
+          shm->windows |= 1 << window;
+
+          GIMP_LOG (SHM, "acquired tile window %d", window);
+
+          return window;
+        }
+    }
+
+  return -1;
+}
+
+void
+gimp_plug_in_shm_release_window (GimpPlugInShm *shm,
+                                 gint           window)
+{
+  g_return_if_fail (shm != NULL);
+  g_return_if_fail (window >= 0 && window < GP_TILE_N_WINDOWS);
+
+  shm->windows &= ~(1 << window);
+
+  GIMP_LOG (SHM, "released tile window %d", window);
+}
+
+guint32
+gimp_plug_in_shm_get_window_offset (GimpPlugInShm *shm,
+                                    gint           window)
+{
+  g_return_val_if_fail (shm != NULL, 0);
+  g_return_val_if_fail (window >= 0 && window < GP_TILE_N_WINDOWS, 0);
+
+  return TILE_MAP_SIZE * (1 + window * GP_TILE_WINDOW_SIZE);
+}
+
+guchar *
+gimp_plug_in_shm_get_slot_addr (GimpPlugInShm *shm,
+                                gint           window,
+                                gint           slot)
+{
+  g_return_val_if_fail (shm != NULL, NULL);
+  g_return_val_if_fail (slot >= 0 && slot < GP_TILE_WINDOW_SIZE, NULL);
+
+  return (shm->shm_addr +
+          gimp_plug_in_shm_get_window_offset (shm, window) +
+          slot * TILE_MAP_SIZE);
+}
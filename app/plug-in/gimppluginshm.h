@@ -21,11 +21,20 @@
 #define __GIMP_PLUG_IN_SHM_H__
 
 
-GimpPlugInShm * gimp_plug_in_shm_new      (void);
-void            gimp_plug_in_shm_free     (GimpPlugInShm *shm);
+GimpPlugInShm * gimp_plug_in_shm_new               (void);
+void            gimp_plug_in_shm_free              (GimpPlugInShm *shm);
 
-gint            gimp_plug_in_shm_get_ID   (GimpPlugInShm *shm);
-guchar        * gimp_plug_in_shm_get_addr (GimpPlugInShm *shm);
+gint            gimp_plug_in_shm_get_ID            (GimpPlugInShm *shm);
+guchar        * gimp_plug_in_shm_get_addr          (GimpPlugInShm *shm);
+
+gint            gimp_plug_in_shm_acquire_window    (GimpPlugInShm *shm);
+void            gimp_plug_in_shm_release_window    (GimpPlugInShm *shm,
+                                                    gint           window);
+guint32         gimp_plug_in_shm_get_window_offset (GimpPlugInShm *shm,
+                                                    gint           window);
+guchar        * gimp_plug_in_shm_get_slot_addr     (GimpPlugInShm *shm,
+                                                    gint           window,
+                                                    gint           slot);
 
 
 #endif /* __GIMP_PLUG_IN_SHM_H__ */
@@ -0,0 +1,315 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "widgets/widgets-types.h"
+
+#include "core/gimp.h"
+#include "core/gimpdrawable.h"
+#include "core/gimpimage.h"
+#include "core/gimpimage-contiguous-region.h"
+#include "core/gimplayer.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define GIMP_TEST_IMAGE_SIZE       256
+#define GIMP_TEST_PERF_IMAGE_SIZE  4096
+#define GIMP_TEST_PERF_RUNS        5
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-contiguous-region/" #function, gimp, function);
+
+
+typedef enum
+{
+  FILL_UNIFORM,
+  FILL_NOISE,
+  FILL_WALL
+} FillType;
+
+
+static GimpLayer *
+create_test_layer (Gimp       *gimp,
+                   gint        size,
+                   FillType    fill,
+                   GimpImage **image_return)
+{
+  GimpImage          *image;
+  GimpLayer          *layer;
+  GeglBufferIterator *iter;
+  GRand              *rand = g_rand_new_with_seed (42);
+
+  image = gimp_image_new (gimp, size, size, GIMP_RGB, GIMP_PRECISION_U8);
+
+  layer = gimp_layer_new (image, size, size,
+                          babl_format ("R'G'B'A u8"),
+                          "Test Layer",
+                          1.0,
+                          GIMP_NORMAL_MODE);
+
+  gimp_image_add_layer (image, layer, GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+
+  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
+                                   NULL, 0, babl_format ("R'G'B'A u8"),
+                                   GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      GeglRectangle *roi  = &iter->roi[0];
+      guchar        *dest = iter->data[0];
+      gint           x, y;
+
+      for (y = roi->y; y < roi->y + roi->height; y++)
+        for (x = roi->x; x < roi->x + roi->width; x++)
+          {
+            switch (fill)
+              {
+              case FILL_UNIFORM:
+                dest[0] = dest[1] = dest[2] = 128;
+                break;
+
+              case FILL_NOISE:
+                /*  small noise which stays below the select threshold  */
+                dest[0] = 120 + g_rand_int_range (rand, 0, 16);
+                dest[1] = 120 + g_rand_int_range (rand, 0, 16);
+                dest[2] = 120 + g_rand_int_range (rand, 0, 16);
+                break;
+
+              case FILL_WALL:
+                /*  a vertical wall with a gap at the bottom, the seed
+                 *  fill has to wind around it
+                 */
+                if (x == size / 2 && y < size - 1)
+                  dest[0] = dest[1] = dest[2] = 255;
+                else
+                  dest[0] = dest[1] = dest[2] = 0;
+                break;
+              }
+
+            dest[3] = 255;
+            dest += 4;
+          }
+    }
+
+  g_rand_free (rand);
+
+  *image_return = image;
+
+  return layer;
+}
+
+static gdouble
+count_selected (GeglBuffer *mask)
+{
+  GeglBufferIterator *iter;
+  gdouble             sum = 0.0;
+
+  iter = gegl_buffer_iterator_new (mask, NULL, 0, babl_format ("Y float"),
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *data = iter->data[0];
+
+      while (iter->length--)
+        sum += *data++;
+    }
+
+  return sum;
+}
+
+/**
+ * select_uniform:
+ * @data:
+ *
+ * A seed fill on a uniform layer selects every pixel.
+ **/
+static void
+select_uniform (gconstpointer data)
+{
+  Gimp       *gimp = GIMP (data);
+  GimpImage  *image;
+  GimpLayer  *layer;
+  GeglBuffer *mask;
+
+  layer = create_test_layer (gimp, GIMP_TEST_IMAGE_SIZE, FILL_UNIFORM, &image);
+
+  mask = gimp_image_contiguous_region_by_seed (image, GIMP_DRAWABLE (layer),
+                                               FALSE, FALSE, 0.0, FALSE,
+                                               GIMP_SELECT_CRITERION_COMPOSITE,
+                                               10, 10);
+
+  g_assert_cmpfloat (count_selected (mask), ==,
+                     GIMP_TEST_IMAGE_SIZE * GIMP_TEST_IMAGE_SIZE);
+
+  g_object_unref (mask);
+  g_object_unref (image);
+}
+
+/**
+ * select_around_wall:
+ * @data:
+ *
+ * A seed fill walks around a wall that only has a one pixel gap
+ * at the bottom, and doesn't select the wall itself.
+ **/
+static void
+select_around_wall (gconstpointer data)
+{
+  Gimp       *gimp = GIMP (data);
+  GimpImage  *image;
+  GimpLayer  *layer;
+  GeglBuffer *mask;
+  gfloat      value;
+
+  layer = create_test_layer (gimp, GIMP_TEST_IMAGE_SIZE, FILL_WALL, &image);
+
+  mask = gimp_image_contiguous_region_by_seed (image, GIMP_DRAWABLE (layer),
+                                               FALSE, FALSE, 0.1, FALSE,
+                                               GIMP_SELECT_CRITERION_COMPOSITE,
+                                               0, 0);
+
+  g_assert_cmpfloat (count_selected (mask), ==,
+                     GIMP_TEST_IMAGE_SIZE * GIMP_TEST_IMAGE_SIZE -
+                     (GIMP_TEST_IMAGE_SIZE - 1));
+
+  gegl_buffer_sample (mask, GIMP_TEST_IMAGE_SIZE - 1, 0, NULL, &value,
+                      babl_format ("Y float"),
+                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+  g_assert_cmpfloat (value, ==, 1.0);
+
+  gegl_buffer_sample (mask, GIMP_TEST_IMAGE_SIZE / 2, 0, NULL, &value,
+                      babl_format ("Y float"),
+                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+  g_assert_cmpfloat (value, ==, 0.0);
+
+  g_object_unref (mask);
+  g_object_unref (image);
+}
+
+static void
+time_fuzzy_select (Gimp     *gimp,
+                   FillType  fill)
+{
+  GimpImage *image;
+  GimpLayer *layer;
+  GTimer    *timer;
+  gdouble    min_time = G_MAXDOUBLE;
+  gint       i;
+
+  layer = create_test_layer (gimp, GIMP_TEST_PERF_IMAGE_SIZE, fill, &image);
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < GIMP_TEST_PERF_RUNS; i++)
+    {
+      GeglBuffer *mask;
+
+      g_timer_start (timer);
+
+      mask = gimp_image_contiguous_region_by_seed (image, GIMP_DRAWABLE (layer),
+                                                   FALSE, TRUE, 0.1, FALSE,
+                                                   GIMP_SELECT_CRITERION_COMPOSITE,
+                                                   GIMP_TEST_PERF_IMAGE_SIZE / 2,
+                                                   GIMP_TEST_PERF_IMAGE_SIZE / 2);
+
+      g_timer_stop (timer);
+
+      min_time = MIN (min_time, g_timer_elapsed (timer, NULL));
+
+      g_object_unref (mask);
+    }
+
+  g_test_minimized_result (min_time,
+                           "fuzzy select on %dx%d %s layer: %.3f seconds",
+                           GIMP_TEST_PERF_IMAGE_SIZE,
+                           GIMP_TEST_PERF_IMAGE_SIZE,
+                           fill == FILL_UNIFORM ? "uniform" : "noisy",
+                           min_time);
+
+  g_timer_destroy (timer);
+  g_object_unref (image);
+}
+
+/**
+ * perf_select_uniform:
+ * @data:
+ *
+ * Times a fuzzy select that covers a large uniform layer.
+ **/
+static void
+perf_select_uniform (gconstpointer data)
+{
+  time_fuzzy_select (GIMP (data), FILL_UNIFORM);
+}
+
+/**
+ * perf_select_noise:
+ * @data:
+ *
+ * Times a fuzzy select that covers a large noisy layer.
+ **/
+static void
+perf_select_noise (gconstpointer data)
+{
+  time_fuzzy_select (GIMP (data), FILL_NOISE);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (select_uniform);
+  ADD_TEST (select_around_wall);
+
+  /* The benchmarks only run with "-m perf" */
+  if (g_test_perf ())
+    {
+      ADD_TEST (perf_select_uniform);
+      ADD_TEST (perf_select_noise);
+    }
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
@@ -0,0 +1,420 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "widgets/widgets-types.h"
+
+#include "core/gimp.h"
+
+#include "operations/gimpdistancetransform.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+/* not square, and radii much larger than the features of the mask */
+#define GIMP_TEST_WIDTH            128
+#define GIMP_TEST_HEIGHT           96
+#define GIMP_TEST_RADIUS_X         40
+#define GIMP_TEST_RADIUS_Y         30
+#define GIMP_TEST_PERF_SIZE        4096
+#define GIMP_TEST_PERF_RADIUS      200
+#define GIMP_TEST_PERF_RUNS        5
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-distance-transform/" #function, gimp, function);
+
+
+/* Fill the mask with scattered selected pixels, or with scattered
+ * pixels of any value on top of that.
+ */
+static void
+create_mask (gfloat   *mask,
+             gint      width,
+             gint      height,
+             gboolean  binary)
+{
+  GRand *rand = g_rand_new_with_seed (42);
+  gint   i;
+
+  for (i = 0; i < width * height; i++)
+    {
+      mask[i] = g_rand_int_range (rand, 0, 37) == 0 ? 1.0f : 0.0f;
+
+      if (! binary && g_rand_int_range (rand, 0, 7) == 0)
+        mask[i] = g_rand_int_range (rand, 0, 256) / 255.0;
+    }
+
+  if (! binary)
+    mask[0] = 0.5f;
+
+  g_rand_free (rand);
+}
+
+/* The half heights of the columns of the ellipse, the way grow and
+ * shrink computed them before they used the distance transform.
+ */
+static gint *
+create_baseline_ellipse (gint radius_x,
+                         gint radius_y)
+{
+  gint *circ = g_new (gint, 2 * radius_x + 1);
+  gint  i;
+
+  for (i = 0; i < 2 * radius_x + 1; i++)
+    {
+      gdouble tmp;
+
+      if (i > radius_x)
+        tmp = (i - radius_x) - 0.5;
+      else if (i < radius_x)
+        tmp = (radius_x - i) - 0.5;
+      else
+        tmp = 0.0;
+
+      circ[i] = RINT (radius_y /
+                      (gdouble) radius_x * sqrt (SQR (radius_x) - SQR (tmp)));
+    }
+
+  return circ;
+}
+
+/* Dilates mask by brute force, within the columns of half height
+ * circ[], or within the rectangle of the radii if circ is NULL.
+ */
+static gfloat
+reference_dilate_pixel (const gfloat *mask,
+                        gint          width,
+                        gint          height,
+                        gint          x,
+                        gint          y,
+                        gint          radius_x,
+                        gint          radius_y,
+                        const gint   *circ,
+                        gboolean      invert,
+                        gboolean      outside_is_source)
+{
+  gfloat max = 0.0f;
+  gint   i, j;
+
+  for (i = -radius_x; i <= radius_x; i++)
+    {
+      gint half_height = circ ? circ[i + radius_x] : radius_y;
+
+      for (j = -half_height; j <= half_height; j++)
+        {
+          gfloat value;
+
+          if (x + i < 0 || x + i >= width || y + j < 0 || y + j >= height)
+            {
+              if (! outside_is_source)
+                continue;
+
+              value = 1.0f;
+            }
+          else
+            {
+              value = mask[(y + j) * width + x + i];
+
+              if (invert)
+                value = 1.0f - value;
+            }
+
+          max = MAX (max, value);
+        }
+    }
+
+  return invert ? 1.0f - max : max;
+}
+
+static void
+check_dilate (gboolean binary,
+              gboolean invert,
+              gboolean outside_is_source)
+{
+  GeglRectangle  rect   = { 0, 0, GIMP_TEST_WIDTH, GIMP_TEST_HEIGHT };
+  const Babl    *format = babl_format ("Y float");
+  GeglBuffer    *input;
+  GeglBuffer    *output;
+  gfloat        *mask;
+  gfloat        *result;
+  gint          *circ   = NULL;
+  gint           x, y;
+
+  mask   = g_new (gfloat, rect.width * rect.height);
+  result = g_new (gfloat, rect.width * rect.height);
+
+  create_mask (mask, rect.width, rect.height, binary);
+
+  input  = gegl_buffer_new (&rect, format);
+  output = gegl_buffer_new (&rect, format);
+
+  gegl_buffer_set (input, &rect, 0, format, mask, GEGL_AUTO_ROWSTRIDE);
+
+  gimp_distance_transform_dilate (input, output, &rect,
+                                  GIMP_TEST_RADIUS_X, GIMP_TEST_RADIUS_Y,
+                                  invert, outside_is_source);
+
+  gegl_buffer_get (output, &rect, 1.0, format, result,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  /* selections of only 0.0 and 1.0 grow by the same ellipse as
+   * before, others by the rectangle of the radii
+   */
+  if (binary)
+    circ = create_baseline_ellipse (GIMP_TEST_RADIUS_X, GIMP_TEST_RADIUS_Y);
+
+  for (y = 0; y < rect.height; y++)
+    for (x = 0; x < rect.width; x++)
+      {
+        gfloat expected = reference_dilate_pixel (mask,
+                                                  rect.width, rect.height,
+                                                  x, y,
+                                                  GIMP_TEST_RADIUS_X,
+                                                  GIMP_TEST_RADIUS_Y,
+                                                  circ,
+                                                  invert, outside_is_source);
+
+        g_assert_cmpfloat (fabs (result[y * rect.width + x] - expected),
+                           <=, 1e-6);
+      }
+
+  g_free (circ);
+  g_object_unref (output);
+  g_object_unref (input);
+  g_free (result);
+  g_free (mask);
+}
+
+/**
+ * grow_binary:
+ * @data:
+ *
+ * Growing a selection of only 0.0 and 1.0 by a large radius gives
+ * the same ellipse as the old per-column filter.
+ **/
+static void
+grow_binary (gconstpointer data)
+{
+  check_dilate (TRUE, FALSE, FALSE);
+}
+
+/**
+ * shrink_binary:
+ * @data:
+ *
+ * Shrinking a selection of only 0.0 and 1.0 by a large radius gives
+ * the same ellipse as the old per-column filter, with and without
+ * edge lock.
+ **/
+static void
+shrink_binary (gconstpointer data)
+{
+  check_dilate (TRUE, TRUE, FALSE);
+  check_dilate (TRUE, TRUE, TRUE);
+}
+
+/**
+ * grow_grey:
+ * @data:
+ *
+ * Growing a selection with partially selected pixels by a large
+ * radius takes the maximum within the rectangle of the radii.
+ **/
+static void
+grow_grey (gconstpointer data)
+{
+  check_dilate (FALSE, FALSE, FALSE);
+}
+
+/**
+ * shrink_grey:
+ * @data:
+ *
+ * Shrinking a selection with partially selected pixels by a large
+ * radius takes the minimum within the rectangle of the radii.
+ **/
+static void
+shrink_grey (gconstpointer data)
+{
+  check_dilate (FALSE, TRUE, FALSE);
+  check_dilate (FALSE, TRUE, TRUE);
+}
+
+/**
+ * border_hard_edge:
+ * @data:
+ *
+ * Thresholding the distance to the source pixels gives the hard
+ * elliptical edge the border used to have, with the offsets reduced
+ * by half a pixel.
+ **/
+static void
+border_hard_edge (gconstpointer data)
+{
+  gint    width  = 2 * GIMP_TEST_RADIUS_X + 5;
+  gint    height = 2 * GIMP_TEST_RADIUS_Y + 5;
+  gint    cx     = width  / 2;
+  gint    cy     = height / 2;
+  gfloat *dist   = g_new (gfloat, width * height);
+  gint    x, y;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      dist[y * width + x] = (x == cx && y == cy) ?
+                            0.0f : GIMP_DISTANCE_TRANSFORM_FAR;
+
+  gimp_distance_transform_squares (dist, width, height,
+                                   (gdouble) GIMP_TEST_RADIUS_Y /
+                                             GIMP_TEST_RADIUS_X,
+                                   GIMP_TEST_RADIUS_Y);
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        gdouble dx = MAX (ABS (x - cx) - 0.5, 0.0) / GIMP_TEST_RADIUS_X;
+        gdouble dy = MAX (ABS (y - cy) - 0.5, 0.0) / GIMP_TEST_RADIUS_Y;
+
+        g_assert_cmpfloat (dist[y * width + x], ==,
+                           SQR (dx) + SQR (dy) < 1.0 ? 1.0f : 0.0f);
+      }
+
+  g_free (dist);
+}
+
+static void
+time_grow (gboolean binary)
+{
+  GeglRectangle  rect   = { 0, 0, GIMP_TEST_PERF_SIZE, GIMP_TEST_PERF_SIZE };
+  const Babl    *format = babl_format ("Y float");
+  GeglBuffer    *input;
+  GeglBuffer    *output;
+  gfloat        *mask;
+  GTimer        *timer;
+  gdouble        min_time = G_MAXDOUBLE;
+  gint           i;
+
+  mask = g_new (gfloat, rect.width * rect.height);
+
+  create_mask (mask, rect.width, rect.height, binary);
+
+  input  = gegl_buffer_new (&rect, format);
+  output = gegl_buffer_new (&rect, format);
+
+  gegl_buffer_set (input, &rect, 0, format, mask, GEGL_AUTO_ROWSTRIDE);
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < GIMP_TEST_PERF_RUNS; i++)
+    {
+      g_timer_start (timer);
+
+      gimp_distance_transform_dilate (input, output, &rect,
+                                      GIMP_TEST_PERF_RADIUS,
+                                      GIMP_TEST_PERF_RADIUS,
+                                      FALSE, FALSE);
+
+      g_timer_stop (timer);
+
+      min_time = MIN (min_time, g_timer_elapsed (timer, NULL));
+    }
+
+  g_test_minimized_result (min_time,
+                           "grow %dx%d %s mask by %d: %.3f seconds",
+                           GIMP_TEST_PERF_SIZE,
+                           GIMP_TEST_PERF_SIZE,
+                           binary ? "binary" : "grey",
+                           GIMP_TEST_PERF_RADIUS,
+                           min_time);
+
+  g_timer_destroy (timer);
+  g_object_unref (output);
+  g_object_unref (input);
+  g_free (mask);
+}
+
+/**
+ * perf_grow_binary:
+ * @data:
+ *
+ * Times growing a large selection of only 0.0 and 1.0.
+ **/
+static void
+perf_grow_binary (gconstpointer data)
+{
+  time_grow (TRUE);
+}
+
+/**
+ * perf_grow_grey:
+ * @data:
+ *
+ * Times growing a large selection with partially selected pixels.
+ **/
+static void
+perf_grow_grey (gconstpointer data)
+{
+  time_grow (FALSE);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (grow_binary);
+  ADD_TEST (shrink_binary);
+  ADD_TEST (grow_grey);
+  ADD_TEST (shrink_grey);
+  ADD_TEST (border_hard_edge);
+
+  /* The benchmarks only run with "-m perf" */
+  if (g_test_perf ())
+    {
+      ADD_TEST (perf_grow_binary);
+      ADD_TEST (perf_grow_grey);
+    }
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
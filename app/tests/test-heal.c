@@ -0,0 +1,343 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "widgets/widgets-types.h"
+
+#include "core/gimp.h"
+
+#include "paint/gimpheal-laplace.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+/* not square, and not a power of two */
+#define GIMP_TEST_WIDTH            97
+#define GIMP_TEST_HEIGHT           80
+#define GIMP_TEST_DEPTH            4
+#define GIMP_TEST_N_THREADS        4
+#define GIMP_TEST_REFERENCE_RUNS   20
+#define GIMP_TEST_PERF_RUNS        5
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-heal/" #function, gimp, function);
+
+
+/* Fill data with a smooth gradient plus noise, the way the difference
+ * of two image areas looks, and mask with a round brush.
+ */
+static void
+create_dab (gfloat *data,
+            guchar *mask,
+            gint    width,
+            gint    height)
+{
+  GRand *rand = g_rand_new_with_seed (42);
+  gint   x, y, c;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        gdouble dx     = x - width  / 2.0 + 0.5;
+        gdouble dy     = y - height / 2.0 + 0.5;
+        gdouble radius = MIN (width, height) / 2.0 - 1.0;
+
+        mask[y * width + x] = (SQR (dx) + SQR (dy) < SQR (radius)) ? 255 : 0;
+
+        for (c = 0; c < GIMP_TEST_DEPTH; c++)
+          {
+            data[(y * width + x) * GIMP_TEST_DEPTH + c] =
+              0.3 * sin (x * 0.05 * (c + 1)) + 0.2 * cos (y * 0.07) +
+              g_rand_double_range (rand, -0.1, 0.1);
+          }
+      }
+
+  g_rand_free (rand);
+}
+
+/* Solve the dab far past the convergence criteria of the solvers */
+static gfloat *
+create_reference (gint width,
+                  gint height)
+{
+  gfloat *data = g_new (gfloat, width * height * GIMP_TEST_DEPTH);
+  guchar *mask = g_new (guchar, width * height);
+  gint    run;
+
+  create_dab (data, mask, width, height);
+
+  for (run = 0; run < GIMP_TEST_REFERENCE_RUNS; run++)
+    gimp_heal_laplace_multigrid (data, width, height, GIMP_TEST_DEPTH, mask);
+
+  g_free (mask);
+
+  return data;
+}
+
+static gdouble
+max_difference (const gfloat *data,
+                const gfloat *reference,
+                gint          size)
+{
+  gdouble max = 0.0;
+  gint    i;
+
+  for (i = 0; i < size; i++)
+    max = MAX (max, fabs (data[i] - reference[i]));
+
+  return max;
+}
+
+/**
+ * multigrid_solves_laplace:
+ * @data:
+ *
+ * Checks that the multigrid solver leaves the boundary alone, and that
+ * its solution satisfies the discrete Laplace equation everywhere
+ * inside the mask.
+ **/
+static void
+multigrid_solves_laplace (gconstpointer data)
+{
+  const gint  width     = GIMP_TEST_WIDTH;
+  const gint  height    = GIMP_TEST_HEIGHT;
+  const gint  depth     = GIMP_TEST_DEPTH;
+  const gint  rowstride = width * depth;
+  gfloat     *original  = g_new (gfloat, width * height * depth);
+  gfloat     *solution  = g_new (gfloat, width * height * depth);
+  guchar     *mask      = g_new (guchar, width * height);
+  gint        x, y, c;
+
+  create_dab (original, mask, width, height);
+  memcpy (solution, original, width * height * depth * sizeof (gfloat));
+
+  gimp_heal_laplace_multigrid (solution, width, height, depth, mask);
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      for (c = 0; c < depth; c++)
+        {
+          gint offset = y * rowstride + x * depth + c;
+
+          if (! mask[y * width + x] ||
+              x == 0 || x == width  - 1 ||
+              y == 0 || y == height - 1)
+            {
+              g_assert_cmpfloat (solution[offset], ==, original[offset]);
+            }
+          else
+            {
+              gdouble residual = (4.0 * solution[offset]         -
+                                  solution[offset - depth]       -
+                                  solution[offset + depth]       -
+                                  solution[offset - rowstride]   -
+                                  solution[offset + rowstride]);
+
+              g_assert_cmpfloat (fabs (residual), <, 1e-4);
+            }
+        }
+
+  g_free (mask);
+  g_free (solution);
+  g_free (original);
+}
+
+/**
+ * multigrid_matches_reference:
+ * @data:
+ *
+ * Checks that a single multigrid solve is within a small fraction of
+ * an 8 bit level of the fully converged solution, and closer to it
+ * than the Gauss-Seidel solver it replaced.
+ **/
+static void
+multigrid_matches_reference (gconstpointer data)
+{
+  const gint  width     = GIMP_TEST_WIDTH;
+  const gint  height    = GIMP_TEST_HEIGHT;
+  const gint  size      = width * height * GIMP_TEST_DEPTH;
+  gfloat     *reference = create_reference (width, height);
+  gfloat     *solution  = g_new (gfloat,  size);
+  gdouble    *matrix    = g_new (gdouble, size);
+  gdouble    *result    = g_new (gdouble, size);
+  guchar     *mask      = g_new (guchar, width * height);
+  gdouble     multigrid_error;
+  gdouble     gauss_seidel_error;
+  gint        i;
+
+  create_dab (solution, mask, width, height);
+
+  for (i = 0; i < size; i++)
+    matrix[i] = solution[i];
+
+  gimp_heal_laplace_multigrid (solution, width, height, GIMP_TEST_DEPTH,
+                               mask);
+  gimp_heal_laplace_gauss_seidel (matrix, height, GIMP_TEST_DEPTH, width,
+                                  result, mask);
+
+  multigrid_error = max_difference (solution, reference, size);
+
+  for (i = 0; i < size; i++)
+    solution[i] = result[i];
+
+  gauss_seidel_error = max_difference (solution, reference, size);
+
+  g_assert_cmpfloat (multigrid_error, <, 0.1 / 255.0);
+  g_assert_cmpfloat (multigrid_error, <, gauss_seidel_error);
+
+  g_free (mask);
+  g_free (result);
+  g_free (matrix);
+  g_free (solution);
+  g_free (reference);
+}
+
+/**
+ * perf_dab_latency:
+ * @data:
+ *
+ * Compares the time the multigrid and the Gauss-Seidel solvers take to
+ * heal a dab, and their distance from the converged solution, at
+ * several brush sizes.
+ **/
+static void
+perf_dab_latency (gconstpointer data)
+{
+  static const gint sizes[] = { 32, 64, 128, 256, 512 };
+  GTimer           *timer   = g_timer_new ();
+  gdouble           total   = 0.0;
+  gint              s;
+
+  for (s = 0; s < G_N_ELEMENTS (sizes); s++)
+    {
+      const gint  width              = sizes[s];
+      const gint  height             = sizes[s];
+      const gint  size               = width * height * GIMP_TEST_DEPTH;
+      gfloat     *reference          = create_reference (width, height);
+      gfloat     *solution           = g_new (gfloat,  size);
+      gdouble    *matrix             = g_new (gdouble, size);
+      gdouble    *result             = g_new (gdouble, size);
+      guchar     *mask               = g_new (guchar, width * height);
+      gdouble     multigrid          = G_MAXDOUBLE;
+      gdouble     gauss_seidel       = G_MAXDOUBLE;
+      gdouble     multigrid_error    = 0.0;
+      gdouble     gauss_seidel_error = 0.0;
+      gint        run;
+      gint        i;
+
+      for (run = 0; run < GIMP_TEST_PERF_RUNS; run++)
+        {
+          create_dab (solution, mask, width, height);
+
+          for (i = 0; i < size; i++)
+            matrix[i] = solution[i];
+
+          g_timer_start (timer);
+          gimp_heal_laplace_multigrid (solution, width, height,
+                                       GIMP_TEST_DEPTH, mask);
+          g_timer_stop (timer);
+
+          multigrid = MIN (multigrid, g_timer_elapsed (timer, NULL));
+
+          g_timer_start (timer);
+          gimp_heal_laplace_gauss_seidel (matrix, height, GIMP_TEST_DEPTH,
+                                          width, result, mask);
+          g_timer_stop (timer);
+
+          gauss_seidel = MIN (gauss_seidel, g_timer_elapsed (timer, NULL));
+        }
+
+      multigrid_error = max_difference (solution, reference, size);
+
+      for (i = 0; i < size; i++)
+        solution[i] = result[i];
+
+      gauss_seidel_error = max_difference (solution, reference, size);
+
+      g_test_message ("%3dx%-3d multigrid: %8.3f ms, max error %.2f levels; "
+                      "gauss-seidel: %8.3f ms, max error %.2f levels",
+                      width, height,
+                      multigrid    * 1000.0, multigrid_error    * 255.0,
+                      gauss_seidel * 1000.0, gauss_seidel_error * 255.0);
+
+      total += multigrid;
+
+      g_free (mask);
+      g_free (result);
+      g_free (matrix);
+      g_free (solution);
+      g_free (reference);
+    }
+
+  g_test_minimized_result (total,
+                           "multigrid heal of %d dab sizes: %.3f s",
+                           (gint) G_N_ELEMENTS (sizes), total);
+
+  g_timer_destroy (timer);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Solve the channels in parallel even on a single core machine */
+  g_object_set (gimp->config,
+                "num-processors", GIMP_TEST_N_THREADS,
+                NULL);
+
+  /* Add tests */
+  ADD_TEST (multigrid_solves_laplace);
+  ADD_TEST (multigrid_matches_reference);
+
+  /* The benchmarks only run with "-m perf" */
+  if (g_test_perf ())
+    {
+      ADD_TEST (perf_dab_latency);
+    }
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
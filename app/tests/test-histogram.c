@@ -0,0 +1,489 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "widgets/widgets-types.h"
+
+#include "core/gimp.h"
+#include "core/gimphistogram.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+/* not a multiple of the chunk size, so there are partial chunks */
+#define GIMP_TEST_WIDTH            549
+#define GIMP_TEST_HEIGHT           300
+#define GIMP_TEST_N_THREADS        4
+#define GIMP_TEST_PERF_IMAGE_SIZE  4096
+#define GIMP_TEST_PERF_RUNS        5
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-histogram/" #function, gimp, function);
+
+
+static GeglBuffer *
+create_noise_buffer (gint width,
+                     gint height)
+{
+  GeglBuffer *buffer;
+  guchar     *pixels;
+  GRand      *rand = g_rand_new_with_seed (42);
+  gint        i;
+
+  buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height),
+                            babl_format ("R'G'B'A u8"));
+
+  pixels = g_new (guchar, width * height * 4);
+
+  for (i = 0; i < width * height * 4; i++)
+    pixels[i] = g_rand_int_range (rand, 0, 256);
+
+  gegl_buffer_set (buffer, NULL, 0, babl_format ("R'G'B'A u8"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (pixels);
+  g_rand_free (rand);
+
+  return buffer;
+}
+
+static GeglBuffer *
+create_mask_buffer (gint width,
+                    gint height)
+{
+  GeglBuffer *mask;
+  gfloat     *pixels;
+  gint        x, y;
+
+  mask = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height),
+                          babl_format ("Y float"));
+
+  pixels = g_new (gfloat, width * height);
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      pixels[y * width + x] = (gfloat) x / (width - 1);
+
+  gegl_buffer_set (mask, NULL, 0, babl_format ("Y float"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (pixels);
+
+  return mask;
+}
+
+/*  the same counting as gimp_histogram_calculate(), without chunks
+ *  and threads
+ */
+static gdouble *
+reference_histogram (GeglBuffer *buffer,
+                     GeglBuffer *mask)
+{
+  gint     width  = gegl_buffer_get_width (buffer);
+  gint     height = gegl_buffer_get_height (buffer);
+  gdouble *values = g_new0 (gdouble, 5 * 256);
+  guchar  *pixels = g_new (guchar, width * height * 4);
+  gfloat  *masks  = g_new (gfloat, width * height);
+  gint     i;
+
+  gegl_buffer_get (buffer, NULL, 1.0, babl_format ("R'G'B'A u8"),
+                   pixels, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (mask)
+    gegl_buffer_get (mask, NULL, 1.0, babl_format ("Y float"),
+                     masks, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (i = 0; i < width * height; i++)
+    {
+      const guchar  *p      = pixels + i * 4;
+      const gdouble  masked = mask ? masks[i] : 1.0;
+      const gdouble  weight = p[3] / 255.0;
+
+      values[1 * 256 + p[0]] += weight * masked;
+      values[2 * 256 + p[1]] += weight * masked;
+      values[3 * 256 + p[2]] += weight * masked;
+      values[4 * 256 + p[3]] += masked;
+      values[0 * 256 + MAX (MAX (p[0], p[1]), p[2])] += weight * masked;
+    }
+
+  g_free (masks);
+  g_free (pixels);
+
+  return values;
+}
+
+static void
+assert_histogram_equals (GimpHistogram *histogram,
+                         const gdouble *values)
+{
+  gint c, i;
+
+  g_assert_cmpint (gimp_histogram_n_bins (histogram), ==, 256);
+
+  for (c = 0; c < 5; c++)
+    for (i = 0; i < 256; i++)
+      {
+        gdouble expected = values[c * 256 + i];
+        gdouble value    = gimp_histogram_get_value (histogram, c, i);
+
+        g_assert_cmpfloat (fabs (value - expected), <=,
+                           1e-9 * MAX (1.0, expected));
+      }
+}
+
+static void
+assert_histograms_equal (GimpHistogram *histogram1,
+                         GimpHistogram *histogram2)
+{
+  gint c, i;
+
+  for (c = 0; c < 5; c++)
+    for (i = 0; i < gimp_histogram_n_bins (histogram1); i++)
+      {
+        gdouble value1 = gimp_histogram_get_value (histogram1, c, i);
+        gdouble value2 = gimp_histogram_get_value (histogram2, c, i);
+
+        g_assert_cmpfloat (fabs (value1 - value2), <=,
+                           1e-9 * MAX (1.0, value1));
+      }
+}
+
+static void
+paint_rect (GeglBuffer          *buffer,
+            const GeglRectangle *rect)
+{
+  guchar *pixels = g_new (guchar, rect->width * rect->height * 4);
+  gint    i;
+
+  for (i = 0; i < rect->width * rect->height; i++)
+    {
+      pixels[i * 4 + 0] = 10;
+      pixels[i * 4 + 1] = 200;
+      pixels[i * 4 + 2] = 77;
+      pixels[i * 4 + 3] = 255;
+    }
+
+  gegl_buffer_set (buffer, rect, 0, babl_format ("R'G'B'A u8"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (pixels);
+}
+
+/**
+ * calculate_matches_reference:
+ * @data:
+ *
+ * Checks that the histogram counted in parallel chunks equals a plain
+ * single threaded count, with and without a mask.
+ **/
+static void
+calculate_matches_reference (gconstpointer data)
+{
+  GeglBuffer    *buffer    = create_noise_buffer (GIMP_TEST_WIDTH,
+                                                  GIMP_TEST_HEIGHT);
+  GeglBuffer    *mask      = create_mask_buffer (GIMP_TEST_WIDTH,
+                                                 GIMP_TEST_HEIGHT);
+  GimpHistogram *histogram = gimp_histogram_new ();
+  gdouble       *values;
+
+  gimp_histogram_calculate (histogram,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            NULL, NULL);
+
+  values = reference_histogram (buffer, NULL);
+  assert_histogram_equals (histogram, values);
+  g_free (values);
+
+  gimp_histogram_calculate (histogram,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            mask, gegl_buffer_get_extent (mask));
+
+  values = reference_histogram (buffer, mask);
+  assert_histogram_equals (histogram, values);
+  g_free (values);
+
+  gimp_histogram_unref (histogram);
+  g_object_unref (mask);
+  g_object_unref (buffer);
+}
+
+/**
+ * update_matches_calculate:
+ * @data:
+ *
+ * Checks that updating a histogram after painting gives the same
+ * result as calculating it from scratch.
+ **/
+static void
+update_matches_calculate (gconstpointer data)
+{
+  GeglBuffer    *buffer  = create_noise_buffer (GIMP_TEST_WIDTH,
+                                                GIMP_TEST_HEIGHT);
+  GeglBuffer    *mask    = create_mask_buffer (GIMP_TEST_WIDTH,
+                                               GIMP_TEST_HEIGHT);
+  GimpHistogram *updated = gimp_histogram_new ();
+  GimpHistogram *full    = gimp_histogram_new ();
+  GeglRectangle  rect    = { 250, 100, 40, 180 };
+
+  gimp_histogram_calculate (updated,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            mask, gegl_buffer_get_extent (mask));
+
+  paint_rect (buffer, &rect);
+
+  gimp_histogram_update (updated,
+                         buffer, gegl_buffer_get_extent (buffer),
+                         mask, gegl_buffer_get_extent (mask),
+                         &rect);
+  gimp_histogram_calculate (full,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            mask, gegl_buffer_get_extent (mask));
+
+  assert_histograms_equal (updated, full);
+
+  /*  a different area makes the update count everything again  */
+  gimp_histogram_update (updated,
+                         buffer, GEGL_RECTANGLE (0, 0, 100, 100),
+                         NULL, NULL,
+                         &rect);
+  gimp_histogram_calculate (full,
+                            buffer, GEGL_RECTANGLE (0, 0, 100, 100),
+                            NULL, NULL);
+
+  assert_histograms_equal (updated, full);
+
+  gimp_histogram_unref (full);
+  gimp_histogram_unref (updated);
+  g_object_unref (mask);
+  g_object_unref (buffer);
+}
+
+/**
+ * float_with_many_bins:
+ * @data:
+ *
+ * Checks that a histogram with more than 256 bins resolves each step
+ * of a float gradient into its own bin.
+ **/
+static void
+float_with_many_bins (gconstpointer data)
+{
+  const gint     n_bins    = 1024;
+  GeglBuffer    *buffer;
+  GimpHistogram *histogram;
+  gfloat        *pixels;
+  gint           x, y;
+
+  buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, n_bins, 16),
+                            babl_format ("R'G'B'A float"));
+
+  pixels = g_new (gfloat, n_bins * 16 * 4);
+
+  for (y = 0; y < 16; y++)
+    for (x = 0; x < n_bins; x++)
+      {
+        gfloat *p = pixels + (y * n_bins + x) * 4;
+
+        p[0] = p[1] = p[2] = (gfloat) x / (n_bins - 1);
+        p[3] = 1.0;
+      }
+
+  gegl_buffer_set (buffer, NULL, 0, babl_format ("R'G'B'A float"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+
+  histogram = gimp_histogram_new_with_bins (n_bins);
+
+  gimp_histogram_calculate (histogram,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            NULL, NULL);
+
+  g_assert_cmpint (gimp_histogram_n_bins (histogram), ==, n_bins);
+
+  for (x = 0; x < n_bins; x++)
+    {
+      g_assert_cmpfloat (gimp_histogram_get_value (histogram,
+                                                   GIMP_HISTOGRAM_RED, x),
+                         ==, 16.0);
+      g_assert_cmpfloat (gimp_histogram_get_value (histogram,
+                                                   GIMP_HISTOGRAM_VALUE, x),
+                         ==, 16.0);
+    }
+
+  g_assert_cmpfloat (gimp_histogram_get_value (histogram,
+                                               GIMP_HISTOGRAM_ALPHA,
+                                               n_bins - 1),
+                     ==, n_bins * 16.0);
+
+  gimp_histogram_unref (histogram);
+  g_free (pixels);
+  g_object_unref (buffer);
+}
+
+/**
+ * float_out_of_range:
+ * @data:
+ *
+ * Checks that float values outside of [0, 1] are counted in the edge
+ * bins, and that NaN values are not counted at all.
+ **/
+static void
+float_out_of_range (gconstpointer data)
+{
+  const gint     n_bins    = 1024;
+  const gfloat   values[]  = { -0.5, 0.0, 1.0, 2.0, NAN };
+  const gint     n_values  = G_N_ELEMENTS (values);
+  GeglBuffer    *buffer;
+  GimpHistogram *histogram;
+  gfloat         pixels[G_N_ELEMENTS (values)];
+  gint           x;
+
+  buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, n_values, 1),
+                            babl_format ("Y float"));
+
+  for (x = 0; x < n_values; x++)
+    pixels[x] = values[x];
+
+  gegl_buffer_set (buffer, NULL, 0, babl_format ("Y float"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+
+  histogram = gimp_histogram_new_with_bins (n_bins);
+
+  gimp_histogram_calculate (histogram,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            NULL, NULL);
+
+  g_assert_cmpfloat (gimp_histogram_get_value (histogram,
+                                               GIMP_HISTOGRAM_VALUE, 0),
+                     ==, 2.0);
+  g_assert_cmpfloat (gimp_histogram_get_value (histogram,
+                                               GIMP_HISTOGRAM_VALUE,
+                                               n_bins - 1),
+                     ==, 2.0);
+  g_assert_cmpfloat (gimp_histogram_get_count (histogram,
+                                               GIMP_HISTOGRAM_VALUE,
+                                               0, n_bins - 1),
+                     ==, n_values - 1);
+
+  gimp_histogram_unref (histogram);
+  g_object_unref (buffer);
+}
+
+/**
+ * perf_calculate_and_update:
+ * @data:
+ *
+ * Compares a full calculation of a large buffer's histogram with an
+ * update after painting a brush sized area.
+ **/
+static void
+perf_calculate_and_update (gconstpointer data)
+{
+  GeglBuffer    *buffer    = create_noise_buffer (GIMP_TEST_PERF_IMAGE_SIZE,
+                                                  GIMP_TEST_PERF_IMAGE_SIZE);
+  GimpHistogram *histogram = gimp_histogram_new ();
+  GeglRectangle  rect      = { 1000, 1000, 64, 64 };
+  GTimer        *timer     = g_timer_new ();
+  gdouble        calculate = G_MAXDOUBLE;
+  gdouble        update    = G_MAXDOUBLE;
+  gint           run;
+
+  for (run = 0; run < GIMP_TEST_PERF_RUNS; run++)
+    {
+      g_timer_start (timer);
+      gimp_histogram_calculate (histogram,
+                                buffer, gegl_buffer_get_extent (buffer),
+                                NULL, NULL);
+      g_timer_stop (timer);
+
+      calculate = MIN (calculate, g_timer_elapsed (timer, NULL));
+
+      paint_rect (buffer, &rect);
+
+      g_timer_start (timer);
+      gimp_histogram_update (histogram,
+                             buffer, gegl_buffer_get_extent (buffer),
+                             NULL, NULL,
+                             &rect);
+      g_timer_stop (timer);
+
+      update = MIN (update, g_timer_elapsed (timer, NULL));
+    }
+
+  g_test_minimized_result (calculate + update,
+                           "%dx%d, %d threads: calculate %.4f seconds, "
+                           "update %dx%d %.4f seconds",
+                           GIMP_TEST_PERF_IMAGE_SIZE,
+                           GIMP_TEST_PERF_IMAGE_SIZE,
+                           GIMP_TEST_N_THREADS,
+                           calculate, rect.width, rect.height, update);
+
+  g_timer_destroy (timer);
+  gimp_histogram_unref (histogram);
+  g_object_unref (buffer);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Count in parallel even on a single core machine */
+  g_object_set (gimp->config,
+                "num-processors", GIMP_TEST_N_THREADS,
+                NULL);
+
+  /* Add tests */
+  ADD_TEST (calculate_matches_reference);
+  ADD_TEST (update_matches_calculate);
+  ADD_TEST (float_with_many_bins);
+  ADD_TEST (float_out_of_range);
+
+  /* The benchmarks only run with "-m perf" */
+  if (g_test_perf ())
+    {
+      ADD_TEST (perf_calculate_and_update);
+    }
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
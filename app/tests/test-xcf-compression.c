@@ -0,0 +1,486 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "widgets/widgets-types.h"
+
+#include "config/gimpcoreconfig.h"
+
+#include "core/gimp.h"
+#include "core/gimpcontext.h"
+#include "core/gimpdrawable.h"
+#include "core/gimpimage.h"
+#include "core/gimplayer.h"
+#include "core/gimpparamspecs.h"
+
+#include "pdb/gimppdb.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define GIMP_TEST_IMAGE_SIZE       200
+#define GIMP_TEST_PERF_IMAGE_SIZE  2048
+#define GIMP_TEST_PERF_RUNS        3
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-xcf-compression/" #function, gimp, function);
+
+
+/*  the values of the gimp-xcf-save "compression" argument  */
+typedef enum
+{
+  COMPRESSION_NONE = 0,
+  COMPRESSION_RLE  = 1,
+  COMPRESSION_ZLIB = 2,
+  COMPRESSION_ZSTD = 4
+} Compression;
+
+static const struct
+{
+  Compression  compression;
+  const gchar *name;
+}
+compressions[] =
+{
+  { COMPRESSION_RLE,  "rle"  },
+  { COMPRESSION_ZLIB, "zlib" },
+  { COMPRESSION_ZSTD, "zstd" }
+};
+
+
+/*  a smooth gradient with a bit of sensor-like noise, which is closer
+ *  to a photograph than flat test colors
+ */
+static GimpImage *
+create_test_image (Gimp          *gimp,
+                   gint           size,
+                   GimpPrecision  precision)
+{
+  GimpImage          *image;
+  GimpLayer          *layer;
+  GeglBufferIterator *iter;
+  GRand              *rand = g_rand_new_with_seed (42);
+
+  image = gimp_image_new (gimp, size, size, GIMP_RGB, precision);
+
+  layer = gimp_layer_new (image, size, size,
+                          gimp_image_get_layer_format (image, TRUE),
+                          "Test Layer",
+                          1.0,
+                          GIMP_NORMAL_MODE);
+
+  gimp_image_add_layer (image, layer, GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+
+  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
+                                   NULL, 0, babl_format ("RGBA float"),
+                                   GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      GeglRectangle *roi  = &iter->roi[0];
+      gfloat        *dest = iter->data[0];
+      gint           x, y;
+
+      for (y = roi->y; y < roi->y + roi->height; y++)
+        for (x = roi->x; x < roi->x + roi->width; x++)
+          {
+            gfloat noise = g_rand_double_range (rand, -0.01, 0.01);
+
+            dest[0] = (gfloat) x / size + noise;
+            dest[1] = (gfloat) y / size + noise;
+            dest[2] = 0.5 + noise;
+            dest[3] = 1.0;
+
+            dest += 4;
+          }
+    }
+
+  g_rand_free (rand);
+
+  return image;
+}
+
+static GimpLayer *
+get_layer (GimpImage *image)
+{
+  return GIMP_LAYER (gimp_image_get_layer_iter (image)->data);
+}
+
+static void
+save_image (GimpImage   *image,
+            const gchar *filename,
+            Compression  compression)
+{
+  Gimp           *gimp = image->gimp;
+  GimpValueArray *return_vals;
+  GError         *error = NULL;
+
+  return_vals =
+    gimp_pdb_execute_procedure_by_name (gimp->pdb,
+                                        gimp_get_user_context (gimp),
+                                        NULL, &error,
+                                        "gimp-xcf-save",
+                                        GIMP_TYPE_INT32, 0,
+                                        GIMP_TYPE_IMAGE_ID,
+                                        gimp_image_get_ID (image),
+                                        GIMP_TYPE_DRAWABLE_ID,
+                                        gimp_item_get_ID (GIMP_ITEM (get_layer (image))),
+                                        G_TYPE_STRING, filename,
+                                        G_TYPE_STRING, filename,
+                                        GIMP_TYPE_INT32, compression,
+                                        G_TYPE_NONE);
+
+  g_assert_no_error (error);
+  g_assert_cmpint (g_value_get_enum (gimp_value_array_index (return_vals, 0)),
+                   ==, GIMP_PDB_SUCCESS);
+
+  gimp_value_array_unref (return_vals);
+}
+
+static GimpImage *
+load_image (Gimp        *gimp,
+            const gchar *filename)
+{
+  GimpValueArray *return_vals;
+  GimpImage      *image;
+  GError         *error = NULL;
+
+  return_vals =
+    gimp_pdb_execute_procedure_by_name (gimp->pdb,
+                                        gimp_get_user_context (gimp),
+                                        NULL, &error,
+                                        "gimp-xcf-load",
+                                        GIMP_TYPE_INT32, 0,
+                                        G_TYPE_STRING, filename,
+                                        G_TYPE_STRING, filename,
+                                        G_TYPE_NONE);
+
+  g_assert_no_error (error);
+  g_assert_cmpint (g_value_get_enum (gimp_value_array_index (return_vals, 0)),
+                   ==, GIMP_PDB_SUCCESS);
+
+  image = gimp_value_get_image (gimp_value_array_index (return_vals, 1), gimp);
+  g_object_ref (image);
+
+  gimp_value_array_unref (return_vals);
+
+  return image;
+}
+
+static void
+assert_same_pixels (GimpImage *image,
+                    GimpImage *loaded_image)
+{
+  GeglBuffer         *buffer;
+  GeglBuffer         *loaded_buffer;
+  const Babl         *format;
+  GeglBufferIterator *iter;
+  gint                bpp;
+
+  buffer        = gimp_drawable_get_buffer (GIMP_DRAWABLE (get_layer (image)));
+  loaded_buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (get_layer (loaded_image)));
+
+  format = gegl_buffer_get_format (buffer);
+  bpp    = babl_format_get_bytes_per_pixel (format);
+
+  g_assert (gegl_buffer_get_format (loaded_buffer) == format);
+  g_assert_cmpint (gegl_buffer_get_width (loaded_buffer), ==,
+                   gegl_buffer_get_width (buffer));
+  g_assert_cmpint (gegl_buffer_get_height (loaded_buffer), ==,
+                   gegl_buffer_get_height (buffer));
+
+  iter = gegl_buffer_iterator_new (buffer, NULL, 0, format,
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+  gegl_buffer_iterator_add (iter, loaded_buffer, NULL, 0, format,
+                            GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    g_assert (! memcmp (iter->data[0], iter->data[1], iter->length * bpp));
+}
+
+static void
+write_and_read_image (Gimp          *gimp,
+                      GimpPrecision  precision,
+                      Compression    compression)
+{
+  GimpImage *image;
+  GimpImage *loaded_image;
+  gchar     *filename;
+
+  image = create_test_image (gimp, GIMP_TEST_IMAGE_SIZE, precision);
+
+  filename = g_build_filename (g_get_tmp_dir (),
+                               "gimp-test-compression.xcf", NULL);
+
+  save_image (image, filename, compression);
+  loaded_image = load_image (gimp, filename);
+
+  assert_same_pixels (image, loaded_image);
+
+  g_object_unref (loaded_image);
+  g_object_unref (image);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+/**
+ * write_and_read_u8_zlib:
+ * @data:
+ *
+ * An 8-bit image survives a save and load with zlib compressed tiles.
+ **/
+static void
+write_and_read_u8_zlib (gconstpointer data)
+{
+  write_and_read_image (GIMP (data), GIMP_PRECISION_U8, COMPRESSION_ZLIB);
+}
+
+/**
+ * write_and_read_u8_zstd:
+ * @data:
+ *
+ * An 8-bit image survives a save and load with zstd compressed tiles,
+ * or zlib compressed ones when built without zstd.
+ **/
+static void
+write_and_read_u8_zstd (gconstpointer data)
+{
+  write_and_read_image (GIMP (data), GIMP_PRECISION_U8, COMPRESSION_ZSTD);
+}
+
+/**
+ * write_and_read_float_none:
+ * @data:
+ *
+ * A float image survives a save and load with uncompressed tiles.
+ **/
+static void
+write_and_read_float_none (gconstpointer data)
+{
+  write_and_read_image (GIMP (data), GIMP_PRECISION_FLOAT, COMPRESSION_NONE);
+}
+
+/**
+ * write_and_read_float_zlib:
+ * @data:
+ *
+ * A float image survives a save and load with zlib compressed tiles.
+ **/
+static void
+write_and_read_float_zlib (gconstpointer data)
+{
+  write_and_read_image (GIMP (data), GIMP_PRECISION_FLOAT, COMPRESSION_ZLIB);
+}
+
+/**
+ * write_and_read_float_zstd:
+ * @data:
+ *
+ * A float image survives a save and load with zstd compressed tiles.
+ **/
+static void
+write_and_read_float_zstd (gconstpointer data)
+{
+  write_and_read_image (GIMP (data), GIMP_PRECISION_FLOAT, COMPRESSION_ZSTD);
+}
+
+/**
+ * lazy_load_and_overwrite:
+ * @data:
+ *
+ * A lazily loaded image has the same pixels as the saved one, and
+ * keeps them when it is saved over the file its tiles come from.
+ **/
+static void
+lazy_load_and_overwrite (gconstpointer data)
+{
+  Gimp      *gimp = GIMP (data);
+  GimpImage *image;
+  GimpImage *lazy_image;
+  GimpImage *loaded_image;
+  gchar     *filename;
+
+  image = create_test_image (gimp, GIMP_TEST_IMAGE_SIZE, GIMP_PRECISION_U8);
+
+  filename = g_build_filename (g_get_tmp_dir (),
+                               "gimp-test-compression.xcf", NULL);
+
+  save_image (image, filename, COMPRESSION_ZLIB);
+
+  g_object_set (gimp->config, "xcf-lazy-load", TRUE, NULL);
+  lazy_image = load_image (gimp, filename);
+  g_object_set (gimp->config, "xcf-lazy-load", FALSE, NULL);
+
+  assert_same_pixels (image, lazy_image);
+
+  save_image (lazy_image, filename, COMPRESSION_RLE);
+  loaded_image = load_image (gimp, filename);
+
+  assert_same_pixels (image, lazy_image);
+  assert_same_pixels (image, loaded_image);
+
+  g_object_unref (loaded_image);
+  g_object_unref (lazy_image);
+  g_object_unref (image);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+time_compressions (Gimp          *gimp,
+                   GimpPrecision  precision)
+{
+  GimpImage *image;
+  gchar     *filename;
+  GTimer    *timer;
+  gint       i;
+
+  image = create_test_image (gimp, GIMP_TEST_PERF_IMAGE_SIZE, precision);
+
+  filename = g_build_filename (g_get_tmp_dir (),
+                               "gimp-test-compression.xcf", NULL);
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < G_N_ELEMENTS (compressions); i++)
+    {
+      gdouble  save_time = G_MAXDOUBLE;
+      gdouble  load_time = G_MAXDOUBLE;
+      GStatBuf st;
+      gint     run;
+
+      for (run = 0; run < GIMP_TEST_PERF_RUNS; run++)
+        {
+          GimpImage *loaded_image;
+
+          g_timer_start (timer);
+          save_image (image, filename, compressions[i].compression);
+          g_timer_stop (timer);
+
+          save_time = MIN (save_time, g_timer_elapsed (timer, NULL));
+
+          g_timer_start (timer);
+          loaded_image = load_image (gimp, filename);
+          g_timer_stop (timer);
+
+          load_time = MIN (load_time, g_timer_elapsed (timer, NULL));
+
+          g_object_unref (loaded_image);
+        }
+
+      g_assert (g_stat (filename, &st) == 0);
+
+      g_test_minimized_result (save_time + load_time,
+                               "%s %dx%d %s: %" G_GINT64_FORMAT " bytes, "
+                               "save %.3f seconds, load %.3f seconds",
+                               precision == GIMP_PRECISION_U8 ? "u8" : "float",
+                               GIMP_TEST_PERF_IMAGE_SIZE,
+                               GIMP_TEST_PERF_IMAGE_SIZE,
+                               compressions[i].name,
+                               (gint64) st.st_size,
+                               save_time, load_time);
+    }
+
+  g_timer_destroy (timer);
+
+  g_unlink (filename);
+  g_free (filename);
+
+  g_object_unref (image);
+}
+
+/**
+ * perf_compression_u8:
+ * @data:
+ *
+ * Compares file size and save/load time of RLE, zlib and zstd on a
+ * large 8-bit image.
+ **/
+static void
+perf_compression_u8 (gconstpointer data)
+{
+  time_compressions (GIMP (data), GIMP_PRECISION_U8);
+}
+
+/**
+ * perf_compression_float:
+ * @data:
+ *
+ * Compares file size and save/load time of RLE, zlib and zstd on a
+ * large float image.
+ **/
+static void
+perf_compression_float (gconstpointer data)
+{
+  time_compressions (GIMP (data), GIMP_PRECISION_FLOAT);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (write_and_read_u8_zlib);
+  ADD_TEST (write_and_read_u8_zstd);
+  ADD_TEST (write_and_read_float_none);
+  ADD_TEST (write_and_read_float_zlib);
+  ADD_TEST (write_and_read_float_zstd);
+  ADD_TEST (lazy_load_and_overwrite);
+
+  /* The benchmarks only run with "-m perf" */
+  if (g_test_perf ())
+    {
+      ADD_TEST (perf_compression_u8);
+      ADD_TEST (perf_compression_float);
+    }
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
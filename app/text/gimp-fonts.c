@@ -20,9 +20,13 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <glib-object.h>
+#include <glib/gstdio.h>
 
 #include <fontconfig/fontconfig.h>
+#include <pango/pangocairo.h>
 
 #include "libgimpbase/gimpbase.h"
 #include "libgimpconfig/gimpconfig.h"
@@ -35,15 +39,60 @@
 
 #include "gimp-fonts.h"
 #include "gimpfontlist.h"
+#include "gimptextlayout.h"
+
+
+#define CONF_FNAME  "fonts.conf"
+#define INDEX_FNAME "fontindex"
+
+#define INDEX_HEADER \
+  "# GIMP fontindex\n" \
+  "#\n" \
+  "# This file caches the list of installed fonts. It is written by\n" \
+  "# GIMP and recreated whenever a font directory changes.\n" \
+  "\n" \
+  "version 1\n"
+
+
+typedef struct _GimpFontsLoad GimpFontsLoad;
+
+struct _GimpFontsLoad
+{
+  Gimp      *gimp;
+
+  gchar     *font_path;   /*  the expanded font path                  */
+  gchar     *user_conf;   /*  the personal fonts.conf                 */
+  gchar     *sys_conf;    /*  the system-wide fonts.conf              */
+  gchar     *index_file;
+
+  FcConfig  *config;      /*  built by the thread, made current later  */
+  gboolean   success;
+  gchar    **names;       /*  the fonts found, from the index or not  */
+  guint      idle_id;
+};
 
 
-#define CONF_FNAME "fonts.conf"
+static gpointer  gimp_fonts_load_thread     (gpointer       data);
+static gboolean  gimp_fonts_load_idle       (gpointer       data);
+static void      gimp_fonts_load_finish     (GimpFontsLoad *load);
 
+static gboolean  gimp_fonts_load_fonts_conf (FcConfig      *config,
+                                             const gchar   *fonts_conf);
+static void      gimp_fonts_add_directories (FcConfig      *config,
+                                             const gchar   *path_str);
 
-static gboolean gimp_fonts_load_fonts_conf (FcConfig    *config,
-                                            gchar       *fonts_conf);
-static void     gimp_fonts_add_directories (FcConfig    *config,
-                                            const gchar *path_str);
+static gchar   * gimp_fonts_get_stamp       (FcConfig      *config,
+                                             const gchar   *path_str);
+static gchar  ** gimp_fonts_read_index      (const gchar   *filename,
+                                             const gchar   *stamp);
+static void      gimp_fonts_write_index     (const gchar   *filename,
+                                             const gchar   *stamp,
+                                             gchar        **names);
+
+
+/*  the font load that is running in the background, if any  */
+static GThread       *load_thread = NULL;
+static GimpFontsLoad *load_data   = NULL;
 
 
 void
@@ -55,20 +104,45 @@ gimp_fonts_init (Gimp *gimp)
   gimp_object_set_name (GIMP_OBJECT (gimp->fonts), "fonts");
 
   g_signal_connect_swapped (gimp->config, "notify::font-path",
-                            G_CALLBACK (gimp_fonts_load), gimp);
+                            G_CALLBACK (gimp_fonts_load_async), gimp);
 }
 
 void
 gimp_fonts_load (Gimp *gimp)
 {
-  FcConfig *config;
-  gchar    *fonts_conf;
-  gchar    *path;
-
   g_return_if_fail (GIMP_IS_FONT_LIST (gimp->fonts));
 
   gimp_set_busy (gimp);
 
+  gimp_fonts_load_async (gimp);
+  gimp_fonts_wait (gimp);
+
+  gimp_unset_busy (gimp);
+}
+
+/**
+ * gimp_fonts_load_async:
+ * @gimp: a #Gimp
+ *
+ * Starts loading the fonts in a background thread. The fonts container
+ * is emptied and stays frozen until the fonts are loaded, it is filled
+ * from the main loop once the thread is done.
+ *
+ * Setting up fontconfig can't be avoided, but the list of fonts is
+ * read from an index in the personal GIMP directory as long as the
+ * fontconfig configuration files and the font directories have not
+ * been modified since the index was written.
+ **/
+void
+gimp_fonts_load_async (Gimp *gimp)
+{
+  GimpFontsLoad *load;
+
+  g_return_if_fail (GIMP_IS_FONT_LIST (gimp->fonts));
+
+  /*  let a load that is still running finish first  */
+  gimp_fonts_wait (gimp);
+
   if (gimp->be_verbose)
     g_print ("Loading fonts\n");
 
@@ -76,36 +150,46 @@ gimp_fonts_load (Gimp *gimp)
 
   gimp_container_clear (GIMP_CONTAINER (gimp->fonts));
 
-  config = FcInitLoadConfig ();
-
-  if (! config)
-    goto cleanup;
+  load = g_slice_new0 (GimpFontsLoad);
 
-  fonts_conf = gimp_personal_rc_file (CONF_FNAME);
-  if (! gimp_fonts_load_fonts_conf (config, fonts_conf))
-    goto cleanup;
+  load->gimp       = gimp;
+  load->font_path  = gimp_config_path_expand (gimp->config->font_path,
+                                              TRUE, NULL);
+  load->user_conf  = gimp_personal_rc_file (CONF_FNAME);
+  load->sys_conf   = g_build_filename (gimp_sysconf_directory (),
+                                       CONF_FNAME, NULL);
+  load->index_file = gimp_personal_rc_file (INDEX_FNAME);
 
-  fonts_conf = g_build_filename (gimp_sysconf_directory (), CONF_FNAME, NULL);
-  if (! gimp_fonts_load_fonts_conf (config, fonts_conf))
-    goto cleanup;
+  load_data   = load;
+  load_thread = g_thread_new ("fonts", gimp_fonts_load_thread, load);
+}
 
-  path = gimp_config_path_expand (gimp->config->font_path, TRUE, NULL);
-  gimp_fonts_add_directories (config, path);
-  g_free (path);
+/**
+ * gimp_fonts_wait:
+ * @gimp: a #Gimp
+ *
+ * Blocks until a font load started with gimp_fonts_load_async() is
+ * complete and the fonts container is filled. Returns immediately if
+ * no fonts are being loaded.
+ **/
+void
+gimp_fonts_wait (Gimp *gimp)
+{
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
 
-  if (! FcConfigBuildFonts (config))
+  if (load_thread)
     {
-      FcConfigDestroy (config);
-      goto cleanup;
-    }
+      GimpFontsLoad *load = load_data;
 
-  FcConfigSetCurrent (config);
+      g_thread_join (load_thread);
 
-  gimp_font_list_restore (GIMP_FONT_LIST (gimp->fonts));
+      load_thread = NULL;
+      load_data   = NULL;
 
- cleanup:
-  gimp_container_thaw (GIMP_CONTAINER (gimp->fonts));
-  gimp_unset_busy (gimp);
+      g_source_remove (load->idle_id);
+
+      gimp_fonts_load_finish (load);
+    }
 }
 
 void
@@ -113,6 +197,10 @@ gimp_fonts_reset (Gimp *gimp)
 {
   g_return_if_fail (GIMP_IS_GIMP (gimp));
 
+  gimp_fonts_wait (gimp);
+
+  gimp_text_layout_clear_cache ();
+
   if (gimp->no_fonts)
     return;
 
@@ -120,21 +208,117 @@ gimp_fonts_reset (Gimp *gimp)
   FcInitReinitialize ();
 }
 
+
+/*  private functions  */
+
+static gpointer
+gimp_fonts_load_thread (gpointer data)
+{
+  GimpFontsLoad *load = data;
+  FcConfig      *config;
+  gchar         *stamp;
+
+  config = FcInitLoadConfig ();
+
+  if (! config)
+    goto done;
+
+  if (! gimp_fonts_load_fonts_conf (config, load->user_conf))
+    goto done;
+
+  if (! gimp_fonts_load_fonts_conf (config, load->sys_conf))
+    goto done;
+
+  gimp_fonts_add_directories (config, load->font_path);
+
+  if (! FcConfigBuildFonts (config))
+    {
+      FcConfigDestroy (config);
+      goto done;
+    }
+
+  /*  the config only becomes current in gimp_fonts_load_finish(), on
+   *  the main thread, which is still using the old one
+   */
+  load->config = config;
+
+  stamp = gimp_fonts_get_stamp (config, load->font_path);
+
+  load->names = gimp_fonts_read_index (load->index_file, stamp);
+
+  if (! load->names)
+    {
+      load->names = gimp_font_list_query_names (config);
+
+      gimp_fonts_write_index (load->index_file, stamp, load->names);
+    }
+
+  g_free (stamp);
+
+  load->success = TRUE;
+
+ done:
+  load->idle_id = g_idle_add (gimp_fonts_load_idle, load);
+
+  return NULL;
+}
+
 static gboolean
-gimp_fonts_load_fonts_conf (FcConfig *config,
-                            gchar    *fonts_conf)
+gimp_fonts_load_idle (gpointer data)
+{
+  GimpFontsLoad *load = data;
+
+  /*  make sure the thread is done with load  */
+  g_thread_join (load_thread);
+
+  load_thread = NULL;
+  load_data   = NULL;
+
+  gimp_fonts_load_finish (load);
+
+  return FALSE;
+}
+
+static void
+gimp_fonts_load_finish (GimpFontsLoad *load)
 {
-  gboolean ret = TRUE;
+  Gimp *gimp = load->gimp;
 
+  if (load->success)
+    FcConfigSetCurrent (load->config);
+  else if (load->config)
+    FcConfigDestroy (load->config);
+
+  /*  cached layouts and font maps refer to the old set of fonts  */
+  gimp_text_layout_clear_cache ();
+
+  if (load->success)
+    gimp_font_list_restore_names (GIMP_FONT_LIST (gimp->fonts),
+                                  (const gchar **) load->names);
+
+  gimp_container_thaw (GIMP_CONTAINER (gimp->fonts));
+
+  g_free (load->font_path);
+  g_free (load->user_conf);
+  g_free (load->sys_conf);
+  g_free (load->index_file);
+  g_strfreev (load->names);
+
+  g_slice_free (GimpFontsLoad, load);
+}
+
+static gboolean
+gimp_fonts_load_fonts_conf (FcConfig    *config,
+                            const gchar *fonts_conf)
+{
   if (! FcConfigParseAndLoad (config, (const guchar *) fonts_conf, FcFalse))
     {
       FcConfigDestroy (config);
-      ret = FALSE;
-    }
 
-  g_free (fonts_conf);
+      return FALSE;
+    }
 
-  return ret;
+  return TRUE;
 }
 
 static void
@@ -154,3 +338,164 @@ gimp_fonts_add_directories (FcConfig    *config,
 
   gimp_path_free (path);
 }
+
+static void
+gimp_fonts_stamp_file (GString     *stamp,
+                       const gchar *filename)
+{
+  GStatBuf  st;
+  gchar    *escaped;
+
+  escaped = g_strescape (filename, NULL);
+
+  if (g_stat (filename, &st) == 0)
+    g_string_append_printf (stamp, "%" G_GINT64_FORMAT " %s\n",
+                            (gint64) st.st_mtime, escaped);
+  else
+    g_string_append_printf (stamp, "- %s\n", escaped);
+
+  g_free (escaped);
+}
+
+static void
+gimp_fonts_stamp_directory (GString     *stamp,
+                            const gchar *dirname)
+{
+  GDir        *dir;
+  const gchar *name;
+
+  gimp_fonts_stamp_file (stamp, dirname);
+
+  dir = g_dir_open (dirname, 0, NULL);
+
+  if (! dir)
+    return;
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      gchar *filename = g_build_filename (dirname, name, NULL);
+
+      if (g_file_test (filename, G_FILE_TEST_IS_DIR) &&
+          ! g_file_test (filename, G_FILE_TEST_IS_SYMLINK))
+        gimp_fonts_stamp_directory (stamp, filename);
+
+      g_free (filename);
+    }
+
+  g_dir_close (dir);
+}
+
+/*  Describes the fontconfig setup by the modification times of all
+ *  configuration files and font directories. Adding, removing or
+ *  replacing a font changes the modification time of its directory,
+ *  so the index is valid as long as the stamp doesn't change.
+ */
+static gchar *
+gimp_fonts_get_stamp (FcConfig    *config,
+                      const gchar *path_str)
+{
+  GString   *stamp = g_string_new (NULL);
+  FcStrList *strings;
+  FcChar8   *string;
+  GList     *path;
+  GList     *list;
+
+  strings = FcConfigGetConfigFiles (config);
+
+  while ((string = FcStrListNext (strings)))
+    gimp_fonts_stamp_file (stamp, (const gchar *) string);
+
+  FcStrListDone (strings);
+
+  strings = FcConfigGetFontDirs (config);
+
+  while ((string = FcStrListNext (strings)))
+    gimp_fonts_stamp_file (stamp, (const gchar *) string);
+
+  FcStrListDone (strings);
+
+  /*  directories from the font path are added as application fonts
+   *  and may not show up in the config's font directories
+   */
+  path = gimp_path_parse (path_str, 256, TRUE, NULL);
+
+  for (list = path; list; list = list->next)
+    gimp_fonts_stamp_directory (stamp, list->data);
+
+  gimp_path_free (path);
+
+  return g_string_free (stamp, FALSE);
+}
+
+static gchar **
+gimp_fonts_read_index (const gchar *filename,
+                       const gchar *stamp)
+{
+  gchar      *contents;
+  gchar      *names_start;
+  gchar     **lines;
+  GPtrArray  *names;
+  gint        i;
+
+  if (! g_file_get_contents (filename, &contents, NULL, NULL))
+    return NULL;
+
+  /*  the index is only valid if it was written for the same stamp  */
+  if (! g_str_has_prefix (contents, INDEX_HEADER) ||
+      strncmp (contents + strlen (INDEX_HEADER), stamp, strlen (stamp)) ||
+      contents[strlen (INDEX_HEADER) + strlen (stamp)] != '\n')
+    {
+      g_free (contents);
+
+      return NULL;
+    }
+
+  names_start = contents + strlen (INDEX_HEADER) + strlen (stamp) + 1;
+
+  lines = g_strsplit (names_start, "\n", -1);
+  names = g_ptr_array_new ();
+
+  for (i = 0; lines[i]; i++)
+    {
+      if (*lines[i])
+        g_ptr_array_add (names, g_strcompress (lines[i]));
+    }
+
+  g_ptr_array_add (names, NULL);
+
+  g_strfreev (lines);
+  g_free (contents);
+
+  return (gchar **) g_ptr_array_free (names, FALSE);
+}
+
+static void
+gimp_fonts_write_index (const gchar  *filename,
+                        const gchar  *stamp,
+                        gchar       **names)
+{
+  GString *contents = g_string_new (INDEX_HEADER);
+  GError  *error    = NULL;
+  gint     i;
+
+  g_string_append (contents, stamp);
+  g_string_append_c (contents, '\n');
+
+  for (i = 0; names[i]; i++)
+    {
+      gchar *escaped = g_strescape (names[i], NULL);
+
+      g_string_append (contents, escaped);
+      g_string_append_c (contents, '\n');
+
+      g_free (escaped);
+    }
+
+  if (! g_file_set_contents (filename, contents->str, contents->len, &error))
+    {
+      g_printerr ("Failed to write font index: %s\n", error->message);
+      g_clear_error (&error);
+    }
+
+  g_string_free (contents, TRUE);
+}
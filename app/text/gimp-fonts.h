@@ -19,9 +19,11 @@
 #define __GIMP_FONTS_H__
 
 
-void   gimp_fonts_init  (Gimp *gimp);
-void   gimp_fonts_load  (Gimp *gimp);
-void   gimp_fonts_reset (Gimp *gimp);
+void   gimp_fonts_init       (Gimp *gimp);
+void   gimp_fonts_load       (Gimp *gimp);
+void   gimp_fonts_load_async (Gimp *gimp);
+void   gimp_fonts_wait       (Gimp *gimp);
+void   gimp_fonts_reset      (Gimp *gimp);
 
 
 #endif  /* __GIMP_FONTS_H__ */
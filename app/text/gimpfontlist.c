@@ -48,11 +48,12 @@
 
 static void   gimp_font_list_add_font   (GimpFontList         *list,
                                          PangoContext         *context,
-                                         PangoFontDescription *desc);
+                                         const gchar          *name);
 
-static void   gimp_font_list_load_names (GimpFontList         *list,
-                                         PangoFontMap         *fontmap,
-                                         PangoContext         *context);
+static void   gimp_font_list_add_name   (GPtrArray            *names,
+                                         PangoFontDescription *desc);
+static void   gimp_font_list_load_names (GPtrArray            *names,
+                                         gpointer              fc_config);
 
 
 G_DEFINE_TYPE (GimpFontList, gimp_font_list, GIMP_TYPE_LIST)
@@ -90,11 +91,59 @@ gimp_font_list_new (gdouble xresolution,
 
 void
 gimp_font_list_restore (GimpFontList *list)
+{
+  gchar **names;
+
+  g_return_if_fail (GIMP_IS_FONT_LIST (list));
+
+  names = gimp_font_list_query_names (NULL);
+
+  gimp_font_list_restore_names (list, (const gchar **) names);
+
+  g_strfreev (names);
+}
+
+/**
+ * gimp_font_list_query_names:
+ * @fc_config: the #FcConfig to enumerate, or %NULL for the current one
+ *
+ * Enumerates the fonts known to a fontconfig configuration. This
+ * function doesn't touch any #GimpFontList and may be called from any
+ * thread, with a @fc_config which isn't current yet.
+ *
+ * Return value: a %NULL-terminated array of font names, to be freed
+ *               with g_strfreev()
+ **/
+gchar **
+gimp_font_list_query_names (gpointer fc_config)
+{
+  GPtrArray *names = g_ptr_array_new ();
+
+  gimp_font_list_load_names (names, fc_config);
+
+  g_ptr_array_add (names, NULL);
+
+  return (gchar **) g_ptr_array_free (names, FALSE);
+}
+
+/**
+ * gimp_font_list_restore_names:
+ * @list:  a #GimpFontList
+ * @names: a %NULL-terminated array of font names
+ *
+ * Adds a #GimpFont for each of @names to @list, as returned by
+ * gimp_font_list_query_names() or read back from the font index.
+ **/
+void
+gimp_font_list_restore_names (GimpFontList  *list,
+                              const gchar  **names)
 {
   PangoFontMap *fontmap;
   PangoContext *context;
+  gint          i;
 
   g_return_if_fail (GIMP_IS_FONT_LIST (list));
+  g_return_if_fail (names != NULL);
 
   fontmap = pango_cairo_font_map_new_for_font_type (CAIRO_FONT_TYPE_FT);
   if (! fontmap)
@@ -108,7 +157,9 @@ gimp_font_list_restore (GimpFontList *list)
 
   gimp_container_freeze (GIMP_CONTAINER (list));
 
-  gimp_font_list_load_names (list, PANGO_FONT_MAP (fontmap), context);
+  for (i = 0; names[i]; i++)
+    gimp_font_list_add_font (list, context, names[i]);
+
   g_object_unref (context);
 
   gimp_list_sort_by_name (GIMP_LIST (list));
@@ -117,8 +168,23 @@ gimp_font_list_restore (GimpFontList *list)
 }
 
 static void
-gimp_font_list_add_font (GimpFontList         *list,
-                         PangoContext         *context,
+gimp_font_list_add_font (GimpFontList *list,
+                         PangoContext *context,
+                         const gchar  *name)
+{
+  GimpFont *font;
+
+  font = g_object_new (GIMP_TYPE_FONT,
+                       "name",          name,
+                       "pango-context", context,
+                       NULL);
+
+  gimp_container_add (GIMP_CONTAINER (list), GIMP_OBJECT (font));
+  g_object_unref (font);
+}
+
+static void
+gimp_font_list_add_name (GPtrArray            *names,
                          PangoFontDescription *desc)
 {
   gchar *name;
@@ -129,33 +195,22 @@ gimp_font_list_add_font (GimpFontList         *list,
   name = pango_font_description_to_string (desc);
 
   if (g_utf8_validate (name, -1, NULL))
-    {
-      GimpFont *font;
-
-      font = g_object_new (GIMP_TYPE_FONT,
-                           "name",          name,
-                           "pango-context", context,
-                           NULL);
-
-      gimp_container_add (GIMP_CONTAINER (list), GIMP_OBJECT (font));
-      g_object_unref (font);
-    }
-
-  g_free (name);
+    g_ptr_array_add (names, name);
+  else
+    g_free (name);
 }
 
 #ifdef USE_FONTCONFIG_DIRECTLY
 /* We're really chummy here with the implementation. Oh well. */
 
 /* This is copied straight from make_alias_description in pango, plus
- * the gimp_font_list_add_font bits.
+ * the gimp_font_list_add_name bits.
  */
 static void
-gimp_font_list_make_alias (GimpFontList *list,
-                           PangoContext *context,
-                           const gchar  *family,
-                           gboolean      bold,
-                           gboolean      italic)
+gimp_font_list_make_alias (GPtrArray   *names,
+                           const gchar *family,
+                           gboolean     bold,
+                           gboolean     italic)
 {
   PangoFontDescription *desc = pango_font_description_new ();
 
@@ -169,31 +224,29 @@ gimp_font_list_make_alias (GimpFontList *list,
                                      PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL);
   pango_font_description_set_stretch (desc, PANGO_STRETCH_NORMAL);
 
-  gimp_font_list_add_font (list, context, desc);
+  gimp_font_list_add_name (names, desc);
 
   pango_font_description_free (desc);
 }
 
 static void
-gimp_font_list_load_aliases (GimpFontList *list,
-                             PangoContext *context)
+gimp_font_list_load_aliases (GPtrArray *names)
 {
   const gchar *families[] = { "Sans", "Serif", "Monospace" };
   gint         i;
 
   for (i = 0; i < 3; i++)
     {
-      gimp_font_list_make_alias (list, context, families[i], FALSE, FALSE);
-      gimp_font_list_make_alias (list, context, families[i], TRUE,  FALSE);
-      gimp_font_list_make_alias (list, context, families[i], FALSE, TRUE);
-      gimp_font_list_make_alias (list, context, families[i], TRUE,  TRUE);
+      gimp_font_list_make_alias (names, families[i], FALSE, FALSE);
+      gimp_font_list_make_alias (names, families[i], TRUE,  FALSE);
+      gimp_font_list_make_alias (names, families[i], FALSE, TRUE);
+      gimp_font_list_make_alias (names, families[i], TRUE,  TRUE);
     }
 }
 
 static void
-gimp_font_list_load_names (GimpFontList *list,
-                           PangoFontMap *fontmap,
-                           PangoContext *context)
+gimp_font_list_load_names (GPtrArray *names,
+                           gpointer   fc_config)
 {
   FcObjectSet *os;
   FcPattern   *pat;
@@ -206,7 +259,7 @@ gimp_font_list_load_names (GimpFontList *list,
 
   pat = FcPatternCreate ();
 
-  fontset = FcFontList (NULL, pat, os);
+  fontset = FcFontList (fc_config, pat, os);
 
   FcPatternDestroy (pat);
   FcObjectSetDestroy (os);
@@ -216,30 +269,36 @@ gimp_font_list_load_names (GimpFontList *list,
       PangoFontDescription *desc;
 
       desc = pango_fc_font_description_from_pattern (fontset->fonts[i], FALSE);
-      gimp_font_list_add_font (list, context, desc);
+      gimp_font_list_add_name (names, desc);
       pango_font_description_free (desc);
     }
 
   /*  only create aliases if there is at least one font available  */
   if (fontset->nfont > 0)
-    gimp_font_list_load_aliases (list, context);
+    gimp_font_list_load_aliases (names);
 
   FcFontSetDestroy (fontset);
 }
 
 #else  /* ! USE_FONTCONFIG_DIRECTLY */
 
+/*  pango can only list the fonts of the current configuration  */
 static void
-gimp_font_list_load_names (GimpFontList *list,
-                           PangoFontMap *fontmap,
-                           PangoContext *context)
+gimp_font_list_load_names (GPtrArray *names,
+                           gpointer   fc_config)
 {
+  PangoFontMap     *fontmap;
   PangoFontFamily **families;
   PangoFontFace   **faces;
   gint              n_families;
   gint              n_faces;
   gint              i, j;
 
+  fontmap = pango_cairo_font_map_new_for_font_type (CAIRO_FONT_TYPE_FT);
+  if (! fontmap)
+    g_error ("You are using a Pango that has been built against a cairo "
+             "that lacks the Freetype font backend");
+
   pango_font_map_list_families (fontmap, &families, &n_families);
 
   for (i = 0; i < n_families; i++)
@@ -251,12 +310,13 @@ gimp_font_list_load_names (GimpFontList *list,
           PangoFontDescription *desc;
 
           desc = pango_font_face_describe (faces[j]);
-          gimp_font_list_add_font (list, context, desc);
+          gimp_font_list_add_name (names, desc);
           pango_font_description_free (desc);
         }
     }
 
   g_free (families);
+  g_object_unref (fontmap);
 }
 
 #endif /* USE_FONTCONFIG_DIRECTLY */
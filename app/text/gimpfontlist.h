@@ -50,11 +50,15 @@ struct _GimpFontListClass
 };
 
 
-GType           gimp_font_list_get_type (void) G_GNUC_CONST;
+GType           gimp_font_list_get_type      (void) G_GNUC_CONST;
 
-GimpContainer * gimp_font_list_new      (gdouble       xresolution,
-                                         gdouble       yresolution);
-void            gimp_font_list_restore  (GimpFontList *list);
+GimpContainer * gimp_font_list_new           (gdouble        xresolution,
+                                              gdouble        yresolution);
+void            gimp_font_list_restore       (GimpFontList  *list);
+
+gchar        ** gimp_font_list_query_names   (gpointer       fc_config);
+void            gimp_font_list_restore_names (GimpFontList  *list,
+                                              const gchar  **names);
 
 
 #endif  /*  __GIMP_FONT_LIST_H__  */
@@ -46,6 +46,7 @@
 #include "core/gimpitemtree.h"
 #include "core/gimpparasitelist.h"
 
+#include "gimp-fonts.h"
 #include "gimptext.h"
 #include "gimptextlayer.h"
 #include "gimptextlayer-transform.h"
@@ -107,6 +108,7 @@ static void       gimp_text_layer_push_undo      (GimpDrawable      *drawable,
                                                   gint               height);
 
 static void       gimp_text_layer_text_changed   (GimpTextLayer     *layer);
+static void       gimp_text_layer_drop_layout    (GimpTextLayer     *layer);
 static gboolean   gimp_text_layer_render         (GimpTextLayer     *layer);
 static void       gimp_text_layer_render_layout  (GimpTextLayer     *layer,
                                                   GimpTextLayout    *layout);
@@ -178,6 +180,7 @@ gimp_text_layer_init (GimpTextLayer *layer)
 {
   layer->text          = NULL;
   layer->text_parasite = NULL;
+  layer->layout        = NULL;
 }
 
 static void
@@ -191,6 +194,8 @@ gimp_text_layer_finalize (GObject *object)
       layer->text = NULL;
     }
 
+  gimp_text_layer_drop_layout (layer);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -238,6 +243,10 @@ gimp_text_layer_set_property (GObject      *object,
       break;
     case PROP_MODIFIED:
       text_layer->modified = g_value_get_boolean (value);
+
+      /*  the buffer no longer shows what was rendered last  */
+      if (text_layer->modified)
+        gimp_text_layer_drop_layout (text_layer);
       break;
 
     default:
@@ -357,6 +366,8 @@ gimp_text_layer_set_buffer (GimpDrawable *drawable,
   GimpTextLayer *layer = GIMP_TEXT_LAYER (drawable);
   GimpImage     *image = gimp_item_get_image (GIMP_ITEM (layer));
 
+  gimp_text_layer_drop_layout (layer);
+
   if (push_undo && ! layer->modified)
     gimp_image_undo_group_start (image, GIMP_UNDO_GROUP_DRAWABLE_MOD,
                                  undo_desc);
@@ -388,6 +399,8 @@ gimp_text_layer_push_undo (GimpDrawable *drawable,
   GimpTextLayer *layer = GIMP_TEXT_LAYER (drawable);
   GimpImage     *image = gimp_item_get_image (GIMP_ITEM (layer));
 
+  gimp_text_layer_drop_layout (layer);
+
   if (! layer->modified)
     gimp_image_undo_group_start (image, GIMP_UNDO_GROUP_DRAWABLE, undo_desc);
 
@@ -603,6 +616,16 @@ gimp_text_layer_text_changed (GimpTextLayer *layer)
   gimp_text_layer_render (layer);
 }
 
+static void
+gimp_text_layer_drop_layout (GimpTextLayer *layer)
+{
+  if (layer->layout)
+    {
+      g_object_unref (layer->layout);
+      layer->layout = NULL;
+    }
+}
+
 static gboolean
 gimp_text_layer_render (GimpTextLayer *layer)
 {
@@ -622,6 +645,9 @@ gimp_text_layer_render (GimpTextLayer *layer)
   item     = GIMP_ITEM (layer);
   image    = gimp_item_get_image (item);
 
+  /*  the fonts might still be loading in the background  */
+  gimp_fonts_wait (image->gimp);
+
   if (gimp_container_is_empty (image->gimp->fonts))
     {
       gimp_message_literal (image->gimp, NULL, GIMP_MESSAGE_ERROR,
@@ -695,7 +721,8 @@ gimp_text_layer_render (GimpTextLayer *layer)
 
   gimp_text_layer_render_layout (layer, layout);
 
-  g_object_unref (layout);
+  gimp_text_layer_drop_layout (layer);
+  layer->layout = layout;
 
   g_object_thaw_notify (G_OBJECT (drawable));
 
@@ -711,18 +738,41 @@ gimp_text_layer_render_layout (GimpTextLayer  *layer,
   GeglBuffer      *buffer;
   cairo_t         *cr;
   cairo_surface_t *surface;
-  gint             width;
-  gint             height;
+  PangoRectangle   area;
+  gboolean         partial;
 
   g_return_if_fail (gimp_drawable_has_alpha (drawable));
 
-  width  = gimp_item_get_width  (item);
-  height = gimp_item_get_height (item);
+  /*  if the buffer still shows the previous layout, only render the
+   *  lines that changed since then
+   */
+  partial = (layer->layout &&
+             gimp_text_layout_get_damage (layout, layer->layout, &area));
+
+  if (partial)
+    {
+      if (area.width < 1 || area.height < 1)
+        return;
+    }
+  else
+    {
+      area.x      = 0;
+      area.y      = 0;
+      area.width  = gimp_item_get_width  (item);
+      area.height = gimp_item_get_height (item);
+    }
 
-  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                        area.width, area.height);
 
   cr = cairo_create (surface);
-  gimp_text_layout_render (layout, cr, layer->text->base_dir, FALSE);
+  cairo_translate (cr, -area.x, -area.y);
+
+  if (partial)
+    gimp_text_layout_render_area (layout, cr, &area);
+  else
+    gimp_text_layout_render (layout, cr, layer->text->base_dir, FALSE);
+
   cairo_destroy (cr);
 
   cairo_surface_flush (surface);
@@ -730,10 +780,11 @@ gimp_text_layer_render_layout (GimpTextLayer  *layer,
   buffer = gimp_cairo_surface_create_buffer (surface);
 
   gegl_buffer_copy (buffer, NULL,
-                    gimp_drawable_get_buffer (drawable), NULL);
+                    gimp_drawable_get_buffer (drawable),
+                    GEGL_RECTANGLE (area.x, area.y, 0, 0));
 
   g_object_unref (buffer);
   cairo_surface_destroy (surface);
 
-  gimp_drawable_update (drawable, 0, 0, width, height);
+  gimp_drawable_update (drawable, area.x, area.y, area.width, area.height);
 }
@@ -48,6 +48,11 @@ struct _GimpTextLayer
   gboolean      modified;
 
   const Babl   *convert_format;
+
+  GimpTextLayout *layout;       /*  the layout that the buffer currently
+                                 *  shows, used to limit re-rendering to
+                                 *  the lines that changed
+                                 */
 };
 
 struct _GimpTextLayerClass
@@ -55,3 +55,66 @@ gimp_text_layout_render (GimpTextLayout    *layout,
   else
     pango_cairo_show_layout (cr, pango_layout);
 }
+
+/*  Renders only the lines of @layout whose ink extents intersect @area
+ *  (given in layer pixels), clipped to @area. This gives the same
+ *  pixels in @area as gimp_text_layout_render() without rasterizing
+ *  the rest of the layout.
+ */
+void
+gimp_text_layout_render_area (GimpTextLayout       *layout,
+                              cairo_t              *cr,
+                              const PangoRectangle *area)
+{
+  PangoLayout     *pango_layout;
+  PangoLayoutIter *iter;
+  cairo_matrix_t   trafo;
+  gint             x, y;
+
+  g_return_if_fail (GIMP_IS_TEXT_LAYOUT (layout));
+  g_return_if_fail (cr != NULL);
+  g_return_if_fail (area != NULL);
+
+  cairo_rectangle (cr, area->x, area->y, area->width, area->height);
+  cairo_clip (cr);
+
+  gimp_text_layout_get_offsets (layout, &x, &y);
+
+  cairo_translate (cr, x, y);
+
+  gimp_text_layout_get_transform (layout, &trafo);
+  cairo_transform (cr, &trafo);
+
+  pango_layout = gimp_text_layout_get_pango_layout (layout);
+
+  iter = pango_layout_get_iter (pango_layout);
+
+  do
+    {
+      PangoLayoutLine *line;
+      PangoRectangle   ink;
+      PangoRectangle   logical;
+      gint             baseline;
+
+      pango_layout_iter_get_line_extents (iter, &ink, &logical);
+      pango_extents_to_pixels (&ink, NULL);
+
+      ink.x += x;
+      ink.y += y;
+
+      if (ink.x < area->x + area->width  && area->x < ink.x + ink.width &&
+          ink.y < area->y + area->height && area->y < ink.y + ink.height)
+        {
+          line     = pango_layout_iter_get_line_readonly (iter);
+          baseline = pango_layout_iter_get_baseline (iter);
+
+          cairo_move_to (cr,
+                         pango_units_to_double (logical.x),
+                         pango_units_to_double (baseline));
+          pango_cairo_show_layout_line (cr, line);
+        }
+    }
+  while (pango_layout_iter_next_line (iter));
+
+  pango_layout_iter_free (iter);
+}
@@ -22,10 +22,13 @@
 #define __GIMP_TEXT_LAYOUT_RENDER_H__
 
 
-void  gimp_text_layout_render (GimpTextLayout    *layout,
-                               cairo_t           *cr,
-                               GimpTextDirection  base_dir,
-                               gboolean           path);
+void  gimp_text_layout_render      (GimpTextLayout       *layout,
+                                    cairo_t              *cr,
+                                    GimpTextDirection     base_dir,
+                                    gboolean              path);
+void  gimp_text_layout_render_area (GimpTextLayout       *layout,
+                                    cairo_t              *cr,
+                                    const PangoRectangle *area);
 
 
 #endif /* __GIMP_TEXT_LAYOUT_RENDER_H__ */
@@ -28,6 +28,7 @@
 
 #include "libgimpbase/gimpbase.h"
 #include "libgimpcolor/gimpcolor.h"
+#include "libgimpconfig/gimpconfig.h"
 #include "libgimpmath/gimpmath.h"
 
 #include "text-types.h"
@@ -36,6 +37,18 @@
 #include "gimptextlayout.h"
 
 
+/*  the number of recently built layouts kept around for reuse  */
+#define LAYOUT_CACHE_SIZE 64
+
+
+typedef struct _GimpTextLayoutLine GimpTextLayoutLine;
+
+struct _GimpTextLayoutLine
+{
+  guint           hash;  /*  glyphs, attributes and position of the line  */
+  PangoRectangle  ink;   /*  ink extents in layer pixels                  */
+};
+
 struct _GimpTextLayout
 {
   GObject         object;
@@ -45,17 +58,26 @@ struct _GimpTextLayout
   gdouble         yres;
   PangoLayout    *layout;
   PangoRectangle  extents;
+
+  GArray         *lines;
 };
 
 
-static void           gimp_text_layout_finalize   (GObject        *object);
+static void             gimp_text_layout_finalize     (GObject        *object);
 
-static void           gimp_text_layout_position   (GimpTextLayout *layout);
-static void           gimp_text_layout_set_markup (GimpTextLayout *layout);
+static GimpTextLayout * gimp_text_layout_create       (GimpText       *text,
+                                                       gdouble         xres,
+                                                       gdouble         yres);
+static gchar          * gimp_text_layout_cache_key    (GimpText       *text,
+                                                       gdouble         xres,
+                                                       gdouble         yres);
+static void             gimp_text_layout_position     (GimpTextLayout *layout);
+static void             gimp_text_layout_set_markup   (GimpTextLayout *layout);
+static void             gimp_text_layout_ensure_lines (GimpTextLayout *layout);
 
-static PangoContext * gimp_text_get_pango_context (GimpText       *text,
-                                                   gdouble         xres,
-                                                   gdouble         yres);
+static PangoContext   * gimp_text_get_pango_context   (GimpText       *text,
+                                                       gdouble         xres,
+                                                       gdouble         yres);
 
 
 G_DEFINE_TYPE (GimpTextLayout, gimp_text_layout, G_TYPE_OBJECT)
@@ -63,6 +85,16 @@ G_DEFINE_TYPE (GimpTextLayout, gimp_text_layout, G_TYPE_OBJECT)
 #define parent_class gimp_text_layout_parent_class
 
 
+/*  layouts by cache key, most recently used first in layout_lru  */
+static GHashTable *layout_cache = NULL;
+static GQueue      layout_lru   = G_QUEUE_INIT;
+
+/*  font maps by resolution, so that fonts and their rendered glyphs
+ *  are shared between all layouts
+ */
+static GHashTable *font_maps    = NULL;
+
+
 static void
 gimp_text_layout_class_init (GimpTextLayoutClass *klass)
 {
@@ -76,6 +108,7 @@ gimp_text_layout_init (GimpTextLayout *layout)
 {
   layout->text   = NULL;
   layout->layout = NULL;
+  layout->lines  = NULL;
 }
 
 static void
@@ -93,15 +126,120 @@ gimp_text_layout_finalize (GObject *object)
       g_object_unref (layout->layout);
       layout->layout = NULL;
     }
+  if (layout->lines)
+    {
+      g_array_free (layout->lines, TRUE);
+      layout->lines = NULL;
+    }
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
 
+/**
+ * gimp_text_layout_new:
+ * @text: a #GimpText
+ * @xres: horizontal resolution
+ * @yres: vertical resolution
+ *
+ * Returns a layout of @text at the given resolution. Layouts are
+ * cached by everything that affects them (text, markup, font, box,
+ * ...), so asking again for an unchanged text returns the layout
+ * built before instead of shaping the text again. The returned
+ * layout keeps a copy of @text and must be treated as read-only.
+ *
+ * Return value: a new reference to a #GimpTextLayout
+ **/
 GimpTextLayout *
 gimp_text_layout_new (GimpText  *text,
                       gdouble    xres,
                       gdouble    yres)
+{
+  GimpTextLayout *layout;
+  gchar          *key;
+
+  g_return_val_if_fail (GIMP_IS_TEXT (text), NULL);
+
+  if (! layout_cache)
+    layout_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+  key = gimp_text_layout_cache_key (text, xres, yres);
+
+  layout = g_hash_table_lookup (layout_cache, key);
+
+  if (layout)
+    {
+      g_free (key);
+
+      g_queue_remove (&layout_lru, layout);
+      g_queue_push_head (&layout_lru, layout);
+
+      return g_object_ref (layout);
+    }
+
+  text = gimp_config_duplicate (GIMP_CONFIG (text));
+
+  layout = gimp_text_layout_create (text, xres, yres);
+
+  g_object_unref (text);
+
+  if (! layout)
+    {
+      g_free (key);
+
+      return NULL;
+    }
+
+  g_object_set_data_full (G_OBJECT (layout), "gimp-text-layout-cache-key",
+                          key, (GDestroyNotify) g_free);
+
+  g_hash_table_insert (layout_cache, key, layout);
+  g_queue_push_head (&layout_lru, g_object_ref (layout));
+
+  while (g_queue_get_length (&layout_lru) > LAYOUT_CACHE_SIZE)
+    {
+      GimpTextLayout *old = g_queue_pop_tail (&layout_lru);
+
+      g_hash_table_remove (layout_cache,
+                           g_object_get_data (G_OBJECT (old),
+                                              "gimp-text-layout-cache-key"));
+      g_object_unref (old);
+    }
+
+  return layout;
+}
+
+/**
+ * gimp_text_layout_clear_cache:
+ *
+ * Drops all cached layouts and font maps. Needs to be called whenever
+ * the set of available fonts changes.
+ **/
+void
+gimp_text_layout_clear_cache (void)
+{
+  GimpTextLayout *layout;
+
+  if (layout_cache)
+    {
+      g_hash_table_destroy (layout_cache);
+      layout_cache = NULL;
+    }
+
+  while ((layout = g_queue_pop_head (&layout_lru)))
+    g_object_unref (layout);
+
+  if (font_maps)
+    {
+      g_hash_table_destroy (font_maps);
+      font_maps = NULL;
+    }
+}
+
+static GimpTextLayout *
+gimp_text_layout_create (GimpText  *text,
+                         gdouble    xres,
+                         gdouble    yres)
 {
   GimpTextLayout       *layout;
   PangoContext         *context;
@@ -109,8 +247,6 @@ gimp_text_layout_new (GimpText  *text,
   PangoAlignment        alignment = PANGO_ALIGN_LEFT;
   gint                  size;
 
-  g_return_val_if_fail (GIMP_IS_TEXT (text), NULL);
-
   font_desc = pango_font_description_from_string (text->font);
   g_return_val_if_fail (font_desc != NULL, NULL);
 
@@ -444,6 +580,133 @@ gimp_text_layout_untransform_distance (GimpTextLayout *layout,
     }
 }
 
+/**
+ * gimp_text_layout_get_damage:
+ * @layout:     a #GimpTextLayout
+ * @old_layout: the #GimpTextLayout that was rendered before
+ * @damage:     returns the area that differs between the two layouts
+ *
+ * Compares the lines of @layout with the lines of @old_layout and
+ * returns the union of the ink extents of all lines that changed,
+ * in layer pixels. Lines are compared by their glyphs, attributes
+ * and position, so typing a character only damages the line it is
+ * typed into (and the lines after it if they reflow).
+ *
+ * Return value: %TRUE if @damage is valid, %FALSE if the layouts
+ *               can't be compared and all of @layout must be
+ *               rendered again.
+ **/
+gboolean
+gimp_text_layout_get_damage (GimpTextLayout *layout,
+                             GimpTextLayout *old_layout,
+                             PangoRectangle *damage)
+{
+  cairo_matrix_t  matrix;
+  gint            x1 = G_MAXINT;
+  gint            y1 = G_MAXINT;
+  gint            x2 = G_MININT;
+  gint            y2 = G_MININT;
+  guint           n_lines;
+  guint           i;
+
+  g_return_val_if_fail (GIMP_IS_TEXT_LAYOUT (layout), FALSE);
+  g_return_val_if_fail (GIMP_IS_TEXT_LAYOUT (old_layout), FALSE);
+  g_return_val_if_fail (damage != NULL, FALSE);
+
+  if (layout == old_layout)
+    {
+      damage->x      = 0;
+      damage->y      = 0;
+      damage->width  = 0;
+      damage->height = 0;
+
+      return TRUE;
+    }
+
+  if (layout->xres             != old_layout->xres             ||
+      layout->yres             != old_layout->yres             ||
+      layout->extents.x        != old_layout->extents.x        ||
+      layout->extents.y        != old_layout->extents.y        ||
+      layout->extents.width    != old_layout->extents.width    ||
+      layout->extents.height   != old_layout->extents.height   ||
+      layout->text->antialias  != old_layout->text->antialias  ||
+      layout->text->hint_style != old_layout->text->hint_style)
+    return FALSE;
+
+  /*  line extents are only meaningful in layer pixels without a
+   *  transformation
+   */
+  gimp_text_layout_get_transform (layout, &matrix);
+
+  if (matrix.xx != 1.0 || matrix.xy != 0.0 ||
+      matrix.yx != 0.0 || matrix.yy != 1.0)
+    return FALSE;
+
+  gimp_text_layout_get_transform (old_layout, &matrix);
+
+  if (matrix.xx != 1.0 || matrix.xy != 0.0 ||
+      matrix.yx != 0.0 || matrix.yy != 1.0)
+    return FALSE;
+
+  gimp_text_layout_ensure_lines (layout);
+  gimp_text_layout_ensure_lines (old_layout);
+
+  n_lines = MAX (layout->lines->len, old_layout->lines->len);
+
+  for (i = 0; i < n_lines; i++)
+    {
+      GimpTextLayoutLine *line     = NULL;
+      GimpTextLayoutLine *old_line = NULL;
+
+      if (i < layout->lines->len)
+        line = &g_array_index (layout->lines, GimpTextLayoutLine, i);
+
+      if (i < old_layout->lines->len)
+        old_line = &g_array_index (old_layout->lines, GimpTextLayoutLine, i);
+
+      if (line && old_line && line->hash == old_line->hash)
+        continue;
+
+      if (line && line->ink.width > 0 && line->ink.height > 0)
+        {
+          x1 = MIN (x1, line->ink.x);
+          y1 = MIN (y1, line->ink.y);
+          x2 = MAX (x2, line->ink.x + line->ink.width);
+          y2 = MAX (y2, line->ink.y + line->ink.height);
+        }
+
+      if (old_line && old_line->ink.width > 0 && old_line->ink.height > 0)
+        {
+          x1 = MIN (x1, old_line->ink.x);
+          y1 = MIN (y1, old_line->ink.y);
+          x2 = MAX (x2, old_line->ink.x + old_line->ink.width);
+          y2 = MAX (y2, old_line->ink.y + old_line->ink.height);
+        }
+    }
+
+  if (x1 < x2 && y1 < y2)
+    {
+      x1 = CLAMP (x1, 0, layout->extents.width);
+      y1 = CLAMP (y1, 0, layout->extents.height);
+      x2 = CLAMP (x2, 0, layout->extents.width);
+      y2 = CLAMP (y2, 0, layout->extents.height);
+
+      damage->x      = x1;
+      damage->y      = y1;
+      damage->width  = x2 - x1;
+      damage->height = y2 - y1;
+    }
+  else
+    {
+      damage->x      = 0;
+      damage->y      = 0;
+      damage->width  = 0;
+      damage->height = 0;
+    }
+
+  return TRUE;
+}
+
 static gboolean
 gimp_text_layout_split_markup (const gchar  *markup,
                                gchar       **open_tag,
@@ -634,6 +897,165 @@ gimp_text_layout_position (GimpTextLayout *layout)
 #endif
 }
 
+static void
+gimp_text_layout_key_append (GString     *key,
+                             const gchar *str)
+{
+  if (str)
+    g_string_append_printf (key, "%" G_GSIZE_FORMAT ":%s",
+                            strlen (str), str);
+  else
+    g_string_append (key, "-");
+}
+
+static gchar *
+gimp_text_layout_cache_key (GimpText *text,
+                            gdouble   xres,
+                            gdouble   yres)
+{
+  GString *key = g_string_new (NULL);
+
+  gimp_text_layout_key_append (key, text->text);
+  gimp_text_layout_key_append (key, text->markup);
+  gimp_text_layout_key_append (key, text->font);
+  gimp_text_layout_key_append (key, text->language);
+
+  g_string_append_printf (key, " %.10g %.10g", xres, yres);
+
+  g_string_append_printf (key, " %d %.10g %d %d %d %d",
+                          text->unit, text->font_size,
+                          text->antialias, text->hint_style,
+                          text->kerning, text->base_dir);
+
+  g_string_append_printf (key, " %.10g %.10g %.10g %.10g",
+                          text->color.r, text->color.g,
+                          text->color.b, text->color.a);
+
+  g_string_append_printf (key, " %d %.10g %.10g %.10g",
+                          text->justify, text->indent,
+                          text->line_spacing, text->letter_spacing);
+
+  g_string_append_printf (key, " %d %.10g %.10g %d %.10g",
+                          text->box_mode, text->box_width, text->box_height,
+                          text->box_unit, text->border);
+
+  g_string_append_printf (key, " %.10g %.10g %.10g %.10g",
+                          text->transformation.coeff[0][0],
+                          text->transformation.coeff[0][1],
+                          text->transformation.coeff[1][0],
+                          text->transformation.coeff[1][1]);
+
+  return g_string_free (key, FALSE);
+}
+
+static guint
+gimp_text_layout_line_hash (PangoLayoutLine *line)
+{
+  GSList *list;
+  guint   hash = 5381;
+
+#define MIX(value) hash = (hash << 5) + hash + (guint) (value)
+
+  for (list = line->runs; list; list = g_slist_next (list))
+    {
+      PangoGlyphItem   *run    = list->data;
+      PangoGlyphString *glyphs = run->glyphs;
+      GSList           *attrs;
+      gint              i;
+
+      MIX (g_direct_hash (run->item->analysis.font));
+      MIX (run->item->analysis.level);
+
+      for (i = 0; i < glyphs->num_glyphs; i++)
+        {
+          MIX (glyphs->glyphs[i].glyph);
+          MIX (glyphs->glyphs[i].geometry.width);
+          MIX (glyphs->glyphs[i].geometry.x_offset);
+          MIX (glyphs->glyphs[i].geometry.y_offset);
+        }
+
+      /*  color, underline and friends are applied when rendering  */
+      for (attrs = run->item->analysis.extra_attrs;
+           attrs;
+           attrs = g_slist_next (attrs))
+        {
+          PangoAttribute *attr = attrs->data;
+
+          MIX (attr->klass->type);
+
+          switch (attr->klass->type)
+            {
+            case PANGO_ATTR_FOREGROUND:
+            case PANGO_ATTR_BACKGROUND:
+            case PANGO_ATTR_UNDERLINE_COLOR:
+            case PANGO_ATTR_STRIKETHROUGH_COLOR:
+              {
+                PangoColor *color = &((PangoAttrColor *) attr)->color;
+
+                MIX (color->red);
+                MIX (color->green);
+                MIX (color->blue);
+              }
+              break;
+
+            case PANGO_ATTR_UNDERLINE:
+            case PANGO_ATTR_STRIKETHROUGH:
+            case PANGO_ATTR_RISE:
+              MIX (((PangoAttrInt *) attr)->value);
+              break;
+
+            default:
+              break;
+            }
+        }
+    }
+
+#undef MIX
+
+  return hash;
+}
+
+static void
+gimp_text_layout_ensure_lines (GimpTextLayout *layout)
+{
+  PangoLayoutIter *iter;
+
+  if (layout->lines)
+    return;
+
+  layout->lines = g_array_new (FALSE, FALSE, sizeof (GimpTextLayoutLine));
+
+  iter = pango_layout_get_iter (layout->layout);
+
+  do
+    {
+      GimpTextLayoutLine line;
+      PangoRectangle     ink;
+      PangoRectangle     logical;
+      gint               baseline;
+
+      pango_layout_iter_get_line_extents (iter, &ink, &logical);
+      baseline = pango_layout_iter_get_baseline (iter);
+
+      pango_extents_to_pixels (&ink, NULL);
+
+      line.ink    = ink;
+      line.ink.x += layout->extents.x;
+      line.ink.y += layout->extents.y;
+
+      line.hash = gimp_text_layout_line_hash
+        (pango_layout_iter_get_line_readonly (iter));
+
+      line.hash = (line.hash << 5) + line.hash + logical.x;
+      line.hash = (line.hash << 5) + line.hash + baseline;
+
+      g_array_append_val (layout->lines, line);
+    }
+  while (pango_layout_iter_next_line (iter));
+
+  pango_layout_iter_free (iter);
+}
+
 static cairo_font_options_t *
 gimp_text_get_font_options (GimpText *text)
 {
@@ -671,18 +1093,30 @@ gimp_text_get_pango_context (GimpText *text,
                              gdouble   yres)
 {
   PangoContext         *context;
-  PangoFontMap         *fontmap;
+  PangoFontMap         *fontmap = NULL;
   cairo_font_options_t *options;
 
-  fontmap = pango_cairo_font_map_new_for_font_type (CAIRO_FONT_TYPE_FT);
+  if (font_maps)
+    fontmap = g_hash_table_lookup (font_maps, &yres);
+  else
+    font_maps = g_hash_table_new_full (g_double_hash, g_double_equal,
+                                       g_free, g_object_unref);
+
   if (! fontmap)
-    g_error ("You are using a Pango that has been built against a cairo "
-             "that lacks the Freetype font backend");
+    {
+      fontmap = pango_cairo_font_map_new_for_font_type (CAIRO_FONT_TYPE_FT);
+      if (! fontmap)
+        g_error ("You are using a Pango that has been built against a cairo "
+                 "that lacks the Freetype font backend");
 
-  pango_cairo_font_map_set_resolution (PANGO_CAIRO_FONT_MAP (fontmap), yres);
+      pango_cairo_font_map_set_resolution (PANGO_CAIRO_FONT_MAP (fontmap),
+                                           yres);
+
+      g_hash_table_insert (font_maps, g_memdup (&yres, sizeof (gdouble)),
+                           fontmap);
+    }
 
   context = pango_font_map_create_context (fontmap);
-  g_object_unref (fontmap);
 
   options = gimp_text_get_font_options (text);
   pango_cairo_context_set_font_options (context, options);
@@ -40,6 +40,8 @@ GType            gimp_text_layout_get_type             (void) G_GNUC_CONST;
 GimpTextLayout * gimp_text_layout_new                  (GimpText       *text,
                                                         gdouble         xres,
                                                         gdouble         yres);
+void             gimp_text_layout_clear_cache          (void);
+
 gboolean         gimp_text_layout_get_size             (GimpTextLayout *layout,
                                                         gint           *width,
                                                         gint           *heigth);
@@ -74,5 +76,9 @@ void             gimp_text_layout_untransform_distance (GimpTextLayout *layout,
                                                         gdouble        *x,
                                                         gdouble        *y);
 
+gboolean         gimp_text_layout_get_damage           (GimpTextLayout *layout,
+                                                        GimpTextLayout *old_layout,
+                                                        PangoRectangle *damage);
+
 
 #endif /* __GIMP_TEXT_LAYOUT_H__ */
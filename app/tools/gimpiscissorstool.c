@@ -42,8 +42,6 @@
 
 /* Livewire boundary implementation done by Laramie Leavitt */
 
-#if 0
-
 #include "config.h"
 
 #include <stdlib.h>
@@ -57,14 +55,6 @@
 
 #include "tools-types.h"
 
-#include "base/pixel-region.h"
-#include "base/tile-manager.h"
-#include "base/tile.h"
-
-#include "paint-funcs/paint-funcs.h"
-
-#include "gegl/gimp-gegl-utils.h"
-
 #include "core/gimpchannel.h"
 #include "core/gimpchannel-select.h"
 #include "core/gimpimage.h"
@@ -80,17 +70,16 @@
 
 #include "gimpiscissorsoptions.h"
 #include "gimpiscissorstool.h"
+#include "gimptilehandleriscissors.h"
 #include "gimptoolcontrol.h"
 
 #include "gimp-intl.h"
 
 
 /*  defines  */
-#define  MAX_GRADIENT      179.606  /* == sqrt (127^2 + 127^2) */
 #define  GRADIENT_SEARCH   32  /* how far to look when snapping to an edge */
 #define  EXTEND_BY         0.2 /* proportion to expand cost map by */
 #define  FIXED             5   /* additional fixed size to expand cost map */
-#define  MIN_GRADIENT      63  /* gradients < this are directionless */
 
 #define  COST_WIDTH        2   /* number of bytes for each pixel in cost map  */
 
@@ -102,9 +91,13 @@
 #define  SEED_POINT        9
 
 /*  Functional defines  */
-#define  PIXEL_COST(x)     ((x) >> 8)
 #define  PIXEL_DIR(x)      ((x) & 0x000000ff)
 
+/*  the number of buckets of the radix heap, one for each bit of a
+ *  guint32 cost, plus one for the costs equal to the last minimum
+ */
+#define  N_HEAP_BUCKETS    33
+
 
 struct _ICurve
 {
@@ -113,6 +106,24 @@ struct _ICurve
   GPtrArray *points;
 };
 
+typedef struct
+{
+  guint32 cost;
+  guint32 index;
+} HeapItem;
+
+/*  A radix heap: a monotone priority queue for the integer costs of
+ *  the path search.  Items are kept in buckets by the highest bit in
+ *  which their cost differs from the last minimum, so every item is
+ *  moved at most 32 times before it is popped.
+ */
+typedef struct
+{
+  GArray  *buckets[N_HEAP_BUCKETS];
+  guint32  last;
+  gint     n_items;
+} RadixHeap;
+
 
 /*  local function prototypes  */
 
@@ -158,16 +169,23 @@ static void   gimp_iscissors_tool_draw           (GimpDrawTool          *draw_to
 
 static void          iscissors_convert         (GimpIscissorsTool *iscissors,
                                                 GimpDisplay       *display);
-static TileManager * gradient_map_new          (GimpImage         *image);
+static GeglBuffer  * gradient_map_new          (GimpIscissorsTool *iscissors,
+                                                GimpImage         *image);
+static guint8      * gradient_map_get          (GimpIscissorsTool *iscissors,
+                                                GimpImage         *image,
+                                                gint               x,
+                                                gint               y,
+                                                gint               width,
+                                                gint               height);
 
-static void          find_optimal_path         (TileManager       *gradient_map,
+static void          find_optimal_path         (const guint8      *gradient,
                                                 GimpTempBuf       *dp_buf,
                                                 gint               x1,
                                                 gint               y1,
-                                                gint               x2,
-                                                gint               y2,
                                                 gint               xs,
-                                                gint               ys);
+                                                gint               ys,
+                                                gint               xe,
+                                                gint               ye);
 static void          find_max_gradient         (GimpIscissorsTool *iscissors,
                                                 GimpImage         *image,
                                                 gint              *x,
@@ -232,38 +250,10 @@ static const gint move[8][2] =
  */
 
 
-/*  temporary convolution buffers --  */
-static guchar  maxgrad_conv0[TILE_WIDTH * TILE_HEIGHT * 4] = "";
-static guchar  maxgrad_conv1[TILE_WIDTH * TILE_HEIGHT * 4] = "";
-static guchar  maxgrad_conv2[TILE_WIDTH * TILE_HEIGHT * 4] = "";
-
-
-static const gfloat horz_deriv[9] =
-{
-   1,  0, -1,
-   2,  0, -2,
-   1,  0, -1,
-};
-
-static const gfloat vert_deriv[9] =
-{
-   1,  2,  1,
-   0,  0,  0,
-  -1, -2, -1,
-};
-
-static const gfloat blur_32[9] =
-{
-   1,  1,  1,
-   1, 24,  1,
-   1,  1,  1,
-};
-
 static gfloat  distance_weights[GRADIENT_SEARCH * GRADIENT_SEARCH];
 
 static gint    diagonal_weight[256];
 static gint    direction_value[256][4];
-static Tile   *cur_tile    = NULL;
 
 
 void
@@ -395,14 +385,12 @@ gimp_iscissors_tool_control (GimpTool       *tool,
       /* free the gradient map */
       if (iscissors->gradient_map)
         {
-          /* release any tile we were using */
-          if (cur_tile)
-            {
-              tile_release (cur_tile, FALSE);
-              cur_tile = NULL;
-            }
+          gegl_buffer_remove_handler (iscissors->gradient_map,
+                                      iscissors->gradient_handler);
+          g_object_unref (iscissors->gradient_handler);
+          iscissors->gradient_handler = NULL;
 
-          tile_manager_unref (iscissors->gradient_map);
+          g_object_unref (iscissors->gradient_map);
           iscissors->gradient_map = NULL;
         }
 
@@ -1294,8 +1282,9 @@ calculate_curve (GimpIscissorsTool *iscissors,
    *  by the parameter "curve".
    *    Here are the steps:
    *      1)  Calculate the appropriate working area for this operation
-   *      2)  Allocate a temp buf for the dynamic programming array
-   *      3)  Run the dynamic programming algorithm to find the optimal path
+   *      2)  Fetch the gradient map of the working area and allocate a
+   *            temp buf for the links of the path search
+   *      3)  Run Dijkstra's algorithm to find the optimal path
    *      4)  Translate the optimal path into pixels in the icurve data
    *            structure.
    */
@@ -1340,24 +1329,25 @@ calculate_curve (GimpIscissorsTool *iscissors,
   /*  If the bounding box has width and height...  */
   if ((x2 - x1) && (y2 - y1))
     {
+      guint8 *gradient;
+
       width = (x2 - x1);
       height = (y2 - y1);
 
-      /* Initialise the gradient map tile manager for this image if we
-       * don't already have one. */
-      if (!iscissors->gradient_map)
-          iscissors->gradient_map = gradient_map_new (image);
+      gradient = gradient_map_get (iscissors, image, x1, y1, width, height);
 
-      /*  allocate the dynamic programming array  */
+      /*  allocate the link array  */
       if (iscissors->dp_buf)
         gimp_temp_buf_unref (iscissors->dp_buf);
 
       iscissors->dp_buf = gimp_temp_buf_new (width, height,
                                              babl_format ("Y u32"));
 
-      /*  find the optimal path of pixels from (x1, y1) to (x2, y2)  */
-      find_optimal_path (iscissors->gradient_map, iscissors->dp_buf,
-                         x1, y1, x2, y2, xs, ys);
+      /*  find the optimal path of pixels from (xs, ys) to (xe, ye)  */
+      find_optimal_path (gradient, iscissors->dp_buf,
+                         x1, y1, xs, ys, xe, ye);
+
+      g_free (gradient);
 
       /*  get a list of the pixels in the optimal path  */
       curve->points = plot_pixels (iscissors, iscissors->dp_buf,
@@ -1392,57 +1382,19 @@ calculate_curve (GimpIscissorsTool *iscissors,
 }
 
 
-/* badly need to get a replacement - this is _way_ too expensive */
-static gboolean
-gradient_map_value (TileManager *map,
-                    gint         x,
-                    gint         y,
-                    guint8      *grad,
-                    guint8      *dir)
-{
-  static gint   cur_tilex;
-  static gint   cur_tiley;
-  const guint8 *p;
-
-  if (! cur_tile ||
-      x / TILE_WIDTH != cur_tilex ||
-      y / TILE_HEIGHT != cur_tiley)
-    {
-      if (cur_tile)
-        tile_release (cur_tile, FALSE);
-
-      cur_tile = tile_manager_get_tile (map, x, y, TRUE, FALSE);
-
-      if (!cur_tile)
-        return FALSE;
-
-      cur_tilex = x / TILE_WIDTH;
-      cur_tiley = y / TILE_HEIGHT;
-    }
-
-  p = tile_data_pointer (cur_tile, x, y);
-
-  *grad = p[0];
-  *dir  = p[1];
-
-  return TRUE;
-}
-
-static gint
-calculate_link (TileManager *gradient_map,
-                gint         x,
-                gint         y,
-                guint32      pixel,
-                gint         link)
+/*  the cost of the link from the pixel at @from to its neighbor at
+ *  @to, both indices into @gradient
+ */
+static inline gint
+calculate_link (const guint8 *gradient,
+                gint          to,
+                gint          from,
+                gint          link)
 {
   gint   value = 0;
-  guint8 grad1, dir1, grad2, dir2;
-
-  if (!gradient_map_value (gradient_map, x, y, &grad1, &dir1))
-    {
-      grad1 = 0;
-      dir1 = 255;
-    }
+  guint8 grad1 = gradient[to   * COST_WIDTH];
+  guint8 dir1  = gradient[to   * COST_WIDTH + 1];
+  guint8 dir2  = gradient[from * COST_WIDTH + 1];
 
   /* Convert the gradient into a cost: large gradients are good, and
    * so have low cost. */
@@ -1455,15 +1407,6 @@ calculate_link (TileManager *gradient_map,
     value += grad1 * OMEGA_G;
 
   /*  calculate the contribution of the gradient direction  */
-  x += (gint8)(pixel & 0xff);
-  y += (gint8)((pixel & 0xff00) >> 8);
-
-  if (!gradient_map_value (gradient_map, x, y, &grad2, &dir2))
-    {
-      grad2 = 0;
-      dir2 = 255;
-    }
-
   value +=
     (direction_value[dir1][link] + direction_value[dir2][link]) * OMEGA_D;
 
@@ -1515,298 +1458,240 @@ plot_pixels (GimpIscissorsTool *iscissors,
 }
 
 
-#define PACK(x, y) ((((y) & 0xff) << 8) | ((x) & 0xff))
-#define OFFSET(pixel) ((gint8)((pixel) & 0xff) + \
-                       ((gint8)(((pixel) & 0xff00) >> 8)) * gimp_temp_buf_get_width (dp_buf))
+static void
+radix_heap_init (RadixHeap *heap)
+{
+  gint i;
 
+  for (i = 0; i < N_HEAP_BUCKETS; i++)
+    heap->buckets[i] = g_array_new (FALSE, FALSE, sizeof (HeapItem));
+
+  heap->last    = 0;
+  heap->n_items = 0;
+}
 
 static void
-find_optimal_path (TileManager *gradient_map,
-                   GimpTempBuf *dp_buf,
-                   gint         x1,
-                   gint         y1,
-                   gint         x2,
-                   gint         y2,
-                   gint         xs,
-                   gint         ys)
+radix_heap_free (RadixHeap *heap)
 {
-  gint     i, j, k;
-  gint     x, y;
-  gint     link;
-  gint     linkdir;
-  gint     dirx, diry;
-  gint     min_cost;
-  gint     new_cost;
-  gint     offset;
-  gint     cum_cost[8];
-  gint     link_cost[8];
-  gint     pixel_cost[8];
-  guint32  pixel[8];
-  guint32 *data;
-  guint32 *d;
-  gint     dp_buf_width  = gimp_temp_buf_get_width  (dp_buf);
-  gint     dp_buf_height = gimp_temp_buf_get_height (dp_buf);
-
-  /*  initialize the dynamic programming buffer  */
-  data = (guint32 *) gimp_temp_buf_data_clear (dp_buf);
+  gint i;
+
+  for (i = 0; i < N_HEAP_BUCKETS; i++)
+    g_array_free (heap->buckets[i], TRUE);
+}
+
+static inline gint
+radix_heap_bucket (RadixHeap *heap,
+                   guint32    cost)
+{
+  return cost == heap->last ? 0 : g_bit_storage (cost ^ heap->last);
+}
 
-  /*  what directions are we filling the array in according to?  */
-  dirx = (xs - x1 == 0) ? 1 : -1;
-  diry = (ys - y1 == 0) ? 1 : -1;
-  linkdir = (dirx * diry);
+/*  @cost must not be less than the last popped cost  */
+static inline void
+radix_heap_push (RadixHeap *heap,
+                 guint32    cost,
+                 guint32    index)
+{
+  HeapItem item = { cost, index };
 
-  y = ys;
+  g_array_append_val (heap->buckets[radix_heap_bucket (heap, cost)], item);
 
-  for (i = 0; i < dp_buf_height; i++)
+  heap->n_items++;
+}
+
+static gboolean
+radix_heap_pop (RadixHeap *heap,
+                guint32   *cost,
+                guint32   *index)
+{
+  GArray   *bucket = heap->buckets[0];
+  HeapItem *item;
+
+  if (heap->n_items == 0)
+    return FALSE;
+
+  if (bucket->len == 0)
     {
-      x = xs;
+      GArray *full;
+      gint    i;
+      guint   j;
 
-      d = data + (y-y1) * dp_buf_width + (x-x1);
+      for (i = 1; heap->buckets[i]->len == 0; i++)
+        /* nothing */;
 
-      for (j = 0; j < dp_buf_width; j++)
-        {
-          min_cost = G_MAXINT;
-
-          /* pixel[] array encodes how to get to a neighbour, if possible.
-           * 0 means no connection (eg edge).
-           * Rest packed as bottom two bytes: y offset then x offset.
-           * Initially, we assume we can't get anywhere. */
-          for (k = 0; k < 8; k++)
-            pixel[k] = 0;
-
-          /*  Find the valid neighboring pixels  */
-          /*  the previous pixel  */
-          if (j)
-            pixel[((dirx == 1) ? 4 : 0)] = PACK (-dirx, 0);
-
-          /*  the previous row of pixels  */
-          if (i)
-            {
-              pixel[((diry == 1) ? 5 : 1)] = PACK (0, -diry);
+      full = heap->buckets[i];
 
-              link = (linkdir == 1) ? 3 : 2;
-              if (j)
-                pixel[((diry == 1) ? (link + 4) : link)] = PACK(-dirx, -diry);
+      /*  the minimum of the first non-empty bucket becomes the new
+       *  last minimum, which moves all its items to lower buckets
+       */
+      heap->last = g_array_index (full, HeapItem, 0).cost;
 
-              link = (linkdir == 1) ? 2 : 3;
-              if (j != dp_buf_width - 1)
-                pixel[((diry == 1) ? (link + 4) : link)] = PACK (dirx, -diry);
-            }
+      for (j = 1; j < full->len; j++)
+        heap->last = MIN (heap->last, g_array_index (full, HeapItem, j).cost);
 
-          /*  find the minimum cost of going through each neighbor to reach the
-           *  seed point...
-           */
-          link = -1;
-          for (k = 0; k < 8; k ++)
-            if (pixel[k])
-              {
-                link_cost[k] = calculate_link (gradient_map,
-                                               xs + j*dirx, ys + i*diry,
-                                               pixel [k],
-                                               ((k > 3) ? k - 4 : k));
-                offset = OFFSET (pixel [k]);
-                pixel_cost[k] = PIXEL_COST (d[offset]);
-                cum_cost[k] = pixel_cost[k] + link_cost[k];
-                if (cum_cost[k] < min_cost)
-                  {
-                    min_cost = cum_cost[k];
-                    link = k;
-                  }
-              }
-
-          /*  If anything can be done...  */
-          if (link >= 0)
-            {
-              /*  set the cumulative cost of this pixel and the new direction  */
-              *d = (cum_cost[link] << 8) + link;
-
-              /*  possibly change the links from the other pixels to this pixel...
-               *  these changes occur if a neighboring pixel will receive a lower
-               *  cumulative cost by going through this pixel.
-               */
-              for (k = 0; k < 8; k ++)
-                if (pixel[k] && k != link)
-                  {
-                    /*  if the cumulative cost at the neighbor is greater than
-                     *  the cost through the link to the current pixel, change the
-                     *  neighbor's link to point to the current pixel.
-                     */
-                    new_cost = link_cost[k] + cum_cost[link];
-                    if (pixel_cost[k] > new_cost)
-                    {
-                      /*  reverse the link direction   /-----------------------\ */
-                      offset = OFFSET (pixel[k]);
-                      d[offset] = (new_cost << 8) + ((k > 3) ? k - 4 : k + 4);
-                    }
-                  }
-            }
-          /*  Set the seed point  */
-          else if (!i && !j)
-            *d = SEED_POINT;
+      for (j = 0; j < full->len; j++)
+        {
+          item = &g_array_index (full, HeapItem, j);
 
-          /*  increment the data pointer and the x counter  */
-          d += dirx;
-          x += dirx;
+          g_array_append_val (heap->buckets[radix_heap_bucket (heap,
+                                                               item->cost)],
+                              *item);
         }
 
-      /*  increment the y counter  */
-      y += diry;
+      g_array_set_size (full, 0);
     }
-}
-
 
-/* Called to fill in a newly referenced tile in the gradient map */
-static void
-gradmap_tile_validate (TileManager *tm,
-                       Tile        *tile,
-                       GimpImage   *image)
-{
-  GimpPickable *pickable;
-  const Babl   *pickable_format;
-  GeglBuffer   *src_buffer;
-  Tile         *srctile;
-  PixelRegion   srcPR;
-  PixelRegion   destPR;
-  gint          x, y;
-  gint          dw, dh;
-  gint          sw, sh;
-  gint          i, j;
-  gint          b;
-  gfloat        gradient;
-  guint8       *tiledata;
-  guint8       *gradmap;
-
-  tile_manager_get_tile_coordinates (tm, tile, &x, &y);
-
-  dw = tile_ewidth (tile);
-  dh = tile_eheight (tile);
-
-  pickable = GIMP_PICKABLE (gimp_image_get_projection (image));
-
-  gimp_pickable_flush (pickable);
-
-  /* get corresponding tile in the image */
-  src_buffer = gimp_pickable_get_buffer (pickable);
-  srctile = tile_manager_get_tile (gimp_gegl_buffer_get_tiles (src_buffer),
-                                   x, y, TRUE, FALSE);
-  if (! srctile)
-    return;
+  item = &g_array_index (bucket, HeapItem, bucket->len - 1);
 
-  sw = tile_ewidth (srctile);
-  sh = tile_eheight (srctile);
+  *cost  = item->cost;
+  *index = item->index;
 
-  pickable_format = gimp_pickable_get_format (pickable);
+  g_array_set_size (bucket, bucket->len - 1);
 
-  pixel_region_init_data (&srcPR,
-                          tile_data_pointer (srctile, 0, 0),
-                          babl_format_get_bytes_per_pixel (pickable_format),
-                          babl_format_get_bytes_per_pixel (pickable_format) *
-                          MIN (dw, sw),
-                          0, 0, MIN (dw, sw), MIN (dh, sh));
+  heap->n_items--;
 
+  return TRUE;
+}
 
-  /* XXX tile edges? */
+/*  Finds the lowest cost path from the seed point (xs, ys) to the end
+ *  point (xe, ye) within the working area of @dp_buf, whose upper
+ *  left corner is (x1, y1), with Dijkstra's algorithm.  Link costs
+ *  are small integers, so the pixels are ordered by a radix heap, and
+ *  the search stops as soon as the end point is reached.  On return,
+ *  each reached pixel of @dp_buf holds the direction of the link
+ *  towards the seed point, which is SEED_POINT itself.
+ */
+static void
+find_optimal_path (const guint8 *gradient,
+                   GimpTempBuf  *dp_buf,
+                   gint          x1,
+                   gint          y1,
+                   gint          xs,
+                   gint          ys,
+                   gint          xe,
+                   gint          ye)
+{
+  RadixHeap  heap;
+  guint32   *data;
+  guint32   *cost;
+  guint32    seed;
+  guint32    end;
+  guint32    index;
+  guint32    c;
+  gint       width  = gimp_temp_buf_get_width  (dp_buf);
+  gint       height = gimp_temp_buf_get_height (dp_buf);
+  gint       i;
 
-  /*  Blur the source to get rid of noise  */
-  pixel_region_init_data (&destPR, maxgrad_conv0, 4, TILE_WIDTH * 4,
-                          0, 0, srcPR.w, srcPR.h);
-  convolve_region (&srcPR, &destPR, blur_32, 3, 32, GIMP_NORMAL_CONVOL, FALSE);
+  data = (guint32 *) gimp_temp_buf_data_clear (dp_buf);
+  cost = g_new (guint32, width * height);
 
-  /*  Use the blurred region as the new source pixel region  */
-  pixel_region_init_data (&srcPR, maxgrad_conv0, 4, TILE_WIDTH * 4,
-                          0, 0, srcPR.w, srcPR.h);
+  for (i = 0; i < width * height; i++)
+    cost[i] = G_MAXUINT32;
 
-  /*  Get the horizontal derivative  */
-  pixel_region_init_data (&destPR, maxgrad_conv1, 4, TILE_WIDTH * 4,
-                          0, 0, srcPR.w, srcPR.h);
-  convolve_region (&srcPR, &destPR, horz_deriv, 3, 1, GIMP_NEGATIVE_CONVOL,
-                   FALSE);
+  seed = (ys - y1) * width + (xs - x1);
+  end  = (ye - y1) * width + (xe - x1);
 
-  /*  Get the vertical derivative  */
-  pixel_region_init_data (&destPR, maxgrad_conv2, 4, TILE_WIDTH * 4,
-                          0, 0, srcPR.w, srcPR.h);
-  convolve_region (&srcPR, &destPR, vert_deriv, 3, 1, GIMP_NEGATIVE_CONVOL,
-                   FALSE);
+  cost[seed] = 0;
+  data[seed] = SEED_POINT;
 
-  /* calculate overall gradient */
-  tiledata = tile_data_pointer (tile, 0, 0);
+  radix_heap_init (&heap);
+  radix_heap_push (&heap, 0, seed);
 
-  for (i = 0; i < srcPR.h; i++)
+  while (radix_heap_pop (&heap, &c, &index))
     {
-      const guint8 *datah = maxgrad_conv1 + srcPR.rowstride * i;
-      const guint8 *datav = maxgrad_conv2 + srcPR.rowstride * i;
+      gint x, y;
+      gint k;
+
+      /*  skip outdated entries of pixels that were reached again
+       *  with a lower cost
+       */
+      if (c > cost[index])
+        continue;
 
-      gradmap = tiledata + tile_ewidth (tile) * COST_WIDTH * i;
+      if (index == end)
+        break;
 
-      for (j = 0; j < srcPR.w; j++)
+      x = index % width;
+      y = index / width;
+
+      for (k = 0; k < 8; k++)
         {
-          gint8 hmax = datah[0] - 128;
-          gint8 vmax = datav[0] - 128;
+          gint    nx = x + move[k][0];
+          gint    ny = y + move[k][1];
+          guint32 neighbor;
+          guint32 new_cost;
 
-          for (b = 1; b < srcPR.bytes; b++)
-            {
-              if (abs (datah[b] - 128) > abs (hmax))
-                hmax = datah[b] - 128;
+          if (nx < 0 || nx >= width || ny < 0 || ny >= height)
+            continue;
 
-              if (abs (datav[b] - 128) > abs (vmax))
-                vmax = datav[b] - 128;
-            }
+          neighbor = ny * width + nx;
+
+          new_cost = c + calculate_link (gradient, neighbor, index, k & 3);
 
-          if (i == 0 || j == 0 || i == srcPR.h-1 || j == srcPR.w-1)
+          if (new_cost < cost[neighbor])
             {
-              gradmap[j * COST_WIDTH + 0] = 0;
-              gradmap[j * COST_WIDTH + 1] = 255;
-              goto contin;
-            }
+              cost[neighbor] = new_cost;
 
-          /* 1 byte absolute magnitude first */
-          gradient = sqrt (SQR (hmax) + SQR (vmax));
-          gradmap[j * COST_WIDTH] = gradient * 255 / MAX_GRADIENT;
+              /*  link back to the current pixel, the opposite move  */
+              data[neighbor] = (k + 4) & 7;
 
-          /* then 1 byte direction */
-          if (gradient > MIN_GRADIENT)
-            {
-              gfloat direction;
-
-              if (!hmax)
-                direction = (vmax > 0) ? G_PI_2 : -G_PI_2;
-              else
-                direction = atan ((gdouble) vmax / (gdouble) hmax);
-
-              /* Scale the direction from between 0 and 254,
-               *  corresponding to -PI/2, PI/2 255 is reserved for
-               *  d9irectionless pixels */
-              gradmap[j * COST_WIDTH + 1] =
-                (guint8) (254 * (direction + G_PI_2) / G_PI);
-            }
-          else
-            {
-              gradmap[j * COST_WIDTH + 1] = 255; /* reserved for weak gradient */
+              radix_heap_push (&heap, new_cost, neighbor);
             }
-
-        contin:
-          datah += srcPR.bytes;
-          datav += srcPR.bytes;
         }
     }
 
-  tile_release (srctile, FALSE);
+  radix_heap_free (&heap);
+  g_free (cost);
 }
 
-static TileManager *
-gradient_map_new (GimpImage *image)
+static GeglBuffer *
+gradient_map_new (GimpIscissorsTool *iscissors,
+                  GimpImage         *image)
 {
-  TileManager *tm;
+  GeglBuffer *buffer;
 
-  tm = tile_manager_new (gimp_image_get_width  (image),
-                         gimp_image_get_height (image),
-                         sizeof (guint8) * COST_WIDTH);
+  buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0,
+                                            gimp_image_get_width  (image),
+                                            gimp_image_get_height (image)),
+                            babl_format_n (babl_type ("u8"), COST_WIDTH));
 
-  tile_manager_set_validate_proc (tm,
-                                  (TileValidateProc) gradmap_tile_validate,
-                                  image);
+  iscissors->gradient_handler =
+    gimp_tile_handler_iscissors_new (GIMP_PICKABLE (gimp_image_get_projection (image)));
 
-  return tm;
+  gegl_buffer_add_handler (buffer, iscissors->gradient_handler);
+
+  return buffer;
+}
+
+/*  Returns the gradient map of the given area, which is computed in
+ *  parallel where it is not available yet.
+ */
+static guint8 *
+gradient_map_get (GimpIscissorsTool *iscissors,
+                  GimpImage         *image,
+                  gint               x,
+                  gint               y,
+                  gint               width,
+                  gint               height)
+{
+  GeglRectangle  rect = { x, y, width, height };
+  guint8        *gradient;
+
+  /* Initialise the gradient map for this image if we don't already
+   * have one. */
+  if (! iscissors->gradient_map)
+    iscissors->gradient_map = gradient_map_new (iscissors, image);
+
+  gimp_tile_handler_iscissors_validate (GIMP_TILE_HANDLER_ISCISSORS (iscissors->gradient_handler),
+                                        iscissors->gradient_map, &rect);
+
+  gradient = g_new (guint8, width * height * COST_WIDTH);
+
+  gegl_buffer_get (iscissors->gradient_map, &rect, 1.0,
+                   babl_format_n (babl_type ("u8"), COST_WIDTH), gradient,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  return gradient;
 }
 
 static void
@@ -1815,19 +1700,12 @@ find_max_gradient (GimpIscissorsTool *iscissors,
                    gint              *x,
                    gint              *y)
 {
-  PixelRegion  srcPR;
-  gint         radius;
-  gint         i, j;
-  gint         endx, endy;
-  gint         cx, cy;
-  gint         x1, y1, x2, y2;
-  gpointer     pr;
-  gfloat       max_gradient;
-
-  /* Initialise the gradient map tile manager for this image if we
-   * don't already have one. */
-  if (! iscissors->gradient_map)
-    iscissors->gradient_map = gradient_map_new (image);
+  guint8  *gradient;
+  gint     radius;
+  gint     i, j;
+  gint     cx, cy;
+  gint     x1, y1, x2, y2;
+  gfloat   max_gradient;
 
   radius = GRADIENT_SEARCH >> 1;
 
@@ -1844,40 +1722,34 @@ find_max_gradient (GimpIscissorsTool *iscissors,
   *x = cx;
   *y = cy;
 
-  /*  Find the point of max gradient  */
-  pixel_region_init (&srcPR, iscissors->gradient_map,
-                     x1, y1, x2 - x1, y2 - y1, FALSE);
+  if (x2 <= x1 || y2 <= y1)
+    return;
 
-  /* this iterates over 1, 2 or 4 tiles only */
-  for (pr = pixel_regions_register (1, &srcPR);
-       pr != NULL;
-       pr = pixel_regions_process (pr))
+  gradient = gradient_map_get (iscissors, image,
+                               x1, y1, x2 - x1, y2 - y1);
+
+  /*  Find the point of max gradient  */
+  for (i = y1; i < y2; i++)
     {
-      endx = srcPR.x + srcPR.w;
-      endy = srcPR.y + srcPR.h;
+      const guint8 *g = gradient + (i - y1) * (x2 - x1) * COST_WIDTH;
 
-      for (i = srcPR.y; i < endy; i++)
+      for (j = x1; j < x2; j++)
         {
-          const guint8 *gradient = srcPR.data + srcPR.rowstride * (i - srcPR.y);
+          gfloat value = *g;
 
-          for (j = srcPR.x; j < endx; j++)
-            {
-              gfloat g = *gradient;
-
-              gradient += COST_WIDTH;
+          g += COST_WIDTH;
 
-              g *= distance_weights [(i-y1) * GRADIENT_SEARCH + (j-x1)];
+          value *= distance_weights [(i-y1) * GRADIENT_SEARCH + (j-x1)];
 
-              if (g > max_gradient)
-                {
-                  max_gradient = g;
+          if (value > max_gradient)
+            {
+              max_gradient = value;
 
-                  *x = j;
-                  *y = i;
-                }
+              *x = j;
+              *y = i;
             }
         }
     }
-}
 
-#endif
+  g_free (gradient);
+}
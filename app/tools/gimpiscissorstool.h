@@ -15,8 +15,6 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#if 0
-
 #ifndef __GIMP_ISCISSORS_TOOL_H__
 #define __GIMP_ISCISSORS_TOOL_H__
 
@@ -64,29 +62,30 @@ struct _GimpIscissorsTool
 {
   GimpSelectionTool  parent_instance;
 
-  IscissorsOps    op;
+  IscissorsOps     op;
 
-  gint            x, y;         /*  upper left hand coordinate            */
-  gint            ix, iy;       /*  initial coordinates                   */
-  gint            nx, ny;       /*  new coordinates                       */
+  gint             x, y;             /*  upper left hand coordinate            */
+  gint             ix, iy;           /*  initial coordinates                   */
+  gint             nx, ny;           /*  new coordinates                       */
 
-  GimpTempBuf    *dp_buf;       /*  dynamic programming buffer            */
+  GimpTempBuf     *dp_buf;           /*  links of the path search              */
 
-  ICurve         *livewire;     /*  livewire boundary curve               */
+  ICurve          *livewire;         /*  livewire boundary curve               */
 
-  ICurve         *curve1;       /*  1st curve connected to current point  */
-  ICurve         *curve2;       /*  2nd curve connected to current point  */
+  ICurve          *curve1;           /*  1st curve connected to current point  */
+  ICurve          *curve2;           /*  2nd curve connected to current point  */
 
-  GQueue         *curves;       /*  the list of curves                    */
+  GQueue          *curves;           /*  the list of curves                    */
 
-  gboolean        first_point;  /*  is this the first point?              */
-  gboolean        connected;    /*  is the region closed?                 */
+  gboolean         first_point;      /*  is this the first point?              */
+  gboolean         connected;        /*  is the region closed?                 */
 
-  IscissorsState  state;        /*  state of iscissors                    */
+  IscissorsState   state;            /*  state of iscissors                    */
 
   /* XXX might be useful */
-  GimpChannel    *mask;         /*  selection mask                        */
-  TileManager    *gradient_map; /*  lazily filled gradient map            */
+  GimpChannel     *mask;             /*  selection mask                        */
+  GeglBuffer      *gradient_map;     /*  lazily filled gradient map            */
+  gpointer         gradient_handler; /*  computes the gradient map tiles       */
 };
 
 struct _GimpIscissorsToolClass
@@ -102,5 +101,3 @@ GType   gimp_iscissors_tool_get_type (void) G_GNUC_CONST;
 
 
 #endif  /*  __GIMP_ISCISSORS_TOOL_H__  */
-
-#endif
@@ -0,0 +1,543 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <cairo.h>
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "tools-types.h"
+
+#include "core/gimp-parallel.h"
+#include "core/gimppickable.h"
+
+#include "gimptilehandleriscissors.h"
+
+
+#define MAX_GRADIENT        179.606  /* == sqrt (127^2 + 127^2) */
+#define MIN_GRADIENT        63       /* gradients < this are directionless */
+
+#define COST_WIDTH          2        /* number of bytes for each pixel */
+
+#define MIN_PARALLEL_PIXELS (64 * 64)
+
+
+enum
+{
+  PROP_0,
+  PROP_FORMAT,
+  PROP_TILE_WIDTH,
+  PROP_TILE_HEIGHT
+};
+
+
+typedef struct
+{
+  const guint8        *src;
+  gint                 src_stride;
+  guint8              *dest;
+  gint                 dest_stride;
+  const GeglRectangle *rect;
+  gint                 image_width;
+  gint                 image_height;
+} IscissorsComputeData;
+
+
+static void     gimp_tile_handler_iscissors_finalize     (GObject         *object);
+static void     gimp_tile_handler_iscissors_set_property (GObject         *object,
+                                                          guint            property_id,
+                                                          const GValue    *value,
+                                                          GParamSpec      *pspec);
+static void     gimp_tile_handler_iscissors_get_property (GObject         *object,
+                                                          guint            property_id,
+                                                          GValue          *value,
+                                                          GParamSpec      *pspec);
+
+static gpointer gimp_tile_handler_iscissors_command      (GeglTileSource  *source,
+                                                          GeglTileCommand  command,
+                                                          gint             x,
+                                                          gint             y,
+                                                          gint             z,
+                                                          gpointer         data);
+
+static guint8 * gimp_tile_handler_iscissors_get_source   (GimpTileHandlerIscissors *iscissors,
+                                                          const GeglRectangle      *rect);
+static void     gimp_tile_handler_iscissors_compute      (const guint8        *src,
+                                                          gint                 src_stride,
+                                                          guint8              *dest,
+                                                          gint                 dest_stride,
+                                                          const GeglRectangle *rect,
+                                                          gint                 image_width,
+                                                          gint                 image_height);
+static void     gimp_tile_handler_iscissors_compute_area (const GeglRectangle *area,
+                                                          gpointer             data);
+
+
+G_DEFINE_TYPE (GimpTileHandlerIscissors, gimp_tile_handler_iscissors,
+               GEGL_TYPE_TILE_HANDLER)
+
+#define parent_class gimp_tile_handler_iscissors_parent_class
+
+
+static void
+gimp_tile_handler_iscissors_class_init (GimpTileHandlerIscissorsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize     = gimp_tile_handler_iscissors_finalize;
+  object_class->set_property = gimp_tile_handler_iscissors_set_property;
+  object_class->get_property = gimp_tile_handler_iscissors_get_property;
+
+  g_object_class_install_property (object_class, PROP_FORMAT,
+                                   g_param_spec_pointer ("format", NULL, NULL,
+                                                         GIMP_PARAM_READWRITE));
+
+  g_object_class_install_property (object_class, PROP_TILE_WIDTH,
+                                   g_param_spec_int ("tile-width", NULL, NULL,
+                                                     1, G_MAXINT, 1,
+                                                     GIMP_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (object_class, PROP_TILE_HEIGHT,
+                                   g_param_spec_int ("tile-height", NULL, NULL,
+                                                     1, G_MAXINT, 1,
+                                                     GIMP_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+}
+
+static void
+gimp_tile_handler_iscissors_init (GimpTileHandlerIscissors *iscissors)
+{
+  GeglTileSource *source = GEGL_TILE_SOURCE (iscissors);
+
+  source->command = gimp_tile_handler_iscissors_command;
+
+  iscissors->valid_region = cairo_region_create ();
+}
+
+static void
+gimp_tile_handler_iscissors_finalize (GObject *object)
+{
+  GimpTileHandlerIscissors *iscissors = GIMP_TILE_HANDLER_ISCISSORS (object);
+
+  if (iscissors->pickable)
+    {
+      g_object_unref (iscissors->pickable);
+      iscissors->pickable = NULL;
+    }
+
+  cairo_region_destroy (iscissors->valid_region);
+  iscissors->valid_region = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gimp_tile_handler_iscissors_set_property (GObject      *object,
+                                          guint         property_id,
+                                          const GValue *value,
+                                          GParamSpec   *pspec)
+{
+  GimpTileHandlerIscissors *iscissors = GIMP_TILE_HANDLER_ISCISSORS (object);
+
+  switch (property_id)
+    {
+    case PROP_FORMAT:
+      iscissors->format = g_value_get_pointer (value);
+      break;
+    case PROP_TILE_WIDTH:
+      iscissors->tile_width = g_value_get_int (value);
+      break;
+    case PROP_TILE_HEIGHT:
+      iscissors->tile_height = g_value_get_int (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+gimp_tile_handler_iscissors_get_property (GObject    *object,
+                                          guint       property_id,
+                                          GValue     *value,
+                                          GParamSpec *pspec)
+{
+  GimpTileHandlerIscissors *iscissors = GIMP_TILE_HANDLER_ISCISSORS (object);
+
+  switch (property_id)
+    {
+    case PROP_FORMAT:
+      g_value_set_pointer (value, (gpointer) iscissors->format);
+      break;
+    case PROP_TILE_WIDTH:
+      g_value_set_int (value, iscissors->tile_width);
+      break;
+    case PROP_TILE_HEIGHT:
+      g_value_set_int (value, iscissors->tile_height);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+/*  computes a tile that is fetched before anybody validated it  */
+static GeglTile *
+gimp_tile_handler_iscissors_validate_tile (GeglTileSource *source,
+                                           GeglTile       *tile,
+                                           gint            x,
+                                           gint            y)
+{
+  GimpTileHandlerIscissors *iscissors;
+  GeglBuffer               *src_buffer;
+  cairo_rectangle_int_t     tile_rect;
+  GeglRectangle             rect;
+  guint8                   *src;
+
+  iscissors = GIMP_TILE_HANDLER_ISCISSORS (source);
+
+  tile_rect.x      = x * iscissors->tile_width;
+  tile_rect.y      = y * iscissors->tile_height;
+  tile_rect.width  = iscissors->tile_width;
+  tile_rect.height = iscissors->tile_height;
+
+  if (cairo_region_contains_rectangle (iscissors->valid_region,
+                                       &tile_rect) == CAIRO_REGION_OVERLAP_IN)
+    return tile;
+
+  cairo_region_union_rectangle (iscissors->valid_region, &tile_rect);
+
+  src_buffer = gimp_pickable_get_buffer (iscissors->pickable);
+
+  if (! gegl_rectangle_intersect (&rect,
+                                  GEGL_RECTANGLE (tile_rect.x,
+                                                  tile_rect.y,
+                                                  tile_rect.width,
+                                                  tile_rect.height),
+                                  gegl_buffer_get_extent (src_buffer)))
+    return tile;
+
+  if (! tile)
+    tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (source),
+                                          x, y, 0);
+
+  src = gimp_tile_handler_iscissors_get_source (iscissors, &rect);
+
+  gegl_tile_lock (tile);
+
+  gimp_tile_handler_iscissors_compute (src, (rect.width + 4) * 4,
+                                       gegl_tile_get_data (tile),
+                                       iscissors->tile_width * COST_WIDTH,
+                                       &rect,
+                                       gegl_buffer_get_width  (src_buffer),
+                                       gegl_buffer_get_height (src_buffer));
+
+  gegl_tile_unlock (tile);
+
+  g_free (src);
+
+  return tile;
+}
+
+static gpointer
+gimp_tile_handler_iscissors_command (GeglTileSource  *source,
+                                     GeglTileCommand  command,
+                                     gint             x,
+                                     gint             y,
+                                     gint             z,
+                                     gpointer         data)
+{
+  gpointer retval;
+
+  retval = gegl_tile_handler_source_command (source, command, x, y, z, data);
+
+  if (command == GEGL_TILE_GET && z == 0)
+    retval = gimp_tile_handler_iscissors_validate_tile (source, retval, x, y);
+
+  return retval;
+}
+
+/*  reads the R'G'B'A u8 pixels of @rect grown by 2 on each side,
+ *  which the blur and the derivatives need
+ */
+static guint8 *
+gimp_tile_handler_iscissors_get_source (GimpTileHandlerIscissors *iscissors,
+                                        const GeglRectangle      *rect)
+{
+  guint8 *src;
+
+  src = g_new (guint8, (rect->width + 4) * (rect->height + 4) * 4);
+
+  gegl_buffer_get (gimp_pickable_get_buffer (iscissors->pickable),
+                   GEGL_RECTANGLE (rect->x - 2, rect->y - 2,
+                                   rect->width + 4, rect->height + 4),
+                   1.0, babl_format ("R'G'B'A u8"), src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+
+  return src;
+}
+
+/*  Computes the gradient map of @rect.  @src points to the pixel at
+ *  (@rect->x - 2, @rect->y - 2) of the source, see above.  This only
+ *  touches memory, so it can run in any thread.
+ */
+static void
+gimp_tile_handler_iscissors_compute (const guint8        *src,
+                                     gint                 src_stride,
+                                     guint8              *dest,
+                                     gint                 dest_stride,
+                                     const GeglRectangle *rect,
+                                     gint                 image_width,
+                                     gint                 image_height)
+{
+  gint    blur_width  = rect->width  + 2;
+  gint    blur_height = rect->height + 2;
+  gint    blur_stride = blur_width * 4;
+  guint8 *blur;
+  gint    x, y, c;
+
+  blur = g_new (guint8, blur_stride * blur_height);
+
+  /*  Blur the source to get rid of noise, with the kernel
+   *
+   *    1  1  1
+   *    1 24  1  / 32
+   *    1  1  1
+   */
+  for (y = 0; y < blur_height; y++)
+    {
+      const guint8 *s = src + (y + 1) * src_stride + 4;
+      guint8       *b = blur + y * blur_stride;
+
+      for (x = 0; x < blur_stride; x++)
+        {
+          gint sum = (s[x - src_stride - 4] + s[x - src_stride] +
+                      s[x - src_stride + 4] +
+                      s[x - 4] + 24 * s[x] + s[x + 4] +
+                      s[x + src_stride - 4] + s[x + src_stride] +
+                      s[x + src_stride + 4]);
+
+          b[x] = sum / 32;
+        }
+    }
+
+  /*  Get the horizontal and vertical derivatives of the blurred
+   *  source, and keep the strongest of all channels
+   */
+  for (y = 0; y < rect->height; y++)
+    {
+      const guint8 *b  = blur + (y + 1) * blur_stride + 4;
+      guint8       *d  = dest + y * dest_stride;
+      gint          iy = rect->y + y;
+
+      for (x = 0; x < rect->width; x++, b += 4, d += COST_WIDTH)
+        {
+          gint    ix   = rect->x + x;
+          gint    hmax = 0;
+          gint    vmax = 0;
+          gdouble gradient;
+
+          if (ix == 0 || iy == 0 ||
+              ix == image_width - 1 || iy == image_height - 1)
+            {
+              d[0] = 0;
+              d[1] = 255;
+              continue;
+            }
+
+          for (c = 0; c < 4; c++)
+            {
+              gint h = ((b[c - blur_stride - 4] + 2 * b[c - 4] +
+                         b[c + blur_stride - 4]) -
+                        (b[c - blur_stride + 4] + 2 * b[c + 4] +
+                         b[c + blur_stride + 4]));
+              gint v = ((b[c - blur_stride - 4] + 2 * b[c - blur_stride] +
+                         b[c - blur_stride + 4]) -
+                        (b[c + blur_stride - 4] + 2 * b[c + blur_stride] +
+                         b[c + blur_stride + 4]));
+
+              h = CLAMP (h, -128, 127);
+              v = CLAMP (v, -128, 127);
+
+              if (c == 0 || abs (h) > abs (hmax))
+                hmax = h;
+
+              if (c == 0 || abs (v) > abs (vmax))
+                vmax = v;
+            }
+
+          /* 1 byte absolute magnitude first */
+          gradient = sqrt (SQR (hmax) + SQR (vmax));
+          d[0] = MIN (gradient * 255 / MAX_GRADIENT, 255);
+
+          /* then 1 byte direction */
+          if (gradient > MIN_GRADIENT)
+            {
+              gdouble direction;
+
+              if (! hmax)
+                direction = (vmax > 0) ? G_PI_2 : -G_PI_2;
+              else
+                direction = atan ((gdouble) vmax / (gdouble) hmax);
+
+              /* Scale the direction from between 0 and 254,
+               * corresponding to -PI/2, PI/2 255 is reserved for
+               * directionless pixels
+               */
+              d[1] = (guint8) (254 * (direction + G_PI_2) / G_PI);
+            }
+          else
+            {
+              d[1] = 255; /* reserved for weak gradient */
+            }
+        }
+    }
+
+  g_free (blur);
+}
+
+static void
+gimp_tile_handler_iscissors_compute_area (const GeglRectangle *area,
+                                          gpointer             data)
+{
+  IscissorsComputeData *compute = data;
+  const GeglRectangle  *rect    = compute->rect;
+
+  gimp_tile_handler_iscissors_compute (compute->src +
+                                       (area->y - rect->y) * compute->src_stride +
+                                       (area->x - rect->x) * 4,
+                                       compute->src_stride,
+                                       compute->dest +
+                                       (area->y - rect->y) * compute->dest_stride +
+                                       (area->x - rect->x) * COST_WIDTH,
+                                       compute->dest_stride,
+                                       area,
+                                       compute->image_width,
+                                       compute->image_height);
+}
+
+GeglTileHandler *
+gimp_tile_handler_iscissors_new (GimpPickable *pickable)
+{
+  GimpTileHandlerIscissors *iscissors;
+
+  g_return_val_if_fail (GIMP_IS_PICKABLE (pickable), NULL);
+
+  iscissors = g_object_new (GIMP_TYPE_TILE_HANDLER_ISCISSORS, NULL);
+
+  iscissors->pickable = g_object_ref (pickable);
+
+  return GEGL_TILE_HANDLER (iscissors);
+}
+
+/**
+ * gimp_tile_handler_iscissors_validate:
+ * @iscissors: a #GimpTileHandlerIscissors
+ * @buffer:    the buffer @iscissors is added to
+ * @rect:      the area to validate
+ *
+ * Computes all tiles of @rect that were not computed yet, one row of
+ * tiles at a time, distributing each row over the worker threads.
+ * The source pixels are read up front, in the calling thread.
+ **/
+void
+gimp_tile_handler_iscissors_validate (GimpTileHandlerIscissors *iscissors,
+                                      GeglBuffer               *buffer,
+                                      const GeglRectangle      *rect)
+{
+  GeglBuffer    *src_buffer;
+  GeglRectangle  area;
+  gint           tile_x1, tile_x2;
+  gint           tile_y1, tile_y2;
+  gint           tile_y;
+
+  g_return_if_fail (GIMP_IS_TILE_HANDLER_ISCISSORS (iscissors));
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+  g_return_if_fail (rect != NULL);
+
+  gimp_pickable_flush (iscissors->pickable);
+
+  src_buffer = gimp_pickable_get_buffer (iscissors->pickable);
+
+  if (! gegl_rectangle_intersect (&area, rect,
+                                  gegl_buffer_get_extent (src_buffer)))
+    return;
+
+  tile_x1 = area.x / iscissors->tile_width;
+  tile_y1 = area.y / iscissors->tile_height;
+  tile_x2 = (area.x + area.width  - 1) / iscissors->tile_width;
+  tile_y2 = (area.y + area.height - 1) / iscissors->tile_height;
+
+  for (tile_y = tile_y1; tile_y <= tile_y2; tile_y++)
+    {
+      IscissorsComputeData  compute;
+      cairo_rectangle_int_t band_rect;
+      GeglRectangle         band;
+      guint8               *src;
+      guint8               *dest;
+
+      band_rect.x      = tile_x1 * iscissors->tile_width;
+      band_rect.y      = tile_y  * iscissors->tile_height;
+      band_rect.width  = (tile_x2 - tile_x1 + 1) * iscissors->tile_width;
+      band_rect.height = iscissors->tile_height;
+
+      if (cairo_region_contains_rectangle (iscissors->valid_region,
+                                           &band_rect) == CAIRO_REGION_OVERLAP_IN)
+        continue;
+
+      /*  mark the band valid first, so storing it below doesn't
+       *  compute its tiles on the fly
+       */
+      cairo_region_union_rectangle (iscissors->valid_region, &band_rect);
+
+      gegl_rectangle_intersect (&band,
+                                GEGL_RECTANGLE (band_rect.x,
+                                                band_rect.y,
+                                                band_rect.width,
+                                                band_rect.height),
+                                gegl_buffer_get_extent (src_buffer));
+
+      src  = gimp_tile_handler_iscissors_get_source (iscissors, &band);
+      dest = g_new (guint8, band.width * band.height * COST_WIDTH);
+
+      compute.src          = src;
+      compute.src_stride   = (band.width + 4) * 4;
+      compute.dest         = dest;
+      compute.dest_stride  = band.width * COST_WIDTH;
+      compute.rect         = &band;
+      compute.image_width  = gegl_buffer_get_width  (src_buffer);
+      compute.image_height = gegl_buffer_get_height (src_buffer);
+
+      gimp_parallel_distribute_area (&band, MIN_PARALLEL_PIXELS,
+                                     gimp_tile_handler_iscissors_compute_area,
+                                     &compute);
+
+      gegl_buffer_set (buffer, &band, 0, iscissors->format, dest,
+                       GEGL_AUTO_ROWSTRIDE);
+
+      g_free (dest);
+      g_free (src);
+    }
+}
@@ -54,6 +54,14 @@ static void     gimp_histogram_editor_layer_changed (GimpImage           *image,
 static void     gimp_histogram_editor_frozen_update (GimpHistogramEditor *editor,
                                                      const GParamSpec    *pspec);
 static void     gimp_histogram_editor_update        (GimpHistogramEditor *editor);
+static void     gimp_histogram_editor_drawable_update
+                                                    (GimpDrawable        *drawable,
+                                                     gint                 x,
+                                                     gint                 y,
+                                                     gint                 width,
+                                                     gint                 height,
+                                                     GimpHistogramEditor *editor);
+static void     gimp_histogram_editor_queue_update  (GimpHistogramEditor *editor);
 
 static gboolean gimp_histogram_editor_idle_update   (GimpHistogramEditor *editor);
 static gboolean gimp_histogram_menu_sensitivity     (gint                 value,
@@ -107,6 +115,7 @@ gimp_histogram_editor_init (GimpHistogramEditor *editor)
   editor->histogram    = NULL;
   editor->bg_histogram = NULL;
   editor->valid        = FALSE;
+  editor->update_all   = TRUE;
   editor->idle_id      = 0;
   editor->box          = gimp_histogram_box_new ();
 
@@ -327,7 +336,7 @@ gimp_histogram_editor_layer_changed (GimpImage           *image,
                                             gimp_histogram_editor_menu_update,
                                             editor);
       g_signal_handlers_disconnect_by_func (editor->drawable,
-                                            gimp_histogram_editor_update,
+                                            gimp_histogram_editor_drawable_update,
                                             editor);
       g_signal_handlers_disconnect_by_func (editor->drawable,
                                             gimp_histogram_editor_frozen_update,
@@ -346,8 +355,8 @@ gimp_histogram_editor_layer_changed (GimpImage           *image,
                                G_CALLBACK (gimp_histogram_editor_frozen_update),
                                editor, G_CONNECT_SWAPPED);
       g_signal_connect_object (editor->drawable, "update",
-                               G_CALLBACK (gimp_histogram_editor_update),
-                               editor, G_CONNECT_SWAPPED);
+                               G_CALLBACK (gimp_histogram_editor_drawable_update),
+                               editor, 0);
       g_signal_connect_object (editor->drawable, "alpha-changed",
                                G_CALLBACK (gimp_histogram_editor_menu_update),
                                editor, G_CONNECT_SWAPPED);
@@ -372,10 +381,17 @@ gimp_histogram_editor_validate (GimpHistogramEditor *editor)
 {
   if (! editor->valid && editor->histogram)
     {
-      if (editor->drawable)
+      if (! editor->drawable)
+        gimp_histogram_clear_values (editor->histogram);
+      else if (editor->update_all)
         gimp_drawable_calculate_histogram (editor->drawable, editor->histogram);
       else
-        gimp_histogram_clear_values (editor->histogram);
+        gimp_drawable_update_histogram (editor->drawable, editor->histogram,
+                                        &editor->update_rect);
+
+      editor->update_all = FALSE;
+      editor->update_rect.width  = 0;
+      editor->update_rect.height = 0;
 
       gimp_histogram_editor_info_update (editor);
 
@@ -419,6 +435,34 @@ gimp_histogram_editor_frozen_update (GimpHistogramEditor *editor,
 
 static void
 gimp_histogram_editor_update (GimpHistogramEditor *editor)
+{
+  editor->update_all = TRUE;
+
+  gimp_histogram_editor_queue_update (editor);
+}
+
+static void
+gimp_histogram_editor_drawable_update (GimpDrawable        *drawable,
+                                       gint                 x,
+                                       gint                 y,
+                                       gint                 width,
+                                       gint                 height,
+                                       GimpHistogramEditor *editor)
+{
+  GeglRectangle rect = { x, y, width, height };
+
+  /*  collect the changed area, so only that part gets counted again  */
+  if (editor->update_rect.width > 0 && editor->update_rect.height > 0)
+    gegl_rectangle_bounding_box (&editor->update_rect,
+                                 &editor->update_rect, &rect);
+  else
+    editor->update_rect = rect;
+
+  gimp_histogram_editor_queue_update (editor);
+}
+
+static void
+gimp_histogram_editor_queue_update (GimpHistogramEditor *editor)
 {
   if (editor->idle_id)
     g_source_remove (editor->idle_id);
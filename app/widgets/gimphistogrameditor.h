@@ -42,6 +42,8 @@ struct _GimpHistogramEditor
 
   guint                 idle_id;
   gboolean              valid;
+  gboolean              update_all;
+  GeglRectangle         update_rect;  /* changed area if ! update_all  */
 
   GtkWidget            *menu;
   GtkWidget            *box;
@@ -0,0 +1,749 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimptilebackendxcf.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifndef _O_BINARY
+#define _O_BINARY 0
+#endif
+
+#include <gegl.h>
+#include <glib/gstdio.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#ifdef G_OS_WIN32
+#include "libgimpbase/gimpwin32-io.h"
+#endif
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+
+#include "xcf-private.h"
+#include "xcf-load.h"
+#include "gimptilebackendxcf.h"
+
+#include "gimp-intl.h"
+
+
+typedef enum
+{
+  XCF_TILE_IN_FILE,  /* not read yet                   */
+  XCF_TILE_STORED,   /* written back, lives in store    */
+  XCF_TILE_EMPTY     /* voided, or could not be read    */
+} XcfTileState;
+
+struct _GimpTileBackendXcfFile
+{
+  gint      ref_count;
+  gchar    *filename;
+  gint      fd;
+  goffset   size;
+  gint64    mtime;
+  GMutex    mutex;     /* serializes reads where there is no pread() */
+  gboolean  reported;  /* an error was shown for this file already   */
+};
+
+
+static void       gimp_tile_backend_xcf_finalize   (GObject                *object);
+
+static gpointer   gimp_tile_backend_xcf_command    (GeglTileSource         *source,
+                                                    GeglTileCommand         command,
+                                                    gint                    x,
+                                                    gint                    y,
+                                                    gint                    z,
+                                                    gpointer                data);
+
+static GeglTile * gimp_tile_backend_xcf_get_tile   (GimpTileBackendXcf     *backend,
+                                                    gint                    x,
+                                                    gint                    y);
+static void       gimp_tile_backend_xcf_set_tile   (GimpTileBackendXcf     *backend,
+                                                    gint                    x,
+                                                    gint                    y,
+                                                    GeglTile               *tile);
+static void       gimp_tile_backend_xcf_void_tile  (GimpTileBackendXcf     *backend,
+                                                    gint                    x,
+                                                    gint                    y);
+static void       gimp_tile_backend_xcf_store_tile (GimpTileBackendXcf     *backend,
+                                                    gint                    index,
+                                                    const guchar           *src);
+static gboolean   gimp_tile_backend_xcf_read_tile  (GimpTileBackendXcf     *backend,
+                                                    gint                    index,
+                                                    guchar                 *dest,
+                                                    GError                **error);
+static void       gimp_tile_backend_xcf_report     (GimpTileBackendXcf     *backend,
+                                                    GimpTileBackendXcfFile *file,
+                                                    const GError           *error);
+static void       gimp_tile_backend_xcf_detach     (GimpTileBackendXcf     *backend);
+
+static gboolean   gimp_tile_backend_xcf_file_read  (GimpTileBackendXcfFile *file,
+                                                    goffset                 offset,
+                                                    guchar                 *dest,
+                                                    gsize                   size,
+                                                    GError                **error);
+
+
+G_DEFINE_TYPE (GimpTileBackendXcf, gimp_tile_backend_xcf,
+               GEGL_TYPE_TILE_BACKEND)
+
+#define parent_class gimp_tile_backend_xcf_parent_class
+
+
+/*  all live backends, so saving can find the ones reading its file  */
+static GList  *xcf_backends       = NULL;
+static GMutex  xcf_backends_mutex;
+
+
+static void
+gimp_tile_backend_xcf_class_init (GimpTileBackendXcfClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gimp_tile_backend_xcf_finalize;
+}
+
+static void
+gimp_tile_backend_xcf_init (GimpTileBackendXcf *backend)
+{
+  GeglTileSource *source = GEGL_TILE_SOURCE (backend);
+
+  source->command = gimp_tile_backend_xcf_command;
+
+  g_mutex_init (&backend->lock);
+}
+
+static void
+gimp_tile_backend_xcf_finalize (GObject *object)
+{
+  GimpTileBackendXcf *backend = GIMP_TILE_BACKEND_XCF (object);
+
+  g_mutex_lock (&xcf_backends_mutex);
+  xcf_backends = g_list_remove (xcf_backends, backend);
+  g_mutex_unlock (&xcf_backends_mutex);
+
+  if (backend->file)
+    {
+      gimp_tile_backend_xcf_file_unref (backend->file);
+      backend->file = NULL;
+    }
+
+  if (backend->store)
+    {
+      g_object_unref (backend->store);
+      backend->store = NULL;
+    }
+
+  g_free (backend->offsets);
+  g_free (backend->states);
+
+  g_mutex_clear (&backend->lock);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static gpointer
+gimp_tile_backend_xcf_command (GeglTileSource  *source,
+                               GeglTileCommand  command,
+                               gint             x,
+                               gint             y,
+                               gint             z,
+                               gpointer         data)
+{
+  GimpTileBackendXcf *backend = GIMP_TILE_BACKEND_XCF (source);
+
+  /*  XCF files only contain the full resolution level  */
+  if (z != 0)
+    return NULL;
+
+  if (x < 0 || x >= backend->n_tile_cols ||
+      y < 0 || y >= backend->n_tile_rows)
+    return NULL;
+
+  switch (command)
+    {
+    case GEGL_TILE_GET:
+      return gimp_tile_backend_xcf_get_tile (backend, x, y);
+
+    case GEGL_TILE_SET:
+      gimp_tile_backend_xcf_set_tile (backend, x, y, data);
+      gegl_tile_mark_as_stored (data);
+      break;
+
+    case GEGL_TILE_VOID:
+      gimp_tile_backend_xcf_void_tile (backend, x, y);
+      break;
+
+    case GEGL_TILE_EXIST:
+      return GINT_TO_POINTER (TRUE);
+
+    default:
+      g_assert (command < GEGL_TILE_LAST_COMMAND && command >= 0);
+    }
+
+  return NULL;
+}
+
+static GeglTile *
+gimp_tile_backend_xcf_get_tile (GimpTileBackendXcf *backend,
+                                gint                x,
+                                gint                y)
+{
+  GeglTileBackend        *tile_backend = GEGL_TILE_BACKEND (backend);
+  const Babl             *format       = gegl_tile_backend_get_format (tile_backend);
+  gint                    tile_size    = gegl_tile_backend_get_tile_size (tile_backend);
+  gint                    index        = y * backend->n_tile_cols + x;
+  GimpTileBackendXcfFile *file         = NULL;
+  GeglTile               *tile         = NULL;
+  GError                 *error        = NULL;
+
+  g_mutex_lock (&backend->lock);
+
+  switch ((XcfTileState) backend->states[index])
+    {
+    case XCF_TILE_IN_FILE:
+      tile = gegl_tile_new (tile_size);
+
+      if (! gimp_tile_backend_xcf_read_tile (backend, index,
+                                             gegl_tile_get_data (tile),
+                                             &error))
+        {
+          gegl_tile_unref (tile);
+          tile = NULL;
+
+          /*  don't try again, the tile stays empty  */
+          backend->states[index] = XCF_TILE_EMPTY;
+
+          file = gimp_tile_backend_xcf_file_ref (backend->file);
+        }
+      break;
+
+    case XCF_TILE_STORED:
+      tile = gegl_tile_new (tile_size);
+
+      gegl_buffer_get (backend->store,
+                       GEGL_RECTANGLE (x * XCF_TILE_WIDTH,
+                                       y * XCF_TILE_HEIGHT,
+                                       XCF_TILE_WIDTH, XCF_TILE_HEIGHT),
+                       1.0, format, gegl_tile_get_data (tile),
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+      break;
+
+    case XCF_TILE_EMPTY:
+      break;
+    }
+
+  g_mutex_unlock (&backend->lock);
+
+  if (error)
+    {
+      gimp_tile_backend_xcf_report (backend, file, error);
+      gimp_tile_backend_xcf_file_unref (file);
+      g_clear_error (&error);
+    }
+
+  return tile;
+}
+
+static void
+gimp_tile_backend_xcf_set_tile (GimpTileBackendXcf *backend,
+                                gint                x,
+                                gint                y,
+                                GeglTile           *tile)
+{
+  gint index = y * backend->n_tile_cols + x;
+
+  g_mutex_lock (&backend->lock);
+
+  gimp_tile_backend_xcf_store_tile (backend, index, gegl_tile_get_data (tile));
+
+  g_mutex_unlock (&backend->lock);
+}
+
+static void
+gimp_tile_backend_xcf_void_tile (GimpTileBackendXcf *backend,
+                                 gint                x,
+                                 gint                y)
+{
+  gint index = y * backend->n_tile_cols + x;
+
+  g_mutex_lock (&backend->lock);
+
+  backend->states[index] = XCF_TILE_EMPTY;
+
+  g_mutex_unlock (&backend->lock);
+}
+
+/*  copies the pixels of tile @index into the store buffer, which is
+ *  created on first use. must be called with backend->lock held.
+ */
+static void
+gimp_tile_backend_xcf_store_tile (GimpTileBackendXcf *backend,
+                                  gint                index,
+                                  const guchar       *src)
+{
+  const Babl *format = gegl_tile_backend_get_format (GEGL_TILE_BACKEND (backend));
+  gint        x      = index % backend->n_tile_cols;
+  gint        y      = index / backend->n_tile_cols;
+
+  if (! backend->store)
+    {
+      /*  covers whole tiles, so edge tiles keep their padding  */
+      backend->store =
+        gegl_buffer_new (GEGL_RECTANGLE (0, 0,
+                                         backend->n_tile_cols * XCF_TILE_WIDTH,
+                                         backend->n_tile_rows * XCF_TILE_HEIGHT),
+                         format);
+    }
+
+  gegl_buffer_set (backend->store,
+                   GEGL_RECTANGLE (x * XCF_TILE_WIDTH, y * XCF_TILE_HEIGHT,
+                                   XCF_TILE_WIDTH, XCF_TILE_HEIGHT),
+                   0, format, src, GEGL_AUTO_ROWSTRIDE);
+
+  backend->states[index] = XCF_TILE_STORED;
+}
+
+/*  reads and decodes tile @index from the file into @dest, which has
+ *  the rowstride of a full tile. must be called with backend->lock
+ *  held.
+ */
+static gboolean
+gimp_tile_backend_xcf_read_tile (GimpTileBackendXcf  *backend,
+                                 gint                 index,
+                                 guchar              *dest,
+                                 GError             **error)
+{
+  const Babl    *format    = gegl_tile_backend_get_format (GEGL_TILE_BACKEND (backend));
+  gint           bpp       = babl_format_get_bytes_per_pixel (format);
+  goffset        file_size = backend->file->size;
+  guint32        offset    = backend->offsets[index];
+  guint32        offset2   = backend->offsets[index + 1];
+  GeglRectangle  rect;
+  gsize          data_length;
+  guchar        *data;
+  guchar        *tile_data;
+  gboolean       success;
+
+  rect.x      = (index % backend->n_tile_cols) * XCF_TILE_WIDTH;
+  rect.y      = (index / backend->n_tile_cols) * XCF_TILE_HEIGHT;
+  rect.width  = MIN (XCF_TILE_WIDTH,  backend->width  - rect.x);
+  rect.height = MIN (XCF_TILE_HEIGHT, backend->height - rect.y);
+
+  /*  same as the eager loader, the last tile may use up to the
+   *  maximum possible size allowing for negative compression
+   */
+  if (backend->compression == COMPRESS_NONE)
+    data_length = bpp * rect.width * rect.height;
+  else if (offset2 > offset)
+    data_length = offset2 - offset;
+  else
+    data_length = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp * 1.5;
+
+  data_length = MIN (data_length, file_size - offset);
+
+  data = g_malloc (data_length);
+
+  if (! gimp_tile_backend_xcf_file_read (backend->file, offset,
+                                         data, data_length, error))
+    {
+      g_free (data);
+      return FALSE;
+    }
+
+  /*  edge tiles are stored without padding  */
+  if (rect.width == XCF_TILE_WIDTH && rect.height == XCF_TILE_HEIGHT)
+    tile_data = dest;
+  else
+    tile_data = g_malloc (bpp * rect.width * rect.height);
+
+  success = xcf_load_tile_decode (backend->compression,
+                                  data, data_length,
+                                  tile_data, &rect, bpp);
+
+  g_free (data);
+
+  if (tile_data != dest)
+    {
+      gint row;
+
+      memset (dest, 0, XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp);
+
+      for (row = 0; success && row < rect.height; row++)
+        {
+          memcpy (dest + row * XCF_TILE_WIDTH * bpp,
+                  tile_data + row * rect.width * bpp,
+                  rect.width * bpp);
+        }
+
+      g_free (tile_data);
+    }
+
+  if (! success)
+    g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                         _("Corrupt tile data"));
+
+  return success;
+}
+
+/*  shows the first error which happens on @file, the tiles are
+ *  left empty from here on
+ */
+static void
+gimp_tile_backend_xcf_report (GimpTileBackendXcf     *backend,
+                              GimpTileBackendXcfFile *file,
+                              const GError           *error)
+{
+  gboolean report;
+
+  g_mutex_lock (&file->mutex);
+  report = ! file->reported;
+  file->reported = TRUE;
+  g_mutex_unlock (&file->mutex);
+
+  if (report)
+    gimp_message (backend->gimp, NULL, GIMP_MESSAGE_ERROR,
+                  _("Could not read image data from '%s', "
+                    "parts of the image are left empty: %s"),
+                  gimp_filename_to_utf8 (file->filename), error->message);
+}
+
+/*  moves all tiles which are still in the file into the store buffer
+ *  and closes the file
+ */
+static void
+gimp_tile_backend_xcf_detach (GimpTileBackendXcf *backend)
+{
+  GeglTileBackend        *tile_backend = GEGL_TILE_BACKEND (backend);
+  gint                    tile_size    = gegl_tile_backend_get_tile_size (tile_backend);
+  gint                    n_tiles      = backend->n_tile_cols * backend->n_tile_rows;
+  GimpTileBackendXcfFile *file;
+  GError                 *error        = NULL;
+  guchar                 *pixels;
+  gint                    index;
+
+  g_mutex_lock (&backend->lock);
+
+  file = backend->file;
+
+  if (! file)
+    {
+      g_mutex_unlock (&backend->lock);
+      return;
+    }
+
+  pixels = g_malloc (tile_size);
+
+  for (index = 0; index < n_tiles; index++)
+    {
+      if (backend->states[index] != XCF_TILE_IN_FILE)
+        continue;
+
+      if (! error &&
+          gimp_tile_backend_xcf_read_tile (backend, index, pixels, &error))
+        {
+          gimp_tile_backend_xcf_store_tile (backend, index, pixels);
+        }
+      else
+        {
+          backend->states[index] = XCF_TILE_EMPTY;
+        }
+    }
+
+  g_free (pixels);
+
+  backend->file = NULL;
+
+  g_mutex_unlock (&backend->lock);
+
+  if (error)
+    {
+      gimp_tile_backend_xcf_report (backend, file, error);
+      g_clear_error (&error);
+    }
+
+  gimp_tile_backend_xcf_file_unref (file);
+}
+
+static gboolean
+gimp_tile_backend_xcf_file_read (GimpTileBackendXcfFile  *file,
+                                 goffset                  offset,
+                                 guchar                  *dest,
+                                 gsize                    size,
+                                 GError                 **error)
+{
+  struct stat st;
+  gsize       done = 0;
+
+  /*  a file which was truncated or rewritten behind our back can't
+   *  be trusted anymore, even where it can still be read
+   */
+  if (fstat (file->fd, &st) != 0 ||
+      st.st_size  != file->size  ||
+      st.st_mtime != file->mtime)
+    {
+      g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                           _("The file was changed on disk"));
+      return FALSE;
+    }
+
+  while (done < size)
+    {
+      gssize n;
+      gint   save_errno;
+
+#ifdef G_OS_WIN32
+      g_mutex_lock (&file->mutex);
+
+      if (lseek (file->fd, offset + done, SEEK_SET) < 0)
+        n = -1;
+      else
+        n = read (file->fd, dest + done, size - done);
+
+      save_errno = errno;
+
+      g_mutex_unlock (&file->mutex);
+#else
+      n = pread (file->fd, dest + done, size - done, offset + done);
+
+      save_errno = errno;
+#endif
+
+      if (n < 0)
+        {
+          if (save_errno == EINTR)
+            continue;
+
+          g_set_error_literal (error, G_FILE_ERROR,
+                               g_file_error_from_errno (save_errno),
+                               g_strerror (save_errno));
+          return FALSE;
+        }
+      else if (n == 0)
+        {
+          g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                               _("Unexpected end of file"));
+          return FALSE;
+        }
+
+      done += n;
+    }
+
+  return TRUE;
+}
+
+
+/*  public functions  */
+
+GeglTileBackend *
+gimp_tile_backend_xcf_new (Gimp                   *gimp,
+                           GimpTileBackendXcfFile *file,
+                           const Babl             *format,
+                           gint                    width,
+                           gint                    height,
+                           XcfCompressionType      compression,
+                           const guint32          *offsets)
+{
+  GeglTileBackend    *tile_backend;
+  GimpTileBackendXcf *backend;
+  gint                n_tiles;
+
+  g_return_val_if_fail (GIMP_IS_GIMP (gimp), NULL);
+  g_return_val_if_fail (file != NULL, NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+  g_return_val_if_fail (offsets != NULL, NULL);
+
+  tile_backend = g_object_new (GIMP_TYPE_TILE_BACKEND_XCF,
+                               "tile-width",  XCF_TILE_WIDTH,
+                               "tile-height", XCF_TILE_HEIGHT,
+                               "format",      format,
+                               NULL);
+
+  backend = GIMP_TILE_BACKEND_XCF (tile_backend);
+
+  backend->gimp        = gimp;
+  backend->file        = gimp_tile_backend_xcf_file_ref (file);
+  backend->compression = compression;
+  backend->width       = width;
+  backend->height      = height;
+  backend->n_tile_cols = (width  + XCF_TILE_WIDTH  - 1) / XCF_TILE_WIDTH;
+  backend->n_tile_rows = (height + XCF_TILE_HEIGHT - 1) / XCF_TILE_HEIGHT;
+
+  n_tiles = backend->n_tile_cols * backend->n_tile_rows;
+
+  backend->offsets = g_memdup (offsets, (n_tiles + 1) * sizeof (guint32));
+  backend->states  = g_new0 (guint8, n_tiles); /* XCF_TILE_IN_FILE */
+
+  gegl_tile_backend_set_extent (tile_backend,
+                                GEGL_RECTANGLE (0, 0, width, height));
+
+  g_mutex_lock (&xcf_backends_mutex);
+  xcf_backends = g_list_prepend (xcf_backends, backend);
+  g_mutex_unlock (&xcf_backends_mutex);
+
+  return tile_backend;
+}
+
+/**
+ * gimp_tile_backend_xcf_detach_file:
+ * @filename: a file which is about to be overwritten
+ *
+ * Makes all backends which still read tiles from @filename copy them
+ * to their store buffers and close the file.
+ **/
+void
+gimp_tile_backend_xcf_detach_file (const gchar *filename)
+{
+  GStatBuf  target;
+  GList    *list;
+
+  g_return_if_fail (filename != NULL);
+
+  /*  nothing can be read from a file which doesn't exist  */
+  if (g_stat (filename, &target) != 0)
+    return;
+
+  g_mutex_lock (&xcf_backends_mutex);
+
+  for (list = xcf_backends; list; list = g_list_next (list))
+    {
+      GimpTileBackendXcf *backend = list->data;
+      const gchar        *backend_filename;
+      GStatBuf            st;
+
+      g_mutex_lock (&backend->lock);
+      backend_filename = backend->file ? backend->file->filename : NULL;
+      g_mutex_unlock (&backend->lock);
+
+      if (! backend_filename)
+        continue;
+
+      if (! strcmp (backend_filename, filename) ||
+          (target.st_ino != 0                   &&
+           g_stat (backend_filename, &st) == 0  &&
+           st.st_dev == target.st_dev           &&
+           st.st_ino == target.st_ino))
+        {
+          gimp_tile_backend_xcf_detach (backend);
+        }
+    }
+
+  g_mutex_unlock (&xcf_backends_mutex);
+}
+
+/**
+ * gimp_tile_backend_xcf_file_open:
+ * @filename: an XCF file
+ * @error:    return location for errors
+ *
+ * Opens @filename for the backends of one loaded image to read their
+ * tiles from. The backends share the file descriptor.
+ *
+ * Return value: the opened file, or %NULL
+ **/
+GimpTileBackendXcfFile *
+gimp_tile_backend_xcf_file_open (const gchar  *filename,
+                                 GError      **error)
+{
+  GimpTileBackendXcfFile *file;
+  struct stat             st;
+  gint                    fd;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  fd = g_open (filename, O_RDONLY | _O_BINARY, 0);
+
+  if (fd < 0)
+    {
+      gint save_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (save_errno),
+                   _("Could not open '%s' for reading: %s"),
+                   gimp_filename_to_utf8 (filename), g_strerror (save_errno));
+      return NULL;
+    }
+
+  if (fstat (fd, &st) != 0)
+    {
+      gint save_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (save_errno),
+                   _("Could not open '%s' for reading: %s"),
+                   gimp_filename_to_utf8 (filename), g_strerror (save_errno));
+      close (fd);
+      return NULL;
+    }
+
+  file = g_slice_new0 (GimpTileBackendXcfFile);
+
+  file->ref_count = 1;
+  file->filename  = g_strdup (filename);
+  file->fd        = fd;
+  file->size      = st.st_size;
+  file->mtime     = st.st_mtime;
+
+  g_mutex_init (&file->mutex);
+
+  return file;
+}
+
+GimpTileBackendXcfFile *
+gimp_tile_backend_xcf_file_ref (GimpTileBackendXcfFile *file)
+{
+  g_return_val_if_fail (file != NULL, NULL);
+
+  g_atomic_int_inc (&file->ref_count);
+
+  return file;
+}
+
+void
+gimp_tile_backend_xcf_file_unref (GimpTileBackendXcfFile *file)
+{
+  g_return_if_fail (file != NULL);
+
+  if (g_atomic_int_dec_and_test (&file->ref_count))
+    {
+      close (file->fd);
+
+      g_mutex_clear (&file->mutex);
+      g_free (file->filename);
+
+      g_slice_free (GimpTileBackendXcfFile, file);
+    }
+}
+
+goffset
+gimp_tile_backend_xcf_file_get_size (GimpTileBackendXcfFile *file)
+{
+  g_return_val_if_fail (file != NULL, 0);
+
+  return file->size;
+}
@@ -20,6 +20,12 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include <cairo.h>
 #include <gegl.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -34,6 +40,7 @@
 #include "gegl/gimp-gegl-tile-compat.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 #include "core/gimpcontainer.h"
 #include "core/gimpdrawable-private.h" /* eek */
 #include "core/gimpgrid.h"
@@ -66,6 +73,7 @@
 #include "xcf-load.h"
 #include "xcf-read.h"
 #include "xcf-seek.h"
+#include "gimptilebackendxcf.h"
 
 #include "gimp-intl.h"
 
@@ -75,6 +83,24 @@
 /* #define GIMP_XCF_PATH_DEBUG */
 
 
+/*  a batch of tiles, read by the calling thread and decoded into
+ *  plain memory by the workers, the calling thread stores them in the
+ *  buffer afterwards
+ */
+typedef struct
+{
+  XcfCompressionType  compression;
+  gint                bpp;
+  gsize               data_size;
+  guchar             *data;
+  gint               *lengths;
+  GeglRectangle      *rects;
+  gsize               tile_size;
+  guchar             *tiles;
+  volatile gint       failed;
+} XcfLoadTileBatch;
+
+
 static void            xcf_load_add_masks     (GimpImage     *image);
 static gboolean        xcf_load_image_props   (XcfInfo       *info,
                                                GimpImage     *image);
@@ -101,18 +127,31 @@ static GimpChannel   * xcf_load_channel       (XcfInfo       *info,
 static GimpLayerMask * xcf_load_layer_mask    (XcfInfo       *info,
                                                GimpImage     *image);
 static gboolean        xcf_load_buffer        (XcfInfo       *info,
-                                               GeglBuffer    *buffer);
+                                               GimpDrawable  *drawable);
 static gboolean        xcf_load_level         (XcfInfo       *info,
-                                               GeglBuffer    *buffer);
-static gboolean        xcf_load_tile          (XcfInfo       *info,
-                                               GeglBuffer    *buffer,
+                                               GimpDrawable  *drawable);
+static gboolean        xcf_load_level_lazy    (XcfInfo       *info,
+                                               GimpDrawable  *drawable,
+                                               const guint32 *offsets,
+                                               guint          ntiles);
+static void            xcf_load_tile_batch    (gsize          offset,
+                                               gsize          size,
+                                               gpointer       user_data);
+static gboolean        xcf_load_tile_rle      (const guchar  *xcfdata,
+                                               gint           data_length,
+                                               guchar        *tile_data,
                                                GeglRectangle *tile_rect,
-                                               const Babl    *format);
-static gboolean        xcf_load_tile_rle      (XcfInfo       *info,
-                                               GeglBuffer    *buffer,
-                                               GeglRectangle *tile_rect,
-                                               const Babl    *format,
-                                               gint           data_length);
+                                               gint           bpp);
+static gboolean        xcf_load_tile_zlib     (const guchar  *xcfdata,
+                                               gint           data_length,
+                                               guchar        *tile_data,
+                                               gint           tile_size);
+#ifdef HAVE_ZSTD
+static gboolean        xcf_load_tile_zstd     (const guchar  *xcfdata,
+                                               gint           data_length,
+                                               guchar        *tile_data,
+                                               gint           tile_size);
+#endif
 static GimpParasite  * xcf_load_parasite      (XcfInfo       *info);
 static gboolean        xcf_load_old_paths     (XcfInfo       *info,
                                                GimpImage     *image);
@@ -363,6 +402,45 @@ xcf_load_image (Gimp     *gimp,
   return NULL;
 }
 
+/* decodes one tile into tile_data, with a rowstride of
+ * tile_rect->width * bpp. only touches memory, so it may be called
+ * from any thread. returns FALSE if the tile data is corrupt.
+ */
+gboolean
+xcf_load_tile_decode (XcfCompressionType  compression,
+                      const guchar       *xcfdata,
+                      gint                data_length,
+                      guchar             *tile_data,
+                      GeglRectangle      *tile_rect,
+                      gint                bpp)
+{
+  gint tile_size = bpp * tile_rect->width * tile_rect->height;
+
+  switch (compression)
+    {
+    case COMPRESS_NONE:
+      memcpy (tile_data, xcfdata, MIN (data_length, tile_size));
+      return TRUE;
+    case COMPRESS_RLE:
+      return xcf_load_tile_rle (xcfdata, data_length,
+                                tile_data, tile_rect, bpp);
+    case COMPRESS_ZLIB:
+      return xcf_load_tile_zlib (xcfdata, data_length,
+                                 tile_data, tile_size);
+    case COMPRESS_FRACTAL:
+      g_error ("xcf: fractal compression unimplemented");
+      break;
+    case COMPRESS_ZSTD:
+#ifdef HAVE_ZSTD
+      return xcf_load_tile_zstd (xcfdata, data_length,
+                                 tile_data, tile_size);
+#endif
+      break;
+    }
+
+  return FALSE;
+}
+
 static void
 xcf_load_add_masks (GimpImage *image)
 {
@@ -483,7 +561,8 @@ xcf_load_image_props (XcfInfo   *info,
             if ((compression != COMPRESS_NONE) &&
                 (compression != COMPRESS_RLE) &&
                 (compression != COMPRESS_ZLIB) &&
-                (compression != COMPRESS_FRACTAL))
+                (compression != COMPRESS_FRACTAL) &&
+                (compression != COMPRESS_ZSTD))
               {
                 gimp_message (info->gimp, G_OBJECT (info->progress),
                               GIMP_MESSAGE_ERROR,
@@ -492,6 +571,18 @@ xcf_load_image_props (XcfInfo   *info,
                 return FALSE;
               }
 
+#ifndef HAVE_ZSTD
+            if (compression == COMPRESS_ZSTD)
+              {
+                gimp_message_literal (info->gimp, G_OBJECT (info->progress),
+                                      GIMP_MESSAGE_ERROR,
+                                      "This GIMP was built without zstd "
+                                      "support and can't load zstd "
+                                      "compressed files");
+                return FALSE;
+              }
+#endif
+
             info->compression = compression;
           }
           break;
@@ -1231,8 +1322,7 @@ xcf_load_layer (XcfInfo    *info,
       if (! xcf_seek_pos (info, hierarchy_offset, NULL))
         goto error;
 
-      if (! xcf_load_buffer (info,
-                             gimp_drawable_get_buffer (GIMP_DRAWABLE (layer))))
+      if (! xcf_load_buffer (info, GIMP_DRAWABLE (layer)))
         goto error;
 
       xcf_progress_update (info);
@@ -1323,8 +1413,7 @@ xcf_load_channel (XcfInfo   *info,
   if (!xcf_seek_pos (info, hierarchy_offset, NULL))
     goto error;
 
-  if (!xcf_load_buffer (info,
-                        gimp_drawable_get_buffer (GIMP_DRAWABLE (channel))))
+  if (!xcf_load_buffer (info, GIMP_DRAWABLE (channel)))
     goto error;
 
   xcf_progress_update (info);
@@ -1382,8 +1471,7 @@ xcf_load_layer_mask (XcfInfo   *info,
   if (! xcf_seek_pos (info, hierarchy_offset, NULL))
     goto error;
 
-  if (!xcf_load_buffer (info,
-                        gimp_drawable_get_buffer (GIMP_DRAWABLE (layer_mask))))
+  if (!xcf_load_buffer (info, GIMP_DRAWABLE (layer_mask)))
     goto error;
 
   xcf_progress_update (info);
@@ -1400,9 +1488,10 @@ xcf_load_layer_mask (XcfInfo   *info,
 }
 
 static gboolean
-xcf_load_buffer (XcfInfo    *info,
-                 GeglBuffer *buffer)
+xcf_load_buffer (XcfInfo      *info,
+                 GimpDrawable *drawable)
 {
+  GeglBuffer *buffer = gimp_drawable_get_buffer (drawable);
   const Babl *format;
   guint32     saved_pos;
   guint32     offset;
@@ -1450,7 +1539,7 @@ xcf_load_buffer (XcfInfo    *info,
     return FALSE;
 
   /* read in the level */
-  if (!xcf_load_level (info, buffer))
+  if (!xcf_load_level (info, drawable))
     return FALSE;
 
   /* restore the saved position so we'll be ready to
@@ -1464,23 +1553,24 @@ xcf_load_buffer (XcfInfo    *info,
 
 
 static gboolean
-xcf_load_level (XcfInfo    *info,
-                GeglBuffer *buffer)
+xcf_load_level (XcfInfo      *info,
+                GimpDrawable *drawable)
 {
-  const Babl *format;
-  gint        bpp;
-  guint32     saved_pos;
-  guint32     offset, offset2;
-  gint        n_tile_rows;
-  gint        n_tile_cols;
-  guint       ntiles;
-  gint        width;
-  gint        height;
-  gint        i;
-  gint        fail;
-
-  format = gegl_buffer_get_format (buffer);
-  bpp    = babl_format_get_bytes_per_pixel (format);
+  GeglBuffer       *buffer = gimp_drawable_get_buffer (drawable);
+  XcfLoadTileBatch  batch;
+  guint32          *offsets;
+  gint              bpp;
+  gint              n_tile_rows;
+  gint              n_tile_cols;
+  guint             ntiles;
+  gint              width;
+  gint              height;
+  gint              i, j;
+  gboolean          success = TRUE;
+
+  batch.compression = info->compression;
+
+  bpp = babl_format_get_bytes_per_pixel (gegl_buffer_get_format (buffer));
 
   info->cp += xcf_read_int32 (info->fp, (guint32 *) &width, 1);
   info->cp += xcf_read_int32 (info->fp, (guint32 *) &height, 1);
@@ -1489,155 +1579,229 @@ xcf_load_level (XcfInfo    *info,
       height != gegl_buffer_get_height (buffer))
     return FALSE;
 
-  /* read in the first tile offset.
-   *  if it is '0', then this tile level is empty
-   *  and we can simply return.
-   */
-  info->cp += xcf_read_int32 (info->fp, &offset, 1);
-  if (offset == 0)
-    return TRUE;
-
   n_tile_rows = gimp_gegl_buffer_get_n_tile_rows (buffer, XCF_TILE_HEIGHT);
   n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
 
   ntiles = n_tile_rows * n_tile_cols;
-  for (i = 0; i < ntiles; i++)
+
+  /* read in the whole offset table, which is terminated by a '0'
+   *  offset. entries missing from a truncated file stay '0'.
+   */
+  offsets = g_new0 (guint32, ntiles + 1);
+
+  info->cp += xcf_read_int32 (info->fp, offsets, ntiles + 1);
+
+  /* if the first tile offset is '0', then this tile level is empty
+   *  and we can simply return.
+   */
+  if (offsets[0] == 0)
     {
-      GeglRectangle rect;
+      g_free (offsets);
+      return TRUE;
+    }
 
-      fail = FALSE;
+  /* leave the tiles in the file until they are used, if we can */
+  if (info->lazy_file &&
+      xcf_load_level_lazy (info, drawable, offsets, ntiles))
+    {
+      g_free (offsets);
+      return TRUE;
+    }
 
-      if (offset == 0)
+  /* the tiles of a batch are read in order by this thread, decoded
+   * on all threads, and stored in the buffer by this thread again,
+   * GEGL buffers must not be written from several threads at once
+   */
+  batch.bpp       = bpp;
+  batch.data_size = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp * 1.5;
+  batch.data      = g_malloc (XCF_TILE_BATCH_SIZE * batch.data_size);
+  batch.lengths   = g_new (gint, XCF_TILE_BATCH_SIZE);
+  batch.rects     = g_new (GeglRectangle, XCF_TILE_BATCH_SIZE);
+  batch.tile_size = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp;
+  batch.tiles     = g_malloc (XCF_TILE_BATCH_SIZE * batch.tile_size);
+  batch.failed    = FALSE;
+
+  for (i = 0; i < ntiles && success; i += XCF_TILE_BATCH_SIZE)
+    {
+      gint n_tiles = MIN (ntiles - i, XCF_TILE_BATCH_SIZE);
+
+      for (j = 0; j < n_tiles; j++)
         {
-          gimp_message_literal (info->gimp, G_OBJECT (info->progress),
-				GIMP_MESSAGE_ERROR,
-				"not enough tiles found in level");
-          return FALSE;
-        }
+          guint32 offset  = offsets[i + j];
+          guint32 offset2 = offsets[i + j + 1];
+          gint    data_length;
 
-      /* save the current position as it is where the
-       *  next tile offset is stored.
-       */
-      saved_pos = info->cp;
+          batch.lengths[j] = 0;
 
-      /* read in the offset of the next tile so we can calculate the amount
-         of data needed for this tile*/
-      info->cp += xcf_read_int32 (info->fp, &offset2, 1);
+          gimp_gegl_buffer_get_tile_rect (buffer,
+                                          XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
+                                          i + j, &batch.rects[j]);
 
-      /* if the offset is 0 then we need to read in the maximum possible
-         allowing for negative compression */
-      if (offset2 == 0)
-        offset2 = offset + XCF_TILE_WIDTH * XCF_TILE_WIDTH * bpp * 1.5;
-                                        /* 1.5 is probably more
-                                           than we need to allow */
+          if (offset == 0)
+            {
+              gimp_message_literal (info->gimp, G_OBJECT (info->progress),
+                                    GIMP_MESSAGE_ERROR,
+                                    "not enough tiles found in level");
+              success = FALSE;
+              break;
+            }
 
-      /* seek to the tile offset */
-      if (! xcf_seek_pos (info, offset, NULL))
-        return FALSE;
+          /* if the next offset is 0 then we need to read in the maximum
+           * possible allowing for negative compression
+           */
+          if (offset2 == 0)
+            offset2 = offset + batch.data_size;
 
-      /* get the tile from the tile manager */
-      gimp_gegl_buffer_get_tile_rect (buffer,
-                                      XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
-                                      i, &rect);
+          if (batch.compression == COMPRESS_NONE)
+            {
+              data_length = (bpp *
+                             batch.rects[j].width * batch.rects[j].height);
+            }
+          else
+            {
+              data_length = MIN ((gint) (offset2 - offset),
+                                 (gint) batch.data_size);
+            }
 
-      /* read in the tile */
-      switch (info->compression)
-        {
-        case COMPRESS_NONE:
-          if (!xcf_load_tile (info, buffer, &rect, format))
-            fail = TRUE;
-          break;
-        case COMPRESS_RLE:
-          if (!xcf_load_tile_rle (info, buffer, &rect, format,
-                                  offset2 - offset))
-            fail = TRUE;
-          break;
-        case COMPRESS_ZLIB:
-          g_error ("xcf: zlib compression unimplemented");
-          fail = TRUE;
-          break;
-        case COMPRESS_FRACTAL:
-          g_error ("xcf: fractal compression unimplemented");
-          fail = TRUE;
-          break;
+          /* Workaround for bug #357809: skip tiles with a bogus data
+           * length as if they did not contain any data.  It is better
+           * than failing, which would skip the whole hierarchy while
+           * there may still be some valid tiles in the file.
+           */
+          if (data_length <= 0)
+            continue;
+
+          /* seek to the tile offset */
+          if (! xcf_seek_pos (info, offset, NULL))
+            {
+              success = FALSE;
+              break;
+            }
+
+          /* we have to use fread instead of xcf_read_* because we may
+           * be reading past the end of the file here
+           */
+          batch.lengths[j] = fread (batch.data + j * batch.data_size,
+                                    sizeof (guchar), data_length, info->fp);
+          info->cp += batch.lengths[j];
         }
 
-      if (fail)
-        return FALSE;
+      if (! success)
+        break;
 
-      /* restore the saved position so we'll be ready to
-       *  read the next offset.
-       */
-      if (!xcf_seek_pos (info, saved_pos, NULL))
-        return FALSE;
+      gimp_parallel_distribute_range (n_tiles, 1,
+                                      xcf_load_tile_batch, &batch);
 
-      /* read in the offset of the next tile */
-      info->cp += xcf_read_int32 (info->fp, &offset, 1);
+      for (j = 0; j < n_tiles; j++)
+        {
+          if (batch.lengths[j] > 0)
+            gegl_buffer_set (buffer, &batch.rects[j], 0,
+                             gegl_buffer_get_format (buffer),
+                             batch.tiles + j * batch.tile_size,
+                             GEGL_AUTO_ROWSTRIDE);
+        }
+
+      if (batch.failed)
+        success = FALSE;
     }
 
-  if (offset != 0)
+  if (success && offsets[ntiles] != 0)
     {
       gimp_message (info->gimp, G_OBJECT (info->progress), GIMP_MESSAGE_ERROR,
-                    "encountered garbage after reading level: %d", offset);
-      return FALSE;
+                    "encountered garbage after reading level: %d",
+                    offsets[ntiles]);
+      success = FALSE;
     }
 
-  return TRUE;
+  g_free (batch.tiles);
+  g_free (batch.rects);
+  g_free (batch.lengths);
+  g_free (batch.data);
+  g_free (offsets);
+
+  return success;
 }
 
 static gboolean
-xcf_load_tile (XcfInfo       *info,
-               GeglBuffer    *buffer,
-               GeglRectangle *tile_rect,
-               const Babl    *format)
+xcf_load_level_lazy (XcfInfo       *info,
+                     GimpDrawable  *drawable,
+                     const guint32 *offsets,
+                     guint          ntiles)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
+  GeglBuffer      *buffer    = gimp_drawable_get_buffer (drawable);
+  goffset          file_size = gimp_tile_backend_xcf_file_get_size (info->lazy_file);
+  GeglTileBackend *backend;
+  GeglBuffer      *lazy_buffer;
+  gint             i;
+
+  if (info->compression == COMPRESS_FRACTAL ||
+      offsets[ntiles] != 0)
+    return FALSE;
+
+  /* only trust the offset table if it points into the file, the
+   * eager loader reports everything else
+   */
+  for (i = 0; i < ntiles; i++)
+    {
+      if (offsets[i] == 0 || offsets[i] >= file_size)
+        return FALSE;
+    }
 
-  info->cp += xcf_read_int8 (info->fp, tile_data, tile_size);
+  backend = gimp_tile_backend_xcf_new (info->gimp,
+                                       info->lazy_file,
+                                       gegl_buffer_get_format (buffer),
+                                       gegl_buffer_get_width (buffer),
+                                       gegl_buffer_get_height (buffer),
+                                       info->compression,
+                                       offsets);
 
-  gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE);
+  lazy_buffer = gegl_buffer_new_for_backend (NULL, backend);
+  g_object_unref (backend);
+
+  gimp_drawable_set_buffer (drawable, FALSE, NULL, lazy_buffer);
+  g_object_unref (lazy_buffer);
 
   return TRUE;
 }
 
-static gboolean
-xcf_load_tile_rle (XcfInfo       *info,
-                   GeglBuffer    *buffer,
-                   GeglRectangle *tile_rect,
-                   const Babl    *format,
-                   gint           data_length)
+static void
+xcf_load_tile_batch (gsize    offset,
+                     gsize    size,
+                     gpointer user_data)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  gint    i;
-  gint    nmemb_read_successfully;
-  guchar *xcfdata;
-  guchar *xcfodata;
-  guchar *xcfdatalimit;
-
-  /* Workaround for bug #357809: avoid crashing on g_malloc() and skip
-   * this tile (return TRUE without storing data) as if it did not
-   * contain any data.  It is better than returning FALSE, which would
-   * skip the whole hierarchy while there may still be some valid
-   * tiles in the file.
-   */
-  if (data_length <= 0)
-    return TRUE;
+  XcfLoadTileBatch *batch = user_data;
+  gsize             i;
+
+  for (i = offset; i < offset + size; i++)
+    {
+      const guchar *xcfdata     = batch->data + i * batch->data_size;
+      gint          data_length = batch->lengths[i];
 
-  xcfdata = xcfodata = g_alloca (data_length);
+      if (data_length == 0)
+        continue;
 
-  /* we have to use fread instead of xcf_read_* because we may be
-   * reading past the end of the file here
-   */
-  nmemb_read_successfully = fread ((gchar *) xcfdata, sizeof (gchar),
-                                   data_length, info->fp);
-  info->cp += nmemb_read_successfully;
+      if (! xcf_load_tile_decode (batch->compression,
+                                  xcfdata, data_length,
+                                  batch->tiles + i * batch->tile_size,
+                                  &batch->rects[i], batch->bpp))
+        {
+          /* don't store what was decoded of the tile */
+          batch->lengths[i] = 0;
+
+          g_atomic_int_set (&batch->failed, TRUE);
+        }
+    }
+}
 
-  xcfdatalimit = &xcfodata[nmemb_read_successfully - 1];
+static gboolean
+xcf_load_tile_rle (const guchar  *xcfdata,
+                   gint           data_length,
+                   guchar        *tile_data,
+                   GeglRectangle *tile_rect,
+                   gint           bpp)
+{
+  const guchar *xcfdatalimit = &xcfdata[data_length - 1];
+  gint          i;
 
   for (i = 0; i < bpp; i++)
     {
@@ -1729,15 +1893,66 @@ xcf_load_tile_rle (XcfInfo       *info,
         }
     }
 
-  gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE);
-
   return TRUE;
 
  bogus_rle:
   return FALSE;
 }
 
+static gboolean
+xcf_load_tile_zlib (const guchar *xcfdata,
+                    gint          data_length,
+                    guchar       *tile_data,
+                    gint          tile_size)
+{
+  z_stream strm;
+  gint     status;
+
+  strm.zalloc    = Z_NULL;
+  strm.zfree     = Z_NULL;
+  strm.opaque    = Z_NULL;
+  strm.next_in   = (Bytef *) xcfdata;
+  strm.avail_in  = data_length;
+  strm.next_out  = tile_data;
+  strm.avail_out = tile_size;
+
+  if (inflateInit (&strm) != Z_OK)
+    return FALSE;
+
+  /* the stream ends before the estimated data length of the last tile,
+   * so inflate until we see its end instead of using up the input
+   */
+  status = inflate (&strm, Z_FINISH);
+
+  inflateEnd (&strm);
+
+  return (status == Z_STREAM_END && strm.total_out == tile_size);
+}
+
+#ifdef HAVE_ZSTD
+static gboolean
+xcf_load_tile_zstd (const guchar *xcfdata,
+                    gint          data_length,
+                    guchar       *tile_data,
+                    gint          tile_size)
+{
+  gsize frame_size;
+  gsize size;
+
+  /* zstd wants the exact frame, which can be shorter than the
+   * estimated data length of the last tile
+   */
+  frame_size = ZSTD_findFrameCompressedSize (xcfdata, data_length);
+
+  if (ZSTD_isError (frame_size))
+    return FALSE;
+
+  size = ZSTD_decompress (tile_data, tile_size, xcfdata, frame_size);
+
+  return (! ZSTD_isError (size) && size == tile_size);
+}
+#endif /* HAVE_ZSTD */
+
 static GimpParasite *
 xcf_load_parasite (XcfInfo *info)
 {
@@ -19,9 +19,16 @@
 #define __XCF_LOAD_H__
 
 
-GimpImage * xcf_load_image (Gimp     *gimp,
-                            XcfInfo  *info,
-                            GError  **error);
+GimpImage * xcf_load_image       (Gimp                *gimp,
+                                  XcfInfo             *info,
+                                  GError             **error);
+
+gboolean    xcf_load_tile_decode (XcfCompressionType   compression,
+                                  const guchar        *xcfdata,
+                                  gint                 data_length,
+                                  guchar              *tile_data,
+                                  GeglRectangle       *tile_rect,
+                                  gint                 bpp);
 
 
 #endif  /* __XCF_LOAD_H__ */
@@ -22,6 +22,9 @@
 #define XCF_TILE_WIDTH  64
 #define XCF_TILE_HEIGHT 64
 
+/*  the number of tiles encoded or decoded at once on the worker threads  */
+#define XCF_TILE_BATCH_SIZE 64
+
 typedef enum
 {
   PROP_END                =  0,
@@ -63,8 +66,9 @@ typedef enum
 {
   COMPRESS_NONE              =  0,
   COMPRESS_RLE               =  1,
-  COMPRESS_ZLIB              =  2,  /* unused */
-  COMPRESS_FRACTAL           =  3   /* unused */
+  COMPRESS_ZLIB              =  2,
+  COMPRESS_FRACTAL           =  3,  /* unused */
+  COMPRESS_ZSTD              =  4
 } XcfCompressionType;
 
 typedef enum
@@ -84,25 +88,27 @@ typedef enum
   XCF_GROUP_ITEM_EXPANDED      = 1
 } XcfGroupItemFlagsType;
 
-typedef struct _XcfInfo  XcfInfo;
+typedef struct _XcfInfo                XcfInfo;
+typedef struct _GimpTileBackendXcfFile GimpTileBackendXcfFile;
 
 struct _XcfInfo
 {
-  Gimp               *gimp;
-  GimpProgress       *progress;
-  FILE               *fp;
-  guint               cp;
-  const gchar        *filename;
-  GimpTattoo          tattoo_state;
-  GimpLayer          *active_layer;
-  GimpChannel        *active_channel;
-  GimpDrawable       *floating_sel_drawable;
-  GimpLayer          *floating_sel;
-  guint               floating_sel_offset;
-  gint                swap_num;
-  gint               *ref_count;
-  XcfCompressionType  compression;
-  gint                file_version;
+  Gimp                   *gimp;
+  GimpProgress           *progress;
+  FILE                   *fp;
+  GimpTileBackendXcfFile *lazy_file;
+  guint                   cp;
+  const gchar            *filename;
+  GimpTattoo              tattoo_state;
+  GimpLayer              *active_layer;
+  GimpChannel            *active_channel;
+  GimpDrawable           *floating_sel_drawable;
+  GimpLayer              *floating_sel;
+  guint                   floating_sel_offset;
+  gint                    swap_num;
+  gint                   *ref_count;
+  XcfCompressionType      compression;
+  gint                    file_version;
 };
 
 
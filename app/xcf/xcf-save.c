@@ -20,6 +20,12 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include <cairo.h>
 #include <gegl.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -33,6 +39,7 @@
 #include "gegl/gimp-gegl-tile-compat.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 #include "core/gimpcontainer.h"
 #include "core/gimpchannel.h"
 #include "core/gimpdrawable.h"
@@ -68,6 +75,24 @@
 #include "gimp-intl.h"
 
 
+/*  a batch of tiles, read from the buffer into plain memory by the
+ *  calling thread, encoded by the workers and written in order by the
+ *  calling thread again
+ */
+typedef struct
+{
+  XcfCompressionType  compression;
+  gint                bpp;
+  gsize               data_size;
+  guchar             *data;
+  gint               *lengths;
+  gint               *rle_counts;
+  GeglRectangle      *rects;
+  gsize               tile_size;
+  guchar             *tiles;
+} XcfSaveTileBatch;
+
+
 static gboolean xcf_save_image_props   (XcfInfo           *info,
                                         GimpImage         *image,
                                         GError           **error);
@@ -98,17 +123,24 @@ static gboolean xcf_save_buffer        (XcfInfo           *info,
 static gboolean xcf_save_level         (XcfInfo           *info,
                                         GeglBuffer        *buffer,
                                         GError           **error);
-static gboolean xcf_save_tile          (XcfInfo           *info,
-                                        GeglBuffer        *buffer,
+static void     xcf_save_tile_batch    (gsize              offset,
+                                        gsize              size,
+                                        gpointer           user_data);
+static gint     xcf_save_tile_rle      (const guchar      *tile_data,
                                         GeglRectangle     *tile_rect,
-                                        const Babl        *format,
-                                        GError           **error);
-static gboolean xcf_save_tile_rle      (XcfInfo           *info,
-                                        GeglBuffer        *buffer,
-                                        GeglRectangle     *tile_rect,
-                                        const Babl        *format,
+                                        gint               bpp,
                                         guchar            *rlebuf,
-                                        GError           **error);
+                                        gint              *bad_count);
+static gint     xcf_save_tile_zlib     (const guchar      *tile_data,
+                                        gint               tile_size,
+                                        guchar            *zbuf,
+                                        gsize              zbuf_size);
+#ifdef HAVE_ZSTD
+static gint     xcf_save_tile_zstd     (const guchar      *tile_data,
+                                        gint               tile_size,
+                                        guchar            *zbuf,
+                                        gsize              zbuf_size);
+#endif
 static gboolean xcf_save_parasite      (XcfInfo           *info,
                                         GimpParasite      *parasite,
                                         GError           **error);
@@ -218,6 +250,17 @@ xcf_save_choose_format (XcfInfo   *info,
   if (gimp_image_get_precision (image) != GIMP_PRECISION_U8)
     save_version = MAX (4, save_version);
 
+#ifndef HAVE_ZSTD
+  /* fall back to zlib if we were built without zstd */
+  if (info->compression == COMPRESS_ZSTD)
+    info->compression = COMPRESS_ZLIB;
+#endif
+
+  /* need version 5 for zlib and zstd compressed tiles */
+  if (info->compression == COMPRESS_ZLIB ||
+      info->compression == COMPRESS_ZSTD)
+    save_version = MAX (5, save_version);
+
   info->file_version = save_version;
 }
 
@@ -1415,138 +1458,203 @@ xcf_save_level (XcfInfo     *info,
                 GeglBuffer  *buffer,
                 GError     **error)
 {
-  const Babl *format;
-  guint32     saved_pos;
-  guint32     offset;
-  guint32     width;
-  guint32     height;
-  gint        bpp;
-  gint        n_tile_rows;
-  gint        n_tile_cols;
-  guint       ntiles;
-  gint        i;
-  guchar     *rlebuf;
-  GError     *tmp_error = NULL;
-
-  format = gegl_buffer_get_format (buffer);
+  XcfSaveTileBatch  batch;
+  guint32           saved_pos;
+  guint32          *offsets;
+  guint32           width;
+  guint32           height;
+  gint              bpp;
+  gint              n_tile_rows;
+  gint              n_tile_cols;
+  guint             ntiles;
+  gint              i, j;
+  gboolean          success   = TRUE;
+  GError           *tmp_error = NULL;
+
+  batch.compression = info->compression;
 
   width  = gegl_buffer_get_width (buffer);
   height = gegl_buffer_get_height (buffer);
-  bpp    = babl_format_get_bytes_per_pixel (format);
+  bpp    = babl_format_get_bytes_per_pixel (gegl_buffer_get_format (buffer));
 
   xcf_write_int32_check_error (info, (guint32 *) &width, 1);
   xcf_write_int32_check_error (info, (guint32 *) &height, 1);
 
   saved_pos = info->cp;
 
-  /* allocate a temporary buffer to store the rle data before it is
-   * written to disk
-   */
-  rlebuf = g_alloca (XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp * 1.5);
-
   n_tile_rows = gimp_gegl_buffer_get_n_tile_rows (buffer, XCF_TILE_HEIGHT);
   n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
 
   ntiles = n_tile_rows * n_tile_cols;
   xcf_check_error (xcf_seek_pos (info, info->cp + (ntiles + 1) * 4, error));
 
-  for (i = 0; i < ntiles; i++)
+  /* allocate room for the rle or compressed data of a batch of tiles,
+   * the tiles of a batch are read by this thread, encoded on all
+   * threads, and then written to disk in order by this one.  GEGL
+   * buffers must not be read from several threads at once.
+   */
+  batch.bpp        = bpp;
+  batch.data_size  = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp * 1.5;
+  batch.data       = g_malloc (XCF_TILE_BATCH_SIZE * batch.data_size);
+  batch.lengths    = g_new (gint, XCF_TILE_BATCH_SIZE);
+  batch.rle_counts = g_new (gint, XCF_TILE_BATCH_SIZE);
+  batch.rects      = g_new (GeglRectangle, XCF_TILE_BATCH_SIZE);
+  batch.tile_size  = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp;
+  batch.tiles      = g_malloc (XCF_TILE_BATCH_SIZE * batch.tile_size);
+
+  offsets = g_new (guint32, ntiles + 1);
+
+  for (i = 0; i < ntiles && success; i += XCF_TILE_BATCH_SIZE)
     {
-      GeglRectangle rect;
+      gint n_tiles = MIN (ntiles - i, XCF_TILE_BATCH_SIZE);
 
-      /* save the start offset of where we are writing
-       *  out the next tile.
-       */
-      offset = info->cp;
+      for (j = 0; j < n_tiles; j++)
+        {
+          gimp_gegl_buffer_get_tile_rect (buffer,
+                                          XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
+                                          i + j, &batch.rects[j]);
+
+          /* uncompressed tiles go directly into the batch */
+          gegl_buffer_get (buffer, &batch.rects[j], 1.0,
+                           gegl_buffer_get_format (buffer),
+                           batch.compression == COMPRESS_NONE ?
+                           batch.data  + j * batch.data_size :
+                           batch.tiles + j * batch.tile_size,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+        }
 
-      gimp_gegl_buffer_get_tile_rect (buffer,
-                                      XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
-                                      i, &rect);
+      gimp_parallel_distribute_range (n_tiles, 1,
+                                      xcf_save_tile_batch, &batch);
 
-      /* write out the tile. */
-      switch (info->compression)
+      for (j = 0; j < n_tiles; j++)
         {
-        case COMPRESS_NONE:
-          xcf_check_error (xcf_save_tile (info, buffer, &rect, format,
-                                          error));
-          break;
-        case COMPRESS_RLE:
-          xcf_check_error (xcf_save_tile_rle (info, buffer, &rect, format,
-                                              rlebuf, error));
-          break;
-        case COMPRESS_ZLIB:
-          g_error ("xcf: zlib compression unimplemented");
-          break;
-        case COMPRESS_FRACTAL:
-          g_error ("xcf: fractal compression unimplemented");
-          break;
+          if (batch.lengths[j] < 0)
+            {
+              g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                           _("Error compressing tile data"));
+              success = FALSE;
+              break;
+            }
+
+          /* the tile is still written, as it always was */
+          if (batch.rle_counts[j] != 0)
+            g_message ("xcf: uh oh! xcf rle tile saving error: %d",
+                       batch.rle_counts[j]);
+
+          /* save the start offset of where we are writing
+           *  out the tile.
+           */
+          offsets[i + j] = info->cp;
+
+          info->cp += xcf_write_int8 (info->fp,
+                                      batch.data + j * batch.data_size,
+                                      batch.lengths[j], &tmp_error);
+
+          if (tmp_error)
+            {
+              g_propagate_error (error, tmp_error);
+              success = FALSE;
+              break;
+            }
         }
+    }
 
-      /* seek back to where we are to write out the next
-       *  tile offset and write it out.
-       */
-      xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-      xcf_write_int32_check_error (info, &offset, 1);
+  g_free (batch.tiles);
+  g_free (batch.rects);
+  g_free (batch.rle_counts);
+  g_free (batch.lengths);
+  g_free (batch.data);
 
-      /* increment the location we are to write out the
-       *  next offset.
+  if (success)
+    {
+      /* write out the offset table, with a '0' offset position to
+       *  indicate the end of the level offsets.
        */
-      saved_pos = info->cp;
+      offsets[ntiles] = 0;
+
+      success = xcf_seek_pos (info, saved_pos, error);
+
+      if (success)
+        {
+          info->cp += xcf_write_int32 (info->fp, offsets, ntiles + 1,
+                                       &tmp_error);
+
+          if (tmp_error)
+            {
+              g_propagate_error (error, tmp_error);
+              success = FALSE;
+            }
+        }
 
       /* seek to the end of the file which is where
-       *  we will write out the next tile.
+       *  we will write out the next level or buffer.
        */
-      xcf_check_error (xcf_seek_end (info, error));
+      if (success)
+        success = xcf_seek_end (info, error);
     }
 
-  /* write out a '0' offset position to indicate the end
-   *  of the level offsets.
-   */
-  offset = 0;
-  xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
-
-  return TRUE;
+  g_free (offsets);
 
+  return success;
 }
 
-static gboolean
-xcf_save_tile (XcfInfo        *info,
-               GeglBuffer     *buffer,
-               GeglRectangle  *tile_rect,
-               const Babl     *format,
-               GError        **error)
+static void
+xcf_save_tile_batch (gsize    offset,
+                     gsize    size,
+                     gpointer user_data)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  GError *tmp_error = NULL;
+  XcfSaveTileBatch *batch = user_data;
+  gsize             i;
 
-  gegl_buffer_get (buffer, tile_rect, 1.0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  for (i = offset; i < offset + size; i++)
+    {
+      GeglRectangle *rect      = &batch->rects[i];
+      const guchar  *tile_data = batch->tiles + i * batch->tile_size;
+      guchar        *dest      = batch->data  + i * batch->data_size;
+      gint           tile_size = batch->bpp * rect->width * rect->height;
+      gint           len       = -1;
 
-  xcf_write_int8_check_error (info, tile_data, tile_size);
+      batch->rle_counts[i] = 0;
 
-  return TRUE;
+      switch (batch->compression)
+        {
+        case COMPRESS_NONE:
+          len = tile_size;
+          break;
+        case COMPRESS_RLE:
+          len = xcf_save_tile_rle (tile_data, rect, batch->bpp, dest,
+                                   &batch->rle_counts[i]);
+          break;
+        case COMPRESS_ZLIB:
+          len = xcf_save_tile_zlib (tile_data, tile_size,
+                                    dest, batch->data_size);
+          break;
+        case COMPRESS_FRACTAL:
+          g_error ("xcf: fractal compression unimplemented");
+          break;
+        case COMPRESS_ZSTD:
+#ifdef HAVE_ZSTD
+          len = xcf_save_tile_zstd (tile_data, tile_size,
+                                    dest, batch->data_size);
+#else
+          g_error ("xcf: zstd compression unavailable");
+#endif
+          break;
+        }
+
+      batch->lengths[i] = len;
+    }
 }
 
-static gboolean
-xcf_save_tile_rle (XcfInfo        *info,
-                   GeglBuffer     *buffer,
-                   GeglRectangle  *tile_rect,
-                   const Babl     *format,
-                   guchar         *rlebuf,
-                   GError        **error)
+static gint
+xcf_save_tile_rle (const guchar  *tile_data,
+                   GeglRectangle *tile_rect,
+                   gint           bpp,
+                   guchar        *rlebuf,
+                   gint          *bad_count)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  gint    len       = 0;
-  gint    i, j;
-  GError *tmp_error  = NULL;
-
-  gegl_buffer_get (buffer, tile_rect, 1.0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gint len = 0;
+  gint i, j;
 
   for (i = 0; i < bpp; i++)
     {
@@ -1640,14 +1748,51 @@ xcf_save_tile_rle (XcfInfo        *info,
             }
         }
 
+      /* this runs on a worker thread, so the writer reports the
+       * error instead of calling g_message() here
+       */
       if (count != (tile_rect->width * tile_rect->height))
-        g_message ("xcf: uh oh! xcf rle tile saving error: %d", count);
+        *bad_count = count;
     }
 
-  xcf_write_int8_check_error (info, rlebuf, len);
+  return len;
+}
 
-  return TRUE;
+static gint
+xcf_save_tile_zlib (const guchar *tile_data,
+                    gint          tile_size,
+                    guchar       *zbuf,
+                    gsize         zbuf_size)
+{
+  uLongf len = zbuf_size;
+
+  if (compress2 (zbuf, &len, tile_data, tile_size,
+                 Z_DEFAULT_COMPRESSION) != Z_OK)
+    return -1;
+
+  return len;
+}
+
+#ifdef HAVE_ZSTD
+static gint
+xcf_save_tile_zstd (const guchar *tile_data,
+                    gint          tile_size,
+                    guchar       *zbuf,
+                    gsize         zbuf_size)
+{
+  gsize len;
+
+  /* level 3 is zstd's default, it compresses better than zlib at
+   * several times the speed
+   */
+  len = ZSTD_compress (zbuf, zbuf_size, tile_data, tile_size, 3);
+
+  if (ZSTD_isError (len))
+    return -1;
+
+  return len;
 }
+#endif /* HAVE_ZSTD */
 
 static gboolean
 xcf_save_parasite (XcfInfo       *info,
@@ -28,6 +28,8 @@
 
 #include "core/core-types.h"
 
+#include "config/gimpcoreconfig.h"
+
 #include "core/gimp.h"
 #include "core/gimpimage.h"
 #include "core/gimpparamspecs.h"
@@ -41,6 +43,7 @@
 #include "xcf-load.h"
 #include "xcf-read.h"
 #include "xcf-save.h"
+#include "gimptilebackendxcf.h"
 
 #include "gimp-intl.h"
 
@@ -70,7 +73,8 @@ static GimpXcfLoaderFunc * const xcf_loaders[] =
   xcf_load_image,   /* version 1 */
   xcf_load_image,   /* version 2 */
   xcf_load_image,   /* version 3 */
-  xcf_load_image    /* version 4 */
+  xcf_load_image,   /* version 4 */
+  xcf_load_image    /* version 5 */
 };
 
 
@@ -156,6 +160,15 @@ xcf_init (Gimp *gimp)
                                                        FALSE, FALSE, TRUE,
                                                        NULL,
                                                        GIMP_PARAM_READWRITE));
+  gimp_procedure_add_argument (procedure,
+                               gimp_param_spec_int32 ("compression",
+                                                      "Compression",
+                                                      "Tile compression: "
+                                                      "-1 = automatic, "
+                                                      "0 = none, 1 = RLE, "
+                                                      "2 = zlib, 4 = zstd",
+                                                      -1, COMPRESS_ZSTD, -1,
+                                                      GIMP_PARAM_READWRITE));
   gimp_plug_in_manager_add_procedure (gimp->plug_in_manager, proc);
   g_object_unref (procedure);
 
@@ -254,6 +267,7 @@ xcf_load_invoker (GimpProcedure         *procedure,
     {
       info.gimp                  = gimp;
       info.progress              = progress;
+      info.lazy_file             = NULL;
       info.cp                    = 0;
       info.filename              = filename;
       info.tattoo_state          = 0;
@@ -277,6 +291,12 @@ xcf_load_invoker (GimpProcedure         *procedure,
           g_free (name);
         }
 
+      /*  with lazy loading, drawables read their tiles from the
+       *  file when they are first used
+       */
+      if (gimp->config->xcf_lazy_load)
+        info.lazy_file = gimp_tile_backend_xcf_file_open (filename, NULL);
+
       success = TRUE;
 
       info.cp += xcf_read_int8 (info.fp, (guint8 *) id, 14);
@@ -319,6 +339,9 @@ xcf_load_invoker (GimpProcedure         *procedure,
 
       fclose (info.fp);
 
+      if (info.lazy_file)
+        gimp_tile_backend_xcf_file_unref (info.lazy_file);
+
       if (progress)
         gimp_progress_end (progress);
     }
@@ -354,19 +377,39 @@ xcf_save_invoker (GimpProcedure         *procedure,
   GimpValueArray *return_vals;
   GimpImage      *image;
   const gchar    *filename;
-  gboolean        success = FALSE;
+  gint            compression = -1;
+  gboolean        success     = FALSE;
 
   gimp_set_busy (gimp);
 
   image    = gimp_value_get_image (gimp_value_array_index (args, 1), gimp);
   filename = g_value_get_string (gimp_value_array_index (args, 3));
 
+  /*  old callers don't pass the compression argument  */
+  if (gimp_value_array_length (args) > 5)
+    compression = g_value_get_int (gimp_value_array_index (args, 5));
+
+  /*  RLE is hopeless on the noisy low bits of high bit depth images,
+   *  use zlib there unless asked otherwise
+   */
+  if (compression == COMPRESS_FRACTAL)
+    compression = COMPRESS_RLE;
+  else if (compression < 0)
+    compression = (gimp_image_get_precision (image) == GIMP_PRECISION_U8 ?
+                   COMPRESS_RLE : COMPRESS_ZLIB);
+
+  /*  the file may still back the tiles of lazily loaded drawables,
+   *  read them before we overwrite it
+   */
+  gimp_tile_backend_xcf_detach_file (filename);
+
   info.fp = g_fopen (filename, "wb");
 
   if (info.fp)
     {
       info.gimp                  = gimp;
       info.progress              = progress;
+      info.lazy_file             = NULL;
       info.cp                    = 0;
       info.filename              = filename;
       info.active_layer          = NULL;
@@ -376,7 +419,7 @@ xcf_save_invoker (GimpProcedure         *procedure,
       info.floating_sel_offset   = 0;
       info.swap_num              = 0;
       info.ref_count             = NULL;
-      info.compression           = COMPRESS_RLE;
+      info.compression           = compression;
 
       if (progress)
         {
@@ -121,6 +121,9 @@
 
 #define TILE_MAP_SIZE (_tile_width * _tile_height * 16)
 
+#define SHM_SIZE      (TILE_MAP_SIZE * \
+                       (1 + GP_TILE_N_WINDOWS * GP_TILE_WINDOW_SIZE))
+
 #define ERRMSG_SHM_FAILED "Could not attach to gimp shared memory segment"
 
 /* Maybe this should go in a public header if we add other things to it */
@@ -1010,6 +1013,9 @@ gimp_run_procedure2 (const gchar     *name,
   proc_run.nparams = n_params;
   proc_run.params  = (GPParam *) params;
 
+  /*  the procedure has to see what we wrote to mapped tiles  */
+  _gimp_tile_window_sync ();
+
   if (! gp_proc_run_write (_writechannel, &proc_run, NULL))
     gimp_quit ();
 
@@ -1639,7 +1645,7 @@ gimp_close (void)
 #elif defined(USE_POSIX_SHM)
 
   if ((_shm_ID != -1) && (_shm_addr != MAP_FAILED))
-    munmap (_shm_addr, TILE_MAP_SIZE);
+    munmap (_shm_addr, SHM_SIZE);
 
 #endif
 
@@ -1986,7 +1992,7 @@ gimp_config (GPConfig *config)
           /* Map the shared memory into our address space for use */
           _shm_addr = (guchar *) MapViewOfFile (shm_handle,
                                                 FILE_MAP_ALL_ACCESS,
-                                                0, 0, TILE_MAP_SIZE);
+                                                0, 0, SHM_SIZE);
 
           /* Verify that we mapped our view */
           if (!_shm_addr)
@@ -2017,7 +2023,7 @@ gimp_config (GPConfig *config)
       if (shm_fd != -1)
         {
           /* Map the shared memory into our address space for use */
-          _shm_addr = (guchar *) mmap (NULL, TILE_MAP_SIZE,
+          _shm_addr = (guchar *) mmap (NULL, SHM_SIZE,
                                        PROT_READ | PROT_WRITE, MAP_SHARED,
                                        shm_fd, 0);
 
@@ -2058,6 +2064,8 @@ gimp_proc_run (GPProcRun *proc_run)
       proc_return.nparams = n_return_vals;
       proc_return.params  = (GPParam *) return_vals;
 
+      _gimp_tile_window_sync ();
+
       if (! gp_proc_return_write (_writechannel, &proc_return, NULL))
         gimp_quit ();
     }
@@ -2091,6 +2099,8 @@ gimp_temp_proc_run (GPProcRun *proc_run)
       proc_return.nparams = n_return_vals;
       proc_return.params  = (GPParam *) return_vals;
 
+      _gimp_tile_window_sync ();
+
       if (! gp_temp_proc_return_write (_writechannel, &proc_return, NULL))
         gimp_quit ();
     }
@@ -2110,6 +2120,11 @@ gimp_process_message (GimpWireMessage *msg)
     case GP_TILE_REQ:
     case GP_TILE_ACK:
     case GP_TILE_DATA:
+    case GP_TILE_MAP_REQ:
+    case GP_TILE_MAP_DATA:
+    case GP_TILE_COMMIT:
+    case GP_TILE_LIST_REQ:
+    case GP_TILE_LIST_DATA:
       g_warning ("unexpected tile message received (should not happen)");
       break;
     case GP_PROC_RUN:
@@ -244,6 +244,8 @@ gimp_pixel_rgn_get_row (GimpPixelRgn *pr,
 
   end = x + width;
 
+  _gimp_tile_prefetch (pr->drawable, pr->shadow, x, y, width, 1);
+
   while (x < end)
     {
       GimpTile     *tile;
@@ -301,6 +303,8 @@ gimp_pixel_rgn_get_col (GimpPixelRgn *pr,
 
   end = y + height;
 
+  _gimp_tile_prefetch (pr->drawable, pr->shadow, x, y, 1, height);
+
   while (y < end)
     {
       GimpTile     *tile;
@@ -376,6 +380,8 @@ gimp_pixel_rgn_get_rect (GimpPixelRgn *pr,
   yend = y + height;
   ystep = 0;
 
+  _gimp_tile_prefetch (pr->drawable, pr->shadow, x, y, width, height);
+
   while (y < yend)
     {
       x = xstart;
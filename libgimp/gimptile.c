@@ -48,6 +48,24 @@
  */
 #define FREE_QUANTUM 0.1
 
+/*  The size of a slot in the tile window, see GP_TILE_WINDOW_SIZE.
+ */
+#define TILE_SLOT_SIZE       (gimp_tile_width () * gimp_tile_height () * 16)
+#define TILE_SLOT_ADDR(slot) (tile_window_addr + (slot) * TILE_SLOT_SIZE)
+
+
+/*  A slot of the tile window, our part of the shared memory segment.
+ *  The data of a mapped tile points right into its slot, and changes
+ *  to it are sent to the core in batches by gimp_tile_window_commit().
+ *  A tile keeps its slot after it was released, so it can be used
+ *  again without asking the core, until _gimp_tile_window_sync().
+ */
+typedef struct
+{
+  GimpTile *tile;   /*  the tile occupying the slot, or NULL        */
+  gboolean  dirty;  /*  the slot holds changes not committed yet   */
+} GimpTileSlot;
+
 
 void         gimp_read_expect_msg   (GimpWireMessage *msg,
                                      gint             type);
@@ -57,6 +75,23 @@ static void  gimp_tile_put          (GimpTile        *tile);
 static void  gimp_tile_cache_insert (GimpTile        *tile);
 static void  gimp_tile_cache_flush  (GimpTile        *tile);
 
+static gboolean  gimp_tile_get_mapped        (GimpTile       *tile);
+static gboolean  gimp_tile_get_prefetched    (GimpTile       *tile);
+static void      gimp_tile_list_fetch        (GimpTile      **tiles,
+                                              gint            n_tiles);
+static gboolean  gimp_tile_prefetch_is_drawable (gpointer     key,
+                                                 gpointer     value,
+                                                 gpointer     data);
+
+static gboolean  gimp_tile_is_mapped         (GimpTile       *tile);
+static gboolean  gimp_tile_window_available  (void);
+static gint      gimp_tile_window_lookup     (GimpTile       *tile);
+static gint      gimp_tile_window_get_slot   (const gboolean *reserved);
+static void      gimp_tile_window_release    (gint            slot);
+static gint      gimp_tile_window_map        (GimpTile      **tiles,
+                                              gint            n_tiles);
+static void      gimp_tile_window_commit     (void);
+
 
 /*  private variables  */
 
@@ -67,6 +102,14 @@ static gulong       max_tile_size   = 0;
 static gulong       cur_cache_size  = 0;
 static gulong       max_cache_size  = 0;
 
+static GimpTileSlot tile_window[GP_TILE_WINDOW_SIZE];
+static guchar     * tile_window_addr     = NULL;
+static gboolean     tile_window_disabled = FALSE;
+static gint         tile_window_next     = 0;
+
+/*  tiles fetched ahead of use by GP_TILE_LIST_REQ, maps GimpTile to data  */
+static GHashTable * tile_prefetch_table  = NULL;
+
 
 /*  public functions  */
 
@@ -94,7 +137,18 @@ gimp_tile_ref_zero (GimpTile *tile)
   tile->ref_count++;
 
   if (tile->ref_count == 1)
-    tile->data = g_new0 (guchar, tile->ewidth * tile->eheight * tile->bpp);
+    {
+      gint slot = gimp_tile_window_lookup (tile);
+
+      /*  the window's or prefetched copy of the tile is outdated now  */
+      if (slot != -1)
+        gimp_tile_window_release (slot);
+
+      if (tile_prefetch_table)
+        g_hash_table_remove (tile_prefetch_table, tile);
+
+      tile->data = g_new0 (guchar, tile->ewidth * tile->eheight * tile->bpp);
+    }
 
   gimp_tile_cache_insert (tile);
 }
@@ -112,7 +166,10 @@ gimp_tile_unref (GimpTile *tile,
   if (tile->ref_count == 0)
     {
       gimp_tile_flush (tile);
-      g_free (tile->data);
+
+      if (! gimp_tile_is_mapped (tile))
+        g_free (tile->data);
+
       tile->data = NULL;
     }
 }
@@ -124,7 +181,17 @@ gimp_tile_flush (GimpTile *tile)
 
   if (tile->data && tile->dirty)
     {
-      gimp_tile_put (tile);
+      if (gimp_tile_is_mapped (tile))
+        {
+          gint slot = (tile->data - tile_window_addr) / TILE_SLOT_SIZE;
+
+          tile_window[slot].dirty = TRUE;
+        }
+      else
+        {
+          gimp_tile_put (tile);
+        }
+
       tile->dirty = FALSE;
     }
 }
@@ -169,6 +236,7 @@ void
 _gimp_tile_cache_flush_drawable (GimpDrawable *drawable)
 {
   GList *list;
+  gint   slot;
 
   g_return_if_fail (drawable != NULL);
 
@@ -182,6 +250,104 @@ _gimp_tile_cache_flush_drawable (GimpDrawable *drawable)
       if (tile->drawable == drawable)
         gimp_tile_cache_flush (tile);
     }
+
+  /*  the drawable's tiles may be freed after this, so they have to
+   *  leave the tile window
+   */
+  gimp_tile_window_commit ();
+
+  for (slot = 0; slot < GP_TILE_WINDOW_SIZE; slot++)
+    {
+      GimpTile *tile = tile_window[slot].tile;
+
+      if (tile && tile->drawable == drawable)
+        gimp_tile_window_release (slot);
+    }
+
+  if (tile_prefetch_table)
+    g_hash_table_foreach_remove (tile_prefetch_table,
+                                 gimp_tile_prefetch_is_drawable, drawable);
+}
+
+void
+_gimp_tile_window_sync (void)
+{
+  gint slot;
+
+  gimp_tile_window_commit ();
+
+  /*  the core may change the drawables now, forget the tiles
+   *  nobody holds on to
+   */
+  for (slot = 0; slot < GP_TILE_WINDOW_SIZE; slot++)
+    {
+      GimpTile *tile = tile_window[slot].tile;
+
+      if (tile && tile->ref_count == 0)
+        tile_window[slot].tile = NULL;
+    }
+
+  if (tile_prefetch_table)
+    g_hash_table_remove_all (tile_prefetch_table);
+}
+
+/*  Fetches the tiles covering the given area of @drawable which are
+ *  not available yet, with a single message, so that the following
+ *  gimp_tile_ref() calls don't need to talk to the core one by one.
+ */
+void
+_gimp_tile_prefetch (GimpDrawable *drawable,
+                     gboolean      shadow,
+                     gint          x,
+                     gint          y,
+                     gint          width,
+                     gint          height)
+{
+  GimpTile *tiles[GP_TILE_LIST_SIZE];
+  gint      n_tiles  = 0;
+  gint      n_mapped = 0;
+  gint      row, col;
+
+  g_return_if_fail (drawable != NULL);
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  for (row = y / gimp_tile_height ();
+       row <= (y + height - 1) / gimp_tile_height ();
+       row++)
+    {
+      for (col = x / gimp_tile_width ();
+           col <= (x + width - 1) / gimp_tile_width ();
+           col++)
+        {
+          GimpTile *tile = gimp_drawable_get_tile (drawable, shadow, row, col);
+
+          if (n_tiles == GP_TILE_LIST_SIZE)
+            break;
+
+          if (tile->ref_count > 0                       ||
+              gimp_tile_window_lookup (tile) != -1      ||
+              (tile_prefetch_table &&
+               g_hash_table_lookup (tile_prefetch_table, tile)))
+            continue;
+
+          tiles[n_tiles++] = tile;
+        }
+    }
+
+  /*  a single tile is fetched just as fast when it is used  */
+  if (n_tiles < 2)
+    return;
+
+  if (gimp_tile_window_available ())
+    n_mapped = MAX (gimp_tile_window_map (tiles, n_tiles), 0);
+
+  /*  the tiles which didn't fit into the window are still fetched
+   *  with a single message
+   */
+  if (n_mapped < n_tiles)
+    gimp_tile_list_fetch (tiles + n_mapped, n_tiles - n_mapped);
 }
 
 
@@ -196,6 +362,9 @@ gimp_tile_get (GimpTile *tile)
   GPTileData      *tile_data;
   GimpWireMessage  msg;
 
+  if (gimp_tile_get_mapped (tile) || gimp_tile_get_prefetched (tile))
+    return;
+
   tile_req.drawable_ID = tile->drawable->drawable_id;
   tile_req.tile_num    = tile->tile_num;
   tile_req.shadow      = tile->shadow;
@@ -283,6 +452,154 @@ gimp_tile_put (GimpTile *tile)
   gimp_wire_destroy (&msg);
 }
 
+/*  Maps @tile, together with the following tiles of its row which are
+ *  not in use yet, into the tile window. Returns FALSE if the tile has
+ *  to be transferred otherwise, because the window is not available
+ *  or all of its slots hold tiles which are in use.
+ */
+static gboolean
+gimp_tile_get_mapped (GimpTile *tile)
+{
+  GimpDrawable *drawable = tile->drawable;
+  GimpTile     *tiles    = tile - tile->tile_num;
+  GimpTile     *row[GP_TILE_WINDOW_SIZE];
+  gint          n_tiles  = 0;
+  gint          row_end;
+  gint          slot;
+  gint          i;
+
+  if (! gimp_tile_window_available ())
+    return FALSE;
+
+  slot = gimp_tile_window_lookup (tile);
+
+  if (slot == -1)
+    {
+      row_end = ((tile->tile_num / drawable->ntile_cols + 1) *
+                 drawable->ntile_cols);
+
+      row[n_tiles++] = tile;
+
+      for (i = tile->tile_num + 1;
+           i < row_end && n_tiles < GP_TILE_WINDOW_SIZE;
+           i++)
+        {
+          if (tiles[i].ref_count == 0 &&
+              gimp_tile_window_lookup (&tiles[i]) == -1)
+            {
+              row[n_tiles++] = &tiles[i];
+            }
+        }
+
+      if (gimp_tile_window_map (row, n_tiles) < 1)
+        return FALSE;
+
+      slot = gimp_tile_window_lookup (tile);
+
+      if (slot == -1)
+        return FALSE;
+    }
+
+  tile->data = TILE_SLOT_ADDR (slot);
+
+  return TRUE;
+}
+
+static gboolean
+gimp_tile_get_prefetched (GimpTile *tile)
+{
+  if (tile_prefetch_table)
+    {
+      guchar *data = g_hash_table_lookup (tile_prefetch_table, tile);
+
+      if (data)
+        {
+          g_hash_table_steal (tile_prefetch_table, tile);
+
+          tile->data = data;
+
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/*  Fetches @tiles through the pipe with a single GP_TILE_LIST_REQ and
+ *  keeps their data until they are used.
+ */
+static void
+gimp_tile_list_fetch (GimpTile **tiles,
+                      gint       n_tiles)
+{
+  extern GIOChannel *_writechannel;
+
+  GPTileReq        tile_reqs[GP_TILE_LIST_SIZE];
+  GPTileList       tile_list;
+  GPTileDataList  *reply;
+  GimpWireMessage  msg;
+  gint             i;
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      tile_reqs[i].drawable_ID = tiles[i]->drawable->drawable_id;
+      tile_reqs[i].tile_num    = tiles[i]->tile_num;
+      tile_reqs[i].shadow      = tiles[i]->shadow;
+    }
+
+  tile_list.n_tiles = n_tiles;
+  tile_list.tiles   = tile_reqs;
+
+  if (! gp_tile_list_req_write (_writechannel, &tile_list, NULL))
+    gimp_quit ();
+
+  gimp_read_expect_msg (&msg, GP_TILE_LIST_DATA);
+
+  reply = msg.data;
+
+  if (reply->n_tiles != n_tiles)
+    {
+      g_message ("received tile list did not match requested tile list");
+      gimp_quit ();
+    }
+
+  if (! tile_prefetch_table)
+    tile_prefetch_table = g_hash_table_new_full (g_direct_hash, NULL,
+                                                 NULL, g_free);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      GimpTile   *tile      = tiles[i];
+      GPTileData *tile_data = &reply->tiles[i];
+
+      if (tile_data->drawable_ID != tile->drawable->drawable_id ||
+          tile_data->tile_num    != tile->tile_num              ||
+          tile_data->shadow      != tile->shadow                ||
+          tile_data->width       != tile->ewidth                ||
+          tile_data->height      != tile->eheight               ||
+          tile_data->bpp         != tile->bpp)
+        {
+          g_message ("received tile info did not match computed tile info");
+          gimp_quit ();
+        }
+
+      g_hash_table_insert (tile_prefetch_table, tile, tile_data->data);
+      tile_data->data = NULL;
+    }
+
+  gimp_wire_destroy (&msg);
+}
+
+static gboolean
+gimp_tile_prefetch_is_drawable (gpointer key,
+                                gpointer value,
+                                gpointer data)
+{
+  GimpTile *tile = key;
+
+  return tile->drawable == data;
+}
+
 /* This function is nearly identical to the function 'tile_cache_insert'
  *  in the file 'tile_cache.c' which is part of the main gimp application.
  */
@@ -408,3 +725,200 @@ gimp_tile_cache_flush (GimpTile *tile)
       gimp_tile_unref (tile, FALSE);
     }
 }
+
+static gboolean
+gimp_tile_is_mapped (GimpTile *tile)
+{
+  return (tile_window_addr               &&
+          tile->data >= tile_window_addr &&
+          tile->data <  TILE_SLOT_ADDR (GP_TILE_WINDOW_SIZE));
+}
+
+static gboolean
+gimp_tile_window_available (void)
+{
+  return ! tile_window_disabled && gimp_shm_ID () != -1;
+}
+
+static gint
+gimp_tile_window_lookup (GimpTile *tile)
+{
+  gint slot;
+
+  for (slot = 0; slot < GP_TILE_WINDOW_SIZE; slot++)
+    {
+      if (tile_window[slot].tile == tile)
+        return slot;
+    }
+
+  return -1;
+}
+
+/*  Returns an empty slot which is not @reserved, making room for it
+ *  if necessary. Slots of tiles which are in use are never given up,
+ *  pixel regions and plug-ins may hold pointers into them. Returns -1
+ *  if all slots are taken by such tiles.
+ */
+static gint
+gimp_tile_window_get_slot (const gboolean *reserved)
+{
+  gint slot;
+  gint i;
+
+  for (slot = 0; slot < GP_TILE_WINDOW_SIZE; slot++)
+    {
+      if (! reserved[slot] && ! tile_window[slot].tile)
+        return slot;
+    }
+
+  for (i = 0; i < GP_TILE_WINDOW_SIZE; i++)
+    {
+      slot = (tile_window_next + i) % GP_TILE_WINDOW_SIZE;
+
+      if (! reserved[slot] && tile_window[slot].tile->ref_count == 0)
+        {
+          tile_window_next = slot + 1;
+
+          gimp_tile_window_release (slot);
+
+          return slot;
+        }
+    }
+
+  return -1;
+}
+
+static void
+gimp_tile_window_release (gint slot)
+{
+  GimpTile *tile = tile_window[slot].tile;
+
+  if (tile_window[slot].dirty)
+    gimp_tile_window_commit ();
+
+  /*  a tile which is still in use, which only happens when its
+   *  drawable goes away, continues on a private copy
+   */
+  if (tile->data)
+    tile->data = g_memdup (tile->data,
+                           tile->ewidth * tile->eheight * tile->bpp);
+
+  tile_window[slot].tile = NULL;
+}
+
+/*  Maps @tiles into the tile window with a single GP_TILE_MAP_REQ, as
+ *  many of them as there are slots not used by other tiles. Returns
+ *  the number of tiles mapped, the first ones of @tiles, or -1 if the
+ *  core can't give us a window.
+ */
+static gint
+gimp_tile_window_map (GimpTile **tiles,
+                      gint       n_tiles)
+{
+  extern GIOChannel *_writechannel;
+
+  gboolean         reserved[GP_TILE_WINDOW_SIZE] = { FALSE, };
+  GPTileMapInfo    infos[GP_TILE_WINDOW_SIZE];
+  GPTileMap        tile_map;
+  GPTileMap       *reply;
+  GimpWireMessage  msg;
+  gint             n_mapped = 0;
+  gint             slot;
+  gint             i;
+
+  for (i = 0; i < n_tiles && n_mapped < GP_TILE_WINDOW_SIZE; i++)
+    {
+      GimpTile *tile = tiles[i];
+
+      slot = gimp_tile_window_get_slot (reserved);
+
+      if (slot == -1)
+        break;
+
+      reserved[slot]          = TRUE;
+      tile_window[slot].tile  = tile;
+      tile_window[slot].dirty = FALSE;
+
+      infos[n_mapped].drawable_ID = tile->drawable->drawable_id;
+      infos[n_mapped].tile_num    = tile->tile_num;
+      infos[n_mapped].shadow      = tile->shadow;
+      infos[n_mapped].slot        = slot;
+      n_mapped++;
+    }
+
+  if (n_mapped == 0)
+    return 0;
+
+  tile_map.offset  = 0;
+  tile_map.n_tiles = n_mapped;
+  tile_map.tiles   = infos;
+
+  if (! gp_tile_map_req_write (_writechannel, &tile_map, NULL))
+    gimp_quit ();
+
+  gimp_read_expect_msg (&msg, GP_TILE_MAP_DATA);
+
+  reply = msg.data;
+
+  if (reply->n_tiles != n_mapped)
+    {
+      /*  all windows are taken, don't ask again  */
+      for (i = 0; i < n_mapped; i++)
+        tile_window[infos[i].slot].tile = NULL;
+
+      tile_window_disabled = TRUE;
+
+      gimp_wire_destroy (&msg);
+
+      return -1;
+    }
+
+  tile_window_addr = gimp_shm_addr () + reply->offset;
+
+  gimp_wire_destroy (&msg);
+
+  return n_mapped;
+}
+
+/*  Sends the changes to all mapped tiles to the core.
+ */
+static void
+gimp_tile_window_commit (void)
+{
+  extern GIOChannel *_writechannel;
+
+  GPTileMapInfo    infos[GP_TILE_WINDOW_SIZE];
+  GPTileMap        tile_map;
+  GimpWireMessage  msg;
+  gint             n_tiles = 0;
+  gint             slot;
+
+  for (slot = 0; slot < GP_TILE_WINDOW_SIZE; slot++)
+    {
+      GimpTile *tile = tile_window[slot].tile;
+
+      if (tile && tile_window[slot].dirty)
+        {
+          infos[n_tiles].drawable_ID = tile->drawable->drawable_id;
+          infos[n_tiles].tile_num    = tile->tile_num;
+          infos[n_tiles].shadow      = tile->shadow;
+          infos[n_tiles].slot        = slot;
+          n_tiles++;
+
+          tile_window[slot].dirty = FALSE;
+        }
+    }
+
+  if (n_tiles == 0)
+    return;
+
+  tile_map.offset  = 0;
+  tile_map.n_tiles = n_tiles;
+  tile_map.tiles   = infos;
+
+  if (! gp_tile_commit_write (_writechannel, &tile_map, NULL))
+    gimp_quit ();
+
+  gimp_read_expect_msg (&msg, GP_TILE_ACK);
+  gimp_wire_destroy (&msg);
+}
@@ -63,6 +63,13 @@ void    gimp_tile_cache_ntiles (gulong     ntiles);
 /*  private function  */
 
 G_GNUC_INTERNAL void _gimp_tile_cache_flush_drawable (GimpDrawable *drawable);
+G_GNUC_INTERNAL void _gimp_tile_window_sync          (void);
+G_GNUC_INTERNAL void _gimp_tile_prefetch             (GimpDrawable *drawable,
+                                                      gboolean      shadow,
+                                                      gint          x,
+                                                      gint          y,
+                                                      gint          width,
+                                                      gint          height);
 
 
 G_END_DECLS
@@ -123,29 +123,41 @@ enum
 
 enum
 {
-  ARCH_X86_INTEL_FEATURE_PNI      = 1 << 0
+  ARCH_X86_INTEL_FEATURE_PNI      = 1 << 0,
+  ARCH_X86_INTEL_FEATURE_OSXSAVE  = 1 << 27,
+  ARCH_X86_INTEL_FEATURE_AVX      = 1 << 28
+};
+
+/* extended features, cpuid leaf 7, in ebx */
+enum
+{
+  ARCH_X86_INTEL_FEATURE_AVX2     = 1 << 5
 };
 
 #if !defined(ARCH_X86_64) && (defined(PIC) || defined(__PIC__))
-#define cpuid(op,eax,ebx,ecx,edx)  \
-  __asm__ ("movl %%ebx, %%esi\n\t" \
-           "cpuid\n\t"             \
-           "xchgl %%ebx,%%esi"     \
-           : "=a" (eax),           \
-             "=S" (ebx),           \
-             "=c" (ecx),           \
-             "=d" (edx)            \
-           : "0" (op))
+#define cpuid_count(op,count,eax,ebx,ecx,edx) \
+  __asm__ ("movl %%ebx, %%esi\n\t"           \
+           "cpuid\n\t"                       \
+           "xchgl %%ebx,%%esi"               \
+           : "=a" (eax),                     \
+             "=S" (ebx),                     \
+             "=c" (ecx),                     \
+             "=d" (edx)                      \
+           : "0" (op),                       \
+             "2" (count))
 #else
-#define cpuid(op,eax,ebx,ecx,edx)  \
-  __asm__ ("cpuid"                 \
-           : "=a" (eax),           \
-             "=b" (ebx),           \
-             "=c" (ecx),           \
-             "=d" (edx)            \
-           : "0" (op))
+#define cpuid_count(op,count,eax,ebx,ecx,edx) \
+  __asm__ ("cpuid"                           \
+           : "=a" (eax),                     \
+             "=b" (ebx),                     \
+             "=c" (ecx),                     \
+             "=d" (edx)                      \
+           : "0" (op),                       \
+             "2" (count))
 #endif
 
+#define cpuid(op,eax,ebx,ecx,edx) cpuid_count (op, 0, eax, ebx, ecx, edx)
+
 
 static X86Vendor
 arch_get_vendor (void)
@@ -220,6 +232,22 @@ arch_get_vendor (void)
   return ARCH_X86_VENDOR_UNKNOWN;
 }
 
+#ifdef USE_AVX2
+static guint32
+arch_xgetbv (void)
+{
+  guint32 eax, edx;
+
+  /* xgetbv with ecx = 0, spelled out for old assemblers */
+  __asm__ (".byte 0x0f, 0x01, 0xd0"
+           : "=a" (eax),
+             "=d" (edx)
+           : "c" (0));
+
+  return eax;
+}
+#endif /* USE_AVX2 */
+
 static guint32
 arch_accel_intel (void)
 {
@@ -245,6 +273,26 @@ arch_accel_intel (void)
 
     if (ecx & ARCH_X86_INTEL_FEATURE_PNI)
       caps |= GIMP_CPU_ACCEL_X86_SSE3;
+
+#ifdef USE_AVX2
+    /*  AVX needs the OS to save the ymm registers, check XCR0  */
+    if ((ecx & ARCH_X86_INTEL_FEATURE_OSXSAVE) &&
+        (ecx & ARCH_X86_INTEL_FEATURE_AVX)     &&
+        (arch_xgetbv () & 0x6) == 0x6)
+      {
+        caps |= GIMP_CPU_ACCEL_X86_AVX;
+
+        cpuid (0, eax, ebx, ecx, edx);
+
+        if (eax >= 7)
+          {
+            cpuid_count (7, 0, eax, ebx, ecx, edx);
+
+            if (ebx & ARCH_X86_INTEL_FEATURE_AVX2)
+              caps |= GIMP_CPU_ACCEL_X86_AVX2;
+          }
+      }
+#endif /* USE_AVX2 */
 #endif /* USE_SSE */
   }
 #endif /* USE_MMX */
@@ -410,7 +458,10 @@ arch_accel (void)
 
 #ifdef USE_SSE
   if ((caps & GIMP_CPU_ACCEL_X86_SSE) && !arch_accel_sse_os_support ())
-    caps &= ~(GIMP_CPU_ACCEL_X86_SSE | GIMP_CPU_ACCEL_X86_SSE2);
+    caps &= ~(GIMP_CPU_ACCEL_X86_SSE  |
+              GIMP_CPU_ACCEL_X86_SSE2 |
+              GIMP_CPU_ACCEL_X86_AVX  |
+              GIMP_CPU_ACCEL_X86_AVX2);
 #endif
 
   return caps;
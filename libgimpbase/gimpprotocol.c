@@ -67,6 +67,30 @@ static void _gp_tile_data_write          (GIOChannel       *channel,
                                           gpointer          user_data);
 static void _gp_tile_data_destroy        (GimpWireMessage  *msg);
 
+static void _gp_tile_map_read            (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_map_write           (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_map_destroy         (GimpWireMessage  *msg);
+
+static void _gp_tile_list_req_read       (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_list_req_write      (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_list_req_destroy    (GimpWireMessage  *msg);
+
+static void _gp_tile_list_data_read      (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_list_data_write     (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_list_data_destroy   (GimpWireMessage  *msg);
+
 static void _gp_proc_run_read            (GIOChannel       *channel,
                                           GimpWireMessage  *msg,
                                           gpointer          user_data);
@@ -197,6 +221,26 @@ gp_init (void)
                       _gp_has_init_read,
                       _gp_has_init_write,
                       _gp_has_init_destroy);
+  gimp_wire_register (GP_TILE_MAP_REQ,
+                      _gp_tile_map_read,
+                      _gp_tile_map_write,
+                      _gp_tile_map_destroy);
+  gimp_wire_register (GP_TILE_MAP_DATA,
+                      _gp_tile_map_read,
+                      _gp_tile_map_write,
+                      _gp_tile_map_destroy);
+  gimp_wire_register (GP_TILE_COMMIT,
+                      _gp_tile_map_read,
+                      _gp_tile_map_write,
+                      _gp_tile_map_destroy);
+  gimp_wire_register (GP_TILE_LIST_REQ,
+                      _gp_tile_list_req_read,
+                      _gp_tile_list_req_write,
+                      _gp_tile_list_req_destroy);
+  gimp_wire_register (GP_TILE_LIST_DATA,
+                      _gp_tile_list_data_read,
+                      _gp_tile_list_data_write,
+                      _gp_tile_list_data_destroy);
 }
 
 gboolean
@@ -292,6 +336,101 @@ gp_tile_data_write (GIOChannel *channel,
   return TRUE;
 }
 
+gboolean
+gp_tile_map_req_write (GIOChannel *channel,
+                       GPTileMap  *tile_map,
+                       gpointer    user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_TILE_MAP_REQ;
+  msg.data = tile_map;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_tile_map_data_write (GIOChannel *channel,
+                        GPTileMap  *tile_map,
+                        gpointer    user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_TILE_MAP_DATA;
+  msg.data = tile_map;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_tile_commit_write (GIOChannel *channel,
+                      GPTileMap  *tile_map,
+                      gpointer    user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_TILE_COMMIT;
+  msg.data = tile_map;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_tile_list_req_write (GIOChannel *channel,
+                        GPTileList *tile_list,
+                        gpointer    user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_TILE_LIST_REQ;
+  msg.data = tile_list;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_tile_list_data_write (GIOChannel     *channel,
+                         GPTileDataList *tile_list,
+                         gpointer        user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_TILE_LIST_DATA;
+  msg.data = tile_list;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
 gboolean
 gp_proc_run_write (GIOChannel *channel,
                    GPProcRun  *proc_run,
@@ -843,6 +982,322 @@ _gp_tile_data_destroy (GimpWireMessage *msg)
     }
 }
 
+/*  tile_map  */
+
+static void
+_gp_tile_map_read (GIOChannel      *channel,
+                   GimpWireMessage *msg,
+                   gpointer         user_data)
+{
+  GPTileMap *tile_map = g_slice_new0 (GPTileMap);
+  gint       i;
+
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_map->offset, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_map->n_tiles, 1, user_data))
+    goto cleanup;
+
+  if (tile_map->n_tiles > GP_TILE_WINDOW_SIZE)
+    goto cleanup;
+
+  tile_map->tiles = g_new0 (GPTileMapInfo, tile_map->n_tiles);
+
+  for (i = 0; i < tile_map->n_tiles; i++)
+    {
+      GPTileMapInfo *info = &tile_map->tiles[i];
+
+      if (! _gimp_wire_read_int32 (channel,
+                                   (guint32 *) &info->drawable_ID, 1,
+                                   user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   &info->tile_num, 1, user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   &info->shadow, 1, user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   &info->slot, 1, user_data))
+        goto cleanup;
+    }
+
+  msg->data = tile_map;
+  return;
+
+ cleanup:
+  g_free (tile_map->tiles);
+  g_slice_free (GPTileMap, tile_map);
+  msg->data = NULL;
+}
+
+static void
+_gp_tile_map_write (GIOChannel      *channel,
+                    GimpWireMessage *msg,
+                    gpointer         user_data)
+{
+  GPTileMap *tile_map = msg->data;
+  gint       i;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_map->offset, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_map->n_tiles, 1, user_data))
+    return;
+
+  for (i = 0; i < tile_map->n_tiles; i++)
+    {
+      GPTileMapInfo *info = &tile_map->tiles[i];
+
+      if (! _gimp_wire_write_int32 (channel,
+                                    (const guint32 *) &info->drawable_ID, 1,
+                                    user_data))
+        return;
+      if (! _gimp_wire_write_int32 (channel,
+                                    &info->tile_num, 1, user_data))
+        return;
+      if (! _gimp_wire_write_int32 (channel,
+                                    &info->shadow, 1, user_data))
+        return;
+      if (! _gimp_wire_write_int32 (channel,
+                                    &info->slot, 1, user_data))
+        return;
+    }
+}
+
+static void
+_gp_tile_map_destroy (GimpWireMessage *msg)
+{
+  GPTileMap *tile_map = msg->data;
+
+  if (tile_map)
+    {
+      g_free (tile_map->tiles);
+      g_slice_free (GPTileMap, tile_map);
+    }
+}
+
+/*  tile_list_req  */
+
+static void
+_gp_tile_list_req_read (GIOChannel      *channel,
+                        GimpWireMessage *msg,
+                        gpointer         user_data)
+{
+  GPTileList *tile_list = g_slice_new0 (GPTileList);
+  gint        i;
+
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_list->n_tiles, 1, user_data))
+    goto cleanup;
+
+  if (tile_list->n_tiles > GP_TILE_LIST_SIZE)
+    goto cleanup;
+
+  tile_list->tiles = g_new0 (GPTileReq, tile_list->n_tiles);
+
+  for (i = 0; i < tile_list->n_tiles; i++)
+    {
+      GPTileReq *tile_req = &tile_list->tiles[i];
+
+      if (! _gimp_wire_read_int32 (channel,
+                                   (guint32 *) &tile_req->drawable_ID, 1,
+                                   user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   &tile_req->tile_num, 1, user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   &tile_req->shadow, 1, user_data))
+        goto cleanup;
+    }
+
+  msg->data = tile_list;
+  return;
+
+ cleanup:
+  g_free (tile_list->tiles);
+  g_slice_free (GPTileList, tile_list);
+  msg->data = NULL;
+}
+
+static void
+_gp_tile_list_req_write (GIOChannel      *channel,
+                         GimpWireMessage *msg,
+                         gpointer         user_data)
+{
+  GPTileList *tile_list = msg->data;
+  gint        i;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_list->n_tiles, 1, user_data))
+    return;
+
+  for (i = 0; i < tile_list->n_tiles; i++)
+    {
+      GPTileReq *tile_req = &tile_list->tiles[i];
+
+      if (! _gimp_wire_write_int32 (channel,
+                                    (const guint32 *) &tile_req->drawable_ID, 1,
+                                    user_data))
+        return;
+      if (! _gimp_wire_write_int32 (channel,
+                                    &tile_req->tile_num, 1, user_data))
+        return;
+      if (! _gimp_wire_write_int32 (channel,
+                                    &tile_req->shadow, 1, user_data))
+        return;
+    }
+}
+
+static void
+_gp_tile_list_req_destroy (GimpWireMessage *msg)
+{
+  GPTileList *tile_list = msg->data;
+
+  if (tile_list)
+    {
+      g_free (tile_list->tiles);
+      g_slice_free (GPTileList, tile_list);
+    }
+}
+
+/*  tile_list_data  */
+
+static void
+_gp_tile_list_data_read (GIOChannel      *channel,
+                         GimpWireMessage *msg,
+                         gpointer         user_data)
+{
+  GPTileDataList *tile_list = g_slice_new0 (GPTileDataList);
+  gint            i;
+
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_list->n_tiles, 1, user_data))
+    goto cleanup;
+
+  if (tile_list->n_tiles > GP_TILE_LIST_SIZE)
+    goto cleanup;
+
+  tile_list->tiles = g_new0 (GPTileData, tile_list->n_tiles);
+
+  for (i = 0; i < tile_list->n_tiles; i++)
+    {
+      GPTileData *tile_data = &tile_list->tiles[i];
+      guint       length;
+
+      if (! _gimp_wire_read_int32 (channel,
+                                   (guint32 *) &tile_data->drawable_ID, 1,
+                                   user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   &tile_data->tile_num, 1, user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   &tile_data->shadow, 1, user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   &tile_data->bpp, 1, user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   &tile_data->width, 1, user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   &tile_data->height, 1, user_data))
+        goto cleanup;
+
+      /*  the data of a tile list always goes through the pipe  */
+      length = tile_data->width * tile_data->height * tile_data->bpp;
+
+      tile_data->data = g_new (guchar, length);
+
+      if (! _gimp_wire_read_int8 (channel,
+                                  (guint8 *) tile_data->data, length,
+                                  user_data))
+        goto cleanup;
+    }
+
+  msg->data = tile_list;
+  return;
+
+ cleanup:
+  if (tile_list->tiles)
+    {
+      for (i = 0; i < tile_list->n_tiles; i++)
+        g_free (tile_list->tiles[i].data);
+
+      g_free (tile_list->tiles);
+    }
+
+  g_slice_free (GPTileDataList, tile_list);
+  msg->data = NULL;
+}
+
+static void
+_gp_tile_list_data_write (GIOChannel      *channel,
+                          GimpWireMessage *msg,
+                          gpointer         user_data)
+{
+  GPTileDataList *tile_list = msg->data;
+  gint            i;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_list->n_tiles, 1, user_data))
+    return;
+
+  for (i = 0; i < tile_list->n_tiles; i++)
+    {
+      GPTileData *tile_data = &tile_list->tiles[i];
+      guint       length;
+
+      if (! _gimp_wire_write_int32 (channel,
+                                    (const guint32 *) &tile_data->drawable_ID, 1,
+                                    user_data))
+        return;
+      if (! _gimp_wire_write_int32 (channel,
+                                    &tile_data->tile_num, 1, user_data))
+        return;
+      if (! _gimp_wire_write_int32 (channel,
+                                    &tile_data->shadow, 1, user_data))
+        return;
+      if (! _gimp_wire_write_int32 (channel,
+                                    &tile_data->bpp, 1, user_data))
+        return;
+      if (! _gimp_wire_write_int32 (channel,
+                                    &tile_data->width, 1, user_data))
+        return;
+      if (! _gimp_wire_write_int32 (channel,
+                                    &tile_data->height, 1, user_data))
+        return;
+
+      length = tile_data->width * tile_data->height * tile_data->bpp;
+
+      if (! _gimp_wire_write_int8 (channel,
+                                   (const guint8 *) tile_data->data, length,
+                                   user_data))
+        return;
+    }
+}
+
+static void
+_gp_tile_list_data_destroy (GimpWireMessage *msg)
+{
+  GPTileDataList *tile_list = msg->data;
+
+  if (tile_list)
+    {
+      gint i;
+
+      for (i = 0; i < tile_list->n_tiles; i++)
+        g_free (tile_list->tiles[i].data);
+
+      g_free (tile_list->tiles);
+      g_slice_free (GPTileDataList, tile_list);
+    }
+}
+
 /*  proc_run  */
 
 static void
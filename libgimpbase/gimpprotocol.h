@@ -26,7 +26,20 @@ G_BEGIN_DECLS
 
 /* Increment every time the protocol changes
  */
-#define GIMP_PROTOCOL_VERSION  0x0014
+#define GIMP_PROTOCOL_VERSION  0x0016
+
+
+/* The shared memory segment holds one tile for GP_TILE_DATA, followed
+ * by GP_TILE_N_WINDOWS windows of GP_TILE_WINDOW_SIZE tile slots, which
+ * GP_TILE_MAP_REQ maps tiles into. Each tile slot is large enough for
+ * a tile of any format (tile_width * tile_height * 16 bytes).
+ */
+#define GP_TILE_N_WINDOWS    4
+#define GP_TILE_WINDOW_SIZE  32
+
+/* The maximal number of tiles in a GP_TILE_LIST_REQ.
+ */
+#define GP_TILE_LIST_SIZE    GP_TILE_WINDOW_SIZE
 
 
 enum
@@ -43,7 +56,12 @@ enum
   GP_PROC_INSTALL,
   GP_PROC_UNINSTALL,
   GP_EXTENSION_ACK,
-  GP_HAS_INIT
+  GP_HAS_INIT,
+  GP_TILE_MAP_REQ,
+  GP_TILE_MAP_DATA,
+  GP_TILE_COMMIT,
+  GP_TILE_LIST_REQ,
+  GP_TILE_LIST_DATA
 };
 
 
@@ -51,6 +69,10 @@ typedef struct _GPConfig        GPConfig;
 typedef struct _GPTileReq       GPTileReq;
 typedef struct _GPTileAck       GPTileAck;
 typedef struct _GPTileData      GPTileData;
+typedef struct _GPTileMapInfo   GPTileMapInfo;
+typedef struct _GPTileMap       GPTileMap;
+typedef struct _GPTileList      GPTileList;
+typedef struct _GPTileDataList  GPTileDataList;
 typedef struct _GPParam         GPParam;
 typedef struct _GPParamDef      GPParamDef;
 typedef struct _GPProcRun       GPProcRun;
@@ -103,6 +125,33 @@ struct _GPTileData
   guchar  *data;
 };
 
+struct _GPTileMapInfo
+{
+  gint32   drawable_ID;
+  guint32  tile_num;
+  guint32  shadow;
+  guint32  slot;
+};
+
+struct _GPTileMap
+{
+  guint32        offset;
+  guint32        n_tiles;
+  GPTileMapInfo *tiles;
+};
+
+struct _GPTileList
+{
+  guint32    n_tiles;
+  GPTileReq *tiles;
+};
+
+struct _GPTileDataList
+{
+  guint32     n_tiles;
+  GPTileData *tiles;
+};
+
 struct _GPParam
 {
   guint32 type;
@@ -202,6 +251,21 @@ gboolean  gp_tile_ack_write         (GIOChannel      *channel,
 gboolean  gp_tile_data_write        (GIOChannel      *channel,
                                      GPTileData      *tile_data,
                                      gpointer         user_data);
+gboolean  gp_tile_map_req_write     (GIOChannel      *channel,
+                                     GPTileMap       *tile_map,
+                                     gpointer         user_data);
+gboolean  gp_tile_map_data_write    (GIOChannel      *channel,
+                                     GPTileMap       *tile_map,
+                                     gpointer         user_data);
+gboolean  gp_tile_commit_write      (GIOChannel      *channel,
+                                     GPTileMap       *tile_map,
+                                     gpointer         user_data);
+gboolean  gp_tile_list_req_write    (GIOChannel      *channel,
+                                     GPTileList      *tile_list,
+                                     gpointer         user_data);
+gboolean  gp_tile_list_data_write   (GIOChannel      *channel,
+                                     GPTileDataList  *tile_list,
+                                     gpointer         user_data);
 gboolean  gp_proc_run_write         (GIOChannel      *channel,
                                      GPProcRun       *proc_run,
                                      gpointer         user_data);
@@ -31,6 +31,10 @@ cpu_accel_print_results (void)
               (support & GIMP_CPU_ACCEL_X86_SSE2)    ? "yes" : "no");
   g_printerr ("  sse3    : %s\n",
               (support & GIMP_CPU_ACCEL_X86_SSE3)    ? "yes" : "no");
+  g_printerr ("  avx     : %s\n",
+              (support & GIMP_CPU_ACCEL_X86_AVX)     ? "yes" : "no");
+  g_printerr ("  avx2    : %s\n",
+              (support & GIMP_CPU_ACCEL_X86_AVX2)    ? "yes" : "no");
 #endif
 #ifdef ARCH_PPC
   g_printerr ("  altivec : %s\n",
@@ -63,7 +63,8 @@ static gint           gimp_thumb_size       (GimpThumbSize  size);
 static gchar        * gimp_thumb_png_lookup (const gchar   *name,
                                              const gchar   *basedir,
                                              GimpThumbSize *size) G_GNUC_MALLOC;
-static const gchar  * gimp_thumb_png_name   (const gchar   *uri);
+static const gchar  * gimp_thumb_png_name   (const gchar   *uri,
+                                             gchar          name[40]);
 static void           gimp_thumb_exit       (void);
 
 
@@ -369,6 +370,8 @@ gchar *
 gimp_thumb_name_from_uri (const gchar   *uri,
                           GimpThumbSize  size)
 {
+  gchar name[40];
+
   g_return_val_if_fail (gimp_thumb_initialized, NULL);
   g_return_val_if_fail (uri != NULL, NULL);
 
@@ -378,7 +381,7 @@ gimp_thumb_name_from_uri (const gchar   *uri,
   size = gimp_thumb_size (size);
 
   return g_build_filename (thumb_subdirs[size],
-                           gimp_thumb_png_name (uri),
+                           gimp_thumb_png_name (uri, name),
                            NULL);
 }
 
@@ -401,6 +404,7 @@ gchar *
 gimp_thumb_name_from_uri_local (const gchar   *uri,
                                 GimpThumbSize  size)
 {
+  gchar  name[40];
   gchar *filename;
   gchar *result = NULL;
 
@@ -424,7 +428,7 @@ gimp_thumb_name_from_uri_local (const gchar   *uri,
 
           result = g_build_filename (dirname,
                                      ".thumblocal", thumb_sizenames[i],
-                                     gimp_thumb_png_name (uri),
+                                     gimp_thumb_png_name (uri, name),
                                      NULL);
 
           g_free (dirname);
@@ -461,6 +465,7 @@ gchar *
 gimp_thumb_find_thumb (const gchar   *uri,
                        GimpThumbSize *size)
 {
+  gchar  name[40];
   gchar *result;
 
   g_return_val_if_fail (gimp_thumb_initialized, NULL);
@@ -468,7 +473,7 @@ gimp_thumb_find_thumb (const gchar   *uri,
   g_return_val_if_fail (size != NULL, NULL);
   g_return_val_if_fail (*size > GIMP_THUMB_SIZE_FAIL, NULL);
 
-  result = gimp_thumb_png_lookup (gimp_thumb_png_name (uri), NULL, size);
+  result = gimp_thumb_png_lookup (gimp_thumb_png_name (uri, name), NULL, size);
 
   if (! result)
     {
@@ -482,7 +487,8 @@ gimp_thumb_find_thumb (const gchar   *uri,
             {
               gchar *dirname = g_path_get_dirname (filename);
 
-              result = gimp_thumb_png_lookup (gimp_thumb_png_name (baseuri + 1),
+              result = gimp_thumb_png_lookup (gimp_thumb_png_name (baseuri + 1,
+                                                                   name),
                                               dirname, size);
 
               g_free (dirname);
@@ -791,11 +797,13 @@ gimp_thumb_png_lookup (const gchar   *name,
   return thumb_name;
 }
 
+/*  writes into a caller provided buffer, so that thumbnails can be
+ *  looked up from more than one thread
+ */
 static const gchar *
-gimp_thumb_png_name (const gchar *uri)
+gimp_thumb_png_name (const gchar *uri,
+                     gchar        name[40])
 {
-  static gchar name[40];
-
   GChecksum *checksum;
   guchar     digest[16];
   gsize      len = sizeof (digest);
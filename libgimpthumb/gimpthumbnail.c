@@ -516,6 +516,69 @@ gimp_thumbnail_set_from_thumb (GimpThumbnail  *thumbnail,
   return TRUE;
 }
 
+/**
+ * gimp_thumbnail_copy_info:
+ * @thumbnail: a #GimpThumbnail object
+ * @src:       the #GimpThumbnail to copy from
+ *
+ * Copies the location of the image file and all information about
+ * the image and its thumbnail from @src to @thumbnail.
+ *
+ * #GimpThumbnail objects must not be shared between threads. This
+ * function allows one to check or load a thumbnail using a private
+ * copy and to hand the results back to the thread that owns
+ * @thumbnail.
+ *
+ * Since: GIMP 2.10
+ **/
+void
+gimp_thumbnail_copy_info (GimpThumbnail *thumbnail,
+                          GimpThumbnail *src)
+{
+  g_return_if_fail (GIMP_IS_THUMBNAIL (thumbnail));
+  g_return_if_fail (GIMP_IS_THUMBNAIL (src));
+
+  GIMP_THUMB_DEBUG_CALL (thumbnail);
+
+  if (thumbnail == src)
+    return;
+
+  g_object_freeze_notify (G_OBJECT (thumbnail));
+
+  if (g_strcmp0 (thumbnail->image_uri, src->image_uri))
+    {
+      g_free (thumbnail->image_uri);
+      thumbnail->image_uri = g_strdup (src->image_uri);
+
+      g_object_notify (G_OBJECT (thumbnail), "image-uri");
+    }
+
+  g_free (thumbnail->image_filename);
+  thumbnail->image_filename = g_strdup (src->image_filename);
+
+  g_free (thumbnail->thumb_filename);
+  thumbnail->thumb_filename = g_strdup (src->thumb_filename);
+
+  thumbnail->image_not_found_errno = src->image_not_found_errno;
+  thumbnail->thumb_size            = src->thumb_size;
+  thumbnail->thumb_filesize        = src->thumb_filesize;
+  thumbnail->thumb_mtime           = src->thumb_mtime;
+
+  g_object_set (thumbnail,
+                "image-state",      src->image_state,
+                "image-filesize",   src->image_filesize,
+                "image-mtime",      src->image_mtime,
+                "image-mimetype",   src->image_mimetype,
+                "image-width",      src->image_width,
+                "image-height",     src->image_height,
+                "image-type",       src->image_type,
+                "image-num-layers", src->image_num_layers,
+                "thumb-state",      src->thumb_state,
+                NULL);
+
+  g_object_thaw_notify (G_OBJECT (thumbnail));
+}
+
 /**
  * gimp_thumbnail_peek_image:
  * @thumbnail: a #GimpThumbnail object
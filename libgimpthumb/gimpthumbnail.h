@@ -99,6 +99,8 @@ gboolean         gimp_thumbnail_set_filename     (GimpThumbnail  *thumbnail,
 gboolean         gimp_thumbnail_set_from_thumb   (GimpThumbnail  *thumbnail,
                                                   const gchar    *filename,
                                                   GError        **error);
+void             gimp_thumbnail_copy_info        (GimpThumbnail  *thumbnail,
+                                                  GimpThumbnail  *src);
 
 GimpThumbState   gimp_thumbnail_peek_image       (GimpThumbnail  *thumbnail);
 GimpThumbState   gimp_thumbnail_peek_thumb       (GimpThumbnail  *thumbnail,
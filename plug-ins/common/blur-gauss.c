@@ -17,8 +17,14 @@
 
 #include "config.h"
 
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(ARCH_X86) && defined(USE_SSE2) && defined(__SSE2__)
+#define HAVE_ACCEL 1
+#include <emmintrin.h>
+#endif
+
 #include <libgimp/gimp.h>
 #include <libgimp/gimpui.h>
 
@@ -32,6 +38,8 @@
 #define PLUG_IN_BINARY  "blur-gauss"
 #define PLUG_IN_ROLE    "gimp-blur-gauss"
 
+#define GAUSS_MAX_THREADS 64
+
 typedef enum
 {
   BLUR_IIR,
@@ -45,6 +53,42 @@ typedef struct
   BlurMethod  method;
 } BlurValues;
 
+typedef struct
+{
+  gint    offset;  /*  first column or row of the strip  */
+  gint    size;    /*  number of columns or rows         */
+  guchar *buf;
+} BlurStrip;
+
+typedef struct
+{
+  BlurMethod   method;
+  gboolean     vertical;
+  gint         bytes;
+  gboolean     has_alpha;
+  gboolean     use_sse2;
+
+  /*  the blurred area  */
+  gint         x;
+  gint         y;
+  gint         width;
+  gint         height;
+
+  /*  BLUR_IIR  */
+  gfloat       n_p[5], n_m[5];
+  gfloat       d_p[5], d_m[5];
+  gfloat       bd_p[5], bd_m[5];
+
+  /*  BLUR_RLE  */
+  gint        *curve;
+  gint        *sum;
+  gint         length;
+  gint         total;
+
+  /*  the strips the threads are done with  */
+  GAsyncQueue *done;
+} BlurPass;
+
 
 /* Declare local functions.
  */
@@ -80,8 +124,8 @@ static void      find_iir_constants    (gdouble  n_p[],
                                         gdouble  bd_m[],
                                         gdouble  std_dev);
 
-static void      transfer_pixels   (const gdouble *src1,
-                                    const gdouble *src2,
+static void      transfer_pixels   (const gfloat  *src1,
+                                    const gfloat  *src2,
                                     guchar        *dest,
                                     gint           bytes,
                                     gint           width);
@@ -870,335 +914,546 @@ do_full_lre (const gint *src,
     }
 }
 
+/*
+ * The blur passes work on strips of whole tiles: columns of tiles for
+ * the vertical pass and rows of tiles for the horizontal pass.  The
+ * pixel region calls talk to the core, so only the main thread reads
+ * and writes strips; a pool of threads blurs them in between.
+ */
+
+static gint
+gauss_get_n_threads (void)
+{
+  static gint n_threads = 0;
+
+  if (! n_threads)
+    {
+      gchar *value = gimp_gimprc_query ("num-processors");
+
+      n_threads = value ? atoi (value) : 1;
+      n_threads = CLAMP (n_threads, 1, GAUSS_MAX_THREADS);
+
+      g_free (value);
+    }
+
+  return n_threads;
+}
+
+/*  the area of a strip, relative to the blurred area  */
 static void
-gauss_iir (GimpDrawable *drawable,
-           gdouble       horz,
-           gdouble       vert,
-           BlurMethod    method,
-           guchar       *preview_buffer,
-           gint          x1,
-           gint          y1,
-           gint          width,
-           gint          height)
+gauss_strip_get_area (const BlurPass  *pass,
+                      const BlurStrip *strip,
+                      gint            *x,
+                      gint            *y,
+                      gint            *width,
+                      gint            *height)
 {
-  GimpPixelRgn  src_rgn, dest_rgn;
-  gint          bytes;
-  gint          has_alpha;
-  guchar       *dest;
-  guchar       *src,  *sp_p, *sp_m;
-  gdouble       n_p[5], n_m[5];
-  gdouble       d_p[5], d_m[5];
-  gdouble       bd_p[5], bd_m[5];
-  gdouble      *val_p = NULL;
-  gdouble      *val_m = NULL;
-  gdouble      *vp, *vm;
-  gint          i, j;
-  gint          row, col, b;
-  gint          terms;
-  gdouble       progress, max_progress;
-  gint          initial_p[4];
-  gint          initial_m[4];
-  gdouble       std_dev;
-  gboolean      direct;
-  gint          progress_step;
+  if (pass->vertical)
+    {
+      *x      = strip->offset;
+      *y      = 0;
+      *width  = strip->size;
+      *height = pass->height;
+    }
+  else
+    {
+      *x      = 0;
+      *y      = strip->offset;
+      *width  = pass->width;
+      *height = strip->size;
+    }
+}
 
-  direct = (preview_buffer == NULL);
+static void
+gauss_strip_read (const BlurPass *pass,
+                  BlurStrip      *strip,
+                  GimpPixelRgn   *src_rgn,
+                  const guchar   *src_buffer)
+{
+  gint x, y, width, height;
+  gint row;
 
-  bytes = drawable->bpp;
-  has_alpha = gimp_drawable_has_alpha (drawable->drawable_id);
+  gauss_strip_get_area (pass, strip, &x, &y, &width, &height);
 
-  val_p = g_new (gdouble, MAX (width, height) * bytes);
-  val_m = g_new (gdouble, MAX (width, height) * bytes);
+  if (src_rgn)
+    {
+      gimp_pixel_rgn_get_rect (src_rgn, strip->buf,
+                               pass->x + x, pass->y + y, width, height);
+    }
+  else
+    {
+      for (row = 0; row < height; row++)
+        memcpy (strip->buf + row * width * pass->bytes,
+                src_buffer + ((y + row) * pass->width + x) * pass->bytes,
+                width * pass->bytes);
+    }
+}
 
-  src =  g_new (guchar, MAX (width, height) * bytes);
-  dest = g_new (guchar, MAX (width, height) * bytes);
+static void
+gauss_strip_write (const BlurPass  *pass,
+                   const BlurStrip *strip,
+                   GimpPixelRgn    *dest_rgn,
+                   guchar          *dest_buffer)
+{
+  gint x, y, width, height;
+  gint row;
 
-  gimp_pixel_rgn_init (&src_rgn,
-                       drawable, 0, 0, drawable->width, drawable->height,
-                       FALSE, FALSE);
-  if (direct)
+  gauss_strip_get_area (pass, strip, &x, &y, &width, &height);
+
+  if (dest_rgn)
     {
-      gimp_pixel_rgn_init (&dest_rgn,
-                           drawable, 0, 0, drawable->width, drawable->height,
-                           TRUE, TRUE);
+      gimp_pixel_rgn_set_rect (dest_rgn, strip->buf,
+                               pass->x + x, pass->y + y, width, height);
     }
+  else
+    {
+      for (row = 0; row < height; row++)
+        memcpy (dest_buffer + ((y + row) * pass->width + x) * pass->bytes,
+                strip->buf + row * width * pass->bytes,
+                width * pass->bytes);
+    }
+}
 
+#ifdef HAVE_ACCEL
 
-  progress = 0.0;
-  max_progress  = (horz <= 0.0) ? 0 : width * height * horz;
-  max_progress += (vert <= 0.0) ? 0 : width * height * vert;
+/*  one step of the recursion for four lanes at a time  */
+static gint
+iir_row_sse2 (const gfloat *s,
+              gfloat       *v,
+              gint          lanes,
+              gint          stride,
+              const gfloat *n_c,
+              const gfloat *d_c)
+{
+  const __m128 n0 = _mm_set1_ps (n_c[0]);
+  const __m128 n1 = _mm_set1_ps (n_c[1]);
+  const __m128 n2 = _mm_set1_ps (n_c[2]);
+  const __m128 n3 = _mm_set1_ps (n_c[3]);
+  const __m128 n4 = _mm_set1_ps (n_c[4]);
+  const __m128 d1 = _mm_set1_ps (d_c[1]);
+  const __m128 d2 = _mm_set1_ps (d_c[2]);
+  const __m128 d3 = _mm_set1_ps (d_c[3]);
+  const __m128 d4 = _mm_set1_ps (d_c[4]);
+  gint         l;
+
+  for (l = 0; l + 4 <= lanes; l += 4)
+    {
+      __m128 val;
+
+      val = _mm_mul_ps (n0, _mm_loadu_ps (s + l));
+      val = _mm_add_ps (val, _mm_mul_ps (n1, _mm_loadu_ps (s + l - stride)));
+      val = _mm_add_ps (val, _mm_mul_ps (n2, _mm_loadu_ps (s + l - 2 * stride)));
+      val = _mm_add_ps (val, _mm_mul_ps (n3, _mm_loadu_ps (s + l - 3 * stride)));
+      val = _mm_add_ps (val, _mm_mul_ps (n4, _mm_loadu_ps (s + l - 4 * stride)));
+      val = _mm_sub_ps (val, _mm_mul_ps (d1, _mm_loadu_ps (v + l - stride)));
+      val = _mm_sub_ps (val, _mm_mul_ps (d2, _mm_loadu_ps (v + l - 2 * stride)));
+      val = _mm_sub_ps (val, _mm_mul_ps (d3, _mm_loadu_ps (v + l - 3 * stride)));
+      val = _mm_sub_ps (val, _mm_mul_ps (d4, _mm_loadu_ps (v + l - 4 * stride)));
+
+      _mm_storeu_ps (v + l, val);
+    }
 
+  return l;
+}
 
-  /*  First the vertical pass  */
-  if (vert > 0.0)
+#endif /* HAVE_ACCEL */
+
+/*
+ * iir_recurse (sp, vp, n, lanes, stride, n_c, d_c, bd_c, use_sse2);
+ *
+ * Run the 4th order recursion over 'n' steps of 'lanes' independent
+ * values.  Step k of the input starts at 'sp + k * stride', so a
+ * negative 'stride' runs the anti-causal direction.  The lanes of a
+ * step are contiguous, which is what makes them vectorizable.
+ */
+static void
+iir_recurse (const gfloat *sp,
+             gfloat       *vp,
+             gint          n,
+             gint          lanes,
+             gint          stride,
+             const gfloat *n_c,
+             const gfloat *d_c,
+             const gfloat *bd_c,
+             gboolean      use_sse2)
+{
+  gint k, l, i;
+
+  /*  the first steps repeat the edge value outside the area  */
+  for (k = 0; k < MIN (n, 4); k++)
     {
-      vert = fabs (vert) + 1.0;
-      std_dev = sqrt (-(vert * vert) / (2 * log (1.0 / 255.0)));
+      const gfloat *s = sp + k * stride;
+      gfloat       *v = vp + k * stride;
 
-      /* We do not want too many progress updates because they
-       * can slow down the processing significantly for very
-       * large images
-       */
-      progress_step = width / 16;
+      for (l = 0; l < lanes; l++)
+        {
+          gfloat val = n_c[0] * s[l];
 
-      if (progress_step < 5)
-        progress_step = 5;
+          for (i = 1; i <= k; i++)
+            val += n_c[i] * s[l - i * stride] - d_c[i] * v[l - i * stride];
 
-      /*  derive the constants for calculating the gaussian
-       *  from the std dev
-       */
+          for (; i <= 4; i++)
+            val += (n_c[i] - bd_c[i]) * sp[l];
 
-      find_iir_constants (n_p, n_m, d_p, d_m, bd_p, bd_m, std_dev);
+          v[l] = val;
+        }
+    }
+
+  for (; k < n; k++)
+    {
+      const gfloat *s = sp + k * stride;
+      gfloat       *v = vp + k * stride;
+
+      l = 0;
+
+#ifdef HAVE_ACCEL
+      if (use_sse2)
+        l = iir_row_sse2 (s, v, lanes, stride, n_c, d_c);
+#endif
 
-      for (col = 0; col < width; col++)
+      for (; l < lanes; l++)
         {
-          memset (val_p, 0, height * bytes * sizeof (gdouble));
-          memset (val_m, 0, height * bytes * sizeof (gdouble));
+          v[l] = (n_c[0] * s[l] +
+                  n_c[1] * s[l - stride] +
+                  n_c[2] * s[l - 2 * stride] +
+                  n_c[3] * s[l - 3 * stride] +
+                  n_c[4] * s[l - 4 * stride] -
+                  d_c[1] * v[l - stride] -
+                  d_c[2] * v[l - 2 * stride] -
+                  d_c[3] * v[l - 3 * stride] -
+                  d_c[4] * v[l - 4 * stride]);
+        }
+    }
+}
 
-          gimp_pixel_rgn_get_col (&src_rgn, src, col + x1, y1, height);
+static void
+gauss_strip_iir (const BlurPass *pass,
+                 guchar         *buf,
+                 gint            width,
+                 gint            height)
+{
+  const gint  bytes = pass->bytes;
+  const gint  total = width * height * bytes;
+  gfloat     *src   = g_new (gfloat, total);
+  gfloat     *val_p = g_new (gfloat, total);
+  gfloat     *val_m = g_new (gfloat, total);
+  gint        n, lanes;
+  gint        x, y, b;
+
+  if (pass->vertical)
+    {
+      /*  the rows of the strip are the steps  */
+      n     = height;
+      lanes = width * bytes;
 
-          if (has_alpha)
-            multiply_alpha (src, height, bytes);
+      for (b = 0; b < total; b++)
+        src[b] = buf[b];
+    }
+  else
+    {
+      /*  transpose, so the columns of the strip are the steps  */
+      n     = width;
+      lanes = height * bytes;
 
-          sp_p = src;
-          sp_m = src + (height - 1) * bytes;
-          vp = val_p;
-          vm = val_m + (height - 1) * bytes;
+      for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+          for (b = 0; b < bytes; b++)
+            src[(x * height + y) * bytes + b] = buf[(y * width + x) * bytes + b];
+    }
 
-          /*  Set up the first vals  */
-          for (i = 0; i < bytes; i++)
-            {
-              initial_p[i] = sp_p[i];
-              initial_m[i] = sp_m[i];
-            }
+  iir_recurse (src, val_p, n, lanes, lanes,
+               pass->n_p, pass->d_p, pass->bd_p, pass->use_sse2);
+  iir_recurse (src + (n - 1) * lanes, val_m + (n - 1) * lanes, n, lanes, -lanes,
+               pass->n_m, pass->d_m, pass->bd_m, pass->use_sse2);
 
-          for (row = 0; row < height; row++)
-            {
-              gdouble *vpptr, *vmptr;
-              terms = (row < 4) ? row : 4;
-
-              for (b = 0; b < bytes; b++)
-                {
-                  vpptr = vp + b; vmptr = vm + b;
-                  for (i = 0; i <= terms; i++)
-                    {
-                      *vpptr += n_p[i] * sp_p[(-i * bytes) + b] - d_p[i] * vp[(-i * bytes) + b];
-                      *vmptr += n_m[i] * sp_m[(i * bytes) + b] - d_m[i] * vm[(i * bytes) + b];
-                    }
-                  for (j = i; j <= 4; j++)
-                    {
-                      *vpptr += (n_p[j] - bd_p[j]) * initial_p[b];
-                      *vmptr += (n_m[j] - bd_m[j]) * initial_m[b];
-                    }
-                }
-
-              sp_p += bytes;
-              sp_m -= bytes;
-              vp += bytes;
-              vm -= bytes;
-            }
+  if (pass->vertical)
+    {
+      transfer_pixels (val_p, val_m, buf, bytes, width * height);
+    }
+  else
+    {
+      for (x = 0; x < width; x++)
+        for (y = 0; y < height; y++)
+          transfer_pixels (val_p + (x * height + y) * bytes,
+                           val_m + (x * height + y) * bytes,
+                           buf + (y * width + x) * bytes,
+                           bytes, 1);
+    }
 
-          transfer_pixels (val_p, val_m, dest, bytes, height);
+  g_free (val_m);
+  g_free (val_p);
+  g_free (src);
+}
 
+/*  the pixel at (x, y) of 'src' becomes the pixel at (y, x) of 'dest'  */
+static void
+transpose_pixels (const guchar *src,
+                  guchar       *dest,
+                  gint          width,
+                  gint          height,
+                  gint          bytes)
+{
+  gint x, y, b;
 
-          if (has_alpha)
-            separate_alpha (dest, height, bytes);
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      for (b = 0; b < bytes; b++)
+        dest[(x * height + y) * bytes + b] = src[(y * width + x) * bytes + b];
+}
 
-          if (direct)
-            {
-              gimp_pixel_rgn_set_col(&dest_rgn, dest, col + x1, y1, height);
+/*  blur the rows of 'buf' in place  */
+static void
+gauss_rows_rle (const BlurPass *pass,
+                guchar         *buf,
+                gint            width,
+                gint            height)
+{
+  const gint  bytes  = pass->bytes;
+  const gint  length = pass->length;
+  gint       *rle;
+  gint       *pix;
+  gint        row, b;
+
+  rle = g_new (gint, width + 2 * length);
+  rle += length; /* rle[] extends from -length to width+length-1 */
 
-              progress += height * vert;
+  pix = g_new (gint, width + 2 * length);
+  pix += length; /* pix[] extends from -length to width+length-1 */
 
-              if ((col % progress_step) == 0)
-                gimp_progress_update (progress / max_progress);
+  for (row = 0; row < height; row++, buf += width * bytes)
+    {
+      for (b = 0; b < bytes; b++)
+        {
+          /*  the row is copied to pix[], so it can be blurred in place  */
+          gint same = run_length_encode (buf + b, rle, pix, bytes,
+                                         width, length, TRUE);
+
+          if (same > (3 * width) / 4)
+            {
+              /* encoded_rle is only fastest if there are a lot of
+               * repeating pixels
+               */
+              do_encoded_lre (rle, pix, buf + b, width, length, bytes,
+                              pass->curve, pass->total, pass->sum);
             }
           else
             {
-              for (row = 0; row < height; row++)
-                memcpy (preview_buffer + (row * width + col) * bytes,
-                        dest + row * bytes,
-                        bytes);
+              /* else a full but more simple algorithm is better */
+              do_full_lre (pix, buf + b, width, length, bytes,
+                           pass->curve, pass->total);
             }
         }
+    }
 
-      /*  prepare for the horizontal pass  */
-      gimp_pixel_rgn_init (&src_rgn,
-                           drawable,
-                           0, 0,
-                           drawable->width, drawable->height,
-                           FALSE, TRUE);
+  g_free (rle - length);
+  g_free (pix - length);
+}
+
+static void
+gauss_strip_rle (const BlurPass *pass,
+                 guchar         *buf,
+                 gint            width,
+                 gint            height)
+{
+  if (pass->vertical)
+    {
+      /*  blur the columns as rows, walking down a column of a wide
+       *  strip touches a new cache line for every pixel
+       */
+      guchar *tmp = g_new (guchar, width * height * pass->bytes);
+
+      transpose_pixels (buf, tmp, width, height, pass->bytes);
+      gauss_rows_rle (pass, tmp, height, width);
+      transpose_pixels (tmp, buf, height, width, pass->bytes);
+
+      g_free (tmp);
     }
-  else if (!direct)
+  else
     {
-      gimp_pixel_rgn_get_rect (&src_rgn,
-                               preview_buffer,
-                               x1, y1,
-                               width, height);
+      gauss_rows_rle (pass, buf, width, height);
     }
+}
 
-  /*  Now the horizontal pass  */
-  if (horz > 0.0)
-    {
+/*  runs in the thread pool, must not call into libgimp  */
+static void
+gauss_strip_blur (BlurStrip *strip,
+                  BlurPass  *pass)
+{
+  gint x, y, width, height;
 
-      /* We do not want too many progress updates because they
-       * can slow down the processing significantly for very
-       * large images
-       */
-      progress_step = height / 16;
+  gauss_strip_get_area (pass, strip, &x, &y, &width, &height);
 
-      if (progress_step < 5)
-        progress_step = 5;
+  if (pass->has_alpha)
+    multiply_alpha (strip->buf, width * height, pass->bytes);
 
-      horz = fabs (horz) + 1.0;
+  if (pass->method == BLUR_IIR)
+    gauss_strip_iir (pass, strip->buf, width, height);
+  else
+    gauss_strip_rle (pass, strip->buf, width, height);
 
-      if (horz != vert)
-        {
-          std_dev = sqrt (-(horz * horz) / (2 * log (1.0 / 255.0)));
+  if (pass->has_alpha)
+    separate_alpha (strip->buf, width * height, pass->bytes);
 
-          /*  derive the constants for calculating the gaussian
-           *  from the std dev
-           */
-          find_iir_constants (n_p, n_m, d_p, d_m, bd_p, bd_m, std_dev);
+  g_async_queue_push (pass->done, strip);
+}
 
-        }
+static void
+gauss_pass_run (BlurPass     *pass,
+                GimpPixelRgn *src_rgn,
+                GimpPixelRgn *dest_rgn,
+                guchar       *buffer,
+                gdouble       radius,
+                gdouble      *progress,
+                gdouble       max_progress)
+{
+  GThreadPool *pool;
+  gint         n_threads = gauss_get_n_threads ();
+  gint         tile_size;
+  gint         start, end;
+  gint         pos;
+  gint         pending   = 0;
+
+  if (pass->vertical)
+    {
+      tile_size = gimp_tile_width ();
+      start     = pass->x;
+      end       = pass->x + pass->width;
+    }
+  else
+    {
+      tile_size = gimp_tile_height ();
+      start     = pass->y;
+      end       = pass->y + pass->height;
+    }
 
+  pass->done = g_async_queue_new ();
 
-      for (row = 0; row < height; row++)
-        {
+  pool = g_thread_pool_new ((GFunc) gauss_strip_blur, pass,
+                            n_threads, FALSE, NULL);
 
-          memset (val_p, 0, width * bytes * sizeof (gdouble));
-          memset (val_m, 0, width * bytes * sizeof (gdouble));
+  pos = start;
 
-          if (direct)
-            {
-              gimp_pixel_rgn_get_row (&src_rgn, src, x1, row + y1, width);
-            }
-          else
-            {
-              memcpy (src,
-                      preview_buffer + row * width * bytes,
-                      width * bytes);
-            }
+  while (pos < end || pending > 0)
+    {
+      BlurStrip *strip;
+      gint       x, y, width, height;
 
+      /*  keep a few strips queued, but don't read the whole drawable  */
+      if (pos < end && pending < 2 * n_threads)
+        {
+          strip = g_slice_new (BlurStrip);
 
-          if (has_alpha)
-            multiply_alpha (src, width, bytes);
+          /*  align the strips to the tile grid  */
+          strip->offset = pos - start;
+          strip->size   = MIN ((pos / tile_size + 1) * tile_size, end) - pos;
 
+          gauss_strip_get_area (pass, strip, &x, &y, &width, &height);
 
-          sp_p = src;
-          sp_m = src + (width - 1) * bytes;
-          vp = val_p;
-          vm = val_m + (width - 1) * bytes;
+          strip->buf = g_new (guchar, width * height * pass->bytes);
 
-          /*  Set up the first vals  */
-          for (i = 0; i < bytes; i++)
-            {
-              initial_p[i] = sp_p[i];
-              initial_m[i] = sp_m[i];
-            }
+          gauss_strip_read (pass, strip, src_rgn, buffer);
 
-          for (col = 0; col < width; col++)
-            {
-              gdouble *vpptr, *vmptr;
-
-              terms = (col < 4) ? col : 4;
-
-              for (b = 0; b < bytes; b++)
-                {
-                  vpptr = vp + b; vmptr = vm + b;
-
-                  for (i = 0; i <= terms; i++)
-                    {
-                      *vpptr += n_p[i] * sp_p[(-i * bytes) + b] -
-                        d_p[i] * vp[(-i * bytes) + b];
-                      *vmptr += n_m[i] * sp_m[(i * bytes) + b] -
-                        d_m[i] * vm[(i * bytes) + b];
-                    }
-                  for (j = i; j <= 4; j++)
-                    {
-                      *vpptr += (n_p[j] - bd_p[j]) * initial_p[b];
-                      *vmptr += (n_m[j] - bd_m[j]) * initial_m[b];
-                    }
-                }
-
-              sp_p += bytes;
-              sp_m -= bytes;
-              vp += bytes;
-              vm -= bytes;
-            }
+          g_thread_pool_push (pool, strip, NULL);
 
-          transfer_pixels (val_p, val_m, dest, bytes, width);
+          pos += strip->size;
+          pending++;
 
-          if (has_alpha)
-            separate_alpha (dest, width, bytes);
+          continue;
+        }
 
-          if (direct)
-            {
-              gimp_pixel_rgn_set_row (&dest_rgn, dest, x1, row + y1, width);
+      strip = g_async_queue_pop (pass->done);
+      pending--;
 
-              progress += width * horz;
+      gauss_strip_write (pass, strip, dest_rgn, buffer);
 
-              if ((row % progress_step) == 0)
-                gimp_progress_update (progress / max_progress);
-            }
-          else
-            {
-              memcpy (preview_buffer + row * width * bytes,
-                      dest,
-                      width * bytes);
-            }
+      if (dest_rgn)
+        {
+          gauss_strip_get_area (pass, strip, &x, &y, &width, &height);
+
+          *progress += width * height * radius;
+
+          gimp_progress_update (*progress / max_progress);
         }
+
+      g_free (strip->buf);
+      g_slice_free (BlurStrip, strip);
     }
 
-  /*  free up buffers  */
+  g_thread_pool_free (pool, FALSE, TRUE);
+  g_async_queue_unref (pass->done);
+  pass->done = NULL;
+}
 
-  g_free (val_p);
-  g_free (val_m);
+static void
+gauss_pass_set_std_dev (BlurPass *pass,
+                        gdouble   std_dev)
+{
+  if (pass->method == BLUR_IIR)
+    {
+      gdouble n_p[5], n_m[5];
+      gdouble d_p[5], d_m[5];
+      gdouble bd_p[5], bd_m[5];
+      gint    i;
 
-  g_free (src);
-  g_free (dest);
-}
+      /*  derive the constants for calculating the gaussian
+       *  from the std dev
+       */
+      find_iir_constants (n_p, n_m, d_p, d_m, bd_p, bd_m, std_dev);
 
+      for (i = 0; i <= 4; i++)
+        {
+          pass->n_p[i]  = n_p[i];
+          pass->n_m[i]  = n_m[i];
+          pass->d_p[i]  = d_p[i];
+          pass->d_m[i]  = d_m[i];
+          pass->bd_p[i] = bd_p[i];
+          pass->bd_m[i] = bd_m[i];
+        }
+    }
+  else
+    {
+      if (pass->curve)
+        free_rle_curve (pass->curve, pass->length, pass->sum);
+
+      make_rle_curve (std_dev,
+                      &pass->curve, &pass->length, &pass->sum, &pass->total);
+    }
+}
 
 static void
-gauss_rle (GimpDrawable *drawable,
-           gdouble       horz,
-           gdouble       vert,
-           BlurMethod    method,
-           guchar       *preview_buffer,
-           gint          x1,
-           gint          y1,
-           gint          width,
-           gint          height)
+gauss_blur (GimpDrawable *drawable,
+            gdouble       horz,
+            gdouble       vert,
+            BlurMethod    method,
+            guchar       *preview_buffer,
+            gint          x1,
+            gint          y1,
+            gint          width,
+            gint          height)
 {
   GimpPixelRgn  src_rgn, dest_rgn;
-  gint          bytes;
-  gboolean      has_alpha;
-  guchar       *dest;
-  guchar       *src;
-  gint          row, col, b;
+  BlurPass      pass = { 0, };
   gdouble       progress, max_progress;
   gdouble       std_dev;
-  gint          total = 1;
-  gint         *curve = NULL;
-  gint         *sum   = NULL;
-  gint          length;
   gboolean      direct;
-  gint          progress_step;
 
   direct = (preview_buffer == NULL);
 
-  bytes = drawable->bpp;
-  has_alpha = gimp_drawable_has_alpha (drawable->drawable_id);
+  pass.method    = method;
+  pass.bytes     = drawable->bpp;
+  pass.has_alpha = gimp_drawable_has_alpha (drawable->drawable_id);
+  pass.x         = x1;
+  pass.y         = y1;
+  pass.width     = width;
+  pass.height    = height;
 
-  src  = g_new (guchar, MAX (width, height) * bytes);
-  dest = g_new (guchar, MAX (width, height) * bytes);
+#ifdef HAVE_ACCEL
+  pass.use_sse2  = (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_SSE2);
+#endif
 
   gimp_pixel_rgn_init (&src_rgn,
                        drawable, 0, 0, drawable->width, drawable->height,
                        FALSE, FALSE);
-
   if (direct)
     gimp_pixel_rgn_init (&dest_rgn,
                          drawable, 0, 0, drawable->width, drawable->height,
@@ -1208,88 +1463,20 @@ gauss_rle (GimpDrawable *drawable,
   max_progress  = (horz <= 0.0) ? 0 : width * height * horz;
   max_progress += (vert <= 0.0) ? 0 : width * height * vert;
 
-
   /*  First the vertical pass  */
   if (vert > 0.0)
     {
-      gint   * rle = NULL;
-      gint   * pix = NULL;
-
       vert = fabs (vert) + 1.0;
       std_dev = sqrt (-(vert * vert) / (2 * log (1.0 / 255.0)));
 
-      /* Insure that we do not have too many progress updates for
-       * images with a lot of rows or columns
-       */
-      progress_step = width / 16;
-
-      if (progress_step < 5)
-        progress_step = 5;
+      gauss_pass_set_std_dev (&pass, std_dev);
 
-      make_rle_curve (std_dev, &curve, &length, &sum, &total);
-
-      rle = g_new (gint, height + 2 * length);
-      rle += length; /* rle[] extends from -length to height+length-1 */
-
-      pix = g_new (gint, height + 2 * length);
-      pix += length; /* pix[] extends from -length to height+length-1 */
-
-      for (col = 0; col < width; col++)
-        {
+      pass.vertical = TRUE;
 
-          gimp_pixel_rgn_get_col (&src_rgn, src, col + x1, y1, height);
-
-          if (has_alpha)
-            multiply_alpha (src, height, bytes);
-
-          for (b = 0; b < bytes; b++)
-            {
-              gint same =  run_length_encode (src + b, rle, pix, bytes,
-                                              height, length, TRUE);
-
-              if (same > (3 * height) / 4)
-                {
-                  /* encoded_rle is only fastest if there are a lot of
-                   * repeating pixels
-                   */
-                  do_encoded_lre (rle, pix, dest + b, height, length, bytes,
-                                  curve, total, sum);
-                }
-              else
-                {
-                  /* else a full but more simple algorithm is better */
-                  do_full_lre (pix, dest + b, height, length, bytes,
-                               curve, total);
-                }
-            }
-
-          if (has_alpha)
-            separate_alpha (dest, height, bytes);
-
-          if (direct)
-            {
-              gimp_pixel_rgn_set_col (&dest_rgn, dest, col + x1, y1, height);
+      gauss_pass_run (&pass, &src_rgn, direct ? &dest_rgn : NULL,
+                      preview_buffer, vert, &progress, max_progress);
 
-              progress += height * vert;
-
-              if ((col % progress_step) == 0)
-                gimp_progress_update (progress / max_progress);
-            }
-          else
-            {
-              for (row = 0; row < height; row++)
-                memcpy (preview_buffer + (row * width + col) * bytes,
-                        dest + row * bytes,
-                        bytes);
-            }
-
-        }
-
-
-      g_free (rle - length);
-      g_free (pix - length);
-
-      /* prepare for the horizontal pass  */
+      /*  prepare for the horizontal pass  */
       gimp_pixel_rgn_init (&src_rgn,
                            drawable, 0, 0, drawable->width, drawable->height,
                            FALSE, TRUE);
@@ -1303,108 +1490,26 @@ gauss_rle (GimpDrawable *drawable,
   /*  Now the horizontal pass  */
   if (horz > 0.0)
     {
-      gint   * rle = NULL;
-      gint   * pix = NULL;
-
-      /* Insure that we do not have too many progress updates for
-       * images with a lot of rows or columns
-       */
-      progress_step = height / 16;
-
-      if (progress_step < 5) {
-        progress_step = 5;
-      }
-
       horz = fabs (horz) + 1.0;
 
-      /* euse the same curve if possible else recompute a new one */
+      /* reuse the same constants if possible else recompute them */
       if (horz != vert)
         {
-
           std_dev = sqrt (-(horz * horz) / (2 * log (1.0 / 255.0)));
 
-          if (curve != NULL) {
-            free_rle_curve(curve, length, sum);
-          }
-
-          make_rle_curve(std_dev, &curve, &length, &sum, &total);
-
+          gauss_pass_set_std_dev (&pass, std_dev);
         }
 
+      pass.vertical = FALSE;
 
-      rle = g_new (gint, width+2*length);
-      rle += length; /* so rle[] extends from -width to width+length-1 */
-
-      pix = g_new (gint, width+2*length);
-      pix += length; /* so pix[] extends from -width to width+length-1 */
-
-      for (row = 0; row < height; row++)
-        {
-          if (direct)
-            {
-              gimp_pixel_rgn_get_row (&src_rgn, src, x1, row + y1, width);
-            }
-          else
-            {
-              memcpy (src,
-                      preview_buffer + row * width * bytes,
-                      width * bytes);
-            }
-
-          if (has_alpha)
-            multiply_alpha (src, width, bytes);
-
-          for (b = 0; b < bytes; b++)
-            {
-              gint same = run_length_encode (src + b, rle, pix, bytes,
-                                             width, length, TRUE);
-
-              if (same > (3 * width) / 4)
-                {
-                  /* encoded_rle is only fastest if there are a lot of
-                   * repeating pixels
-                   */
-                  do_encoded_lre (rle, pix, dest + b, width, length, bytes,
-                                  curve, total, sum);
-                }
-              else
-                {
-                  /* else a full but more simple algorithm is better */
-                  do_full_lre (pix, dest + b, width, length, bytes,
-                               curve, total);
-                }
-            }
-
-
-          if (has_alpha)
-            separate_alpha (dest, width, bytes);
-
-          if (direct)
-            {
-              gimp_pixel_rgn_set_row (&dest_rgn, dest, x1, row + y1, width);
-
-              progress += width * horz;
-
-              if ((row % progress_step) == 0)
-                gimp_progress_update (progress / max_progress);
-            }
-          else
-            {
-              memcpy (preview_buffer + row * width * bytes,
-                      dest,
-                      width * bytes);
-            }
-        }
-
-      g_free (rle - length);
-      g_free (pix - length);
+      gauss_pass_run (&pass,
+                      direct ? &src_rgn  : NULL,
+                      direct ? &dest_rgn : NULL,
+                      preview_buffer, horz, &progress, max_progress);
     }
 
-  if (curve)
-    free_rle_curve (curve, length, sum);
-
-  g_free (src);
-  g_free (dest);
+  if (pass.curve)
+    free_rle_curve (pass.curve, pass.length, pass.sum);
 }
 
 
@@ -1461,12 +1566,8 @@ gauss (GimpDrawable *drawable,
     }
 
 
-  if (method == BLUR_IIR)
-    gauss_iir (drawable,
-               horz, vert, method, preview_buffer, x, y, width, height);
-  else
-    gauss_rle (drawable,
-               horz, vert, method, preview_buffer, x, y, width, height);
+  gauss_blur (drawable,
+              horz, vert, method, preview_buffer, x, y, width, height);
 
   if (preview)
     {
@@ -1485,15 +1586,15 @@ gauss (GimpDrawable *drawable,
 }
 
 static void
-transfer_pixels (const gdouble *src1,
-                 const gdouble *src2,
-                 guchar        *dest,
-                 gint           bytes,
-                 gint           width)
+transfer_pixels (const gfloat *src1,
+                 const gfloat *src2,
+                 guchar       *dest,
+                 gint          bytes,
+                 gint          width)
 {
-  gint    b;
-  gint    bend = bytes * width;
-  gdouble sum;
+  gint   b;
+  gint   bend = bytes * width;
+  gfloat sum;
 
   for (b = 0; b < bend; b++)
     {
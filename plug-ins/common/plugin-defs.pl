@@ -7,7 +7,7 @@
     'apply-canvas' => { ui => 1 },
     'blinds' => { ui => 1 },
     'blur' => {},
-    'blur-gauss' => { ui => 1 },
+    'blur-gauss' => { ui => 1, cflags => 'SSE2_EXTRA_CFLAGS' },
     'blur-gauss-selective' => { ui => 1, cflags => 'MMX_EXTRA_CFLAGS' },
     'blur-motion' => { ui => 1 },
     'border-average' => { ui => 1 },